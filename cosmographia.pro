@@ -39,6 +39,7 @@ APP_SOURCES = \
     $$MAIN_PATH/NumberFormat.cpp \
     $$MAIN_PATH/ObserverAction.cpp \
     $$MAIN_PATH/SkyLabelLayer.cpp \
+    $$MAIN_PATH/TilePrefetcher.cpp \
     $$MAIN_PATH/TleTrajectory.cpp \
     $$MAIN_PATH/TwoVectorFrame.cpp \
     $$MAIN_PATH/UnitConversion.cpp \
@@ -56,7 +57,9 @@ APP_SOURCES = \
     $$MAIN_PATH/astro/TASS17.cpp \
     $$MAIN_PATH/catalog/AstorbLoader.cpp \
     $$MAIN_PATH/catalog/BodyInfo.cpp \
+    $$MAIN_PATH/catalog/CatalogCache.cpp \
     $$MAIN_PATH/catalog/ChebyshevPolyFileLoader.cpp \
+    $$MAIN_PATH/catalog/JsonReader.cpp \
     $$MAIN_PATH/catalog/UniverseCatalog.cpp \
     $$MAIN_PATH/catalog/UniverseLoader.cpp \
     $$MAIN_PATH/geometry/FeatureLabelSetGeometry.cpp \
@@ -65,11 +68,16 @@ APP_SOURCES = \
     $$MAIN_PATH/geometry/SimpleTrajectoryGeometry.cpp \
     $$MAIN_PATH/geometry/StarGlobeGeometry.cpp \
     $$MAIN_PATH/geometry/TimeSwitchedGeometry.cpp \
+    $$MAIN_PATH/vext/ArchiveTiledMap.cpp \
+    $$MAIN_PATH/vext/AtmosphereCache.cpp \
     $$MAIN_PATH/vext/CompositeTrajectory.cpp \
     $$MAIN_PATH/vext/LocalTiledMap.cpp \
     $$MAIN_PATH/vext/NameTemplateTiledMap.cpp \
     $$MAIN_PATH/vext/PathRelativeTextureLoader.cpp \
     $$MAIN_PATH/vext/SimpleRotationModel.cpp \
+    $$MAIN_PATH/vext/TextureCompressor.cpp \
+    $$MAIN_PATH/vext/TileArchive.cpp \
+    $$MAIN_PATH/vext/TileManifest.cpp \
     $$MAIN_PATH/compatibility/CatalogParser.cpp \
     $$MAIN_PATH/compatibility/CelBodyFixedFrame.cpp \
     $$MAIN_PATH/compatibility/CmodLoader.cpp \
@@ -104,6 +112,7 @@ APP_HEADERS = \
     $$MAIN_PATH/NumberFormat.h \
     $$MAIN_PATH/ObserverAction.h \
     $$MAIN_PATH/SkyLabelLayer.h \
+    $$MAIN_PATH/TilePrefetcher.h \
     $$MAIN_PATH/TleTrajectory.h \
     $$MAIN_PATH/TwoVectorFrame.h \
     $$MAIN_PATH/UnitConversion.h \
@@ -122,7 +131,9 @@ APP_HEADERS = \
     $$MAIN_PATH/astro/TASS17.h \
     $$MAIN_PATH/catalog/AstorbLoader.h \
     $$MAIN_PATH/catalog/BodyInfo.h \
+    $$MAIN_PATH/catalog/CatalogCache.h \
     $$MAIN_PATH/catalog/ChebyshevPolyFileLoader.h \
+    $$MAIN_PATH/catalog/JsonReader.h \
     $$MAIN_PATH/catalog/UniverseCatalog.h \
     $$MAIN_PATH/catalog/UniverseLoader.h \
     $$MAIN_PATH/geometry/FeatureLabelSetGeometry.h \
@@ -131,13 +142,18 @@ APP_HEADERS = \
     $$MAIN_PATH/geometry/SimpleTrajectoryGeometry.h \
     $$MAIN_PATH/geometry/StarGlobeGeometry.h \
     $$MAIN_PATH/geometry/TimeSwitchedGeometry.h \
+    $$MAIN_PATH/vext/ArchiveTiledMap.h \
     $$MAIN_PATH/vext/ArcStripParticleGenerator.h \
+    $$MAIN_PATH/vext/AtmosphereCache.h \
     $$MAIN_PATH/vext/CompositeTrajectory.h \
     $$MAIN_PATH/vext/LocalTiledMap.h \
     $$MAIN_PATH/vext/NameTemplateTiledMap.h \
     $$MAIN_PATH/vext/PathRelativeTextureLoader.h \
     $$MAIN_PATH/vext/SimpleRotationModel.h \
     $$MAIN_PATH/vext/StripParticleGenerator.h \
+    $$MAIN_PATH/vext/TextureCompressor.h \
+    $$MAIN_PATH/vext/TileArchive.h \
+    $$MAIN_PATH/vext/TileManifest.h \
     $$MAIN_PATH/compatibility/CatalogParser.h \
     $$MAIN_PATH/compatibility/CelBodyFixedFrame.h \
     $$MAIN_PATH/compatibility/CmodLoader.h \
@@ -170,6 +186,7 @@ VESTA_SOURCES = \
     $$VESTA_PATH/ConeGeometry.cpp \
     $$VESTA_PATH/ConstellationsLayer.cpp \
     $$VESTA_PATH/CubeMapFramebuffer.cpp \
+    $$VESTA_PATH/CubeMapUpdateSchedule.cpp \
     $$VESTA_PATH/DataChunk.cpp \
     $$VESTA_PATH/DDSLoader.cpp \
     $$VESTA_PATH/Debug.cpp \
@@ -186,6 +203,7 @@ VESTA_SOURCES = \
     $$VESTA_PATH/HierarchicalTiledMap.cpp \
     $$VESTA_PATH/InertialFrame.cpp \
     $$VESTA_PATH/KeplerianTrajectory.cpp \
+    $$VESTA_PATH/LabelArbiter.cpp \
     $$VESTA_PATH/LabelGeometry.cpp \
     $$VESTA_PATH/LabelVisualizer.cpp \
     $$VESTA_PATH/LightSource.cpp \
@@ -212,6 +230,7 @@ VESTA_SOURCES = \
     $$VESTA_PATH/SkyImageLayer.cpp \
     $$VESTA_PATH/Spectrum.cpp \
     $$VESTA_PATH/StarCatalog.cpp \
+    $$VESTA_PATH/StarSkyIndex.cpp \
     $$VESTA_PATH/StarsLayer.cpp \
     $$VESTA_PATH/Submesh.cpp \
     $$VESTA_PATH/TextureFont.cpp \
@@ -233,8 +252,14 @@ VESTA_SOURCES = \
     $$VESTA_PATH/internal/DefaultFont.cpp \
     $$VESTA_PATH/internal/EclipseShadowVolumeSet.cpp \
     $$VESTA_PATH/internal/InputDataStream.cpp \
+    $$VESTA_PATH/internal/MappedFile.cpp \
     $$VESTA_PATH/internal/OutputDataStream.cpp \
-    $$VESTA_PATH/internal/ObjLoader.cpp
+    $$VESTA_PATH/internal/ObjLoader.cpp \
+    $$VESTA_PATH/internal/ShadowMapCache.cpp \
+    $$VESTA_PATH/internal/StarVertexStream.cpp \
+    $$VESTA_PATH/internal/TextBatch.cpp \
+    $$VESTA_PATH/internal/TileVertexCache.cpp \
+    $$VESTA_PATH/internal/VisibilitySet.cpp
 
 VESTA_HEADERS = \
     $$VESTA_PATH/AlignedEllipsoid.h \
@@ -254,6 +279,7 @@ VESTA_HEADERS = \
     $$VESTA_PATH/ConeGeometry.h \
     $$VESTA_PATH/ConstellationsLayer.h \
     $$VESTA_PATH/CubeMapFramebuffer.h \
+    $$VESTA_PATH/CubeMapUpdateSchedule.h \
     $$VESTA_PATH/DataChunk.h \
     $$VESTA_PATH/Debug.h \
     $$VESTA_PATH/DDSLoader.h \
@@ -275,6 +301,7 @@ VESTA_HEADERS = \
     $$VESTA_PATH/Intersect.h \
     $$VESTA_PATH/JavaCallbackTrajectory.h \
     $$VESTA_PATH/KeplerianTrajectory.h \
+    $$VESTA_PATH/LabelArbiter.h \
     $$VESTA_PATH/LabelGeometry.h \
     $$VESTA_PATH/LabelVisualizer.h \
     $$VESTA_PATH/LightSource.h \
@@ -310,6 +337,7 @@ VESTA_HEADERS = \
     $$VESTA_PATH/SkyLayer.h \
     $$VESTA_PATH/Spectrum.h \
     $$VESTA_PATH/StarCatalog.h \
+    $$VESTA_PATH/StarSkyIndex.h \
     $$VESTA_PATH/StarsLayer.h \
     $$VESTA_PATH/StateVector.h \
     $$VESTA_PATH/Submesh.h \
@@ -338,8 +366,14 @@ VESTA_HEADERS = \
     $$VESTA_PATH/internal/DefaultFont.h \
     $$VESTA_PATH/internal/EclipseShadowVolumeSet.h \
     $$VESTA_PATH/internal/InputDataStream.h \
+    $$VESTA_PATH/internal/MappedFile.h \
     $$VESTA_PATH/internal/OutputDataStream.h \
-    $$VESTA_PATH/internal/ObjLoader.h
+    $$VESTA_PATH/internal/ObjLoader.h \
+    $$VESTA_PATH/internal/ShadowMapCache.h \
+    $$VESTA_PATH/internal/StarVertexStream.h \
+    $$VESTA_PATH/internal/TextBatch.h \
+    $$VESTA_PATH/internal/TileVertexCache.h \
+    $$VESTA_PATH/internal/VisibilitySet.h
 
 
 ### particle system module ###
@@ -650,6 +684,18 @@ win32 {
     DEFINES += NOMINMAX
 }
 
+# OpenMP is used to parallelize atmosphere scattering table computation and
+# visibility determination. Where it's unavailable (e.g. Apple's compilers), that
+# work is done serially.
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+unix:!macx|win32-g++ {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+
 win32-msvc2008|win32-msvc2010 {
     # Disable MSVC's warnings about some standard C and C++ library
     # functions.
@@ -71,6 +71,7 @@
 #include <QDesktopServices>
 #include <QNetworkDiskCache>
 #include <QNetworkRequest>
+#include <QTimer>
 #include <QDeclarativeEngine>
 #include <QDeclarativeComponent>
 #include <QDeclarativeContext>
@@ -541,6 +542,19 @@ Cosmographia::initializeUniverse()
     m_universe->addEntity(sun);
 
     StarCatalog* stars = NULL;
+
+    // Prefer a starcat file (created from the star file by the starpack tool.) It's
+    // memory mapped, so the stars are read from disk only as they're drawn.
+    if (QFile::exists("tycho2.starcat"))
+    {
+        stars = StarCatalog::MapStarCat("tycho2.starcat");
+        if (stars)
+        {
+            m_universe->setStarCatalog(stars);
+            return;
+        }
+    }
+
     QFile starFile("tycho2.stars");
     if (starFile.open(QFile::ReadOnly))
     {
@@ -733,8 +747,19 @@ Cosmographia::initialize()
     // Set up the texture loader
     m_loader->setTextureLoader(dynamic_cast<PathRelativeTextureLoader*>(m_view3d->textureLoader()));
 
+    // Load mesh files in the background so that catalogs with large models don't
+    // freeze the user interface. Loaded meshes are picked up by a timer.
+    m_loader->setAsynchronousMeshLoadingEnabled(true);
+    QTimer* meshTimer = new QTimer(this);
+    connect(meshTimer, SIGNAL(timeout()), this, SLOT(processLoadedMeshes()));
+    meshTimer->start(100);
+
+    // Read the startup catalogs in parallel, then load them in order
+    m_loader->prefetchCatalogFiles(QStringList() << QFileInfo("solarsys.json").absoluteFilePath()
+                                                 << QFileInfo("start-viewpoints.json").absoluteFilePath());
     loadCatalogFile("solarsys.json");
     loadCatalogFile("start-viewpoints.json");
+    m_loader->clearPrefetchedFiles();
 
     loadGallery("gallery/gallery.json");
 
@@ -805,11 +830,21 @@ Cosmographia::initialize()
     {
         QString saveDir = QDir::currentPath();
         QDir::setCurrent(QCoreApplication::applicationDirPath());
+
+        QStringList catalogPaths;
         foreach (QString fileName, catalogLoadList)
         {
-            QFileInfo fileInfo(fileName);
-            loadCatalogFile(fileInfo.absoluteFilePath());
+            catalogPaths << QFileInfo(fileName).absoluteFilePath();
+        }
+
+        // Read all of the catalogs in parallel, then load them in order
+        m_loader->prefetchCatalogFiles(catalogPaths);
+        foreach (QString path, catalogPaths)
+        {
+            loadCatalogFile(path);
         }
+        m_loader->clearPrefetchedFiles();
+
         QDir::setCurrent(saveDir);
     }
 
@@ -1393,6 +1428,9 @@ Cosmographia::loadStarNamesFile(const QString &fileName, StarCatalog* starCatalo
             // could be specified for labels.
             QString spaceName = QString(" ") + name;
             starNamesLayer->addLabel(spaceName.toLatin1().data(), star->declination, star->RA, Spectrum(0.5f, 0.5f, 0.7f), minFov);
+
+            // Show the name when the star is picked
+            m_view3d->setStarName(star->identifier, name);
         }
     }
 
@@ -1665,6 +1703,23 @@ Cosmographia::loadGallery(const QString& fileName)
 }
 
 
+// Give meshes loaded in the background to the bodies waiting for them, and report
+// any errors that occurred while loading them.
+void
+Cosmographia::processLoadedMeshes()
+{
+    m_loader->clearMessageLog();
+    m_loader->processLoadedMeshes();
+
+    QString errorMessages = m_loader->messageLog();
+    if (!errorMessages.isEmpty())
+    {
+        m_loader->clearMessageLog();
+        showCatalogErrorDialog(errorMessages);
+    }
+}
+
+
 void
 Cosmographia::processReceivedResource(QNetworkReply* reply)
 {
@@ -110,6 +110,7 @@ private slots:
     void loadCatalog();
     void unloadLastCatalog();
     void copyStateUrlToClipboard();
+    void processLoadedMeshes();
 
 private:
     void initializeUniverse();
@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include "LocalImageLoader.h"
+#include "vext/ArchiveTiledMap.h"
+#include "vext/TextureCompressor.h"
 #include <QDebug>
 #include <QFileInfo>
 
@@ -20,7 +22,8 @@ using namespace vesta;
 
 
 LocalImageLoader::LocalImageLoader() :
-    m_searchPath(".")
+    m_searchPath("."),
+    m_compressTextures(0)
 {
 }
 
@@ -40,7 +43,11 @@ LocalImageLoader::loadTexture(TextureMap* texture)
 
         qDebug() << "loadTexture: " << textureName;
 
-        if (info.suffix() == "dds" || info.suffix() == "dxt5nm")
+        if (ArchiveTiledMap::isArchiveTileName(textureName))
+        {
+            loadArchiveTile(texture, textureName);
+        }
+        else if (info.suffix() == "dds" || info.suffix() == "dxt5nm")
         {
             // Handle DDS textures
             QFile ddsFile(textureName);
@@ -62,7 +69,7 @@ LocalImageLoader::loadTexture(TextureMap* texture)
             QImage image(textureName);
             if (!image.isNull())
             {
-                emit textureLoaded(texture, image);
+                imageLoaded(texture, image);
             }
             else
             {
@@ -73,6 +80,82 @@ LocalImageLoader::loadTexture(TextureMap* texture)
 }
 
 
+// Load a tile from a packed tile archive. The tile data is decoded directly from
+// the mapped archive file.
+void
+LocalImageLoader::loadArchiveTile(TextureMap* texture, const QString& tileName)
+{
+    ArchiveTiledMap::TileAddress address = ArchiveTiledMap::parseTileName(tileName);
+    QSharedPointer<TileArchive> archive;
+    if (address.valid)
+    {
+        archive = TileArchive::open(address.archiveFileName);
+    }
+
+    QByteArray data;
+    if (archive)
+    {
+        data = archive->tileData(address.level, address.column, address.row);
+    }
+
+    if (data.isEmpty())
+    {
+        emit textureLoadFailed(texture);
+    }
+    else if (archive->tileFormat() == TileArchive::DDSFormat)
+    {
+        emit ddsTextureLoaded(texture, new DataChunk(data.constData(), data.size()));
+    }
+    else
+    {
+        QImage image = QImage::fromData(reinterpret_cast<const uchar*>(data.constData()), data.size());
+        if (!image.isNull())
+        {
+            imageLoaded(texture, image);
+        }
+        else
+        {
+            emit textureLoadFailed(texture);
+        }
+    }
+}
+
+
+// Hand off a decoded image to the rendering thread. When texture compression is
+// enabled, mipmapped color textures are compressed here so that the rendering
+// thread only has to upload them.
+void
+LocalImageLoader::imageLoaded(TextureMap* texture, const QImage& image)
+{
+    const TextureProperties& properties = texture->properties();
+    if (isTextureCompressionEnabled() &&
+        properties.usage == TextureProperties::ColorTexture &&
+        properties.useMipmaps &&
+        TextureCompressor::canCompress(image))
+    {
+        DataChunk* ddsData = TextureCompressor::compress(image);
+        if (ddsData)
+        {
+            emit ddsTextureLoaded(texture, ddsData);
+            return;
+        }
+    }
+
+    emit textureLoaded(texture, image);
+}
+
+
+/** Enable or disable compression of loaded textures. Compression should only be
+  * enabled when the graphics hardware supports DXT compressed textures. This
+  * method may be called from any thread.
+  */
+void
+LocalImageLoader::setTextureCompressionEnabled(bool enabled)
+{
+    m_compressTextures.storeRelease(enabled ? 1 : 0);
+}
+
+
 void
 LocalImageLoader::setSearchPath(const QString& path)
 {
@@ -19,6 +19,7 @@
 #include <vesta/TextureMap.h>
 #include <QImage>
 #include <QObject>
+#include <QAtomicInt>
 
 
 /** LocalImageLoader handles loading of images from disk. It uses signals and slots
@@ -37,6 +38,13 @@ public:
         return m_searchPath;
     }
 
+    bool isTextureCompressionEnabled() const
+    {
+        return m_compressTextures.loadAcquire() != 0;
+    }
+
+    void setTextureCompressionEnabled(bool enabled);
+
 public slots:
     void loadTexture(vesta::TextureMap* texture);
     void setSearchPath(const QString& path);
@@ -54,8 +62,13 @@ signals:
       */
     void textureLoadFailed(vesta::TextureMap* texture);
 
+private:
+    void loadArchiveTile(vesta::TextureMap* texture, const QString& tileName);
+    void imageLoaded(vesta::TextureMap* texture, const QImage& image);
+
 private:
     QString m_searchPath;
+    QAtomicInt m_compressTextures;
 };
 
 #endif // _LOCAL_IMAGE_LOADER_H_
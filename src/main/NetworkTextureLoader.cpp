@@ -14,6 +14,7 @@
 
 #include "NetworkTextureLoader.h"
 #include "LocalImageLoader.h"
+#include "vext/ArchiveTiledMap.h"
 #include <vesta/DataChunk.h>
 #include <vesta/DDSLoader.h>
 #include <QFileInfo>
@@ -156,6 +157,11 @@ NetworkTextureLoader::resolveResourceName(const std::string& resourceName)
     {
         return resourceName;
     }
+    else if (ArchiveTiledMap::isArchiveTileName(QString::fromUtf8(resourceName.c_str())))
+    {
+        // Tiles from archives already contain the absolute path of the archive
+        return resourceName;
+    }
     else if (!resourceName.empty() && (resourceName.at(0) == ':' || resourceName.at(0) == '/' || isWindowsAbsolutePath))
     {
         // Either a Qt internal resource (prefix ':') or an absolute path (prefix '/')
@@ -354,3 +360,17 @@ NetworkTextureLoader::setLocalSearchPath(const QString& path)
         m_localImageLoader->setSearchPath(path);
     }
 }
+
+
+/** Enable or disable compression of loaded textures. When enabled, the image
+  * loading thread builds the mipmaps for color textures and compresses them to
+  * DXT format before they're handed to the rendering thread.
+  */
+void
+NetworkTextureLoader::setTextureCompressionEnabled(bool enabled)
+{
+    if (m_localImageLoader)
+    {
+        m_localImageLoader->setTextureCompressionEnabled(enabled);
+    }
+}
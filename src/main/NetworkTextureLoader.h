@@ -53,6 +53,8 @@ public:
     QString localSearchPath() const;
     void setLocalSearchPath(const QString& path);
 
+    void setTextureCompressionEnabled(bool enabled);
+
 public slots:
     void queueTexture(vesta::TextureMap* texture, const QImage& image);
     void queueTexture(vesta::TextureMap* texture, vesta::DataChunk* ddsData);
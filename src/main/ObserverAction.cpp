@@ -39,6 +39,21 @@ static double smoothstep2(double x)
 }
 
 
+// Get the fraction of an action's duration that has elapsed at the specified
+// time, clamped to [0, 1]. Actions with zero duration complete immediately.
+static double ActionProgress(double realTime, double startTime, double duration)
+{
+    if (duration == 0.0)
+    {
+        return 1.0;
+    }
+    else
+    {
+        return max(0.0, min(1.0, (realTime - startTime) / duration));
+    }
+}
+
+
 CenterObserverAction::CenterObserverAction(Observer* observer,
                                            Entity* target,
                                            double duration,
@@ -56,21 +71,20 @@ CenterObserverAction::CenterObserverAction(Observer* observer,
 }
 
 
+// Compute the absolute orientation of the observer at normalized time t.
+Quaterniond
+CenterObserverAction::orientationAt(double t) const
+{
+    return m_startOrientation.slerp(smoothstep(t), m_finalOrientation);
+}
+
+
 bool
 CenterObserverAction::updateObserver(Observer* observer, double realTime, double simTime)
 {
-    double t;
-    if (m_duration == 0.0)
-    {
-        t = 1.0;
-    }
-    else
-    {
-        t = min(1.0, (realTime - m_startTime) / m_duration);
-    }
-    t = smoothstep(t);
+    double t = ActionProgress(realTime, m_startTime, m_duration);
 
-    Quaterniond q = m_startOrientation.slerp(t, m_finalOrientation);
+    Quaterniond q = orientationAt(t);
     q = observer->pointingFrame()->orientation(simTime).conjugate() * q;
     observer->setOrientation(q);
 
@@ -78,6 +92,17 @@ CenterObserverAction::updateObserver(Observer* observer, double realTime, double
 }
 
 
+bool
+CenterObserverAction::predictObserver(const Observer* observer, double realTime, double simTime,
+                                      Vector3d* position, Quaterniond* orientation) const
+{
+    *position = observer->absolutePosition(simTime);
+    *orientation = orientationAt(ActionProgress(realTime, m_startTime, m_duration));
+
+    return true;
+}
+
+
 template<class T>
 static double SolveBisection(const T& f, double lower, double upper, double tolerance)
 {
@@ -210,18 +235,12 @@ GotoObserverAction::GotoObserverAction(Observer* observer,
 }
 
 
-bool
-GotoObserverAction::updateObserver(Observer* observer, double realTime, double simTime)
+// Compute the absolute position and orientation of the observer at the specified
+// time. The return value is the normalized time in the interval [0, 1].
+double
+GotoObserverAction::interpolate(double realTime, double simTime, Vector3d* position, Quaterniond* orientation) const
 {
-    double t;
-    if (m_duration == 0.0)
-    {
-        t = 1.0;
-    }
-    else
-    {
-        t = min(1.0, (realTime - m_startTime) / m_duration);
-    }
+    double t = ActionProgress(realTime, m_startTime, m_duration);
 
     Vector3d targetPosition = m_target->position(simTime);
     Vector3d startToTarget = targetPosition - m_startPosition;
@@ -234,12 +253,22 @@ GotoObserverAction::updateObserver(Observer* observer, double realTime, double s
     // Interpolation factor for position
     double pt = smoothStepExp(t, 0.1 / travelDistance, 0.5);
 
-    Quaterniond q = m_startOrientation.slerp(rt, m_finalOrientation);
-    q = observer->pointingFrame()->orientation(simTime).conjugate() * q;
-    observer->setOrientation(q);
+    *orientation = m_startOrientation.slerp(rt, m_finalOrientation);
+    *position = m_startPosition + (pt * (travelDistance / distanceFromStart)) * startToTarget;
+
+    return t;
+}
+
 
+bool
+GotoObserverAction::updateObserver(Observer* observer, double realTime, double simTime)
+{
+    Vector3d currentPosition;
+    Quaterniond q;
+    double t = interpolate(realTime, simTime, &currentPosition, &q);
 
-    Vector3d currentPosition = m_startPosition + (pt * (travelDistance / distanceFromStart)) * startToTarget;
+    q = observer->pointingFrame()->orientation(simTime).conjugate() * q;
+    observer->setOrientation(q);
 
     // Transform the current position into the observer frame
     Vector3d p = currentPosition - observer->center()->position(simTime);
@@ -257,6 +286,15 @@ GotoObserverAction::updateObserver(Observer* observer, double realTime, double s
 }
 
 
+bool
+GotoObserverAction::predictObserver(const Observer* /* observer */, double realTime, double simTime,
+                                    Vector3d* position, Quaterniond* orientation) const
+{
+    interpolate(realTime, simTime, position, orientation);
+    return true;
+}
+
+
 /** OrbitGoto is a specialized observer action that does the following:
   *   - Zooms away from the current center object
   *   - Orients the observer to point at the target
@@ -294,57 +332,106 @@ OrbitGotoObserverAction::OrbitGotoObserverAction(Observer* observer,
 }
 
 
-bool
-OrbitGotoObserverAction::updateObserver(Observer* observer, double realTime, double simTime)
+// Compute the position of the observer at normalized time t, relative to the
+// center object and in the observer's position frame. currentPosition is the
+// observer's present position (used only for direction in the first phase),
+// and startPosition and startDistance give the position where the second phase
+// begins, relative to the target.
+Vector3d
+OrbitGotoObserverAction::relativePosition(double t,
+                                          const Vector3d& currentPosition,
+                                          const Vector3d& startPosition,
+                                          double startDistance) const
 {
-    double t;
-    if (m_duration == 0.0)
-    {
-        t = 1.0;
-    }
-    else
-    {
-        t = min(1.0, (realTime - m_startTime) / m_duration);
-    }
-
-    Vector3d targetPosition = m_target->position(simTime);
-
     if (t <= 0.5)
     {
         double u = smoothStepExp(t * 2, 0.1 / m_startDistance, 0.5);
         double distance = (1.0 - u) * m_startDistance + u * m_finalDistanceFromTarget * 0.1;
-        observer->setPosition(observer->position().normalized() * distance);
+        return currentPosition.normalized() * distance;
     }
     else
     {
-        if (!m_switchedFrames)
-        {
-            // Switch to the target frame
-            observer->updateCenter(m_target.ptr(), simTime);
-            m_startPosition = observer->position();
-            m_startDistance = observer->position().norm();
-            m_up = observer->absoluteOrientation(simTime) * Vector3d::UnitY();
-            m_switchedFrames = true;
-        }
-
         double u = smoothstep2((t - 0.5) * 2);
-        double distance = (1.0 - u) * m_startDistance + u * m_finalDistanceFromTarget;
+        double distance = (1.0 - u) * startDistance + u * m_finalDistanceFromTarget;
         Vector3d finalPosition = InertialFrame::eclipticJ2000()->orientation() * Vector3d::UnitZ() * m_finalDistanceFromTarget;
-        Vector3d v0 = m_startPosition.normalized();
+        Vector3d v0 = startPosition.normalized();
         Vector3d v1 = finalPosition.normalized();
         Vector3d w = slerp(u, v0, v1);
-        observer->setPosition(distance * w);
+        return distance * w;
     }
+}
+
 
+// Compute the absolute orientation of the observer at normalized time t, given
+// the absolute positions of the observer and the target.
+Quaterniond
+OrbitGotoObserverAction::orientationAt(double t, const Vector3d& absolutePosition, const Vector3d& targetPosition) const
+{
     double rt = smoothstep2(min(1.0, t * 4.0));
     Vector3d up = Vector3d::UnitZ();
-    Quaterniond finalOrientation = LookRotation(observer->absolutePosition(simTime),
+    Quaterniond finalOrientation = LookRotation(absolutePosition,
                                                 targetPosition,
                                                 up);
 
-    Quaterniond q = m_startOrientation.slerp(rt, finalOrientation);
+    return m_startOrientation.slerp(rt, finalOrientation);
+}
+
+
+bool
+OrbitGotoObserverAction::updateObserver(Observer* observer, double realTime, double simTime)
+{
+    double t = ActionProgress(realTime, m_startTime, m_duration);
+
+    Vector3d targetPosition = m_target->position(simTime);
+
+    if (t > 0.5 && !m_switchedFrames)
+    {
+        // Switch to the target frame
+        observer->updateCenter(m_target.ptr(), simTime);
+        m_startPosition = observer->position();
+        m_startDistance = observer->position().norm();
+        m_up = observer->absoluteOrientation(simTime) * Vector3d::UnitY();
+        m_switchedFrames = true;
+    }
+
+    observer->setPosition(relativePosition(t, observer->position(), m_startPosition, m_startDistance));
+
+    Quaterniond q = orientationAt(t, observer->absolutePosition(simTime), targetPosition);
     q = observer->pointingFrame()->orientation(simTime).conjugate() * q;
     observer->setOrientation(q);
 
     return t >= 1.0;
 }
+
+
+bool
+OrbitGotoObserverAction::predictObserver(const Observer* observer, double realTime, double simTime,
+                                         Vector3d* position, Quaterniond* orientation) const
+{
+    double t = ActionProgress(realTime, m_startTime, m_duration);
+
+    Vector3d targetPosition = m_target->position(simTime);
+    Quaterniond frameOrientation = observer->positionFrame()->orientation(simTime);
+    Vector3d centerPosition = observer->center()->position(simTime);
+
+    Vector3d startPosition = m_startPosition;
+    double startDistance = m_startDistance;
+    if (t > 0.5)
+    {
+        if (!m_switchedFrames)
+        {
+            // The frame switch hasn't happened yet. Estimate where it will occur: at the
+            // end of the first phase, the observer is at a tenth of the final distance
+            // from the current center.
+            Vector3d switchPosition = centerPosition + frameOrientation * relativePosition(0.5, observer->position(), startPosition, startDistance);
+            startPosition = frameOrientation.conjugate() * (switchPosition - targetPosition);
+            startDistance = startPosition.norm();
+        }
+        centerPosition = targetPosition;
+    }
+
+    *position = centerPosition + frameOrientation * relativePosition(t, observer->position(), startPosition, startDistance);
+    *orientation = orientationAt(t, *position, targetPosition);
+
+    return true;
+}
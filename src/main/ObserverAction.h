@@ -28,6 +28,29 @@ public:
     }
 
     virtual bool updateObserver(vesta::Observer* observer, double realTime, double simTime) = 0;
+
+    /** Compute the absolute position and orientation that this action will give
+      * the observer at some (usually future) time, without modifying either the
+      * observer or the action. The default implementation can't make a prediction.
+      *
+      * \return true if the position and orientation were computed
+      */
+    virtual bool predictObserver(const vesta::Observer* /* observer */,
+                                 double /* realTime */,
+                                 double /* simTime */,
+                                 Eigen::Vector3d* /* position */,
+                                 Eigen::Quaterniond* /* orientation */) const
+    {
+        return false;
+    }
+
+    /** Get the object that the observer is traveling to, or null if the action
+      * has no target.
+      */
+    virtual vesta::Entity* target() const
+    {
+        return NULL;
+    }
 };
 
 
@@ -38,6 +61,11 @@ public:
 
     CenterObserverAction(vesta::Observer* observer, vesta::Entity* target, double duration, double realTime, double simulationTime);
     virtual bool updateObserver(vesta::Observer* observer, double realTime, double simTime);
+    virtual bool predictObserver(const vesta::Observer* observer, double realTime, double simTime,
+                                 Eigen::Vector3d* position, Eigen::Quaterniond* orientation) const;
+
+private:
+    Eigen::Quaterniond orientationAt(double t) const;
 
 private:
     double m_duration;
@@ -59,11 +87,16 @@ public:
                        double simulationTime,
                        double finalDistanceFromTarget);
     virtual bool updateObserver(vesta::Observer* observer, double realTime, double simTime);
-    vesta::Entity* target() const
+    virtual bool predictObserver(const vesta::Observer* observer, double realTime, double simTime,
+                                 Eigen::Vector3d* position, Eigen::Quaterniond* orientation) const;
+    virtual vesta::Entity* target() const
     {
         return m_target.ptr();
     }
 
+private:
+    double interpolate(double realTime, double simTime, Eigen::Vector3d* position, Eigen::Quaterniond* orientation) const;
+
 private:
     double m_duration;
     double m_startTime;
@@ -88,11 +121,22 @@ public:
                        double simulationTime,
                        double finalDistanceFromTarget);
     virtual bool updateObserver(vesta::Observer* observer, double realTime, double simTime);
-    vesta::Entity* target() const
+    virtual bool predictObserver(const vesta::Observer* observer, double realTime, double simTime,
+                                 Eigen::Vector3d* position, Eigen::Quaterniond* orientation) const;
+    virtual vesta::Entity* target() const
     {
         return m_target.ptr();
     }
 
+private:
+    Eigen::Vector3d relativePosition(double t,
+                                     const Eigen::Vector3d& currentPosition,
+                                     const Eigen::Vector3d& startPosition,
+                                     double startDistance) const;
+    Eigen::Quaterniond orientationAt(double t,
+                                     const Eigen::Vector3d& absolutePosition,
+                                     const Eigen::Vector3d& targetPosition) const;
+
 private:
     double m_duration;
     double m_startTime;
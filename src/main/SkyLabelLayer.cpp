@@ -68,7 +68,15 @@ SkyLabelLayer::render(vesta::RenderContext& rc)
 
                 rc.pushModelView();
                 rc.translateModelView(label.position);
-                rc.drawEncodedText(Vector3f::Zero(), label.text, m_font.ptr(), TextureFont::Utf8, color, m_opacity);
+
+                // Sky labels yield to the labels of nearby objects; among themselves, labels
+                // that remain visible in wider fields of view take precedence.
+                float priority = -1.0f + label.minimumFov / (label.minimumFov + 1.0f);
+                float opacity = m_opacity * rc.arbitrateLabel(this, iter - m_labels.begin(), Vector3f::Zero(), label.text, m_font.ptr(), TextureFont::Utf8, 0.0f, priority);
+                if (opacity > 0.0f)
+                {
+                    rc.drawEncodedText(Vector3f::Zero(), label.text, m_font.ptr(), TextureFont::Utf8, color, opacity);
+                }
                 rc.popModelView();
             }
         }
@@ -0,0 +1,221 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TilePrefetcher.h"
+#include "ObserverAction.h"
+#include <vesta/WorldGeometry.h>
+#include <vesta/Frame.h>
+#include <vesta/Units.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+// Number of predicted views generated per frame. They're spaced evenly over the
+// look ahead interval.
+static const unsigned int PredictionSteps = 2;
+
+// Don't estimate velocity from updates that are very close together in time.
+static const double MinimumVelocityInterval = 1.0e-3;
+
+
+TilePrefetcher::TilePrefetcher() :
+    m_enabled(true),
+    m_lookAheadTime(1.5),
+    m_maxRequestsPerFrame(8),
+    m_hasPreviousState(false),
+    m_previousRealTime(0.0),
+    m_previousPosition(Vector3d::Zero()),
+    m_previousOrientation(Quaterniond::Identity())
+{
+}
+
+
+TilePrefetcher::~TilePrefetcher()
+{
+}
+
+
+void
+TilePrefetcher::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!enabled)
+    {
+        reset();
+    }
+}
+
+
+void
+TilePrefetcher::setLookAheadTime(double seconds)
+{
+    m_lookAheadTime = max(0.0, seconds);
+}
+
+
+void
+TilePrefetcher::setMaxRequestsPerFrame(unsigned int maxRequests)
+{
+    m_maxRequestsPerFrame = maxRequests;
+}
+
+
+/** Forget the observer's motion history. This should be called whenever the
+  * observer jumps discontinuously (e.g. when a viewpoint is restored.)
+  */
+void
+TilePrefetcher::reset()
+{
+    m_hasPreviousState = false;
+    m_previousCenter = NULL;
+}
+
+
+/** Predict the observer's position over the look ahead interval and queue
+  * the surface tiles that will be needed there.
+  *
+  * \param observer the observer used for the current frame
+  * \param action the active observer action, or null if there is none
+  * \param realTime the real time used for observer actions
+  * \param simTime the current simulation time
+  * \param simTimeRate rate at which simulation time advances relative to real time
+  * \param fovY vertical field of view in radians
+  * \param viewport the viewport of the main view
+  *
+  * \return the number of tiles newly added to the prefetch queue
+  */
+unsigned int
+TilePrefetcher::update(const Observer* observer,
+                       const ObserverAction* action,
+                       double realTime,
+                       double simTime,
+                       double simTimeRate,
+                       float fovY,
+                       const Viewport& viewport)
+{
+    Entity* center = observer->center();
+    if (!m_enabled || !center || viewport.height() == 0)
+    {
+        return 0;
+    }
+
+    Vector3d position = observer->absolutePosition(simTime) - center->position(simTime);
+    Quaterniond orientation = observer->absoluteOrientation(simTime);
+
+    // Estimate the observer's linear and angular velocity relative to the center
+    // object. Tracking the position relative to the center keeps the prediction
+    // stable when the observer is following an orbiting body.
+    Vector3d velocity = Vector3d::Zero();
+    AngleAxisd angularVelocity(0.0, Vector3d::UnitZ());
+    double dt = realTime - m_previousRealTime;
+    bool haveVelocity = m_hasPreviousState && m_previousCenter.ptr() == center && dt > MinimumVelocityInterval;
+    if (haveVelocity)
+    {
+        velocity = (position - m_previousPosition) / dt;
+        angularVelocity = AngleAxisd(orientation * m_previousOrientation.conjugate());
+        if (angularVelocity.angle() > PI)
+        {
+            angularVelocity.angle() -= 2 * PI;
+        }
+        angularVelocity.angle() /= dt;
+    }
+
+    if (!m_hasPreviousState || dt > MinimumVelocityInterval || m_previousCenter.ptr() != center)
+    {
+        m_hasPreviousState = true;
+        m_previousRealTime = realTime;
+        m_previousCenter = center;
+        m_previousPosition = position;
+        m_previousOrientation = orientation;
+    }
+
+    // Nothing to predict if the observer isn't moving
+    if (!action && velocity.isZero() && angularVelocity.angle() == 0.0)
+    {
+        return 0;
+    }
+
+    float pixelSize = float(2.0 * tan(fovY / 2.0) / viewport.height());
+    PlanarProjection projection = PlanarProjection::CreatePerspective(fovY, viewport.aspectRatio(), 0.00001f, 1.0e12f);
+
+    // Predicted views are visited in order of increasing time so that the most
+    // urgently needed tiles are requested first.
+    unsigned int requestCount = 0;
+    for (unsigned int step = 1; step <= PredictionSteps && requestCount < m_maxRequestsPerFrame; ++step)
+    {
+        double lookAhead = m_lookAheadTime * double(step) / double(PredictionSteps);
+        double predictedSimTime = simTime + lookAhead * simTimeRate;
+
+        Vector3d predictedPosition;
+        Quaterniond predictedOrientation;
+        Entity* target = NULL;
+        if (action && action->predictObserver(observer, realTime + lookAhead, predictedSimTime, &predictedPosition, &predictedOrientation))
+        {
+            target = action->target();
+        }
+        else
+        {
+            predictedPosition = center->position(predictedSimTime) + position + velocity * lookAhead;
+            predictedOrientation = AngleAxisd(angularVelocity.angle() * lookAhead, angularVelocity.axis()) * orientation;
+        }
+
+        requestCount += prefetchView(center, predictedPosition, predictedOrientation, predictedSimTime,
+                                     projection, pixelSize, m_maxRequestsPerFrame - requestCount);
+        if (target && target != center)
+        {
+            requestCount += prefetchView(target, predictedPosition, predictedOrientation, predictedSimTime,
+                                         projection, pixelSize, m_maxRequestsPerFrame - requestCount);
+        }
+    }
+
+    return requestCount;
+}
+
+
+// Request the surface tiles of a body that will be visible from the specified
+// position and orientation.
+unsigned int
+TilePrefetcher::prefetchView(Entity* body,
+                             const Vector3d& position,
+                             const Quaterniond& orientation,
+                             double simTime,
+                             const PlanarProjection& projection,
+                             float pixelSize,
+                             unsigned int maxRequests) const
+{
+    if (maxRequests == 0 || !body->isVisible(simTime))
+    {
+        return 0;
+    }
+
+    WorldGeometry* world = dynamic_cast<WorldGeometry*>(body->geometry());
+    if (!world)
+    {
+        return 0;
+    }
+
+    // Transform the predicted camera into the body-fixed frame of the world
+    Quaterniond bodyOrientation = body->orientation(simTime);
+    Vector3d eyePosition = bodyOrientation.conjugate() * (position - body->position(simTime));
+    Quaterniond cameraOrientation = bodyOrientation.conjugate() * orientation;
+
+    return world->prefetchTiles(eyePosition.cast<float>(), cameraOrientation.cast<float>(),
+                                projection, pixelSize, maxRequests);
+}
@@ -0,0 +1,105 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _TILE_PREFETCHER_H_
+#define _TILE_PREFETCHER_H_
+
+#include <vesta/Observer.h>
+#include <vesta/Viewport.h>
+#include <vesta/PlanarProjection.h>
+#include <Eigen/Geometry>
+
+class ObserverAction;
+
+
+/** TilePrefetcher starts loading planet surface tiles before they're needed.
+  * Each frame, it predicts where the observer will be over the next second or
+  * two, either from an active observer action (such as a goto) or by
+  * extrapolating the observer's recent motion. The surface quadtrees of nearby
+  * worlds are tessellated for the predicted views, and the tiles that those
+  * views would draw are added to the texture loader's prefetch queue.
+  *
+  * Prefetching should be done after the frame has been rendered so that tiles
+  * needed for the current view are always requested first. Queued tiles are
+  * loaded by TextureMapLoader::issuePrefetches().
+  */
+class TilePrefetcher
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    TilePrefetcher();
+    ~TilePrefetcher();
+
+    bool isEnabled() const
+    {
+        return m_enabled;
+    }
+
+    void setEnabled(bool enabled);
+
+    /** Get how far ahead (in seconds of real time) the observer position is
+      * predicted.
+      */
+    double lookAheadTime() const
+    {
+        return m_lookAheadTime;
+    }
+
+    void setLookAheadTime(double seconds);
+
+    /** Get the maximum number of new tile loads that will be requested in a frame.
+      */
+    unsigned int maxRequestsPerFrame() const
+    {
+        return m_maxRequestsPerFrame;
+    }
+
+    void setMaxRequestsPerFrame(unsigned int maxRequests);
+
+    unsigned int update(const vesta::Observer* observer,
+                        const ObserverAction* action,
+                        double realTime,
+                        double simTime,
+                        double simTimeRate,
+                        float fovY,
+                        const vesta::Viewport& viewport);
+    void reset();
+
+private:
+    unsigned int prefetchView(vesta::Entity* body,
+                              const Eigen::Vector3d& position,
+                              const Eigen::Quaterniond& orientation,
+                              double simTime,
+                              const vesta::PlanarProjection& projection,
+                              float pixelSize,
+                              unsigned int maxRequests) const;
+
+private:
+    bool m_enabled;
+    double m_lookAheadTime;
+    unsigned int m_maxRequestsPerFrame;
+
+    // Observer state from the previous update, used to estimate velocity. The position
+    // is relative to the observer's center object.
+    bool m_hasPreviousState;
+    double m_previousRealTime;
+    vesta::counted_ptr<vesta::Entity> m_previousCenter;
+    Eigen::Vector3d m_previousPosition;
+    Eigen::Quaterniond m_previousOrientation;
+};
+
+#endif // _TILE_PREFETCHER_H_
@@ -17,6 +17,7 @@
 #define TEST_SIMPLE_TRAJECTORY 0
 
 #include <cmath>
+#include <algorithm>
 
 #include <QGLWidget>
 
@@ -24,6 +25,7 @@
 #include "UniverseView.h"
 #include "MarkerLayer.h"
 #include "GalleryView.h"
+#include "TilePrefetcher.h"
 #include "UnitConversion.h"
 
 #include "ObserverAction.h"
@@ -67,6 +69,7 @@
 #include <vesta/NadirVisualizer.h>
 #include <vesta/BodyDirectionVisualizer.h>
 #include <vesta/LabelVisualizer.h>
+#include <vesta/LabelArbiter.h>
 #include <vesta/TrajectoryGeometry.h>
 #include <vesta/TextureFont.h>
 #include <vesta/DataChunk.h>
@@ -80,6 +83,7 @@
 #include <vesta/interaction/ObserverController.h>
 
 #include <vesta/CubeMapFramebuffer.h>
+#include <vesta/glhelp/GLShaderProgram.h>
 
 #include <vesta/ParticleSystemGeometry.h>
 #include <vesta/particlesys/ParticleEmitter.h>
@@ -127,6 +131,12 @@ static const double KeyboardRotationAcceleration = 3.5;
 static const unsigned int ShadowMapSize = 2048;
 static const unsigned int ReflectionMapSize = 512;
 
+// The reflection map is updated a few faces at a time; all faces are redrawn at
+// once only after the observer jumps a long distance.
+static const unsigned int ReflectionFacesPerFrame = 2;
+static const double ReflectionMapMoveThreshold = 0.001;  // 1 meter
+static const double ReflectionMapJumpThreshold = 100.0;  // 100 km
+
 static double StartOfTime = GregorianDate(1800, 1, 1, 13, 0, 0, 0, TimeScale_TDB).toTDBSec();
 static double EndOfTime   = GregorianDate(2100, 1, 1, 0, 0, 0, 0, TimeScale_TDB).toTDBSec();
 
@@ -139,6 +149,9 @@ static const double StatusMessageDuration = 2.5;
 
 static const float CenterMarkerSize = 10.0f;
 
+// Maximum distance in pixels between a click and the star that it selects
+static const double StarPickRadius = 5.0;
+
 static const bool ShowTimeInVideos = true;
 
 #ifdef LEO3D_SUPPORT
@@ -408,6 +421,9 @@ UniverseView::UniverseView(QWidget *parent, Universe* universe, UniverseCatalog*
     m_frameCount(0),
     m_frameCountStartTime(0.0),
     m_framesPerSecond(0.0),
+    m_frameTimeTotal(0.0),
+    m_frameStatisticsVisible(false),
+    m_reflectionSchedule(ReflectionFacesPerFrame),
     m_reflectionsEnabled(false),
     m_stereoMode(Mono),
     m_antialiasingSamples(1),
@@ -427,6 +443,7 @@ UniverseView::UniverseView(QWidget *parent, Universe* universe, UniverseCatalog*
     m_statusUpdateTime(0.0),
     m_markers(NULL),
     m_galleryView(NULL),
+    m_tilePrefetcher(NULL),
     m_earthMapMonth(1),
     m_leoState(NULL)
 {
@@ -438,6 +455,9 @@ UniverseView::UniverseView(QWidget *parent, Universe* universe, UniverseCatalog*
     m_renderer = new UniverseRenderer();
     m_renderer->setDefaultSunEnabled(false);
 
+    m_labelArbiter = new LabelArbiter();
+    m_renderer->setLabelArbiter(m_labelArbiter.ptr());
+
     m_labelFont = new TextureFont();
     m_textFont = new TextureFont();
     m_titleFont = new TextureFont();
@@ -450,6 +470,8 @@ UniverseView::UniverseView(QWidget *parent, Universe* universe, UniverseCatalog*
     m_galleryView->setScale(1.0f);
     m_galleryView->setFont(m_textFont.ptr());
 
+    m_tilePrefetcher = new TilePrefetcher();
+
     // Enable multisample antialiasing if its enabled in the settings
     {
         QSettings settings;
@@ -509,6 +531,7 @@ UniverseView::~UniverseView()
 {
     //makeCurrent();
     delete m_galleryView;
+    delete m_tilePrefetcher;
     delete m_renderer;
 }
 
@@ -554,7 +577,7 @@ static void
 setLabelFadeRange(LabelGeometry* label, Entity* body, const BodyInfo* info, vesta::Arc* arc, double fadeSize)
 {
     float geometrySize = 1.0f;
-    if (body->geometry())
+    if (body->geometry() && body->geometry()->boundingSphereRadius() > 0.0f)
     {
         geometrySize = body->geometry()->boundingSphereRadius();
     }
@@ -582,6 +605,40 @@ setLabelFadeRange(LabelGeometry* label, Entity* body, const BodyInfo* info, vest
 }
 
 
+// Set the priority of a label when it overlaps other labels. Labels of more prominent
+// classes of objects win over others; within a class, the larger label wins.
+static void
+setLabelPriority(LabelGeometry* label, const BodyInfo* info)
+{
+    float priority = 2.0f;
+    if (info)
+    {
+        switch (info->classification)
+        {
+        case BodyInfo::Star:
+            priority = 6.0f;
+            break;
+        case BodyInfo::Planet:
+            priority = 5.0f;
+            break;
+        case BodyInfo::DwarfPlanet:
+            priority = 4.0f;
+            break;
+        case BodyInfo::Satellite:
+            priority = 3.0f;
+            break;
+        case BodyInfo::Asteroid:
+            priority = 1.0f;
+            break;
+        default:
+            break;
+        }
+    }
+
+    label->setLabelPriority(priority);
+}
+
+
 static Visualizer*
 labelBody(Entity* planet, const BodyInfo* info, const QString& labelText, TextureFont* font, TextureMap* icon, const Spectrum& color, double fadeSize, bool visible)
 {
@@ -624,6 +681,7 @@ labelBody(Entity* planet, const BodyInfo* info, const QString& labelText, Textur
             label->label()->setIcon(icon);
             label->label()->setIconColor(color);
             setLabelFadeRange(label->label(), planet, info, arc, fadeSize);
+            setLabelPriority(label->label(), info);
             multiLabel->addLabel(startTime, label);
             startTime += arc->duration();
         }
@@ -636,6 +694,7 @@ labelBody(Entity* planet, const BodyInfo* info, const QString& labelText, Textur
         labelVis->label()->setIcon(icon);
         labelVis->label()->setIconColor(color);
         setLabelFadeRange(labelVis->label(), planet, info, planet->chronology()->firstArc(), fadeSize);
+        setLabelPriority(labelVis->label(), info);
         vis = labelVis;
     }
 
@@ -686,6 +745,15 @@ void UniverseView::initializeGL()
     }
 #endif
 
+    // Compressing textures in the loading thread saves graphics memory at some cost
+    // in image quality, so it's off unless enabled in the settings (and supported by
+    // the hardware.)
+    {
+        QSettings settings;
+        bool compress = settings.value("TextureCompression", false).toBool();
+        m_textureLoader->setTextureCompressionEnabled(compress && TextureMap::IsFormatSupported(TextureMap::DXT1));
+    }
+
     m_spacecraftIcon->makeResident();
 
     glShadeModel(GL_FLAT);
@@ -735,6 +803,9 @@ void UniverseView::initializeGL()
     if (CubeMapFramebuffer::supported())
     {
         m_reflectionMap = CubeMapFramebuffer::CreateCubicReflectionMap(ReflectionMapSize, TextureMap::R8G8B8A8);
+        m_reflectionSchedule.setMoveThreshold(ReflectionMapMoveThreshold);
+        m_reflectionSchedule.setJumpThreshold(ReflectionMapJumpThreshold);
+        m_reflectionSchedule.invalidate();
     }
 
     m_glareOverlay = m_renderer->createGlareOverlay();
@@ -1257,6 +1328,14 @@ UniverseView::drawInfoOverlay()
             m_textFont->render(texMemString.toLatin1().data(), Vector2f(viewportWidth - 200.0f, 10.0f));
             */
 
+            if (m_frameStatisticsVisible)
+            {
+                std::string frameRateString = QString("%1 fps").arg(m_framesPerSecond, 0, 'f', 1).toLatin1().data();
+                std::string statisticsString = m_frameStatistics.toLatin1().data();
+                m_textFont->render(frameRateString, Vector2f(viewportWidth - m_textFont->textWidth(frameRateString) - 10.0f, 30.0f));
+                m_textFont->render(statisticsString, Vector2f(viewportWidth - m_textFont->textWidth(statisticsString) - 10.0f, 10.0f));
+            }
+
             // Display information about the selection
             if (m_selectedBody.isValid())
             {
@@ -1497,6 +1576,28 @@ void UniverseView::paintGL()
     else if (elapsedTime - m_frameCountStartTime > 1.0)
     {
         m_framesPerSecond = m_frameCount / (elapsedTime - m_frameCountStartTime);
+
+        // Average the cost of drawing the scene over the same interval. The times are
+        // measured on the CPU and don't include time that the GPU spends catching up.
+        const UniverseRenderer::RenderStatistics& stats = m_renderer->statistics();
+        double frames = double(m_frameCount);
+        m_frameStatistics = QString("%1 ms/frame, %2 reflection faces, %3 shadow maps (%4 reused), %5 shadow cube faces (%6 reused), ")
+                            .arg(m_frameTimeTotal * 1000.0 / frames, 0, 'f', 2)
+                            .arg(stats.cubeMapFaceCount / frames, 0, 'f', 1)
+                            .arg(stats.shadowMapsRendered / frames, 0, 'f', 1)
+                            .arg(stats.shadowMapsReused / frames, 0, 'f', 1)
+                            .arg(stats.omniShadowFacesRendered / frames, 0, 'f', 1)
+                            .arg(stats.omniShadowFacesReused / frames, 0, 'f', 1);
+        m_frameStatistics += QString("%1 uniforms (%2 skipped), %3 draws, %4 materials (%5 skipped)")
+                            .arg(GLShaderProgram::uniformUploadCount() / frames, 0, 'f', 0)
+                            .arg(GLShaderProgram::skippedUniformUploadCount() / frames, 0, 'f', 0)
+                            .arg(stats.drawCallCount / frames, 0, 'f', 0)
+                            .arg(stats.materialUpdateCount / frames, 0, 'f', 0)
+                            .arg(stats.materialUpdatesSkipped / frames, 0, 'f', 0);
+        m_renderer->resetStatistics();
+        GLShaderProgram::resetUniformStatistics();
+        m_frameTimeTotal = 0.0;
+
         m_frameCount = 0;
         m_frameCountStartTime = elapsedTime;
     }
@@ -1515,6 +1616,7 @@ void UniverseView::paintGL()
         m_glareOverlay->setGlareSize(max(width(), height()) / 20.0f);
     }
 
+    m_labelArbiter->beginFrame(secondsFromBaseTime());
     m_renderer->beginViewSet(m_universe.ptr(), m_simulationTime);
 
     if (m_reflectionsEnabled && !m_reflectionMap.isNull())
@@ -1527,9 +1629,16 @@ void UniverseView::paintGL()
         m_renderer->setSkyLayersEnabled(false);
 
         // Set the near clip plane distance to 1km so that only distant objects are drawn
-        // into the reflection map.
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        m_renderer->renderCubeMap(NULL, reflectionCenter, m_reflectionMap.ptr(), 1.0f);
+        // into the reflection map. Because everything in the map is distant, faces drawn
+        // a frame or two ago are still good approximations, so only a couple of faces are
+        // redrawn each frame (and none when nothing is moving.)
+        unsigned int reflectionFaces = m_reflectionSchedule.nextFaces(reflectionCenter, m_simulationTime);
+        if (reflectionFaces != 0)
+        {
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            m_renderer->renderCubeMap(NULL, reflectionCenter, m_reflectionMap.ptr(), 1.0f,
+                                      UniverseRenderer::MaximumFarDistance, Quaterniond::Identity(), reflectionFaces);
+        }
 
         // Generate mipmaps
         // TODO: Move this into GLCubeMapFramebuffer
@@ -1684,6 +1793,15 @@ void UniverseView::paintGL()
     }
 
     m_renderer->endViewSet();
+    m_labelArbiter->endFrame();
+    m_frameTimeTotal += secondsFromBaseTime() - elapsedTime;
+
+    // Queue surface tiles for where the observer is headed. Prefetch requests are only
+    // passed on to the loader when the view just drawn didn't request many tiles, so
+    // they never hold up tiles that are needed right now.
+    m_tilePrefetcher->update(m_observer.ptr(), m_observerAction.ptr(), secondsFromBaseTime(), m_simulationTime,
+                             isPaused() ? 0.0 : timeScale(), float(m_fovY), mainViewport);
+    m_textureLoader->issuePrefetches(m_tilePrefetcher->maxRequestsPerFrame());
 
     // Capture the framebuffer *before* rendering the UI
     if (m_captureNextImage)
@@ -1814,6 +1932,19 @@ void UniverseView::mouseReleaseEvent(QMouseEvent* event)
 
                     m_markers->addMarker(m_selectedBody.ptr(), markerColor, 20.0f, Marker::Pulse, m_realTime, 0.5);                    
                 }
+                else
+                {
+                    // No body was clicked; identify the star nearest the click instead
+                    const StarCatalog::StarRecord* star = pickStarRecord(event->pos());
+                    if (star)
+                    {
+                        setStatusMessage(QString("%1: RA %2\260, Dec %3\260, magnitude %4").
+                                         arg(starName(*star)).
+                                         arg(toDegrees(star->RA), 0, 'f', 3).
+                                         arg(toDegrees(star->declination), 0, 'f', 3).
+                                         arg(star->apparentMagnitude, 0, 'f', 2));
+                    }
+                }
             }
         }
         else if (event->button() == Qt::RightButton)
@@ -2043,6 +2174,12 @@ UniverseView::keyReleaseEvent(QKeyEvent* event)
         setLimitingMagnitude(min(13.0, limitingMagnitude() + 0.2));
     }
 
+    // Alt+Shift+F toggles the frame time and render statistics display
+    if (event->key() == Qt::Key_F && (event->modifiers() & Qt::AltModifier) && (event->modifiers() & Qt::ShiftModifier))
+    {
+        m_frameStatisticsVisible = !m_frameStatisticsVisible;
+    }
+
     // Alt+Shift+W enables wireframe mode
     // TODO: This should only be available in debug builds
     if (event->key() == Qt::Key_W && (event->modifiers() & Qt::AltModifier) && (event->modifiers() & Qt::ShiftModifier))
@@ -2366,6 +2503,145 @@ UniverseView::pickObject(const QPoint& point)
 }
 
 
+// Find the star closest to the specified point in the view. Only stars bright enough
+// to be drawn may be picked.
+const StarCatalog::StarRecord*
+UniverseView::pickStarRecord(const QPoint& point)
+{
+    Quaterniond cameraOrientation = m_observer->absoluteOrientation(m_simulationTime);
+    Vector2d pickPoint(point.x(), size().height() - point.y());
+    Viewport viewport(size().width(), size().height());
+    PlanarProjection projection = PlanarProjection::CreatePerspective(m_fovY, viewport.aspectRatio(), 1.0f, 100.0f);
+
+    return m_universe->pickViewportStar(pickPoint, cameraOrientation, projection, viewport, StarPickRadius, float(limitingMagnitude()));
+}
+
+
+// Get the name of a star: its common name if one was loaded from the star names
+// file, and otherwise its catalog number.
+QString
+UniverseView::starName(const StarCatalog::StarRecord& star) const
+{
+    QString name = m_starNames.value(star.identifier);
+    if (name.isEmpty())
+    {
+        name = QString("Tycho %1").arg(star.identifier);
+    }
+
+    return name;
+}
+
+
+// Convert a star record to a map for use in scripts. Angles are in degrees.
+QVariantMap
+UniverseView::starInfo(const StarCatalog::StarRecord& star) const
+{
+    QVariantMap info;
+    info.insert("identifier", star.identifier);
+    info.insert("name", starName(star));
+    info.insert("ra", toDegrees(star.RA));
+    info.insert("dec", toDegrees(star.declination));
+    info.insert("magnitude", star.apparentMagnitude);
+    info.insert("colorIndex", star.bvColorIndex);
+
+    return info;
+}
+
+
+/** Set the name that is shown when the star with the specified catalog identifier
+  * is picked.
+  */
+void
+UniverseView::setStarName(unsigned int identifier, const QString& name)
+{
+    m_starNames.insert(identifier, name);
+}
+
+
+/** Return information about the star nearest the point (x, y) in the view, where
+  * y increases downward. The result has the properties identifier, name, ra, dec,
+  * magnitude, and colorIndex; it is undefined if there's no star within a few
+  * pixels of the point.
+  */
+QVariant
+UniverseView::pickStar(int x, int y)
+{
+    const StarCatalog::StarRecord* star = pickStarRecord(QPoint(x, y));
+    if (star)
+    {
+        return starInfo(*star);
+    }
+    else
+    {
+        return QVariant();
+    }
+}
+
+
+static Vector3f
+skyDirection(double ra, double dec)
+{
+    double cosDec = cos(toRadians(dec));
+    return Vector3f(float(cosDec * cos(toRadians(ra))), float(cosDec * sin(toRadians(ra))), float(sin(toRadians(dec))));
+}
+
+
+static bool
+brighterStar(const QVariant& star0, const QVariant& star1)
+{
+    return star0.toMap().value("magnitude").toDouble() < star1.toMap().value("magnitude").toDouble();
+}
+
+
+/** Find the stars brighter than a limiting magnitude within a radius of a point on
+  * the sky. The stars are returned as a list sorted from brightest to faintest;
+  * see pickStar() for the properties of each star. The right ascension,
+  * declination, and radius are in degrees.
+  */
+QVariantList
+UniverseView::findStarsInCone(double ra, double dec, double radius, double limitingMagnitude)
+{
+    QVariantList stars;
+    StarCatalog* catalog = m_universe->starCatalog();
+    if (catalog)
+    {
+        vector<unsigned int> found;
+        catalog->findStarsInCone(skyDirection(ra, dec), float(toRadians(radius)), float(limitingMagnitude), found);
+        for (vector<unsigned int>::const_iterator iter = found.begin(); iter != found.end(); ++iter)
+        {
+            stars << starInfo(catalog->star(*iter));
+        }
+        stable_sort(stars.begin(), stars.end(), brighterStar);
+    }
+
+    return stars;
+}
+
+
+/** Find the count stars brighter than a limiting magnitude that are nearest to a
+  * point on the sky. The stars are returned as a list sorted by distance from the
+  * point; see pickStar() for the properties of each star. The right ascension and
+  * declination are in degrees.
+  */
+QVariantList
+UniverseView::findNearestStars(double ra, double dec, int count, double limitingMagnitude)
+{
+    QVariantList stars;
+    StarCatalog* catalog = m_universe->starCatalog();
+    if (catalog && count > 0)
+    {
+        vector<unsigned int> found;
+        catalog->findNearestStars(skyDirection(ra, dec), (unsigned int) count, float(limitingMagnitude), found);
+        for (vector<unsigned int>::const_iterator iter = found.begin(); iter != found.end(); ++iter)
+        {
+            stars << starInfo(catalog->star(*iter));
+        }
+    }
+
+    return stars;
+}
+
+
 // Constrain the viewer's position to lie within maxRange kilometers of the origin
 void
 UniverseView::constrainViewerPosition(double maxRange)
@@ -3430,6 +3706,12 @@ UniverseView::reflections() const
 void
 UniverseView::setReflections(bool enable)
 {
+    // The reflection map isn't updated while reflections are off
+    if (enable && !m_reflectionsEnabled)
+    {
+        m_reflectionSchedule.invalidate();
+    }
+
     m_reflectionsEnabled = enable;
 }
 
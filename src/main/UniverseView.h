@@ -26,18 +26,22 @@
 #include <QDateTime>
 #include <QGestureEvent>
 #include <QUrl>
+#include <QHash>
+#include <QVariant>
 #include <vesta/Universe.h>
 #include <vesta/Observer.h>
 #include <vesta/TextureMapLoader.h>
 #include <vesta/MeshGeometry.h>
 #include <vesta/Visualizer.h>
 #include <vesta/TiledMap.h>
+#include <vesta/CubeMapUpdateSchedule.h>
 
 class QVideoEncoder;
 class ObserverAction;
 class Viewpoint;
 class MarkerLayer;
 class GalleryView;
+class TilePrefetcher;
 
 class QGraphicsScene;
 
@@ -54,6 +58,7 @@ namespace vesta
     class Trajectory;
     class TrajectoryPlotGenerator;
     class GlareOverlay;
+    class LabelArbiter;
 }
 
 class UniverseView : public QDeclarativeView
@@ -115,6 +120,9 @@ public:
     Q_INVOKABLE void setStateFromUrl(const QUrl& url);
     Q_INVOKABLE void setMouseClickEventProcessed(bool accepted);
     Q_INVOKABLE void setMouseMoveEventProcessed(bool accepted);
+    Q_INVOKABLE QVariant pickStar(int x, int y);
+    Q_INVOKABLE QVariantList findStarsInCone(double ra, double dec, double radius, double limitingMagnitude);
+    Q_INVOKABLE QVariantList findNearestStars(double ra, double dec, int count, double limitingMagnitude);
 
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -225,6 +233,8 @@ public:
     double limitingMagnitude() const;
     double ambientLight() const;
 
+    void setStarName(unsigned int identifier, const QString& name);
+
     QString currentTimeString() const;
 
     enum TimeDisplayMode
@@ -405,6 +415,9 @@ private:
     bool gestureEvent(QGestureEvent* event);
 
     vesta::Entity* pickObject(const QPoint& point);
+    const vesta::StarCatalog::StarRecord* pickStarRecord(const QPoint& point);
+    QString starName(const vesta::StarCatalog::StarRecord& star) const;
+    QVariantMap starInfo(const vesta::StarCatalog::StarRecord& star) const;
     void constrainViewerPosition(double maxRange);
 
 private:
@@ -419,10 +432,12 @@ private:
 
     vesta::counted_ptr<vesta::Universe> m_universe;
     UniverseCatalog* m_catalog;
+    QHash<unsigned int, QString> m_starNames;
     vesta::counted_ptr<vesta::Observer> m_observer;
     vesta::counted_ptr<vesta::ObserverController> m_controller;
     vesta::UniverseRenderer* m_renderer;
     vesta::counted_ptr<vesta::GlareOverlay> m_glareOverlay;
+    vesta::counted_ptr<vesta::LabelArbiter> m_labelArbiter;
     FrameType m_observerFrame;
     double m_fovY;
 
@@ -450,11 +465,15 @@ private:
     unsigned int m_frameCount;
     double m_frameCountStartTime;
     double m_framesPerSecond;
+    double m_frameTimeTotal;
+    QString m_frameStatistics;
+    bool m_frameStatisticsVisible;
 
     vesta::counted_ptr<vesta::Entity> m_selectedBody;
 
     vesta::counted_ptr<NetworkTextureLoader> m_textureLoader;
     vesta::counted_ptr<vesta::CubeMapFramebuffer> m_reflectionMap;
+    vesta::CubeMapUpdateSchedule m_reflectionSchedule;
     vesta::counted_ptr<vesta::MeshGeometry> m_defaultSpacecraftMesh;
 
     bool m_reflectionsEnabled;
@@ -495,6 +514,7 @@ private:
 
     MarkerLayer* m_markers;
     GalleryView* m_galleryView;
+    TilePrefetcher* m_tilePrefetcher;
 
     int m_earthMapMonth;
 
@@ -23,6 +23,7 @@
 #include <QDateTime>
 #include <QDir>
 #include <QFile>
+#include <QStandardPaths>
 #include <cmath>
 
 using namespace std;
@@ -31,6 +32,9 @@ using namespace std;
 // class will take care of managing the other pending requests itself.
 const static int MaxOutstandingNetworkRequests = 12;
 
+// Maximum memory (in KB) occupied by recently decoded WMS tiles
+const static int SourceImageCacheSize = 32 * 1024;
+
 
 /** WMSRequester handles retrieving map tiles from a Web Map Server and converting
   * them to a form that can be easily used with VESTA's WorldGeometry class. The
@@ -65,11 +69,21 @@ const static int MaxOutstandingNetworkRequests = 12;
   *    - If the user moves the camera quickly over the surface of a planet, huge
   *      number of requests may be queued. We occasionally trim queue, removing
   *      requests for tiles that haven't been visible for some time.
+  *
+  * Neighboring texture tiles are often built from the same WMS tiles, and a texture
+  * tile may be requested again while it's still being assembled. Each WMS tile is
+  * requested from the server only once no matter how many texture tiles are waiting
+  * for it, and recently decoded WMS tiles are kept in memory so that they can be
+  * reused by tiles requested later. Finished texture tiles are stored on disk, keyed
+  * by surface, level, column, and row; they're loaded directly from the disk store
+  * when requested again.
   */
 WMSRequester::WMSRequester(QObject* parent) :
     QObject(parent),
     m_dispatchedRequestCount(0)
 {
+    m_sourceImages.setMaxCost(SourceImageCacheSize);
+
     m_networkManager = new QNetworkAccessManager(this);
     QNetworkDiskCache* cache = new QNetworkDiskCache(this);
     //cache->setCacheDirectory(QDesktopServices::storageLocation(QDesktopServices::CacheLocation));
@@ -81,6 +95,7 @@ WMSRequester::WMSRequester(QObject* parent) :
 
 WMSRequester::~WMSRequester()
 {
+    qDeleteAll(m_tileAssemblies);
 }
 
 
@@ -121,12 +136,25 @@ WMSRequester::retrieveTile(const QString& tileName,
         return;
     }
 
-    QString fileName = tileFileName(tileName, surface);
-    QFileInfo fileInfo(fileName);
-    if (fileInfo.exists())
+    TileAddress address = parseTileName(tileName);
+    if (address.valid)
+    {
+        QString fileName = tileFileName(address);
+        QFileInfo fileInfo(fileName);
+        if (fileInfo.exists())
+        {
+            QImage image(fileName);
+            emit imageCompleted(tileName, image);
+            return;
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    // Coalesce repeated requests for a tile that's already being assembled
+    if (m_tileAssemblies.contains(tileName))
     {
-        QImage image(fileName);
-        emit imageCompleted(tileName, image);
+        m_tileAssemblies[tileName]->texture = texture;
         return;
     }
 
@@ -162,14 +190,18 @@ WMSRequester::retrieveTile(const QString& tileName,
     int northIndex = int(ceil((tileBox.north - topLeft.south) / wmsTileLatExtent));
 
     TileAssembly* tileAssembly = new TileAssembly;
-    tileAssembly->tileImage;
     tileAssembly->requestCount = 0;
+    tileAssembly->failed = false;
     tileAssembly->tileName = tileName;
     tileAssembly->surfaceName = surface;
     tileAssembly->tileWidth = tileSize;
     tileAssembly->tileHeight = tileSize;
+    tileAssembly->address = address;
     tileAssembly->texture = texture;
 
+    // Create all the build operations before executing any of them, so that the
+    // tile isn't completed early when some of the WMS tiles are already in memory.
+    QList<TileBuildOperation> ops;
     for (int lat = southIndex; lat < northIndex; ++lat)
     {
         for (int lon = westIndex; lon < eastIndex; ++lon)
@@ -189,25 +221,53 @@ WMSRequester::retrieveTile(const QString& tileName,
                                 tileSize * wmsTileLongExtent / tileLongExtent, tileSize * wmsTileLatExtent / tileLatExtent);
             op.urlString = urlString;
             op.tile->requestCount++;
+            ops << op;
+        }
+    }
+
+    if (ops.isEmpty())
+    {
+        delete tileAssembly;
+        return;
+    }
 
+    m_tileAssemblies.insert(tileName, tileAssembly);
+
+    foreach (const TileBuildOperation& op, ops)
+    {
+        QImage* sourceImage = m_sourceImages.object(op.urlString);
+        if (sourceImage)
+        {
+            // The WMS tile was recently used to build another tile
+            drawSourceImage(op, *sourceImage);
+            finishOperation(op.tile);
+        }
+        else if (m_sourceRequests.contains(op.urlString))
+        {
+            // The WMS tile has already been requested for another tile
+            m_sourceRequests[op.urlString].append(op);
+        }
+        else
+        {
+            m_sourceRequests[op.urlString].append(op);
             if (m_dispatchedRequestCount < MaxOutstandingNetworkRequests)
             {
-                requestTile(op);
+                requestTile(op.urlString);
             }
             else
             {
-                QMutexLocker locker(&m_mutex);
-                m_queuedTiles.append(op);
+                m_queuedSources.append(op.urlString);
             }
         }
     }
 }
 
 
+// Request a WMS tile from the server. This method must be called with m_mutex locked.
 void
-WMSRequester::requestTile(const TileBuildOperation& op)
+WMSRequester::requestTile(const QString& urlString)
 {
-    QUrl url(op.urlString);
+    QUrl url(urlString);
 
     // Testing the 'SourceIsFromCache' attribute of replies from the OnEarth server
     // seems to indicate that the tiles are not being cached. However, tiles are still
@@ -226,10 +286,125 @@ WMSRequester::requestTile(const TileBuildOperation& op)
 
     QNetworkReply* reply = m_networkManager->get(request);
 
-    m_mutex.lock();
     m_dispatchedRequestCount++;
-    m_requestedTiles[reply] = op;
-    m_mutex.unlock();
+    m_requestedSources[reply] = urlString;
+}
+
+
+// Blit a WMS tile into the texture tile that it is part of. This method must be called
+// with m_mutex locked.
+void
+WMSRequester::drawSourceImage(const TileBuildOperation& op, const QImage& image)
+{
+    TileAssembly* tileAssembly = op.tile;
+
+    bool firstOp = false;
+    if (tileAssembly->tileImage.isNull())
+    {
+         tileAssembly->tileImage = QImage(tileAssembly->tileWidth, tileAssembly->tileHeight, QImage::Format_RGB888);
+         firstOp = true;
+    }
+
+    QPainter painter(&tileAssembly->tileImage);
+
+    // Clear the background to white before the first operation
+    if (firstOp)
+    {
+        painter.fillRect(QRectF(0.0f, 0.0f, tileAssembly->tileImage.width(), tileAssembly->tileImage.height()), Qt::white);
+    }
+
+    painter.setRenderHints(QPainter::SmoothPixmapTransform, true);
+
+    // A hack to work around some drawing problems that left occasional gaps
+    // in tiles. There's either a bug in Qt's painter class, or some trouble
+    // with roundoff errors. Increasing the rectangle size very slightly
+    // eliminates the gaps.
+    QRectF r(op.subrect);
+    r.setSize(QSizeF(r.width() * 1.0001f, r.height() * 1.0001f));
+    painter.drawImage(r, image);
+    painter.end();
+}
+
+
+// Record that one of the build operations for a tile is complete. When the last operation
+// finishes, the tile is either saved and delivered or, if any of the WMS tiles couldn't
+// be retrieved, abandoned so that it will be requested again later. This method must be
+// called with m_mutex locked.
+void
+WMSRequester::finishOperation(TileAssembly* tileAssembly)
+{
+    tileAssembly->requestCount--;
+    if (tileAssembly->requestCount > 0)
+    {
+        return;
+    }
+
+    m_tileAssemblies.remove(tileAssembly->tileName);
+
+    if (tileAssembly->failed)
+    {
+        // Set status to unitialized so that loading will be retried if the tile
+        // is needed again.
+        if (tileAssembly->texture)
+        {
+            tileAssembly->texture->setStatus(vesta::TextureMap::Uninitialized);
+        }
+    }
+    else
+    {
+        if (tileAssembly->address.valid)
+        {
+            QString imageName = tileFileName(tileAssembly->address);
+            QFileInfo fileInfo(imageName);
+            QDir tileDir = fileInfo.dir();
+            if (!tileDir.exists())
+            {
+                tileDir.mkpath(tileDir.absolutePath());
+            }
+
+            bool ok = tileAssembly->tileImage.save(imageName);
+            if (!ok)
+            {
+                qDebug() << "Failed writing to " << imageName;
+            }
+        }
+
+        emit imageCompleted(tileAssembly->tileName, tileAssembly->tileImage.rgbSwapped());
+    }
+
+    delete tileAssembly;
+}
+
+
+// Abandon all of the build operations waiting for a WMS tile. This method must be called
+// with m_mutex locked.
+void
+WMSRequester::abandonSource(const QString& urlString)
+{
+    QList<TileBuildOperation> ops = m_sourceRequests.take(urlString);
+    foreach (const TileBuildOperation& op, ops)
+    {
+        op.tile->failed = true;
+        finishOperation(op.tile);
+    }
+}
+
+
+// Get the time that any of the textures waiting for a WMS tile was last used. This method
+// must be called with m_mutex locked.
+vesta::v_uint64
+WMSRequester::sourceLastUsed(const QString& urlString) const
+{
+    vesta::v_uint64 lastUsed = 0;
+    foreach (const TileBuildOperation& op, m_sourceRequests.value(urlString))
+    {
+        if (op.tile->texture)
+        {
+            lastUsed = max(lastUsed, op.tile->texture->lastUsed());
+        }
+    }
+
+    return lastUsed;
 }
 
 
@@ -244,82 +419,40 @@ WMSRequester::processTile(QNetworkReply* reply)
     QVariant redirectionTargetUrl = reply->attribute(QNetworkRequest::RedirectionTargetAttribute);
     // see CS001432 on how to handle this
 
+    QMutexLocker locker(&m_mutex);
+
     --m_dispatchedRequestCount;
 
+    QString urlString = m_requestedSources.take(reply);
+
     // no error received?
     if (reply->error() == QNetworkReply::NoError)
     {
-        bool fromCache = reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool();
-
         QImageReader imageReader(reply);
         QImage image = imageReader.read();
 
         if (image.isNull())
         {
             qDebug() << "Received bad image: " << reply->header(QNetworkRequest::LocationHeader);
+            abandonSource(urlString);
         }
         else
         {
-            QMutexLocker locker(&m_mutex);
-
-            TileBuildOperation op = m_requestedTiles.take(reply);
-
-            TileAssembly* tileAssembly = op.tile;
-
-            if (tileAssembly)
+            // Every tile waiting for this WMS tile is built from the single decoded image
+            QList<TileBuildOperation> ops = m_sourceRequests.take(urlString);
+            foreach (const TileBuildOperation& op, ops)
             {
-                bool firstOp = false;
-                if (tileAssembly->tileImage.isNull())
-                {
-                     tileAssembly->tileImage = QImage(tileAssembly->tileWidth, tileAssembly->tileHeight, QImage::Format_RGB888);
-                     firstOp = true;
-                }
-
-                QPainter painter(&tileAssembly->tileImage);
-
-                // Clear the background to white before the first operation
-                if (firstOp)
-                {
-                    painter.fillRect(QRectF(0.0f, 0.0f, tileAssembly->tileImage.width(), tileAssembly->tileImage.height()), Qt::white);
-                }
-
-                painter.setRenderHints(QPainter::SmoothPixmapTransform, true);
-
-                // A hack to work around some drawing problems that left occasional gaps
-                // in tiles. There's either a bug in Qt's painter class, or some trouble
-                // with roundoff errors. Increasing the rectangle size very slightly
-                // eliminates the gaps.
-                QRectF r(op.subrect);
-                r.setSize(QSizeF(r.width() * 1.0001f, r.height() * 1.0001f));
-                painter.drawImage(r, image);
-                painter.end();
-
-                tileAssembly->requestCount--;
-                if (tileAssembly->requestCount == 0)
-                {
-                    QString imageName = tileFileName(tileAssembly->tileName, tileAssembly->surfaceName);
-                    QFileInfo fileInfo(imageName);
-                    QDir tileDir = fileInfo.dir();
-                    if (!tileDir.exists())
-                    {
-                        tileDir.mkpath(tileDir.absolutePath());
-                    }
-
-                    bool ok = tileAssembly->tileImage.save(imageName);
-                    if (!ok)
-                    {
-                        qDebug() << "Failed writing to " << imageName;
-                    }
-
-                    emit imageCompleted(tileAssembly->tileName, tileAssembly->tileImage.rgbSwapped());
-                    delete tileAssembly;
-                }
+                drawSourceImage(op, image);
+                finishOperation(op.tile);
             }
+
+            m_sourceImages.insert(urlString, new QImage(image), max(1, image.bytesPerLine() * image.height() / 1024));
         }
     }
     else
     {
         qDebug() << "Network error: " << reply->errorString();
+        abandonSource(urlString);
     }
 
     reply->deleteLater();
@@ -327,61 +460,44 @@ WMSRequester::processTile(QNetworkReply* reply)
     // If there are queued tiled requests and not too many active WMS server connections,
     // then make some more network requests. Prioritize requests for textures tiles that
     // are currently visible.
-    while (m_dispatchedRequestCount < MaxOutstandingNetworkRequests)
+    while (m_dispatchedRequestCount < MaxOutstandingNetworkRequests && !m_queuedSources.isEmpty())
     {
-        int tileIndex = -1;
+        // Request the WMS tile needed for the most recently used texture tile
+        int sourceIndex = 0;
         vesta::v_uint64 mostRecent = 0;
-        TileBuildOperation op;
+        for (int i = 0; i < m_queuedSources.size(); ++i)
         {
-            QMutexLocker locker(&m_mutex);
-
-            // Request a WMS tile for the most recently used texture tile
-            for (int i = 0; i < m_queuedTiles.size(); ++i)
+            vesta::v_uint64 lastUsed = sourceLastUsed(m_queuedSources[i]);
+            if (lastUsed > mostRecent)
             {
-                if (m_queuedTiles[i].tile->texture->lastUsed() > mostRecent)
-                {
-                    tileIndex = i;
-                    mostRecent = m_queuedTiles[i].tile->texture->lastUsed();
-                }
+                sourceIndex = i;
+                mostRecent = lastUsed;
             }
+        }
 
-            if (tileIndex >= 0)
+        QString nextUrl = m_queuedSources.takeAt(sourceIndex);
+
+        // Trim the queue by removing requests for tiles that haven't been visible
+        // for a while. This will happen when the user moves the camera quickly over
+        // the surface of a planet. We want to load tiles for the location that the
+        // user is looking at now, not the places that they zoomed past quickly on
+        // the way there.
+        //
+        // Tiles that haven't been accessed in the last cullLag frames are removed.
+        const unsigned int cullLag = 60;
+        if (mostRecent >= cullLag)
+        {
+            vesta::v_uint64 cullBefore = mostRecent - cullLag;
+            for (int i = m_queuedSources.size() - 1; i >= 0; --i)
             {
-                op = m_queuedTiles.takeAt(tileIndex);
-
-                // Trim the queue by removing requests for tiles that haven't been visible
-                // for a while. This will happen when the user moves the camera quickly over
-                // the surface of a planet. We want to load tiles for the location that the
-                // user is looking at now, not the places that they zoomed past quickly on
-                // the way there.
-                //
-                // Tiles that haven't been accessed in the last cullLag frames are remove
-                const unsigned int cullLag = 60;
-                if (mostRecent >= cullLag)
+                if (sourceLastUsed(m_queuedSources[i]) < cullBefore)
                 {
-                    vesta::v_uint64 cullBefore = mostRecent - cullLag;
-                    for (int i = m_queuedTiles.size() - 1; i >= 0; --i)
-                    {
-                        if (m_queuedTiles[i].tile->texture->lastUsed() < cullBefore)
-                        {
-                            // Set status to unitialized so that loading will be retried if the tile
-                            // comes into view later.
-                            m_queuedTiles[i].tile->texture->setStatus(vesta::TextureMap::Uninitialized);
-                            m_queuedTiles.removeAt(i);
-                        }
-                    }
+                    abandonSource(m_queuedSources.takeAt(i));
                 }
             }
         }
 
-        if (tileIndex >= 0)
-        {
-            requestTile(op);
-        }
-        else
-        {
-            break;
-        }
+        requestTile(nextUrl);
     }
 }
 
@@ -401,12 +517,14 @@ WMSRequester::addSurfaceDefinition(const QString& name,
 }
 
 
+/** Get the name of the file in the local tile store that holds an assembled tile.
+  */
 QString
-WMSRequester::tileFileName(const QString& tileName, const QString& surfaceName)
+WMSRequester::tileFileName(const TileAddress& address)
 {
     //QString cacheDirName = QDesktopServices::storageLocation(QDesktopServices::CacheLocation) + "/wms_tiles";
-    QString cacheDirName = QStandardPaths::locate(QStandardPaths::CacheLocation, "wms_tiles", QStandardPaths::LocateDirectory);
-    return QString("%1/%2/%3.png").arg(cacheDirName).arg(surfaceName).arg(tileName);
+    QString cacheDirName = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/wms_tiles";
+    return QString("%1/%2/%3/%4_%5.png").arg(cacheDirName).arg(address.surface).arg(address.level).arg(address.x).arg(address.y);
 }
 
 
@@ -454,13 +572,12 @@ WMSRequester::parseTileName(const QString& tileName)
 }
 
 
-/** Get the number of tiles in the queue. The count includes both active
-  * and queued requests. Since different texture tiles may use the same
-  * WMS tiles, the count will generally be larger (often by a factor of
-  * four or more) than the number of texture tiles.
+/** Get the number of WMS tiles in the queue. The count includes both active
+  * and queued requests. Since a texture tile may be built from several WMS
+  * tiles, the count can be larger than the number of texture tiles.
   */
 unsigned int
 WMSRequester::pendingTileCount() const
 {
-    return (unsigned int) (m_dispatchedRequestCount + m_queuedTiles.size());
+    return (unsigned int) (m_dispatchedRequestCount + m_queuedSources.size());
 }
@@ -20,6 +20,8 @@
 #include <QNetworkReply>
 #include <QImage>
 #include <QMutex>
+#include <QHash>
+#include <QCache>
 
 class WMSRequester : public QObject
 {
@@ -79,6 +81,7 @@ public:
         unsigned int tileWidth;
         unsigned int tileHeight;
         int requestCount;
+        bool failed;
         TileAddress address;
         vesta::TextureMap* texture;
     };
@@ -137,17 +140,33 @@ signals:
     void imageCompleted(const QString& tileName, const QImage& image);
 
 private:
-    QString tileFileName(const QString& tileName, const QString& surfaceName);
+    static QString tileFileName(const TileAddress& address);
     QString createWmsUrl(const QString& requestUrl,
                          const LatLongBoundingBox& box,
                          unsigned int tileWidth,
                          unsigned int tileHeight) const;
-    void requestTile(const TileBuildOperation& op);
+    void requestTile(const QString& urlString);
+    void drawSourceImage(const TileBuildOperation& op, const QImage& image);
+    void finishOperation(TileAssembly* tileAssembly);
+    void abandonSource(const QString& urlString);
+    vesta::v_uint64 sourceLastUsed(const QString& urlString) const;
 
 private:
     QNetworkAccessManager* m_networkManager;
-    QList<TileBuildOperation> m_queuedTiles;
-    QHash<QNetworkReply*, TileBuildOperation> m_requestedTiles;
+
+    // Texture tiles currently being assembled, keyed by tile name
+    QHash<QString, TileAssembly*> m_tileAssemblies;
+
+    // Build operations waiting for each WMS tile, keyed by the WMS request URL. There
+    // is only one network request per WMS tile, no matter how many operations are
+    // waiting for it.
+    QHash<QString, QList<TileBuildOperation> > m_sourceRequests;
+    QList<QString> m_queuedSources;
+    QHash<QNetworkReply*, QString> m_requestedSources;
+
+    // Recently decoded WMS tiles
+    QCache<QString, QImage> m_sourceImages;
+
     QHash<QString, SurfaceProperties> m_surfaces;
     QMutex m_mutex;
     int m_dispatchedRequestCount;
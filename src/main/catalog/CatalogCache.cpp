@@ -0,0 +1,156 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "CatalogCache.h"
+#include <QFile>
+#include <QDir>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QDebug>
+
+
+static const quint32 CacheFileMagic = 0x43434154; // "CCAT"
+
+// Increment this whenever the way that catalog or sample files are parsed
+// changes; doing so orphans all previously cached entries.
+static const quint32 CacheFileVersion = 2;
+
+
+CatalogCache::CatalogCache() :
+    m_directory(DefaultDirectory())
+{
+}
+
+
+CatalogCache::CatalogCache(const QString& directory) :
+    m_directory(directory)
+{
+}
+
+
+CatalogCache::~CatalogCache()
+{
+}
+
+
+/** Get the default location of the catalog cache.
+  */
+QString
+CatalogCache::DefaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/catalogs";
+}
+
+
+/** Compute the key for a cache entry from the contents of a file and the kind
+  * of data parsed from it. The kind distinguishes different interpretations of
+  * the same file contents, e.g. a rotation file read with different conventions.
+  */
+QByteArray
+CatalogCache::Key(const QString& kind, const QByteArray& contents)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(kind.toUtf8());
+    hash.addData("|", 1);
+    hash.addData(contents);
+
+    return hash.result();
+}
+
+
+/** Get the name of the cache file for an entry.
+  */
+QString
+CatalogCache::fileName(const QByteArray& key) const
+{
+    return m_directory + "/" + QString::fromLatin1(key.toHex()) + ".catcache";
+}
+
+
+/** Load a cached entry.
+  *
+  * \return true if the entry was found and read without errors
+  */
+bool
+CatalogCache::load(const QByteArray& key, QVariant* value) const
+{
+    if (!isEnabled())
+    {
+        return false;
+    }
+
+    QFile file(fileName(key));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != CacheFileMagic || version != CacheFileVersion)
+    {
+        return false;
+    }
+
+    in >> *value;
+
+    return in.status() == QDataStream::Ok;
+}
+
+
+/** Store an entry in the cache. The file is written completely before it
+  * replaces any existing entry, so that a partially written file is never
+  * mistaken for a valid entry.
+  */
+bool
+CatalogCache::save(const QByteArray& key, const QVariant& value) const
+{
+    if (!isEnabled())
+    {
+        return false;
+    }
+
+    QDir dir(m_directory);
+    if (!dir.exists())
+    {
+        dir.mkpath(dir.absolutePath());
+    }
+
+    QSaveFile file(fileName(key));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << CacheFileMagic << CacheFileVersion << value;
+
+    if (out.status() != QDataStream::Ok || !file.commit())
+    {
+        qDebug() << "Unable to store catalog cache entry in " << file.fileName();
+        return false;
+    }
+
+    return true;
+}
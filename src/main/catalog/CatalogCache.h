@@ -0,0 +1,64 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _CATALOG_CACHE_H_
+#define _CATALOG_CACHE_H_
+
+#include <QString>
+#include <QByteArray>
+#include <QVariant>
+
+
+/** CatalogCache stores the parsed contents of catalog files and sample data
+  * files on disk, so that they don't have to be parsed again the next time that
+  * they're loaded. Entries are named with a hash of the file contents and the kind
+  * of data stored, thus an edited file simply produces a different name and cache
+  * entries never need to be invalidated.
+  *
+  * A cache with an empty directory is disabled: nothing is loaded or saved.
+  * All methods may be called from multiple threads at once.
+  */
+class CatalogCache
+{
+public:
+    CatalogCache();
+    CatalogCache(const QString& directory);
+    ~CatalogCache();
+
+    QString directory() const
+    {
+        return m_directory;
+    }
+
+    bool isEnabled() const
+    {
+        return !m_directory.isEmpty();
+    }
+
+    QString fileName(const QByteArray& key) const;
+
+    bool load(const QByteArray& key, QVariant* value) const;
+    bool save(const QByteArray& key, const QVariant& value) const;
+
+    static QString DefaultDirectory();
+    static QByteArray Key(const QString& kind, const QByteArray& contents);
+
+private:
+    QString m_directory;
+};
+
+#endif // _CATALOG_CACHE_H_
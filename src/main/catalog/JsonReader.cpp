@@ -0,0 +1,660 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "JsonReader.h"
+
+
+/** Create a reader for JSON text. The reader keeps a reference to the data
+  * (which is implicitly shared) rather than copying it.
+  */
+JsonReader::JsonReader(const QByteArray& data) :
+    m_data(data),
+    m_pos(NULL),
+    m_end(NULL),
+    m_line(1),
+    m_currentTokenType(NoToken),
+    m_state(ExpectValue),
+    m_numberStart(NULL),
+    m_numberLength(0),
+    m_numberHasFraction(false),
+    m_numberHasExponent(false),
+    m_errorLine(0)
+{
+    m_pos = m_data.constData();
+    m_end = m_pos + m_data.size();
+
+    // Skip a UTF-8 byte order mark
+    if (m_end - m_pos >= 3 && m_pos[0] == '\xef' && m_pos[1] == '\xbb' && m_pos[2] == '\xbf')
+    {
+        m_pos += 3;
+    }
+}
+
+
+JsonReader::~JsonReader()
+{
+}
+
+
+JsonReader::TokenType
+JsonReader::setError(const QString& message)
+{
+    m_currentTokenType = Invalid;
+    m_errorMessage = message;
+    m_errorLine = m_line;
+
+    return Invalid;
+}
+
+
+/** Skip over whitespace and comments.
+  *
+  * \return false if there was an unterminated comment
+  */
+bool
+JsonReader::skipWhitespace()
+{
+    while (m_pos != m_end)
+    {
+        char c = *m_pos;
+        if (c == '\n')
+        {
+            ++m_line;
+            ++m_pos;
+        }
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f')
+        {
+            ++m_pos;
+        }
+        else if (c == '/' && m_end - m_pos >= 2 && m_pos[1] == '/')
+        {
+            while (m_pos != m_end && *m_pos != '\n')
+            {
+                ++m_pos;
+            }
+        }
+        else if (c == '/' && m_end - m_pos >= 2 && m_pos[1] == '*')
+        {
+            m_pos += 2;
+            for (;;)
+            {
+                if (m_pos == m_end)
+                {
+                    setError("Unterminated comment");
+                    return false;
+                }
+                else if (*m_pos == '*' && m_end - m_pos >= 2 && m_pos[1] == '/')
+                {
+                    m_pos += 2;
+                    break;
+                }
+                else if (*m_pos == '\n')
+                {
+                    ++m_line;
+                }
+                ++m_pos;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+
+static int
+hexDigitValue(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+
+/** Read a string starting at the opening quote. Escapes are handled as by
+  * QJson: unknown escape sequences produce the escaped character, and \u
+  * escapes are decoded as individual UTF-16 code units.
+  */
+bool
+JsonReader::readString(bool isName)
+{
+    const char* start = ++m_pos;
+    bool escaped = false;
+    while (m_pos != m_end && *m_pos != '"')
+    {
+        if (*m_pos == '\\')
+        {
+            escaped = true;
+            if (++m_pos == m_end)
+            {
+                break;
+            }
+        }
+        if (*m_pos == '\n')
+        {
+            ++m_line;
+        }
+        ++m_pos;
+    }
+
+    if (m_pos == m_end)
+    {
+        setError("Unterminated string");
+        return false;
+    }
+
+    int length = int(m_pos - start);
+    ++m_pos;
+
+    if (!escaped)
+    {
+        if (isName)
+        {
+            // Look up the name without copying it
+            QByteArray key = QByteArray::fromRawData(start, length);
+            QHash<QByteArray, QString>::const_iterator iter = m_names.constFind(key);
+            if (iter != m_names.constEnd())
+            {
+                m_stringValue = iter.value();
+            }
+            else
+            {
+                m_stringValue = QString::fromUtf8(start, length);
+                m_names.insert(QByteArray(start, length), m_stringValue);
+            }
+        }
+        else
+        {
+            m_stringValue = QString::fromUtf8(start, length);
+        }
+
+        return true;
+    }
+
+    QString value;
+    QByteArray segment;
+    for (const char* p = start; p != start + length; ++p)
+    {
+        if (*p != '\\')
+        {
+            segment += *p;
+            continue;
+        }
+
+        ++p;
+        switch (*p)
+        {
+        case 'b':
+            segment += '\b';
+            break;
+        case 'f':
+            segment += '\f';
+            break;
+        case 'n':
+            segment += '\n';
+            break;
+        case 'r':
+            segment += '\r';
+            break;
+        case 't':
+            segment += '\t';
+            break;
+        case 'u':
+            {
+                if (start + length - p < 5)
+                {
+                    setError("Invalid \\u escape in string");
+                    return false;
+                }
+
+                ushort code = 0;
+                for (int i = 1; i <= 4; ++i)
+                {
+                    int digit = hexDigitValue(p[i]);
+                    if (digit < 0)
+                    {
+                        setError("Invalid \\u escape in string");
+                        return false;
+                    }
+                    code = ushort(code * 16 + digit);
+                }
+                p += 4;
+
+                value += QString::fromUtf8(segment);
+                segment.clear();
+                value += QChar(code);
+            }
+            break;
+        default:
+            segment += *p;
+            break;
+        }
+    }
+    value += QString::fromUtf8(segment);
+    m_stringValue = value;
+
+    return true;
+}
+
+
+/** Read a number: an optional minus sign, one or more digits, an optional fraction,
+  * and an optional exponent. As with QJson, the fraction and exponent may have no
+  * digits.
+  */
+bool
+JsonReader::readNumber()
+{
+    m_numberStart = m_pos;
+    m_numberHasFraction = false;
+    m_numberHasExponent = false;
+
+    if (*m_pos == '-')
+    {
+        ++m_pos;
+    }
+
+    if (m_pos == m_end || *m_pos < '0' || *m_pos > '9')
+    {
+        setError("Invalid number");
+        return false;
+    }
+
+    while (m_pos != m_end && *m_pos >= '0' && *m_pos <= '9')
+    {
+        ++m_pos;
+    }
+
+    if (m_pos != m_end && *m_pos == '.')
+    {
+        m_numberHasFraction = true;
+        ++m_pos;
+        while (m_pos != m_end && *m_pos >= '0' && *m_pos <= '9')
+        {
+            ++m_pos;
+        }
+    }
+
+    if (m_pos != m_end && (*m_pos == 'e' || *m_pos == 'E'))
+    {
+        m_numberHasExponent = true;
+        ++m_pos;
+        if (m_pos != m_end && (*m_pos == '+' || *m_pos == '-'))
+        {
+            ++m_pos;
+        }
+        while (m_pos != m_end && *m_pos >= '0' && *m_pos <= '9')
+        {
+            ++m_pos;
+        }
+    }
+
+    m_numberLength = int(m_pos - m_numberStart);
+
+    return true;
+}
+
+
+/** Read true, false, or null. The first character has already been matched;
+  * as with QJson, the comparison ignores case.
+  */
+bool
+JsonReader::readLiteral(const char* rest)
+{
+    ++m_pos;
+    for (; *rest; ++rest, ++m_pos)
+    {
+        if (m_pos == m_end || (*m_pos | 0x20) != *rest)
+        {
+            setError("Unexpected character");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+JsonReader::State
+JsonReader::stateAfterValue() const
+{
+    return m_containers.empty() ? ExpectEnd : ExpectSeparator;
+}
+
+
+JsonReader::TokenType
+JsonReader::beginContainer(char type, TokenType token)
+{
+    if (m_containers.size() >= MaxNestingDepth)
+    {
+        return setError("Objects and arrays are nested too deeply");
+    }
+
+    ++m_pos;
+    m_containers.push_back(type);
+    m_state = type == '{' ? ExpectNameOrEndObject : ExpectValueOrEndArray;
+    m_currentTokenType = token;
+
+    return token;
+}
+
+
+JsonReader::TokenType
+JsonReader::endContainer(TokenType token)
+{
+    ++m_pos;
+    m_containers.pop_back();
+    m_state = stateAfterValue();
+    m_currentTokenType = token;
+
+    return token;
+}
+
+
+/** Read the next token. Once the end of the input or an error has been reached,
+  * the same token is returned for every subsequent call.
+  */
+JsonReader::TokenType
+JsonReader::readNext()
+{
+    if (m_currentTokenType == Invalid || m_currentTokenType == EndToken)
+    {
+        return m_currentTokenType;
+    }
+
+    for (;;)
+    {
+        if (!skipWhitespace())
+        {
+            return Invalid;
+        }
+
+        if (m_pos == m_end)
+        {
+            if (m_state == ExpectEnd || (m_state == ExpectValue && m_currentTokenType == NoToken))
+            {
+                // An empty document is accepted, as it is by QJson
+                m_currentTokenType = EndToken;
+                return EndToken;
+            }
+            else
+            {
+                return setError("Unexpected end of input");
+            }
+        }
+
+        char c = *m_pos;
+        switch (m_state)
+        {
+        case ExpectEnd:
+            return setError("Unexpected data after the end of the document");
+
+        case ExpectSeparator:
+            if (c == ',')
+            {
+                ++m_pos;
+                m_state = m_containers.back() == '{' ? ExpectName : ExpectValue;
+                continue;
+            }
+            else if (c == '}' && m_containers.back() == '{')
+            {
+                return endContainer(EndObject);
+            }
+            else if (c == ']' && m_containers.back() == '[')
+            {
+                return endContainer(EndArray);
+            }
+            else
+            {
+                return setError("Expected ',' or the end of an object or array");
+            }
+
+        case ExpectNameOrEndObject:
+            if (c == '}')
+            {
+                return endContainer(EndObject);
+            }
+            // Fall through
+
+        case ExpectName:
+            if (c != '"')
+            {
+                return setError("Expected a member name");
+            }
+            if (!readString(true) || !skipWhitespace())
+            {
+                return Invalid;
+            }
+            if (m_pos == m_end || *m_pos != ':')
+            {
+                return setError("Expected ':' after member name");
+            }
+            ++m_pos;
+            m_state = ExpectValue;
+            m_currentTokenType = Name;
+            return Name;
+
+        case ExpectValueOrEndArray:
+            if (c == ']')
+            {
+                return endContainer(EndArray);
+            }
+            // Fall through
+
+        case ExpectValue:
+            break;
+        }
+
+        // Read a value
+        TokenType token = NoToken;
+        switch (c)
+        {
+        case '{':
+            return beginContainer('{', BeginObject);
+        case '[':
+            return beginContainer('[', BeginArray);
+        case '"':
+            if (!readString(false))
+            {
+                return Invalid;
+            }
+            token = String;
+            break;
+        case 't':
+        case 'T':
+            if (!readLiteral("rue"))
+            {
+                return Invalid;
+            }
+            token = True;
+            break;
+        case 'f':
+        case 'F':
+            if (!readLiteral("alse"))
+            {
+                return Invalid;
+            }
+            token = False;
+            break;
+        case 'n':
+        case 'N':
+            if (!readLiteral("ull"))
+            {
+                return Invalid;
+            }
+            token = Null;
+            break;
+        default:
+            if (c == '-' || (c >= '0' && c <= '9'))
+            {
+                if (!readNumber())
+                {
+                    return Invalid;
+                }
+                token = Number;
+            }
+            else
+            {
+                return setError("Unexpected character");
+            }
+            break;
+        }
+
+        m_state = stateAfterValue();
+        m_currentTokenType = token;
+        return token;
+    }
+}
+
+
+/** Get the value of the current Number token, converted to the same type that
+  * QJson uses.
+  */
+QVariant
+JsonReader::numberValue() const
+{
+    QByteArray text(m_numberStart, m_numberLength);
+    if (m_numberHasExponent)
+    {
+        return QVariant(text);
+    }
+    else if (m_numberHasFraction)
+    {
+        return QVariant(text.toDouble());
+    }
+    else if (text.startsWith('-'))
+    {
+        return QVariant(text.toLongLong());
+    }
+    else
+    {
+        return QVariant(text.toULongLong());
+    }
+}
+
+
+/** Read the value that begins with the current token, which must be the first
+  * token of a value. When the value is an object or array, the reader is left at
+  * the token that ends it. If an object has more than one member with the same
+  * name, the first one is used, as with QJson.
+  *
+  * \return the value, or an invalid QVariant if there was an error
+  */
+QVariant
+JsonReader::readValue()
+{
+    switch (m_currentTokenType)
+    {
+    case BeginObject:
+        {
+            QVariantMap map;
+            while (readNext() == Name)
+            {
+                QString name = m_stringValue;
+                readNext();
+                QVariant value = readValue();
+                if (error())
+                {
+                    return QVariant();
+                }
+
+                if (!map.contains(name))
+                {
+                    map.insert(name, value);
+                }
+            }
+
+            return error() ? QVariant() : QVariant(map);
+        }
+
+    case BeginArray:
+        {
+            QVariantList list;
+            while (readNext() != EndArray)
+            {
+                QVariant value = readValue();
+                if (error())
+                {
+                    return QVariant();
+                }
+                list << value;
+            }
+
+            return QVariant(list);
+        }
+
+    case String:
+        return QVariant(m_stringValue);
+
+    case Number:
+        return numberValue();
+
+    case True:
+        return QVariant(true);
+
+    case False:
+        return QVariant(false);
+
+    case Null:
+        return QVariant();
+
+    default:
+        if (!error())
+        {
+            setError("Expected a value");
+        }
+        return QVariant();
+    }
+}
+
+
+/** Read an entire document.
+  *
+  * \return the value of the document, or an invalid QVariant if the document is
+  * empty or there was an error
+  */
+QVariant
+JsonReader::read()
+{
+    if (readNext() == EndToken)
+    {
+        return QVariant();
+    }
+
+    QVariant value = readValue();
+    if (!error() && readNext() != EndToken)
+    {
+        return QVariant();
+    }
+
+    return error() ? QVariant() : value;
+}
@@ -0,0 +1,146 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _CATALOG_JSON_READER_H_
+#define _CATALOG_JSON_READER_H_
+
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+#include <QHash>
+#include <vector>
+
+
+/** JsonReader is a pull parser for the JSON text of catalog files. It reads
+  * directly from UTF-8 encoded data, and it skips C and C++ style comments
+  * anywhere that whitespace is allowed (but not inside strings.)
+  *
+  * Tokens are read one at a time with readNext(); read() builds a complete
+  * QVariant tree instead. Values are converted to exactly the same QVariant
+  * types as QJson produces: integers are LongLong or ULongLong, numbers with
+  * a fraction are Double, and numbers with an exponent are kept as ByteArray
+  * text. The jsonparity tool checks this against QJson for the bundled catalogs.
+  */
+class JsonReader
+{
+public:
+    JsonReader(const QByteArray& data);
+    ~JsonReader();
+
+    enum TokenType
+    {
+        NoToken,
+        EndToken,
+        Invalid,
+        BeginObject,
+        EndObject,
+        BeginArray,
+        EndArray,
+        Name,
+        String,
+        Number,
+        True,
+        False,
+        Null,
+    };
+
+    TokenType readNext();
+    QVariant readValue();
+    QVariant read();
+
+    TokenType currentToken() const
+    {
+        return m_currentTokenType;
+    }
+
+    /** Get the text of the current Name or String token.
+      */
+    QString stringValue() const
+    {
+        return m_stringValue;
+    }
+
+    QVariant numberValue() const;
+
+    QString errorMessage() const
+    {
+        return m_errorMessage;
+    }
+
+    /** Get the line number (starting from 1) where an error occurred.
+      */
+    int errorLine() const
+    {
+        return m_errorLine;
+    }
+
+    bool error() const
+    {
+        return m_currentTokenType == Invalid;
+    }
+
+    bool atEnd() const
+    {
+        return m_currentTokenType == EndToken;
+    }
+
+    static const unsigned int MaxNestingDepth = 512;
+
+private:
+    enum State
+    {
+        ExpectValue,
+        ExpectValueOrEndArray,
+        ExpectName,
+        ExpectNameOrEndObject,
+        ExpectSeparator,
+        ExpectEnd,
+    };
+
+    TokenType setError(const QString& message);
+    bool skipWhitespace();
+    bool readString(bool isName);
+    bool readNumber();
+    bool readLiteral(const char* rest);
+    TokenType beginContainer(char type, TokenType token);
+    TokenType endContainer(TokenType token);
+    State stateAfterValue() const;
+
+private:
+    QByteArray m_data;
+    const char* m_pos;
+    const char* m_end;
+    int m_line;
+
+    TokenType m_currentTokenType;
+    State m_state;
+    std::vector<char> m_containers;
+
+    QString m_stringValue;
+    const char* m_numberStart;
+    int m_numberLength;
+    bool m_numberHasFraction;
+    bool m_numberHasExponent;
+
+    // Object member names are shared between all objects that use them
+    QHash<QByteArray, QString> m_names;
+
+    QString m_errorMessage;
+    int m_errorLine;
+};
+
+#endif // _CATALOG_JSON_READER_H_
@@ -16,7 +16,9 @@
 
 #include "UniverseLoader.h"
 #include "AstorbLoader.h"
+#include "CatalogCache.h"
 #include "ChebyshevPolyFileLoader.h"
+#include "JsonReader.h"
 #include "../TleTrajectory.h"
 #include "../InterpolatedStateTrajectory.h"
 #include "../InterpolatedRotation.h"
@@ -38,7 +40,9 @@
 #include "../vext/ArcStripParticleGenerator.h"
 #include "../vext/PathRelativeTextureLoader.h"
 #include "../vext/NameTemplateTiledMap.h"
+#include "../vext/ArchiveTiledMap.h"
 #include "../vext/CompositeTrajectory.h"
+#include "../vext/AtmosphereCache.h"
 #include "../astro/Rotation.h"
 #include "../Viewpoint.h"
 #include <vesta/Units.h>
@@ -56,6 +60,7 @@
 #include <vesta/WorldGeometry.h>
 #include <vesta/Atmosphere.h>
 #include <vesta/DataChunk.h>
+#include <vesta/Material.h>
 #include <vesta/ArrowGeometry.h>
 #include <vesta/PlanetaryRings.h>
 #include <vesta/SensorFrustumGeometry.h>
@@ -71,6 +76,8 @@
 #ifdef SPICE_ENABLED
 #include "../spice/SpiceTrajectory.h"
 #include "../spice/SpiceRotationModel.h"
+#include "../spice/SpiceLock.h"
+#include <QMutexLocker>
 #endif
 
 #include <vesta/particlesys/ParticleEmitter.h>
@@ -78,7 +85,6 @@
 #include <vesta/particlesys/BoxGenerator.h>
 #include <vesta/particlesys/DiscGenerator.h>
 
-#include <qjson/parser.h>
 #include <qjson/serializer.h>
 
 #include <QDateTime>
@@ -86,7 +92,12 @@
 #include <QFileInfo>
 #include <QRegExp>
 #include <QBuffer>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
 #include <QDebug>
+#include <vector>
+#include <cstring>
 
 using namespace vesta;
 using namespace Eigen;
@@ -189,13 +200,54 @@ static bool readNextQuaternion(Scanner* scanner, Quaterniond* value)
 }
 
 
+// Records of sample files are cached as a flat array of doubles
+static bool
+LoadCachedSamples(const CatalogCache* cache, const QByteArray& key, unsigned int recordSize, std::vector<double>* samples)
+{
+    QVariant cached;
+    if (!cache || !cache->load(key, &cached))
+    {
+        return false;
+    }
+
+    QByteArray data = cached.toByteArray();
+    if (data.size() % (recordSize * sizeof(double)) != 0)
+    {
+        return false;
+    }
+
+    samples->resize(data.size() / sizeof(double));
+    if (!samples->empty())
+    {
+        memcpy(&(*samples)[0], data.constData(), data.size());
+    }
+
+    return true;
+}
+
+
+static void
+SaveCachedSamples(const CatalogCache* cache, const QByteArray& key, const std::vector<double>& samples)
+{
+    if (cache)
+    {
+        QByteArray data;
+        if (!samples.empty())
+        {
+            data = QByteArray(reinterpret_cast<const char*>(&samples[0]), samples.size() * sizeof(double));
+        }
+        cache->save(key, data);
+    }
+}
+
+
 /** Load a list of time/state vector records from a file. The values
   * are stored in ASCII format with newline terminated hash comments
   * allowed. Dates are given as TDB Julian dates, positions are
   * in units of kilometers, and velocities are km/sec.
   */
 InterpolatedStateTrajectory*
-LoadXYZVTrajectory(const QString& fileName)
+LoadXYZVTrajectory(const QString& fileName, const CatalogCache* cache)
 {
     QFile file(fileName);
     if (!file.open(QIODevice::ReadOnly))
@@ -204,9 +256,31 @@ LoadXYZVTrajectory(const QString& fileName)
         return NULL;
     }
 
+    QByteArray data = file.readAll();
     InterpolatedStateTrajectory::TimeStateList states;
+    std::vector<double> samples;
+
+    QByteArray cacheKey;
+    if (cache)
+    {
+        cacheKey = CatalogCache::Key("xyzv", data);
+        if (LoadCachedSamples(cache, cacheKey, 7, &samples))
+        {
+            for (unsigned int i = 0; i < samples.size(); i += 7)
+            {
+                InterpolatedStateTrajectory::TimeState state;
+                state.tsec = samples[i];
+                state.state = StateVector(Vector3d(samples[i + 1], samples[i + 2], samples[i + 3]),
+                                          Vector3d(samples[i + 4], samples[i + 5], samples[i + 6]));
+                states.push_back(state);
+            }
+            return new InterpolatedStateTrajectory(states);
+        }
+    }
 
-    Scanner scanner(&file);
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    Scanner scanner(&buffer);
     bool ok = true;
     bool done = false;
     while (!done)
@@ -238,6 +312,10 @@ LoadXYZVTrajectory(const QString& fileName)
             state.tsec = tdbSec;
             state.state = StateVector(position, velocity);
             states.push_back(state);
+
+            samples.push_back(tdbSec);
+            samples.insert(samples.end(), position.data(), position.data() + 3);
+            samples.insert(samples.end(), velocity.data(), velocity.data() + 3);
         }
     }
 
@@ -248,6 +326,7 @@ LoadXYZVTrajectory(const QString& fileName)
     }
     else
     {
+        SaveCachedSamples(cache, cacheKey, samples);
         return new InterpolatedStateTrajectory(states);
     }
 }
@@ -259,7 +338,7 @@ LoadXYZVTrajectory(const QString& fileName)
   * in units of kilometers.
   */
 InterpolatedStateTrajectory*
-LoadXYZTrajectory(const QString& fileName)
+LoadXYZTrajectory(const QString& fileName, const CatalogCache* cache)
 {
     QFile file(fileName);
     if (!file.open(QIODevice::ReadOnly))
@@ -268,9 +347,30 @@ LoadXYZTrajectory(const QString& fileName)
         return NULL;
     }
 
+    QByteArray data = file.readAll();
     InterpolatedStateTrajectory::TimePositionList positions;
+    std::vector<double> samples;
+
+    QByteArray cacheKey;
+    if (cache)
+    {
+        cacheKey = CatalogCache::Key("xyz", data);
+        if (LoadCachedSamples(cache, cacheKey, 4, &samples))
+        {
+            for (unsigned int i = 0; i < samples.size(); i += 4)
+            {
+                InterpolatedStateTrajectory::TimePosition record;
+                record.tsec = samples[i];
+                record.position = Vector3d(samples[i + 1], samples[i + 2], samples[i + 3]);
+                positions.push_back(record);
+            }
+            return new InterpolatedStateTrajectory(positions);
+        }
+    }
 
-    Scanner scanner(&file);
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    Scanner scanner(&buffer);
     bool ok = true;
     bool done = false;
     while (!done)
@@ -301,6 +401,9 @@ LoadXYZTrajectory(const QString& fileName)
             record.tsec = tdbSec;
             record.position = position;
             positions.push_back(record);
+
+            samples.push_back(tdbSec);
+            samples.insert(samples.end(), position.data(), position.data() + 3);
         }
     }
 
@@ -311,6 +414,7 @@ LoadXYZTrajectory(const QString& fileName)
     }
     else
     {
+        SaveCachedSamples(cache, cacheKey, samples);
         return new InterpolatedStateTrajectory(positions);
     }
 }
@@ -329,7 +433,7 @@ enum RotationConvention
   * real part of the quaternion is before the imaginary parts.)
   */
 InterpolatedRotation*
-LoadInterpolatedRotation(const QString& fileName, RotationConvention mode)
+LoadInterpolatedRotation(const QString& fileName, RotationConvention mode, const CatalogCache* cache)
 {
     QFile file(fileName);
     if (!file.open(QIODevice::ReadOnly))
@@ -338,9 +442,31 @@ LoadInterpolatedRotation(const QString& fileName, RotationConvention mode)
         return NULL;
     }
 
+    QByteArray data = file.readAll();
     InterpolatedRotation::TimeOrientationList orientations;
+    std::vector<double> samples;
+
+    // Orientations are cached after conversion, so the convention is part of the key
+    QByteArray cacheKey;
+    if (cache)
+    {
+        cacheKey = CatalogCache::Key(mode == Celestia_Rotation ? "q-celestia" : "q", data);
+        if (LoadCachedSamples(cache, cacheKey, 5, &samples))
+        {
+            for (unsigned int i = 0; i < samples.size(); i += 5)
+            {
+                InterpolatedRotation::TimeOrientation record;
+                record.tsec = samples[i];
+                record.orientation = Quaterniond(samples[i + 1], samples[i + 2], samples[i + 3], samples[i + 4]);
+                orientations.push_back(record);
+            }
+            return new InterpolatedRotation(orientations);
+        }
+    }
 
-    Scanner scanner(&file);
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    Scanner scanner(&buffer);
     bool ok = true;
     bool done = false;
     while (!done)
@@ -384,6 +510,12 @@ LoadInterpolatedRotation(const QString& fileName, RotationConvention mode)
             }
 
             orientations.push_back(record);
+
+            samples.push_back(tdbSec);
+            samples.push_back(record.orientation.w());
+            samples.push_back(record.orientation.x());
+            samples.push_back(record.orientation.y());
+            samples.push_back(record.orientation.z());
         }
     }
 
@@ -394,20 +526,379 @@ LoadInterpolatedRotation(const QString& fileName, RotationConvention mode)
     }
     else
     {
+        SaveCachedSamples(cache, cacheKey, samples);
         return new InterpolatedRotation(orientations);
     }
 }
 
 
+/** Read a JSON catalog file and parse it. If the catalog cache isn't null and
+  * the file is unchanged since it was last parsed, the cached contents are used
+  * instead. This function doesn't modify any loader state, so it may be called
+  * from a worker thread.
+  */
+static bool
+ParseCatalogFile(const QString& path, const CatalogCache* cache, QVariantMap* contents, QString* errorMessage)
+{
+    QFile catalogFile(path);
+    if (!catalogFile.open(QIODevice::ReadOnly))
+    {
+        *errorMessage = QString("Cannot open required file %1").arg(path);
+        return false;
+    }
+
+    QByteArray catalogData = catalogFile.readAll();
+
+    QByteArray cacheKey;
+    if (cache)
+    {
+        cacheKey = CatalogCache::Key("catalog", catalogData);
+        QVariant cached;
+        if (cache->load(cacheKey, &cached))
+        {
+            *contents = cached.toMap();
+            return true;
+        }
+    }
+
+    // The reader skips comments itself, and builds the value tree straight from
+    // the UTF-8 data without converting the whole file to a QString.
+    JsonReader reader(catalogData);
+    QVariant result = reader.read();
+    if (reader.error())
+    {
+        *errorMessage = QString("Error in %1, line %2: %3").arg(path).arg(reader.errorLine()).arg(reader.errorMessage());
+        return false;
+    }
+
+    *contents = result.toMap();
+
+    if (cache)
+    {
+        cache->save(cacheKey, *contents);
+    }
+
+    return true;
+}
+
+
+/** Load a mesh file and optimize it for rendering. The optimizations can be expensive
+  * for large meshes, but they can dramatically improve rendering performance. The best
+  * solution is to use mesh files that are already optimized, but the average model
+  * loaded off the web benefits from some preprocessing at load time.
+  *
+  * This function doesn't modify any loader state, so it may be called from a worker
+  * thread provided that the texture loader isn't shared with another thread.
+  */
+static MeshGeometry*
+LoadOptimizedMesh(const QString& fileName, TextureMapLoader* textureLoader, QString* errorMessage)
+{
+    MeshGeometry* meshGeometry = NULL;
+    if (fileName.toLower().endsWith(".cmod"))
+    {
+        QFile cmodFile(fileName);
+        if (!cmodFile.open(QIODevice::ReadOnly))
+        {
+            *errorMessage = QString("Error opening cmod file '%1'").arg(fileName);
+        }
+        else
+        {
+            CmodLoader loader(&cmodFile, textureLoader);
+            meshGeometry = loader.loadMesh();
+            if (loader.error())
+            {
+                *errorMessage = QString("Error loading cmod file %1: %2").arg(fileName, loader.errorMessage());
+            }
+        }
+    }
+    else
+    {
+        meshGeometry = MeshGeometry::loadFromFile(fileName.toUtf8().data(), textureLoader);
+    }
+
+    if (meshGeometry)
+    {
+        meshGeometry->mergeSubmeshes();
+        meshGeometry->uniquifyVertices();
+        meshGeometry->mergeMaterials();
+        meshGeometry->compressIndices();
+    }
+
+    return meshGeometry;
+}
+
+
+// Texture loader used for meshes that are loaded by worker threads. The shared
+// texture loader isn't thread safe, so the textures created here are just
+// placeholders that record a texture name and properties; they're replaced by
+// UniverseLoader::resolveMeshTextures() on the loader's thread.
+class DeferredTextureLoader : public TextureMapLoader
+{
+public:
+    virtual bool handleMakeResident(TextureMap* /* texture */)
+    {
+        return false;
+    }
+};
+
+
+// A file to be read by a catalog loading task. Each task writes only to its own
+// item, and an item is only read after its task has finished.
+struct CatalogLoadItem
+{
+    enum FileType
+    {
+        CatalogFile,
+        SampledTrajectoryFile,
+        ChebyshevTrajectoryFile,
+        SampledRotationFile,
+        MeshFile,
+    };
+
+    CatalogLoadItem(FileType _type, const QString& _fileName, const QString& _key) :
+        type(_type),
+        fileName(_fileName),
+        key(_key),
+        rotationConvention(Standard_Rotation),
+        loadTextures(false),
+        cache(NULL),
+        trajectory(NULL),
+        rotation(NULL),
+        mesh(NULL),
+        finished(0)
+    {
+    }
+
+    FileType type;
+    QString fileName;
+    QString key;
+    RotationConvention rotationConvention;
+    bool loadTextures;
+    const CatalogCache* cache;
+
+    QVariantMap contents;
+    QString errorMessage;
+    Trajectory* trajectory;
+    RotationModel* rotation;
+    MeshGeometry* mesh;
+    counted_ptr<TextureMapLoader> textureLoader;
+
+    // Set by the task once all of the results above have been written
+    QAtomicInt finished;
+};
+
+
+class CatalogLoadTask : public QRunnable
+{
+public:
+    CatalogLoadTask(CatalogLoadItem* item) :
+        m_item(item)
+    {
+    }
+
+    virtual void run()
+    {
+        switch (m_item->type)
+        {
+        case CatalogLoadItem::CatalogFile:
+            ParseCatalogFile(m_item->fileName, m_item->cache, &m_item->contents, &m_item->errorMessage);
+            break;
+
+        case CatalogLoadItem::SampledTrajectoryFile:
+            if (m_item->fileName.toLower().endsWith(".xyzv"))
+            {
+                m_item->trajectory = LoadXYZVTrajectory(m_item->fileName, m_item->cache);
+            }
+            else
+            {
+                m_item->trajectory = LoadXYZTrajectory(m_item->fileName, m_item->cache);
+            }
+            break;
+
+        case CatalogLoadItem::ChebyshevTrajectoryFile:
+            m_item->trajectory = LoadChebyshevPolyFile(m_item->fileName);
+            break;
+
+        case CatalogLoadItem::SampledRotationFile:
+            m_item->rotation = LoadInterpolatedRotation(m_item->fileName, m_item->rotationConvention, m_item->cache);
+            break;
+
+        case CatalogLoadItem::MeshFile:
+            if (m_item->loadTextures)
+            {
+                m_item->textureLoader = new DeferredTextureLoader();
+            }
+            m_item->mesh = LoadOptimizedMesh(m_item->fileName, m_item->textureLoader.ptr(), &m_item->errorMessage);
+            break;
+        }
+
+        m_item->finished.storeRelease(1);
+    }
+
+private:
+    CatalogLoadItem* m_item;
+};
+
+
+// Create a load item for a file referenced by a catalog, or return null if the
+// file doesn't exist.
+static CatalogLoadItem*
+PrefetchItem(CatalogLoadItem::FileType type, const QString& fileName)
+{
+    QString path = QFileInfo(fileName).canonicalFilePath();
+    if (path.isEmpty())
+    {
+        return NULL;
+    }
+
+    return new CatalogLoadItem(type, path, path);
+}
+
+
+// Find the sample, Chebyshev polynomial, and mesh files referenced anywhere in a
+// catalog definition. File names are relative to the search path, which is both
+// the data and model search path while the catalog is loaded.
+static void
+FindReferencedFiles(const QVariant& value, const QString& searchPath, QList<CatalogLoadItem*>* items)
+{
+    if (value.type() == QVariant::List)
+    {
+        foreach (QVariant v, value.toList())
+        {
+            FindReferencedFiles(v, searchPath, items);
+        }
+    }
+    else if (value.type() == QVariant::Map)
+    {
+        QVariantMap map = value.toMap();
+        QString type = map.value("type").toString();
+        QString source = map.value("source").toString();
+        QString fileName = searchPath + "/" + source;
+
+        // Missing files are reported when the catalog is loaded
+        CatalogLoadItem* item = NULL;
+        if (!source.isEmpty())
+        {
+            if (type == "InterpolatedStates" && (source.toLower().endsWith(".xyzv") || source.toLower().endsWith(".xyz")))
+            {
+                item = PrefetchItem(CatalogLoadItem::SampledTrajectoryFile, fileName);
+            }
+            else if (type == "ChebyshevPoly")
+            {
+                item = PrefetchItem(CatalogLoadItem::ChebyshevTrajectoryFile, fileName);
+            }
+            else if (type == "Interpolated" && source.toLower().endsWith(".q"))
+            {
+                item = PrefetchItem(CatalogLoadItem::SampledRotationFile, fileName);
+                if (item && map.value("compatibility").toString() == "celestia")
+                {
+                    item->rotationConvention = Celestia_Rotation;
+                    item->key += "|celestia";
+                }
+            }
+            else if (type == "Mesh")
+            {
+                item = PrefetchItem(CatalogLoadItem::MeshFile, fileName);
+            }
+        }
+
+        if (item)
+        {
+            *items << item;
+        }
+
+        foreach (QVariant v, map)
+        {
+            FindReferencedFiles(v, searchPath, items);
+        }
+    }
+}
+
+
+// Find the files that will be read when a prefetched catalog is loaded: the
+// catalog files that it requires, and the sample, Chebyshev polynomial, and mesh
+// files referenced anywhere in its items. loadCatalogFile() sets the data and
+// model search paths to the directory containing the catalog, so names are
+// resolved relative to that directory here; the loader's own search paths are
+// left alone. SSC files are omitted, as they're always read as they are loaded.
+static void
+FindPrefetchFiles(const QString& catalogPath, const QVariantMap& contents, QList<CatalogLoadItem*>* items)
+{
+    QString searchPath = QFileInfo(catalogPath).absolutePath();
+
+    foreach (QVariant v, contents.value("require").toList())
+    {
+        QString fileName = v.toString();
+        if (!fileName.isEmpty() && !fileName.toLower().endsWith(".ssc"))
+        {
+            QString path = QFileInfo(searchPath + "/" + fileName).canonicalFilePath();
+            if (!path.isEmpty())
+            {
+                *items << new CatalogLoadItem(CatalogLoadItem::CatalogFile, path, path);
+            }
+        }
+    }
+
+    FindReferencedFiles(contents.value("items"), searchPath, items);
+}
+
+
+/** Remove an object read by a catalog loading task from a table of prefetched
+  * objects. Returns false if the file wasn't prefetched. The object may be null
+  * if there was an error reading the file.
+  */
+template<class T> static bool
+TakePrefetchedObject(QHash<QString, T*>& table, const QString& fileName, const QString& keySuffix, T** object)
+{
+    if (table.isEmpty())
+    {
+        return false;
+    }
+
+    typename QHash<QString, T*>::iterator iter = table.find(QFileInfo(fileName).canonicalFilePath() + keySuffix);
+    if (iter == table.end())
+    {
+        return false;
+    }
+
+    *object = iter.value();
+    table.erase(iter);
+
+    return true;
+}
+
+
 UniverseLoader::UniverseLoader() :
     m_dataSearchPath("."),
-    m_texturesInModelDirectory(true)
+    m_texturesInModelDirectory(true),
+    m_atmosphereTexturesEnabled(true),
+    m_threadPool(NULL),
+    m_parallelLoadingEnabled(true),
+    m_meshThreadPool(NULL),
+    m_asynchronousMeshLoadingEnabled(false)
 {
+    // Catalog loading uses its own thread pool; waiting for the global pool
+    // could block on unrelated long running tasks.
+    m_threadPool = new QThreadPool();
+
+    // Asynchronous mesh loads get a separate pool so that prefetching catalog
+    // files never waits for them.
+    m_meshThreadPool = new QThreadPool();
 }
 
 
 UniverseLoader::~UniverseLoader()
 {
+    clearPrefetchedFiles();
+    delete m_threadPool;
+
+    m_meshThreadPool->waitForDone();
+    foreach (PendingMesh pending, m_pendingMeshes)
+    {
+        delete pending.item->mesh;
+        delete pending.item;
+    }
+    delete m_meshThreadPool;
 }
 
 
@@ -1026,7 +1517,21 @@ UniverseLoader::loadChebyshevPolynomialsTrajectory(const QVariantMap& info)
             return trajectory.ptr();
         }
 
-        ChebyshevPolyTrajectory* chebTrajectory = LoadChebyshevPolyFile(fileName);
+        ChebyshevPolyTrajectory* chebTrajectory = NULL;
+        Trajectory* prefetchedTrajectory = NULL;
+        if (TakePrefetchedObject(m_prefetchedTrajectories, fileName, QString(), &prefetchedTrajectory))
+        {
+            chebTrajectory = dynamic_cast<ChebyshevPolyTrajectory*>(prefetchedTrajectory);
+            if (!chebTrajectory)
+            {
+                delete prefetchedTrajectory;
+            }
+        }
+        else
+        {
+            chebTrajectory = LoadChebyshevPolyFile(fileName);
+        }
+
         if (chebTrajectory && isPeriodic)
         {
             chebTrajectory->setPeriod(period);
@@ -1060,13 +1565,18 @@ UniverseLoader::loadInterpolatedStatesTrajectory(const QVariantMap& info)
         QString name = info.value("source").toString();
 
         QString fileName = dataFileName(name);
-        if (name.toLower().endsWith(".xyzv"))
+        Trajectory* prefetchedTrajectory = NULL;
+        if (TakePrefetchedObject(m_prefetchedTrajectories, fileName, QString(), &prefetchedTrajectory))
         {
-            return LoadXYZVTrajectory(fileName);
+            return prefetchedTrajectory;
+        }
+        else if (name.toLower().endsWith(".xyzv"))
+        {
+            return LoadXYZVTrajectory(fileName, catalogCache());
         }
         else if (name.toLower().endsWith(".xyz"))
         {
-            return LoadXYZTrajectory(fileName);
+            return LoadXYZTrajectory(fileName, catalogCache());
         }
         else
         {
@@ -1360,6 +1870,7 @@ bool getNAIFCode(const QVariant& v, SpiceInt* code)
     else if (v.canConvert(QVariant::String))
     {
         SpiceBoolean found = SPICEFALSE;
+        QMutexLocker locker(&SpiceMutex);
         bodn2c_c(v.toString().toLatin1().data(), code, &found);
         return found == SPICETRUE;
     }
@@ -1675,9 +2186,15 @@ UniverseLoader::loadInterpolatedRotationModel(const QVariantMap& info)
         }
 
         QString fileName = dataFileName(name);
-        if (name.toLower().endsWith(".q"))
+        QString keySuffix = rotationConvention == Celestia_Rotation ? "|celestia" : "";
+        RotationModel* prefetchedRotation = NULL;
+        if (TakePrefetchedObject(m_prefetchedRotations, fileName, keySuffix, &prefetchedRotation))
+        {
+            return prefetchedRotation;
+        }
+        else if (name.toLower().endsWith(".q"))
         {
-            return LoadInterpolatedRotation(fileName, rotationConvention);
+            return LoadInterpolatedRotation(fileName, rotationConvention, catalogCache());
         }
         else
         {
@@ -2372,6 +2889,7 @@ loadTiledMap(const QVariantMap& map, PathRelativeTextureLoader* textureLoader)
         QVariant tileSizeVar = map.value("tileSize");
         QVariant levelCountVar = map.value("levelCount");
         QVariant borderThicknessVar = map.value("tileBorderThickness");
+        QVariant manifestVar = map.value("manifest");
 
         if (!templateNameVar.isValid())
         {
@@ -2420,6 +2938,65 @@ loadTiledMap(const QVariantMap& map, PathRelativeTextureLoader* textureLoader)
             tiledMap->setTextureUsage(TextureProperties::CompressedNormalMap);
         }
 
+        // Optionally use a manifest of available tiles instead of requesting
+        // tiles that may not exist.
+        if (manifestVar.toBool())
+        {
+            tiledMap->enableManifest();
+        }
+
+        return tiledMap;
+    }
+    else if (type == "TileArchive")
+    {
+        QVariant archiveVar = map.value("archive");
+        QVariant tileSizeVar = map.value("tileSize");
+        QVariant borderThicknessVar = map.value("tileBorderThickness");
+
+        if (archiveVar.type() != QVariant::String)
+        {
+            qDebug() << "Bad or missing archive name for TileArchive tiled texture";
+            return NULL;
+        }
+
+        if (!tileSizeVar.canConvert(QVariant::UInt))
+        {
+            qDebug() << "Bad or missing tileSize for TileArchive tiled texture";
+            return NULL;
+        }
+
+        float borderThickness = 0.0f;
+        if (borderThicknessVar.isValid())
+        {
+            bool ok = false;
+            borderThickness = borderThicknessVar.toFloat(&ok);
+            if (!ok)
+            {
+                qDebug() << "TileArchive tiled texture has invalid border thickness.";
+                return NULL;
+            }
+        }
+
+        QString archiveName = QString::fromUtf8(textureLoader->searchPath().c_str()) + QString("/") + archiveVar.toString();
+        QSharedPointer<TileArchive> archive = TileArchive::open(archiveName);
+        if (archive.isNull())
+        {
+            qDebug() << "Failed to open tile archive " << archiveName;
+            return NULL;
+        }
+
+        // Enforce some limits on tile size; adjust it to improve sharpness as for
+        // NameTemplate maps.
+        unsigned int tileSize = std::max(128u, std::min(8192u, tileSizeVar.toUInt()));
+        tileSize = (tileSize * 3) / 5;
+
+        ArchiveTiledMap* tiledMap = new ArchiveTiledMap(textureLoader, archive, tileSize);
+        tiledMap->setTileBorderFraction(borderThickness);
+        if (archive->tileFormat() == TileArchive::DDSFormat)
+        {
+            tiledMap->setTextureUsage(TextureProperties::CompressedNormalMap);
+        }
+
         return tiledMap;
     }
     else
@@ -2445,55 +3022,219 @@ UniverseLoader::loadMeshFile(const QString& fileName)
         // Set the texture loader path to search in the model file's directory for texture files
         // except when loading SSC files, when the texturesInModelDirectory property will be false.
         QFileInfo info(fileName);
-        QString savedPath = QString::fromUtf8(m_textureLoader->searchPath().c_str());
-        if (m_texturesInModelDirectory)
+        QString savedPath;
+        if (m_textureLoader.isValid())
         {
-            m_textureLoader->setSearchPath(info.absolutePath().toUtf8().data());
+            savedPath = QString::fromUtf8(m_textureLoader->searchPath().c_str());
+            if (m_texturesInModelDirectory)
+            {
+                m_textureLoader->setSearchPath(info.absolutePath().toUtf8().data());
+            }
         }
 
         MeshGeometry* meshGeometry = NULL;
-        if (fileName.toLower().endsWith(".cmod"))
+        QString loadErrorMessage;
+        QHash<QString, PrefetchedMesh>::iterator iter = m_prefetchedMeshes.end();
+        if (!m_prefetchedMeshes.isEmpty())
         {
-            QFile cmodFile(fileName);
-            if (!cmodFile.open(QIODevice::ReadOnly))
-            {
-                errorMessage(QString("Error opening cmod file '%1'").arg(fileName));
-            }
-            else
+            iter = m_prefetchedMeshes.find(info.canonicalFilePath());
+        }
+
+        if (iter != m_prefetchedMeshes.end())
+        {
+            // The mesh was loaded and optimized by a worker thread
+            meshGeometry = iter->mesh;
+            loadErrorMessage = iter->errorMessage;
+            if (meshGeometry)
             {
-                CmodLoader loader(&cmodFile, m_textureLoader.ptr());
-                meshGeometry = loader.loadMesh();
-                if (loader.error())
-                {
-                    errorMessage(QString("Error loading cmod file %1: %2").arg(fileName, loader.errorMessage()));
-                }
+                resolveMeshTextures(meshGeometry);
             }
+            m_prefetchedMeshes.erase(iter);
         }
         else
         {
-            meshGeometry = MeshGeometry::loadFromFile(fileName.toUtf8().data(), m_textureLoader.ptr());
+            meshGeometry = LoadOptimizedMesh(fileName, m_textureLoader.ptr(), &loadErrorMessage);
+        }
+
+        if (!loadErrorMessage.isEmpty())
+        {
+            errorMessage(loadErrorMessage);
         }
 
         if (meshGeometry)
         {
-            // Optimize the mesh. The optimizations can be expensive for large meshes, but they can dramatically
-            // improve rendering performance. The best solution is to use mesh files that are already optimized, but
-            // the average model loaded off the web benefits from some preprocessing at load time.
-            meshGeometry->mergeSubmeshes();
-            meshGeometry->uniquifyVertices();
-            meshGeometry->mergeMaterials();
-            meshGeometry->compressIndices();
             m_geometryCache.insert(fileName, vesta::counted_ptr<Geometry>(meshGeometry));
             geometry = meshGeometry;
         }
 
-        m_textureLoader->setSearchPath(savedPath.toUtf8().data());
+        if (m_textureLoader.isValid())
+        {
+            m_textureLoader->setSearchPath(savedPath.toUtf8().data());
+        }
     }
 
     return geometry;
 }
 
 
+/** Replace the placeholder textures of a mesh loaded by a worker thread with textures
+  * from the texture loader. The texture loader's search path must already be set
+  * for the mesh.
+  */
+void
+UniverseLoader::resolveMeshTextures(MeshGeometry* mesh)
+{
+    QHash<TextureMap*, TextureMap*> resolved;
+    TextureMap* textures[3];
+
+    for (unsigned int i = 0; i < mesh->materialCount(); ++i)
+    {
+        Material* material = mesh->material(i);
+        textures[0] = material->baseTexture();
+        textures[1] = material->normalTexture();
+        textures[2] = material->specularTexture();
+
+        // The same placeholder may be used by several materials
+        for (unsigned int j = 0; j < 3; ++j)
+        {
+            TextureMap* placeholder = textures[j];
+            if (placeholder)
+            {
+                if (!resolved.contains(placeholder))
+                {
+                    TextureMap* texture = NULL;
+                    if (m_textureLoader.isValid())
+                    {
+                        texture = m_textureLoader->loadTexture(placeholder->name(), placeholder->properties());
+                    }
+                    resolved.insert(placeholder, texture);
+                }
+                textures[j] = resolved.value(placeholder);
+            }
+        }
+
+        material->setBaseTexture(textures[0]);
+        material->setNormalTexture(textures[1]);
+        material->setSpecularTexture(textures[2]);
+    }
+}
+
+
+/** Start loading a mesh file in a worker thread. The mesh will be set in the mesh
+  * instance by processLoadedMeshes() after loading has finished; a mesh file used by
+  * several instances is only loaded once. When the radius is greater than zero, the
+  * instance is scaled to fit the mesh in a sphere of that radius.
+  */
+void
+UniverseLoader::startMeshLoad(const QString& fileName, MeshInstanceGeometry* meshInstance, double radius)
+{
+    QHash<QString, PendingMesh>::iterator iter = m_pendingMeshes.find(fileName);
+    if (iter == m_pendingMeshes.end())
+    {
+        PendingMesh pending;
+        pending.item = new CatalogLoadItem(CatalogLoadItem::MeshFile, fileName, fileName);
+        pending.item->loadTextures = m_textureLoader.isValid();
+        pending.bodyName = m_currentBodyName;
+
+        // Record the texture search path that loadMeshFile() would use, since
+        // it may have changed by the time that the mesh is ready.
+        if (m_textureLoader.isValid())
+        {
+            if (m_texturesInModelDirectory)
+            {
+                pending.textureSearchPath = QFileInfo(fileName).absolutePath();
+            }
+            else
+            {
+                pending.textureSearchPath = QString::fromUtf8(m_textureLoader->searchPath().c_str());
+            }
+        }
+
+        iter = m_pendingMeshes.insert(fileName, pending);
+        m_meshThreadPool->start(new CatalogLoadTask(pending.item));
+    }
+
+    PendingMeshInstance instance;
+    instance.geometry = meshInstance;
+    instance.radius = radius;
+    iter->instances << instance;
+}
+
+
+/** Set the meshes that have finished loading in the background in the geometry
+  * waiting for them. This should be called regularly by the thread that loads
+  * catalogs when asynchronous mesh loading is enabled. Only the mesh data is read
+  * by the worker threads; vertex buffers and textures are created on the GL thread
+  * the first time that each mesh is drawn.
+  */
+void
+UniverseLoader::processLoadedMeshes()
+{
+    QHash<QString, PendingMesh>::iterator iter = m_pendingMeshes.begin();
+    while (iter != m_pendingMeshes.end())
+    {
+        CatalogLoadItem* item = iter->item;
+        if (item->finished.loadAcquire() == 0)
+        {
+            ++iter;
+            continue;
+        }
+
+        // Errors are reported for the item that first used the mesh, as
+        // they would be if the mesh had been loaded right away.
+        if (!item->errorMessage.isEmpty())
+        {
+            QString savedBodyName = m_currentBodyName;
+            m_currentBodyName = iter->bodyName;
+            errorMessage(item->errorMessage);
+            m_currentBodyName = savedBodyName;
+        }
+
+        MeshGeometry* mesh = item->mesh;
+        if (mesh)
+        {
+            QString savedPath;
+            if (m_textureLoader.isValid())
+            {
+                savedPath = QString::fromUtf8(m_textureLoader->searchPath().c_str());
+                m_textureLoader->setSearchPath(iter->textureSearchPath.toUtf8().data());
+            }
+
+            resolveMeshTextures(mesh);
+
+            if (m_textureLoader.isValid())
+            {
+                m_textureLoader->setSearchPath(savedPath.toUtf8().data());
+            }
+
+            m_geometryCache.insert(iter.key(), vesta::counted_ptr<Geometry>(mesh));
+            foreach (PendingMeshInstance instance, iter->instances)
+            {
+                instance.geometry->setMesh(mesh);
+                if (instance.radius > 0.0)
+                {
+                    instance.geometry->fitToRadius(float(instance.radius));
+                }
+            }
+        }
+
+        delete item;
+        iter = m_pendingMeshes.erase(iter);
+    }
+}
+
+
+/** Wait for all meshes being loaded in the background to finish loading, then
+  * set them in the geometry waiting for them.
+  */
+void
+UniverseLoader::waitForPendingMeshes()
+{
+    m_meshThreadPool->waitForDone();
+    processLoadedMeshes();
+}
+
+
 PlanetaryRings*
 UniverseLoader::loadRingSystemGeometry(const QVariantMap& map)
 {
@@ -2702,12 +3443,37 @@ UniverseLoader::loadGlobeGeometry(const QVariantMap& map)
             Atmosphere* atm = Atmosphere::LoadAtmScat(&chunk);
             if (atm)
             {
-                atm->generateTextures();
+                if (m_atmosphereTexturesEnabled)
+                {
+                    atm->generateTextures();
+                }
                 atm->addRef();
                 world->setAtmosphere(atm);
             }
         }
     }
+    else if (atmosphereVar.type() == QVariant::Map)
+    {
+        Atmosphere* atm = NULL;
+        if (radii.maxCoeff() > 0.0)
+        {
+            atm = loadAtmosphere(atmosphereVar.toMap(), radii.maxCoeff());
+        }
+        else
+        {
+            errorMessage("Globe radius must be given for atmosphere.");
+        }
+
+        if (atm)
+        {
+            if (m_atmosphereTexturesEnabled)
+            {
+                atm->generateTextures();
+            }
+            atm->addRef();
+            world->setAtmosphere(atm);
+        }
+    }
 
     QVariant ringsVar = map.value("ringSystem");
     if (ringsVar.isValid())
@@ -2727,6 +3493,58 @@ UniverseLoader::loadGlobeGeometry(const QVariantMap& map)
 }
 
 
+/** Create an atmosphere from a list of scattering parameters. Computing the
+  * scattering tables is expensive, so they're stored in the atmosphere cache
+  * and only computed when no tables for identical parameters are cached.
+  */
+Atmosphere*
+UniverseLoader::loadAtmosphere(const QVariantMap& map, double planetRadius)
+{
+    Atmosphere* atm = new Atmosphere();
+    atm->setPlanetRadius(float(planetRadius));
+
+    bool ok = true;
+    if (map.contains("rayleighScaleHeight"))
+    {
+        atm->setRayleighScaleHeight(float(distanceValue(map.value("rayleighScaleHeight"), Unit_Kilometer, 8.0, &ok)));
+    }
+
+    if (ok && map.contains("rayleighScattering"))
+    {
+        atm->setRayleighScatteringCoeff(vec3Value(map.value("rayleighScattering"), &ok).cast<float>());
+    }
+
+    if (ok && map.contains("mieScaleHeight"))
+    {
+        atm->setMieScaleHeight(float(distanceValue(map.value("mieScaleHeight"), Unit_Kilometer, 1.2, &ok)));
+    }
+
+    if (ok && map.contains("absorption"))
+    {
+        atm->setAbsorptionCoeff(vec3Value(map.value("absorption"), &ok).cast<float>());
+    }
+
+    if (!ok)
+    {
+        errorMessage("Invalid scattering parameters given for atmosphere.");
+        delete atm;
+        return NULL;
+    }
+
+    atm->setMieScatteringCoeff(float(doubleValue(map.value("mieScattering"), atm->mieScatteringCoeff())));
+    atm->setMieAsymmetry(float(doubleValue(map.value("mieAsymmetry"), atm->mieAsymmetry())));
+
+    AtmosphereCache cache;
+    Atmosphere* result = cache.findOrCompute(atm);
+    if (result != atm)
+    {
+        delete atm;
+    }
+
+    return result;
+}
+
+
 Geometry*
 UniverseLoader::loadMeshGeometry(const QVariantMap& map)
 {
@@ -2769,20 +3587,43 @@ UniverseLoader::loadMeshGeometry(const QVariantMap& map)
     if (map.contains("source"))
     {
         QString sourceName = map.value("source").toString();
-        MeshGeometry* mesh = dynamic_cast<MeshGeometry*>(loadMeshFile(modelFileName(sourceName)));
-
-        if (mesh)
+        QString fileName = modelFileName(sourceName);
+
+        // Only meshes with a size can be loaded in the background: the size of
+        // a mesh that is only scaled isn't known until its file has been read,
+        // and the body's classification and label fading are set up from it
+        // right after the geometry is loaded.
+        if (m_asynchronousMeshLoadingEnabled &&
+            radius > 0.0 &&
+            !m_geometryCache.contains(fileName) &&
+            !m_prefetchedMeshes.contains(QFileInfo(fileName).canonicalFilePath()))
+        {
+            // Nothing is drawn for the instance until the mesh has been loaded and
+            // set by processLoadedMeshes(); until then, the size stands in for the
+            // radius of the mesh.
+            meshInstance = new MeshInstanceGeometry(NULL);
+            meshInstance->setRadiusHint(float(radius));
+            startMeshLoad(fileName, meshInstance, radius);
+        }
+        else
         {
-            meshInstance = new MeshInstanceGeometry(mesh);
-            if (radius > 0.0)
+            MeshGeometry* mesh = dynamic_cast<MeshGeometry*>(loadMeshFile(fileName));
+            if (mesh)
             {
-                float maxExtent = mesh->meshBoundingBox().extents().maxCoeff();
-                meshInstance->setScale(radius * 2.0f / maxExtent);
-            }
-            else
-            {
-                meshInstance->setScale(float(scale));
+                meshInstance = new MeshInstanceGeometry(mesh);
+                if (radius > 0.0)
+                {
+                    meshInstance->fitToRadius(float(radius));
+                }
+                else
+                {
+                    meshInstance->setScale(float(scale));
+                }
             }
+        }
+
+        if (meshInstance)
+        {
             meshInstance->setMeshRotation(meshRotation);
             meshInstance->setMeshOffset(meshOffset);
         }
@@ -4046,7 +4887,23 @@ UniverseLoader::loadCatalogFile(const QString& fileName,
     }
     else
     {
-        return loadCatalogFile(fileName, catalog, 0);
+        // Read the catalog and everything that it requires ahead of time unless
+        // that was already done by an earlier call to prefetchCatalogFiles()
+        bool prefetched = false;
+        if (m_parallelLoadingEnabled && !m_prefetchedCatalogs.contains(QFileInfo(dataFileName(fileName)).canonicalFilePath()))
+        {
+            prefetchCatalogFiles(QStringList(fileName));
+            prefetched = true;
+        }
+
+        CatalogContents* contents = loadCatalogFile(fileName, catalog, 0);
+
+        if (prefetched)
+        {
+            clearPrefetchedFiles();
+        }
+
+        return contents;
     }
 }
 
@@ -4163,33 +5020,28 @@ UniverseLoader::loadCatalogFile(const QString& fileName,
         return contents;
     }
 
-    QFile catalogFile(path);
-    if (!catalogFile.open(QIODevice::ReadOnly))
+    // Use the parsed contents if the file was read ahead of time
+    QVariantMap contentsMap;
+    QString parseErrorMessage;
+    bool parseOk = false;
+    QHash<QString, PrefetchedCatalog>::const_iterator iter = m_prefetchedCatalogs.constFind(path);
+    if (iter != m_prefetchedCatalogs.constEnd())
     {
-        errorMessage(QString("Cannot open required file %1").arg(path));
-        return contents;
+        contentsMap = iter->contents;
+        parseErrorMessage = iter->errorMessage;
+        parseOk = parseErrorMessage.isEmpty();
+    }
+    else
+    {
+        parseOk = ParseCatalogFile(path, catalogCache(), &contentsMap, &parseErrorMessage);
     }
 
-    // Strip single-line C++ style comments from the JSON text. This is a
-    // temporary solution, as the regex used here doesn't properly distinguish
-    // and ignore comment characters in the middle of a string.
-    QString catalogText(catalogFile.readAll());
-    QRegExp stripComments("//[^\"]*[\n\r]");
-    stripComments.setMinimal(true);
-    QByteArray catalogBytes = catalogText.replace(stripComments, " ").toUtf8();
-    QBuffer buffer(&catalogBytes);
-
-    QJson::Parser parser;
-
-    bool parseOk = false;
-    QVariant result = parser.parse(&buffer, &parseOk);
     if (!parseOk)
     {
-        errorMessage(QString("Error in %1, line %2: %3").arg(path).arg(parser.errorLine()).arg(parser.errorString()));
+        errorMessage(parseErrorMessage);
         return contents;
     }
 
-    QVariantMap contentsMap = result.toMap();
     if (contentsMap.empty())
     {
         errorMessage("Solar system catalog is empty.");
@@ -4215,6 +5067,175 @@ UniverseLoader::loadCatalogFile(const QString& fileName,
 }
 
 
+/** Read catalog files ahead of time. The catalog files in the list, all of the
+  * catalog files that they require, and the sample, Chebyshev polynomial, and mesh
+  * files that they reference are read in parallel by worker threads. The require
+  * graph is traversed breadth first; catalogs required by more than one file are
+  * only read once.
+  *
+  * Nothing is added to the universe catalog here: the catalogs must still be loaded
+  * with loadCatalogFile(), which uses the prefetched files instead of reading them.
+  * Bodies are thus created in exactly the same order as when files are read during
+  * loading. Prefetched files are kept until clearPrefetchedFiles() is called.
+  */
+void
+UniverseLoader::prefetchCatalogFiles(const QStringList& fileNames)
+{
+    if (!m_parallelLoadingEnabled)
+    {
+        return;
+    }
+
+    // Files already in the caches or prefetched by an earlier call are skipped
+    QSet<QString> visited;
+    visited.unite(QSet<QString>::fromList(m_prefetchedTrajectories.keys()));
+    visited.unite(QSet<QString>::fromList(m_prefetchedRotations.keys()));
+    visited.unite(QSet<QString>::fromList(m_prefetchedMeshes.keys()));
+    foreach (QString fileName, m_trajectoryCache.keys())
+    {
+        visited.insert(QFileInfo(fileName).canonicalFilePath());
+    }
+    foreach (QString fileName, m_geometryCache.keys())
+    {
+        visited.insert(QFileInfo(fileName).canonicalFilePath());
+    }
+
+    QList<CatalogLoadItem*> items;
+    foreach (QString fileName, fileNames)
+    {
+        if (!fileName.toLower().endsWith(".ssc"))
+        {
+            QString path = QFileInfo(QFileInfo(fileName).isAbsolute() ? fileName : dataFileName(fileName)).canonicalFilePath();
+            if (!path.isEmpty())
+            {
+                items << new CatalogLoadItem(CatalogLoadItem::CatalogFile, path, path);
+            }
+        }
+    }
+
+    while (!items.isEmpty())
+    {
+        QList<CatalogLoadItem*> startedItems;
+        foreach (CatalogLoadItem* item, items)
+        {
+            if (visited.contains(item->key) || m_prefetchedCatalogs.contains(item->key))
+            {
+                delete item;
+            }
+            else if (item->type == CatalogLoadItem::MeshFile && m_asynchronousMeshLoadingEnabled)
+            {
+                // Meshes will be loaded in the background instead
+                delete item;
+            }
+            else
+            {
+                visited.insert(item->key);
+                item->loadTextures = m_textureLoader.isValid();
+                item->cache = catalogCache();
+                startedItems << item;
+
+                CatalogLoadTask* task = new CatalogLoadTask(item);
+                m_threadPool->start(task);
+            }
+        }
+        m_threadPool->waitForDone();
+
+        // Store the results. Files referenced by the catalogs just read are read
+        // in the next pass, along with the catalogs that they require.
+        items.clear();
+        foreach (CatalogLoadItem* item, startedItems)
+        {
+            switch (item->type)
+            {
+            case CatalogLoadItem::CatalogFile:
+                {
+                    PrefetchedCatalog catalog;
+                    catalog.contents = item->contents;
+                    catalog.errorMessage = item->errorMessage;
+                    m_prefetchedCatalogs.insert(item->key, catalog);
+
+                    FindPrefetchFiles(item->fileName, item->contents, &items);
+                }
+                break;
+
+            case CatalogLoadItem::SampledTrajectoryFile:
+            case CatalogLoadItem::ChebyshevTrajectoryFile:
+                m_prefetchedTrajectories.insert(item->key, item->trajectory);
+                break;
+
+            case CatalogLoadItem::SampledRotationFile:
+                m_prefetchedRotations.insert(item->key, item->rotation);
+                break;
+
+            case CatalogLoadItem::MeshFile:
+                {
+                    PrefetchedMesh mesh;
+                    mesh.mesh = item->mesh;
+                    mesh.textureLoader = item->textureLoader;
+                    mesh.errorMessage = item->errorMessage;
+                    m_prefetchedMeshes.insert(item->key, mesh);
+                }
+                break;
+            }
+
+            delete item;
+        }
+    }
+}
+
+
+/** Discard all files read by prefetchCatalogFiles() that haven't been used.
+  */
+void
+UniverseLoader::clearPrefetchedFiles()
+{
+    m_prefetchedCatalogs.clear();
+
+    foreach (Trajectory* trajectory, m_prefetchedTrajectories)
+    {
+        delete trajectory;
+    }
+    m_prefetchedTrajectories.clear();
+
+    foreach (RotationModel* rotation, m_prefetchedRotations)
+    {
+        delete rotation;
+    }
+    m_prefetchedRotations.clear();
+
+    foreach (PrefetchedMesh mesh, m_prefetchedMeshes)
+    {
+        delete mesh.mesh;
+    }
+    m_prefetchedMeshes.clear();
+}
+
+
+/** Set the directory where parsed catalog and sample files are cached. Caching
+  * is disabled when the path is empty.
+  */
+void
+UniverseLoader::setCatalogCacheDirectory(const QString& path)
+{
+    m_catalogCache = CatalogCache(path);
+}
+
+
+QString
+UniverseLoader::catalogCacheDirectory() const
+{
+    return m_catalogCache.directory();
+}
+
+
+// Get the catalog cache, or null if caching is disabled
+const CatalogCache*
+UniverseLoader::catalogCache() const
+{
+    return m_catalogCache.isEnabled() ? &m_catalogCache : NULL;
+}
+
+
 CatalogContents*
 UniverseLoader::loadCatalogItems(const QVariantMap& contentsMap,
                                  UniverseCatalog* catalog,
@@ -4531,6 +5552,7 @@ void
 UniverseLoader::loadSpiceKernels(const QStringList& kernelList)
 {
 #ifdef SPICE_ENABLED
+    QMutexLocker locker(&SpiceMutex);
     foreach (QString kernel, kernelList)
     {
         furnsh_c(kernel.toLatin1().data());
@@ -4564,6 +5586,7 @@ void
 UniverseLoader::unloadSpiceKernels(const QStringList& kernelList)
 {
 #ifdef SPICE_ENABLED
+    QMutexLocker locker(&SpiceMutex);
     for (int i = kernelList.length() - 1; i >= 0; --i)
     {
         QString kernel = kernelList.at(i);
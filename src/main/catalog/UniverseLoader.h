@@ -18,6 +18,7 @@
 #define _UNIVERSE_LOADER_H_
 
 #include "UniverseCatalog.h"
+#include "CatalogCache.h"
 #include <vesta/Entity.h>
 #include <vesta/Frame.h>
 #include <vesta/Trajectory.h>
@@ -32,11 +33,16 @@
 
 
 class TleTrajectory;
+class MeshInstanceGeometry;
+class QThreadPool;
+struct CatalogLoadItem;
 
 namespace vesta
 {
     class PlanetaryRings;
+    class Atmosphere;
     class InertialFrame;
+    class MeshGeometry;
 }
 
 class Viewpoint;
@@ -119,8 +125,54 @@ public:
         m_texturesInModelDirectory = enable;
     }
 
+    /** This property is normally true. It should be set to false when catalogs
+      * are loaded without a current GL context, e.g. when prebuilding the
+      * atmosphere cache; atmosphere scattering tables are then computed and
+      * cached, but no textures are created for them.
+      */
+    void setAtmosphereTexturesEnabled(bool enable)
+    {
+        m_atmosphereTexturesEnabled = enable;
+    }
+
+    /** This property is normally true. When it is false, catalog files and the
+      * files they reference are read one at a time as the catalog is loaded
+      * instead of being read ahead of time in parallel.
+      */
+    void setParallelLoadingEnabled(bool enable)
+    {
+        m_parallelLoadingEnabled = enable;
+    }
+
+    bool parallelLoadingEnabled() const
+    {
+        return m_parallelLoadingEnabled;
+    }
+
+    /** This property is normally false. When it is true, mesh files for meshes
+      * with a size are loaded by worker threads: mesh geometry is created without
+      * a mesh, and the mesh is set by processLoadedMeshes() once it has been loaded.
+      */
+    void setAsynchronousMeshLoadingEnabled(bool enable)
+    {
+        m_asynchronousMeshLoadingEnabled = enable;
+    }
+
+    bool asynchronousMeshLoadingEnabled() const
+    {
+        return m_asynchronousMeshLoadingEnabled;
+    }
+
+    void processLoadedMeshes();
+    void waitForPendingMeshes();
+
+    void setCatalogCacheDirectory(const QString& path);
+    QString catalogCacheDirectory() const;
+
     CatalogContents* loadCatalogFile(const QString& fileName,
                                      UniverseCatalog* catalog);
+    void prefetchCatalogFiles(const QStringList& fileNames);
+    void clearPrefetchedFiles();
     void unloadSpiceKernels(const QStringList& kernelList);
 
     void clearMessageLog();
@@ -135,6 +187,7 @@ private:
                                   const UniverseCatalog* catalog);
     vesta::Geometry* loadGlobeGeometry(const QVariantMap& map);
     vesta::PlanetaryRings* loadRingSystemGeometry(const QVariantMap& map);
+    vesta::Atmosphere* loadAtmosphere(const QVariantMap& map, double planetRadius);
     vesta::Geometry* loadMeshGeometry(const QVariantMap& map);
     vesta::Geometry* loadSensorGeometry(const QVariantMap& map,
                                         const UniverseCatalog* catalog);
@@ -200,6 +253,9 @@ private:
 
     void cleanGeometryCache();
     vesta::Geometry* loadMeshFile(const QString& fileName);
+    void startMeshLoad(const QString& fileName, MeshInstanceGeometry* meshInstance, double radius);
+    void resolveMeshTextures(vesta::MeshGeometry* mesh);
+    const CatalogCache* catalogCache() const;
 
     CatalogContents* loadCatalogFile(const QString& fileName,
                                      UniverseCatalog* catalog,
@@ -244,6 +300,49 @@ private:
     QString m_messageLog;
 
     bool m_texturesInModelDirectory;
+    bool m_atmosphereTexturesEnabled;
+
+    // Files read ahead of time by prefetchCatalogFiles(), keyed by canonical path
+    struct PrefetchedCatalog
+    {
+        QVariantMap contents;
+        QString errorMessage;
+    };
+
+    struct PrefetchedMesh
+    {
+        vesta::MeshGeometry* mesh;
+        vesta::counted_ptr<vesta::TextureMapLoader> textureLoader;
+        QString errorMessage;
+    };
+
+    CatalogCache m_catalogCache;
+    QThreadPool* m_threadPool;
+    bool m_parallelLoadingEnabled;
+    QHash<QString, PrefetchedCatalog> m_prefetchedCatalogs;
+    QHash<QString, vesta::Trajectory*> m_prefetchedTrajectories;
+    QHash<QString, vesta::RotationModel*> m_prefetchedRotations;
+    QHash<QString, PrefetchedMesh> m_prefetchedMeshes;
+
+    // Meshes being loaded by worker threads, keyed by file name. The instances
+    // are the geometry waiting for each mesh.
+    struct PendingMeshInstance
+    {
+        vesta::counted_ptr<MeshInstanceGeometry> geometry;
+        double radius;
+    };
+
+    struct PendingMesh
+    {
+        CatalogLoadItem* item;
+        QString bodyName;
+        QString textureSearchPath;
+        QList<PendingMeshInstance> instances;
+    };
+
+    QThreadPool* m_meshThreadPool;
+    bool m_asynchronousMeshLoadingEnabled;
+    QHash<QString, PendingMesh> m_pendingMeshes;
 };
 
 #endif // _UNIVERSE_LOADER_H_
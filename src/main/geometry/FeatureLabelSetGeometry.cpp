@@ -26,10 +26,16 @@ using namespace std;
 
 
 float FeatureLabelSetGeometry::ms_globalOpacity = 1.0f;
+const float FeatureLabelSetGeometry::VisibleSizeThreshold = 20.0f;
+
+// Cells with more features than this are subdivided
+static const unsigned int MaxFeaturesPerCell = 32;
+static const unsigned int MaxCellDepth = 12;
 
 
 FeatureLabelSetGeometry::FeatureLabelSetGeometry() :
     m_maxFeatureDistance(0.0f),
+    m_cellIndexValid(false),
     m_occludingEllipsoid(Vector3d::Zero())
 {
 }
@@ -45,8 +51,6 @@ FeatureLabelSetGeometry::~FeatureLabelSetGeometry()
 void
 FeatureLabelSetGeometry::render(RenderContext& rc, double /* clock */) const
 {
-    const float visibleSizeThreshold = 20.0f; // in pixels
-
     // No need to draw anything if the labels are turned off with an opacity
     // setting near 0.
     if (ms_globalOpacity <= 0.01f)
@@ -57,54 +61,160 @@ FeatureLabelSetGeometry::render(RenderContext& rc, double /* clock */) const
     // Render during the opaque pass if opaque or during the translucent pass if not.
     if (rc.pass() == RenderContext::TranslucentPass)
     {
-        // Get the position of the camera in the body-fixed frame of the labeled object
-        Transform3f inv = Transform3f(rc.modelview().inverse(Affine)); // Assuming an affine modelview matrix
-        Vector3f cameraPosition = inv.translation();
-        float overallPixelSize = boundingSphereRadius() / (rc.pixelSize() * cameraPosition.norm());
+        findVisibleLabels(rc.modelview(), rc.pixelSize(), m_visibleLabels);
 
-        // Only draw individual labels if the overall projected size of the set exceeds the threshold
-        if (overallPixelSize > visibleSizeThreshold)
+        for (vector<VisibleLabel>::const_iterator iter = m_visibleLabels.begin(); iter != m_visibleLabels.end(); ++iter)
         {
-            // Labels are treated as either completely visible or completely occluded. A label is
-            // visible when the labeled point isn't blocked by the occluding ellipsoid.
-            AlignedEllipsoid testEllipsoid(m_occludingEllipsoid.semiAxes() * 0.999);
-            Vector3f ellipsoidSemiAxes = testEllipsoid.semiAxes().cast<float>();
+            const Feature& feature = m_features[iter->feature];
+
+            rc.pushModelView();
+            rc.translateModelView(iter->position);
+
+            // Larger features take precedence over smaller ones when labels overlap
+            float opacity = ms_globalOpacity * rc.arbitrateLabel(this, iter->feature, Vector3f::Zero(), feature.label, m_font.ptr(), TextureFont::Utf8, 0.0f,
+                                                                 iter->pixelSize / (iter->pixelSize + 100.0f));
+            if (opacity > 0.0f)
+            {
+                rc.drawEncodedText(Vector3f::Zero(), feature.label, m_font.ptr(), TextureFont::Utf8, feature.color, opacity);
+            }
+
+            rc.popModelView();
+        }
+    }
+}
+
+
+/** Find the features that are large enough to label and not hidden by the occluding
+  * ellipsoid, in the order that they should be drawn. Labels are placed on a plane
+  * just in front of the ellipsoid, so that they aren't partially hidden by it.
+  *
+  * \param modelview transformation from the body-fixed frame to camera space
+  * \param pixelSize size of a pixel at unit distance from the camera
+  * \param labels filled in with the visible labels; any previous contents are removed
+  */
+void
+FeatureLabelSetGeometry::findVisibleLabels(const Transform3f& modelview, float pixelSize, vector<VisibleLabel>& labels) const
+{
+    labels.clear();
+
+    // Get the position of the camera in the body-fixed frame of the labeled object
+    Transform3f inv = Transform3f(modelview.inverse(Affine)); // Assuming an affine modelview matrix
+    Vector3f cameraPosition = inv.translation();
+    float overallPixelSize = boundingSphereRadius() / (pixelSize * cameraPosition.norm());
+
+    // Only draw individual labels if the overall projected size of the set exceeds the threshold
+    if (overallPixelSize <= VisibleSizeThreshold)
+    {
+        return;
+    }
+
+    if (!m_cellIndexValid)
+    {
+        buildCellIndex();
+    }
+
+    // Labels are treated as either completely visible or completely occluded. A label is
+    // visible when the labeled point isn't blocked by the occluding ellipsoid.
+    AlignedEllipsoid testEllipsoid(m_occludingEllipsoid.semiAxes() * 0.999);
+    Vector3f ellipsoidSemiAxes = testEllipsoid.semiAxes().cast<float>();
+
+    float cameraDistance = cameraPosition.norm();
+    Vector3f viewDir = -cameraPosition / cameraDistance;
+    double distanceToEllipsoid = 0.0;
+
+    // Instead of computing the ellipsoid intersection (as the line below), just treat the planet as a sphere
+    //TestRayEllipsoidIntersection(cameraPosition, viewDir, ellipsoidSemiAxes, &distanceToEllipsoid);
+    distanceToEllipsoid = (cameraPosition.norm() - ellipsoidSemiAxes.maxCoeff()) * 0.99f;
+
+    // We don't want labels partially hidden by the planet ellipsoid, so we'll project them onto a
+    // plane that lies just in front of the planet ellipsoid and which is parallel to the view plane
+    Hyperplane<float, 3> labelPlane(viewDir, cameraPosition + viewDir * float(distanceToEllipsoid));
+
+    // Labels are drawn on the label plane, so no label is closer to the camera than the
+    // plane. This bounds the projected size of all features in a cell.
+    float maxFeaturePixelSize = 0.0f;
+    if (distanceToEllipsoid > 0.0)
+    {
+        maxFeaturePixelSize = 1.0f / (pixelSize * float(distanceToEllipsoid));
+    }
 
-            Vector3f viewDir = -cameraPosition.normalized();
-            double distanceToEllipsoid = 0.0;
+    // Cells are also culled when they lie completely beyond the horizon of the
+    // largest sphere inside the occluding ellipsoid; such cells are hidden by the
+    // ellipsoid too. A point at distance r from the center is above the horizon only
+    // when its angle from the sub-camera point is less than acos(R/d) + acos(R/r).
+    float occluderRadius = ellipsoidSemiAxes.minCoeff();
+    bool horizonCulling = cameraDistance > occluderRadius;
+    float cameraHorizonAngle = horizonCulling ? acos(occluderRadius / cameraDistance) : 0.0f;
 
-            // Instead of computing the ellipsoid intersection (as the line below), just treat the planet as a sphere
-            //TestRayEllipsoidIntersection(cameraPosition, viewDir, ellipsoidSemiAxes, &distanceToEllipsoid);
-            distanceToEllipsoid = (cameraPosition.norm() - ellipsoidSemiAxes.maxCoeff()) * 0.99f;
+    unsigned int cellStack[MaxCellDepth * 3 + 8];
+    unsigned int stackSize = 0;
+    for (unsigned int i = 0; i < 6 && i < m_cells.size(); ++i)
+    {
+        cellStack[stackSize++] = i;
+    }
 
-            // We don't want labels partially hidden by the planet ellipsoid, so we'll project them onto a
-            // plane that lies just in front of the planet ellipsoid and which is parallel to the view plane
-            Hyperplane<float, 3> labelPlane(viewDir, cameraPosition + viewDir * float(distanceToEllipsoid));
+    while (stackSize > 0)
+    {
+        const Cell& cell = m_cells[cellStack[--stackSize]];
+        if (cell.featureCount == 0)
+        {
+            continue;
+        }
 
-            for (vector<Feature, Eigen::aligned_allocator<Feature> >::const_iterator iter = m_features.begin(); iter != m_features.end(); ++iter)
+        if (maxFeaturePixelSize > 0.0f && cell.maxSize * maxFeaturePixelSize <= VisibleSizeThreshold)
+        {
+            continue;
+        }
+
+        if (horizonCulling)
+        {
+            float axisAngle = acos(min(1.0f, max(-1.0f, -viewDir.dot(cell.axis))));
+            float cellAngle = acos(min(1.0f, cell.cosRadius));
+            float horizonAngle = cameraHorizonAngle + acos(min(1.0f, occluderRadius / cell.maxDistance));
+            if (axisAngle - cellAngle > horizonAngle)
+            {
+                continue;
+            }
+        }
+
+        if (cell.firstChild != 0)
+        {
+            for (unsigned int i = 0; i < 4; ++i)
             {
-                Vector3f r = iter->position - cameraPosition;
+                cellStack[stackSize++] = cell.firstChild + i;
+            }
+            continue;
+        }
+
+        for (unsigned int i = cell.firstFeature; i < cell.firstFeature + cell.featureCount; ++i)
+        {
+            unsigned int featureIndex = m_featureOrder[i];
+            const Feature& feature = m_features[featureIndex];
 
-                Vector3f labelPosition = labelPlane.projection(iter->position);
-                float k = -(labelPlane.normal().dot(cameraPosition) + labelPlane.offset()) / (labelPlane.normal().dot(r));
-                labelPosition = cameraPosition + k * r;
+            Vector3f r = feature.position - cameraPosition;
 
-                rc.pushModelView();
-                rc.translateModelView(labelPosition);
-                float featureDistance = rc.modelview().translation().norm();
-                float pixelSize = iter->size / (rc.pixelSize() * featureDistance);
+            float k = -(labelPlane.normal().dot(cameraPosition) + labelPlane.offset()) / (labelPlane.normal().dot(r));
+            Vector3f labelPosition = cameraPosition + k * r;
 
-                float d = r.norm();
-                r /= d;
-                double t = 0.0;
-                TestRayEllipsoidIntersection(cameraPosition, r, ellipsoidSemiAxes, &t);
+            float featureDistance = (modelview * labelPosition).norm();
+            float featurePixelSize = feature.size / (pixelSize * featureDistance);
+            if (featurePixelSize <= VisibleSizeThreshold)
+            {
+                continue;
+            }
 
-                if (pixelSize > visibleSizeThreshold && d < t)
-                {
-                    rc.drawEncodedText(Vector3f::Zero(), iter->label, m_font.ptr(), TextureFont::Utf8, iter->color, ms_globalOpacity);
-                }
+            float d = r.norm();
+            r /= d;
+            double t = 0.0;
+            TestRayEllipsoidIntersection(cameraPosition, r, ellipsoidSemiAxes, &t);
 
-                rc.popModelView();
+            if (d < t)
+            {
+                VisibleLabel label;
+                label.feature = featureIndex;
+                label.position = labelPosition;
+                label.pixelSize = featurePixelSize;
+                labels.push_back(label);
             }
         }
     }
@@ -138,4 +248,178 @@ FeatureLabelSetGeometry::addFeature(const string& label, const Vector3f& positio
     m_features.push_back(feature);
 
     m_maxFeatureDistance = max(m_maxFeatureDistance, position.norm());
+    m_cellIndexValid = false;
+}
+
+
+// Map a direction to a face of the cube and a position on that face.
+static unsigned int
+cubeFace(const Vector3f& v, Vector2f* faceCoord)
+{
+    int axis = 0;
+    v.cwise().abs().maxCoeff(&axis);
+    float w = v[axis];
+    if (w == 0.0f)
+    {
+        *faceCoord = Vector2f::Zero();
+        return 0;
+    }
+
+    *faceCoord = Vector2f(v[(axis + 1) % 3] / std::abs(w), v[(axis + 2) % 3] / std::abs(w));
+    return axis * 2 + (w < 0.0f ? 1 : 0);
+}
+
+
+void
+FeatureLabelSetGeometry::buildCellIndex() const
+{
+    m_cells.clear();
+    m_featureOrder.resize(m_features.size());
+
+    vector<Vector2f> faceCoords(m_features.size());
+    vector<unsigned int> faces(m_features.size());
+    unsigned int faceCounts[6] = { 0, 0, 0, 0, 0, 0 };
+    for (unsigned int i = 0; i < m_features.size(); ++i)
+    {
+        faces[i] = cubeFace(m_features[i].position, &faceCoords[i]);
+        faceCounts[faces[i]]++;
+    }
+
+    // Group the features by cube face
+    unsigned int faceStart[6];
+    unsigned int n = 0;
+    for (unsigned int face = 0; face < 6; ++face)
+    {
+        faceStart[face] = n;
+        n += faceCounts[face];
+    }
+
+    for (unsigned int i = 0; i < m_features.size(); ++i)
+    {
+        m_featureOrder[faceStart[faces[i]]++] = i;
+    }
+
+    m_cells.resize(6);
+    n = 0;
+    for (unsigned int face = 0; face < 6; ++face)
+    {
+        m_cells[face].firstFeature = n;
+        m_cells[face].featureCount = faceCounts[face];
+        n += faceCounts[face];
+    }
+
+    for (unsigned int face = 0; face < 6; ++face)
+    {
+        buildCell(face, -1.0f, -1.0f, 1.0f, 1.0f, 0, faceCoords);
+    }
+
+    m_cellIndexValid = true;
+}
+
+
+// Predicate for partitioning features within a cell
+class FaceCoordLess
+{
+public:
+    FaceCoordLess(const vector<Vector2f>& faceCoords, unsigned int axis, float split) :
+        m_faceCoords(faceCoords),
+        m_axis(axis),
+        m_split(split)
+    {
+    }
+
+    bool operator()(unsigned int featureIndex) const
+    {
+        return m_faceCoords[featureIndex][m_axis] < m_split;
+    }
+
+private:
+    const vector<Vector2f>& m_faceCoords;
+    unsigned int m_axis;
+    float m_split;
+};
+
+
+// Compute the bounds of a cell, then split it into four children if it contains
+// too many features.
+void
+FeatureLabelSetGeometry::buildCell(unsigned int cellIndex,
+                                   float u0, float v0, float u1, float v1,
+                                   unsigned int depth,
+                                   const vector<Vector2f>& faceCoords) const
+{
+    unsigned int begin = m_cells[cellIndex].firstFeature;
+    unsigned int end = begin + m_cells[cellIndex].featureCount;
+
+    Vector3f axis = Vector3f::Zero();
+    float maxDistance = 0.0f;
+    float maxSize = 0.0f;
+    for (unsigned int i = begin; i < end; ++i)
+    {
+        const Feature& feature = m_features[m_featureOrder[i]];
+        float distance = feature.position.norm();
+        if (distance > 0.0f)
+        {
+            axis += feature.position / distance;
+        }
+        maxDistance = max(maxDistance, distance);
+        maxSize = max(maxSize, feature.size);
+    }
+
+    // A cell whose features have no average direction is never culled by direction
+    float cosRadius = -1.0f;
+    if (axis.norm() > 0.0f)
+    {
+        axis.normalize();
+        cosRadius = 1.0f;
+        for (unsigned int i = begin; i < end; ++i)
+        {
+            const Feature& feature = m_features[m_featureOrder[i]];
+            float distance = feature.position.norm();
+            cosRadius = distance > 0.0f ? min(cosRadius, axis.dot(feature.position) / distance) : -1.0f;
+        }
+    }
+    else
+    {
+        axis = Vector3f::UnitZ();
+    }
+
+    {
+        Cell& cell = m_cells[cellIndex];
+        cell.axis = axis;
+        cell.cosRadius = cosRadius;
+        cell.maxDistance = maxDistance;
+        cell.maxSize = maxSize;
+        cell.firstChild = 0;
+    }
+
+    if (end - begin <= MaxFeaturesPerCell || depth >= MaxCellDepth)
+    {
+        return;
+    }
+
+    float uMid = (u0 + u1) * 0.5f;
+    float vMid = (v0 + v1) * 0.5f;
+
+    unsigned int* order = &m_featureOrder[0];
+    unsigned int* uSplit = partition(order + begin, order + end, FaceCoordLess(faceCoords, 0, uMid));
+    unsigned int* vSplit0 = partition(order + begin, uSplit, FaceCoordLess(faceCoords, 1, vMid));
+    unsigned int* vSplit1 = partition(uSplit, order + end, FaceCoordLess(faceCoords, 1, vMid));
+
+    unsigned int bounds[5] = { begin, unsigned(vSplit0 - order), unsigned(uSplit - order), unsigned(vSplit1 - order), end };
+
+    // Resizing the cell array invalidates references to cells
+    unsigned int firstChild = m_cells.size();
+    m_cells[cellIndex].firstChild = firstChild;
+    m_cells.resize(firstChild + 4);
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        m_cells[firstChild + i].firstFeature = bounds[i];
+        m_cells[firstChild + i].featureCount = bounds[i + 1] - bounds[i];
+    }
+
+    buildCell(firstChild + 0, u0,   v0,   uMid, vMid, depth + 1, faceCoords);
+    buildCell(firstChild + 1, u0,   vMid, uMid, v1,   depth + 1, faceCoords);
+    buildCell(firstChild + 2, uMid, v0,   u1,   vMid, depth + 1, faceCoords);
+    buildCell(firstChild + 3, uMid, vMid, u1,   v1,   depth + 1, faceCoords);
 }
@@ -43,6 +43,25 @@ public:
 
     void addFeature(const std::string& label, const Eigen::Vector3f& position, float radius, const vesta::Spectrum& color);
 
+    /** A label selected for drawing by findVisibleLabels()
+      */
+    struct VisibleLabel
+    {
+        // Index of the feature, in the order that features were added
+        unsigned int feature;
+        // Position of the label in the body-fixed frame
+        Eigen::Vector3f position;
+        // Projected size of the feature in pixels
+        float pixelSize;
+    };
+
+    void findVisibleLabels(const Eigen::Transform3f& modelview, float pixelSize, std::vector<VisibleLabel>& labels) const;
+
+    /** Labels are only drawn for features with a projected size greater than this
+      * many pixels.
+      */
+    static const float VisibleSizeThreshold;
+
     vesta::TextureFont* font() const
     {
         return m_font.ptr();
@@ -91,9 +110,41 @@ private:
         vesta::Spectrum color;
     };
 
+    // Features are grouped into the cells of a spherical quadtree built on the faces
+    // of a cube, so that cells on the far side of the body or containing only
+    // features too small to label can be skipped without visiting their features.
+    struct Cell
+    {
+        // Axis and cosine of the angular radius of a cone containing the directions
+        // of all features in the cell
+        Eigen::Vector3f axis;
+        float cosRadius;
+
+        float maxDistance;
+        float maxSize;
+
+        unsigned int firstFeature;
+        unsigned int featureCount;
+        // Index of the first of four children; zero for leaf cells
+        unsigned int firstChild;
+    };
+
+    void buildCellIndex() const;
+    void buildCell(unsigned int cellIndex,
+                   float u0, float v0, float u1, float v1,
+                   unsigned int depth,
+                   const std::vector<Eigen::Vector2f>& faceCoords) const;
+
+private:
     std::vector<Feature, Eigen::aligned_allocator<Feature> > m_features;
     float m_maxFeatureDistance;
 
+    // The cell index is built when the labels are first drawn
+    mutable std::vector<Cell> m_cells;
+    mutable std::vector<unsigned int> m_featureOrder;
+    mutable bool m_cellIndexValid;
+    mutable std::vector<VisibleLabel> m_visibleLabels;
+
     vesta::counted_ptr<vesta::TextureFont> m_font;
     vesta::AlignedEllipsoid m_occludingEllipsoid;
 
@@ -25,7 +25,8 @@ MeshInstanceGeometry::MeshInstanceGeometry(vesta::MeshGeometry* mesh) :
     m_mesh(mesh),
     m_scale(1.0f),
     m_meshOffset(Vector3f::Zero()),
-    m_meshRotation(Quaternionf::Identity())
+    m_meshRotation(Quaternionf::Identity()),
+    m_radiusHint(0.0f)
 {
     setShadowReceiver(true);
     setShadowCaster(true);
@@ -41,6 +42,11 @@ void
 MeshInstanceGeometry::render(RenderContext& rc,
                              double animationClock) const
 {
+    if (m_mesh.isNull())
+    {
+        return;
+    }
+
     rc.pushModelView();
     rc.scaleModelView(Vector3f::Constant(m_scale));
     rc.translateModelView(m_meshOffset);
@@ -54,6 +60,11 @@ void
 MeshInstanceGeometry::renderShadow(RenderContext& rc,
                                    double animationClock) const
 {
+    if (m_mesh.isNull())
+    {
+        return;
+    }
+
     rc.pushModelView();
     rc.scaleModelView(Vector3f::Constant(m_scale));
     rc.translateModelView(m_meshOffset);
@@ -66,10 +77,27 @@ MeshInstanceGeometry::renderShadow(RenderContext& rc,
 float
 MeshInstanceGeometry::boundingSphereRadius() const
 {
+    if (m_mesh.isNull())
+    {
+        return m_radiusHint;
+    }
+
     return (m_mesh->boundingSphereRadius() + m_meshOffset.norm()) * m_scale;
 }
 
 
+/** Set the scale so that the mesh fits in a sphere with the specified radius. The
+  * largest dimension of the mesh bounding box is made equal to the diameter. The
+  * mesh must not be null.
+  */
+void
+MeshInstanceGeometry::fitToRadius(float radius)
+{
+    float maxExtent = m_mesh->meshBoundingBox().extents().maxCoeff();
+    m_scale = radius * 2.0f / maxExtent;
+}
+
+
 /** Get an axis-aligned box large enough to contain the geometry.
   */
 vesta::BoundingBox
@@ -93,6 +121,11 @@ MeshInstanceGeometry::handleRayPick(const Vector3d& pickOrigin,
                                     double clock,
                                     double* distance) const
 {
+    if (m_mesh.isNull())
+    {
+        return false;
+    }
+
     Quaterniond q = m_meshRotation.cast<double>().conjugate();
     double invScale = 1.0 / m_scale;
     Vector3d origin = q * ((invScale * pickOrigin) - m_meshOffset.cast<double>());
@@ -22,6 +22,9 @@
 
 /** MeshInstanceGeometry is a wrapper for a VESTA MeshGeometry. It allows separate scale factors to be
   * be assigned to the same mesh geometry.
+  *
+  * The mesh may be null, e.g. while it is being loaded in the background; nothing is drawn
+  * for the instance until a mesh is set, and the bounding sphere radius is the radius hint.
   */
 class MeshInstanceGeometry : public vesta::Geometry
 {
@@ -44,6 +47,12 @@ public:
         return m_mesh.isNull() || m_mesh->isOpaque();
     }
 
+    /** \reimp */
+    bool hasBlendedParts() const
+    {
+        return !m_mesh.isNull() && m_mesh->hasBlendedParts();
+    }
+
     /** Set the scale factor that will be applied to the mesh. The scale
       * factor is multiplied by the scale factor of the mesh geometry.
       */
@@ -97,6 +106,31 @@ public:
         return m_mesh.ptr();
     }
 
+    /** Set the mesh drawn by this instance.
+      */
+    void setMesh(vesta::MeshGeometry* mesh)
+    {
+        m_mesh = mesh;
+    }
+
+    /** Set the bounding sphere radius reported while the instance has no mesh. Body
+      * classification, label fading, and camera distances all depend on the radius,
+      * so it should be set to the expected size of the mesh when loading is deferred.
+      */
+    void setRadiusHint(float radius)
+    {
+        m_radiusHint = radius;
+    }
+
+    /** Get the bounding sphere radius reported while the instance has no mesh.
+      */
+    float radiusHint() const
+    {
+        return m_radiusHint;
+    }
+
+    void fitToRadius(float radius);
+
     vesta::BoundingBox boundingBox() const;
 
 protected:
@@ -110,6 +144,7 @@ private:
     float m_scale;
     Eigen::Vector3f m_meshOffset;
     Eigen::Quaternionf m_meshRotation;
+    float m_radiusHint;
 };
 
 #endif // _MESH_INSTANCE_GEOMETRY_H_
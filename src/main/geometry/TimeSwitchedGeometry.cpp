@@ -46,6 +46,24 @@ TimeSwitchedGeometry::render(RenderContext& rc, double clock) const
 }
 
 
+/** \reimpl
+  * Report blended parts if any of the geometries in the sequence has them.
+  */
+bool
+TimeSwitchedGeometry::hasBlendedParts() const
+{
+    for (unsigned int i = 0; i < m_geometries.size(); ++i)
+    {
+        if (m_geometries[i].isValid() && m_geometries[i]->hasBlendedParts())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
 Geometry*
 TimeSwitchedGeometry::geometry(unsigned int index) const
 {
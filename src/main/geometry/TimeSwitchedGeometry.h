@@ -43,6 +43,14 @@ public:
         return m_opaque;
     }
 
+    virtual bool hasBlendedParts() const;
+
+    /** \reimp */
+    virtual bool isAnimated() const
+    {
+        return true;
+    }
+
     vesta::Geometry* geometry(unsigned int index) const;
     double startTime(unsigned int index) const;
     void addGeometry(double startTime, vesta::Geometry* label);
@@ -16,9 +16,12 @@
 
 #include <QApplication>
 #include <QDir>
+#include <QFileInfo>
 #include <QMessageBox>
 #include <QDebug>
 #include <QDesktopServices>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
 
 #if defined(Q_WS_MAC) || defined(Q_OS_MAC)
 #include <CoreFoundation/CFBundle.h>
@@ -26,12 +29,337 @@
 
 #include "Cosmographia.h"
 #include "FileOpenEventFilter.h"
+#include "catalog/UniverseCatalog.h"
+#include "catalog/UniverseLoader.h"
+#include "geometry/MeshInstanceGeometry.h"
+#include "vext/AtmosphereCache.h"
+#include <vesta/Arc.h>
+#include <vesta/Chronology.h>
+#include <vesta/Entity.h>
+#include <vesta/Geometry.h>
+#include <iostream>
+#include <typeinfo>
 
 #define MAS_DEPLOY 0
 
 
+// Load catalog files the same way that the main window does: all of the files are
+// read ahead of time, then each catalog is loaded with file names resolved relative
+// to the catalog's directory.
+static void loadCatalogFiles(UniverseLoader* loader, const QStringList& catalogFileNames, UniverseCatalog* catalog)
+{
+    QStringList catalogPaths;
+    foreach (QString fileName, catalogFileNames)
+    {
+        catalogPaths << QFileInfo(fileName).absoluteFilePath();
+    }
+
+    loader->prefetchCatalogFiles(catalogPaths);
+    foreach (QString path, catalogPaths)
+    {
+        QFileInfo info(path);
+        loader->setDataSearchPath(info.absolutePath());
+        loader->setModelSearchPath(info.absolutePath());
+        delete loader->loadCatalogFile(info.fileName(), catalog);
+    }
+    loader->clearPrefetchedFiles();
+}
+
+
+// Load the catalog files named on the command line and compute scattering tables
+// for every atmosphere defined in them, storing the tables in the atmosphere cache.
+// This runs without creating a window or a GL context:
+//
+//     Cosmographia --prebuild-atmospheres <catalog file>...
+static int prebuildAtmospheres(const QStringList& catalogFileNames)
+{
+    if (catalogFileNames.isEmpty())
+    {
+        std::cerr << "Usage: Cosmographia --prebuild-atmospheres <catalog file>..." << std::endl;
+        return 1;
+    }
+
+    UniverseCatalog catalog;
+    UniverseLoader loader;
+    loader.setAtmosphereTexturesEnabled(false);
+
+    loadCatalogFiles(&loader, catalogFileNames, &catalog);
+
+    QString messages = loader.messageLog();
+    if (!messages.isEmpty())
+    {
+        std::cerr << messages.toLocal8Bit().constData() << std::endl;
+    }
+
+    std::cout << "Atmosphere tables are cached in "
+              << QDir::toNativeSeparators(AtmosphereCache::DefaultDirectory()).toLocal8Bit().constData()
+              << std::endl;
+
+    return 0;
+}
+
+
+template<class T> static QString typeName(const T* object)
+{
+    return object ? QString::fromLatin1(typeid(*object).name()) : QString("none");
+}
+
+
+// Describe a body in enough detail to tell whether two bodies loaded from the
+// same catalog definition are the same.
+static QString describeBody(const QString& name, const vesta::Entity* body)
+{
+    // A mesh instance without a mesh draws nothing, just like a body without geometry;
+    // that's what is left when a mesh file loaded in the background can't be read.
+    const vesta::Geometry* geometry = body->geometry();
+    const MeshInstanceGeometry* meshInstance = dynamic_cast<const MeshInstanceGeometry*>(geometry);
+    if (meshInstance && !meshInstance->mesh())
+    {
+        geometry = NULL;
+    }
+
+    QString description = name + " " + typeName(body) + " geometry " + typeName(geometry);
+    if (meshInstance && meshInstance->mesh())
+    {
+        const vesta::MeshGeometry* mesh = meshInstance->mesh();
+        vesta::BoundingBox box = mesh->meshBoundingBox();
+        description += QString(" mesh %1 materials scale %2 radius %3 box %4 %5 %6 %7 %8 %9")
+                       .arg(mesh->materialCount())
+                       .arg(meshInstance->scale(), 0, 'g', 9)
+                       .arg(mesh->boundingSphereRadius(), 0, 'g', 9)
+                       .arg(box.minPoint().x(), 0, 'g', 9).arg(box.minPoint().y(), 0, 'g', 9).arg(box.minPoint().z(), 0, 'g', 9)
+                       .arg(box.maxPoint().x(), 0, 'g', 9).arg(box.maxPoint().y(), 0, 'g', 9).arg(box.maxPoint().z(), 0, 'g', 9);
+    }
+
+    const vesta::Chronology* chronology = body->chronology();
+    for (unsigned int i = 0; i < chronology->arcCount(); ++i)
+    {
+        const vesta::Arc* arc = chronology->arc(i);
+        description += QString(" arc %1 %2 %3").arg(arc->duration(), 0, 'g', 17)
+                       .arg(typeName(arc->trajectory()))
+                       .arg(typeName(arc->rotationModel()));
+    }
+
+    if (!chronology->empty() && chronology->duration() < 1.0e15)
+    {
+        double t = chronology->beginning() + chronology->duration() * 0.5;
+        Eigen::Vector3d position = body->position(t);
+        Eigen::Quaterniond orientation = body->orientation(t);
+        description += QString(" position %1 %2 %3").arg(position.x(), 0, 'g', 17).arg(position.y(), 0, 'g', 17).arg(position.z(), 0, 'g', 17);
+        description += QString(" orientation %1 %2 %3 %4").arg(orientation.w(), 0, 'g', 17).arg(orientation.x(), 0, 'g', 17)
+                       .arg(orientation.y(), 0, 'g', 17).arg(orientation.z(), 0, 'g', 17);
+    }
+
+    return description;
+}
+
+
+static QStringList describeCatalog(const UniverseCatalog& catalog)
+{
+    QStringList descriptions;
+    foreach (QString name, catalog.names())
+    {
+        descriptions << describeBody(name, catalog.find(name));
+    }
+    descriptions.sort();
+
+    return descriptions;
+}
+
+
+// Number of times that catalogs are loaded sequentially and in parallel when
+// comparing load times
+static const int CatalogLoadTimingRounds = 5;
+
+
+// Result of loading a set of catalogs for a comparison
+struct CatalogLoadResult
+{
+    QStringList bodies;
+    QString messageLog;
+    qint64 loadTime;
+};
+
+
+static CatalogLoadResult loadForComparison(const QStringList& catalogFileNames,
+                                           bool parallel,
+                                           const QString& cacheDirectory,
+                                           bool asynchronousMeshes = false)
+{
+    UniverseCatalog catalog;
+    UniverseLoader loader;
+    loader.setAtmosphereTexturesEnabled(false);
+    loader.setParallelLoadingEnabled(parallel);
+    loader.setCatalogCacheDirectory(cacheDirectory);
+    loader.setAsynchronousMeshLoadingEnabled(asynchronousMeshes);
+
+    QElapsedTimer timer;
+    timer.start();
+    loadCatalogFiles(&loader, catalogFileNames, &catalog);
+
+    CatalogLoadResult result;
+    result.loadTime = timer.elapsed();
+
+    // Meshes loaded in the background must be in place before the bodies are described
+    loader.waitForPendingMeshes();
+    result.bodies = describeCatalog(catalog);
+    result.messageLog = loader.messageLog();
+
+    return result;
+}
+
+
+static QStringList sortedLines(const QString& text)
+{
+    QStringList lines = text.split('\n');
+    lines.sort();
+    return lines;
+}
+
+
+// Print the differences between a load and the reference load, returning
+// the number of differences. Errors from files loaded in the background are
+// logged when loading finishes, so the order of messages is only compared
+// when messagesInOrder is true.
+static int reportDifferences(const char* name,
+                             const CatalogLoadResult& reference,
+                             const CatalogLoadResult& result,
+                             bool messagesInOrder = true)
+{
+    int differenceCount = 0;
+    foreach (QString body, reference.bodies)
+    {
+        if (!result.bodies.contains(body))
+        {
+            std::cout << name << ", missing: " << body.toLocal8Bit().constData() << std::endl;
+            ++differenceCount;
+        }
+    }
+    foreach (QString body, result.bodies)
+    {
+        if (!reference.bodies.contains(body))
+        {
+            std::cout << name << ", extra: " << body.toLocal8Bit().constData() << std::endl;
+            ++differenceCount;
+        }
+    }
+
+    bool messagesMatch = messagesInOrder ?
+                         reference.messageLog == result.messageLog :
+                         sortedLines(reference.messageLog) == sortedLines(result.messageLog);
+    if (!messagesMatch)
+    {
+        std::cout << name << ", error messages differ" << std::endl;
+        ++differenceCount;
+    }
+
+    std::cout << name << ": " << result.bodies.size() << " bodies loaded in " << result.loadTime << " ms, "
+              << differenceCount << " differences" << std::endl;
+
+    return differenceCount;
+}
+
+
+static qint64 medianTime(QList<qint64> times)
+{
+    qSort(times);
+    return times.isEmpty() ? 0 : times.at(times.size() / 2);
+}
+
+
+// Load the catalog files named on the command line in several ways and report any
+// differences in the loaded bodies. The reference load reads files one at a time
+// while loading, without the catalog cache. It's compared with loads that read files
+// ahead of time in parallel, first with an empty catalog cache and then with the
+// cache entries that the first load stored. Finally, meshes are loaded in the
+// background and checked once they've replaced the empty mesh geometry. A temporary
+// cache directory is used, so the user's cache is left alone. This runs without
+// creating a window or a GL context:
+//
+//     Cosmographia --compare-catalog-loading <catalog file>...
+//
+// The sequential and parallel load times reported are the medians of several loads
+// made in alternating order, after an untimed load that brings all of the files into
+// the operating system's file cache. Every timed load thus reads from a warm cache;
+// measuring cold loads requires dropping the file cache before each run, which needs
+// administrator rights and isn't done here.
+static int compareCatalogLoading(const QStringList& catalogFileNames)
+{
+    if (catalogFileNames.isEmpty())
+    {
+        std::cerr << "Usage: Cosmographia --compare-catalog-loading <catalog file>..." << std::endl;
+        return 1;
+    }
+
+    QTemporaryDir cacheDirectory;
+    if (!cacheDirectory.isValid())
+    {
+        std::cerr << "Unable to create a temporary cache directory" << std::endl;
+        return 1;
+    }
+
+    // Warm up the file cache
+    loadForComparison(catalogFileNames, false, QString());
+
+    // Alternate the order of the timed loads so that neither kind always runs first
+    CatalogLoadResult reference;
+    CatalogLoadResult parallel;
+    QList<qint64> sequentialTimes;
+    QList<qint64> parallelTimes;
+    for (int round = 0; round < CatalogLoadTimingRounds; ++round)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            if ((round + i) % 2 == 0)
+            {
+                reference = loadForComparison(catalogFileNames, false, QString());
+                sequentialTimes << reference.loadTime;
+            }
+            else
+            {
+                parallel = loadForComparison(catalogFileNames, true, QString());
+                parallelTimes << parallel.loadTime;
+            }
+        }
+    }
+    reference.loadTime = medianTime(sequentialTimes);
+    parallel.loadTime = medianTime(parallelTimes);
+
+    std::cout << "Sequential: " << reference.bodies.size() << " bodies loaded in " << reference.loadTime << " ms" << std::endl;
+
+    int differenceCount = 0;
+    differenceCount += reportDifferences("Parallel", reference, parallel);
+    differenceCount += reportDifferences("Cache miss", reference, loadForComparison(catalogFileNames, true, cacheDirectory.path()));
+    differenceCount += reportDifferences("Cache hit", reference, loadForComparison(catalogFileNames, true, cacheDirectory.path()));
+    differenceCount += reportDifferences("Sequential cache hit", reference, loadForComparison(catalogFileNames, false, cacheDirectory.path()));
+    differenceCount += reportDifferences("Asynchronous meshes", reference,
+                                         loadForComparison(catalogFileNames, true, cacheDirectory.path(), true), false);
+
+    return differenceCount == 0 ? 0 : 1;
+}
+
+
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && QString::fromLocal8Bit(argv[1]) == "--prebuild-atmospheres")
+    {
+        QCoreApplication app(argc, argv);
+#if MAS_DEPLOY
+#else
+        QCoreApplication::setOrganizationName("Periapsis Visual Software");
+        QCoreApplication::setOrganizationDomain("periapsisvisual.com");
+        QCoreApplication::setApplicationName("Cosmographia");
+#endif
+
+        return prebuildAtmospheres(QCoreApplication::arguments().mid(2));
+    }
+
+    if (argc > 1 && QString::fromLocal8Bit(argv[1]) == "--compare-catalog-loading")
+    {
+        QCoreApplication app(argc, argv);
+        return compareCatalogLoading(QCoreApplication::arguments().mid(2));
+    }
+
     QApplication app(argc, argv);
 
     FileOpenEventFilter* appEventFilter = new FileOpenEventFilter();
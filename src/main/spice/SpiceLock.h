@@ -0,0 +1,29 @@
+// SpiceLock.h
+//
+// Copyright (C) 2013 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SPICE_LOCK_H_
+#define _SPICE_LOCK_H_
+
+#include <QMutex>
+
+// CSPICE keeps its error state and kernel pool in global variables, so it
+// can't be called from more than one thread at a time. The renderer evaluates
+// trajectories and rotation models on worker threads, and catalogs (which may
+// load kernels and look up NAIF codes) are loaded on background threads. Every
+// CSPICE call, including furnsh_c, unload_c and name lookups, must hold this lock.
+extern QMutex SpiceMutex;
+
+#endif // _SPICE_LOCK_H_
@@ -15,6 +15,8 @@
 // limitations under the License.
 
 #include "SpiceRotationModel.h"
+#include "SpiceLock.h"
+#include <QMutexLocker>
 #include <SpiceUsr.h>
 
 using namespace vesta;
@@ -40,6 +42,7 @@ SpiceRotationModel::orientation(double tdbSec) const
     double et = tdbSec;
     SpiceDouble transform[3][3];
 
+    QMutexLocker locker(&SpiceMutex);
     pxform_c(m_fromFrame.c_str(), m_toFrame.c_str(), et, transform);
     if (!failed_c())
     {
@@ -66,6 +69,7 @@ SpiceRotationModel::angularVelocity(double tdbSec) const
     double et = tdbSec;
     SpiceDouble transform[6][6];
 
+    QMutexLocker locker(&SpiceMutex);
     sxform_c(m_fromFrame.c_str(), m_toFrame.c_str(), et, transform);
     if (!failed_c())
     {
@@ -15,6 +15,8 @@
 // limitations under the License.
 
 #include "SpiceTrajectory.h"
+#include "SpiceLock.h"
+#include <QMutexLocker>
 #include <algorithm>
 #include <iostream>
 
@@ -23,6 +25,9 @@ using namespace Eigen;
 using namespace std;
 
 
+QMutex SpiceMutex;
+
+
 SpiceTrajectory::SpiceTrajectory(SpiceInt targetID, SpiceInt centerID, const char* spiceFrame) :
     m_targetID(targetID),
     m_centerID(centerID),
@@ -45,6 +50,8 @@ SpiceTrajectory::state(double tdbSec) const
 
     SpiceDouble sv[6];
     SpiceDouble lightTime;
+
+    QMutexLocker locker(&SpiceMutex);
     spkgeo_c(m_targetID, et, m_spiceFrame.c_str(), m_centerID, sv, &lightTime);
     if (failed_c())
     {
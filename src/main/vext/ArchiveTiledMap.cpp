@@ -0,0 +1,105 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ArchiveTiledMap.h"
+#include <QStringList>
+
+using namespace vesta;
+using namespace std;
+
+
+static const char* ArchiveTilePrefix = "tilepack:";
+
+
+ArchiveTiledMap::ArchiveTiledMap(TextureMapLoader* loader,
+                                 const QSharedPointer<TileArchive>& archive,
+                                 unsigned int tileSize) :
+    HierarchicalTiledMap(loader, tileSize),
+    m_archive(archive)
+{
+}
+
+
+ArchiveTiledMap::~ArchiveTiledMap()
+{
+}
+
+
+string
+ArchiveTiledMap::tileResourceIdentifier(unsigned int level, unsigned int column, unsigned int row)
+{
+    QString name = QString("%1%2#%3,%4,%5").arg(ArchiveTilePrefix).arg(m_archive->fileName()).arg(level).arg(column).arg(row);
+    return string(name.toUtf8().data());
+}
+
+
+bool
+ArchiveTiledMap::isValidTileAddress(unsigned int level, unsigned int column, unsigned int row)
+{
+    return level < m_archive->levelCount() && column < (2u << level) && row < (1u << level);
+}
+
+
+bool
+ArchiveTiledMap::tileExists(unsigned int level, unsigned int column, unsigned int row, const std::string& /* resourceId */)
+{
+    return m_archive->contains(level, column, row);
+}
+
+
+/** Return true if the name refers to a tile in an archive.
+  */
+bool
+ArchiveTiledMap::isArchiveTileName(const QString& name)
+{
+    return name.startsWith(ArchiveTilePrefix);
+}
+
+
+/** Extract the archive file name and tile address from an archive tile
+  * resource name.
+  */
+ArchiveTiledMap::TileAddress
+ArchiveTiledMap::parseTileName(const QString& name)
+{
+    TileAddress address;
+    address.valid = false;
+    address.level = 0;
+    address.column = 0;
+    address.row = 0;
+
+    int separator = name.lastIndexOf('#');
+    if (!isArchiveTileName(name) || separator < 0)
+    {
+        return address;
+    }
+
+    int prefixLength = QString(ArchiveTilePrefix).length();
+    QStringList parts = name.mid(separator + 1).split(",");
+    if (parts.size() == 3)
+    {
+        bool levelOk = false;
+        bool columnOk = false;
+        bool rowOk = false;
+        address.archiveFileName = name.mid(prefixLength, separator - prefixLength);
+        address.level = parts[0].toUInt(&levelOk);
+        address.column = parts[1].toUInt(&columnOk);
+        address.row = parts[2].toUInt(&rowOk);
+        address.valid = levelOk && columnOk && rowOk;
+    }
+
+    return address;
+}
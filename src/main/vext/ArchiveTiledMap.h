@@ -0,0 +1,61 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _VEXT_ARCHIVE_TILED_MAP_H_
+#define _VEXT_ARCHIVE_TILED_MAP_H_
+
+#include "TileArchive.h"
+#include <vesta/HierarchicalTiledMap.h>
+#include <QString>
+#include <QSharedPointer>
+#include <string>
+
+
+/** ArchiveTiledMap loads texture tiles from a packed tile archive. Tile
+  * existence is determined from the archive index, so no file system
+  * access is required until a tile is actually loaded.
+  *
+  * Tiles are identified by resource names of the form:
+  *   tilepack:ARCHIVEPATH#LEVEL,COLUMN,ROW
+  * The image loader reads the tile data directly from the archive.
+  */
+class ArchiveTiledMap : public vesta::HierarchicalTiledMap
+{
+public:
+    ArchiveTiledMap(vesta::TextureMapLoader* loader, const QSharedPointer<TileArchive>& archive, unsigned int tileSize);
+    ~ArchiveTiledMap();
+
+    virtual std::string tileResourceIdentifier(unsigned int level, unsigned int column, unsigned int row);
+    virtual bool isValidTileAddress(unsigned int level, unsigned int column, unsigned int row);
+    virtual bool tileExists(unsigned int level, unsigned int column, unsigned int row, const std::string& resourceId);
+
+    struct TileAddress
+    {
+        bool valid;
+        QString archiveFileName;
+        unsigned int level;
+        unsigned int column;
+        unsigned int row;
+    };
+
+    static bool isArchiveTileName(const QString& name);
+    static TileAddress parseTileName(const QString& name);
+
+private:
+    QSharedPointer<TileArchive> m_archive;
+};
+
+#endif // _VEXT_ARCHIVE_TILED_MAP_H_
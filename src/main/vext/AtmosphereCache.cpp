@@ -0,0 +1,192 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "AtmosphereCache.h"
+#include <vesta/Atmosphere.h>
+#include <vesta/DataChunk.h>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QDebug>
+
+using namespace vesta;
+
+
+// Increment this whenever the scattering table integration changes in a way that
+// alters the table contents; doing so orphans all previously cached tables.
+static const quint32 ScatteringTableVersion = 1;
+
+
+AtmosphereCache::AtmosphereCache() :
+    m_directory(DefaultDirectory())
+{
+}
+
+
+AtmosphereCache::AtmosphereCache(const QString& directory) :
+    m_directory(directory)
+{
+}
+
+
+AtmosphereCache::~AtmosphereCache()
+{
+}
+
+
+/** Get the directory in the user's cache location where atmosphere tables are
+  * stored by default.
+  */
+QString
+AtmosphereCache::DefaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/atmospheres";
+}
+
+
+/** Compute a hash of all the values that determine the contents of the scattering
+  * tables for an atmosphere. Floating point values are hashed by their exact bit
+  * patterns, so any change at all in a parameter gives a different hash.
+  */
+QByteArray
+AtmosphereCache::ParameterHash(const Atmosphere* atmosphere)
+{
+    QByteArray key;
+    QDataStream out(&key, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    out << ScatteringTableVersion;
+    out << atmosphere->planetRadius();
+    out << atmosphere->rayleighScaleHeight();
+    out << atmosphere->rayleighScatteringCoeff().x()
+        << atmosphere->rayleighScatteringCoeff().y()
+        << atmosphere->rayleighScatteringCoeff().z();
+    out << atmosphere->mieScaleHeight();
+    out << atmosphere->mieScatteringCoeff();
+    out << atmosphere->mieAsymmetry();
+    out << atmosphere->absorptionCoeff().x()
+        << atmosphere->absorptionCoeff().y()
+        << atmosphere->absorptionCoeff().z();
+
+    // Table dimensions used by Atmosphere::computeScattering()
+    out << quint32(Atmosphere::DefaultTransmittanceTableHeightSamples)
+        << quint32(Atmosphere::DefaultTransmittanceTableViewAngleSamples)
+        << quint32(Atmosphere::DefaultScatterTableHeightSamples)
+        << quint32(Atmosphere::DefaultScatterTableViewAngleSamples)
+        << quint32(Atmosphere::DefaultScatterTableSunAngleSamples);
+
+    return QCryptographicHash::hash(key, QCryptographicHash::Sha1);
+}
+
+
+/** Get the name of the cache file for an atmosphere with the same parameters
+  * as the specified one.
+  */
+QString
+AtmosphereCache::fileName(const Atmosphere* atmosphere) const
+{
+    return m_directory + "/" + QString::fromLatin1(ParameterHash(atmosphere).toHex()) + ".atmscat";
+}
+
+
+/** Load cached scattering tables for an atmosphere with the same parameters as
+  * the specified one.
+  *
+  * \return a new atmosphere with precomputed tables, or NULL if there are no
+  * cached tables for the parameters
+  */
+Atmosphere*
+AtmosphereCache::load(const Atmosphere* atmosphere) const
+{
+    QFile file(fileName(atmosphere));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return NULL;
+    }
+
+    QByteArray data = file.readAll();
+    DataChunk chunk(data.data(), data.size());
+
+    return Atmosphere::LoadAtmScat(&chunk);
+}
+
+
+/** Write the scattering tables of an atmosphere to the cache. The tables are
+  * written to a temporary file that is renamed once it's complete, so that a
+  * partially written file is never mistaken for a valid cache entry.
+  */
+bool
+AtmosphereCache::save(Atmosphere* atmosphere) const
+{
+    QDir dir(m_directory);
+    if (!dir.exists())
+    {
+        dir.mkpath(dir.absolutePath());
+    }
+
+    QString cacheFileName = fileName(atmosphere);
+    QString tempFileName = cacheFileName + ".tmp";
+    if (!atmosphere->SaveAtmScat(QFile::encodeName(tempFileName).constData()))
+    {
+        QFile::remove(tempFileName);
+        return false;
+    }
+
+    QFile::remove(cacheFileName);
+    if (!QFile::rename(tempFileName, cacheFileName))
+    {
+        qDebug() << "Unable to store atmosphere tables in " << cacheFileName;
+        QFile::remove(tempFileName);
+        return false;
+    }
+
+    return true;
+}
+
+
+/** Get an atmosphere with precomputed scattering tables for the parameters of the
+  * specified atmosphere, which should not yet have any tables. If the tables are
+  * cached, a new atmosphere is loaded from the cache. Otherwise, the tables of the
+  * specified atmosphere are computed and saved, and the atmosphere itself is returned.
+  * The caller is responsible for destroying the parameter atmosphere when a different
+  * one is returned.
+  *
+  * \param computed if not NULL, set to true if the tables had to be computed
+  */
+Atmosphere*
+AtmosphereCache::findOrCompute(Atmosphere* atmosphere, bool* computed) const
+{
+    Atmosphere* cached = load(atmosphere);
+    if (computed)
+    {
+        *computed = (cached == NULL);
+    }
+
+    if (cached)
+    {
+        return cached;
+    }
+
+    atmosphere->computeScattering();
+    save(atmosphere);
+
+    return atmosphere;
+}
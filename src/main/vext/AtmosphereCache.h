@@ -0,0 +1,61 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _VEXT_ATMOSPHERE_CACHE_H_
+#define _VEXT_ATMOSPHERE_CACHE_H_
+
+#include <QString>
+#include <QByteArray>
+
+namespace vesta
+{
+    class Atmosphere;
+}
+
+
+/** AtmosphereCache stores precomputed atmosphere scattering tables on disk so
+  * that they only have to be integrated once. Tables are saved as atmscat files
+  * named with a hash of everything that affects their contents: the scattering
+  * parameters, the planet radius, and the table dimensions. Changing any of
+  * these simply produces a different file name, so cached tables never need to
+  * be invalidated.
+  */
+class AtmosphereCache
+{
+public:
+    AtmosphereCache();
+    AtmosphereCache(const QString& directory);
+    ~AtmosphereCache();
+
+    QString directory() const
+    {
+        return m_directory;
+    }
+
+    QString fileName(const vesta::Atmosphere* atmosphere) const;
+
+    vesta::Atmosphere* load(const vesta::Atmosphere* atmosphere) const;
+    bool save(vesta::Atmosphere* atmosphere) const;
+    vesta::Atmosphere* findOrCompute(vesta::Atmosphere* atmosphere, bool* computed = NULL) const;
+
+    static QString DefaultDirectory();
+    static QByteArray ParameterHash(const vesta::Atmosphere* atmosphere);
+
+private:
+    QString m_directory;
+};
+
+#endif // _VEXT_ATMOSPHERE_CACHE_H_
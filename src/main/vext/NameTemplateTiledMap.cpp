@@ -73,5 +73,32 @@ NameTemplateTiledMap::tileResourceExists(const std::string& /* resourceId */)
 }
 
 
+bool
+NameTemplateTiledMap::tileExists(unsigned int level, unsigned int column, unsigned int row, const std::string& resourceId)
+{
+    if (m_manifest && m_manifest->isReady())
+    {
+        return m_manifest->contains(level, column, row);
+    }
+    else
+    {
+        return tileResourceExists(resourceId);
+    }
+}
 
 
+/** Use a tile manifest to avoid requesting tiles that aren't present. The
+  * manifest is loaded (or built) in a background thread; until it's ready, all
+  * tiles are assumed to exist.
+  */
+void
+NameTemplateTiledMap::enableManifest()
+{
+    if (!m_manifest)
+    {
+        // Tiles are arranged with north = 0
+        QString pattern = QString::fromUtf8(m_nameTemplate.c_str(), m_nameTemplate.length());
+        m_manifest = QSharedPointer<TileManifest>(new TileManifest(pattern, true, m_levelCount));
+        TileManifest::openInBackground(m_manifest);
+    }
+}
@@ -19,6 +19,8 @@
 
 #include <vesta/HierarchicalTiledMap.h>
 #include <vesta/TextureMapLoader.h>
+#include "TileManifest.h"
+#include <QSharedPointer>
 #include <string>
 
 class NameTemplateTiledMap : public vesta::HierarchicalTiledMap
@@ -30,10 +32,14 @@ public:
     virtual std::string tileResourceIdentifier(unsigned int level, unsigned int column, unsigned int row);
     virtual bool isValidTileAddress(unsigned int level, unsigned int column, unsigned int row);
     virtual bool tileResourceExists(const std::string& resourceId);
+    virtual bool tileExists(unsigned int level, unsigned int column, unsigned int row, const std::string& resourceId);
+
+    void enableManifest();
 
 private:
     std::string m_nameTemplate;
     unsigned int m_levelCount;
+    QSharedPointer<TileManifest> m_manifest;
 };
 
 #endif // _NAME_PATTERN_TILED_MAP_H_
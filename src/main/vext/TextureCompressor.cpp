@@ -0,0 +1,411 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TextureCompressor.h"
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace vesta;
+using namespace std;
+
+
+static const quint32 DDSMagic = 0x20534444;
+static const int DDSHeaderSize = 128;  // includes the four byte magic number
+
+static const quint32 FourCC_DXT1 = 0x31545844;
+static const quint32 FourCC_DXT5 = 0x35545844;
+
+static const quint32 DDSD_CAPS        = 0x00000001;
+static const quint32 DDSD_HEIGHT      = 0x00000002;
+static const quint32 DDSD_WIDTH       = 0x00000004;
+static const quint32 DDSD_PIXELFORMAT = 0x00001000;
+static const quint32 DDSD_MIPMAPCOUNT = 0x00020000;
+static const quint32 DDSD_LINEARSIZE  = 0x00080000;
+static const quint32 DDPF_FOURCC      = 0x00000004;
+static const quint32 DDSCAPS_COMPLEX  = 0x00000008;
+static const quint32 DDSCAPS_TEXTURE  = 0x00001000;
+static const quint32 DDSCAPS_MIPMAP   = 0x00400000;
+
+
+static bool isPow2(unsigned int x)
+{
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+
+static inline quint16 packRGB565(const int color[3])
+{
+    int r = (color[0] * 31 + 127) / 255;
+    int g = (color[1] * 63 + 127) / 255;
+    int b = (color[2] * 31 + 127) / 255;
+    return quint16((r << 11) | (g << 5) | b);
+}
+
+
+static inline void unpackRGB565(quint16 c, int color[3])
+{
+    int r = (c >> 11) & 0x1f;
+    int g = (c >> 5) & 0x3f;
+    int b = c & 0x1f;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+
+/** Return true if the image can be compressed. Only images with power-of-two
+  * dimensions are supported.
+  */
+bool
+TextureCompressor::canCompress(const QImage& image)
+{
+    return !image.isNull() && isPow2(image.width()) && isPow2(image.height());
+}
+
+
+/** Build the mipmap chain for an image and compress it. The image is encoded as DXT5
+  * if it has an alpha channel and DXT1 otherwise.
+  *
+  * \return the contents of a DDS file containing the compressed image, or null if
+  * the image can't be compressed. The caller is responsible for deleting the
+  * returned data.
+  */
+DataChunk*
+TextureCompressor::compress(const QImage& image)
+{
+    if (!canCompress(image))
+    {
+        return NULL;
+    }
+
+    bool alpha = image.hasAlphaChannel();
+    unsigned int width = image.width();
+    unsigned int height = image.height();
+
+    // Unpack the image into 8-bit RGBA
+    QImage argbImage = image.convertToFormat(QImage::Format_ARGB32);
+    QByteArray pixels(int(width * height * 4), '\0');
+    unsigned char* p = reinterpret_cast<unsigned char*>(pixels.data());
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        const QRgb* row = reinterpret_cast<const QRgb*>(argbImage.constScanLine(int(y)));
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            p[0] = (unsigned char) qRed(row[x]);
+            p[1] = (unsigned char) qGreen(row[x]);
+            p[2] = (unsigned char) qBlue(row[x]);
+            p[3] = (unsigned char) qAlpha(row[x]);
+            p += 4;
+        }
+    }
+
+    unsigned int levelCount = 1;
+    while ((max(width, height) >> (levelCount - 1)) > 1)
+    {
+        ++levelCount;
+    }
+
+    QByteArray data(DDSHeaderSize, '\0');
+    unsigned int levelWidth = width;
+    unsigned int levelHeight = height;
+    for (unsigned int level = 0; level < levelCount; ++level)
+    {
+        encodeLevel(pixels, levelWidth, levelHeight, alpha, &data);
+        if (level + 1 < levelCount)
+        {
+            QByteArray nextLevel;
+            downsample(pixels, levelWidth, levelHeight, &nextLevel);
+            pixels = nextLevel;
+            levelWidth = max(1u, levelWidth / 2);
+            levelHeight = max(1u, levelHeight / 2);
+        }
+    }
+
+    // Fill in the DDS header now that all of the data has been appended
+    unsigned int blockSize = alpha ? 16 : 8;
+    unsigned char* h = reinterpret_cast<unsigned char*>(data.data());
+    qToLittleEndian<quint32>(DDSMagic, h);
+    qToLittleEndian<quint32>(124, h + 4);
+    qToLittleEndian<quint32>(DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE, h + 8);
+    qToLittleEndian<quint32>(height, h + 12);
+    qToLittleEndian<quint32>(width, h + 16);
+    qToLittleEndian<quint32>(((width + 3) / 4) * ((height + 3) / 4) * blockSize, h + 20);
+    qToLittleEndian<quint32>(levelCount, h + 28);
+    qToLittleEndian<quint32>(32, h + 76);
+    qToLittleEndian<quint32>(DDPF_FOURCC, h + 80);
+    qToLittleEndian<quint32>(alpha ? FourCC_DXT5 : FourCC_DXT1, h + 84);
+    qToLittleEndian<quint32>(DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX, h + 108);
+
+    return new DataChunk(data.constData(), data.size());
+}
+
+
+// Reduce an RGBA image to half size with a 2x2 box filter.
+void
+TextureCompressor::downsample(const QByteArray& src, unsigned int width, unsigned int height, QByteArray* dest)
+{
+    unsigned int destWidth = max(1u, width / 2);
+    unsigned int destHeight = max(1u, height / 2);
+    dest->resize(int(destWidth * destHeight * 4));
+
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(src.constData());
+    unsigned char* d = reinterpret_cast<unsigned char*>(dest->data());
+
+    for (unsigned int y = 0; y < destHeight; ++y)
+    {
+        const unsigned char* row0 = s + min(y * 2, height - 1) * width * 4;
+        const unsigned char* row1 = s + min(y * 2 + 1, height - 1) * width * 4;
+        for (unsigned int x = 0; x < destWidth; ++x)
+        {
+            unsigned int x0 = min(x * 2, width - 1) * 4;
+            unsigned int x1 = min(x * 2 + 1, width - 1) * 4;
+            for (unsigned int c = 0; c < 4; ++c)
+            {
+                *d++ = (unsigned char) ((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+
+// Encode one mip level, appending the compressed blocks to out.
+void
+TextureCompressor::encodeLevel(const QByteArray& pixels, unsigned int width, unsigned int height, bool alpha, QByteArray* out)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(pixels.constData());
+    unsigned int blockSize = alpha ? 16 : 8;
+    unsigned int blocksWide = (width + 3) / 4;
+    unsigned int blocksHigh = (height + 3) / 4;
+
+    int offset = out->size();
+    out->resize(offset + int(blocksWide * blocksHigh * blockSize));
+    unsigned char* o = reinterpret_cast<unsigned char*>(out->data()) + offset;
+
+    unsigned char block[16 * 4];
+    for (unsigned int by = 0; by < blocksHigh; ++by)
+    {
+        for (unsigned int bx = 0; bx < blocksWide; ++bx)
+        {
+            // Gather the pixels of the block, replicating edge pixels for levels
+            // smaller than a block.
+            for (unsigned int i = 0; i < 16; ++i)
+            {
+                unsigned int x = min(bx * 4 + (i & 3), width - 1);
+                unsigned int y = min(by * 4 + (i >> 2), height - 1);
+                const unsigned char* src = p + (y * width + x) * 4;
+                block[i * 4 + 0] = src[0];
+                block[i * 4 + 1] = src[1];
+                block[i * 4 + 2] = src[2];
+                block[i * 4 + 3] = src[3];
+            }
+
+            if (alpha)
+            {
+                encodeAlphaBlock(block, o);
+                o += 8;
+            }
+            encodeColorBlock(block, o);
+            o += 8;
+        }
+    }
+}
+
+
+// Encode the color of a 4x4 block of RGBA pixels as a DXT1 block. The endpoints are
+// chosen along the principal axis of the block's colors.
+void
+TextureCompressor::encodeColorBlock(const unsigned char* block, unsigned char* out)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        mean[0] += block[i * 4 + 0];
+        mean[1] += block[i * 4 + 1];
+        mean[2] += block[i * 4 + 2];
+    }
+    mean[0] /= 16.0f;
+    mean[1] /= 16.0f;
+    mean[2] /= 16.0f;
+
+    // Covariance matrix (symmetric, so only six elements are stored)
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        float r = block[i * 4 + 0] - mean[0];
+        float g = block[i * 4 + 1] - mean[1];
+        float b = block[i * 4 + 2] - mean[2];
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+
+    // Find the principal axis with a few steps of power iteration
+    float axis[3] = { cov[0] + cov[1] + cov[2], cov[1] + cov[3] + cov[4], cov[2] + cov[4] + cov[5] };
+    for (unsigned int iter = 0; iter < 4; ++iter)
+    {
+        float v0 = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+        float v1 = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+        float v2 = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+        float m = max(fabs(v0), max(fabs(v1), fabs(v2)));
+        if (m < 1.0e-6f)
+        {
+            break;
+        }
+        axis[0] = v0 / m;
+        axis[1] = v1 / m;
+        axis[2] = v2 / m;
+    }
+
+    if (fabs(axis[0]) + fabs(axis[1]) + fabs(axis[2]) < 1.0e-6f)
+    {
+        // All colors are (nearly) the same; use luminance
+        axis[0] = 0.299f;
+        axis[1] = 0.587f;
+        axis[2] = 0.114f;
+    }
+
+    // Use the colors with the smallest and largest projections onto the axis as
+    // endpoints, inset slightly to reduce the error for colors in between.
+    unsigned int minIndex = 0;
+    unsigned int maxIndex = 0;
+    float minDot = 1.0e30f;
+    float maxDot = -1.0e30f;
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        float d = block[i * 4 + 0] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+        if (d < minDot)
+        {
+            minDot = d;
+            minIndex = i;
+        }
+        if (d > maxDot)
+        {
+            maxDot = d;
+            maxIndex = i;
+        }
+    }
+
+    int maxColor[3];
+    int minColor[3];
+    for (unsigned int c = 0; c < 3; ++c)
+    {
+        int hi = block[maxIndex * 4 + c];
+        int lo = block[minIndex * 4 + c];
+        int inset = (hi - lo) / 16;
+        maxColor[c] = max(0, min(255, hi - inset));
+        minColor[c] = max(0, min(255, lo + inset));
+    }
+
+    quint16 c0 = packRGB565(maxColor);
+    quint16 c1 = packRGB565(minColor);
+    if (c0 < c1)
+    {
+        swap(c0, c1);
+    }
+
+    quint32 indices = 0;
+    if (c0 != c1)
+    {
+        // Four color mode (c0 > c1)
+        int palette[4][3];
+        unpackRGB565(c0, palette[0]);
+        unpackRGB565(c1, palette[1]);
+        for (unsigned int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            unsigned int best = 0;
+            int bestDistance = 1 << 30;
+            for (unsigned int j = 0; j < 4; ++j)
+            {
+                int dr = block[i * 4 + 0] - palette[j][0];
+                int dg = block[i * 4 + 1] - palette[j][1];
+                int db = block[i * 4 + 2] - palette[j][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = j;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+
+    qToLittleEndian<quint16>(c0, out);
+    qToLittleEndian<quint16>(c1, out + 2);
+    qToLittleEndian<quint32>(indices, out + 4);
+}
+
+
+// Encode the alpha of a 4x4 block of RGBA pixels as a DXT5 alpha block.
+void
+TextureCompressor::encodeAlphaBlock(const unsigned char* block, unsigned char* out)
+{
+    int a0 = 0;
+    int a1 = 255;
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        a0 = max(a0, int(block[i * 4 + 3]));
+        a1 = min(a1, int(block[i * 4 + 3]));
+    }
+
+    quint64 indices = 0;
+    if (a0 != a1)
+    {
+        // Eight alpha value mode (a0 > a1)
+        int palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+        for (int k = 2; k < 8; ++k)
+        {
+            palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+        }
+
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            int a = block[i * 4 + 3];
+            unsigned int best = 0;
+            int bestDistance = 256;
+            for (unsigned int j = 0; j < 8; ++j)
+            {
+                int distance = abs(a - palette[j]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = j;
+                }
+            }
+            indices |= quint64(best) << (i * 3);
+        }
+    }
+
+    out[0] = (unsigned char) a0;
+    out[1] = (unsigned char) a1;
+    for (unsigned int i = 0; i < 6; ++i)
+    {
+        out[2 + i] = (unsigned char) ((indices >> (i * 8)) & 0xff);
+    }
+}
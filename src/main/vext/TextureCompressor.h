@@ -0,0 +1,48 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _VEXT_TEXTURE_COMPRESSOR_H_
+#define _VEXT_TEXTURE_COMPRESSOR_H_
+
+#include <vesta/DataChunk.h>
+#include <QImage>
+#include <QByteArray>
+
+
+/** TextureCompressor prepares images for upload as DXT compressed textures. The
+  * complete mipmap chain is built with a box filter and each level is encoded as
+  * DXT1 (opaque images) or DXT5 (images with an alpha channel.) The result is
+  * packaged as the contents of a DDS file, so that it can be handed to the same
+  * code path that loads DDS textures from disk.
+  *
+  * All of the work is done on the CPU, and none of it requires a GL context; it's
+  * intended to be run in a texture loading thread, leaving only the upload for the
+  * rendering thread.
+  */
+class TextureCompressor
+{
+public:
+    static bool canCompress(const QImage& image);
+    static vesta::DataChunk* compress(const QImage& image);
+
+private:
+    static void downsample(const QByteArray& src, unsigned int width, unsigned int height, QByteArray* dest);
+    static void encodeLevel(const QByteArray& pixels, unsigned int width, unsigned int height, bool alpha, QByteArray* out);
+    static void encodeColorBlock(const unsigned char* block, unsigned char* out);
+    static void encodeAlphaBlock(const unsigned char* block, unsigned char* out);
+};
+
+#endif // _VEXT_TEXTURE_COMPRESSOR_H_
@@ -0,0 +1,301 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TileArchive.h"
+#include <QHash>
+#include <QWeakPointer>
+#include <QMutexLocker>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+
+using namespace std;
+
+
+static const char ArchiveMagic[8] = { 'C', 'T', 'I', 'L', 'E', 'P', 'A', 'K' };
+static const quint32 ArchiveVersion = 1;
+static const int HeaderSize = 32;
+static const int IndexEntrySize = 24;
+
+// Archives are shared by all tiled maps and image loaders that use them. Only weak
+// references are kept here so that an archive is closed when it's no longer used.
+static QHash<QString, QWeakPointer<TileArchive> > s_openArchives;
+static QMutex s_openArchivesMutex;
+
+
+TileArchive::TileArchive(const QString& fileName) :
+    m_fileName(fileName),
+    m_file(fileName),
+    m_mappedData(NULL),
+    m_fileSize(0),
+    m_levelCount(0),
+    m_tileFormat(ImageFormat),
+    m_tileCount(0)
+{
+}
+
+
+TileArchive::~TileArchive()
+{
+    if (m_mappedData)
+    {
+        m_file.unmap(const_cast<uchar*>(m_mappedData));
+    }
+}
+
+
+/** Get the archive with the specified file name, opening it if it isn't already
+  * open. This method may be called from any thread.
+  *
+  * \return the archive, or a null pointer if the archive couldn't be opened
+  */
+QSharedPointer<TileArchive>
+TileArchive::open(const QString& fileName)
+{
+    QString key = QFileInfo(fileName).absoluteFilePath();
+
+    QMutexLocker locker(&s_openArchivesMutex);
+
+    QSharedPointer<TileArchive> archive = s_openArchives.value(key).toStrongRef();
+    if (archive.isNull())
+    {
+        archive = QSharedPointer<TileArchive>(new TileArchive(key));
+        if (!archive->openFile())
+        {
+            return QSharedPointer<TileArchive>();
+        }
+        s_openArchives.insert(key, archive.toWeakRef());
+    }
+
+    return archive;
+}
+
+
+bool
+TileArchive::openFile()
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "Can't open tile archive " << m_fileName;
+        return false;
+    }
+
+    m_fileSize = m_file.size();
+    QByteArray header = m_file.read(HeaderSize);
+    if (header.size() != HeaderSize || !equal(ArchiveMagic, ArchiveMagic + 8, header.constData()))
+    {
+        qDebug() << "Bad header in tile archive " << m_fileName;
+        return false;
+    }
+
+    const uchar* h = reinterpret_cast<const uchar*>(header.constData());
+    quint32 version = qFromLittleEndian<quint32>(h + 8);
+    m_levelCount = qFromLittleEndian<quint32>(h + 12);
+    quint32 format = qFromLittleEndian<quint32>(h + 16);
+    m_tileCount = qFromLittleEndian<quint32>(h + 20);
+    quint64 indexOffset = qFromLittleEndian<quint64>(h + 24);
+
+    if (version != ArchiveVersion || format > DDSFormat)
+    {
+        qDebug() << "Unsupported tile archive version or format: " << m_fileName;
+        return false;
+    }
+    m_tileFormat = TileFormat(format);
+
+    if (indexOffset < quint64(HeaderSize) ||
+        indexOffset + quint64(m_tileCount) * IndexEntrySize > quint64(m_fileSize))
+    {
+        qDebug() << "Tile archive " << m_fileName << " is truncated";
+        return false;
+    }
+
+    // Map the whole file. If mapping fails, keep the index in memory and read tiles
+    // through the file instead.
+    m_mappedData = m_file.map(0, m_fileSize);
+    if (!m_mappedData)
+    {
+        m_file.seek(qint64(indexOffset));
+        m_indexData = m_file.read(qint64(m_tileCount) * IndexEntrySize);
+    }
+    else
+    {
+        m_indexData = QByteArray::fromRawData(reinterpret_cast<const char*>(m_mappedData + indexOffset),
+                                              int(m_tileCount) * IndexEntrySize);
+    }
+
+    return m_indexData.size() == int(m_tileCount) * IndexEntrySize;
+}
+
+
+// Binary search the index for a tile
+const uchar*
+TileArchive::findIndexEntry(quint64 id) const
+{
+    const uchar* index = reinterpret_cast<const uchar*>(m_indexData.constData());
+
+    unsigned int low = 0;
+    unsigned int high = m_tileCount;
+    while (low < high)
+    {
+        unsigned int mid = low + (high - low) / 2;
+        quint64 midId = qFromLittleEndian<quint64>(index + mid * IndexEntrySize);
+        if (midId < id)
+        {
+            low = mid + 1;
+        }
+        else if (midId > id)
+        {
+            high = mid;
+        }
+        else
+        {
+            return index + mid * IndexEntrySize;
+        }
+    }
+
+    return NULL;
+}
+
+
+/** Return true if the archive contains the tile at the specified address.
+  */
+bool
+TileArchive::contains(unsigned int level, unsigned int column, unsigned int row) const
+{
+    return findIndexEntry(tileId(level, column, row)) != NULL;
+}
+
+
+/** Get the contents of a tile. When the archive is memory mapped, no data is copied:
+  * the returned byte array refers directly to the mapped file, and it must not be
+  * used after the archive is destroyed.
+  *
+  * \return the tile data, or an empty array if the tile isn't present
+  */
+QByteArray
+TileArchive::tileData(unsigned int level, unsigned int column, unsigned int row)
+{
+    const uchar* entry = findIndexEntry(tileId(level, column, row));
+    if (!entry)
+    {
+        return QByteArray();
+    }
+
+    quint64 offset = qFromLittleEndian<quint64>(entry + 8);
+    quint32 size = qFromLittleEndian<quint32>(entry + 16);
+    if (offset + size > quint64(m_fileSize))
+    {
+        return QByteArray();
+    }
+
+    if (m_mappedData)
+    {
+        return QByteArray::fromRawData(reinterpret_cast<const char*>(m_mappedData + offset), int(size));
+    }
+    else
+    {
+        QMutexLocker locker(&m_fileMutex);
+        m_file.seek(qint64(offset));
+        return m_file.read(qint64(size));
+    }
+}
+
+
+TileArchiveWriter::TileArchiveWriter(const QString& fileName, unsigned int levelCount, TileArchive::TileFormat format) :
+    m_file(fileName),
+    m_levelCount(levelCount),
+    m_tileFormat(format)
+{
+}
+
+
+TileArchiveWriter::~TileArchiveWriter()
+{
+}
+
+
+/** Create the archive file. A placeholder header is written; it is filled in by finish().
+  */
+bool
+TileArchiveWriter::open()
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        return false;
+    }
+
+    QByteArray header(HeaderSize, '\0');
+    return m_file.write(header) == HeaderSize;
+}
+
+
+bool
+TileArchiveWriter::addTile(unsigned int level, unsigned int column, unsigned int row, const QByteArray& data)
+{
+    IndexEntry entry;
+    entry.id = TileArchive::tileId(level, column, row);
+    entry.offset = quint64(m_file.pos());
+    entry.size = quint32(data.size());
+
+    if (m_file.write(data) != data.size())
+    {
+        return false;
+    }
+
+    m_index << entry;
+    return true;
+}
+
+
+/** Write the tile index and header and close the archive file.
+  */
+bool
+TileArchiveWriter::finish()
+{
+    sort(m_index.begin(), m_index.end());
+
+    quint64 indexOffset = quint64(m_file.pos());
+
+    QByteArray index(m_index.size() * IndexEntrySize, '\0');
+    uchar* p = reinterpret_cast<uchar*>(index.data());
+    foreach (const IndexEntry& entry, m_index)
+    {
+        qToLittleEndian<quint64>(entry.id, p);
+        qToLittleEndian<quint64>(entry.offset, p + 8);
+        qToLittleEndian<quint32>(entry.size, p + 16);
+        p += IndexEntrySize;
+    }
+
+    if (m_file.write(index) != index.size())
+    {
+        return false;
+    }
+
+    QByteArray header(HeaderSize, '\0');
+    uchar* h = reinterpret_cast<uchar*>(header.data());
+    copy(ArchiveMagic, ArchiveMagic + 8, header.data());
+    qToLittleEndian<quint32>(ArchiveVersion, h + 8);
+    qToLittleEndian<quint32>(quint32(m_levelCount), h + 12);
+    qToLittleEndian<quint32>(quint32(m_tileFormat), h + 16);
+    qToLittleEndian<quint32>(quint32(m_index.size()), h + 20);
+    qToLittleEndian<quint64>(indexOffset, h + 24);
+
+    bool ok = m_file.seek(0) && m_file.write(header) == HeaderSize;
+    m_file.close();
+
+    return ok;
+}
@@ -0,0 +1,144 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _VEXT_TILE_ARCHIVE_H_
+#define _VEXT_TILE_ARCHIVE_H_
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QVector>
+#include <QSharedPointer>
+
+
+/** TileArchive provides access to a tile pyramid packed into a single file. The
+  * archive is memory mapped when possible, so reading a tile requires neither
+  * an open() call nor a directory lookup.
+  *
+  * All integers in the archive are little endian. The layout is:
+  *
+  *   header (32 bytes)
+  *     8 bytes - magic "CTILEPAK"
+  *     4 bytes - uint32 - version (currently 1)
+  *     4 bytes - uint32 - level count
+  *     4 bytes - uint32 - tile format (0 = image file readable by Qt, 1 = DDS)
+  *     4 bytes - uint32 - tile count
+  *     8 bytes - uint64 - offset of the tile index
+  *   tile data
+  *     the unmodified contents of each tile file, stored contiguously in
+  *     index order
+  *   tile index (24 bytes per tile, sorted by tile id)
+  *     8 bytes - uint64 - tile id: (level << 48) | (column << 24) | row
+  *     8 bytes - uint64 - offset of tile data
+  *     4 bytes - uint32 - size of tile data
+  *     4 bytes - reserved
+  *
+  * Tile addresses follow the HierarchicalTiledMap convention, where row 0 is
+  * the southernmost row of a level.
+  */
+class TileArchive
+{
+public:
+    enum TileFormat
+    {
+        ImageFormat = 0,
+        DDSFormat   = 1
+    };
+
+    ~TileArchive();
+
+    QString fileName() const
+    {
+        return m_fileName;
+    }
+
+    unsigned int levelCount() const
+    {
+        return m_levelCount;
+    }
+
+    TileFormat tileFormat() const
+    {
+        return m_tileFormat;
+    }
+
+    unsigned int tileCount() const
+    {
+        return m_tileCount;
+    }
+
+    bool contains(unsigned int level, unsigned int column, unsigned int row) const;
+    QByteArray tileData(unsigned int level, unsigned int column, unsigned int row);
+
+    static QSharedPointer<TileArchive> open(const QString& fileName);
+
+    static quint64 tileId(unsigned int level, unsigned int column, unsigned int row)
+    {
+        return (quint64(level) << 48) | (quint64(column) << 24) | quint64(row);
+    }
+
+private:
+    TileArchive(const QString& fileName);
+    bool openFile();
+    const uchar* findIndexEntry(quint64 id) const;
+
+private:
+    QString m_fileName;
+    QFile m_file;
+    QMutex m_fileMutex;
+    const uchar* m_mappedData;
+    qint64 m_fileSize;
+    QByteArray m_indexData;
+    unsigned int m_levelCount;
+    TileFormat m_tileFormat;
+    unsigned int m_tileCount;
+};
+
+
+/** TileArchiveWriter creates a tile archive. Tiles may be added in any order;
+  * the index is sorted when the archive is finished.
+  */
+class TileArchiveWriter
+{
+public:
+    TileArchiveWriter(const QString& fileName, unsigned int levelCount, TileArchive::TileFormat format);
+    ~TileArchiveWriter();
+
+    bool open();
+    bool addTile(unsigned int level, unsigned int column, unsigned int row, const QByteArray& data);
+    bool finish();
+
+private:
+    struct IndexEntry
+    {
+        quint64 id;
+        quint64 offset;
+        quint32 size;
+
+        bool operator<(const IndexEntry& other) const
+        {
+            return id < other.id;
+        }
+    };
+
+    QFile m_file;
+    unsigned int m_levelCount;
+    TileArchive::TileFormat m_tileFormat;
+    QVector<IndexEntry> m_index;
+};
+
+#endif // _VEXT_TILE_ARCHIVE_H_
@@ -0,0 +1,538 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TileManifest.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDataStream>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QDebug>
+#include <algorithm>
+
+using namespace std;
+
+
+static const quint32 ManifestMagic = 0x464d5443; // "CTMF"
+static const quint32 ManifestVersion = 1;
+
+// Deeper levels would overflow the 32-bit tile index
+static const unsigned int MaxManifestLevels = 16;
+
+
+// Background task that loads or builds a manifest. The task keeps a reference
+// to the manifest so that it remains valid even if the tiled map that owns it
+// is destroyed first.
+class TileManifestTask : public QRunnable
+{
+public:
+    TileManifestTask(const QSharedPointer<TileManifest>& manifest) :
+        m_manifest(manifest)
+    {
+    }
+
+    virtual void run()
+    {
+        TileManifest::open(m_manifest.data());
+    }
+
+private:
+    QSharedPointer<TileManifest> m_manifest;
+};
+
+
+static qint64
+directoryModificationTime(const QString& path)
+{
+    QFileInfo info(path);
+    if (info.exists())
+    {
+        return info.lastModified().toMSecsSinceEpoch();
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+
+/** Create a new, empty tile manifest. The manifest is not ready for queries
+  * until it has been opened or built.
+  *
+  * \param namePattern tile file name pattern containing %level, %column, and %row
+  * \param flipped true if row 0 in tile file names is the northernmost row
+  * \param levelCount number of levels in the tile pyramid
+  */
+TileManifest::TileManifest(const QString& namePattern, bool flipped, unsigned int levelCount) :
+    m_namePattern(namePattern),
+    m_flipped(flipped),
+    m_levelCount(min(levelCount, MaxManifestLevels)),
+    m_ready(0)
+{
+}
+
+
+TileManifest::~TileManifest()
+{
+}
+
+
+/** Return true if the tile at the specified address is present. The result
+  * is only meaningful once isReady() returns true.
+  */
+bool
+TileManifest::contains(unsigned int level, unsigned int column, unsigned int row) const
+{
+    if (level >= (unsigned int) m_levels.size())
+    {
+        return false;
+    }
+
+    unsigned int columnCount = 2u << level;
+    unsigned int rowCount = 1u << level;
+    if (column >= columnCount || row >= rowCount)
+    {
+        return false;
+    }
+
+    const Level& l = m_levels[level];
+    quint32 index = row * columnCount + column;
+    if (l.bitmap)
+    {
+        int byteIndex = int(index >> 3);
+        return byteIndex < l.bits.size() && (l.bits.at(byteIndex) & (1 << (index & 7))) != 0;
+    }
+    else
+    {
+        return binary_search(l.indices.begin(), l.indices.end(), index);
+    }
+}
+
+
+/** Get the total number of tiles recorded in the manifest.
+  */
+unsigned int
+TileManifest::tileCount() const
+{
+    unsigned int count = 0;
+    foreach (const Level& l, m_levels)
+    {
+        count += l.count;
+    }
+
+    return count;
+}
+
+
+/** Get the name of the file for the tile at the specified address.
+  */
+QString
+TileManifest::tileFileName(unsigned int level, unsigned int column, unsigned int row) const
+{
+    unsigned int y = m_flipped ? (1u << level) - 1 - row : row;
+
+    QString name = m_namePattern;
+    name.replace("%level", QString::number(level));
+    name.replace("%column", QString::number(column));
+    name.replace("%row", QString::number(y));
+
+    return name;
+}
+
+
+/** Get the deepest directory that is shared by all tiles, i.e. the directory part
+  * of the name pattern before the first substitution.
+  */
+QString
+TileManifest::rootDirectory() const
+{
+    int firstSubstitution = m_namePattern.indexOf('%');
+    QString prefix = firstSubstitution < 0 ? m_namePattern : m_namePattern.left(firstSubstitution);
+
+    return QFileInfo(prefix).absolutePath();
+}
+
+
+// Get the name pattern relative to the root directory. This is used to identify
+// the tile set independently of where it is installed.
+static QString
+relativeNamePattern(const QString& rootDirectory, const QString& namePattern)
+{
+    return QDir(rootDirectory).relativeFilePath(QFileInfo(namePattern).absoluteFilePath());
+}
+
+
+/** Get the name of the manifest file stored alongside the tiles. This is the
+  * file written by the tilemanifest tool. The file name contains a hash of the
+  * name pattern so that several tile sets may share a directory.
+  */
+QString
+TileManifest::fileName() const
+{
+    QString root = rootDirectory();
+    QByteArray hash = QCryptographicHash::hash(relativeNamePattern(root, m_namePattern).toUtf8(), QCryptographicHash::Md5);
+
+    return root + "/" + QString("tiles-%1.manifest").arg(QString::fromLatin1(hash.toHex().left(8)));
+}
+
+
+/** Get the name of the manifest file in the user's cache directory. Manifests
+  * generated at run time are written here, since the tile directory may not be
+  * writable.
+  */
+QString
+TileManifest::cacheFileName() const
+{
+    QString key = QFileInfo(m_namePattern).absoluteFilePath() + QString(":%1:%2").arg(int(m_flipped)).arg(m_levelCount);
+    QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5);
+    QString cacheDirName = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/tile_manifests";
+
+    return cacheDirName + "/" + QString::fromLatin1(hash.toHex().left(16)) + ".manifest";
+}
+
+
+/** Return true if none of the directories scanned when the manifest was
+  * built have been modified since then.
+  */
+bool
+TileManifest::isCurrent() const
+{
+    if (m_directories.isEmpty())
+    {
+        return false;
+    }
+
+    QDir root(rootDirectory());
+    foreach (const DirectoryStamp& stamp, m_directories)
+    {
+        if (directoryModificationTime(root.absoluteFilePath(stamp.path)) != stamp.modificationTime)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void
+TileManifest::clear()
+{
+    m_levels.clear();
+    m_directories.clear();
+}
+
+
+void
+TileManifest::setReady()
+{
+    m_ready.storeRelease(1);
+}
+
+
+/** Build the manifest by scanning the tile directories. Each directory is
+  * listed only once, and the children of a tile are only checked if the tile
+  * itself is present; tiles without a parent are thus never recorded, but
+  * HierarchicalTiledMap would not be able to reach them anyway.
+  *
+  * This method must not be called once the manifest is ready.
+  */
+bool
+TileManifest::build()
+{
+    if (isReady())
+    {
+        return false;
+    }
+
+    clear();
+    m_levels.resize(m_levelCount);
+
+    QHash<QString, QSet<QString> > directoryContents;
+    QVector<quint32> present;
+
+    for (unsigned int level = 0; level < m_levelCount; ++level)
+    {
+        unsigned int columnCount = 2u << level;
+
+        QVector<quint32> candidates;
+        if (level == 0)
+        {
+            candidates << 0 << 1;
+        }
+        else
+        {
+            unsigned int parentColumnCount = columnCount / 2;
+            foreach (quint32 parent, present)
+            {
+                quint32 column = (parent % parentColumnCount) * 2;
+                quint32 row = (parent / parentColumnCount) * 2;
+                quint32 index = row * columnCount + column;
+                candidates << index << index + 1 << index + columnCount << index + columnCount + 1;
+            }
+        }
+
+        present.clear();
+        foreach (quint32 index, candidates)
+        {
+            QFileInfo info(tileFileName(level, index % columnCount, index / columnCount));
+            QString dirPath = info.absolutePath();
+
+            QHash<QString, QSet<QString> >::iterator iter = directoryContents.find(dirPath);
+            if (iter == directoryContents.end())
+            {
+                QStringList entries = QDir(dirPath).entryList(QDir::Files);
+                iter = directoryContents.insert(dirPath, QSet<QString>::fromList(entries));
+            }
+
+            if (iter->contains(info.fileName()))
+            {
+                present << index;
+            }
+        }
+
+        sort(present.begin(), present.end());
+
+        // Store the level as either a bitmap or a list of indices, whichever is smaller
+        Level& l = m_levels[level];
+        l.count = present.size();
+        quint64 bitmapSize = (quint64(columnCount) * (columnCount / 2) + 7) / 8;
+        if (bitmapSize <= quint64(present.size()) * sizeof(quint32))
+        {
+            l.bitmap = true;
+            l.bits.fill(0, int(bitmapSize));
+            foreach (quint32 index, present)
+            {
+                l.bits[int(index >> 3)] = l.bits.at(int(index >> 3)) | char(1 << (index & 7));
+            }
+        }
+        else
+        {
+            l.bitmap = false;
+            l.indices = present;
+        }
+
+        if (present.isEmpty())
+        {
+            // No deeper levels can be present
+            break;
+        }
+    }
+
+    QDir root(rootDirectory());
+    foreach (const QString& dirPath, directoryContents.keys())
+    {
+        DirectoryStamp stamp;
+        stamp.path = root.relativeFilePath(dirPath);
+        stamp.modificationTime = directoryModificationTime(dirPath);
+        m_directories << stamp;
+    }
+
+    return true;
+}
+
+
+/** Load the manifest from a file. Loading fails if the file was generated for
+  * a different tile set. The caller must check isCurrent() to verify that the
+  * manifest still reflects the contents of the tile directories.
+  *
+  * This method must not be called once the manifest is ready.
+  */
+bool
+TileManifest::load(const QString& fileName)
+{
+    if (isReady())
+    {
+        return false;
+    }
+
+    clear();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_6);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != ManifestMagic || version != ManifestVersion)
+    {
+        qDebug() << "Ignoring tile manifest with bad header: " << fileName;
+        return false;
+    }
+
+    QString pattern;
+    quint8 flipped = 0;
+    quint32 levelCount = 0;
+    in >> pattern >> flipped >> levelCount;
+    if (pattern != relativeNamePattern(rootDirectory(), m_namePattern) ||
+        (flipped != 0) != m_flipped ||
+        levelCount != m_levelCount)
+    {
+        qDebug() << "Ignoring tile manifest for a different tile set: " << fileName;
+        return false;
+    }
+
+    quint32 directoryCount = 0;
+    in >> directoryCount;
+    for (quint32 i = 0; i < directoryCount && in.status() == QDataStream::Ok; ++i)
+    {
+        DirectoryStamp stamp;
+        in >> stamp.path >> stamp.modificationTime;
+        m_directories << stamp;
+    }
+
+    m_levels.resize(m_levelCount);
+    for (unsigned int level = 0; level < m_levelCount && in.status() == QDataStream::Ok; ++level)
+    {
+        Level& l = m_levels[level];
+        quint8 bitmap = 0;
+        quint32 count = 0;
+        in >> bitmap >> count;
+        l.bitmap = bitmap != 0;
+        l.count = count;
+        if (l.bitmap)
+        {
+            in >> l.bits;
+        }
+        else
+        {
+            in >> l.indices;
+        }
+    }
+
+    if (in.status() != QDataStream::Ok)
+    {
+        qDebug() << "Error reading tile manifest " << fileName;
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+/** Write the manifest to a file, creating the containing directory if necessary.
+  */
+bool
+TileManifest::save(const QString& fileName) const
+{
+    QDir dir = QFileInfo(fileName).dir();
+    if (!dir.exists())
+    {
+        dir.mkpath(dir.absolutePath());
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_6);
+    out.setByteOrder(QDataStream::LittleEndian);
+
+    out << ManifestMagic << ManifestVersion;
+    out << relativeNamePattern(rootDirectory(), m_namePattern) << quint8(m_flipped ? 1 : 0) << quint32(m_levelCount);
+
+    out << quint32(m_directories.size());
+    foreach (const DirectoryStamp& stamp, m_directories)
+    {
+        out << stamp.path << stamp.modificationTime;
+    }
+
+    for (unsigned int level = 0; level < m_levelCount; ++level)
+    {
+        Level l;
+        if (level < (unsigned int) m_levels.size())
+        {
+            l = m_levels[level];
+        }
+
+        out << quint8(l.bitmap ? 1 : 0) << quint32(l.count);
+        if (l.bitmap)
+        {
+            out << l.bits;
+        }
+        else
+        {
+            out << l.indices;
+        }
+    }
+
+    return out.status() == QDataStream::Ok;
+}
+
+
+/** Make the manifest ready for queries, using the first current manifest file
+  * found alongside the tiles or in the cache. If there is none, the tile
+  * directories are scanned and the result is saved to the cache.
+  */
+void
+TileManifest::open(TileManifest* manifest)
+{
+    if (manifest->isReady())
+    {
+        return;
+    }
+
+    if (manifest->load(manifest->fileName()) && manifest->isCurrent())
+    {
+        manifest->setReady();
+        return;
+    }
+
+    QString cacheFile = manifest->cacheFileName();
+    if (manifest->load(cacheFile) && manifest->isCurrent())
+    {
+        manifest->setReady();
+        return;
+    }
+
+    qDebug() << "Building tile manifest for " << manifest->namePattern();
+    manifest->build();
+    if (!manifest->save(cacheFile))
+    {
+        qDebug() << "Failed writing tile manifest to " << cacheFile;
+    }
+
+    manifest->setReady();
+}
+
+
+/** Open the manifest in a thread from the global thread pool. The manifest becomes
+  * ready when the operation is complete; until then, callers should fall back to
+  * checking the file system.
+  */
+void
+TileManifest::openInBackground(const QSharedPointer<TileManifest>& manifest)
+{
+    QThreadPool::globalInstance()->start(new TileManifestTask(manifest));
+}
@@ -0,0 +1,116 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _VEXT_TILE_MANIFEST_H_
+#define _VEXT_TILE_MANIFEST_H_
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QList>
+#include <QAtomicInt>
+#include <QSharedPointer>
+
+
+/** TileManifest records which tiles of a local tile pyramid are present on
+  * disk, so that tile existence queries can be answered from memory instead
+  * of with a stat() call per tile.
+  *
+  * Tile file names are generated from a name pattern in which the strings
+  * %level, %column, and %row are replaced with the tile address. When the
+  * manifest is flipped, row 0 is the northernmost row of a level.
+  *
+  * The manifest stores one compact set per level: either a bitmap with one bit
+  * per tile address or, for sparsely populated levels, a sorted list of tile
+  * indices; whichever is smaller. The modification times of the directories
+  * that were scanned are stored too, and the manifest is considered stale as
+  * soon as any of them changes.
+  */
+class TileManifest
+{
+public:
+    TileManifest(const QString& namePattern, bool flipped, unsigned int levelCount);
+    ~TileManifest();
+
+    QString namePattern() const
+    {
+        return m_namePattern;
+    }
+
+    bool isFlipped() const
+    {
+        return m_flipped;
+    }
+
+    unsigned int levelCount() const
+    {
+        return m_levelCount;
+    }
+
+    /** Return true once the manifest has been loaded or built and may be queried.
+      * This may be called from any thread.
+      */
+    bool isReady() const
+    {
+        return m_ready.loadAcquire() != 0;
+    }
+
+    bool contains(unsigned int level, unsigned int column, unsigned int row) const;
+    unsigned int tileCount() const;
+
+    QString tileFileName(unsigned int level, unsigned int column, unsigned int row) const;
+    QString rootDirectory() const;
+    QString fileName() const;
+    QString cacheFileName() const;
+
+    bool isCurrent() const;
+    bool build();
+    bool load(const QString& fileName);
+    bool save(const QString& fileName) const;
+
+    static void openInBackground(const QSharedPointer<TileManifest>& manifest);
+    static void open(TileManifest* manifest);
+
+private:
+    struct Level
+    {
+        Level() : bitmap(false), count(0) {}
+
+        bool bitmap;
+        unsigned int count;
+        QByteArray bits;
+        QVector<quint32> indices;
+    };
+
+    struct DirectoryStamp
+    {
+        QString path;
+        qint64 modificationTime;
+    };
+
+    void clear();
+    void setReady();
+
+private:
+    QString m_namePattern;
+    bool m_flipped;
+    unsigned int m_levelCount;
+    QVector<Level> m_levels;
+    QList<DirectoryStamp> m_directories;
+    QAtomicInt m_ready;
+};
+
+#endif // _VEXT_TILE_MANIFEST_H_
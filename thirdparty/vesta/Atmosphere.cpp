@@ -494,61 +494,66 @@ Atmosphere::computeTransmittanceTable(unsigned int heightSamples,
     VESTA_LOG("Rayleigh extinction: %f %f %f", Er.x(), Er.y(), Er.z());
     VESTA_LOG("Mie extinction: %f %f %f", Em.x(), Em.y(), Em.z());
 
-    for (unsigned int i = 0; i < heightSamples; ++i)
+    // Every table entry is computed independently of the others, so the rows may be
+    // integrated in parallel without changing the results.
+    const int tableSize = int(heightSamples * viewAngleSamples);
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int cell = 0; cell < tableSize; ++cell)
     {
+        unsigned int i = (unsigned int) cell / viewAngleSamples;
+        unsigned int j = (unsigned int) cell % viewAngleSamples;
+
         float v = float(i) / float(heightSamples);
         float h = minHeight + v * v * maxHeight;
 
         // Calculate the eye position from h
         Vector3f eye = Vector3f::UnitZ() * (m_planetRadius + h);
 
-        for (unsigned int j = 0; j < viewAngleSamples; ++j)
-        {
-            float u = float(j) / float(viewAngleSamples - 1);
-            float mu = toCosViewAngle(u);
+        float u = float(j) / float(viewAngleSamples - 1);
+        float mu = toCosViewAngle(u);
 
-            // Calculate the view direction from mu
-            float cosTheta = mu;
-            float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));
-            Vector3f viewDir(sinTheta, 0.0f, cosTheta);
+        // Calculate the view direction from mu
+        float cosTheta = mu;
+        float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));
+        Vector3f viewDir(sinTheta, 0.0f, cosTheta);
 
-            float pathLength = 0.0f;
-            // The view ray will intersect either the planet or the atmosphere shell geometry
-            if (!TestRaySphereIntersection(eye, viewDir, Vector3f::Zero(), m_planetRadius, &pathLength))
-            {
-                TestRaySphereIntersection(eye, viewDir, Vector3f::Zero(), m_planetRadius + maxHeight, &pathLength);
-            }
-
-            // Compute the intersection point
-            Vector3f x0 = eye + pathLength * viewDir;
+        float pathLength = 0.0f;
+        // The view ray will intersect either the planet or the atmosphere shell geometry
+        if (!TestRaySphereIntersection(eye, viewDir, Vector3f::Zero(), m_planetRadius, &pathLength))
+        {
+            TestRaySphereIntersection(eye, viewDir, Vector3f::Zero(), m_planetRadius + maxHeight, &pathLength);
+        }
 
 #if 0
-            // Numerical integration to compute transmittance
-            Vector3f step = (x0 - eye) / float(integrationSteps);
-            float stepLength = pathLength / float(integrationSteps);
+        // Compute the intersection point
+        Vector3f x0 = eye + pathLength * viewDir;
 
-            // Sum to get the integral of optical depth between the eye and the intersection
-            // point.
-            Vector3f p = eye;
-            float Tr = 0.0f;
-            float Tm = 0.0f;
+        // Numerical integration to compute transmittance
+        Vector3f step = (x0 - eye) / float(integrationSteps);
+        float stepLength = pathLength / float(integrationSteps);
 
-            for (unsigned int k = 0; k < integrationSteps; ++k)
-            {
-                float s = p.norm() - m_planetRadius;
-                
-                Tr += exp(-s / m_rayleighScaleHeight);
-                Tm += exp(-s / m_mieScaleHeight);
-                p += step;
-            }
-            Vector3f opticalDepth = (Er * Tr + Em * Tm) * stepLength;
-            Vector3f xmit = (-opticalDepth).cwise().exp();
+        // Sum to get the integral of optical depth between the eye and the intersection
+        // point.
+        Vector3f p = eye;
+        float Tr = 0.0f;
+        float Tm = 0.0f;
+
+        for (unsigned int k = 0; k < integrationSteps; ++k)
+        {
+            float s = p.norm() - m_planetRadius;
+
+            Tr += exp(-s / m_rayleighScaleHeight);
+            Tm += exp(-s / m_mieScaleHeight);
+            p += step;
+        }
+        Vector3f opticalDepth = (Er * Tr + Em * Tm) * stepLength;
+        Vector3f xmit = (-opticalDepth).cwise().exp();
 #else
-            // Use analytic transmittance calculation
-            Vector3f xmit = transmittance(eye.z(), viewDir.z(), pathLength);
+        // Use analytic transmittance calculation
+        Vector3f xmit = transmittance(eye.z(), viewDir.z(), pathLength);
 #endif
-            m_transmittanceTable[i * viewAngleSamples + j] = xmit;
-        }
+        m_transmittanceTable[cell] = xmit;
     }
 }
 
@@ -594,92 +599,86 @@ Atmosphere::computeInscatterTable(unsigned int heightSamples,
     const float Sm = m_mieScatteringCoeff * 1000.0f;
     const Vector4f scatterFactors = Vector4f(Sr.x(), Sr.y(), Sr.z(), Sm);
 
-    for (unsigned int i = 0; i < heightSamples; ++i)
+    VESTA_LOG("Computing %ux%ux%u scatter table", heightSamples, viewAngleSamples, sunAngleSamples);
+
+    // The table is integrated in parallel over height and view angle. Each (height, view angle)
+    // pair fills its own run of sun angle entries, and the arithmetic for an entry doesn't
+    // depend on how the work is divided among threads, so the table is identical to the one
+    // produced by a serial integration.
+    const int cellCount = int(heightSamples * viewAngleSamples);
+
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int cell = 0; cell < cellCount; ++cell)
     {
-        VESTA_LOG("Scatter texture layer: %d", i);
+        unsigned int i = (unsigned int) cell / viewAngleSamples;
+        unsigned int j = (unsigned int) cell % viewAngleSamples;
+
         float w = float(i) / float(heightSamples);
         float h = minHeight + w * w * maxHeight;
 
         // Calculate the eye position from h
         Vector3f eye = Vector3f::UnitZ() * (m_planetRadius + h);
 
-        for (unsigned int j = 0; j < viewAngleSamples; ++j)
+        float v = float(j) / float(viewAngleSamples - 1);
+        float mu = toCosViewAngle(v);
+
+        // Calculate the view direction from mu
+        float cosTheta = mu;
+        float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));
+        Vector3f viewDir(sinTheta, 0.0f, cosTheta);
+
+        float pathLength = 0.0f;
+        // The view ray will intersect either the planet or the atmosphere shell geometry
+        if (!TestRaySphereIntersection(eye, viewDir, Vector3f::Zero(), m_planetRadius, &pathLength))
         {
-            float v = float(j) / float(viewAngleSamples - 1);
-            //float mu = 2.0f * v - 1.0f;
-            //float x = v * 2.0f - 1.0f;
-
-            //float mu = (x * 0.1f) / (1.1f - abs(x));
-            //float sn = x + 0.15f < 0.0f ? 1.0f : -1.0f;
-            //float mu = (x * (0.1f - 0.15f * sn) - 0.165f) / (sn * x + 1.1f);
-            float mu = toCosViewAngle(v);
-
-            // Calculate the view direction from mu
-            float cosTheta = mu;
-            float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));
-            Vector3f viewDir(sinTheta, 0.0f, cosTheta);
-
-            float pathLength = 0.0f;
-            // The view ray will intersect either the planet or the atmosphere shell geometry
-            if (!TestRaySphereIntersection(eye, viewDir, Vector3f::Zero(), m_planetRadius, &pathLength))
-            {
-                TestRaySphereIntersection(eye, viewDir, Vector3f::Zero(), m_planetRadius + maxHeight, &pathLength);
-            }
+            TestRaySphereIntersection(eye, viewDir, Vector3f::Zero(), m_planetRadius + maxHeight, &pathLength);
+        }
 
-            // Compute the intersection point
-            Vector3f x0 = eye + pathLength * viewDir;
+        // Compute the intersection point
+        Vector3f x0 = eye + pathLength * viewDir;
 
-            Vector3f step = (x0 - eye) / float(integrationSteps);
-            float stepLength = pathLength / float(integrationSteps);
+        Vector3f step = (x0 - eye) / float(integrationSteps);
+        float stepLength = pathLength / float(integrationSteps);
+
+        for (unsigned int k = 0; k < sunAngleSamples; ++k)
+        {
+            float u = float(k) / float(sunAngleSamples - 1);
+            float muS = toCosSunAngle(u);
 
-            Vector3f viewRayTransmittance = transmittance(eye.z(), viewDir.z(), pathLength);
-            //Vector3f viewRayTransmittance = transmittance(eye.z(), viewDir.z());
+            // Calculate the sun direction from mu
+            float cosPhi = muS;
+            float sinPhi2 = 1.0f - cosPhi * cosPhi;
+            float sinPhi = sqrt(max(0.0f, sinPhi2));
+            Vector3f sunDir(sinPhi, 0.0f, cosPhi);
 
-            for (unsigned int k = 0; k < sunAngleSamples; ++k)
+            // Sum to get the integral of optical depth between the eye and the intersection
+            // point.
+            Vector3f p = eye;
+            Vector4f inscatter = Vector4f::Zero();
+
+            for (unsigned int l = 0; l < integrationSteps; ++l)
             {
-                float u = float(k) / float(sunAngleSamples - 1);
-                //float muS = 2.0f * u - 1.0f;
-                float muS = toCosSunAngle(u);//(log(1.0f - u * (1.0f - exp(-3.6f))) + 0.6f) / -3.0f;
-
-                // Calculate the sun direction from mu
-                float cosPhi = muS;
-                float sinPhi2 = 1.0f - cosPhi * cosPhi;
-                float sinPhi = sqrt(max(0.0f, sinPhi2));
-                Vector3f sunDir(sinPhi, 0.0f, cosPhi);
-
-                // Sum to get the integral of optical depth between the eye and the intersection
-                // point.
-                Vector3f p = eye;
-                Vector4f inscatter = Vector4f::Zero();
-
-                for (unsigned int l = 0; l < integrationSteps; ++l)
-                {
-                    float r = p.norm();
-                    float s = r - m_planetRadius;
-
-                    // Compute the transmittance along the view ray
-                    Vector3f viewXmit = transmittance(eye.z(), viewDir.z(), l * stepLength);
-                    //Vector3f viewXmit = viewRayTransmittance.cwise() / transmittance(r, p.dot(viewDir) / r, pathLength - (l + 1) * stepLength);
-                    //Vector3f viewXmit = viewRayTransmittance.cwise() / transmittance(r, p.dot(viewDir) / r);
-
-                    float cosPsi = p.dot(sunDir) / r;
-                    float sinPsi2 = 1.0f - cosPsi * cosPsi;
-
-                    // Compute the transmittance along the path to the sun
-                    float sunPathLength = -r * cosPsi + sqrt(atmRadius * atmRadius - r * r * sinPsi2);
-                    Vector3f sunXmit = transmittance(r, cosPsi, sunPathLength);
-                    float d1 = opticalDepth(r, cosPsi, sunPathLength, m_rayleighScaleHeight, m_planetRadius);
-                    float d2 = opticalDepth(r, cosPsi, sunPathLength, m_mieScaleHeight, m_planetRadius);
-
-                    Vector3f xmit = sunXmit.cwise() * viewXmit;
-                    inscatter.start<3>() += (exp(-s / m_rayleighScaleHeight) * stepLength) * xmit;
-                    inscatter.w() += exp(-s / m_mieScaleHeight) * stepLength * xmit.x();
-
-                    p += step;
-                }
-
-                m_inscatterTable[(i * viewAngleSamples + j) * sunAngleSamples + k] = inscatter.cwise() * scatterFactors;
+                float r = p.norm();
+                float s = r - m_planetRadius;
+
+                // Compute the transmittance along the view ray
+                Vector3f viewXmit = transmittance(eye.z(), viewDir.z(), l * stepLength);
+
+                float cosPsi = p.dot(sunDir) / r;
+                float sinPsi2 = 1.0f - cosPsi * cosPsi;
+
+                // Compute the transmittance along the path to the sun
+                float sunPathLength = -r * cosPsi + sqrt(atmRadius * atmRadius - r * r * sinPsi2);
+                Vector3f sunXmit = transmittance(r, cosPsi, sunPathLength);
+
+                Vector3f xmit = sunXmit.cwise() * viewXmit;
+                inscatter.start<3>() += (exp(-s / m_rayleighScaleHeight) * stepLength) * xmit;
+                inscatter.w() += exp(-s / m_mieScaleHeight) * stepLength * xmit.x();
+
+                p += step;
             }
+
+            m_inscatterTable[cell * sunAngleSamples + k] = inscatter.cwise() * scatterFactors;
         }
     }
 }
@@ -863,12 +862,19 @@ Atmosphere::LoadAtmScat(const DataChunk* data)
   *
   * transmittance table (width * height * 3 floats)
   * scattering table (width * height * depth * 4 floats)
+  *
+  * \return true if the file was written successfully
   */
-void
+bool
 Atmosphere::SaveAtmScat(const char* filename)
 {
     filebuf fb;
-    fb.open (filename,ios::out | ios::binary);
+    if (!fb.open(filename, ios::out | ios::binary))
+    {
+        VESTA_LOG("Can't create atmscat file %s", filename);
+        return false;
+    }
+
     ostream os(&fb);
     OutputDataStream out(os);
     out.setByteOrder(OutputDataStream::LittleEndian);
@@ -879,7 +885,7 @@ Atmosphere::SaveAtmScat(const char* filename)
     if (out.status() != OutputDataStream::Good)
     {
         VESTA_LOG("Error writing header of atmscat file.");
-        return;
+        return false;
     }
 
     out.writeFloat(m_rayleighScaleHeight);
@@ -902,7 +908,7 @@ Atmosphere::SaveAtmScat(const char* filename)
     if (out.status() != OutputDataStream::Good)
     {
         VESTA_LOG("Error writing header of atmscat file.");
-        return;
+        return false;
     }
 
     for (unsigned int i = 0; i < m_transmittanceTable.size(); ++i)
@@ -915,7 +921,7 @@ Atmosphere::SaveAtmScat(const char* filename)
     if (out.status() != OutputDataStream::Good)
     {
         VESTA_LOG("Error writing transmittance table in atmscat file.");
-        return;
+        return false;
     }
 
     for (unsigned int i = 0; i < m_inscatterTable.size(); ++i)
@@ -927,9 +933,9 @@ Atmosphere::SaveAtmScat(const char* filename)
     }
     if (out.status() != OutputDataStream::Good)
     {
-        VESTA_LOG("Error reading inscatter table in atmscat file.");
-        return;
+        VESTA_LOG("Error writing inscatter table in atmscat file.");
+        return false;
     }
 
-    fb.close();
+    return fb.close() != NULL;
 }
@@ -52,7 +52,7 @@ public:
     /** Get the height in kilometers at which the density of Rayleigh scattering
      *  particles is half that at ground level.
      */
-    float rayleighScaleHeight()
+    float rayleighScaleHeight() const
     {
         return m_rayleighScaleHeight;
     }
@@ -68,7 +68,7 @@ public:
     /** Get the height in kilometers at which the density of Mie scattering
      *  particles (aerosols) is half that at ground level.
      */
-    float mieScaleHeight()
+    float mieScaleHeight() const
     {
         return m_mieScaleHeight;
     }
@@ -170,7 +170,7 @@ public:
                            unsigned int viewAngleSamples,
                            unsigned int sunAngleSamples);
 
-    void SaveAtmScat(const char* filename);
+    bool SaveAtmScat(const char* filename);
 
     static const double IndexOfRefraction_Air_0;
     static const double IndexOfRefraction_Air_15;
@@ -68,10 +68,13 @@ Chronology::activeArc(double t) const
         double m_arcBeginning = m_beginning;
         for (vector<counted_ptr<Arc> >::const_iterator iter = m_arcSequence.begin(); iter != m_arcSequence.end(); iter++)
         {
-            counted_ptr<Arc> arc = *iter;
+            // Use a plain pointer here; copying the counted_ptr would modify the
+            // arc's reference count, and this method may be called from several
+            // threads at once.
+            Arc* arc = iter->ptr();
             if (t - m_arcBeginning < arc->duration())
             {
-                return &*arc;
+                return arc;
             }
 
             m_arcBeginning += arc->duration();
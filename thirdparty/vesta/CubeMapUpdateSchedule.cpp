@@ -0,0 +1,112 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#include "CubeMapUpdateSchedule.h"
+#include <algorithm>
+#include <limits>
+
+using namespace vesta;
+using namespace Eigen;
+
+
+static const unsigned int AllFaces = 0x3f;
+
+
+/** Create a new schedule that redraws at most facesPerUpdate faces per update.
+  * Initially, the cube map is considered out of date, and the first update will
+  * draw all faces.
+  */
+CubeMapUpdateSchedule::CubeMapUpdateSchedule(unsigned int facesPerUpdate) :
+    m_facesPerUpdate(1),
+    m_moveThreshold(0.0),
+    m_jumpThreshold(std::numeric_limits<double>::infinity()),
+    m_valid(false),
+    m_center(Vector3d::Zero()),
+    m_lastCenter(Vector3d::Zero()),
+    m_time(0.0),
+    m_staleFaces(AllFaces),
+    m_nextFace(0)
+{
+    setFacesPerUpdate(facesPerUpdate);
+}
+
+
+CubeMapUpdateSchedule::~CubeMapUpdateSchedule()
+{
+}
+
+
+/** Set the maximum number of faces to redraw per update. The value is clamped
+  * to the range 1 to 6; with six faces per update, the cube map is redrawn
+  * completely whenever anything changes.
+  */
+void
+CubeMapUpdateSchedule::setFacesPerUpdate(unsigned int faceCount)
+{
+    m_facesPerUpdate = std::max(1u, std::min(6u, faceCount));
+}
+
+
+/** Force all faces to be redrawn at the next update, e.g. because the cube map
+  * was recreated.
+  */
+void
+CubeMapUpdateSchedule::invalidate()
+{
+    m_valid = false;
+}
+
+
+/** Get the faces of the cube map that should be redrawn for a cube map centered at
+  * the specified position and time. The result is a mask with bit i set when face
+  * i needs to be drawn, suitable for passing to UniverseRenderer::renderCubeMap().
+  */
+unsigned int
+CubeMapUpdateSchedule::nextFaces(const Vector3d& center, double t)
+{
+    if (!m_valid || (center - m_lastCenter).norm() > m_jumpThreshold)
+    {
+        m_valid = true;
+        m_center = center;
+        m_lastCenter = center;
+        m_time = t;
+        m_staleFaces = 0;
+        return AllFaces;
+    }
+
+    m_lastCenter = center;
+
+    // Every face drawn before a change is out of date. Scheduling continues from the
+    // same face, so that when changes occur every frame, each face is still drawn
+    // once every 6 / facesPerUpdate frames.
+    if ((center - m_center).norm() > m_moveThreshold || t != m_time)
+    {
+        m_center = center;
+        m_time = t;
+        m_staleFaces = AllFaces;
+    }
+
+    unsigned int faces = 0;
+    unsigned int faceCount = 0;
+    for (unsigned int i = 0; i < 6 && faceCount < m_facesPerUpdate && m_staleFaces != 0; ++i)
+    {
+        unsigned int face = m_nextFace;
+        m_nextFace = (m_nextFace + 1) % 6;
+
+        if ((m_staleFaces & (1u << face)) != 0)
+        {
+            m_staleFaces &= ~(1u << face);
+            faces |= 1u << face;
+            ++faceCount;
+        }
+    }
+
+    return faces;
+}
@@ -0,0 +1,111 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#ifndef _VESTA_CUBE_MAP_UPDATE_SCHEDULE_H_
+#define _VESTA_CUBE_MAP_UPDATE_SCHEDULE_H_
+
+#include <Eigen/Core>
+
+namespace vesta
+{
+
+/** CubeMapUpdateSchedule spreads the cost of keeping an environment cube map
+  * up to date over several frames. Each frame, nextFaces() is called with the
+  * current cube map center and time, and it returns the mask of faces that
+  * should be redrawn with UniverseRenderer::renderCubeMap():
+  *
+  * \list
+  * \li No faces when nothing has changed since every face was last drawn
+  * \li All faces when the map has never been drawn, or the center has jumped
+  *     by more than the jump distance
+  * \li Otherwise, the next facesPerUpdate() faces that are out of date, in
+  *     round-robin order
+  * \endlist
+  *
+  * Once the center and time stop changing, every face is redrawn within
+  * ceil(6 / facesPerUpdate()) frames, after which the cube map is identical
+  * to one drawn with all six faces at once.
+  */
+class CubeMapUpdateSchedule
+{
+public:
+    CubeMapUpdateSchedule(unsigned int facesPerUpdate = 2);
+    ~CubeMapUpdateSchedule();
+
+    unsigned int nextFaces(const Eigen::Vector3d& center, double t);
+    void invalidate();
+
+    /** Return true if every face of the cube map has been drawn since the center
+      * or time last changed.
+      */
+    bool isComplete() const
+    {
+        return m_valid && m_staleFaces == 0;
+    }
+
+    /** Get the maximum number of faces redrawn per update.
+      */
+    unsigned int facesPerUpdate() const
+    {
+        return m_facesPerUpdate;
+    }
+
+    void setFacesPerUpdate(unsigned int faceCount);
+
+    /** Get the distance that the center may move before the cube map is considered
+      * out of date.
+      */
+    double moveThreshold() const
+    {
+        return m_moveThreshold;
+    }
+
+    /** Set the distance that the center may move before the cube map is considered
+      * out of date. The default is zero, so any movement at all causes faces to
+      * be redrawn.
+      */
+    void setMoveThreshold(double distance)
+    {
+        m_moveThreshold = distance;
+    }
+
+    /** Get the distance the center must move in a single update in order to force
+      * all faces to be redrawn immediately.
+      */
+    double jumpThreshold() const
+    {
+        return m_jumpThreshold;
+    }
+
+    /** Set the distance the center must move in a single update in order to force
+      * all faces to be redrawn immediately. Stale faces would be too noticeable
+      * after a large jump, e.g. when the observer is moved to another object.
+      */
+    void setJumpThreshold(double distance)
+    {
+        m_jumpThreshold = distance;
+    }
+
+private:
+    unsigned int m_facesPerUpdate;
+    double m_moveThreshold;
+    double m_jumpThreshold;
+
+    bool m_valid;
+    Eigen::Vector3d m_center;
+    Eigen::Vector3d m_lastCenter;
+    double m_time;
+    unsigned int m_staleFaces;
+    unsigned int m_nextFace;
+};
+
+}
+
+#endif // _VESTA_CUBE_MAP_UPDATE_SCHEDULE_H_
@@ -110,6 +110,14 @@ public:
       */
     virtual bool isOpaque() const { return true; }
 
+    /** Returns true if parts of this geometry are blended with whatever is
+      * behind them even though the geometry is drawn in the opaque pass, e.g.
+      * a mesh with some translucent materials. The renderer keeps such
+      * geometry in back to front order rather than grouping it with other
+      * instances. The default implementation returns false.
+      */
+    virtual bool hasBlendedParts() const { return false; }
+
     /** Returns true if this geometry can be well approximated by an
       * ellipsoid. This affects shadow rendering: light occlusion is computed
       * analytically for ellipsoidal objects instead of by rendering the
@@ -118,6 +126,13 @@ public:
       */
     virtual bool isEllipsoidal() const { return false; }
 
+    /** Returns true if the shape of this geometry depends on the clock
+      * value passed to render(). The renderer can reuse shadows cast by
+      * geometry that isn't animated when nothing else has changed. The
+      * default implementation returns false.
+      */
+    virtual bool isAnimated() const { return false; }
+
     /** Get the ellipsoid that approximates the shape of this geometry.
       * The result is meaningful only for geometry that reports true
       * for the isEllipsoidal() method.
@@ -37,6 +37,46 @@ computeTileId(unsigned int level, unsigned int x, unsigned int y)
 }
 
 
+// Look up a tile in the cache, creating a texture for it if it hasn't been
+// requested before. Returns null if the tile doesn't exist.
+TextureMap*
+HierarchicalTiledMap::findTile(unsigned int level, unsigned int x, unsigned int y)
+{
+    v_uint64 tileId = computeTileId(level, x, y);
+
+    TileCache::iterator iter = m_tiles.find(tileId);
+    if (iter != m_tiles.end())
+    {
+        // An entry for the tile exists in the hash
+        return iter->second.ptr();
+    }
+
+    TextureMap* tileTexture = NULL;
+    if (isValidTileAddress(level, x, y))
+    {
+        // Tile not present, try and load it
+        string resourceId = tileResourceIdentifier(level, x, y);
+        if (tileExists(level, x, y, resourceId))
+        {
+            TextureProperties props(TextureProperties::Clamp);
+            props.maxAnisotropy = 16;
+            props.usage = textureUsage();
+
+            tileTexture = m_loader->loadTexture(resourceId, props);
+            m_tiles[tileId] = counted_ptr<TextureMap>(tileTexture);
+        }
+        else
+        {
+            // Insert a null in the table so that we don't attempt to load the
+            // tile again.
+            m_tiles[tileId] = counted_ptr<TextureMap>();
+        }
+    }
+
+    return tileTexture;
+}
+
+
 /** Get the tile at the specified level, column, and row.
   *
   * \param level zero-based level index
@@ -58,39 +98,7 @@ HierarchicalTiledMap::tile(unsigned int level, unsigned int x, unsigned int y)
     unsigned int testY = y;
     while (testLevel >= 0 && r.texture == NULL)
     {
-        v_uint64 tileId = computeTileId((unsigned int) testLevel, testX, testY);
-
-        TextureMap* tileTexture = NULL;
-
-        TileCache::iterator iter = m_tiles.find(tileId);
-        if (iter != m_tiles.end())
-        {
-            // An entry for the tile exists in the hash
-            tileTexture = iter->second.ptr();
-        }
-        else
-        {
-            if (isValidTileAddress((unsigned int) testLevel, testX, testY))
-            {
-                // Tile not present, try and load it
-                string resourceId = tileResourceIdentifier((unsigned int) testLevel, testX, testY);
-                if (tileResourceExists(resourceId))
-                {
-                    TextureProperties props(TextureProperties::Clamp);
-                    props.maxAnisotropy = 16;
-                    props.usage = textureUsage();
-
-                    tileTexture = m_loader->loadTexture(resourceId, props);
-                    m_tiles[tileId] = counted_ptr<TextureMap>(tileTexture);
-                }
-                else
-                {
-                    // Insert a null in the table so that we don't attempt to load the
-                    // tile again.
-                    m_tiles[tileId] = counted_ptr<TextureMap>();
-                }
-            }
-        }
+        TextureMap* tileTexture = findTile((unsigned int) testLevel, testX, testY);
 
         if (tileTexture && tileTexture->makeResident())
         {
@@ -120,3 +128,34 @@ HierarchicalTiledMap::tile(unsigned int level, unsigned int x, unsigned int y)
     return r;
 }
 
+
+/** Queue the tile at the specified level, column, and row for loading so that
+  * it's available when tile() is later called for it. If the tile doesn't exist,
+  * the nearest lower resolution tile that does is queued instead. The request
+  * goes into the loader's low priority prefetch queue; see
+  * TextureMapLoader::prefetch().
+  *
+  * \return true if a new load request was queued, false if the tile is already
+  * loaded, loading, or queued.
+  */
+bool
+HierarchicalTiledMap::prefetchTile(unsigned int level, unsigned int x, unsigned int y)
+{
+    int testLevel = int(level);
+    unsigned int testX = x;
+    unsigned int testY = y;
+    while (testLevel >= 0)
+    {
+        TextureMap* tileTexture = findTile((unsigned int) testLevel, testX, testY);
+        if (tileTexture)
+        {
+            return m_loader->prefetch(tileTexture);
+        }
+
+        testX /= 2;
+        testY /= 2;
+        testLevel--;
+    }
+
+    return false;
+}
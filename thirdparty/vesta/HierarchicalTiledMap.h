@@ -36,6 +36,7 @@ public:
     virtual ~HierarchicalTiledMap();
 
     virtual TextureSubrect tile(unsigned int level, unsigned int x, unsigned int y);
+    virtual bool prefetchTile(unsigned int level, unsigned int x, unsigned int y);
 
     /** Subclasses must implement this method to generate a resource identifier string
       * from the level, column, and row of the tile.
@@ -55,6 +56,17 @@ public:
         return true;
     }
 
+    /** Return true if the tile at the specified address exists. The default implementation
+      * simply calls tileResourceExists(). Subclasses that keep an index of available
+      * tiles can override this in order to answer the query from the tile address
+      * alone.
+      */
+    virtual bool tileExists(unsigned int /* level */, unsigned int /* column */, unsigned int /* row */,
+                            const std::string& resourceId)
+    {
+        return tileResourceExists(resourceId);
+    }
+
     TextureMapLoader* loader() const
     {
         return m_loader;
@@ -87,6 +99,9 @@ public:
         m_tileBorderFraction = fraction;
     }
 
+private:
+    TextureMap* findTile(unsigned int level, unsigned int x, unsigned int y);
+
 private:
     TextureMapLoader* m_loader;
 
@@ -0,0 +1,328 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#include "LabelArbiter.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+const float LabelArbiter::DefaultFadeTime = 0.25f;
+const float LabelArbiter::DefaultHysteresis = 0.1f;
+const float LabelArbiter::DefaultMargin = 2.0f;
+const float LabelArbiter::GridCellSize = 64.0f;
+
+// The grid cell size is increased when labels are spread over an area so large
+// that the grid would have more cells than this along either axis.
+static const int MaxGridDimension = 256;
+
+
+class LabelArbiter::RequestPriorityPredicate
+{
+public:
+    bool operator()(const LabelRequest& r0, const LabelRequest& r1) const
+    {
+        if (r0.priority != r1.priority)
+        {
+            return r0.priority > r1.priority;
+        }
+        else
+        {
+            // Break ties consistently from frame to frame
+            return r0.key < r1.key;
+        }
+    }
+};
+
+
+LabelArbiter::LabelArbiter() :
+    m_gridWidth(0),
+    m_gridHeight(0),
+    m_gridOriginX(0.0f),
+    m_gridOriginY(0.0f),
+    m_gridCellSize(GridCellSize),
+    m_frame(0),
+    m_lastTime(0.0),
+    m_timeValid(false),
+    m_fadeTime(DefaultFadeTime),
+    m_hysteresis(DefaultHysteresis),
+    m_margin(DefaultMargin),
+    m_requestCount(0),
+    m_shownCount(0)
+{
+}
+
+
+LabelArbiter::~LabelArbiter()
+{
+}
+
+
+/** Start collecting label requests for a new frame. The opacities of all labels
+  * are moved toward their targets (opaque for labels shown, transparent for the
+  * others) by the time elapsed since the previous frame. Labels that weren't
+  * requested in the previous frame are forgotten; if they're requested again, they
+  * will fade in.
+  *
+  * \param realTime the current time in seconds; only differences between the
+  *        times of successive frames are used
+  */
+void
+LabelArbiter::beginFrame(double realTime)
+{
+    float fadeStep = 1.0f;
+    if (m_timeValid && m_fadeTime > 0.0f)
+    {
+        fadeStep = float(max(0.0, realTime - m_lastTime)) / m_fadeTime;
+    }
+    m_lastTime = realTime;
+    m_timeValid = true;
+
+    ++m_frame;
+
+    LabelStateTable::iterator iter = m_labels.begin();
+    while (iter != m_labels.end())
+    {
+        LabelState& state = iter->second;
+        if (state.lastRequestFrame + 1 < m_frame)
+        {
+            m_labels.erase(iter++);
+        }
+        else
+        {
+            if (state.shown)
+            {
+                state.opacity = min(1.0f, state.opacity + fadeStep);
+            }
+            else
+            {
+                state.opacity = max(0.0f, state.opacity - fadeStep);
+            }
+            ++iter;
+        }
+    }
+
+    m_requests.clear();
+}
+
+
+/** Request space on screen for a label.
+  *
+  * \param owner the object that draws the label
+  * \param index identifies the label among those drawn by the owner
+  * \param minCorner the lower left corner of the label rectangle in pixels
+  * \param maxCorner the upper right corner of the label rectangle in pixels
+  * \param priority labels with higher priorities are given space first
+  *
+  * \return the opacity at which the label should be drawn this frame; labels
+  *         with opacity zero shouldn't be drawn at all
+  */
+float
+LabelArbiter::requestLabel(const void* owner,
+                           unsigned int index,
+                           const Vector2f& minCorner,
+                           const Vector2f& maxCorner,
+                           float priority)
+{
+    LabelKey key;
+    key.owner = owner;
+    key.index = index;
+
+    LabelStateTable::iterator iter = m_labels.find(key);
+    if (iter == m_labels.end())
+    {
+        LabelState newState;
+        newState.opacity = 0.0f;
+        newState.shown = false;
+        newState.lastRequestFrame = 0;
+        iter = m_labels.insert(make_pair(key, newState)).first;
+    }
+
+    LabelState& state = iter->second;
+    if (state.lastRequestFrame != m_frame)
+    {
+        state.lastRequestFrame = m_frame;
+
+        LabelRequest request;
+        request.key = key;
+        request.minX = minCorner.x();
+        request.minY = minCorner.y();
+        request.maxX = maxCorner.x();
+        request.maxY = maxCorner.y();
+        request.priority = state.shown ? priority + m_hysteresis : priority;
+        request.state = &state;
+        m_requests.push_back(request);
+    }
+
+    return state.opacity;
+}
+
+
+/** Decide which of the labels requested in this frame will be shown. Labels are
+  * placed in order of decreasing priority, and a label is shown only if it doesn't
+  * overlap a label that's already been placed. Overlap tests use a uniform grid,
+  * so the cost is roughly linear in the number of labels.
+  */
+void
+LabelArbiter::endFrame()
+{
+    m_requestCount = m_requests.size();
+    m_shownCount = 0;
+
+    if (m_requests.empty())
+    {
+        return;
+    }
+
+    // Labels are expanded by half the margin on every side
+    float halfMargin = m_margin * 0.5f;
+    for (vector<LabelRequest>::iterator iter = m_requests.begin(); iter != m_requests.end(); ++iter)
+    {
+        iter->minX -= halfMargin;
+        iter->minY -= halfMargin;
+        iter->maxX += halfMargin;
+        iter->maxY += halfMargin;
+    }
+
+    float minX = m_requests[0].minX;
+    float minY = m_requests[0].minY;
+    float maxX = m_requests[0].maxX;
+    float maxY = m_requests[0].maxY;
+    for (vector<LabelRequest>::const_iterator iter = m_requests.begin(); iter != m_requests.end(); ++iter)
+    {
+        minX = min(minX, iter->minX);
+        minY = min(minY, iter->minY);
+        maxX = max(maxX, iter->maxX);
+        maxY = max(maxY, iter->maxY);
+    }
+
+    m_gridCellSize = max(GridCellSize, max(maxX - minX, maxY - minY) / MaxGridDimension);
+    m_gridOriginX = minX;
+    m_gridOriginY = minY;
+    m_gridWidth = min(MaxGridDimension, int((maxX - minX) / m_gridCellSize) + 1);
+    m_gridHeight = min(MaxGridDimension, int((maxY - minY) / m_gridCellSize) + 1);
+    m_gridCells.assign(m_gridWidth * m_gridHeight, -1);
+    m_gridEntries.clear();
+
+    sort(m_requests.begin(), m_requests.end(), RequestPriorityPredicate());
+
+    for (unsigned int i = 0; i < m_requests.size(); ++i)
+    {
+        const LabelRequest& request = m_requests[i];
+        int cellX0 = min(m_gridWidth - 1, int((request.minX - m_gridOriginX) / m_gridCellSize));
+        int cellY0 = min(m_gridHeight - 1, int((request.minY - m_gridOriginY) / m_gridCellSize));
+        int cellX1 = min(m_gridWidth - 1, int((request.maxX - m_gridOriginX) / m_gridCellSize));
+        int cellY1 = min(m_gridHeight - 1, int((request.maxY - m_gridOriginY) / m_gridCellSize));
+
+        bool shown = !overlapsShownLabel(request, cellX0, cellY0, cellX1, cellY1);
+        if (shown)
+        {
+            for (int y = cellY0; y <= cellY1; ++y)
+            {
+                for (int x = cellX0; x <= cellX1; ++x)
+                {
+                    int& head = m_gridCells[y * m_gridWidth + x];
+                    m_gridEntries.push_back(make_pair(i, head));
+                    head = int(m_gridEntries.size()) - 1;
+                }
+            }
+
+            ++m_shownCount;
+        }
+
+        request.state->shown = shown;
+    }
+}
+
+
+bool
+LabelArbiter::overlapsShownLabel(const LabelRequest& request, int cellX0, int cellY0, int cellX1, int cellY1) const
+{
+    for (int y = cellY0; y <= cellY1; ++y)
+    {
+        for (int x = cellX0; x <= cellX1; ++x)
+        {
+            for (int entry = m_gridCells[y * m_gridWidth + x]; entry >= 0; entry = m_gridEntries[entry].second)
+            {
+                const LabelRequest& other = m_requests[m_gridEntries[entry].first];
+                if (request.minX < other.maxX && other.minX < request.maxX &&
+                    request.minY < other.maxY && other.minY < request.maxY)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+
+/** Get the current opacity of a label, or zero if the label wasn't requested in
+  * the last frame.
+  */
+float
+LabelArbiter::labelOpacity(const void* owner, unsigned int index) const
+{
+    LabelKey key;
+    key.owner = owner;
+    key.index = index;
+
+    LabelStateTable::const_iterator iter = m_labels.find(key);
+    return iter == m_labels.end() ? 0.0f : iter->second.opacity;
+}
+
+
+/** Return true if the label won space on screen in the last resolved frame.
+  */
+bool
+LabelArbiter::isLabelShown(const void* owner, unsigned int index) const
+{
+    LabelKey key;
+    key.owner = owner;
+    key.index = index;
+
+    LabelStateTable::const_iterator iter = m_labels.find(key);
+    return iter != m_labels.end() && iter->second.shown;
+}
+
+
+/** Set the time in seconds that a label takes to fade completely in or out. With
+  * a fade time of zero, labels appear and disappear immediately (though still one
+  * frame after they win or lose space.)
+  */
+void
+LabelArbiter::setFadeTime(float seconds)
+{
+    m_fadeTime = max(0.0f, seconds);
+}
+
+
+/** Set the priority bonus given to labels that are currently shown. A label only
+  * displaces an overlapping label that's already shown if its priority is greater
+  * by more than this amount.
+  */
+void
+LabelArbiter::setHysteresis(float hysteresis)
+{
+    m_hysteresis = max(0.0f, hysteresis);
+}
+
+
+/** Set the minimum space in pixels between labels.
+  */
+void
+LabelArbiter::setMargin(float pixels)
+{
+    m_margin = max(0.0f, pixels);
+}
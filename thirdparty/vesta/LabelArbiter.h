@@ -0,0 +1,171 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#ifndef _VESTA_LABEL_ARBITER_H_
+#define _VESTA_LABEL_ARBITER_H_
+
+#include "Object.h"
+#include <Eigen/Core>
+#include <vector>
+#include <map>
+
+namespace vesta
+{
+
+/** LabelArbiter decides which labels are shown when labels overlap on screen.
+  * Labels request space by giving their screen rectangle and a priority; the
+  * requests of a frame are resolved together at the end of the frame, with higher
+  * priority labels claiming space first. Labels that lose fade out and labels that
+  * win fade in. Because the decisions for a frame are only known after all labels
+  * have been drawn, the opacity returned by requestLabel() reflects the decisions
+  * of the previous frame, which the fading makes unnoticeable.
+  *
+  * Labels that are currently shown get a priority bonus (the hysteresis), so that
+  * labels with nearly equal priorities don't flicker back and forth.
+  *
+  * A label is identified by an owner pointer and an index, which must be the same
+  * from frame to frame. When the same label is requested more than once in a frame
+  * (for example, in the two views of a stereo pair), only the first request is
+  * considered.
+  *
+  * Typical use:
+  *
+  * \code
+  * arbiter->beginFrame(realTime);
+  * // draw labels, calling requestLabel() for each one
+  * arbiter->endFrame();
+  * \endcode
+  */
+class LabelArbiter : public Object
+{
+public:
+    LabelArbiter();
+    ~LabelArbiter();
+
+    void beginFrame(double realTime);
+    float requestLabel(const void* owner,
+                       unsigned int index,
+                       const Eigen::Vector2f& minCorner,
+                       const Eigen::Vector2f& maxCorner,
+                       float priority);
+    void endFrame();
+
+    float labelOpacity(const void* owner, unsigned int index) const;
+    bool isLabelShown(const void* owner, unsigned int index) const;
+
+    /** Get the time in seconds that a label takes to fade completely in or out.
+      */
+    float fadeTime() const
+    {
+        return m_fadeTime;
+    }
+
+    void setFadeTime(float seconds);
+
+    /** Get the priority bonus given to labels that are currently shown.
+      */
+    float hysteresis() const
+    {
+        return m_hysteresis;
+    }
+
+    void setHysteresis(float hysteresis);
+
+    /** Get the minimum space in pixels between labels.
+      */
+    float margin() const
+    {
+        return m_margin;
+    }
+
+    void setMargin(float pixels);
+
+    /** Get the number of labels requested in the last resolved frame.
+      */
+    unsigned int requestCount() const
+    {
+        return m_requestCount;
+    }
+
+    /** Get the number of labels shown after the last resolved frame.
+      */
+    unsigned int shownCount() const
+    {
+        return m_shownCount;
+    }
+
+    static const float DefaultFadeTime;
+    static const float DefaultHysteresis;
+    static const float DefaultMargin;
+    static const float GridCellSize;
+
+private:
+    struct LabelKey
+    {
+        const void* owner;
+        unsigned int index;
+
+        bool operator<(const LabelKey& other) const
+        {
+            return owner < other.owner || (owner == other.owner && index < other.index);
+        }
+    };
+
+    struct LabelState
+    {
+        float opacity;
+        bool shown;
+        unsigned int lastRequestFrame;
+    };
+
+    struct LabelRequest
+    {
+        LabelKey key;
+        float minX;
+        float minY;
+        float maxX;
+        float maxY;
+        float priority;
+        LabelState* state;
+    };
+
+    class RequestPriorityPredicate;
+
+    typedef std::map<LabelKey, LabelState> LabelStateTable;
+
+    bool overlapsShownLabel(const LabelRequest& request, int cellX0, int cellY0, int cellX1, int cellY1) const;
+
+private:
+    LabelStateTable m_labels;
+    std::vector<LabelRequest> m_requests;
+
+    // Uniform grid of placed labels; each cell is the head of a linked list of
+    // entries in m_gridEntries.
+    std::vector<int> m_gridCells;
+    std::vector<std::pair<unsigned int, int> > m_gridEntries;
+    int m_gridWidth;
+    int m_gridHeight;
+    float m_gridOriginX;
+    float m_gridOriginY;
+    float m_gridCellSize;
+
+    unsigned int m_frame;
+    double m_lastTime;
+    bool m_timeValid;
+    float m_fadeTime;
+    float m_hysteresis;
+    float m_margin;
+    unsigned int m_requestCount;
+    unsigned int m_shownCount;
+};
+
+}
+
+#endif // _VESTA_LABEL_ARBITER_H_
@@ -19,7 +19,8 @@ using namespace std;
 
 
 LabelGeometry::LabelGeometry() :
-    m_iconColor(Spectrum::White())
+    m_iconColor(Spectrum::White()),
+    m_labelPriority(0.0f)
 {
     setFixedApparentSize(true);
 }
@@ -33,7 +34,8 @@ LabelGeometry::LabelGeometry(const std::string& text, TextureFont* font, const S
     m_iconSize(iconSize),
     m_iconColor(Spectrum::White()),
     m_fadeSize(1.0f),
-    m_pickSizeAdjustment(0.0f)
+    m_pickSizeAdjustment(0.0f),
+    m_labelPriority(0.0f)
 {
     setFixedApparentSize(true);
     setClippingPolicy(ZeroExtent);
@@ -57,12 +59,14 @@ LabelGeometry::render(RenderContext& rc, double /* clock */) const
     }
 
     float opacity = 0.99f * m_opacity;
+    float priority = m_labelPriority;
     if (m_fadeRange.isValid())
     {
         float cameraDistance = rc.modelview().translation().norm();
         float pixelSize = m_fadeSize / (rc.pixelSize() * cameraDistance);
 
         opacity *= m_fadeRange->opacity(pixelSize);
+        priority += pixelSize / (pixelSize + 100.0f);
     }
 
     if (opacity == 0.0f)
@@ -73,6 +77,12 @@ LabelGeometry::render(RenderContext& rc, double /* clock */) const
     // Render during the opaque pass if opaque or during the translucent pass if not.
     if (rc.pass() == RenderContext::TranslucentPass)
     {
+        opacity *= rc.arbitrateLabel(this, 0, labelOffset, m_text, m_font.ptr(), TextureFont::Latin1, hasIcon ? m_iconSize : 0.0f, priority);
+        if (opacity == 0.0f)
+        {
+            return;
+        }
+
         // Keep the screen size of the icon fixed by adding a scale factor equal
         // to the distance from the eye.
         float distanceScale = rc.modelview().translation().norm();
@@ -182,6 +182,26 @@ public:
         m_pickSizeAdjustment = pixels;
     }
 
+    /** Get the priority of the label when overlapping labels are resolved.
+      */
+    float labelPriority() const
+    {
+        return m_labelPriority;
+    }
+
+    /** Set the priority of the label when overlapping labels are resolved. When
+      * labels overlap, the one with the highest priority is shown. The apparent
+      * size of a label with a fade range adds between zero and one to the priority,
+      * so priorities that are integers act as classes, and larger labels win within
+      * a class. The default priority is zero.
+      *
+      * \see RenderContext::arbitrateLabel
+      */
+    void setLabelPriority(float priority)
+    {
+        m_labelPriority = priority;
+    }
+
 private:
     std::string m_text;
     counted_ptr<TextureFont> m_font;
@@ -193,6 +213,7 @@ private:
     counted_ptr<FadeRange> m_fadeRange;
     float m_fadeSize;
     float m_pickSizeAdjustment;
+    float m_labelPriority;
 };
 
 }
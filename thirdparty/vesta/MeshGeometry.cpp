@@ -188,6 +188,26 @@ MeshGeometry::boundingSphereRadius() const
 }
 
 
+/** \reimp
+  * A mesh has blended parts if any of its materials is translucent or isn't
+  * drawn with opaque blending.
+  */
+bool
+MeshGeometry::hasBlendedParts() const
+{
+    for (unsigned int i = 0; i < m_materials.size(); ++i)
+    {
+        const Material* material = m_materials[i].ptr();
+        if (material && (material->opacity() < 1.0f || material->blendMode() != Material::Opaque))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
 bool
 MeshGeometry::handleRayPick(const Eigen::Vector3d& pickOrigin,
                             const Eigen::Vector3d& pickDirection,
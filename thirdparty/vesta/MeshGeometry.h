@@ -61,6 +61,7 @@ public:
                       double animationClock) const;
 
     float boundingSphereRadius() const;
+    virtual bool hasBlendedParts() const;
 
     void addSubmesh(Submesh* submesh);
     void addMaterial(Material* material);
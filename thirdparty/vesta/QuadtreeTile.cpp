@@ -14,9 +14,12 @@
 #include "RenderContext.h"
 #include "TiledMap.h"
 #include "WorldLayer.h"
+#include "VertexBuffer.h"
 #include "Debug.h"
+#include "internal/TileVertexCache.h"
 #include <vector>
 #include <algorithm>
+#include <cstring>
 #include <cassert>
 
 using namespace vesta;
@@ -88,6 +91,11 @@ bool QuadtreeTile::ms_indicesInitialized = false;
 
 static const float SquareSize = 1.0f / float(QuadtreeTile::TileSubdivision);
 
+// The children of a persistent tile are only merged once the tile has shrunk well
+// below the split threshold. This prevents tiles from being split and merged on
+// alternate frames when their size is close to the threshold.
+static const float MergeHysteresis = 0.75f;
+
 
 static VertexAttribute posNormTexTangentAttributes[] = {
     VertexAttribute(VertexAttribute::Position,     VertexAttribute::Float3),
@@ -98,6 +106,21 @@ static VertexAttribute posNormTexTangentAttributes[] = {
 
 static VertexSpec PositionNormalTexTangent(4, posNormTexTangentAttributes);
 
+// Cached tile vertices always have the full PositionNormalTexTangent layout; this
+// spec selects just the positions and texture coordinates from that layout.
+static VertexAttribute posTexAttributes[] = {
+    VertexAttribute(VertexAttribute::Position,     VertexAttribute::Float3),
+    VertexAttribute(VertexAttribute::TextureCoord, VertexAttribute::Float2),
+};
+
+static unsigned int posTexCachedOffsets[] = { 0, 24 };
+
+static VertexSpec PositionTexCached(2, posTexAttributes, posTexCachedOffsets);
+
+// Created when first used and never destroyed, since the vertex buffers can only be
+// released while a GL context is current.
+static TileVertexCache* s_tileVertexCache = NULL;
+
 
 // TileTriangulationBuilder is a utility class used to construct tile meshes. Only 16
 // unique tile meshes are used, and they are generated just once.
@@ -406,6 +429,80 @@ QuadtreeTile::tessellate(const Vector3f& eyePosition,
                          const Vector3f& globeSemiAxes,
                          float splitThreshold,
                          float pixelSize)
+{
+    float apparentTileSize = 0.0f;
+    float curveErrorPixels = 0.0f;
+    computeApparentSize(eyePosition, globeSemiAxes, pixelSize, &apparentTileSize, &curveErrorPixels);
+
+    // Tessellate when the tile is too large or the curve approximation error is too great
+    if (apparentTileSize > splitThreshold || curveErrorPixels > 0.5f)
+    {
+        // Only split tiles that lie inside the view frustum.
+        if (!m_isCulled)
+        {
+            split(cullPlanes, globeSemiAxes);
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                m_children[i]->tessellate(eyePosition, cullPlanes, globeSemiAxes, splitThreshold, pixelSize);
+            }
+        }
+    }
+}
+
+
+/** Update a tessellation left over from an earlier frame for a new viewpoint. Unlike
+  * tessellate(), which assumes that it's starting with a newly created tile, update()
+  * recomputes the culling state of existing tiles, splits tiles that have become
+  * too large, and merges tiles whose children are no longer needed.
+  */
+void
+QuadtreeTile::update(const Vector3f& eyePosition,
+                     const CullingPlaneSet& cullPlanes,
+                     const Vector3f& globeSemiAxes,
+                     float splitThreshold,
+                     float pixelSize)
+{
+    // Root tiles are never culled (consistent with tessellate())
+    if (!isRoot())
+    {
+        m_isCulled = m_parent->m_isCulled || cull(cullPlanes);
+    }
+
+    float apparentTileSize = 0.0f;
+    float curveErrorPixels = 0.0f;
+    computeApparentSize(eyePosition, globeSemiAxes, pixelSize, &apparentTileSize, &curveErrorPixels);
+
+    if (!m_isCulled && (apparentTileSize > splitThreshold || curveErrorPixels > 0.5f))
+    {
+        split(cullPlanes, globeSemiAxes);
+    }
+
+    if (hasChildren())
+    {
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            m_children[i]->update(eyePosition, cullPlanes, globeSemiAxes, splitThreshold, pixelSize);
+        }
+
+        bool needChildren = !m_isCulled &&
+                            (apparentTileSize > splitThreshold * MergeHysteresis ||
+                             curveErrorPixels > 0.5f * MergeHysteresis);
+        if (!needChildren)
+        {
+            merge();
+        }
+    }
+}
+
+
+// Compute the approximate projected size of the tile and the error (in pixels)
+// from approximating the curved surface by the tile mesh.
+void
+QuadtreeTile::computeApparentSize(const Vector3f& eyePosition,
+                                  const Vector3f& globeSemiAxes,
+                                  float pixelSize,
+                                  float* apparentTileSize,
+                                  float* curveErrorPixels)
 {
     float tileArc = float(PI) * m_extent;
 
@@ -418,10 +515,10 @@ QuadtreeTile::tessellate(const Vector3f& eyePosition,
     // Compute the approximate projected size of the tile.
     float distanceToTile = max(approxAltitude, (eyePosition - m_center).norm() - m_boundingSphereRadius);
     distanceToTile = max(1.0e-6f, distanceToTile);
-    float apparentTileSize = m_boundingSphereRadius / distanceToTile;
+    *apparentTileSize = m_boundingSphereRadius / distanceToTile;
 
     // Compute the approximate projected size of the tile, in pixel
-    m_approxPixelSize = apparentTileSize / pixelSize;
+    m_approxPixelSize = *apparentTileSize / pixelSize;
 
     // We may also need to split a tile when the error from approximating a
     // curve as a straight line gets too large. In practice, this is mostly
@@ -430,21 +527,7 @@ QuadtreeTile::tessellate(const Vector3f& eyePosition,
     // The error expression is derived from formula for the maximum distance
     // from a unit circle to the chord of angle theta: 1 - cos(angle / 2)
     float curveApproxError = globeSemiAxes.maxCoeff() * (1.0f - cos(tileArc * SquareSize * 0.5f));
-    float curveErrorPixels = curveApproxError / (distanceToTile * pixelSize);
-
-    // Tessellate when the tile is too large or the curve approximation error is too great
-    if (apparentTileSize > splitThreshold || curveErrorPixels > 0.5f)
-    {
-        // Only split tiles that lie inside the view frustum.
-        if (!m_isCulled)
-        {
-            split(cullPlanes, globeSemiAxes);
-            for (unsigned int i = 0; i < 4; ++i)
-            {
-                m_children[i]->tessellate(eyePosition, cullPlanes, globeSemiAxes, splitThreshold, pixelSize);
-            }
-        }
-    }
+    *curveErrorPixels = curveApproxError / (distanceToTile * pixelSize);
 }
 
 
@@ -519,6 +602,64 @@ QuadtreeTile::split(const CullingPlaneSet& cullPlanes, const Vector3f& semiAxes)
 }
 
 
+// Remove the children of this tile. This is only possible when the children have no
+// children of their own, and when none of their neighbors have children; otherwise,
+// merging would leave adjacent tiles differing by more than one level of detail.
+// Returns true if the children were removed.
+bool
+QuadtreeTile::merge()
+{
+    if (!hasChildren())
+    {
+        return true;
+    }
+
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        const QuadtreeTile* child = m_children[i];
+        if (child->hasChildren())
+        {
+            return false;
+        }
+
+        for (unsigned int j = 0; j < 4; ++j)
+        {
+            const QuadtreeTile* neighbor = child->m_neighbors[j];
+            if (neighbor && neighbor->m_parent != this && neighbor->hasChildren())
+            {
+                return false;
+            }
+        }
+    }
+
+    // Unlink the children from tiles outside this one, then release them
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        QuadtreeTile* child = m_children[i];
+        for (unsigned int j = 0; j < 4; ++j)
+        {
+            QuadtreeTile* neighbor = child->m_neighbors[j];
+            if (neighbor && neighbor->m_parent != this)
+            {
+                unsigned int opposing = (j + 2) & 0x3;
+                if (neighbor->m_neighbors[opposing] == child)
+                {
+                    neighbor->m_neighbors[opposing] = NULL;
+                }
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        m_allocator->freeTile(m_children[i]);
+        m_children[i] = NULL;
+    }
+
+    return true;
+}
+
+
 // Return true if this tile lies outside the convex volume given by
 // the intersection of half-spaces.
 bool
@@ -669,138 +810,132 @@ QuadtreeTile::renderWorldLayer(RenderContext& rc, const WorldGeometry* world, co
 void
 QuadtreeTile::drawPatch(RenderContext& rc, unsigned int features) const
 {
-    const unsigned int MaxVertexSize = 11;
-    unsigned int vertexStride = 5;
+    // Texture coordinates map the whole globe to a single texture
+    float u0 = m_southwest.x() * 0.5f + 0.5f;
+    float v0 = m_southwest.y() + 0.5f;
+    float du = m_extent / float(TileSubdivision) * 0.5f;
+    float dv = m_extent / float(TileSubdivision);
 
+    const VertexBuffer* vertices = NULL;
     if ((features & NormalMap) != 0)
     {
-        vertexStride = 11;
+        vertices = bindVertices(rc, PositionNormalTexTangent, u0, v0, du, dv);
     }
     else if ((features & Normals) != 0)
     {
-        vertexStride = 8;
+        vertices = bindVertices(rc, VertexSpec::PositionNormalTex, u0, v0, du, dv);
     }
-
-    const unsigned int vertexCount = (TileSubdivision + 1) * (TileSubdivision + 1);
-
-    float vertexData[vertexCount * MaxVertexSize];
-    unsigned int vertexIndex = 0;
-
-    float tileArc = float(PI) * m_extent;
-    float lonWest = float(PI) * m_southwest.x();
-    float latSouth = float(PI) * m_southwest.y();
-    float dlon = tileArc / float(TileSubdivision);
-    float dlat = tileArc / float(TileSubdivision);
-    float du = m_extent / float(TileSubdivision);
-    float dv = m_extent / float(TileSubdivision);
-
-    // Precompute a trig table for this patch
-    float sines[TileSubdivision + 1];
-    float cosines[TileSubdivision + 1];
-    for (unsigned int i = 0; i <= TileSubdivision; ++i)
+    else
     {
-        float lon = lonWest + i * dlon;
-        sines[i] = sin(lon);
-        cosines[i] = cos(lon);
+        vertices = bindVertices(rc, PositionTexCached, u0, v0, du, dv);
     }
 
-    for (unsigned int i = 0; i <= TileSubdivision; ++i)
+    if (vertices)
     {
-        float v = m_southwest.y() + i * dv;
-        float lat = latSouth + i * dlat;
-        float cosLat = cos(lat);
-        float sinLat = sin(lat);
-
-        if ((features & NormalMap) != 0)
-        {
-            for (unsigned int j = 0; j <= TileSubdivision; ++j)
-            {
-                unsigned int vertexStart = vertexStride * vertexIndex;
-
-                float u = m_southwest.x() + j * du;
-
-                float cosLon = cosines[j];
-                float sinLon = sines[j];
+        drawTriangles(rc);
+        unbindVertices(vertices);
+    }
+}
 
-                Vector3f p(cosLat * cosLon, cosLat * sinLon, sinLat);
 
-                // Position
-                vertexData[vertexStart + 0]  = p.x();
-                vertexData[vertexStart + 1]  = p.y();
-                vertexData[vertexStart + 2]  = p.z();
+// Bind the vertices for this tile, using the vertex cache. The texture coordinates
+// of vertex (i, j) are (u0 + j * du, 1 - (v0 + i * dv)). The returned buffer must be
+// passed to unbindVertices() after drawing; NULL is returned if the vertices couldn't
+// be bound.
+const VertexBuffer*
+QuadtreeTile::bindVertices(RenderContext& rc, const VertexSpec& spec, float u0, float v0, float du, float dv) const
+{
+    if (!s_tileVertexCache)
+    {
+        s_tileVertexCache = new TileVertexCache(TileVertexCache::DefaultCapacity);
+    }
 
-                // Vertex normal
-                vertexData[vertexStart + 3]  = p.x();
-                vertexData[vertexStart + 4]  = p.y();
-                vertexData[vertexStart + 5]  = p.z();
+    TileVertexCache::Key key;
+    key.level = m_level;
+    key.column = m_column;
+    key.row = m_row;
+    key.u0 = u0;
+    key.v0 = v0;
+    key.du = du;
+    key.dv = dv;
 
-                // Texture coordinate
-                vertexData[vertexStart + 6]  = u * 0.5f + 0.5f;
-                vertexData[vertexStart + 7]  = 0.5f - v;
+    const VertexBuffer* vertices = s_tileVertexCache->tileVertices(key, m_southwest, m_extent);
+    if (vertices)
+    {
+        rc.bindVertexBuffer(spec, vertices, TileVertexCache::VertexStride * sizeof(float));
+    }
 
-                // Tangent (we use dP/du), where P(u,v) is the sphere parametrization
-                vertexData[vertexStart + 8]  = -sinLon;
-                vertexData[vertexStart + 9]  = cosLon;
-                vertexData[vertexStart + 10] = 0.0f;
+    return vertices;
+}
 
-                ++vertexIndex;
-            }
-        }
-        else if ((features & Normals) != 0)
-        {
-            for (unsigned int j = 0; j <= TileSubdivision; ++j)
-            {
-                unsigned int vertexStart = vertexStride * vertexIndex;
 
-                float u = m_southwest.x() + j * du;
+// Unbind a tile vertex buffer so that subsequent draws from client memory aren't
+// affected. Vertex array state is left alone, since the material binding for the
+// next tile depends on it.
+void
+QuadtreeTile::unbindVertices(const VertexBuffer* vertices)
+{
+    if (vertices->vbo())
+    {
+        vertices->vbo()->unbind();
+    }
+}
 
-                Vector3f p(cosLat * cosines[j], cosLat * sines[j], sinLat);
-                vertexData[vertexStart + 0] = p.x();
-                vertexData[vertexStart + 1] = p.y();
-                vertexData[vertexStart + 2] = p.z();
-                vertexData[vertexStart + 3] = p.x();
-                vertexData[vertexStart + 4] = p.y();
-                vertexData[vertexStart + 5] = p.z();
-                vertexData[vertexStart + 6] = u * 0.5f + 0.5f;
-                vertexData[vertexStart + 7] = 0.5f - v;
 
-                ++vertexIndex;
-            }
-        }
-        else
+// Adjust the address of the map tile used for this quadtree tile. If the projected
+// size in pixels of the tile is less than the number texels in the tile, then we
+// can use a lower resolution version of the tile.
+void
+QuadtreeTile::mapTileAddress(float tileSize, unsigned int* level, unsigned int* column, unsigned int* row) const
+{
+    if (m_approxPixelSize < tileSize)
+    {
+        unsigned int n = tileSize / m_approxPixelSize;
+        while (n > 0 && *level > 0)
         {
-            for (unsigned int j = 0; j <= TileSubdivision; ++j)
-            {
-                unsigned int vertexStart = vertexStride * vertexIndex;
-
-                float u = m_southwest.x() + j * du;
-
-                Vector3f p(cosLat * cosines[j], cosLat * sines[j], sinLat);
-                vertexData[vertexStart + 0] = p.x();
-                vertexData[vertexStart + 1] = p.y();
-                vertexData[vertexStart + 2] = p.z();
-                vertexData[vertexStart + 3] = u * 0.5f + 0.5f;
-                vertexData[vertexStart + 4] = 0.5f - v;
-
-                ++vertexIndex;
-            }
+            n >>= 1;
+            *column >>= 1;
+            *row >>= 1;
+            --*level;
         }
     }
+}
 
-    if ((features & NormalMap) != 0)
+
+/** Request loading of all map tiles that would be used to draw the visible
+  * leaf tiles of this quadtree. At most maxRequests new loads will be queued.
+  *
+  * \return the number of new load requests
+  */
+unsigned int
+QuadtreeTile::prefetch(TiledMap* tiledMap, unsigned int maxRequests) const
+{
+    if (m_isCulled || maxRequests == 0)
     {
-        rc.bindVertexArray(PositionNormalTexTangent, vertexData, vertexStride * 4);
+        return 0;
     }
-    else if ((features & Normals) != 0)
+
+    unsigned int requestCount = 0;
+    if (hasChildren())
     {
-        rc.bindVertexArray(VertexSpec::PositionNormalTex, vertexData, vertexStride * 4);
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            requestCount += m_children[i]->prefetch(tiledMap, maxRequests - requestCount);
+        }
     }
     else
     {
-        rc.bindVertexArray(VertexSpec::PositionTex, vertexData, vertexStride * 4);
+        unsigned int mapLevel = m_level;
+        unsigned int mapColumn = m_column;
+        unsigned int mapRow = m_row;
+        mapTileAddress(static_cast<float>(tiledMap->tileSize()), &mapLevel, &mapColumn, &mapRow);
+        if (tiledMap->prefetchTile(mapLevel, mapColumn, mapRow))
+        {
+            ++requestCount;
+        }
     }
 
-    drawTriangles(rc);
+    return requestCount;
 }
 
 
@@ -808,39 +943,12 @@ QuadtreeTile::drawPatch(RenderContext& rc, unsigned int features) const
 void
 QuadtreeTile::drawPatch(RenderContext& rc, Material& material, TiledMap* baseMap, unsigned int features) const
 {
-    const unsigned int MaxVertexSize = 11;
-    unsigned int vertexStride = 8;
-
-    const unsigned int vertexCount = (TileSubdivision + 1) * (TileSubdivision + 1);
-
-    float vertexData[vertexCount * MaxVertexSize];
-    unsigned int vertexIndex = 0;
-
-    float tileArc = float(PI) * m_extent;
-    float lonWest = float(PI) * m_southwest.x();
-    float latSouth = float(PI) * m_southwest.y();
-    float dlon = tileArc / float(TileSubdivision);
-    float dlat = tileArc / float(TileSubdivision);
-
     float tileSize = static_cast<float>(baseMap->tileSize());
 
     unsigned int mapLevel = m_level;
     unsigned int mapColumn = m_column;
     unsigned int mapRow = m_row;
-
-    // If the projected size in pixels of the tile is less than the number texels
-    // in the tile, then we can use a lower resolution version of the tile.
-    if (m_approxPixelSize < tileSize)
-    {
-        unsigned int n = tileSize / m_approxPixelSize;
-        while (n > 0 && mapLevel > 0)
-        {
-            n >>= 1;
-            mapColumn >>= 1;
-            mapRow >>= 1;
-            mapLevel--;
-        }
-    }
+    mapTileAddress(tileSize, &mapLevel, &mapColumn, &mapRow);
 
     float u0;
     float v0;
@@ -870,60 +978,28 @@ QuadtreeTile::drawPatch(RenderContext& rc, Material& material, TiledMap* baseMap
         dv = vExt / float(TileSubdivision);
     }
 
-    // Precompute a trig table for this patch
-    float sines[TileSubdivision + 1];
-    float cosines[TileSubdivision + 1];
-    for (unsigned int i = 0; i <= TileSubdivision; ++i)
-    {
-        float lon = lonWest + i * dlon;
-        sines[i] = sin(lon);
-        cosines[i] = cos(lon);
-    }
-
-    for (unsigned int i = 0; i <= TileSubdivision; ++i)
-    {
-        float v = v0 + i * dv;
-        float lat = latSouth + i * dlat;
-        float cosLat = cos(lat);
-        float sinLat = sin(lat);
-
-        for (unsigned int j = 0; j <= TileSubdivision; ++j)
-        {
-            unsigned int vertexStart = vertexStride * vertexIndex;
-
-            float u = u0 + j * du;
-
-            Vector3f p(cosLat * cosines[j], cosLat * sines[j], sinLat);
-            vertexData[vertexStart + 0] = p.x();
-            vertexData[vertexStart + 1] = p.y();
-            vertexData[vertexStart + 2] = p.z();
-            vertexData[vertexStart + 3] = p.x();
-            vertexData[vertexStart + 4] = p.y();
-            vertexData[vertexStart + 5] = p.z();
-            vertexData[vertexStart + 6] = u;
-            vertexData[vertexStart + 7] = 1.0f - v;
-
-            ++vertexIndex;
-        }
-    }
-
     material.setBaseTexture(r.texture);
     rc.bindMaterial(&material);
 
+    const VertexBuffer* vertices = NULL;
     if ((features & NormalMap) != 0)
     {
-        rc.bindVertexArray(PositionNormalTexTangent, vertexData, vertexStride * 4);
+        vertices = bindVertices(rc, PositionNormalTexTangent, u0, v0, du, dv);
     }
     else if ((features & Normals) != 0)
     {
-        rc.bindVertexArray(VertexSpec::PositionNormalTex, vertexData, vertexStride * 4);
+        vertices = bindVertices(rc, VertexSpec::PositionNormalTex, u0, v0, du, dv);
     }
     else
     {
-        rc.bindVertexArray(VertexSpec::PositionTex, vertexData, vertexStride * 4);
+        vertices = bindVertices(rc, PositionTexCached, u0, v0, du, dv);
     }
 
-    drawTriangles(rc);
+    if (vertices)
+    {
+        drawTriangles(rc);
+        unbindVertices(vertices);
+    }
 }
 
 
@@ -931,39 +1007,12 @@ QuadtreeTile::drawPatch(RenderContext& rc, Material& material, TiledMap* baseMap
 void
 QuadtreeTile::drawPatch(RenderContext& rc, Material& material, TiledMap* baseMap, TiledMap* normalMap) const
 {
-    const unsigned int MaxVertexSize = 11;
-    unsigned int vertexStride = 11;
-
-    const unsigned int vertexCount = (TileSubdivision + 1) * (TileSubdivision + 1);
-
-    float vertexData[vertexCount * MaxVertexSize];
-    unsigned int vertexIndex = 0;
-
-    float tileArc = float(PI) * m_extent;
-    float lonWest = float(PI) * m_southwest.x();
-    float latSouth = float(PI) * m_southwest.y();
-    float dlon = tileArc / float(TileSubdivision);
-    float dlat = tileArc / float(TileSubdivision);
-
     float tileSize = static_cast<float>(baseMap->tileSize());
 
     unsigned int mapLevel = m_level;
     unsigned int mapColumn = m_column;
     unsigned int mapRow = m_row;
-
-    // If the projected size in pixels of the tile is less than the number texels
-    // in the tile, then we can use a lower resolution version of the tile.
-    if (m_approxPixelSize < tileSize)
-    {
-        unsigned int n = tileSize / m_approxPixelSize;
-        while (n > 0 && mapLevel > 0)
-        {
-            n >>= 1;
-            mapColumn >>= 1;
-            mapRow >>= 1;
-            mapLevel--;
-        }
-    }
+    mapTileAddress(tileSize, &mapLevel, &mapColumn, &mapRow);
 
     float u0;
     float v0;
@@ -1022,53 +1071,16 @@ QuadtreeTile::drawPatch(RenderContext& rc, Material& material, TiledMap* baseMap
         dv = vExt / float(TileSubdivision);
     }
 
-    // Precompute a trig table for this patch
-    float sines[TileSubdivision + 1];
-    float cosines[TileSubdivision + 1];
-    for (unsigned int i = 0; i <= TileSubdivision; ++i)
-    {
-        float lon = lonWest + i * dlon;
-        sines[i] = sin(lon);
-        cosines[i] = cos(lon);
-    }
-
-    for (unsigned int i = 0; i <= TileSubdivision; ++i)
-    {
-        float v = v0 + i * dv;
-        float lat = latSouth + i * dlat;
-        float cosLat = cos(lat);
-        float sinLat = sin(lat);
-
-        for (unsigned int j = 0; j <= TileSubdivision; ++j)
-        {
-            unsigned int vertexStart = vertexStride * vertexIndex;
-
-            float u = u0 + j * du;
-
-            Vector3f p(cosLat * cosines[j], cosLat * sines[j], sinLat);
-            vertexData[vertexStart + 0] = p.x();
-            vertexData[vertexStart + 1] = p.y();
-            vertexData[vertexStart + 2] = p.z();
-            vertexData[vertexStart + 3] = p.x();
-            vertexData[vertexStart + 4] = p.y();
-            vertexData[vertexStart + 5] = p.z();
-            vertexData[vertexStart + 6] = u;
-            vertexData[vertexStart + 7] = 1.0f - v;
-            vertexData[vertexStart + 8]  = -sines[j];
-            vertexData[vertexStart + 9]  = cosines[j];
-            vertexData[vertexStart + 10] = 0.0f;
-
-            ++vertexIndex;
-        }
-    }
-
     material.setBaseTexture(baseRect.texture);
     material.setNormalTexture(normalMapRect.texture);
     rc.bindMaterial(&material);
 
-    rc.bindVertexArray(PositionNormalTexTangent, vertexData, vertexStride * 4);
-
-    drawTriangles(rc);
+    const VertexBuffer* vertices = bindVertices(rc, PositionNormalTexTangent, u0, v0, du, dv);
+    if (vertices)
+    {
+        drawTriangles(rc);
+        unbindVertices(vertices);
+    }
 }
 
 
@@ -1394,3 +1406,156 @@ QuadtreeTile::createTileMeshIndices()
 
     return ok;
 }
+
+
+/** Create the root tiles for a globe. Presently, there are always two root tiles:
+  * one for the western hemisphere and one for the eastern hemisphere.
+  */
+void
+QuadtreeTileAllocator::newGlobe(const Vector3f& semiAxes, QuadtreeTile** westHemi, QuadtreeTile** eastHemi)
+{
+    *westHemi = newRootTile(0, 0, Vector2f(-1.0f, -0.5f), 1.0f, semiAxes);
+    *eastHemi = newRootTile(0, 1, Vector2f( 0.0f, -0.5f), 1.0f, semiAxes);
+
+    // Set up the neighbor connections for the root nodes. Since the map wraps,
+    // the eastern hemisphere is both the east and west neighbor of the western
+    // hemisphere (and vice versa.) There are no north and south neighbors.
+    (*westHemi)->setNeighbor(QuadtreeTile::West, *eastHemi);
+    (*westHemi)->setNeighbor(QuadtreeTile::East, *eastHemi);
+    (*eastHemi)->setNeighbor(QuadtreeTile::West, *westHemi);
+    (*eastHemi)->setNeighbor(QuadtreeTile::East, *westHemi);
+}
+
+
+PersistentQuadtree::PersistentQuadtree() :
+    m_westHemi(NULL),
+    m_eastHemi(NULL),
+    m_semiAxes(Vector3f::Zero()),
+    m_lastEyePosition(Vector3f::Zero()),
+    m_lastSplitThreshold(0.0f),
+    m_lastPixelSize(0.0f)
+{
+}
+
+
+/** Update the tessellation for a new viewpoint. The tree is rebuilt from scratch
+  * only when the ellipsoid changes.
+  */
+void
+PersistentQuadtree::update(const Vector3f& eyePosition,
+                           const CullingPlaneSet& cullFrustum,
+                           const Vector3f& semiAxes,
+                           float splitThreshold,
+                           float pixelSize)
+{
+    if (!m_westHemi || semiAxes != m_semiAxes)
+    {
+        clear();
+        m_allocator.newGlobe(semiAxes, &m_westHemi, &m_eastHemi);
+        m_semiAxes = semiAxes;
+    }
+    else if (eyePosition == m_lastEyePosition &&
+             splitThreshold == m_lastSplitThreshold &&
+             pixelSize == m_lastPixelSize)
+    {
+        bool frustumChanged = false;
+        for (unsigned int i = 0; i < 6 && !frustumChanged; ++i)
+        {
+            frustumChanged = cullFrustum.planes[i].coeffs() != m_lastCullFrustum.planes[i].coeffs();
+        }
+
+        if (!frustumChanged)
+        {
+            return;
+        }
+    }
+
+    m_westHemi->update(eyePosition, cullFrustum, semiAxes, splitThreshold, pixelSize);
+    m_eastHemi->update(eyePosition, cullFrustum, semiAxes, splitThreshold, pixelSize);
+
+    m_lastCullFrustum = cullFrustum;
+    m_lastEyePosition = eyePosition;
+    m_lastSplitThreshold = splitThreshold;
+    m_lastPixelSize = pixelSize;
+}
+
+
+/** Discard all tiles.
+  */
+void
+PersistentQuadtree::clear()
+{
+    m_allocator.clear();
+    m_westHemi = NULL;
+    m_eastHemi = NULL;
+}
+
+
+PersistentQuadtreeSet::PersistentQuadtreeSet(unsigned int maxTrees) :
+    m_maxTrees(max(1u, maxTrees)),
+    m_useCount(0)
+{
+}
+
+
+PersistentQuadtreeSet::~PersistentQuadtreeSet()
+{
+    clear();
+}
+
+
+/** Get the quadtree for the view with the specified key, creating it if this is
+  * the first time that the view has been drawn. The returned tree still holds the
+  * tessellation from the last time that the view was drawn.
+  */
+PersistentQuadtree*
+PersistentQuadtreeSet::tree(unsigned int viewKey)
+{
+    ++m_useCount;
+
+    unsigned int leastRecentlyUsed = 0;
+    for (unsigned int i = 0; i < m_trees.size(); ++i)
+    {
+        if (m_trees[i].viewKey == viewKey)
+        {
+            m_trees[i].lastUsed = m_useCount;
+            return m_trees[i].tree;
+        }
+
+        if (m_trees[i].lastUsed < m_trees[leastRecentlyUsed].lastUsed)
+        {
+            leastRecentlyUsed = i;
+        }
+    }
+
+    // A view that hasn't been drawn before. Reuse the tree of the view that has gone
+    // the longest without being drawn if there are already too many trees; the tree
+    // is brought up to date incrementally just as if the viewpoint had moved.
+    if (m_trees.size() >= m_maxTrees)
+    {
+        m_trees[leastRecentlyUsed].viewKey = viewKey;
+        m_trees[leastRecentlyUsed].lastUsed = m_useCount;
+        return m_trees[leastRecentlyUsed].tree;
+    }
+
+    ViewTree viewTree;
+    viewTree.viewKey = viewKey;
+    viewTree.lastUsed = m_useCount;
+    viewTree.tree = new PersistentQuadtree;
+    m_trees.push_back(viewTree);
+
+    return viewTree.tree;
+}
+
+
+/** Discard the quadtrees for all views.
+  */
+void
+PersistentQuadtreeSet::clear()
+{
+    for (unsigned int i = 0; i < m_trees.size(); ++i)
+    {
+        delete m_trees[i].tree;
+    }
+    m_trees.clear();
+}
@@ -14,6 +14,7 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <deque>
+#include <vector>
 
 
 // The QuadtreeTile class is used for level of detail when rendering
@@ -29,6 +30,8 @@ class Material;
 class TiledMap;
 class MapLayer;
 class QuadtreeTileAllocator;
+class VertexBuffer;
+class VertexSpec;
 class WorldLayer;
 class WorldGeometry;
 
@@ -79,6 +82,11 @@ public:
                     const Eigen::Vector3f& globeSemiAxes,
                     float splitThreshold,
                     float pixelSize);
+    void update(const Eigen::Vector3f& eyePosition,
+                const CullingPlaneSet& cullFrustum,
+                const Eigen::Vector3f& globeSemiAxes,
+                float splitThreshold,
+                float pixelSize);
     void split(const CullingPlaneSet& cullFrustum, const Eigen::Vector3f& semiAxes);
     bool cull(const CullingPlaneSet& cullFrustum) const;
     void render(RenderContext& rc, unsigned int features) const;
@@ -90,6 +98,7 @@ public:
     void drawPatch(RenderContext& rc, const MapLayer& layer, unsigned int features) const;
     void drawPatch(RenderContext& rc, Material& material, TiledMap* baseMap, unsigned int features) const;
     void drawPatch(RenderContext& rc, Material& material, TiledMap* baseMap, TiledMap* normalMap) const;
+    unsigned int prefetch(TiledMap* tiledMap, unsigned int maxRequests) const;
 
     bool isRoot() const
     {
@@ -117,6 +126,21 @@ public:
         return m_extent;
     }
 
+    unsigned int level() const
+    {
+        return m_level;
+    }
+
+    unsigned int column() const
+    {
+        return m_column;
+    }
+
+    unsigned int row() const
+    {
+        return m_row;
+    }
+
     void link(Direction direction, QuadtreeTile* neighbor)
     {
         m_neighbors[direction] = neighbor;
@@ -133,7 +157,16 @@ public:
 
 private:
     void computeCenterAndRadius(const Eigen::Vector3f& semiAxes);
+    void computeApparentSize(const Eigen::Vector3f& eyePosition,
+                             const Eigen::Vector3f& globeSemiAxes,
+                             float pixelSize,
+                             float* apparentTileSize,
+                             float* curveErrorPixels);
+    bool merge();
+    void mapTileAddress(float tileSize, unsigned int* level, unsigned int* column, unsigned int* row) const;
     void drawTriangles(RenderContext& rc) const;
+    const VertexBuffer* bindVertices(RenderContext& rc, const VertexSpec& spec, float u0, float v0, float du, float dv) const;
+    static void unbindVertices(const VertexBuffer* vertices);
 
     static bool createTileMeshIndices();
 
@@ -185,18 +218,45 @@ public:
                           const Eigen::Vector3f& semiAxes)
     {
         QuadtreeTile tile(parent, whichChild, semiAxes);
+        if (!m_freeTiles.empty())
+        {
+            QuadtreeTile* reused = m_freeTiles.back();
+            m_freeTiles.pop_back();
+            *reused = tile;
+            return reused;
+        }
+
         m_tilePool.push_back(tile);
         return &m_tilePool.back();
     }
 
+    /** Return a tile to the allocator so that its storage can be reused. Freed
+      * tiles remain in the pool, but are marked as culled so that they're
+      * skipped by code that walks the whole tile array.
+      */
+    void freeTile(QuadtreeTile* tile)
+    {
+        tile->m_parent = NULL;
+        tile->m_isCulled = true;
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            tile->m_neighbors[i] = NULL;
+            tile->m_children[i] = NULL;
+        }
+        m_freeTiles.push_back(tile);
+    }
+
+    void newGlobe(const Eigen::Vector3f& semiAxes, QuadtreeTile** westHemi, QuadtreeTile** eastHemi);
+
     unsigned int tileCount() const
     {
-        return m_tilePool.size();
+        return m_tilePool.size() - m_freeTiles.size();
     }
 
     void clear()
     {
         m_tilePool.clear();
+        m_freeTiles.clear();
     }
 
     typedef std::deque<QuadtreeTile> TileArray;
@@ -208,6 +268,99 @@ public:
 
 private:
     TileArray m_tilePool;
+    std::vector<QuadtreeTile*> m_freeTiles;
+};
+
+
+/** PersistentQuadtree keeps the tessellation of an ellipsoid from one frame to the
+  * next. Rather than rebuilding the tree from the root tiles every frame, tiles are
+  * split and merged incrementally so that the work done is proportional to the
+  * change in level of detail. When neither the viewpoint nor the culling frustum
+  * have changed since the last update, the tree is reused as-is.
+  */
+class PersistentQuadtree
+{
+public:
+    PersistentQuadtree();
+
+    void update(const Eigen::Vector3f& eyePosition,
+                const CullingPlaneSet& cullFrustum,
+                const Eigen::Vector3f& semiAxes,
+                float splitThreshold,
+                float pixelSize);
+    void clear();
+
+    QuadtreeTile* westHemisphere() const
+    {
+        return m_westHemi;
+    }
+
+    QuadtreeTile* eastHemisphere() const
+    {
+        return m_eastHemi;
+    }
+
+    unsigned int tileCount() const
+    {
+        return m_allocator.tileCount();
+    }
+
+    const QuadtreeTileAllocator::TileArray& tiles() const
+    {
+        return m_allocator.tiles();
+    }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+    QuadtreeTileAllocator m_allocator;
+    QuadtreeTile* m_westHemi;
+    QuadtreeTile* m_eastHemi;
+    Eigen::Vector3f m_semiAxes;
+
+    // Parameters of the last update
+    CullingPlaneSet m_lastCullFrustum;
+    Eigen::Vector3f m_lastEyePosition;
+    float m_lastSplitThreshold;
+    float m_lastPixelSize;
+};
+
+
+/** PersistentQuadtreeSet holds a separate PersistentQuadtree for each view that an
+  * ellipsoid is drawn in. A planet may be drawn several times in one frame: once for
+  * each stereo eye and once for every cube map face that it appears in. A single
+  * persistent tree shared among those views would be re-split for each of them, doing
+  * more work than building the tree from scratch. Trees are looked up by the view key
+  * of the render context; the least recently used tree is discarded when there are
+  * more than maxTrees views.
+  */
+class PersistentQuadtreeSet
+{
+public:
+    PersistentQuadtreeSet(unsigned int maxTrees = DefaultMaxTrees);
+    ~PersistentQuadtreeSet();
+
+    PersistentQuadtree* tree(unsigned int viewKey);
+    void clear();
+
+    unsigned int treeCount() const
+    {
+        return (unsigned int) m_trees.size();
+    }
+
+    static const unsigned int DefaultMaxTrees = 16;
+
+private:
+    struct ViewTree
+    {
+        unsigned int viewKey;
+        unsigned int lastUsed;
+        PersistentQuadtree* tree;
+    };
+
+    std::vector<ViewTree> m_trees;
+    unsigned int m_maxTrees;
+    unsigned int m_useCount;
 };
 
 } // namespace vesta
@@ -13,6 +13,7 @@
 #include "TextureMap.h"
 #include "Material.h"
 #include "TextureFont.h"
+#include "LabelArbiter.h"
 #include "OGLHeaders.h"
 #include "ShaderBuilder.h"
 #include "VertexBuffer.h"
@@ -20,7 +21,9 @@
 #include "glhelp/GLFramebuffer.h"
 #include "particlesys/ParticleEmitter.h"
 #include "particlesys/ParticleRenderer.h"
+#include "internal/TextBatch.h"
 #include <Eigen/LU>
+#include <Eigen/Array>
 #include <vector>
 #include <cmath>
 #include <cassert>
@@ -229,6 +232,7 @@ RenderContext::RenderContext(ShaderCapability capability) :
     m_cameraOrientation(Quaterniond::Identity()),
     m_pixelSize(0.0f),
     m_renderPass(OpaquePass),
+    m_viewKey(0),
     m_modelViewStackDepth(0),
     m_projectionStackDepth(0),
     m_modelTranslation(Vector3d::Zero()),
@@ -237,8 +241,15 @@ RenderContext::RenderContext(ShaderCapability capability) :
     m_vertexStreamFloats(0),
     m_shaderCapability(capability),
     m_shaderStateCurrent(false),
+    m_shaderStateModelViewCheck(false),
+    m_shaderStateModelView(Matrix4f::Identity()),
     m_modelViewMatrixCurrent(false),
-    m_rendererOutput(FragmentColor)
+    m_rendererOutput(FragmentColor),
+    m_enabledArrays(0),
+    m_knownArrays(0),
+    m_stateCacheEnabled(true),
+    m_textBatch(NULL),
+    m_textBatching(false)
 {
     m_matrixStack[0] = Matrix4f::Identity();
 
@@ -249,6 +260,8 @@ RenderContext::RenderContext(ShaderCapability capability) :
     // Make the vertex stream buffer larger enough to hold a complete particle buffer
     m_vertexStreamFloats = 4 * MaxParticles * 10;
     m_vertexStream = new float[m_vertexStreamFloats];
+
+    m_textBatch = new TextBatch();
 }
 
 
@@ -265,6 +278,7 @@ RenderContext::~RenderContext()
 
     delete m_particleBuffer;
     delete[] m_vertexStream;
+    delete m_textBatch;
 }
 
 
@@ -504,12 +518,13 @@ RenderContext::bindVertexArray(const VertexSpec& spec, const void* vertexData, u
     if (positionAttr.format() != VertexAttribute::Float3)
         return;
 
+    VertexInfo previousVertexInfo = m_vertexInfo;
+
+    setArrayEnabled(PositionArray, true);
 #ifdef VESTA_OGLES2
-    glEnableVertexAttribArray(ShaderBuilder::PositionAttributeLocation);
     glVertexAttribPointer(ShaderBuilder::PositionAttributeLocation, 3, GL_FLOAT, GL_FALSE, stride,
                           data + spec.attributeOffset(positionIndex));
 #else
-    glEnableClientState(GL_VERTEX_ARRAY);
     glVertexPointer(3, GL_FLOAT, stride, data + spec.attributeOffset(positionIndex));
 #endif
 
@@ -520,12 +535,11 @@ RenderContext::bindVertexArray(const VertexSpec& spec, const void* vertexData, u
         VertexAttribute normalAttr = spec.attribute(normalIndex);
         if (normalAttr.format() == VertexAttribute::Float3)
         {
+            setArrayEnabled(NormalArray, true);
 #ifdef VESTA_OGLES2
-            glEnableVertexAttribArray(ShaderBuilder::NormalAttributeLocation);
             glVertexAttribPointer(ShaderBuilder::NormalAttributeLocation, 3, GL_FLOAT, GL_FALSE, stride,
                                   data + spec.attributeOffset(normalIndex));
 #else
-            glEnableClientState(GL_NORMAL_ARRAY);
             glNormalPointer(GL_FLOAT, stride, data + spec.attributeOffset(normalIndex));
 #endif
             m_vertexInfo.hasNormals = true;
@@ -534,11 +548,7 @@ RenderContext::bindVertexArray(const VertexSpec& spec, const void* vertexData, u
 
     if (!m_vertexInfo.hasNormals)
     {
-#ifdef VESTA_OGLES2
-        glDisableVertexAttribArray(ShaderBuilder::NormalAttributeLocation);
-#else
-        glDisableClientState(GL_NORMAL_ARRAY);
-#endif
+        setArrayEnabled(NormalArray, false);
     }
 
     // Texture coordinates
@@ -558,13 +568,12 @@ RenderContext::bindVertexArray(const VertexSpec& spec, const void* vertexData, u
 
         if (formatSize != 0)
         {
+            setArrayEnabled(TexCoordArray, true);
 #ifdef VESTA_OGLES2
-            glEnableVertexAttribArray(ShaderBuilder::TexCoordAttributeLocation);
             glVertexAttribPointer(ShaderBuilder::TexCoordAttributeLocation,
                                   formatSize, GL_FLOAT, GL_FALSE, stride,
                                   data + spec.attributeOffset(texCoordIndex));
 #else
-            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
             glTexCoordPointer(formatSize, GL_FLOAT, stride, data + spec.attributeOffset(texCoordIndex));
 #endif
             m_vertexInfo.hasTexCoords = true;
@@ -573,11 +582,7 @@ RenderContext::bindVertexArray(const VertexSpec& spec, const void* vertexData, u
 
     if (!m_vertexInfo.hasTexCoords)
     {
-#ifdef VESTA_OGLES2
-        glDisableVertexAttribArray(ShaderBuilder::TexCoordAttributeLocation);
-#else
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-#endif
+        setArrayEnabled(TexCoordArray, false);
     }
 
     // Vertex colors
@@ -598,12 +603,11 @@ RenderContext::bindVertexArray(const VertexSpec& spec, const void* vertexData, u
 
         if (formatSize != 0)
         {
+            setArrayEnabled(ColorArray, true);
 #ifdef VESTA_OGLES2
-            glEnableVertexAttribArray(ShaderBuilder::ColorAttributeLocation);
             glVertexAttribPointer(ShaderBuilder::ColorAttributeLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
                                   data + spec.attributeOffset(colorIndex));
 #else
-            glEnableClientState(GL_COLOR_ARRAY);
             glColorPointer(formatSize, formatType, stride, data + spec.attributeOffset(colorIndex));
 #endif
             m_vertexInfo.hasColors = true;
@@ -612,11 +616,7 @@ RenderContext::bindVertexArray(const VertexSpec& spec, const void* vertexData, u
 
     if (!m_vertexInfo.hasColors)
     {
-#ifdef VESTA_OGLES2
-        glDisableVertexAttribArray(ShaderBuilder::ColorAttributeLocation);
-#else
-        glDisableClientState(GL_COLOR_ARRAY);
-#endif
+        setArrayEnabled(ColorArray, false);
     }
 
     // Tangents
@@ -628,12 +628,11 @@ RenderContext::bindVertexArray(const VertexSpec& spec, const void* vertexData, u
             VertexAttribute tangentAttr = spec.attribute(tangentIndex);
             if (tangentAttr.format() == VertexAttribute::Float3)
             {
+                setArrayEnabled(TangentArray, true);
 #ifdef VESTA_OGLES2
-                glEnableVertexAttribArray(ShaderBuilder::TangentAttributeLocation);
                 glVertexAttribPointer(ShaderBuilder::TangentAttributeLocation, 3, GL_FLOAT, GL_FALSE, stride,
                                       data + spec.attributeOffset(tangentIndex));
 #else
-                glEnableVertexAttribArrayARB(ShaderBuilder::TangentAttributeLocation);
                 glVertexAttribPointerARB(ShaderBuilder::TangentAttributeLocation,
                                          3, GL_FLOAT, GL_FALSE, stride, data + spec.attributeOffset(tangentIndex));
 #endif
@@ -643,15 +642,11 @@ RenderContext::bindVertexArray(const VertexSpec& spec, const void* vertexData, u
 
         if (!m_vertexInfo.hasTangents)
         {
-#ifdef VESTA_OGLES2
-            glDisableVertexAttribArray(ShaderBuilder::TangentAttributeLocation);
-#else
-            glDisableVertexAttribArrayARB(ShaderBuilder::TangentAttributeLocation);
-#endif
+            setArrayEnabled(TangentArray, false);
         }
     }
 
-    invalidateShaderState();
+    vertexInfoChanged(previousVertexInfo);
 }
 
 
@@ -694,26 +689,102 @@ RenderContext::unbindVertexBuffer()
 void
 RenderContext::unbindVertexArray()
 {
+    setArrayEnabled(PositionArray, false);
+    setArrayEnabled(NormalArray, false);
+    setArrayEnabled(TexCoordArray, false);
+    setArrayEnabled(ColorArray, false);
+    setArrayEnabled(TangentArray, false);
+
+    m_vertexInfo.hasColors = false;
+    m_vertexInfo.hasNormals = false;
+    m_vertexInfo.hasTexCoords = false;
+    m_vertexInfo.hasTangents = false;
+}
+
+
+// Enable or disable one of the vertex arrays. The enabled arrays are tracked so that
+// binding a series of vertex arrays with the same layout doesn't produce a stream of
+// redundant enable and disable calls.
+void
+RenderContext::setArrayEnabled(VertexArrayType array, bool enabled)
+{
+    unsigned int bit = 1u << array;
+    if (m_stateCacheEnabled && (m_knownArrays & bit) != 0 && ((m_enabledArrays & bit) != 0) == enabled)
+    {
+        m_statistics.arrayStateChangesSkipped++;
+        return;
+    }
+
 #ifdef VESTA_OGLES2
-    glDisableVertexAttribArray(ShaderBuilder::PositionAttributeLocation);
-    glDisableVertexAttribArray(ShaderBuilder::NormalAttributeLocation);
-    glDisableVertexAttribArray(ShaderBuilder::TexCoordAttributeLocation);
-    glDisableVertexAttribArray(ShaderBuilder::ColorAttributeLocation);
-    glDisableVertexAttribArray(ShaderBuilder::TangentAttributeLocation);
+    GLuint attributeLocation = 0;
+    switch (array)
+    {
+        case PositionArray: attributeLocation = ShaderBuilder::PositionAttributeLocation; break;
+        case NormalArray:   attributeLocation = ShaderBuilder::NormalAttributeLocation;   break;
+        case TexCoordArray: attributeLocation = ShaderBuilder::TexCoordAttributeLocation; break;
+        case ColorArray:    attributeLocation = ShaderBuilder::ColorAttributeLocation;    break;
+        case TangentArray:  attributeLocation = ShaderBuilder::TangentAttributeLocation;  break;
+    }
+
+    if (enabled)
+    {
+        glEnableVertexAttribArray(attributeLocation);
+    }
+    else
+    {
+        glDisableVertexAttribArray(attributeLocation);
+    }
 #else
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    glDisableClientState(GL_COLOR_ARRAY);
-    if (m_shaderCapability != FixedFunction)
+    if (array == TangentArray)
     {
-        glDisableVertexAttribArrayARB(ShaderBuilder::TangentAttributeLocation);
+        // Tangents are a generic vertex attribute, only available with shaders
+        if (m_shaderCapability == FixedFunction)
+        {
+            return;
+        }
+
+        if (enabled)
+        {
+            glEnableVertexAttribArrayARB(ShaderBuilder::TangentAttributeLocation);
+        }
+        else
+        {
+            glDisableVertexAttribArrayARB(ShaderBuilder::TangentAttributeLocation);
+        }
+    }
+    else
+    {
+        GLenum clientState = GL_VERTEX_ARRAY;
+        switch (array)
+        {
+            case NormalArray:   clientState = GL_NORMAL_ARRAY;        break;
+            case TexCoordArray: clientState = GL_TEXTURE_COORD_ARRAY; break;
+            case ColorArray:    clientState = GL_COLOR_ARRAY;         break;
+            default:            clientState = GL_VERTEX_ARRAY;        break;
+        }
+
+        if (enabled)
+        {
+            glEnableClientState(clientState);
+        }
+        else
+        {
+            glDisableClientState(clientState);
+        }
     }
 #endif
-    m_vertexInfo.hasColors = false;
-    m_vertexInfo.hasNormals = false;
-    m_vertexInfo.hasTexCoords = false;
-    m_vertexInfo.hasTangents = false;
+
+    if (enabled)
+    {
+        m_enabledArrays |= bit;
+    }
+    else
+    {
+        m_enabledArrays &= ~bit;
+    }
+    m_knownArrays |= bit;
+
+    m_statistics.arrayStateChangeCount++;
 }
 
 
@@ -744,6 +815,7 @@ RenderContext::drawPrimitives(const PrimitiveBatch& batch)
 {
     updateShaderState();
     updateShaderTransformConstants();
+    m_statistics.drawCallCount++;
 
     GLenum oglPrimitiveType = OGLPrimitiveType(batch.primitiveType());
     if (batch.isIndexed())
@@ -770,6 +842,7 @@ RenderContext::drawPrimitives(PrimitiveBatch::PrimitiveType type,
 {
     updateShaderState();
     updateShaderTransformConstants();
+    m_statistics.drawCallCount++;
 
     GLenum oglPrimitiveType = OGLPrimitiveType(type);
     glDrawElements(oglPrimitiveType,
@@ -791,7 +864,21 @@ RenderContext::bindMaterial(const Material* material)
         setShaderMaterial(material);
     }
     m_currentMaterial = *material;
-    invalidateShaderState();
+    m_statistics.materialUpdateCount++;
+
+    if (m_customShader.isValid() || !m_stateCacheEnabled)
+    {
+        // The custom shader must be rebound
+        invalidateShaderState();
+    }
+    else
+    {
+        // The material state is now current, and doesn't need to be sent again
+        // when drawing unless the modelview matrix changes first.
+        m_shaderStateCurrent = true;
+        m_shaderStateModelViewCheck = true;
+        m_shaderStateModelView = modelview().matrix();
+    }
 }
 
 
@@ -1338,6 +1425,24 @@ RenderContext::setShaderMaterial(const Material* material)
 void
 RenderContext::updateShaderState()
 {
+    // Light positions and the eye position are sent to the shader in model space,
+    // so the material must be sent again if the modelview matrix has changed since.
+    if (m_shaderStateModelViewCheck)
+    {
+        m_shaderStateModelViewCheck = false;
+        if (m_shaderStateCurrent)
+        {
+            if ((m_shaderStateModelView.cwise() == modelview().matrix()).all())
+            {
+                m_statistics.materialUpdatesSkipped++;
+            }
+            else
+            {
+                m_shaderStateCurrent = false;
+            }
+        }
+    }
+
     if (!m_shaderStateCurrent)
     {
         m_shaderStateCurrent = true;
@@ -1357,12 +1462,16 @@ RenderContext::updateShaderState()
             else
             {
                 setShaderMaterial(&m_currentMaterial);
+                m_statistics.materialUpdateCount++;
             }
         }
         else
         {
             setFixedFunctionMaterial(&m_currentMaterial);
+            m_statistics.materialUpdateCount++;
         }
+
+        m_shaderStateModelView = modelview().matrix();
     }
 }
 
@@ -1443,6 +1552,23 @@ RenderContext::invalidateShaderState()
 }
 
 
+// Called after the vertex info has been recomputed. A different set of vertex
+// attributes may require a different shader, but binding vertex arrays with the
+// same layout as before leaves the shader state unchanged.
+void
+RenderContext::vertexInfoChanged(const VertexInfo& previousVertexInfo)
+{
+    if (m_stateCacheEnabled && m_vertexInfo == previousVertexInfo && !m_customShader.isValid())
+    {
+        m_shaderStateModelViewCheck = true;
+    }
+    else
+    {
+        invalidateShaderState();
+    }
+}
+
+
 /** Set the vertex information flags from
  *  a vertex specification. This is used by various methods
  *  that use immediate mode rendering instead of setting a vertex
@@ -1452,6 +1578,8 @@ RenderContext::invalidateShaderState()
 void
 RenderContext::setVertexInfo(const VertexSpec& spec)
 {
+    VertexInfo previousVertexInfo = m_vertexInfo;
+
     m_vertexInfo.hasColors = false;
     m_vertexInfo.hasNormals = false;
     m_vertexInfo.hasTangents = false;
@@ -1518,7 +1646,7 @@ RenderContext::setVertexInfo(const VertexSpec& spec)
         }
     }
 
-    invalidateShaderState();
+    vertexInfoChanged(previousVertexInfo);
 }
 
 
@@ -1822,6 +1950,25 @@ RenderContext::drawEncodedText(const Vector3f& position,
         }
     }
 
+    Vector3f origin = m_matrixStack[m_modelViewStackDepth].translation();
+
+    // Project the text origin into normalized device coordinates
+    Vector3f ndc = m_projectionStack[m_projectionStackDepth] * origin;
+
+    // Compute the position in viewport coordinates
+    Vector3f p = (ndc + Vector3f::Ones()) * 0.5f;
+
+    if (m_textBatching)
+    {
+        // Glyphs are stored with the same offset that's applied to the modelview
+        // matrix below, and drawn at the end of the batch.
+        m_textBatch->addText(font, text, encoding,
+                             Vector2f(std::floor(p.x() * m_viewportWidth + 0.5f), std::floor(p.y() * m_viewportHeight + 0.5f)),
+                             position + Vector3f(0.125f, 0.125f, -ndc.z()),
+                             color, opacity);
+        return;
+    }
+
     Material material;
     material.setDiffuse(color);
     material.setOpacity(opacity);
@@ -1831,14 +1978,6 @@ RenderContext::drawEncodedText(const Vector3f& position,
     bindMaterial(&material);
     updateShaderState();
 
-    Vector3f origin = m_matrixStack[m_modelViewStackDepth].translation();
-
-    // Project the text origin into normalized device coordinates
-    Vector3f ndc = m_projectionStack[m_projectionStackDepth] * origin;
-
-    // Compute the position in viewport coordinates
-    Vector3f p = (ndc + Vector3f::Ones()) * 0.5f;
-
     pushProjection();
     setProjection(PlanarProjection::CreateOrthographic2D(0.0f, float(m_viewportWidth), 0.0f, float(m_viewportHeight)));
     pushModelView();
@@ -2290,6 +2429,52 @@ RenderContext::setRendererOutput(RendererOutput output)
 }
 
 
+/** Discard all cached OpenGL state, so that the next draw call sends the complete
+  * material state and the next vertex array binding sets every vertex array. This
+  * must be called whenever the state may have been modified by OpenGL calls made
+  * outside of the render context, e.g. at the start of rendering a view.
+  */
+void
+RenderContext::invalidateStateCache()
+{
+    m_knownArrays = 0;
+    m_shaderStateModelViewCheck = false;
+    invalidateShaderState();
+}
+
+
+/** Enable or disable the state cache. When the cache is disabled, the material is
+  * sent again for every draw call and every vertex array binding sets the state of
+  * all vertex arrays. This is only useful for checking that caching doesn't change
+  * what gets drawn.
+  */
+void
+RenderContext::setStateCacheEnabled(bool enabled)
+{
+    m_stateCacheEnabled = enabled;
+    invalidateStateCache();
+}
+
+
+RenderContext::Statistics::Statistics() :
+    drawCallCount(0),
+    materialUpdateCount(0),
+    materialUpdatesSkipped(0),
+    arrayStateChangeCount(0),
+    arrayStateChangesSkipped(0)
+{
+}
+
+
+/** Reset all statistics to zero.
+  */
+void
+RenderContext::resetStatistics()
+{
+    m_statistics = Statistics();
+}
+
+
 /** Set the default font. This font is used for all drawText calls that
   * specify a NULL font.
   */
@@ -2298,3 +2483,151 @@ RenderContext::setDefaultFont(TextureFont* font)
 {
     m_defaultFont = font;
 }
+
+
+/** Begin collecting text into a batch. Until endTextBatch() is called, text drawn
+  * with drawText() and drawEncodedText() is not drawn immediately; instead, the
+  * glyphs are accumulated and drawn by flushTextBatch() or endTextBatch() with one
+  * draw call per font. The viewport size, projection, and depth range must not
+  * change while text is being batched.
+  *
+  * Batched text is still depth tested, so it's hidden by opaque geometry in front
+  * of it no matter when that geometry is drawn. But blended geometry drawn while
+  * text is batched will be covered by the text even if it lies in front. Call
+  * flushTextBatch() before drawing blended geometry that must cover text drawn
+  * earlier.
+  */
+void
+RenderContext::beginTextBatch()
+{
+    m_textBatching = true;
+}
+
+
+/** Draw all text accumulated since beginTextBatch() or the last flush. Text drawn
+  * afterward continues to be batched.
+  */
+void
+RenderContext::flushTextBatch()
+{
+    if (!m_textBatching || m_textBatch->empty())
+    {
+        return;
+    }
+
+    // Text color and opacity are stored in the vertices
+    Material material;
+    material.setDiffuse(Spectrum::White());
+    material.setOpacity(1.0f);
+    material.setBlendMode(Material::AlphaBlend);
+    setVertexInfo(VertexSpec::PositionColorTex);
+
+    pushProjection();
+    setProjection(PlanarProjection::CreateOrthographic2D(0.0f, float(m_viewportWidth), 0.0f, float(m_viewportHeight)));
+    pushModelView();
+    identityModelView();
+
+    const VertexSpec& vspec = VertexSpec::PositionColorTex;
+    for (unsigned int i = 0; i < m_textBatch->fontCount(); ++i)
+    {
+        const vector<TextBatch::Vertex>& vertices = m_textBatch->vertices(i);
+        if (!vertices.empty())
+        {
+            material.setBaseTexture(m_textBatch->font(i)->glyphTexture());
+            bindMaterial(&material);
+
+            bindVertexArray(vspec, &vertices[0], sizeof(TextBatch::Vertex));
+            drawPrimitives(PrimitiveBatch(PrimitiveBatch::Triangles, vertices.size() / 3, 0));
+            unbindVertexArray();
+        }
+    }
+
+    popModelView();
+    popProjection();
+
+    m_textBatch->clear();
+}
+
+
+/** Draw all text accumulated since beginTextBatch() and stop batching.
+  */
+void
+RenderContext::endTextBatch()
+{
+    flushTextBatch();
+    m_textBatching = false;
+}
+
+
+/** Set the label arbiter used by arbitrateLabel(). When the arbiter is null,
+  * labels are always shown.
+  */
+void
+RenderContext::setLabelArbiter(LabelArbiter* arbiter)
+{
+    m_labelArbiter = arbiter;
+}
+
+
+/** Request screen space for a label drawn at the origin of the current modelview
+  * transformation. The label rectangle covers the text, drawn at the same offset
+  * that would be passed to drawEncodedText(), and a square icon centered on the
+  * origin.
+  *
+  * \param owner the object drawing the label
+  * \param index identifies the label among those drawn by the owner
+  * \param textPosition offset of the text in pixels
+  * \param text the label text
+  * \param font the label font, or null for the default font
+  * \param encoding the encoding of the text, as passed to drawEncodedText()
+  * \param iconSize size of the label icon in pixels, or zero if there is no icon
+  * \param priority labels with higher priority are given space first
+  *
+  * \return the opacity factor for the label: one when there is no label arbiter,
+  *         and zero if the label shouldn't be drawn.
+  */
+float
+RenderContext::arbitrateLabel(const void* owner,
+                              unsigned int index,
+                              const Vector3f& textPosition,
+                              const std::string& text,
+                              const TextureFont* font,
+                              TextureFont::Encoding encoding,
+                              float iconSize,
+                              float priority)
+{
+    if (m_labelArbiter.isNull())
+    {
+        return 1.0f;
+    }
+
+    Vector3f origin = m_matrixStack[m_modelViewStackDepth].translation();
+    if (origin.z() >= 0.0f)
+    {
+        // Behind the camera
+        return 0.0f;
+    }
+
+    // Compute the position in viewport coordinates the same way as drawEncodedText()
+    Vector3f ndc = m_projectionStack[m_projectionStackDepth] * origin;
+    Vector2f p((ndc.x() + 1.0f) * 0.5f * m_viewportWidth, (ndc.y() + 1.0f) * 0.5f * m_viewportHeight);
+    p = Vector2f(std::floor(p.x() + 0.5f), std::floor(p.y() + 0.5f));
+
+    float halfIconSize = iconSize * 0.5f;
+    Vector2f minCorner = p - Vector2f::Constant(halfIconSize);
+    Vector2f maxCorner = p + Vector2f::Constant(halfIconSize);
+
+    if (!font)
+    {
+        font = m_defaultFont.ptr();
+    }
+
+    if (font && !text.empty())
+    {
+        Vector2f textOrigin = p + textPosition.start<2>();
+        minCorner = minCorner.cwise().min(textOrigin - Vector2f(0.0f, font->maxDescent()));
+        maxCorner = maxCorner.cwise().max(textOrigin + Vector2f(font->textWidth(text, encoding), font->maxAscent()));
+    }
+
+    return m_labelArbiter->requestLabel(owner, index, minCorner, maxCorner, priority);
+}
@@ -31,6 +31,8 @@ class ParticleBuffer;
 class VertexBuffer;
 class GLShaderProgram;
 class GLFramebuffer;
+class LabelArbiter;
+class TextBatch;
 
 /** RenderContext provides an interface for state tracking and shader
   * setup. Vesta classes which need to do rendering should use RenderContext
@@ -257,6 +259,24 @@ public:
         m_renderPass = pass;
     }
 
+    /** Return a key identifying the view currently being drawn. Every view drawn
+      * in a view set (a stereo eye, a cube map face) has a different key, and
+      * a view keeps its key from one view set to the next. Geometry that keeps
+      * view-dependent state between frames uses the key to keep that state
+      * separately for each view.
+      */
+    unsigned int viewKey() const
+    {
+        return m_viewKey;
+    }
+
+    /** Set the key of the view currently being drawn.
+      */
+    void setViewKey(unsigned int viewKey)
+    {
+        m_viewKey = viewKey;
+    }
+
     /** Get the current modelview transformation */
     const Eigen::Transform3f& modelview() const
     {
@@ -335,6 +355,18 @@ public:
                          TextureFont::Encoding encoding,
                          const Spectrum& color,
                          float opacity = 1.0f);
+    void beginTextBatch();
+    void flushTextBatch();
+    void endTextBatch();
+
+    /** Return true if text is being batched, i.e. if beginTextBatch() has been
+      * called without a matching endTextBatch().
+      */
+    bool isBatchingText() const
+    {
+        return m_textBatching;
+    }
+
     void drawCone(float apexAngle, const Eigen::Vector3f& axis,
                   const Spectrum& color, float opacity,
                   unsigned int radialSubdivision, unsigned int axialSubdivision);
@@ -364,10 +396,62 @@ public:
 
     void setDefaultFont(TextureFont* font);
 
+    /** Get the label arbiter that decides which overlapping labels are shown, or
+      * null if all labels are shown.
+      */
+    LabelArbiter* labelArbiter() const
+    {
+        return m_labelArbiter.ptr();
+    }
+
+    void setLabelArbiter(LabelArbiter* arbiter);
+    float arbitrateLabel(const void* owner,
+                         unsigned int index,
+                         const Eigen::Vector3f& textPosition,
+                         const std::string& text,
+                         const TextureFont* font,
+                         TextureFont::Encoding encoding,
+                         float iconSize,
+                         float priority);
+
     void unbindShader();
 
     RendererOutput rendererOutput() const;
     void setRendererOutput(RendererOutput output);
+
+    void invalidateStateCache();
+
+    /** Return true if redundant material and vertex array state changes are skipped.
+      */
+    bool isStateCacheEnabled() const
+    {
+        return m_stateCacheEnabled;
+    }
+
+    void setStateCacheEnabled(bool enabled);
+
+    /** Counts of the draw calls and state changes issued by the render context, along with
+      * the state changes that were skipped because they would have had no effect.
+      */
+    struct Statistics
+    {
+        Statistics();
+
+        unsigned int drawCallCount;
+        unsigned int materialUpdateCount;
+        unsigned int materialUpdatesSkipped;
+        unsigned int arrayStateChangeCount;
+        unsigned int arrayStateChangesSkipped;
+    };
+
+    /** Get the statistics accumulated since the last call to resetStatistics().
+      */
+    const Statistics& statistics() const
+    {
+        return m_statistics;
+    }
+
+    void resetStatistics();
             
     ShaderCapability shaderCapability() const
     {
@@ -388,6 +472,14 @@ public:
         bool hasTexCoords;
         bool hasTangents;
         bool hasColors;
+
+        bool operator==(const VertexInfo& other) const
+        {
+            return hasNormals == other.hasNormals &&
+                   hasTexCoords == other.hasTexCoords &&
+                   hasTangents == other.hasTangents &&
+                   hasColors == other.hasColors;
+        }
     };
 
     static RenderContext* Create();
@@ -395,6 +487,17 @@ public:
     static ShaderCapability GetHardwareCapability();
 
 private:
+    enum VertexArrayType
+    {
+        PositionArray = 0,
+        NormalArray   = 1,
+        TexCoordArray = 2,
+        ColorArray    = 3,
+        TangentArray  = 4
+    };
+
+    void setArrayEnabled(VertexArrayType array, bool enabled);
+    void vertexInfoChanged(const VertexInfo& previousVertexInfo);
     void setFixedFunctionMaterial(const Material* material);
     void setShaderMaterial(const Material* material);
     void updateShaderState();
@@ -411,6 +514,7 @@ private:
     int m_viewportWidth;
     int m_viewportHeight;
     RenderPass m_renderPass;
+    unsigned int m_viewKey;
 
     unsigned int m_modelViewStackDepth;
     unsigned int m_projectionStackDepth;
@@ -437,12 +541,30 @@ private:
     counted_ptr<GLShaderProgram> m_cameraDistanceShader;
 
     bool m_shaderStateCurrent;
+
+    // When set, the shader state is current except that it may have been computed
+    // with a different modelview matrix than the one now in effect.
+    bool m_shaderStateModelViewCheck;
+    Eigen::Matrix4f m_shaderStateModelView;
+
     bool m_modelViewMatrixCurrent;
     RendererOutput m_rendererOutput;
 
+    // Bit masks of the vertex arrays currently enabled, and of the arrays whose
+    // state is known (i.e. has been set since the state cache was last invalidated.)
+    unsigned int m_enabledArrays;
+    unsigned int m_knownArrays;
+    bool m_stateCacheEnabled;
+
+    Statistics m_statistics;
+
     static bool m_glInitialized;
 
     counted_ptr<vesta::TextureFont> m_defaultFont;
+    counted_ptr<LabelArbiter> m_labelArbiter;
+
+    TextBatch* m_textBatch;
+    bool m_textBatching;
 };
 
 }
@@ -10,10 +10,18 @@
 
 #include "StarCatalog.h"
 #include "Spectrum.h"
+#include "Units.h"
 #include "Debug.h"
+#include "internal/MappedFile.h"
+#include "internal/OutputDataStream.h"
 #include <Eigen/Core>
 #include <cmath>
+#include <cstring>
 #include <algorithm>
+#include <functional>
+#include <fstream>
+#include <limits>
+#include <queue>
 
 using namespace vesta;
 using namespace Eigen;
@@ -22,7 +30,11 @@ using namespace std;
 
 /** Create an empty star catalog.
   */
-StarCatalog::StarCatalog()
+StarCatalog::StarCatalog() :
+    m_mappedStars(NULL),
+    m_mappedMagnitudes(NULL),
+    m_mappedIdentifiers(NULL),
+    m_mappedStarCount(0)
 {
 }
 
@@ -141,7 +153,25 @@ StarCatalog::addStar(v_uint32 identifier, double ra, double dec, double vmag, do
     star.apparentMagnitude = float(vmag);
     star.bvColorIndex = float(bv);
 
+    if (isMapped())
+    {
+        unmap();
+    }
+
     m_starData.push_back(star);
+    m_skyIndex = NULL;
+    m_queryIndex = NULL;
+    m_queryPositions.clear();
+}
+
+
+/** Compute the position of a star on the unit sphere, in the same equatorial
+  * coordinate system as the catalog.
+  */
+Vector3f StarCatalog::StarPosition(const StarRecord& star)
+{
+    float cosDec = cos(star.declination);
+    return Vector3f(cosDec * cos(star.RA), cosDec * sin(star.RA), sin(star.declination));
 }
 
 
@@ -175,7 +205,16 @@ public:
 void
 StarCatalog::buildCatalogIndex()
 {
+    if (isMapped())
+    {
+        // Mapped catalogs include an index of identifiers
+        return;
+    }
+
     sort(m_starData.begin(), m_starData.end(), StarIdPredicate());
+    m_skyIndex = NULL;
+    m_queryIndex = NULL;
+    m_queryPositions.clear();
 }
 
 
@@ -186,6 +225,36 @@ StarCatalog::buildCatalogIndex()
 const StarCatalog::StarRecord*
 StarCatalog::findStarIdentifier(v_uint32 id)
 {
+    if (isMapped())
+    {
+        // Binary search the identifier index, which lists the star positions in
+        // order of increasing identifier
+        const v_uint32* begin = m_mappedIdentifiers;
+        unsigned int count = m_mappedStarCount;
+        while (count > 0)
+        {
+            unsigned int half = count / 2;
+            if (begin[half] < m_mappedStarCount && m_mappedStars[begin[half]].identifier < id)
+            {
+                begin += half + 1;
+                count -= half + 1;
+            }
+            else
+            {
+                count = half;
+            }
+        }
+
+        if (begin == m_mappedIdentifiers + m_mappedStarCount || *begin >= m_mappedStarCount || m_mappedStars[*begin].identifier != id)
+        {
+            return NULL;
+        }
+        else
+        {
+            return &m_mappedStars[*begin];
+        }
+    }
+
     StarRecord match;
     match.identifier = id;
 
@@ -199,3 +268,655 @@ StarCatalog::findStarIdentifier(v_uint32 id)
         return &(*pos);
     }
 }
+
+
+/** Get the index of the stars by position on the sky. The index is built the first
+  * time that this method is called after stars are added to the catalog or the
+  * catalog is sorted with buildCatalogIndex().
+  */
+StarSkyIndex*
+StarCatalog::skyIndex()
+{
+    if (m_skyIndex.isNull())
+    {
+        m_skyIndex = new StarSkyIndex();
+        m_skyIndex->build(this);
+    }
+
+    return m_skyIndex.ptr();
+}
+
+
+// Cells of the index used for cone and nearest neighbor queries are much smaller
+// than those of the sky index, which are sized for drawing.
+static const unsigned int QueryIndexMaxStarsPerCell = 64;
+static const unsigned int QueryIndexMaxDepth = 14;
+
+
+// Get the index used for spatial queries. For catalogs in memory, this is a
+// separate index with small cells. Mapped catalogs use the sky index, because
+// building another index would read the entire file; the stars of a mapped catalog
+// are in sky index order, so reading the stars of a cell is at least sequential.
+StarSkyIndex*
+StarCatalog::queryIndex()
+{
+    if (isMapped())
+    {
+        return skyIndex();
+    }
+
+    if (m_queryIndex.isNull())
+    {
+        m_queryIndex = new StarSkyIndex();
+        m_queryIndex->build(this, QueryIndexMaxStarsPerCell, QueryIndexMaxDepth);
+
+        // Store positions in index order, so that the stars of a cell can be tested
+        // without reading the star records scattered through the catalog
+        m_queryPositions.resize(m_queryIndex->starCount());
+        for (unsigned int i = 0; i < m_queryPositions.size(); ++i)
+        {
+            m_queryPositions[i] = StarPosition(star(m_queryIndex->catalogIndex(i)));
+        }
+    }
+
+    return m_queryIndex.ptr();
+}
+
+
+// Get the squared chord distance from a direction to the star at a position in the
+// query index. Infinity is returned if the star is known to be farther than
+// maxDistance radians away.
+float
+StarCatalog::queryDistance(const StarSkyIndex* index,
+                           unsigned int position,
+                           const Vector3f& direction,
+                           float declination,
+                           float maxDistance)
+{
+    if (!m_queryPositions.empty())
+    {
+        return (m_queryPositions[position] - direction).squaredNorm();
+    }
+
+    // The difference in declination is a cheap lower bound on the angular distance
+    const StarRecord& s = star(index->catalogIndex(position));
+    if (abs(s.declination - declination) > maxDistance)
+    {
+        return numeric_limits<float>::infinity();
+    }
+    else
+    {
+        return (StarPosition(s) - direction).squaredNorm();
+    }
+}
+
+
+// Squared length of the chord between two points on the unit sphere separated by
+// the specified angle. Comparing chord lengths is more precise than comparing the
+// cosines of small angles.
+static float chordSquared(float angle)
+{
+    float halfChord = sin(min(angle, float(PI)) * 0.5f);
+    return 4.0f * halfChord * halfChord;
+}
+
+
+static float chordAngle(float chordSquared)
+{
+    return 2.0f * asin(min(1.0f, sqrt(chordSquared) * 0.5f));
+}
+
+
+/** Find all stars brighter than the limiting magnitude within an angular radius of
+  * a direction. The catalog indices of the stars found are appended to the stars
+  * vector, in no particular order.
+  *
+  * \param direction the center of the cone, in the equatorial coordinate system of
+  *        the catalog
+  * \param radius the angular radius of the cone in radians
+  * \param limitingMagnitude the apparent magnitude of the faintest stars to find
+  * \param stars vector to which the catalog indices of the stars are appended
+  *
+  * \return the number of stars found
+  */
+unsigned int
+StarCatalog::findStarsInCone(const Vector3f& direction,
+                             float radius,
+                             float limitingMagnitude,
+                             vector<unsigned int>& stars)
+{
+    StarSkyIndex* index = queryIndex();
+    if (index->cellCount() == 0 || radius < 0.0f)
+    {
+        return 0;
+    }
+
+    Vector3f center = direction.normalized();
+    float centerDeclination = asin(max(-1.0f, min(1.0f, center.z())));
+    float maxChordSquared = chordSquared(radius);
+
+    unsigned int foundCount = 0;
+    vector<unsigned int> cellStack;
+    for (unsigned int i = 0; i < StarSkyIndex::RootCellCount; ++i)
+    {
+        cellStack.push_back(i);
+    }
+
+    while (!cellStack.empty())
+    {
+        unsigned int cellIndex = cellStack.back();
+        cellStack.pop_back();
+
+        const StarSkyIndex::Cell& cell = index->cell(cellIndex);
+        if (cell.starCount == 0 ||
+            cell.brightestMagnitude > limitingMagnitude ||
+            StarSkyIndex::AngularDistance(cell, center) > radius)
+        {
+            continue;
+        }
+
+        if (!cell.isLeaf())
+        {
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                cellStack.push_back(cell.firstChild + i);
+            }
+            continue;
+        }
+
+        unsigned int brightCount = index->brighterStarCount(cellIndex, limitingMagnitude);
+        pageIn(cell.firstStar, brightCount);
+        for (unsigned int position = cell.firstStar; position < cell.firstStar + brightCount; ++position)
+        {
+            if (queryDistance(index, position, center, centerDeclination, radius) <= maxChordSquared)
+            {
+                stars.push_back(index->catalogIndex(position));
+                ++foundCount;
+            }
+        }
+    }
+
+    return foundCount;
+}
+
+
+typedef pair<float, unsigned int> StarQueueEntry;
+
+/** Find the stars brighter than the limiting magnitude that are closest to a
+  * direction. The catalog indices of the stars are appended to the stars vector in
+  * order of increasing angular distance.
+  *
+  * \param direction the search direction, in the equatorial coordinate system of
+  *        the catalog
+  * \param count the maximum number of stars to find
+  * \param limitingMagnitude the apparent magnitude of the faintest stars to find
+  * \param stars vector to which the catalog indices of the stars are appended
+  *
+  * \return the number of stars found, which is less than count only when fewer
+  *         than count stars are brighter than the limiting magnitude
+  */
+unsigned int
+StarCatalog::findNearestStars(const Vector3f& direction,
+                              unsigned int count,
+                              float limitingMagnitude,
+                              vector<unsigned int>& stars)
+{
+    StarSkyIndex* index = queryIndex();
+    if (index->cellCount() == 0 || count == 0)
+    {
+        return 0;
+    }
+
+    Vector3f center = direction.normalized();
+    float centerDeclination = asin(max(-1.0f, min(1.0f, center.z())));
+
+    // Visit cells in order of increasing distance, keeping the closest stars found
+    // so far in a heap whose top is the farthest of them. Distances are stored as
+    // squared chord lengths.
+    priority_queue<StarQueueEntry, vector<StarQueueEntry>, greater<StarQueueEntry> > cellQueue;
+    vector<StarQueueEntry> nearest;
+    for (unsigned int i = 0; i < StarSkyIndex::RootCellCount; ++i)
+    {
+        cellQueue.push(StarQueueEntry(StarSkyIndex::AngularDistance(index->cell(i), center), i));
+    }
+
+    while (!cellQueue.empty())
+    {
+        float cellDistance = cellQueue.top().first;
+        unsigned int cellIndex = cellQueue.top().second;
+        cellQueue.pop();
+
+        if (nearest.size() == count && chordSquared(cellDistance) > nearest.front().first)
+        {
+            // All remaining cells are farther than the stars already found
+            break;
+        }
+
+        const StarSkyIndex::Cell& cell = index->cell(cellIndex);
+        if (cell.starCount == 0 || cell.brightestMagnitude > limitingMagnitude)
+        {
+            continue;
+        }
+
+        if (!cell.isLeaf())
+        {
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                unsigned int child = cell.firstChild + i;
+                cellQueue.push(StarQueueEntry(StarSkyIndex::AngularDistance(index->cell(child), center), child));
+            }
+            continue;
+        }
+
+        unsigned int brightCount = index->brighterStarCount(cellIndex, limitingMagnitude);
+        pageIn(cell.firstStar, brightCount);
+        for (unsigned int position = cell.firstStar; position < cell.firstStar + brightCount; ++position)
+        {
+            if (nearest.size() < count)
+            {
+                float distance = queryDistance(index, position, center, centerDeclination, float(PI));
+                nearest.push_back(StarQueueEntry(distance, index->catalogIndex(position)));
+                push_heap(nearest.begin(), nearest.end());
+            }
+            else
+            {
+                float distance = queryDistance(index, position, center, centerDeclination, chordAngle(nearest.front().first));
+                if (distance < nearest.front().first)
+                {
+                    pop_heap(nearest.begin(), nearest.end());
+                    nearest.back() = StarQueueEntry(distance, index->catalogIndex(position));
+                    push_heap(nearest.begin(), nearest.end());
+                }
+            }
+        }
+    }
+
+    sort_heap(nearest.begin(), nearest.end());
+    for (unsigned int i = 0; i < nearest.size(); ++i)
+    {
+        stars.push_back(nearest[i].second);
+    }
+
+    return nearest.size();
+}
+
+
+/** Find the star that a user most likely meant to select by clicking in the
+  * specified direction. Of the stars brighter than the limiting magnitude within
+  * the pick radius, the one with the smallest angular distance is chosen, except
+  * that distances are scaled by the inverse square root of the star's brightness
+  * relative to a star at the limiting magnitude: a bright star is drawn larger than
+  * a faint one, so it's picked over a faint star that's slightly closer.
+  *
+  * \param direction the pick direction, in the equatorial coordinate system of
+  *        the catalog
+  * \param pickRadius the maximum angular distance in radians of the picked star
+  * \param limitingMagnitude the apparent magnitude of the faintest stars to pick
+  *
+  * \return the picked star, or null if there are no stars within the pick radius
+  */
+const StarCatalog::StarRecord*
+StarCatalog::pickStar(const Vector3f& direction,
+                      float pickRadius,
+                      float limitingMagnitude)
+{
+    vector<unsigned int> candidates;
+    findStarsInCone(direction, pickRadius, limitingMagnitude, candidates);
+
+    Vector3f center = direction.normalized();
+    const StarRecord* closest = NULL;
+    float closestDistance = 0.0f;
+    for (unsigned int i = 0; i < candidates.size(); ++i)
+    {
+        const StarRecord& s = star(candidates[i]);
+        float angle = chordAngle((StarPosition(s) - center).squaredNorm());
+        float distance = angle * pow(10.0f, 0.2f * (s.apparentMagnitude - limitingMagnitude));
+        if (!closest || distance < closestDistance)
+        {
+            closest = &s;
+            closestDistance = distance;
+        }
+    }
+
+    return closest;
+}
+
+
+/** Report that a range of stars is about to be used. For catalogs mapped from a
+  * starcat file, the stars are read ahead from disk, and the least recently used
+  * stars are released from memory if the resident limit is exceeded. Nothing is
+  * done for catalogs that aren't mapped.
+  */
+void
+StarCatalog::pageIn(unsigned int firstStar, unsigned int starCount)
+{
+    if (isMapped() && firstStar < m_mappedStarCount)
+    {
+        starCount = min(starCount, m_mappedStarCount - firstStar);
+        const char* base = m_mappedFile->data();
+        m_mappedFile->touch(reinterpret_cast<const char*>(m_mappedStars + firstStar) - base, v_uint64(starCount) * sizeof(StarRecord));
+        m_mappedFile->touch(reinterpret_cast<const char*>(m_mappedMagnitudes + firstStar) - base, v_uint64(starCount) * sizeof(float));
+    }
+}
+
+
+/** Set the maximum number of bytes of a mapped catalog to keep in memory. Regions
+  * of the file are only released when they're paged in with pageIn(); ranges of
+  * stars accessed without calling pageIn() remain resident until the operating
+  * system reclaims them.
+  */
+void
+StarCatalog::setResidentLimit(v_uint64 bytes)
+{
+    if (isMapped())
+    {
+        m_mappedFile->setResidentLimit(bytes);
+    }
+}
+
+
+/** Get the number of bytes of a mapped catalog that have been paged in and not
+  * yet released. Always zero for catalogs that aren't mapped.
+  */
+v_uint64
+StarCatalog::residentBytes() const
+{
+    return isMapped() ? m_mappedFile->residentBytes() : 0;
+}
+
+
+// Copy the stars of a mapped catalog into memory and release the mapping
+void
+StarCatalog::unmap()
+{
+    m_starData.assign(m_mappedStars, m_mappedStars + m_mappedStarCount);
+
+    m_mappedStars = NULL;
+    m_mappedMagnitudes = NULL;
+    m_mappedIdentifiers = NULL;
+    m_mappedStarCount = 0;
+    m_skyIndex = NULL;
+    m_queryIndex = NULL;
+    m_queryPositions.clear();
+    m_mappedFile = NULL;
+}
+
+
+static const unsigned int StarCatHeaderSize = 32;
+static const unsigned int StarCatCellSize = 20;
+static const unsigned int StarCatStarSize = 20;
+static const unsigned int StarCatSectionAlignment = 16;
+
+
+static v_uint64 alignSection(v_uint64 offset)
+{
+    return (offset + StarCatSectionAlignment - 1) / StarCatSectionAlignment * StarCatSectionAlignment;
+}
+
+
+struct StarCatLayout
+{
+    StarCatLayout(v_uint64 starCount, v_uint64 cellCount)
+    {
+        cells = StarCatHeaderSize;
+        stars = alignSection(cells + cellCount * StarCatCellSize);
+        magnitudes = alignSection(stars + starCount * StarCatStarSize);
+        identifiers = alignSection(magnitudes + starCount * sizeof(float));
+        end = identifiers + starCount * sizeof(v_uint32);
+    }
+
+    v_uint64 cells;
+    v_uint64 stars;
+    v_uint64 magnitudes;
+    v_uint64 identifiers;
+    v_uint64 end;
+};
+
+
+static bool writePadding(OutputDataStream& out, v_uint64 from, v_uint64 to)
+{
+    for (v_uint64 i = from; i < to; ++i)
+    {
+        out.writeUbyte(0);
+    }
+
+    return out.status() == OutputDataStream::Good;
+}
+
+
+class IndexedStarIdPredicate
+{
+public:
+    IndexedStarIdPredicate(StarCatalog* catalog, StarSkyIndex* index) :
+        m_catalog(catalog),
+        m_index(index)
+    {
+    }
+
+    bool operator()(v_uint32 position0, v_uint32 position1) const
+    {
+        return m_catalog->star(m_index->catalogIndex(position0)).identifier <
+               m_catalog->star(m_index->catalogIndex(position1)).identifier;
+    }
+
+private:
+    StarCatalog* m_catalog;
+    StarSkyIndex* m_index;
+};
+
+
+/** Save the catalog to a starcat file. A starcat file stores the stars in sky index
+  * order together with the sky index and an index of identifiers, so that it can be
+  * memory mapped by MapStarCat() without any processing at load time.
+  *
+  * starcat file format (all values are little endian):
+  *
+  * bytes          contents
+  * -------------------------------
+  * 0-7            header string ("vstarcat")
+  * 8-11           version identifier (uint32, currently 1)
+  * 12-15          star count (uint32)
+  * 16-19          sky index cell count (uint32)
+  * 20-31          reserved (zero)
+  *
+  * cells (cell count records of 20 bytes: first star, star count, first child
+  *     cell, depth as uint32, and brightest magnitude as float)
+  * stars (star count records of 20 bytes: identifier as uint32, RA, declination,
+  *     apparent magnitude, B-V color index as floats), in sky index order
+  * magnitudes (star count floats), in sky index order
+  * identifier index (star count uint32 star positions), sorted by identifier
+  *
+  * Each of the four sections begins at an offset that's a multiple of 16 bytes;
+  * padding bytes are zero.
+  *
+  * \return true if the file was written successfully
+  */
+bool
+StarCatalog::SaveStarCat(const char* filename)
+{
+    StarSkyIndex* index = skyIndex();
+    unsigned int starCount = size();
+    StarCatLayout layout(starCount, index->cellCount());
+
+    filebuf fb;
+    if (!fb.open(filename, ios::out | ios::binary))
+    {
+        VESTA_LOG("Can't create starcat file %s", filename);
+        return false;
+    }
+
+    ostream os(&fb);
+    OutputDataStream out(os);
+    out.setByteOrder(OutputDataStream::LittleEndian);
+
+    out.writeData("vstarcat", 8);
+    out.writeUint32(1);
+    out.writeUint32(starCount);
+    out.writeUint32(index->cellCount());
+    if (!writePadding(out, 20, layout.cells))
+    {
+        VESTA_LOG("Error writing header of starcat file.");
+        return false;
+    }
+
+    for (unsigned int i = 0; i < index->cellCount(); ++i)
+    {
+        const StarSkyIndex::Cell& cell = index->cell(i);
+        out.writeUint32(cell.firstStar);
+        out.writeUint32(cell.starCount);
+        out.writeUint32(cell.firstChild);
+        out.writeUint32(cell.depth);
+        out.writeFloat(cell.brightestMagnitude);
+    }
+
+    if (!writePadding(out, layout.cells + v_uint64(index->cellCount()) * StarCatCellSize, layout.stars))
+    {
+        VESTA_LOG("Error writing cells of starcat file.");
+        return false;
+    }
+
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        const StarRecord& s = star(index->catalogIndex(i));
+        out.writeUint32(s.identifier);
+        out.writeFloat(s.RA);
+        out.writeFloat(s.declination);
+        out.writeFloat(s.apparentMagnitude);
+        out.writeFloat(s.bvColorIndex);
+    }
+
+    if (!writePadding(out, layout.stars + v_uint64(starCount) * StarCatStarSize, layout.magnitudes))
+    {
+        VESTA_LOG("Error writing stars of starcat file.");
+        return false;
+    }
+
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        out.writeFloat(index->magnitude(i));
+    }
+
+    if (!writePadding(out, layout.magnitudes + v_uint64(starCount) * sizeof(float), layout.identifiers))
+    {
+        VESTA_LOG("Error writing magnitudes of starcat file.");
+        return false;
+    }
+
+    vector<v_uint32> identifierIndex(starCount);
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        identifierIndex[i] = i;
+    }
+    stable_sort(identifierIndex.begin(), identifierIndex.end(), IndexedStarIdPredicate(this, index));
+
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        out.writeUint32(identifierIndex[i]);
+    }
+
+    if (out.status() != OutputDataStream::Good)
+    {
+        VESTA_LOG("Error writing identifier index of starcat file.");
+        return false;
+    }
+
+    return fb.close() != NULL;
+}
+
+
+static v_uint32 readUint32(const char* data)
+{
+    v_uint32 value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+
+static float readFloat(const char* data)
+{
+    float value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+
+/** Create a star catalog from a memory mapped starcat file (see SaveStarCat() for
+  * a description of the format.) The stars are read from disk only as they're used,
+  * so the load time and memory usage don't grow with the size of the catalog. The
+  * catalog index of each star is its position in the sky index. Adding stars to a
+  * mapped catalog copies all stars into memory.
+  *
+  * \return the new catalog, or null if the file couldn't be mapped or isn't a valid
+  *         starcat file
+  */
+StarCatalog*
+StarCatalog::MapStarCat(const char* filename)
+{
+    // Stars are used directly from the file, so the native byte order must match
+    v_uint32 byteOrderCheck = 1;
+    if (*reinterpret_cast<const char*>(&byteOrderCheck) != 1 || sizeof(StarRecord) != StarCatStarSize)
+    {
+        VESTA_LOG("starcat files can't be mapped on this system");
+        return NULL;
+    }
+
+    counted_ptr<MappedFile> file(MappedFile::Open(filename));
+    if (file.isNull())
+    {
+        return NULL;
+    }
+
+    const char* data = file->data();
+    if (file->size() < StarCatHeaderSize || strncmp(data, "vstarcat", 8) != 0)
+    {
+        VESTA_LOG("File %s is not a starcat file", filename);
+        return NULL;
+    }
+
+    v_uint32 version = readUint32(data + 8);
+    if (version != 1)
+    {
+        VESTA_LOG("Unsupported starcat file version %d", version);
+        return NULL;
+    }
+
+    v_uint32 starCount = readUint32(data + 12);
+    v_uint32 cellCount = readUint32(data + 16);
+    StarCatLayout layout(starCount, cellCount);
+    if (file->size() < layout.end)
+    {
+        VESTA_LOG("starcat file %s is truncated", filename);
+        return NULL;
+    }
+
+    vector<StarSkyIndex::Cell> cells(cellCount);
+    for (unsigned int i = 0; i < cellCount; ++i)
+    {
+        const char* record = data + layout.cells + i * StarCatCellSize;
+        cells[i].firstStar = readUint32(record);
+        cells[i].starCount = readUint32(record + 4);
+        cells[i].firstChild = readUint32(record + 8);
+        cells[i].depth = readUint32(record + 12);
+        cells[i].brightestMagnitude = readFloat(record + 16);
+    }
+
+    const float* magnitudes = reinterpret_cast<const float*>(data + layout.magnitudes);
+    counted_ptr<StarSkyIndex> index(new StarSkyIndex());
+    if (!index->setCells(cells, magnitudes, starCount, file.ptr()))
+    {
+        VESTA_LOG("Invalid sky index in starcat file %s", filename);
+        return NULL;
+    }
+
+    const v_uint32* identifiers = reinterpret_cast<const v_uint32*>(data + layout.identifiers);
+
+    StarCatalog* catalog = new StarCatalog();
+    catalog->m_mappedFile = file;
+    catalog->m_mappedStars = reinterpret_cast<const StarRecord*>(data + layout.stars);
+    catalog->m_mappedMagnitudes = magnitudes;
+    catalog->m_mappedIdentifiers = identifiers;
+    catalog->m_mappedStarCount = starCount;
+    catalog->m_skyIndex = index;
+
+    return catalog;
+}
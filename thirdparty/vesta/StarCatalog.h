@@ -14,11 +14,14 @@
 #include "Entity.h"
 #include "Spectrum.h"
 #include "IntegerTypes.h"
+#include "StarSkyIndex.h"
 #include <vector>
 
 namespace vesta
 {
 
+class MappedFile;
+
 class StarCatalog : public Object
 {
 public:
@@ -27,7 +30,7 @@ public:
 
     unsigned int size() const
     {
-        return m_starData.size();
+        return m_mappedStars ? m_mappedStarCount : m_starData.size();
     }
 
     void addStar(v_uint32 identifier, double ra, double dec, double vmag, double bv);
@@ -45,15 +48,62 @@ public:
 
     const StarRecord& star(unsigned int index)
     {
-        return m_starData[index];
+        return m_mappedStars ? m_mappedStars[index] : m_starData[index];
     }
 
     const StarRecord* findStarIdentifier(v_uint32 id);
 
+    StarSkyIndex* skyIndex();
+
+    unsigned int findStarsInCone(const Eigen::Vector3f& direction,
+                                 float radius,
+                                 float limitingMagnitude,
+                                 std::vector<unsigned int>& stars);
+    unsigned int findNearestStars(const Eigen::Vector3f& direction,
+                                  unsigned int count,
+                                  float limitingMagnitude,
+                                  std::vector<unsigned int>& stars);
+    const StarRecord* pickStar(const Eigen::Vector3f& direction,
+                               float pickRadius,
+                               float limitingMagnitude);
+
+    /** Return true if the stars of the catalog are read from a memory mapped file.
+      */
+    bool isMapped() const
+    {
+        return m_mappedStars != NULL;
+    }
+
+    void pageIn(unsigned int firstStar, unsigned int starCount);
+    void setResidentLimit(v_uint64 bytes);
+    v_uint64 residentBytes() const;
+
+    bool SaveStarCat(const char* filename);
+    static StarCatalog* MapStarCat(const char* filename);
+
     static Spectrum StarColor(float bv);
+    static Eigen::Vector3f StarPosition(const StarRecord& star);
+
+private:
+    void unmap();
+    StarSkyIndex* queryIndex();
+    float queryDistance(const StarSkyIndex* index,
+                        unsigned int position,
+                        const Eigen::Vector3f& direction,
+                        float declination,
+                        float maxDistance);
 
 private:
     std::vector<StarRecord> m_starData;
+    counted_ptr<StarSkyIndex> m_skyIndex;
+    counted_ptr<StarSkyIndex> m_queryIndex;
+    std::vector<Eigen::Vector3f> m_queryPositions;
+
+    counted_ptr<MappedFile> m_mappedFile;
+    const StarRecord* m_mappedStars;
+    const float* m_mappedMagnitudes;
+    const v_uint32* m_mappedIdentifiers;
+    unsigned int m_mappedStarCount;
 };
 
 }
@@ -0,0 +1,626 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#include "StarSkyIndex.h"
+#include "StarCatalog.h"
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+// Vertices of the octahedron from which the root cells are built
+static const Vector3f OctahedronVertices[6] =
+{
+    Vector3f( 0.0f,  0.0f,  1.0f),
+    Vector3f( 1.0f,  0.0f,  0.0f),
+    Vector3f( 0.0f,  1.0f,  0.0f),
+    Vector3f(-1.0f,  0.0f,  0.0f),
+    Vector3f( 0.0f, -1.0f,  0.0f),
+    Vector3f( 0.0f,  0.0f, -1.0f),
+};
+
+// Root cells S0-S3 and N0-N3, using the standard HTM vertex order
+static const unsigned int RootCellVertices[8][3] =
+{
+    { 1, 5, 2 },
+    { 2, 5, 3 },
+    { 3, 5, 4 },
+    { 4, 5, 1 },
+    { 1, 0, 4 },
+    { 4, 0, 3 },
+    { 3, 0, 2 },
+    { 2, 0, 1 },
+};
+
+
+// Signed distance (as the sine of an angle) from the nearest edge of a spherical
+// triangle; it is negative for directions outside the triangle.
+static float
+edgeDistance(const Vector3f vertices[3], const Vector3f& direction)
+{
+    float d0 = vertices[0].cross(vertices[1]).normalized().dot(direction);
+    float d1 = vertices[1].cross(vertices[2]).normalized().dot(direction);
+    float d2 = vertices[2].cross(vertices[0]).normalized().dot(direction);
+    return min(d0, min(d1, d2));
+}
+
+
+static void
+initCell(StarSkyIndex::Cell& cell, const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, unsigned int depth)
+{
+    cell.vertices[0] = v0;
+    cell.vertices[1] = v1;
+    cell.vertices[2] = v2;
+
+    // The cap that passes through all three corners contains the cell, since the
+    // cell is the convex hull of its corners on the sphere. The radius is computed
+    // as an angle rather than from the cosine alone: for small cells, the sine
+    // derived from a single precision cosine is much too inaccurate.
+    cell.center = (v0 + v1 + v2).normalized();
+    const Vector3f* corners[3] = { &v0, &v1, &v2 };
+    float radius = 0.0f;
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        radius = max(radius, atan2(cell.center.cross(*corners[i]).norm(), cell.center.dot(*corners[i])));
+    }
+    cell.cosRadius = cos(radius);
+    cell.sinRadius = sin(radius);
+
+    cell.brightestMagnitude = numeric_limits<float>::infinity();
+    cell.firstStar = 0;
+    cell.starCount = 0;
+    cell.firstChild = 0;
+    cell.depth = depth;
+}
+
+
+// Get the corners of child cell i of a cell. Child 3 is the center triangle.
+static void
+childVertices(const StarSkyIndex::Cell& parent, unsigned int child, Vector3f vertices[3])
+{
+    const Vector3f* v = parent.vertices;
+    Vector3f w0 = (v[1] + v[2]).normalized();
+    Vector3f w1 = (v[0] + v[2]).normalized();
+    Vector3f w2 = (v[0] + v[1]).normalized();
+
+    switch (child)
+    {
+    case 0:
+        vertices[0] = v[0]; vertices[1] = w2; vertices[2] = w1;
+        break;
+    case 1:
+        vertices[0] = v[1]; vertices[1] = w0; vertices[2] = w2;
+        break;
+    case 2:
+        vertices[0] = v[2]; vertices[1] = w1; vertices[2] = w0;
+        break;
+    default:
+        vertices[0] = w0; vertices[1] = w1; vertices[2] = w2;
+        break;
+    }
+}
+
+
+// Choose the one of a set of cells that contains a direction. Directions on (or,
+// due to roundoff, just outside of) an edge are assigned to the cell that they're
+// deepest inside of, so that every direction is assigned to exactly one cell.
+static unsigned int
+bestCell(const StarSkyIndex::Cell* cells, unsigned int cellCount, const Vector3f& direction)
+{
+    unsigned int best = 0;
+    float bestDistance = -numeric_limits<float>::infinity();
+    for (unsigned int i = 0; i < cellCount; ++i)
+    {
+        float d = edgeDistance(cells[i].vertices, direction);
+        if (d > bestDistance)
+        {
+            best = i;
+            bestDistance = d;
+        }
+    }
+
+    return best;
+}
+
+
+// Reorder a range of star indices so that they're grouped by the cell that contains
+// them. On return, cellBegin[i] holds the start of the range for cell i.
+static void
+groupByCell(const StarSkyIndex::Cell* cells,
+            unsigned int cellCount,
+            vector<v_uint32>::iterator begin,
+            vector<v_uint32>::iterator end,
+            const vector<Vector3f>& positions,
+            vector<unsigned int>& scratch,
+            unsigned int cellBegin[])
+{
+    unsigned int count = end - begin;
+    scratch.resize(count);
+
+    unsigned int cellStarCount[StarSkyIndex::RootCellCount];
+    for (unsigned int i = 0; i < cellCount; ++i)
+    {
+        cellStarCount[i] = 0;
+    }
+
+    // Precompute the edge planes of the cells; the results are identical to those
+    // of bestCell(), which recomputes them for every direction.
+    Vector3f edgeNormals[StarSkyIndex::RootCellCount][3];
+    for (unsigned int i = 0; i < cellCount; ++i)
+    {
+        const Vector3f* v = cells[i].vertices;
+        edgeNormals[i][0] = v[0].cross(v[1]).normalized();
+        edgeNormals[i][1] = v[1].cross(v[2]).normalized();
+        edgeNormals[i][2] = v[2].cross(v[0]).normalized();
+    }
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        const Vector3f& direction = positions[begin[i]];
+        unsigned int c = 0;
+        float bestDistance = -numeric_limits<float>::infinity();
+        for (unsigned int j = 0; j < cellCount; ++j)
+        {
+            float d = min(edgeNormals[j][0].dot(direction), min(edgeNormals[j][1].dot(direction), edgeNormals[j][2].dot(direction)));
+            if (d > bestDistance)
+            {
+                c = j;
+                bestDistance = d;
+            }
+        }
+
+        scratch[i] = c;
+        cellStarCount[c]++;
+    }
+
+    unsigned int offset = 0;
+    for (unsigned int i = 0; i < cellCount; ++i)
+    {
+        cellBegin[i] = offset;
+        offset += cellStarCount[i];
+    }
+
+    // Stable counting sort; the cell assignments are replaced by the star indices
+    vector<v_uint32> sorted(count);
+    unsigned int next[StarSkyIndex::RootCellCount];
+    copy(cellBegin, cellBegin + cellCount, next);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        sorted[next[scratch[i]]++] = begin[i];
+    }
+
+    copy(sorted.begin(), sorted.end(), begin);
+}
+
+
+class BrighterStarPredicate
+{
+public:
+    BrighterStarPredicate(const vector<float>& magnitudes) :
+        m_magnitudes(magnitudes)
+    {
+    }
+
+    bool operator()(v_uint32 star0, v_uint32 star1) const
+    {
+        if (m_magnitudes[star0] != m_magnitudes[star1])
+        {
+            return m_magnitudes[star0] < m_magnitudes[star1];
+        }
+        else
+        {
+            return star0 < star1;
+        }
+    }
+
+private:
+    const vector<float>& m_magnitudes;
+};
+
+
+StarSkyIndex::StarSkyIndex() :
+    m_starCount(0),
+    m_magnitudeData(NULL),
+    m_maxStarsPerCell(DefaultMaxStarsPerCell),
+    m_maxDepth(DefaultMaxDepth)
+{
+}
+
+
+StarSkyIndex::~StarSkyIndex()
+{
+}
+
+
+/** Build the index for all stars in a catalog. Any previous contents of the
+  * index are discarded.
+  *
+  * \param catalog the star catalog to index
+  * \param maxStarsPerCell cells with more stars than this are subdivided
+  * \param maxDepth the maximum subdivision level; leaf cells at this depth may
+  *        contain any number of stars
+  */
+void
+StarSkyIndex::build(StarCatalog* catalog, unsigned int maxStarsPerCell, unsigned int maxDepth)
+{
+    m_maxStarsPerCell = max(1u, maxStarsPerCell);
+    m_maxDepth = maxDepth;
+    m_cells.clear();
+
+    unsigned int starCount = catalog->size();
+    m_starCount = starCount;
+    vector<Vector3f> positions(starCount);
+    vector<float> magnitudes(starCount);
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        const StarCatalog::StarRecord& star = catalog->star(i);
+        positions[i] = StarCatalog::StarPosition(star);
+        magnitudes[i] = star.apparentMagnitude;
+    }
+
+    m_starOrder.resize(starCount);
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        m_starOrder[i] = i;
+    }
+
+    m_cells.resize(RootCellCount);
+    for (unsigned int i = 0; i < RootCellCount; ++i)
+    {
+        initCell(m_cells[i],
+                 OctahedronVertices[RootCellVertices[i][0]],
+                 OctahedronVertices[RootCellVertices[i][1]],
+                 OctahedronVertices[RootCellVertices[i][2]],
+                 0);
+    }
+
+    vector<unsigned int> scratch;
+    unsigned int cellBegin[RootCellCount];
+    groupByCell(&m_cells[0], RootCellCount, m_starOrder.begin(), m_starOrder.end(), positions, scratch, cellBegin);
+
+    for (unsigned int i = 0; i < RootCellCount; ++i)
+    {
+        unsigned int cellEnd = i + 1 < RootCellCount ? cellBegin[i + 1] : starCount;
+        buildCell(i, cellBegin[i], cellEnd, positions, magnitudes, scratch);
+    }
+
+    m_magnitudes.resize(starCount);
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        m_magnitudes[i] = magnitudes[m_starOrder[i]];
+    }
+    m_magnitudeData = m_magnitudes.empty() ? NULL : &m_magnitudes[0];
+    m_magnitudeStorage = NULL;
+}
+
+
+/** Use a prebuilt index for stars that are already stored in index order. Only the
+  * star ranges, child indices, depths, and brightest magnitudes of the cells are
+  * used; the cell geometry is recomputed, since it's determined completely by the
+  * subdivision. Child cells must appear after their parents.
+  *
+  * \param cells the cells of the index, starting with the eight root cells
+  * \param magnitudes the magnitudes of the stars in index order
+  * \param starCount the number of stars
+  * \param magnitudeStorage an optional object that owns the magnitudes array; the
+  *        index keeps a reference to it
+  *
+  * \return false if the cells aren't a valid index for starCount stars, in which
+  *         case the index is left empty
+  */
+bool
+StarSkyIndex::setCells(const vector<Cell>& cells, const float* magnitudes, unsigned int starCount, Object* magnitudeStorage)
+{
+    m_cells.clear();
+    m_starOrder.clear();
+    m_magnitudes.clear();
+    m_starCount = 0;
+    m_magnitudeData = NULL;
+    m_magnitudeStorage = NULL;
+
+    if (cells.size() < RootCellCount)
+    {
+        return false;
+    }
+
+    vector<Cell> newCells(cells);
+    for (unsigned int i = 0; i < RootCellCount; ++i)
+    {
+        initCell(newCells[i],
+                 OctahedronVertices[RootCellVertices[i][0]],
+                 OctahedronVertices[RootCellVertices[i][1]],
+                 OctahedronVertices[RootCellVertices[i][2]],
+                 0);
+    }
+
+    for (unsigned int i = 0; i < newCells.size(); ++i)
+    {
+        const Cell& cell = cells[i];
+        if (cell.firstStar > starCount || cell.starCount > starCount - cell.firstStar)
+        {
+            return false;
+        }
+
+        newCells[i].firstStar = cell.firstStar;
+        newCells[i].starCount = cell.starCount;
+        newCells[i].firstChild = cell.firstChild;
+        newCells[i].brightestMagnitude = cell.brightestMagnitude;
+
+        if (!cell.isLeaf())
+        {
+            if (cell.firstChild <= i || cell.firstChild > newCells.size() - 4)
+            {
+                return false;
+            }
+
+            for (unsigned int j = 0; j < 4; ++j)
+            {
+                Vector3f vertices[3];
+                childVertices(newCells[i], j, vertices);
+                initCell(newCells[cell.firstChild + j], vertices[0], vertices[1], vertices[2], newCells[i].depth + 1);
+            }
+        }
+    }
+
+    m_cells.swap(newCells);
+    m_starCount = starCount;
+    m_magnitudeData = magnitudes;
+    m_magnitudeStorage = magnitudeStorage;
+
+    return true;
+}
+
+
+void
+StarSkyIndex::buildCell(unsigned int cellIndex,
+                        unsigned int begin,
+                        unsigned int end,
+                        const vector<Vector3f>& positions,
+                        const vector<float>& magnitudes,
+                        vector<unsigned int>& scratch)
+{
+    m_cells[cellIndex].firstStar = begin;
+    m_cells[cellIndex].starCount = end - begin;
+
+    if (end - begin > m_maxStarsPerCell && m_cells[cellIndex].depth < m_maxDepth)
+    {
+        // Note that adding cells may invalidate references to cells
+        unsigned int firstChild = m_cells.size();
+        m_cells[cellIndex].firstChild = firstChild;
+        m_cells.resize(firstChild + 4);
+
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            Vector3f vertices[3];
+            childVertices(m_cells[cellIndex], i, vertices);
+            initCell(m_cells[firstChild + i], vertices[0], vertices[1], vertices[2], m_cells[cellIndex].depth + 1);
+        }
+
+        unsigned int childBegin[4];
+        groupByCell(&m_cells[firstChild], 4, m_starOrder.begin() + begin, m_starOrder.begin() + end, positions, scratch, childBegin);
+
+        float brightest = numeric_limits<float>::infinity();
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            unsigned int childEnd = i < 3 ? begin + childBegin[i + 1] : end;
+            buildCell(firstChild + i, begin + childBegin[i], childEnd, positions, magnitudes, scratch);
+            brightest = min(brightest, m_cells[firstChild + i].brightestMagnitude);
+        }
+
+        m_cells[cellIndex].brightestMagnitude = brightest;
+    }
+    else
+    {
+        sort(m_starOrder.begin() + begin, m_starOrder.begin() + end, BrighterStarPredicate(magnitudes));
+        if (end > begin)
+        {
+            m_cells[cellIndex].brightestMagnitude = magnitudes[m_starOrder[begin]];
+        }
+    }
+}
+
+
+/** Return true if the direction lies within the spherical triangle of a cell.
+  * Directions on an edge are contained by both adjacent cells.
+  */
+bool
+StarSkyIndex::ContainsDirection(const Cell& cell, const Vector3f& direction)
+{
+    return edgeDistance(cell.vertices, direction) >= 0.0f;
+}
+
+
+/** Get the angle in radians between a direction and the nearest point of the
+  * spherical cap that bounds a cell. The result is zero for directions inside the
+  * cap, and never greater than the distance to any star in the cell. The direction
+  * must be a unit vector.
+  */
+float
+StarSkyIndex::AngularDistance(const Cell& cell, const Vector3f& direction)
+{
+    float centerAngle = atan2(direction.cross(cell.center).norm(), direction.dot(cell.center));
+    float capRadius = atan2(cell.sinRadius, cell.cosRadius);
+
+    // Allow for roundoff in the cap radius
+    return max(0.0f, centerAngle - capRadius - 1.0e-6f);
+}
+
+
+/** Find the leaf cell that contains the specified direction, which must be a unit
+  * vector. If the index is empty, the result is zero.
+  */
+unsigned int
+StarSkyIndex::findCell(const Vector3f& direction) const
+{
+    if (m_cells.empty())
+    {
+        return 0;
+    }
+
+    unsigned int cellIndex = bestCell(&m_cells[0], RootCellCount, direction);
+    while (!m_cells[cellIndex].isLeaf())
+    {
+        unsigned int firstChild = m_cells[cellIndex].firstChild;
+        cellIndex = firstChild + bestCell(&m_cells[firstChild], 4, direction);
+    }
+
+    return cellIndex;
+}
+
+
+/** Get the number of stars in a leaf cell that are at least as bright as the
+  * specified magnitude. These stars occupy the index positions starting at
+  * cell(cellIndex).firstStar.
+  */
+unsigned int
+StarSkyIndex::brighterStarCount(unsigned int cellIndex, float magnitude) const
+{
+    const Cell& cell = m_cells[cellIndex];
+    const float* begin = m_magnitudeData + cell.firstStar;
+    return upper_bound(begin, begin + cell.starCount, magnitude) - begin;
+}
+
+
+// Classify a cell with respect to a plane, returning -1 if every point of the
+// cell's bounding cap is outside the plane, 1 if every point is inside, and 0 if
+// the plane intersects the cap.
+static int
+classifyCap(const StarSkyIndex::Cell& cell, const Vector4f& plane)
+{
+    Vector3f normal = plane.start<3>();
+    float length = normal.norm();
+    if (length == 0.0f)
+    {
+        return plane.w() >= 0.0f ? 1 : -1;
+    }
+
+    float d = plane.w() / length;
+    float cosTheta = max(-1.0f, min(1.0f, normal.dot(cell.center) / length));
+    float sinTheta = sqrt(1.0f - cosTheta * cosTheta);
+
+    // Largest and smallest distance of a point in the cap along the plane normal
+    float maxDistance = cosTheta >= cell.cosRadius ? 1.0f : cosTheta * cell.cosRadius + sinTheta * cell.sinRadius;
+    float minDistance = cosTheta <= -cell.cosRadius ? -1.0f : cosTheta * cell.cosRadius - sinTheta * cell.sinRadius;
+
+    if (maxDistance + d < 0.0f)
+    {
+        return -1;
+    }
+    else if (minDistance + d >= 0.0f)
+    {
+        return 1;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+
+/** Find all stars that are at least as bright as the limiting magnitude and that
+  * lie in cells intersecting the view frustum. Directions on the unit sphere are
+  * transformed by the viewProjection matrix; only the side planes of the frustum
+  * are tested, since stars are infinitely distant.
+  *
+  * The stars found are appended to ranges as ranges of index positions, with
+  * adjacent ranges merged. Some stars outside the frustum may be included in the
+  * result, but none inside the frustum are missed.
+  *
+  * \return the number of leaf cells containing stars to draw
+  */
+unsigned int
+StarSkyIndex::findVisibleStars(const Matrix4f& viewProjection,
+                               float limitingMagnitude,
+                               vector<StarRange>& ranges) const
+{
+    if (m_cells.empty())
+    {
+        return 0;
+    }
+
+    // Extract the left, right, bottom, and top clip planes
+    Vector4f planes[4];
+    planes[0] = (viewProjection.row(3) + viewProjection.row(0)).transpose();
+    planes[1] = (viewProjection.row(3) - viewProjection.row(0)).transpose();
+    planes[2] = (viewProjection.row(3) + viewProjection.row(1)).transpose();
+    planes[3] = (viewProjection.row(3) - viewProjection.row(1)).transpose();
+
+    unsigned int visibleCellCount = 0;
+    for (unsigned int i = 0; i < RootCellCount; ++i)
+    {
+        addVisibleCell(i, planes, 0xf, limitingMagnitude, ranges, visibleCellCount);
+    }
+
+    return visibleCellCount;
+}
+
+
+// Recursively add the visible stars in a cell. Bits in the plane mask are set for
+// the planes that the cell might lie outside of; planes that contain a cell also
+// contain all of its children.
+void
+StarSkyIndex::addVisibleCell(unsigned int cellIndex,
+                             const Vector4f* planes,
+                             unsigned int planeMask,
+                             float limitingMagnitude,
+                             vector<StarRange>& ranges,
+                             unsigned int& visibleCellCount) const
+{
+    const Cell& cell = m_cells[cellIndex];
+    if (cell.starCount == 0 || cell.brightestMagnitude > limitingMagnitude)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        if ((planeMask & (1u << i)) != 0)
+        {
+            int classification = classifyCap(cell, planes[i]);
+            if (classification < 0)
+            {
+                return;
+            }
+            else if (classification > 0)
+            {
+                planeMask &= ~(1u << i);
+            }
+        }
+    }
+
+    if (cell.isLeaf())
+    {
+        unsigned int count = brighterStarCount(cellIndex, limitingMagnitude);
+        if (!ranges.empty() && ranges.back().first + ranges.back().count == cell.firstStar)
+        {
+            ranges.back().count += count;
+        }
+        else
+        {
+            StarRange range;
+            range.first = cell.firstStar;
+            range.count = count;
+            ranges.push_back(range);
+        }
+        ++visibleCellCount;
+    }
+    else
+    {
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            addVisibleCell(cell.firstChild + i, planes, planeMask, limitingMagnitude, ranges, visibleCellCount);
+        }
+    }
+}
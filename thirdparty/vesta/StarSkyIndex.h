@@ -0,0 +1,157 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#ifndef _VESTA_STAR_SKY_INDEX_H_
+#define _VESTA_STAR_SKY_INDEX_H_
+
+#include "Object.h"
+#include "IntegerTypes.h"
+#include <Eigen/Core>
+#include <vector>
+
+namespace vesta
+{
+
+class StarCatalog;
+
+/** StarSkyIndex partitions the stars of a catalog into cells of a hierarchical
+  * triangular mesh (HTM) on the celestial sphere. The eight faces of an octahedron
+  * are the root cells; a cell containing more than a maximum number of stars is
+  * split into four by the midpoints of its edges. The stars of each leaf cell are
+  * sorted from brightest to faintest.
+  *
+  * The index stores a permutation of the catalog: every cell covers a contiguous
+  * range of positions, and the stars brighter than some magnitude are a prefix of
+  * the range of each leaf cell. This allows a renderer to store stars in index
+  * order and draw only the stars in cells that intersect the view frustum, and
+  * only down to the limiting magnitude. A catalog that is already stored in index
+  * order (such as a memory mapped starcat file) can use a prebuilt index set with
+  * setCells(); the permutation is then the identity.
+  */
+class StarSkyIndex : public Object
+{
+public:
+    StarSkyIndex();
+    ~StarSkyIndex();
+
+    struct Cell
+    {
+        /** Corners of the spherical triangle, in counterclockwise order as viewed from outside the sphere */
+        Eigen::Vector3f vertices[3];
+
+        /** Center and angular radius of a spherical cap that contains the cell */
+        Eigen::Vector3f center;
+        float cosRadius;
+        float sinRadius;
+
+        /** Magnitude of the brightest star in the cell */
+        float brightestMagnitude;
+
+        unsigned int firstStar;
+        unsigned int starCount;
+
+        /** Index of the first of the four child cells; zero for leaf cells */
+        unsigned int firstChild;
+        unsigned int depth;
+
+        bool isLeaf() const
+        {
+            return firstChild == 0;
+        }
+    };
+
+    /** A range of index positions, as produced by findVisibleStars()
+      */
+    struct StarRange
+    {
+        unsigned int first;
+        unsigned int count;
+    };
+
+    void build(StarCatalog* catalog,
+               unsigned int maxStarsPerCell = DefaultMaxStarsPerCell,
+               unsigned int maxDepth = DefaultMaxDepth);
+    bool setCells(const std::vector<Cell>& cells, const float* magnitudes, unsigned int starCount, Object* magnitudeStorage = NULL);
+
+    /** Get the total number of stars in the index.
+      */
+    unsigned int starCount() const
+    {
+        return m_starCount;
+    }
+
+    /** Get the number of cells (including non-leaf cells.) The first eight cells
+      * are always the root cells.
+      */
+    unsigned int cellCount() const
+    {
+        return m_cells.size();
+    }
+
+    const Cell& cell(unsigned int cellIndex) const
+    {
+        return m_cells[cellIndex];
+    }
+
+    /** Get the catalog index of the star at the specified position in the index.
+      */
+    unsigned int catalogIndex(unsigned int position) const
+    {
+        return m_starOrder.empty() ? position : m_starOrder[position];
+    }
+
+    /** Get the apparent magnitude of the star at the specified position in the index.
+      */
+    float magnitude(unsigned int position) const
+    {
+        return m_magnitudeData[position];
+    }
+
+    unsigned int findCell(const Eigen::Vector3f& direction) const;
+    unsigned int brighterStarCount(unsigned int cellIndex, float magnitude) const;
+    unsigned int findVisibleStars(const Eigen::Matrix4f& viewProjection,
+                                  float limitingMagnitude,
+                                  std::vector<StarRange>& ranges) const;
+
+    static bool ContainsDirection(const Cell& cell, const Eigen::Vector3f& direction);
+    static float AngularDistance(const Cell& cell, const Eigen::Vector3f& direction);
+
+    static const unsigned int RootCellCount = 8;
+    static const unsigned int DefaultMaxStarsPerCell = 4096;
+    static const unsigned int DefaultMaxDepth = 10;
+
+private:
+    void buildCell(unsigned int cellIndex,
+                   unsigned int begin,
+                   unsigned int end,
+                   const std::vector<Eigen::Vector3f>& positions,
+                   const std::vector<float>& magnitudes,
+                   std::vector<unsigned int>& scratch);
+    void addVisibleCell(unsigned int cellIndex,
+                        const Eigen::Vector4f* planes,
+                        unsigned int planeMask,
+                        float limitingMagnitude,
+                        std::vector<StarRange>& ranges,
+                        unsigned int& visibleCellCount) const;
+
+private:
+    std::vector<Cell> m_cells;
+    unsigned int m_starCount;
+    std::vector<v_uint32> m_starOrder;
+    std::vector<float> m_magnitudes;
+    const float* m_magnitudeData;
+    counted_ptr<Object> m_magnitudeStorage;
+    unsigned int m_maxStarsPerCell;
+    unsigned int m_maxDepth;
+};
+
+}
+
+#endif // _VESTA_STAR_SKY_INDEX_H_
@@ -13,6 +13,7 @@
 #include "OGLHeaders.h"
 #include "ShaderBuilder.h"
 #include "Debug.h"
+#include "internal/StarVertexStream.h"
 #include "glhelp/GLVertexBuffer.h"
 #include "glhelp/GLShaderProgram.h"
 #include <string>
@@ -202,8 +203,24 @@ static const char* PassthroughSRGBSource =
 
 static const float DefaultLimitingMagnitude = 7.0f;
 
+// Limiting magnitude used for the brightness values stored in the vertices of
+// stars drawn with the fixed function pipeline.
+static const float FixedFunctionLimitingMagnitude = 7.0f;
+
+// Stars fainter than the limiting magnitude are still drawn with a nonzero pixel
+// value once they've been converted to sRGB. Only stars that are this much dimmer
+// than a star at the limiting magnitude are culled.
+static const float CulledStarBrightness = 1.0f / 32.0f;
+
+// Capacity in stars of the buffer that the vertices of visible stars are streamed into.
+// When more stars than this are in view, the buffer is refilled and drawn several
+// times per frame.
+static const unsigned int StarStreamCapacity = 131072;
+
 StarsLayer::StarsLayer() :
     m_vertexArray(NULL),
+    m_vertexStream(NULL),
+    m_streamedVertexCount(0),
     m_vertexBufferCurrent(false),
     m_starShaderCompiled(false),
     m_style(GaussianStars),
@@ -216,6 +233,8 @@ StarsLayer::StarsLayer() :
 StarsLayer::StarsLayer(StarCatalog* starCatalog) :
     m_starCatalog(starCatalog),
     m_vertexArray(NULL),
+    m_vertexStream(NULL),
+    m_streamedVertexCount(0),
     m_vertexBufferCurrent(false),
     m_starShaderCompiled(false),
     m_style(GaussianStars),
@@ -231,160 +250,7 @@ StarsLayer::~StarsLayer()
     {
         delete[] m_vertexArray;
     }
-}
-
-
-struct StarsLayerVertex
-{
-    float x;
-    float y;
-    float appMag;
-    unsigned char color[4];
-};
-
-struct StarsLayerVertexFF
-{
-    float x;
-    float y;
-    float z;
-    unsigned char color[4];
-};
-
-
-// Compute the position of a star on the unit sphere.
-static Vector3f StarPositionCartesian(const StarCatalog::StarRecord& star)
-{
-    float cosDec = cos(star.declination);
-    return Vector3f(cosDec * cos(star.RA), cosDec * sin(star.RA), sin(star.declination));
-}
-
-
-static void SpectrumToColor(const Spectrum& s, unsigned char color[])
-{
-    color[0] = (int) (255.0f * s.red() + 0.5f);
-    color[1] = (int) (255.0f * s.green() + 0.5f);
-    color[2] = (int) (255.0f * s.blue() + 0.5f);
-}
-
-
-static void SetStarColorSRGB(const StarCatalog::StarRecord& star, unsigned char color[])
-{
-    Spectrum cieXYZ = StarCatalog::StarColor(star.bvColorIndex);
-
-    Spectrum srgb = Spectrum::XYZtoLinearSRGB(cieXYZ);
-    srgb.normalize();
-    srgb = Spectrum::LinearSRGBtoSRGB(srgb);
-    SpectrumToColor(srgb, color);
-}
-
-
-static void SetStarColorLinearSRGB(const StarCatalog::StarRecord& star, unsigned char color[])
-{
-    Spectrum cieXYZ = StarCatalog::StarColor(star.bvColorIndex);
-
-    Spectrum srgb = Spectrum::XYZtoLinearSRGB(cieXYZ);
-    srgb.normalize();
-    SpectrumToColor(srgb, color);
-}
-
-
-static void SetStarBrightness(const StarCatalog::StarRecord& star, float limMag, float satMag, StarsLayerVertexFF& v)
-{
-    float brightness = std::min(1.0f, std::max(0.0f, (limMag - star.apparentMagnitude) / (limMag - satMag)));
-    v.color[3] = (unsigned char) (255.99f * brightness);
-}
-
-
-static char*
-CreateStarVertexArrayFF(StarCatalog* starCatalog)
-{
-    if (starCatalog->size() == 0)
-    {
-        return NULL;
-    }
-
-    StarsLayerVertexFF* va = new StarsLayerVertexFF[starCatalog->size()];
-    for (unsigned int i = 0; i < starCatalog->size(); ++i)
-    {
-        const StarCatalog::StarRecord& star = starCatalog->star(i);
-        Vector3f position = StarPositionCartesian(star);
-        va[i].x = position.x();
-        va[i].y = position.y();
-        va[i].z = position.z();
-        SetStarColorSRGB(star, va[i].color);
-        SetStarBrightness(star, 7.0f, 0.0f, va[i]);
-    }
-
-    return reinterpret_cast<char*>(va);
-}
-
-
-static char*
-CreateStarVertexArray(StarCatalog* starCatalog)
-{
-    if (starCatalog->size() == 0)
-    {
-        return NULL;
-    }
-
-    StarsLayerVertex* va = new StarsLayerVertex[starCatalog->size()];
-    for (unsigned int i = 0; i < starCatalog->size(); ++i)
-    {
-        const StarCatalog::StarRecord& star = starCatalog->star(i);
-        Vector3f position = StarPositionCartesian(star);
-        va[i].x = position.x();
-        va[i].y = position.y();
-
-        SetStarColorLinearSRGB(star, va[i].color);
-        if (position.z() < 0.0f)
-        {
-            va[i].color[3] = 0;
-        }
-        else
-        {
-            va[i].color[3] = 255;
-        }
-
-        va[i].appMag = star.apparentMagnitude;
-    }
-
-    return reinterpret_cast<char*>(va);
-}
-
-
-static GLVertexBuffer*
-CreateStarVertexBuffer(StarCatalog* starCatalog)
-{
-    char* buf = CreateStarVertexArray(starCatalog);
-    if (buf)
-    {
-        GLVertexBuffer* vb = new GLVertexBuffer(sizeof(StarsLayerVertex) * starCatalog->size(), GL_STATIC_DRAW, buf);
-        delete[] buf;
-        return vb;
-    }
-    else
-    {
-        return NULL;
-    }
-
-}
-
-
-// Create a star vertex buffer to use for the fixed function OpenGL pipe
-static GLVertexBuffer*
-CreateStarVertexBufferFF(StarCatalog* starCatalog)
-{
-    char* buf = CreateStarVertexArrayFF(starCatalog);
-    if (buf)
-    {
-        GLVertexBuffer* vb =new  GLVertexBuffer(sizeof(StarsLayerVertexFF) * starCatalog->size(), GL_STATIC_DRAW, buf);
-        delete[] buf;
-        return vb;
-    }
-    else
-    {
-        return NULL;
-    }
+    delete m_vertexStream;
 }
 
 
@@ -428,20 +294,14 @@ StarsLayer::render(RenderContext& rc)
     }
 
     // Update the star vertex buffer (or vertex array memory if vertex buffer objects aren't supported)
-    if (!m_vertexBufferCurrent)
+    // The vertices are streamed from the catalog in sky index order, so the buffer contents must also
+    // be replaced whenever the catalog is modified and its index rebuilt.
+    if (!m_vertexBufferCurrent || m_skyIndex.ptr() != m_starCatalog->skyIndex())
     {
         updateVertexBuffer();
     }
 
-    if (m_vertexBuffer.isValid())
-    {
-        rc.bindVertexBuffer(VertexSpec::PositionColor, m_vertexBuffer.ptr(), VertexSpec::PositionColor.size());
-    }
-    else if (m_vertexArray)
-    {
-        rc.bindVertexArray(VertexSpec::PositionColor, m_vertexArray, VertexSpec::PositionColor.size());
-    }
-    else
+    if (!m_vertexBuffer.isValid() && !m_vertexArray)
     {
         // No valid star data!
         return;
@@ -460,6 +320,27 @@ StarsLayer::render(RenderContext& rc)
     bool enableSRGBExt = GLEW_EXT_framebuffer_sRGB == GL_TRUE;
 #endif
 
+    // Exposure is set such that stars at the limiting magnitude are just
+    // visible on screen, i.e. they will be rendered as pixels with
+    // value visibilityThreshold when exactly centered. Exposure is calculated
+    // so that stars at the saturation magnitude will be rendered as full
+    // brightness pixels.
+    float visibilityThreshold = 1.0f / 255.0f;
+    float logMVisThreshold = log(visibilityThreshold) / log(2.512f);
+    float saturationMag = m_limitingMagnitude - 4.5f; //+ logMVisThreshold;
+    float magScale = (logMVisThreshold) / (saturationMag - m_limitingMagnitude);
+
+    float cullingMagnitude = FixedFunctionLimitingMagnitude;
+    if (useStarShader)
+    {
+        cullingMagnitude = m_limitingMagnitude + log(1.0f / CulledStarBrightness) / (log(2.512f) * magScale);
+    }
+
+    m_visibleStars.clear();
+    m_skyIndex->findVisibleStars((rc.projection() * rc.modelview()).matrix(),
+                                 cullingMagnitude,
+                                 m_visibleStars);
+
     Material starMaterial;
     starMaterial.setDiffuse(Spectrum(1.0f, 1.0f, 1.0f));
     starMaterial.setBlendMode(Material::AdditiveBlend);
@@ -502,16 +383,6 @@ StarsLayer::render(RenderContext& rc)
         starShader->setConstant("glareFalloff", 1.0f / 15.0f);
         starShader->setConstant("glareBrightness", 0.003f);
         starShader->setConstant("diffSpikeBrightness", m_diffractionSpikeBrightness * 3.0f);
-
-        // Exposure is set such that stars at the limiting magnitude are just
-        // visible on screen, i.e. they will be rendered as pixels with
-        // value visibilityThreshold when exactly centered. Exposure is calculated
-        // so that stars at the saturation magnitude will be rendered as full
-        // brightness pixels.
-        float visibilityThreshold = 1.0f / 255.0f;
-        float logMVisThreshold = log(visibilityThreshold) / log(2.512f);
-        float saturationMag = m_limitingMagnitude - 4.5f; //+ logMVisThreshold;
-        float magScale = (logMVisThreshold) / (saturationMag - m_limitingMagnitude);
         starShader->setConstant("thresholdBrightness", visibilityThreshold);
         starShader->setConstant("exposure", pow(2.512f, magScale * saturationMag));
         starShader->setConstant("magScale", magScale);
@@ -535,9 +406,8 @@ StarsLayer::render(RenderContext& rc)
 #endif
     }
 
-    rc.drawPrimitives(PrimitiveBatch(PrimitiveBatch::Points, m_starCatalog->size()));
-
-    rc.unbindVertexBuffer();
+    // Draw only the stars in cells of the sky index that intersect the view frustum
+    drawVisibleStars(rc);
 
     if (useStarShader)
     {
@@ -587,26 +457,122 @@ StarsLayer::updateVertexBuffer()
 {
     bool useStarShader = m_style == GaussianStars && m_starShader.isValid() && m_starShaderSRGB.isValid();
 
+    m_skyIndex = m_starCatalog->skyIndex();
+
+    // Vertices are only created for the stars in view, so the size of the buffer
+    // doesn't depend on the size of the catalog.
+    StarVertexStream::VertexFormat format = StarVertexStream::FixedFunctionVertices;
+    if (GLVertexBuffer::supported() && useStarShader)
+    {
+        format = StarVertexStream::ShaderVertices;
+    }
+
+    delete m_vertexStream;
+    m_vertexStream = new StarVertexStream(format, FixedFunctionLimitingMagnitude);
+    m_streamedStars.clear();
+    m_streamedVertexCount = 0;
+
+    m_vertexBuffer = NULL;
+    if (m_vertexArray)
+    {
+        delete[] m_vertexArray;
+        m_vertexArray = NULL;
+    }
+
     if (GLVertexBuffer::supported())
     {
-        if (useStarShader)
-        {
-            m_vertexBuffer = CreateStarVertexBuffer(m_starCatalog.ptr());
-        }
-        else
+        m_vertexBuffer = new GLVertexBuffer(m_vertexStream->vertexSize() * StarStreamCapacity, GL_DYNAMIC_DRAW);
+    }
+    else
+    {
+        m_vertexArray = new char[m_vertexStream->vertexSize() * StarStreamCapacity];
+    }
+
+    m_vertexBufferCurrent = true;
+}
+
+
+static bool
+SameRanges(const vector<StarSkyIndex::StarRange>& ranges0, const vector<StarSkyIndex::StarRange>& ranges1)
+{
+    if (ranges0.size() != ranges1.size())
+    {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < ranges0.size(); ++i)
+    {
+        if (ranges0[i].first != ranges1[i].first || ranges0[i].count != ranges1[i].count)
         {
-            m_vertexBuffer = CreateStarVertexBufferFF(m_starCatalog.ptr());
+            return false;
         }
     }
-    else
+
+    return true;
+}
+
+
+// Draw the stars in m_visibleStars. The vertices are generated from the catalog and
+// streamed through the vertex buffer in pieces no larger than its capacity. If all
+// of the visible stars fit, they're left in the buffer and reused until the set of
+// visible stars changes.
+void
+StarsLayer::drawVisibleStars(RenderContext& rc)
+{
+    if (m_streamedVertexCount > 0 && SameRanges(m_visibleStars, m_streamedStars))
     {
-        if (m_vertexArray)
+        bindStarVertices(rc);
+        rc.drawPrimitives(PrimitiveBatch(PrimitiveBatch::Points, m_streamedVertexCount));
+        rc.unbindVertexBuffer();
+        return;
+    }
+
+    m_streamedStars.clear();
+    m_streamedVertexCount = 0;
+
+    m_vertexStream->begin(m_starCatalog.ptr(), m_visibleStars);
+    while (!m_vertexStream->isComplete())
+    {
+        char* vertices = m_vertexArray;
+        if (m_vertexBuffer.isValid())
+        {
+            vertices = reinterpret_cast<char*>(m_vertexBuffer->mapWriteOnly());
+        }
+
+        if (!vertices)
+        {
+            break;
+        }
+
+        unsigned int vertexCount = m_vertexStream->next(vertices, StarStreamCapacity);
+        if (m_vertexBuffer.isValid() && !m_vertexBuffer->unmap())
+        {
+            // Buffer contents were lost; skip this piece
+            continue;
+        }
+
+        bindStarVertices(rc);
+        rc.drawPrimitives(PrimitiveBatch(PrimitiveBatch::Points, vertexCount));
+        rc.unbindVertexBuffer();
+
+        if (m_vertexStream->isComplete() && m_vertexStream->starCount() == vertexCount)
         {
-            delete[] m_vertexArray;
-            m_vertexArray = NULL;
+            m_streamedStars = m_visibleStars;
+            m_streamedVertexCount = vertexCount;
         }
-        m_vertexArray = CreateStarVertexArrayFF(m_starCatalog.ptr());
     }
+}
 
-    m_vertexBufferCurrent = true;
+
+void
+StarsLayer::bindStarVertices(RenderContext& rc)
+{
+    if (m_vertexBuffer.isValid())
+    {
+        rc.bindVertexBuffer(VertexSpec::PositionColor, m_vertexBuffer.ptr(), VertexSpec::PositionColor.size());
+    }
+    else
+    {
+        rc.bindVertexArray(VertexSpec::PositionColor, m_vertexArray, VertexSpec::PositionColor.size());
+    }
 }
@@ -20,6 +20,7 @@ namespace vesta
 
 class GLVertexBuffer;
 class GLShaderProgram;
+class StarVertexStream;
 
 class StarsLayer : public SkyLayer
 {
@@ -92,11 +93,18 @@ public:
 
 private:
     void updateVertexBuffer();
+    void drawVisibleStars(RenderContext& rc);
+    void bindStarVertices(RenderContext& rc);
 
 private:
     counted_ptr<StarCatalog> m_starCatalog;
+    counted_ptr<StarSkyIndex> m_skyIndex;
+    std::vector<StarSkyIndex::StarRange> m_visibleStars;
     char* m_vertexArray;
     counted_ptr<GLVertexBuffer> m_vertexBuffer;
+    StarVertexStream* m_vertexStream;
+    std::vector<StarSkyIndex::StarRange> m_streamedStars;
+    unsigned int m_streamedVertexCount;
     counted_ptr<GLShaderProgram> m_starShader;
     counted_ptr<GLShaderProgram> m_starShaderSRGB;
     bool m_vertexBufferCurrent;
@@ -113,6 +113,88 @@ static inline unsigned int lower6bits(char c)
 }
 
 
+// Decode the UTF-8 character starting at byte i of a string. The character code
+// is stored in glyphId, and the number of bytes in the encoded character is
+// returned. Zero is returned if the encoding is invalid.
+static unsigned int
+decodeUtf8(const string& text, unsigned int i, unsigned int* glyphId)
+{
+    unsigned char byte0 = text[i];
+    unsigned int decodeBytes = 0;
+
+    if (byte0 < 0x80)
+    {
+        decodeBytes = 1;
+    }
+    else if ((byte0 & 0xe0) == 0xc0)
+    {
+        decodeBytes = 2;
+    }
+    else if ((byte0 & 0xf0) == 0xe0)
+    {
+        decodeBytes = 3;
+    }
+    else if ((byte0 & 0xf8) == 0xf0)
+    {
+        decodeBytes = 4;
+    }
+    else if ((byte0 & 0xfc) == 0xf8)
+    {
+        decodeBytes = 5;
+    }
+    else if ((byte0 & 0xfe) == 0xfc)
+    {
+        decodeBytes = 6;
+    }
+
+    if (decodeBytes == 0 || i + decodeBytes > text.length())
+    {
+        return 0;
+    }
+
+    switch (decodeBytes)
+    {
+    case 1:
+        *glyphId = byte0;
+        break;
+    case 2:
+        *glyphId = ((byte0 & 0x1f) << 6) |
+                   lower6bits(text[i + 1]);
+        break;
+    case 3:
+        *glyphId = ((byte0 & 0x0f) << 12) |
+                   (lower6bits(text[i + 1]) << 6) |
+                   lower6bits(text[i + 2]);
+        break;
+    case 4:
+        *glyphId = ((byte0 & 0x07) << 18) |
+                   (lower6bits(text[i + 1]) << 12) |
+                   (lower6bits(text[i + 2]) << 6)  |
+                   lower6bits(text[i + 3]);
+        break;
+    case 5:
+        *glyphId = ((byte0 & 0x03) << 24) |
+                   (lower6bits(text[i + 1]) << 18) |
+                   (lower6bits(text[i + 2]) << 12) |
+                   (lower6bits(text[i + 3]) << 6)  |
+                   lower6bits(text[i + 4]);
+        break;
+    case 6:
+        *glyphId = ((byte0 & 0x01) << 30)    |
+                   (lower6bits(text[i + 1]) << 24) |
+                   (lower6bits(text[i + 2]) << 18) |
+                   (lower6bits(text[i + 3]) << 12) |
+                   (lower6bits(text[i + 4]) << 6)  |
+                   lower6bits(text[i + 5]);
+        break;
+    default:
+        break;
+    }
+
+    return decodeBytes;
+}
+
+
 /** Render a string of UTF-8 encoded text at the specified starting position.
  *
  *  Note that this method will not draw anything on systems with OpenGL ES 2.0 (typically mobile
@@ -129,77 +211,11 @@ TextureFont::renderUtf8(const string& text, const Vector2f& startPosition) const
 
     while (i < text.length())
     {
-        unsigned char byte0 = text[i];
-        unsigned int decodeBytes = 0;
-
-        if (byte0 < 0x80)
-        {
-            decodeBytes = 1;
-        }
-        else if ((byte0 & 0xe0) == 0xc0)
-        {
-            decodeBytes = 2;
-        }
-        else if ((byte0 & 0xf0) == 0xe0)
-        {
-            decodeBytes = 3;
-        }
-        else if ((byte0 & 0xf8) == 0xf0)
-        {
-            decodeBytes = 4;
-        }
-        else if ((byte0 & 0xfc) == 0xf8)
-        {
-            decodeBytes = 5;
-        }
-        else if ((byte0 & 0xfe) == 0xfc)
-        {
-            decodeBytes = 6;
-        }
-
-        if (decodeBytes == 0 || i + decodeBytes > text.length())
-        {
-            // Invalid UTF-8 encoding
-            break;
-        }
-
         unsigned int glyphId = 0;
-        switch (decodeBytes)
+        unsigned int decodeBytes = decodeUtf8(text, i, &glyphId);
+        if (decodeBytes == 0)
         {
-        case 1:
-            glyphId = byte0;
-            break;
-        case 2:
-            glyphId = ((byte0 & 0x1f) << 6) |
-                      lower6bits(text[i + 1]);
-            break;
-        case 3:
-            glyphId = ((byte0 & 0x0f) << 12) |
-                      (lower6bits(text[i + 1]) << 6) |
-                      lower6bits(text[i + 2]);
-            break;
-        case 4:
-            glyphId = ((byte0 & 0x07) << 18) |
-                      (lower6bits(text[i + 1]) << 12) |
-                      (lower6bits(text[i + 2]) << 6)  |
-                      lower6bits(text[i + 3]);
-            break;
-        case 5:
-            glyphId = ((byte0 & 0x03) << 24) |
-                      (lower6bits(text[i + 1]) << 18) |
-                      (lower6bits(text[i + 2]) << 12) |
-                      (lower6bits(text[i + 3]) << 6)  |
-                      lower6bits(text[i + 4]);
-            break;
-        case 6:
-            glyphId = ((byte0 & 0x01) << 30)    |
-                      (lower6bits(text[i + 1]) << 24) |
-                      (lower6bits(text[i + 2]) << 18) |
-                      (lower6bits(text[i + 3]) << 12) |
-                      (lower6bits(text[i + 4]) << 6)  |
-                      lower6bits(text[i + 5]);
-            break;
-        default:
+            // Invalid UTF-8 encoding
             break;
         }
 
@@ -345,11 +361,11 @@ TextureFont::renderUtf8ToBuffer(const std::string& text,
     unsigned int glyphCount = 0;
     unsigned int maxGlyphs = 0x10000000;
 
-#ifndef VESTA_NO_IMMEDIATE_MODE_3D
     if (vertexData)
     {
         maxGlyphs = vertexDataSize / GLYPH_SIZE;
     }
+#ifndef VESTA_NO_IMMEDIATE_MODE_3D
     else
     {
         glBegin(GL_QUADS);
@@ -359,77 +375,11 @@ TextureFont::renderUtf8ToBuffer(const std::string& text,
 
     while (i < text.length() && glyphCount < maxGlyphs)
     {
-        unsigned char byte0 = text[i];
-        unsigned int decodeBytes = 0;
-
-        if (byte0 < 0x80)
-        {
-            decodeBytes = 1;
-        }
-        else if ((byte0 & 0xe0) == 0xc0)
-        {
-            decodeBytes = 2;
-        }
-        else if ((byte0 & 0xf0) == 0xe0)
-        {
-            decodeBytes = 3;
-        }
-        else if ((byte0 & 0xf8) == 0xf0)
-        {
-            decodeBytes = 4;
-        }
-        else if ((byte0 & 0xfc) == 0xf8)
-        {
-            decodeBytes = 5;
-        }
-        else if ((byte0 & 0xfe) == 0xfc)
-        {
-            decodeBytes = 6;
-        }
-
-        if (decodeBytes == 0 || i + decodeBytes > text.length())
-        {
-            // Invalid UTF-8 encoding
-            break;
-        }
-
         unsigned int glyphId = 0;
-        switch (decodeBytes)
+        unsigned int decodeBytes = decodeUtf8(text, i, &glyphId);
+        if (decodeBytes == 0)
         {
-        case 1:
-            glyphId = byte0;
-            break;
-        case 2:
-            glyphId = ((byte0 & 0x1f) << 6) |
-                      lower6bits(text[i + 1]);
-            break;
-        case 3:
-            glyphId = ((byte0 & 0x0f) << 12) |
-                      (lower6bits(text[i + 1]) << 6) |
-                      lower6bits(text[i + 2]);
-            break;
-        case 4:
-            glyphId = ((byte0 & 0x07) << 18) |
-                      (lower6bits(text[i + 1]) << 12) |
-                      (lower6bits(text[i + 2]) << 6)  |
-                      lower6bits(text[i + 3]);
-            break;
-        case 5:
-            glyphId = ((byte0 & 0x03) << 24) |
-                      (lower6bits(text[i + 1]) << 18) |
-                      (lower6bits(text[i + 2]) << 12) |
-                      (lower6bits(text[i + 3]) << 6)  |
-                      lower6bits(text[i + 4]);
-            break;
-        case 6:
-            glyphId = ((byte0 & 0x01) << 30)    |
-                      (lower6bits(text[i + 1]) << 24) |
-                      (lower6bits(text[i + 2]) << 18) |
-                      (lower6bits(text[i + 3]) << 12) |
-                      (lower6bits(text[i + 4]) << 6)  |
-                      lower6bits(text[i + 5]);
-            break;
-        default:
+            // Invalid UTF-8 encoding
             break;
         }
 
@@ -492,11 +442,11 @@ TextureFont::renderLatin1ToBuffer(const std::string& text,
     unsigned int glyphCount = 0;
     unsigned int maxGlyphs = 0x10000000;
     
-#ifndef VESTA_NO_IMMEDIATE_MODE_3D
     if (vertexData)
     {
         maxGlyphs = vertexDataSize / GLYPH_SIZE;
     }
+#ifndef VESTA_NO_IMMEDIATE_MODE_3D
     else
     {
         glBegin(GL_QUADS);
@@ -575,6 +525,43 @@ TextureFont::textWidth(const string& text) const
 }
 
 
+/** Compute the width in pixels of a string of text in the specified encoding.
+ *  Text with invalid UTF-8 encoding is measured up to the first bad character,
+ *  which is where renderEncodedString() stops drawing.
+ */
+float
+TextureFont::textWidth(const string& text, Encoding encoding) const
+{
+    if (encoding != Utf8)
+    {
+        return textWidth(text);
+    }
+
+    float width = 0.0f;
+
+    unsigned int i = 0;
+    while (i < text.length())
+    {
+        unsigned int glyphId = 0;
+        unsigned int decodeBytes = decodeUtf8(text, i, &glyphId);
+        if (decodeBytes == 0)
+        {
+            break;
+        }
+
+        const Glyph* glyph = lookupGlyph(glyphId);
+        if (glyph)
+        {
+            width += glyph->advance;
+        }
+
+        i += decodeBytes;
+    }
+
+    return width;
+}
+
+
 /** Get the maximum height above the baseline of any glyph in the font.
   * The returned value is in units of pixels.
   */
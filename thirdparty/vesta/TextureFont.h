@@ -65,6 +65,7 @@ public:
 
 
     float textWidth(const std::string& text) const;
+    float textWidth(const std::string& text, Encoding encoding) const;
     float textAscent(const std::string& text) const;
     float maxAscent() const;
     float maxDescent() const;
@@ -22,7 +22,8 @@ using namespace std;
 
 
 TextureMapLoader::TextureMapLoader() :
-    m_frameCount(0)
+    m_frameCount(0),
+    m_demandRequestCount(0)
 {
 }
 
@@ -101,11 +102,78 @@ TextureMapLoader::makeResident(TextureMap* texture)
 {
     texture->setLastUsed(m_frameCount);
     bool isResident = handleMakeResident(texture);
+    ++m_demandRequestCount;
 
     return isResident;
 }
 
 
+/** Add a texture to the low priority prefetch queue. Unlike makeResident(),
+  * this doesn't start loading the texture right away: queued textures are
+  * handed to the loader by issuePrefetches(), which gives way to textures
+  * requested for rendering. Textures that are already loaded, loading, or
+  * queued are ignored.
+  *
+  * \return true if the texture was added to the queue
+  */
+bool
+TextureMapLoader::prefetch(TextureMap* texture)
+{
+    if (texture->status() != TextureMap::Uninitialized || m_prefetchQueued.count(texture) > 0)
+    {
+        return false;
+    }
+
+    // Requests for views that the observer has moved away from are the least
+    // likely to be useful, so the oldest are discarded when the queue is full.
+    if (m_prefetchQueue.size() >= MaxPrefetchQueueLength)
+    {
+        m_prefetchQueued.erase(m_prefetchQueue.front().ptr());
+        m_prefetchQueue.pop_front();
+    }
+
+    m_prefetchQueue.push_back(counted_ptr<TextureMap>(texture));
+    m_prefetchQueued.insert(texture);
+
+    return true;
+}
+
+
+/** Start loading textures from the prefetch queue. Loads requested through
+  * makeResident() during the current frame count against the limit, so that
+  * prefetching never delays textures needed for the current view. Prefetched
+  * textures are marked as least recently used; they're the first candidates
+  * for eviction until they're actually drawn.
+  *
+  * This should be called once per frame, after rendering.
+  *
+  * \param maxRequests the maximum number of loads to issue in a frame, including
+  * those for textures requested through makeResident()
+  * \return the number of prefetch requests issued
+  */
+unsigned int
+TextureMapLoader::issuePrefetches(unsigned int maxRequests)
+{
+    unsigned int issueCount = 0;
+    while (m_demandRequestCount + issueCount < maxRequests && !m_prefetchQueue.empty())
+    {
+        counted_ptr<TextureMap> texture = m_prefetchQueue.front();
+        m_prefetchQueue.pop_front();
+        m_prefetchQueued.erase(texture.ptr());
+
+        // Skip textures that were requested for rendering while waiting in the queue
+        if (texture->status() == TextureMap::Uninitialized)
+        {
+            handleMakeResident(texture.ptr());
+            texture->setLastUsed(0);
+            ++issueCount;
+        }
+    }
+
+    return issueCount;
+}
+
+
 /** Update the frame count. The frame count is used to track texture usage in order
   * to determine which textures should be evicted first when trimming graphics memory
   * usage.
@@ -113,6 +181,7 @@ TextureMapLoader::makeResident(TextureMap* texture)
 v_int64
 TextureMapLoader::incrementFrameCount()
 {
+    m_demandRequestCount = 0;
     return ++m_frameCount;
 }
 
@@ -15,6 +15,8 @@
 #include "TextureMap.h"
 #include <string>
 #include <map>
+#include <set>
+#include <deque>
 
 
 namespace vesta
@@ -28,6 +30,8 @@ public:
 
     TextureMap* loadTexture(const std::string& resourceName, const TextureProperties& properties);
     bool makeResident(TextureMap* texture);
+    bool prefetch(TextureMap* texture);
+    unsigned int issuePrefetches(unsigned int maxRequests);
 
     /** Handle a request to make a texture resident. Texture loader subclasses
       * must implement this method to load data from the texture source. It is
@@ -54,6 +58,18 @@ public:
       */
     v_int64 incrementFrameCount();
 
+    /** Get the number of textures waiting in the prefetch queue.
+      */
+    unsigned int prefetchQueueLength() const
+    {
+        return (unsigned int) m_prefetchQueue.size();
+    }
+
+    /** Maximum number of textures held in the prefetch queue; when the queue is
+      * full, the oldest requests are dropped.
+      */
+    static const unsigned int MaxPrefetchQueueLength = 256;
+
 protected:
     virtual std::string resolveResourceName(const std::string& resourceName);
 
@@ -61,6 +77,13 @@ private:
     v_int64 m_frameCount;
     typedef std::map<std::string, counted_ptr<TextureMap> > TextureTable;
     TextureTable m_textures;
+
+    // Low priority load requests. These are only passed on to handleMakeResident()
+    // by issuePrefetches(), and only when few textures were requested for rendering
+    // in the current frame.
+    std::deque<counted_ptr<TextureMap> > m_prefetchQueue;
+    std::set<TextureMap*> m_prefetchQueued;
+    unsigned int m_demandRequestCount;
 };
 
 }
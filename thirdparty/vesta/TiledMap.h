@@ -51,6 +51,18 @@ public:
       */
     virtual TextureSubrect tile(unsigned int level, unsigned int x, unsigned int y) = 0;
 
+    /** Request that a tile be loaded before it is needed for rendering. The
+      * default implementation does nothing; tiled maps that load tiles on
+      * demand should override it. Prefetch requests are lower priority than
+      * tiles requested by tile().
+      *
+      * \return true if a new load request was queued for the tile
+      */
+    virtual bool prefetchTile(unsigned int /* level */, unsigned int /* x */, unsigned int /* y */)
+    {
+        return false;
+    }
+
     /** Get the size in pixels of one side of a tile. Maps map
       * contain texture tiles of different resolutions, but determining
       * which tiles to load is based on assuming that all tiles are
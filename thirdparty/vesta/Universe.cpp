@@ -123,6 +123,27 @@ Universe::pickObject(double t,
 }
 
 
+// Get the world coordinate direction of a ray from the camera through a point in
+// the viewport.
+static Vector3d
+viewportPickDirection(const Vector2d& pickPoint,
+                      const Quaterniond& cameraOrientation,
+                      const PlanarProjection& projection,
+                      const Viewport& viewport)
+{
+    // Get the click point in normalized device coordinaes
+    Vector2d ndc = Vector2d((pickPoint.x() - viewport.x()) / viewport.width(),
+                            (pickPoint.y() - viewport.y()) / viewport.height()) * 2.0 - Vector2d::Ones();
+
+    // Convert to a direction in view coordinates
+    double h = tan(projection.fovY() / 2.0);
+    Vector3d pickDirection = Vector3d(h * viewport.aspectRatio() * ndc.x(), h * ndc.y(), -1.0).normalized();
+
+    // Convert to world coordinates
+    return cameraOrientation * pickDirection;
+}
+
+
 /** Determine the closest object intersected by a ray through the specifed point in the
   * viewport. The ray originates at the cameraPosition and passes through the view plane
   * at the pickPoint. The pickObject() method may be used instead of pickViewportObject()
@@ -159,17 +180,7 @@ Universe::pickViewportObject(double t,
     double fovY = projection.fovY();
     double pixelAngle = fovY / viewport.height();
     pc.setPixelAngle(static_cast<float>(pixelAngle));
-
-    // Get the click point in normalized device coordinaes
-    Vector2d ndc = Vector2d((pickPoint.x() - viewport.x()) / viewport.width(),
-                            (pickPoint.y() - viewport.y()) / viewport.height()) * 2.0 - Vector2d::Ones();
-
-    // Convert to a direction in view coordinates
-    double h = tan(fovY / 2.0);
-    Vector3d pickDirection = Vector3d(h * viewport.aspectRatio() * ndc.x(), h * ndc.y(), -1.0).normalized();
-
-    // Convert to world coordinates
-    pc.setPickDirection(cameraOrientation * pickDirection);
+    pc.setPickDirection(viewportPickDirection(pickPoint, cameraOrientation, projection, viewport));
 
     return pickObject(&pc, t, result);
 }
@@ -296,6 +307,59 @@ Universe::setStarCatalog(StarCatalog* starCatalog)
 }
 
 
+/** Find the star in the star catalog that is closest to a pick direction. Stars
+  * brighter than the limiting magnitude are favored over fainter stars at a similar
+  * distance; see StarCatalog::pickStar() for details.
+  *
+  * @param pickDirection the pick direction in world coordinates
+  * @param pickRadius maximum angle in radians between the pick direction and the star
+  * @param limitingMagnitude the apparent magnitude of the faintest stars that may be
+  *    picked; usually the limiting magnitude of the stars layer
+  * @return the picked star, or null if there's no star catalog or no star within the
+  *    pick radius.
+  */
+const StarCatalog::StarRecord*
+Universe::pickStar(const Vector3d& pickDirection,
+                   double pickRadius,
+                   float limitingMagnitude) const
+{
+    if (m_starCatalog.isNull())
+    {
+        return NULL;
+    }
+
+    return m_starCatalog->pickStar(pickDirection.cast<float>(), float(pickRadius), limitingMagnitude);
+}
+
+
+/** Find the star in the star catalog that is closest to a point in the viewport;
+  * see pickStar() for details.
+  *
+  * @param pickPoint viewport coordinates of the pick point
+  * @param cameraOrientation orientation of the camera
+  * @param projection the camera projection
+  * @param viewport the viewport
+  * @param pickRadius maximum distance in pixels between the pick point and the star
+  * @param limitingMagnitude the apparent magnitude of the faintest stars that may be
+  *    picked
+  * @return the picked star, or null if there's no star catalog or no star within the
+  *    pick radius.
+  */
+const StarCatalog::StarRecord*
+Universe::pickViewportStar(const Vector2d& pickPoint,
+                           const Quaterniond& cameraOrientation,
+                           const PlanarProjection& projection,
+                           const Viewport& viewport,
+                           double pickRadius,
+                           float limitingMagnitude) const
+{
+    double pixelAngle = projection.fovY() / viewport.height();
+    return pickStar(viewportPickDirection(pickPoint, cameraOrientation, projection, viewport),
+                    pickRadius * pixelAngle,
+                    limitingMagnitude);
+}
+
+
 /** Add a new sky layer with a specified tag. If a layer with the
   * same tag already exists, it will be replaced.
   */
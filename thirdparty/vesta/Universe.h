@@ -54,6 +54,15 @@ public:
     bool pickObject(PickContext* pc,
                     double t,
                     PickResult* result) const;
+    const StarCatalog::StarRecord* pickStar(const Eigen::Vector3d& pickDirection,
+                                            double pickRadius,
+                                            float limitingMagnitude) const;
+    const StarCatalog::StarRecord* pickViewportStar(const Eigen::Vector2d& pickPoint,
+                                                    const Eigen::Quaterniond& cameraOrientation,
+                                                    const PlanarProjection& projection,
+                                                    const Viewport& viewport,
+                                                    double pickRadius,
+                                                    float limitingMagnitude) const;
 
     typedef std::map<std::string, counted_ptr<SkyLayer> > SkyLayerTable;
     const SkyLayerTable* layers() const
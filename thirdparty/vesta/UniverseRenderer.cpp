@@ -22,10 +22,13 @@
 #include "CubeMapFramebuffer.h"
 #include "TextureFont.h"
 #include "GlareOverlay.h"
+#include "LabelArbiter.h"
 #include "LabelGeometry.h"
 #include "glhelp/GLFramebuffer.h"
 #include "Units.h"
 #include "internal/EclipseShadowVolumeSet.h"
+#include "internal/VisibilitySet.h"
+#include "internal/ShadowMapCache.h"
 #include <Eigen/Geometry>
 #include <algorithm>
 
@@ -51,12 +54,18 @@ const float UniverseRenderer::MaximumFarDistance = 1.0e12f; // one trillion km (
 
 static const float MinimumNearPlaneDistance = 0.00001f;  // 1 centimeter
 static const float MaximumFarPlaneDistance = 1.0e12f; // one trillion km (~6700 AU)
-static const float MinimumNearFarRatio = 0.001f;
 static const float PreferredNearFarRatio = 0.002f;
 
+// Shadow maps are reused until the light or a caster has moved by more than
+// this fraction of a shadow map texel.
+static const float ShadowMapReuseTolerance = 0.25f;
+
 // Solar radius is used to set the size of the default light source
 static const double SolarRadius = 6.96e5;
 
+// View keys of cube map faces start here; keys below are used for ordinary views.
+static const unsigned int CubeMapViewKeyBase = 0x10000;
+
 // Camera rotations used for drawing to the faces of a cube map
 static const Quaterniond Z180 = Quaterniond(AngleAxisd(toRadians(180.0), Vector3d::UnitZ()));
 static const Quaterniond CubeFaceCameraRotations[6] =
@@ -87,11 +96,17 @@ UniverseRenderer::UniverseRenderer() :
     m_defaultSunEnabled(true),
     m_renderViewport(1, 1),
     m_viewIndependentInitializationRequired(true),
+    m_viewCount(0),
+    m_cubeMapCount(0),
+    m_cubeFaceViewKey(0),
+    m_stateCacheEnabled(true),
     m_lastProjection(PlanarProjection::Perspective, -1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 10.0f)
 {
     m_sun = new LightSource();
     m_sun->setLightType(LightSource::Sun);
     m_eclipseShadows = new EclipseShadowVolumeSet();
+    m_visibilitySet = new VisibilitySet();
+    m_shadowMapCache = new ShadowMapCache(MaxShadowMaps, MaxOmniShadowMaps);
 }
 
 
@@ -101,6 +116,31 @@ UniverseRenderer::~UniverseRenderer()
 }
 
 
+UniverseRenderer::RenderStatistics::RenderStatistics() :
+    viewCount(0),
+    cubeMapFaceCount(0),
+    shadowMapsRendered(0),
+    shadowMapsReused(0),
+    omniShadowFacesRendered(0),
+    omniShadowFacesReused(0),
+    drawCallCount(0),
+    materialUpdateCount(0),
+    materialUpdatesSkipped(0),
+    arrayStateChangeCount(0),
+    arrayStateChangesSkipped(0)
+{
+}
+
+
+/** Reset all render statistics to zero.
+  */
+void
+UniverseRenderer::resetStatistics()
+{
+    m_statistics = RenderStatistics();
+}
+
+
 /** Return true if shadows are supported for this renderer. In order to support shadows,
  *  the OpenGL implementation must support both shaders and framebuffer objects.
  */
@@ -159,6 +199,19 @@ UniverseRenderer::setVisualizersEnabled(bool enable)
 }
 
 
+/** Enable or disable caching of render state. With the cache disabled, opaque
+  * items are drawn in depth order rather than grouped by geometry, and the render
+  * context sends the complete material and vertex array state for every draw.
+  * The cache is enabled by default; disabling it is only useful for checking that
+  * the cache doesn't change the rendered image.
+  */
+void
+UniverseRenderer::setStateCacheEnabled(bool enable)
+{
+    m_stateCacheEnabled = enable;
+}
+
+
 /** Enable or disable the drawing of sky layers. Layers may
   * also be shown or hidden individually by calling setVisibility()
   * on the layer. In order for a layer to be drawn, sky layers
@@ -258,6 +311,7 @@ UniverseRenderer::initializeShadowMaps(unsigned int shadowMapSize, unsigned int
 
     m_shadowsEnabled = false;
     m_shadowMaps.clear();
+    m_shadowMapCache->invalidate();
 
     for (unsigned int i = 0; i < shadowMapCount; ++i)
     {
@@ -315,6 +369,7 @@ UniverseRenderer::initializeOmniShadowMaps(unsigned int shadowMapSize, unsigned
     shadowMapSize = min((unsigned int) maxTexSize, shadowMapSize);
 
     m_omniShadowMaps.clear();
+    m_shadowMapCache->invalidate();
 
     // Omnidirectional shadows are implemented as cube maps with the camera to fragment distance
     // stored in the red channel. We require 32-bit floating point precision for storing distances.
@@ -415,8 +470,12 @@ UniverseRenderer::beginViewSet(const Universe* universe, double tsec)
 
     m_eclipseShadows->clear();
 
+    m_renderContext->setLabelArbiter(m_labelArbiter.ptr());
+
     // Set a flag indicating that we haven't rendered any views in this set yet
     m_viewIndependentInitializationRequired = true;
+    m_viewCount = 0;
+    m_cubeMapCount = 0;
 
     return RenderOk;
 }
@@ -437,15 +496,17 @@ UniverseRenderer::endViewSet()
 
     m_universe = NULL;
 
-    return RenderOk;
-}
+    m_renderContext->setLabelArbiter(NULL);
 
+    const RenderContext::Statistics& rcStatistics = m_renderContext->statistics();
+    m_statistics.drawCallCount            += rcStatistics.drawCallCount;
+    m_statistics.materialUpdateCount      += rcStatistics.materialUpdateCount;
+    m_statistics.materialUpdatesSkipped   += rcStatistics.materialUpdatesSkipped;
+    m_statistics.arrayStateChangeCount    += rcStatistics.arrayStateChangeCount;
+    m_statistics.arrayStateChangesSkipped += rcStatistics.arrayStateChangesSkipped;
+    m_renderContext->resetStatistics();
 
-static bool
-visibleItemPredicate(const vesta::UniverseRenderer::VisibleItem& item0,
-                     const vesta::UniverseRenderer::VisibleItem& item1)
-{
-    return item0.farDistance < item1.farDistance;
+    return RenderOk;
 }
 
 
@@ -557,6 +618,8 @@ UniverseRenderer::renderView(const LightingEnvironment* lighting,
         return RenderNoViewSet;
     }
 
+    ++m_statistics.viewCount;
+
     // Last used projection is required for glare rendering
     m_lastProjection = projection;
 
@@ -591,6 +654,25 @@ UniverseRenderer::renderView(const LightingEnvironment* lighting,
 #endif
     glEnable(GL_CULL_FACE);
 
+    // GL state may have been changed by code outside the render context since
+    // the last view was drawn.
+    if (m_renderContext->isStateCacheEnabled() != m_stateCacheEnabled)
+    {
+        m_renderContext->setStateCacheEnabled(m_stateCacheEnabled);
+    }
+    m_renderContext->invalidateStateCache();
+
+    // Views are keyed by the order in which they're drawn in the view set, so that
+    // each stereo eye and cube map face keeps the same key from frame to frame.
+    if (m_cubeFaceViewKey != 0)
+    {
+        m_renderContext->setViewKey(m_cubeFaceViewKey);
+    }
+    else
+    {
+        m_renderContext->setViewKey(++m_viewCount);
+    }
+
     m_renderContext->setCameraOrientation(cameraOrientation.cast<float>());
     m_renderContext->setPixelSize((float) (2 * tan(fieldOfView / 2.0) / viewport.height()));
     m_renderContext->setViewportSize(viewport.width(), viewport.height());
@@ -620,6 +702,9 @@ UniverseRenderer::renderView(const LightingEnvironment* lighting,
             sort(visibleLayers.begin(), visibleLayers.end(), skyLayerOrderPredicate);
         }
 
+        // Labels in sky layers are drawn together after all layers. Nothing in the
+        // sky should cover them.
+        m_renderContext->beginTextBatch();
         for (vector<SkyLayer*>::const_iterator iter = visibleLayers.begin(); iter != visibleLayers.end(); ++iter)
         {
 #ifndef VESTA_NO_FIXED_FUNCTION_3D
@@ -627,6 +712,7 @@ UniverseRenderer::renderView(const LightingEnvironment* lighting,
 #endif
             (*iter)->render(*m_renderContext);
         }
+        m_renderContext->endTextBatch();
     }
 
     glEnable(GL_DEPTH_TEST);
@@ -647,118 +733,54 @@ UniverseRenderer::renderView(const LightingEnvironment* lighting,
     // doesn't intersect the geometry of a body.
     float nearPlaneFovAdjustment = (float) (cos(fieldOfView / 2.0) / sqrt(1.0 + aspectRatio * aspectRatio));
 
-    const vector<Entity*>& entities = m_universe->entities();
-
-    m_visibleItems.clear();
-    m_splittableItems.clear();
-
     m_lighting = lighting;
 
     buildVisibleLightSourceList(cameraPosition);
 
-    // Simply scan through all entities in the universe.
-    // TODO: For better performance with many entities, we could maintain a
-    // bounding sphere hierarchy.
-    for (vector<Entity*>::const_iterator iter = entities.begin(); iter != entities.end(); ++iter)
+    // Entity positions aren't view dependent, so they're evaluated just once for all views
+    // in the set. We also add eclipse shadow volumes for ellipsoidal bodies (except when no
+    // sun light source is defined); subsequent views can reuse the shadow volume set
+    // because shadow volumes are not view dependent either.
+    if (m_viewIndependentInitializationRequired)
     {
-        const Entity* entity = *iter;
+        bool shadowCastersRequired = m_eclipseShadowsEnabled &&
+                                     !m_lightSources.empty() &&
+                                     m_lightSources.front().lightSource->lightType() == LightSource::Sun;
 
-        if (entity->isVisible(m_currentTime))
-        {
-            Vector3d position = entity->position(m_currentTime);
-
-            // Calculate the difference at double precision, then convert to single
-            // precision for the rest of the work.
-            Vector3d cameraRelativePosition = (position - cameraPosition);
-
-            // Cull objects based on size. If an object is less than one pixel in size,
-            // we don't draw its geometry. Visualizers have sizes that may be unrelated
-            // to the size of the object, so we don't cull them.
-            // TODO: Add a method to the visualizer class that specifies whether the size
-            // culling test (i.e. if the visualizer geometry has a fixed size on screen--such
-            // as a label--then it shouldn't be culled.)
-            bool sizeCull = false;
-            if (entity->geometry())
-            {
-                float projectedSize = (entity->geometry()->boundingSphereRadius() / float(cameraRelativePosition.norm())) / m_renderContext->pixelSize();
-                sizeCull = projectedSize < 0.5f;
-            }
-            else
-            {
-                // Objects without geometry are always culled.
-                sizeCull = true;
-            }
+        m_visibilitySet->evaluate(m_universe->entities(), m_currentTime, shadowCastersRequired);
 
-            // We need the camera space position of the object in order to depth
-            // sort the objects.
-            Vector3f cameraSpacePosition = toCameraSpace * cameraRelativePosition.cast<float>();
-
-            if (!sizeCull)
-            {
-                addVisibleItem(entity, entity->geometry(),
-                               position, cameraRelativePosition, cameraSpacePosition,
-                               entity->orientation(m_currentTime).cast<float>(),
-                               nearPlaneFovAdjustment);
-            }
-
-            // Add an eclipse shadow volume for this body if it is ellipsoidal. We only
-            // need to do this for the first view in the set; subsequent views can reuse
-            // the shadow volume set because shadow volumes are not view dependent.
-            if (m_eclipseShadowsEnabled &&
-                m_viewIndependentInitializationRequired &&
-                entity->geometry() &&
-                entity->geometry()->isEllipsoidal() &&
-                entity->geometry()->isShadowCaster() &&
-                !entity->lightSource())
-            {
-                // Add the shadow volume (except when no sun light source is defined.)
-                if (!m_lightSources.empty() && m_lightSources.front().lightSource->lightType() == LightSource::Sun)
-                {
-                    m_eclipseShadows->addShadow(entity,
-                                                position,
-                                                entity->orientation(m_currentTime).cast<float>(),
-                                                m_lightSources.front().position,
-                                                m_lightSources.front().radius);
-                }
-            }
-
-            if (entity->hasVisualizers() && m_visualizersEnabled)
+        if (shadowCastersRequired)
+        {
+            const VisibilitySet::ShadowCasterVector& casters = m_visibilitySet->shadowCasters();
+            for (VisibilitySet::ShadowCasterVector::const_iterator iter = casters.begin(); iter != casters.end(); ++iter)
             {
-                for (Entity::VisualizerTable::const_iterator iter = entity->visualizers()->begin();
-                     iter != entity->visualizers()->end(); ++iter)
-                {
-                    const Visualizer* visualizer = iter->second.ptr();
-                    if (visualizer->isVisible())
-                    {
-                        Vector3d adjustedPosition = cameraRelativePosition;
-                        Vector3f adjustedCameraSpacePosition = cameraSpacePosition;
-
-                        if (visualizer->depthAdjustment() == Visualizer::AdjustToFront)
-                        {
-                            // Adjust the position of the visualizer so that it is drawn in
-                            // front of the object to which it is attached.
-                            if (entity->geometry())
-                            {
-                                float z = -cameraSpacePosition.z() - entity->geometry()->boundingSphereRadius();
-                                float f = z / -cameraSpacePosition.z();
-                                adjustedPosition *= f;
-                                adjustedCameraSpacePosition *= f;
-                            }
-                        }
-
-                        addVisibleItem(entity, visualizer->geometry(),
-                                       position, adjustedPosition, adjustedCameraSpacePosition,
-                                       visualizer->orientation(entity, m_currentTime).cast<float>(),
-                                       nearPlaneFovAdjustment);
-                    }
-                }
+                m_eclipseShadows->addShadow(iter->entity,
+                                            iter->position,
+                                            iter->orientation,
+                                            m_lightSources.front().position,
+                                            m_lightSources.front().radius);
             }
         }
     }
 
-    // Depth sort all visible items
-    sort(m_visibleItems.begin(), m_visibleItems.end(), visibleItemPredicate);
-    sort(m_splittableItems.begin(), m_splittableItems.end(), visibleItemPredicate);
+    // Find the visible items. This involves no drawing, and it is run in parallel
+    // for universes with many entities.
+    // TODO: For better performance with many entities, we could maintain a
+    // bounding sphere hierarchy.
+    VisibilitySet::ViewParameters view;
+    view.cameraPosition = cameraPosition;
+    view.toCameraSpace = toCameraSpace;
+    view.frustum = m_viewFrustum;
+    view.pixelSize = m_renderContext->pixelSize();
+    view.nearAdjust = nearPlaneFovAdjustment;
+    view.visualizersEnabled = m_visualizersEnabled;
+
+    m_visibilitySet->build(view);
+
+    // Take the depth sorted item lists; swapping leaves the old lists with the visibility
+    // set so that their storage is reused for the next view.
+    m_visibleItems.swap(m_visibilitySet->visibleItems());
+    m_splittableItems.swap(m_visibilitySet->splittableItems());
 
     splitDepthBuffer();
     coalesceDepthBuffer();
@@ -861,7 +883,17 @@ UniverseRenderer::renderView(const LightingEnvironment* lighting,
 
     if (m_eclipseShadowsEnabled)
     {
-        m_eclipseShadows->frustumCull(projection.frustum());
+        // Shadows only need to be tested against objects that will actually be drawn
+        float maxReceiverRadius = 0.0f;
+        for (VisibleItemVector::const_iterator iter = m_visibleItems.begin(); iter != m_visibleItems.end(); ++iter)
+        {
+            if (!iter->outsideFrustum)
+            {
+                maxReceiverRadius = max(maxReceiverRadius, iter->boundingRadius);
+            }
+        }
+
+        m_eclipseShadows->frustumCull(projection.frustum(), cameraPosition, cameraOrientation, maxReceiverRadius);
     }
 
     // Draw depth buffer spans from back to front
@@ -1145,90 +1177,6 @@ UniverseRenderer::setDepthRange(float front, float back)
 }
 
 
-void
-UniverseRenderer::addVisibleItem(const Entity* entity,
-                                 const Geometry* geometry,
-                                 const Vector3d& position,
-                                 const Vector3d& cameraRelativePosition,
-                                 const Vector3f& cameraSpacePosition,
-                                 const Quaternionf& orientation,
-                                 float nearAdjust)
-{
-    // Compute the signed distance from the camera plane to the most
-    // distant part of the entity. A distance < 0 indicates that the
-    // entity lies completely behind the camera.
-    float boundingRadius = geometry->boundingSphereRadius();
-    float farDistance = -cameraSpacePosition.z() + boundingRadius;
-
-    // Calculate a near distance that's as far from the camera as possible.
-    float nearDistance = geometry->nearPlaneDistance(orientation.conjugate() * -cameraRelativePosition.cast<float>());
-
-    // Generally, the near distance for an individual object will never be less
-    // than MinimumNearFarRatio times the bounding diameter. Exceptions are things
-    // like trajectories, which should never be clipped by the near plane. This
-    // is handled by marking trajectories as splittable, so that they will be
-    // drawn into multiple depth buffer spans when necessary.
-    switch (geometry->clippingPolicy())
-    {
-    case Geometry::PreserveDepthPrecision:
-        nearDistance = std::max(nearDistance, boundingRadius * MinimumNearFarRatio * 2.0f);
-        break;
-
-    case Geometry::PreventClipping:
-    case Geometry::SplitToPreventClipping:
-        nearDistance = std::max(nearDistance, MinimumNearPlaneDistance);
-        break;
-            
-    case Geometry::ZeroExtent:
-        nearDistance = std::max(nearDistance * 0.98f, MinimumNearDistance);
-        farDistance = farDistance * 1.02f;
-        break;
-    }
-    
-    // ...but make sure that the near plane of the view frustum doesn't
-    // intersect the object's geometry. Note that if nearDistance is greater
-    // farDistance, it means that the object lies outside the view frustum.
-    nearDistance *= nearAdjust;
-
-    bool intersectsFrustum = m_viewFrustum.intersects(BoundingSphere<float>(cameraSpacePosition, boundingRadius));
-
-    // Objects that lie outside the frustum and don't cast shadows don't contribute to the
-    // final scene. They'll be culled eventually, but we can take of them early here. However,
-    // enabling this test causes problems right now with disappearing visualizers when ordinary
-    // objects are in view.
-    /*
-    if (!intersectsFrustum && !geometry->isShadowCaster())
-    {
-        return;
-    }
-    */
-
-    // Add entities in front of the camera to the list of visible items
-    if (farDistance > 0 && nearDistance < farDistance)
-    {
-        VisibleItem visibleItem;
-        visibleItem.entity = entity;
-        visibleItem.geometry = geometry;
-        visibleItem.position = position;
-        visibleItem.cameraRelativePosition = cameraRelativePosition;
-        visibleItem.orientation = orientation;
-        visibleItem.boundingRadius = boundingRadius;
-        visibleItem.nearDistance = nearDistance;
-        visibleItem.farDistance = farDistance;
-        visibleItem.outsideFrustum = !intersectsFrustum;
-
-        if (geometry->clippingPolicy() == Geometry::SplitToPreventClipping)
-        {
-            m_splittableItems.push_back(visibleItem);
-        }
-        else
-        {
-            m_visibleItems.push_back(visibleItem);
-        }
-    }
-}
-
-
 /** Render six views into the faces of a cube map from the specified position. The views are pointed
   * along the universal coordinate system axes, though this can be modified by passing something
   * other than identity for the rotation.
@@ -1240,12 +1188,20 @@ UniverseRenderer::addVisibleItem(const Entity* entity,
   * is 'distant', i.e. at a much farther away than the size of the reflecting geometry. The nearDistance
   * can be set to a value greater than the minimum in order to automatically cull nearby objects.
   *
+  * The faces are rendered as views in the current view set, so entity positions are evaluated
+  * only once for all six faces (and are shared with any other views in the set.)
+  *
+  * The faceMask can be used to spread the cost of updating a cube map over several frames:
+  * only faces with their bit set (1 << CubeMapFramebuffer::Face) are redrawn, and the
+  * others are left with their previous contents.
+  *
   * \param lighting the lighting environment for rendering
   * \param position position of the camera
   * \param cubeMap the target cube map framebuffer to draw into
   * \param nearDistance distance to the near clipping plane (defaults to MinimumNearDistance)
   * \param farDistance distance to the far clipping plane (defaults to MaximumFarDistance)
   * \param rotation optional rotation (defaults to identity)
+  * \param faceMask the faces to draw (defaults to all six)
   */
 UniverseRenderer::RenderStatus
 UniverseRenderer::renderCubeMap(const LightingEnvironment* lighting,
@@ -1253,7 +1209,8 @@ UniverseRenderer::renderCubeMap(const LightingEnvironment* lighting,
                                 CubeMapFramebuffer* cubeMap,
                                 double nearDistance,
                                 double farDistance,
-                                const Quaterniond& rotation)
+                                const Quaterniond& rotation,
+                                unsigned int faceMask)
 {
     Viewport viewport(cubeMap->size(), cubeMap->size());
     PlanarProjection cubeFaceProjection = PlanarProjection::CreatePerspectiveLH(float(toRadians(90.0)),
@@ -1261,26 +1218,41 @@ UniverseRenderer::renderCubeMap(const LightingEnvironment* lighting,
                                                                                 static_cast<float>(nearDistance), 
 																				static_cast<float>(farDistance));
 
+    // Labels in cube map faces don't compete for space with labels in the main view
+    counted_ptr<LabelArbiter> labelArbiter(m_renderContext->labelArbiter());
+    m_renderContext->setLabelArbiter(NULL);
+
+    unsigned int cubeMapViewKey = CubeMapViewKeyBase + 8 * m_cubeMapCount++;
+
+    RenderStatus status = RenderOk;
     for (int face = 0; face < 6; ++face)
     {
+        if ((faceMask & (1u << face)) == 0)
+        {
+            continue;
+        }
+
         Framebuffer* fb = cubeMap->face(CubeMapFramebuffer::Face(face));
         if (fb)
         {
             fb->bind();
             glDepthMask(GL_TRUE);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            RenderStatus status = renderView(lighting, position, rotation * CubeFaceCameraRotations[face], cubeFaceProjection, viewport, fb);
+            ++m_statistics.cubeMapFaceCount;
+            m_cubeFaceViewKey = cubeMapViewKey + face;
+            status = renderView(lighting, position, rotation * CubeFaceCameraRotations[face], cubeFaceProjection, viewport, fb);
             if (status != RenderOk)
             {
-                Framebuffer::unbind();
-                return status;
+                break;
             }
         }
     }
 
+    m_cubeFaceViewKey = 0;
     Framebuffer::unbind();
+    m_renderContext->setLabelArbiter(labelArbiter.ptr());
 
-    return RenderOk;
+    return status;
 }
 
 
@@ -1297,6 +1269,10 @@ UniverseRenderer::renderShadowCubeMap(const LightingEnvironment* lighting, const
                                                                                 MinimumNearPlaneDistance, MaximumFarPlaneDistance);
 
     m_renderContext->setRendererOutput(RenderContext::CameraDistance);
+    counted_ptr<LabelArbiter> labelArbiter(m_renderContext->labelArbiter());
+    m_renderContext->setLabelArbiter(NULL);
+
+    unsigned int cubeMapViewKey = CubeMapViewKeyBase + 8 * m_cubeMapCount++;
 
     for (int face = 0; face < 6; ++face)
     {
@@ -1306,6 +1282,8 @@ UniverseRenderer::renderShadowCubeMap(const LightingEnvironment* lighting, const
             fb->bind();
             glDepthMask(GL_TRUE);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            ++m_statistics.omniShadowFacesRendered;
+            m_cubeFaceViewKey = cubeMapViewKey + face;
             status = renderView(lighting, position, CubeFaceCameraRotations[face], cubeFaceProjection, viewport, fb);
             if (status != RenderOk)
             {
@@ -1314,7 +1292,9 @@ UniverseRenderer::renderShadowCubeMap(const LightingEnvironment* lighting, const
         }
     }
 
+    m_cubeFaceViewKey = 0;
     Framebuffer::unbind();
+    m_renderContext->setLabelArbiter(labelArbiter.ptr());
     m_renderContext->setRendererOutput(RenderContext::FragmentColor);
 
     return status;
@@ -1479,6 +1459,56 @@ finishShadowRendering(Framebuffer* renderSurface, bool colorMask[])
 
 
 
+// Comparison predicate for sorting visible items in the opaque pass. Opaque items come
+// first, grouped by shadow receiver state (which selects the shader) and then by
+// geometry, so that instances of the same geometry are drawn consecutively. Items that
+// aren't completely opaque (including opaque pass geometry with blended parts, whose
+// appearance depends on what was drawn before it) are drawn afterward, in the original
+// back-to-front order.
+class DrawBatchOrder
+{
+public:
+    DrawBatchOrder(const UniverseRenderer::VisibleItemVector& items) :
+        m_items(items)
+    {
+    }
+
+    bool operator()(unsigned int index0, unsigned int index1) const
+    {
+        const Geometry* g0 = m_items[index0].geometry;
+        const Geometry* g1 = m_items[index1].geometry;
+
+        bool opaque0 = g0->isOpaque() && !g0->hasBlendedParts();
+        bool opaque1 = g1->isOpaque() && !g1->hasBlendedParts();
+        if (opaque0 != opaque1)
+        {
+            return opaque0;
+        }
+
+        if (opaque0)
+        {
+            bool receiver0 = g0->isShadowReceiver();
+            bool receiver1 = g1->isShadowReceiver();
+            if (receiver0 != receiver1)
+            {
+                return receiver0;
+            }
+
+            if (g0 != g1)
+            {
+                return less<const Geometry*>()(g0, g1);
+            }
+        }
+
+        // Items are stored front to back
+        return index0 > index1;
+    }
+
+private:
+    const UniverseRenderer::VisibleItemVector& m_items;
+};
+
+
 // Render all of the items in a depth buffer span
 void UniverseRenderer::renderDepthBufferSpan(const DepthBufferSpan& span, const PlanarProjection& projection)
 {
@@ -1536,13 +1566,38 @@ void UniverseRenderer::renderDepthBufferSpan(const DepthBufferSpan& span, const
     {
         m_renderContext->setPass(pass == 0 ? RenderContext::OpaquePass : RenderContext::TranslucentPass);
 
-        // Draw all items in the span
+        // Text (mostly labels) is collected and drawn together. In the opaque pass,
+        // depth testing hides text behind opaque items whatever the drawing order.
+        // In the translucent pass, the text collected so far is drawn before each
+        // item that isn't a label or marker, so that blended items in front of
+        // text still cover it as they would without batching.
+        m_renderContext->beginTextBatch();
+
+        // Translucent items are drawn back to front. The order of opaque items doesn't
+        // matter, so they're grouped to minimize shader and material changes.
+        m_drawOrder.clear();
         for (unsigned int i = 0; i < span.itemCount; i++)
         {
-            const VisibleItem& item = m_visibleItems[span.backItemIndex - i];
+            m_drawOrder.push_back(span.backItemIndex - i);
+        }
+
+        if (pass == 0 && m_stateCacheEnabled)
+        {
+            sort(m_drawOrder.begin(), m_drawOrder.end(), DrawBatchOrder(m_visibleItems));
+        }
+
+        // Draw all items in the span
+        for (unsigned int i = 0; i < m_drawOrder.size(); i++)
+        {
+            const VisibleItem& item = m_visibleItems[m_drawOrder[i]];
 
             if (pass == 0 || !item.geometry->isOpaque())
             {
+                if (pass == 1 && !item.geometry->hasFixedApparentSize())
+                {
+                    m_renderContext->flushTextBatch();
+                }
+
                 if (shadowsOn && item.geometry->isShadowReceiver())
                 {
                     m_renderContext->setShadowMapCount(1);
@@ -1589,10 +1644,16 @@ void UniverseRenderer::renderDepthBufferSpan(const DepthBufferSpan& span, const
             {
                 if (pass == 0 || !item.geometry->isOpaque())
                 {
+                    if (pass == 1 && !item.geometry->hasFixedApparentSize())
+                    {
+                        m_renderContext->flushTextBatch();
+                    }
                     drawItem(item);
                 }
             }
         }
+
+        m_renderContext->endTextBatch();
     }
 }
 
@@ -1651,9 +1712,6 @@ UniverseRenderer::renderDepthBufferSpanShadows(unsigned int shadowIndex,
         return false;
     }
 
-    glDepthRange(0.0f, 1.0f);
-    beginShadowRendering();
-
     Vector3f shadowGroupCenter = shadowReceiverBounds.center();
     float shadowGroupBoundingRadius = shadowReceiverBounds.radius();
 
@@ -1662,40 +1720,78 @@ UniverseRenderer::renderDepthBufferSpanShadows(unsigned int shadowIndex,
     // light source direction is effectively constant.
     Vector3f lightDirection = (lightPosition + shadowGroupCenter.cast<double>()).cast<float>().normalized();
 
-    // Compute the shadow transform, which will convert coordinates from "shadow group space" to
-    // shadow space. Shadow group space has axes aligned with world space but has an origin located
-    // at the center of the collection of mutually shadowing objects.
-    Matrix4f invCameraTransform = m_renderContext->modelview().matrix().transpose();
-    Matrix4f shadowTransform = setupShadowRendering(m_shadowMaps[shadowIndex].ptr(), lightDirection, shadowGroupBoundingRadius);
-    shadowTransform = shadowTransform * Transform3f(Translation3f(-shadowGroupCenter)).matrix() * invCameraTransform;
-
-    // Render shadows for all casters
+    // Describe what will be drawn into the shadow map. Caster positions are relative to
+    // the shadow group center, so the description is unchanged when only the camera moves.
+    ShadowMapCache::Signature& signature = m_shadowMapCache->pendingSignature();
+    signature.clear();
+    signature.setProjection(lightDirection, shadowGroupBoundingRadius);
     for (unsigned int i = 0; i < span.itemCount; ++i)
     {
         const VisibleItem& item = m_visibleItems[span.backItemIndex - i];
         const Geometry* geometry = item.geometry;
-
-        // Note that shadows of ellipsoidal bodies are handled specially by the eclipse shadow code
         if (geometry->isShadowCaster() && !geometry->isEllipsoidal())
         {
-            Vector3f itemPosition = item.cameraRelativePosition.cast<float>();
-            m_renderContext->pushModelView();
-            m_renderContext->translateModelView(itemPosition - shadowGroupCenter);
-            m_renderContext->rotateModelView(item.orientation);
-            item.geometry->renderShadow(*m_renderContext, m_currentTime);
-            m_renderContext->popModelView();
+            signature.addCaster(geometry, item.cameraRelativePosition.cast<float>() - shadowGroupCenter, item.orientation, m_currentTime);
         }
     }
 
-    // Pop the matrices pushed in setupShadowRendering()
-    m_renderContext->popProjection();
-    m_renderContext->popModelView();
+    // The shadow transform converts coordinates from "shadow group space" to shadow space.
+    // Shadow group space has axes aligned with world space but has an origin located at the
+    // center of the collection of mutually shadowing objects.
+    Matrix4f invCameraTransform = m_renderContext->modelview().matrix().transpose();
+
+    // Only redraw the shadow map when something has moved by a visible fraction of a
+    // shadow map texel. Otherwise, the previous contents are reprojected by recomputing
+    // the shadow transform for the current camera position.
+    Framebuffer* shadowMap = m_shadowMaps[shadowIndex].ptr();
+    float texelSize = 2.0f * shadowGroupBoundingRadius / float(shadowMap->width());
+    if (m_shadowMapCache->shadowMap(shadowIndex).matches(signature, ShadowMapReuseTolerance * texelSize, 0.0f))
+    {
+        ++m_statistics.shadowMapsReused;
+    }
+    else
+    {
+        glDepthRange(0.0f, 1.0f);
+        beginShadowRendering();
+
+        Matrix4f shadowMatrix = setupShadowRendering(shadowMap, lightDirection, shadowGroupBoundingRadius);
+
+        // Render shadows for all casters
+        for (unsigned int i = 0; i < span.itemCount; ++i)
+        {
+            const VisibleItem& item = m_visibleItems[span.backItemIndex - i];
+            const Geometry* geometry = item.geometry;
+
+            // Note that shadows of ellipsoidal bodies are handled specially by the eclipse shadow code
+            if (geometry->isShadowCaster() && !geometry->isEllipsoidal())
+            {
+                Vector3f itemPosition = item.cameraRelativePosition.cast<float>();
+                m_renderContext->pushModelView();
+                m_renderContext->translateModelView(itemPosition - shadowGroupCenter);
+                m_renderContext->rotateModelView(item.orientation);
+                item.geometry->renderShadow(*m_renderContext, m_currentTime);
+                m_renderContext->popModelView();
+            }
+        }
 
-    finishShadowRendering(m_renderSurface.ptr(), m_renderColorMask);
+        // Pop the matrices pushed in setupShadowRendering()
+        m_renderContext->popProjection();
+        m_renderContext->popModelView();
 
-    // Reset the viewport
-    glDepthRange(m_depthRangeFront, m_depthRangeBack);
-    glViewport(m_renderViewport.x(), m_renderViewport.y(), m_renderViewport.width(), m_renderViewport.height());
+        finishShadowRendering(m_renderSurface.ptr(), m_renderColorMask);
+
+        // Reset the viewport
+        glDepthRange(m_depthRangeFront, m_depthRangeBack);
+        glViewport(m_renderViewport.x(), m_renderViewport.y(), m_renderViewport.width(), m_renderViewport.height());
+
+        m_shadowMapCache->shadowMap(shadowIndex).swap(signature);
+        m_shadowMapCache->setShadowMatrix(shadowIndex, shadowMatrix);
+        ++m_statistics.shadowMapsRendered;
+    }
+
+    Matrix4f shadowTransform = m_shadowMapCache->shadowMatrix(shadowIndex) *
+                               Transform3f(Translation3f(-shadowGroupCenter)).matrix() *
+                               invCameraTransform;
 
     // Set shadow state in the render context
     m_renderContext->setShadowMapMatrix(shadowIndex, shadowTransform);
@@ -1753,97 +1849,140 @@ UniverseRenderer::renderDepthBufferSpanOmniShadows(unsigned int shadowIndex,
         return false;
     }
 
-    // Set up the view port (same for all faces)
-    glViewport(0, 0, m_omniShadowMaps[shadowIndex]->size(), m_omniShadowMaps[shadowIndex]->size());
-    glDepthRange(0.0f, 1.0f);
-
-    // Set up cube map shadow rendering
-    // When rendering to cube faces, we use a left-handed projection, so reverse the triangles (GL_CW)
-    // Also, tell the renderer to output camera distance instead of color
-    beginCubicShadowRendering();
-    glFrontFace(GL_CW);
-    m_renderContext->setRendererOutput(RenderContext::CameraDistance);
-
-    // Pixel distance is stored in the red channel; clear it to a very large value
-    glClearColor(1.0e15f, 0.0f, 0.0f, 0.0f);
+    CubeMapFramebuffer* shadowMap = m_omniShadowMaps[shadowIndex].ptr();
+    PlanarProjection faceProjection = PlanarProjection::CreatePerspectiveLH(float(toRadians(90.0)), 1.0f, light->range() * 0.0001f, light->range());
+    Frustum faceFrustum = faceProjection.frustum();
 
-    m_renderContext->pushProjection();
-
-    // Draw each face of the cube map. Frustum cull objects to avoid unnecessary
-    // redrawing.
+    // Find the faces of the cube map that need to be redrawn. A face is reused when the
+    // casters that it contains haven't moved relative to the light by a visible fraction
+    // of a texel. Texels on a 90 degree cube face span about 2d/size at distance d.
+    float texelAngle = 2.0f / float(shadowMap->size());
+    unsigned int redrawFaces = 0;
     for (int face = 0; face < 6; ++face)
     {
-        Framebuffer* fb = m_omniShadowMaps[shadowIndex]->face(CubeMapFramebuffer::Face(face));
-        if (fb)
+        Matrix3f toCameraSpace = CubeFaceCameraRotations[face].cast<float>().conjugate().toRotationMatrix();
+
+        ShadowMapCache::Signature& signature = m_shadowMapCache->pendingSignature();
+        signature.clear();
+        signature.setProjection(Vector3f::Zero(), light->range());
+        for (unsigned int i = 0; i < span.itemCount; ++i)
         {
-            fb->bind();
-            glDepthMask(GL_TRUE);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glDisable(GL_BLEND);
+            const VisibleItem& item = m_visibleItems[span.backItemIndex - i];
+            const Geometry* geometry = item.geometry;
+            if (geometry->isShadowCaster() && !geometry->isEllipsoidal())
+            {
+                Vector3f itemPosition = (item.cameraRelativePosition - lightPosition).cast<float>();
+                if (faceFrustum.intersects(BoundingSphere<float>(toCameraSpace * itemPosition, light->range())))
+                {
+                    signature.addCaster(geometry, itemPosition, item.orientation, m_currentTime);
+                }
+            }
+        }
 
-            Quaternionf cameraOrientation = CubeFaceCameraRotations[face].cast<float>();
-            Matrix3f toCameraSpace = cameraOrientation.conjugate().toRotationMatrix();
+        ShadowMapCache::Signature& faceSignature = m_shadowMapCache->omniShadowMapFace(shadowIndex, face);
+        if (faceSignature.matches(signature, 0.0f, ShadowMapReuseTolerance * texelAngle))
+        {
+            ++m_statistics.omniShadowFacesReused;
+        }
+        else
+        {
+            faceSignature.swap(signature);
+            redrawFaces |= 1u << face;
+        }
+    }
 
-            // Set the camera transformation
-            m_renderContext->pushModelView();
-            m_renderContext->setModelView(Matrix4f::Identity());
-            m_renderContext->rotateModelView(cameraOrientation.conjugate().cast<float>());
+    if (redrawFaces != 0)
+    {
+        // Set up the view port (same for all faces)
+        glViewport(0, 0, shadowMap->size(), shadowMap->size());
+        glDepthRange(0.0f, 1.0f);
 
-            // The camera orientation is stored separately; save it so that we can restore
-            // it after rendering all faces.
-            Quaternionf savedCamera = m_renderContext->cameraOrientation();
-            m_renderContext->setCameraOrientation(cameraOrientation);
+        // Set up cube map shadow rendering
+        // When rendering to cube faces, we use a left-handed projection, so reverse the triangles (GL_CW)
+        // Also, tell the renderer to output camera distance instead of color
+        beginCubicShadowRendering();
+        glFrontFace(GL_CW);
+        m_renderContext->setRendererOutput(RenderContext::CameraDistance);
 
-            PlanarProjection faceProjection = PlanarProjection::CreatePerspectiveLH(float(toRadians(90.0)), 1.0f, light->range() * 0.0001f, light->range());
-            Frustum faceFrustum = faceProjection.frustum();
+        // Pixel distance is stored in the red channel; clear it to a very large value
+        glClearColor(1.0e15f, 0.0f, 0.0f, 0.0f);
 
-            m_renderContext->setProjection(faceProjection);
+        m_renderContext->pushProjection();
 
-            // Render shadows for all casters
-            for (unsigned int i = 0; i < span.itemCount; ++i)
+        // Draw each face of the cube map that changed. Frustum cull objects to avoid
+        // unnecessary redrawing.
+        for (int face = 0; face < 6; ++face)
+        {
+            Framebuffer* fb = shadowMap->face(CubeMapFramebuffer::Face(face));
+            if (fb && (redrawFaces & (1u << face)) != 0)
             {
-                const VisibleItem& item = m_visibleItems[span.backItemIndex - i];
-                const Geometry* geometry = item.geometry;
+                fb->bind();
+                glDepthMask(GL_TRUE);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glDisable(GL_BLEND);
+                ++m_statistics.omniShadowFacesRendered;
+
+                Quaternionf cameraOrientation = CubeFaceCameraRotations[face].cast<float>();
+                Matrix3f toCameraSpace = cameraOrientation.conjugate().toRotationMatrix();
+
+                // Set the camera transformation
+                m_renderContext->pushModelView();
+                m_renderContext->setModelView(Matrix4f::Identity());
+                m_renderContext->rotateModelView(cameraOrientation.conjugate().cast<float>());
 
-                // Note that shadows of ellipsoidal bodies are handled specially by the eclipse shadow code
-                if (geometry->isShadowCaster() && !geometry->isEllipsoidal())
+                // The camera orientation is stored separately; save it so that we can restore
+                // it after rendering all faces.
+                Quaternionf savedCamera = m_renderContext->cameraOrientation();
+                m_renderContext->setCameraOrientation(cameraOrientation);
+
+                m_renderContext->setProjection(faceProjection);
+
+                // Render shadows for all casters
+                for (unsigned int i = 0; i < span.itemCount; ++i)
                 {
-                    Vector3f itemPosition = (item.cameraRelativePosition - lightPosition).cast<float>();
-                    Vector3f cameraSpacePosition = toCameraSpace * itemPosition;
+                    const VisibleItem& item = m_visibleItems[span.backItemIndex - i];
+                    const Geometry* geometry = item.geometry;
 
-                    // Test object bounding sphere against cube face frustum
-                    if (faceFrustum.intersects(BoundingSphere<float>(cameraSpacePosition, light->range())))
+                    // Note that shadows of ellipsoidal bodies are handled specially by the eclipse shadow code
+                    if (geometry->isShadowCaster() && !geometry->isEllipsoidal())
                     {
-                        m_renderContext->pushModelView();
-                        m_renderContext->translateModelView(itemPosition);
-                        m_renderContext->rotateModelView(item.orientation);
-                        item.geometry->renderShadow(*m_renderContext, m_currentTime);
-                        m_renderContext->popModelView();
+                        Vector3f itemPosition = (item.cameraRelativePosition - lightPosition).cast<float>();
+                        Vector3f cameraSpacePosition = toCameraSpace * itemPosition;
+
+                        // Test object bounding sphere against cube face frustum
+                        if (faceFrustum.intersects(BoundingSphere<float>(cameraSpacePosition, light->range())))
+                        {
+                            m_renderContext->pushModelView();
+                            m_renderContext->translateModelView(itemPosition);
+                            m_renderContext->rotateModelView(item.orientation);
+                            item.geometry->renderShadow(*m_renderContext, m_currentTime);
+                            m_renderContext->popModelView();
+                        }
                     }
                 }
-            }
 
-            m_renderContext->popModelView();
-            m_renderContext->setCameraOrientation(savedCamera);
+                m_renderContext->popModelView();
+                m_renderContext->setCameraOrientation(savedCamera);
+            }
         }
-    }
 
-    m_renderContext->popProjection();
+        m_renderContext->popProjection();
 
-    // Restore normal renderer operation
-    m_renderContext->setRendererOutput(RenderContext::FragmentColor);
-    finishShadowRendering(m_renderSurface.ptr(), m_renderColorMask);
-    glFrontFace(GL_CCW);
+        // Restore normal renderer operation
+        m_renderContext->setRendererOutput(RenderContext::FragmentColor);
+        finishShadowRendering(m_renderSurface.ptr(), m_renderColorMask);
+        glFrontFace(GL_CCW);
 
-    // Reset the viewport
-    glDepthRange(m_depthRangeFront, m_depthRangeBack);
-    glViewport(m_renderViewport.x(), m_renderViewport.y(), m_renderViewport.width(), m_renderViewport.height());
+        // Reset the viewport
+        glDepthRange(m_depthRangeFront, m_depthRangeBack);
+        glViewport(m_renderViewport.x(), m_renderViewport.y(), m_renderViewport.width(), m_renderViewport.height());
 
-    // Set shadow state in the render context
-    m_renderContext->setOmniShadowMap(shadowIndex, m_omniShadowMaps[shadowIndex]->colorTexture());
+        // Restore clear color to black
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    }
 
-    // Restore clear color to black
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    // Set shadow state in the render context
+    m_renderContext->setOmniShadowMap(shadowIndex, shadowMap->colorTexture());
 
     return true;
 }
@@ -2177,6 +2316,19 @@ UniverseRenderer::setDefaultFont(TextureFont* font)
 }
 
 
+/** Set the label arbiter that decides which labels are shown when labels
+  * overlap. The renderer submits label requests to the arbiter while drawing
+  * the views of a view set, but the caller is responsible for calling
+  * LabelArbiter::beginFrame() and LabelArbiter::endFrame() around the view set.
+  * Labels drawn into cube maps aren't arbitrated.
+  */
+void
+UniverseRenderer::setLabelArbiter(LabelArbiter* arbiter)
+{
+    m_labelArbiter = arbiter;
+}
+
+
 /** Create a glare overlay. An overlay may only be created after the
   * renderer has been initialized. This method returns NULL if there was
   * an error creating the overlay.
@@ -29,8 +29,11 @@ class RenderContext;
 class Framebuffer;
 class CubeMapFramebuffer;
 class EclipseShadowVolumeSet;
+class VisibilitySet;
+class ShadowMapCache;
 class TextureFont;
 class GlareOverlay;
+class LabelArbiter;
 
 /** UniverseRenderer draws views of a VESTA Universe using a 3D rendering
   * library. Views are drawn as sets at a particular time. A typical usage
@@ -78,6 +81,10 @@ public:
     static const unsigned int MaxShadowMaps     = 3;
     static const unsigned int MaxOmniShadowMaps = 3;
 
+    /** Face mask for renderCubeMap() that selects all six faces of a cube map.
+      */
+    static const unsigned int AllCubeMapFaces = 0x3f;
+
     RenderStatus beginViewSet(const Universe* universe, double t);
     RenderStatus endViewSet();
 
@@ -101,7 +108,8 @@ public:
                                CubeMapFramebuffer* cubeMap,
                                double nearDistance = MinimumNearDistance,
                                double farDistance = MaximumFarDistance,
-                               const Eigen::Quaterniond& rotation = Eigen::Quaterniond::Identity());
+                               const Eigen::Quaterniond& rotation = Eigen::Quaterniond::Identity(),
+                               unsigned int faceMask = AllCubeMapFaces);
     RenderStatus renderShadowCubeMap(const LightingEnvironment* lighting,
                                      const Eigen::Vector3d& cameraPosition,
                                      CubeMapFramebuffer* cubeMap);
@@ -156,9 +164,28 @@ public:
     }
     void setSkyLayersEnabled(bool enable);
 
+    /** Return true if redundant state changes are skipped and opaque items are
+      * grouped to reduce state changes. The state cache is on by default.
+      */
+    bool stateCacheEnabled() const
+    {
+        return m_stateCacheEnabled;
+    }
+    void setStateCacheEnabled(bool enable);
+
     TextureFont* defaultFont() const;
     void setDefaultFont(TextureFont* font);
 
+    /** Get the label arbiter used to resolve overlapping labels, or null if
+      * labels are never hidden because of overlap.
+      */
+    LabelArbiter* labelArbiter() const
+    {
+        return m_labelArbiter.ptr();
+    }
+
+    void setLabelArbiter(LabelArbiter* arbiter);
+
     void setDefaultSunEnabled(bool enabled);
 
     /** Return whether the default sun light source is enabled.
@@ -172,6 +199,40 @@ public:
 
     GlareOverlay* createGlareOverlay();
 
+    /** Counts of the expensive rendering operations performed since the statistics
+      * were last reset. cubeMapFaceCount counts only the faces of reflection cube
+      * maps; faces of omnidirectional shadow maps are counted in omniShadowFacesRendered.
+      * Shadow maps and shadow cube faces are counted separately from the ones that
+      * were reused because nothing visible had changed. The
+      * draw call and state change counts are collected from the render context at
+      * the end of each view set.
+      */
+    struct RenderStatistics
+    {
+        RenderStatistics();
+
+        unsigned int viewCount;
+        unsigned int cubeMapFaceCount;
+        unsigned int shadowMapsRendered;
+        unsigned int shadowMapsReused;
+        unsigned int omniShadowFacesRendered;
+        unsigned int omniShadowFacesReused;
+        unsigned int drawCallCount;
+        unsigned int materialUpdateCount;
+        unsigned int materialUpdatesSkipped;
+        unsigned int arrayStateChangeCount;
+        unsigned int arrayStateChangesSkipped;
+    };
+
+    /** Get the render statistics accumulated since the last call to resetStatistics().
+      */
+    const RenderStatistics& statistics() const
+    {
+        return m_statistics;
+    }
+
+    void resetStatistics();
+
 public:
     struct VisibleItem
     {
@@ -237,13 +298,6 @@ private:
                                           const LightSource* light,
                                           const Eigen::Vector3d& lightPosition);
     void setupEclipseShadows(const VisibleItem& item);
-    void addVisibleItem(const Entity* entity,
-                        const Geometry* geometry,
-                        const Eigen::Vector3d& position,
-                        const Eigen::Vector3d& cameraRelativePosition,
-                        const Eigen::Vector3f& cameraSpacePosition,
-                        const Eigen::Quaternionf& orientation,
-                        float nearAdjust);
     void drawItem(const VisibleItem& item);
     Eigen::Matrix4f setupShadowRendering(const Framebuffer* shadowMap,
                                          const Eigen::Vector3f& lightDirection,
@@ -259,6 +313,7 @@ private:
 
     VisibleItemVector m_visibleItems;
     VisibleItemVector m_splittableItems;
+    std::vector<unsigned int> m_drawOrder;
     std::vector<DepthBufferSpan> m_depthBufferSpans;
     std::vector<DepthBufferSpan> m_mergedDepthBufferSpans;
     std::vector<LightSourceItem> m_lightSources;
@@ -288,10 +343,20 @@ private:
     counted_ptr<LightSource> m_sun;
 
     counted_ptr<EclipseShadowVolumeSet> m_eclipseShadows;
+    counted_ptr<VisibilitySet> m_visibilitySet;
+    counted_ptr<ShadowMapCache> m_shadowMapCache;
+    RenderStatistics m_statistics;
 
     bool m_viewIndependentInitializationRequired;
 
+    // Counters used to give each view in a view set its own key
+    unsigned int m_viewCount;
+    unsigned int m_cubeMapCount;
+    unsigned int m_cubeFaceViewKey;
+    bool m_stateCacheEnabled;
+
     counted_ptr<TextureFont> m_defaultFont;
+    counted_ptr<LabelArbiter> m_labelArbiter;
     PlanarProjection m_lastProjection;
 };
 
@@ -22,6 +22,13 @@ using namespace Eigen;
 using namespace std;
 
 
+// Maximum number of tiles for which clipped geometry is cached
+static const unsigned int MaxCachedTiles = 512;
+
+// Maximum number of children of an R-tree node
+static const unsigned int IndexNodeCapacity = 16;
+
+
 enum
 {
     OutWest  = 0x1,
@@ -129,7 +136,8 @@ computeExtrema(const GreatCircleArc& arc)
 }
 
 
-VectorMapLayer::VectorMapLayer()
+VectorMapLayer::VectorMapLayer() :
+    m_indexValid(false)
 {
 }
 
@@ -174,25 +182,22 @@ drawGreatCircleArc(const Vector3f& v0, const Vector3f& v1, unsigned int subdivis
 
 
 static void
-drawConstantBearingArc(float lon0, float lat0, float lon1, float lat1, unsigned int subdivision)
+constantBearingArc(float lon0, float lat0, float lon1, float lat1, unsigned int subdivision, MapElementGeometry* geometry)
 {
-#ifndef VESTA_OGLES2
     float d = 1.0f / subdivision;
     float dlat = lat1 - lat0;
     float dlon = lon1 - lon0;
 
-    glBegin(GL_LINE_STRIP);
+    geometry->begin(MapElementGeometry::LineStrip);
     for (unsigned int i = 0; i < subdivision; ++i)
     {
         float t = i * d;
         float lat = lat0 + dlat * t;
         float lon = lon0 + dlon * t;
         float cosLat = cos(lat);
-        glVertex3f(cos(lon) * cosLat, sin(lon) * cosLat, sin(lat));
+        geometry->addVertex(Vector3f(cos(lon) * cosLat, sin(lon) * cosLat, sin(lat)));
     }
-    glVertex3f(cos(lon1) * cos(lat1), sin(lon1) * cos(lat1), sin(lat1));
-    glEnd();
-#endif
+    geometry->addVertex(Vector3f(cos(lon1) * cos(lat1), sin(lon1) * cos(lat1), sin(lat1)));
 }
 
 
@@ -223,7 +228,7 @@ drawGreatCircleArcUniform(const Vector3f& v0, const Vector3f& v1)
 }
 
 
-static void clippedLine(const SpherePatch& box, const Vector2f& p0, const Vector2f& p1)
+static void clippedLine(const SpherePatch& box, const Vector2f& p0, const Vector2f& p1, MapElementGeometry* geometry)
 {
     bool done = false;
     unsigned int out0 = computeOutcode(box, p0);
@@ -314,7 +319,7 @@ static void clippedLine(const SpherePatch& box, const Vector2f& p0, const Vector
 #if GREAT_CIRCLE
         drawGreatCircleArc(v0, v1);
 #else
-        drawConstantBearingArc(r0.x(), r0.y(), r1.x(), r1.y(), subdivision);
+        constantBearingArc(r0.x(), r0.y(), r1.x(), r1.y(), subdivision, geometry);
 #endif
     }
 }
@@ -324,6 +329,11 @@ void
 VectorMapLayer::addElement(MapElement* e)
 {
     m_elements.push_back(counted_ptr<MapElement>(e));
+
+    // The index and any cached tile geometry are now out of date
+    m_indexValid = false;
+    m_tileCache.clear();
+    m_tileCacheIndex.clear();
 }
 
 
@@ -331,6 +341,12 @@ void
 VectorMapLayer::renderTile(RenderContext& rc, const WorldGeometry* /* world */, const QuadtreeTile* tile) const
 {
 #ifndef VESTA_OGLES2
+    const TileGeometry& tileGeom = tileGeometry(tile);
+    if (tileGeom.elementIndices.empty())
+    {
+        return;
+    }
+
     rc.setVertexInfo(VertexSpec::PositionColor);
 
     Material simpleMaterial;
@@ -338,6 +354,72 @@ VectorMapLayer::renderTile(RenderContext& rc, const WorldGeometry* /* world */,
     simpleMaterial.setOpacity(1.0f);
     rc.bindMaterial(&simpleMaterial);
 
+    for (unsigned int i = 0; i < tileGeom.elementIndices.size(); ++i)
+    {
+        const MapElement* element = m_elements[tileGeom.elementIndices[i]].ptr();
+
+        Spectrum color = element->color();
+        glColor4f(color.red(), color.green(), color.blue(), element->opacity());
+
+        if (element->opacity() < 1.0f)
+        {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        else
+        {
+            glDisable(GL_BLEND);
+        }
+
+        tileGeom.geometry[i].render();
+    }
+
+    glDisable(GL_BLEND);
+#endif
+}
+
+
+// Get the clipped geometry of all elements overlapping a tile, either from the
+// cache or by clipping the elements found in the spatial index.
+const VectorMapLayer::TileGeometry&
+VectorMapLayer::tileGeometry(const QuadtreeTile* tile) const
+{
+    TileAddress address;
+    address.level = tile->level();
+    address.column = tile->column();
+    address.row = tile->row();
+
+    std::map<TileAddress, TileGeometryList::iterator>::iterator cacheIter = m_tileCacheIndex.find(address);
+    if (cacheIter != m_tileCacheIndex.end())
+    {
+        // Move the tile to the front of the LRU list
+        m_tileCache.splice(m_tileCache.begin(), m_tileCache, cacheIter->second);
+        return *cacheIter->second;
+    }
+
+    if (!m_indexValid)
+    {
+        m_index.build(m_elements);
+        m_indexValid = true;
+    }
+
+    // Reuse the least recently used entry when the cache is full
+    if (m_tileCache.size() >= MaxCachedTiles)
+    {
+        m_tileCacheIndex.erase(m_tileCache.back().address);
+        m_tileCache.splice(m_tileCache.begin(), m_tileCache, --m_tileCache.end());
+    }
+    else
+    {
+        m_tileCache.push_front(TileGeometry());
+    }
+
+    TileGeometry& tileGeom = m_tileCache.front();
+    tileGeom.address = address;
+    tileGeom.elementIndices.clear();
+    tileGeom.geometry.clear();
+    m_tileCacheIndex[address] = m_tileCache.begin();
+
     float tileArc = float(PI) * tile->extent();
     Vector2f southwest = tile->southwest();
 
@@ -349,47 +431,198 @@ VectorMapLayer::renderTile(RenderContext& rc, const WorldGeometry* /* world */,
 
     AlignedBox<float, 2> bounds(Vector2f(box.west, box.south), Vector2f(box.east, box.north));
 
-    for (vector<counted_ptr<MapElement> >::const_iterator iter = m_elements.begin(); iter != m_elements.end(); ++iter)
+    vector<unsigned int> candidates;
+    m_index.query(bounds, &candidates);
+
+    for (vector<unsigned int>::const_iterator iter = candidates.begin(); iter != candidates.end(); ++iter)
     {
-        const MapElement* element = iter->ptr();
-        bool tileContainsElement = false;
+        MapElementGeometry geometry;
+        m_elements[*iter]->clip(box.west, box.south, box.east, box.north, &geometry);
+        if (!geometry.isEmpty())
+        {
+            tileGeom.elementIndices.push_back(*iter);
+            tileGeom.geometry.push_back(geometry);
+        }
+    }
+
+    return tileGeom;
+}
+
+
+MapElementIndex::MapElementIndex() :
+    m_root(0)
+{
+}
+
 
-        if (element)
+// Entry used while bulk loading the tree: the bounds of an element or node
+struct IndexEntry
+{
+    float west;
+    float south;
+    float east;
+    float north;
+    unsigned int index;
+
+    float centerX() const { return (west + east) * 0.5f; }
+    float centerY() const { return (south + north) * 0.5f; }
+};
+
+static bool compareCenterX(const IndexEntry& a, const IndexEntry& b)
+{
+    return a.centerX() < b.centerX();
+}
+
+static bool compareCenterY(const IndexEntry& a, const IndexEntry& b)
+{
+    return a.centerY() < b.centerY();
+}
+
+
+/** Rebuild the index for a set of elements. Elements that are null or have empty
+  * bounds aren't added to the index.
+  */
+void
+MapElementIndex::build(const vector<counted_ptr<MapElement> >& elements)
+{
+    m_nodes.clear();
+    m_children.clear();
+    m_root = 0;
+
+    vector<IndexEntry> entries;
+    for (unsigned int i = 0; i < elements.size(); ++i)
+    {
+        const MapElement* element = elements[i].ptr();
+        if (element && !element->bounds().isNull())
+        {
+            // Each element gets a leaf node
+            Node leaf;
+            leaf.west  = element->bounds().min().x();
+            leaf.south = element->bounds().min().y();
+            leaf.east  = element->bounds().max().x();
+            leaf.north = element->bounds().max().y();
+            leaf.firstChild = i;
+            leaf.childCount = 0;
+            leaf.isLeaf = true;
+
+            IndexEntry entry;
+            entry.west = leaf.west;
+            entry.south = leaf.south;
+            entry.east = leaf.east;
+            entry.north = leaf.north;
+            entry.index = m_nodes.size();
+            entries.push_back(entry);
+
+            m_nodes.push_back(leaf);
+        }
+    }
+
+    if (entries.empty())
+    {
+        return;
+    }
+
+    // Build the tree one level at a time, starting from the leaves. At each level,
+    // entries are sorted into vertical slices by x and then packed into nodes by y.
+    while (entries.size() > 1)
+    {
+        unsigned int nodeCount = (entries.size() + IndexNodeCapacity - 1) / IndexNodeCapacity;
+        unsigned int sliceCount = (unsigned int) ceil(sqrt(double(nodeCount)));
+        unsigned int sliceSize = sliceCount * IndexNodeCapacity;
+
+        sort(entries.begin(), entries.end(), compareCenterX);
+
+        vector<IndexEntry> parents;
+        for (unsigned int sliceStart = 0; sliceStart < entries.size(); sliceStart += sliceSize)
         {
-            AlignedBox<float, 2> elementBox = element->bounds();
-            if (!elementBox.isNull())
+            vector<IndexEntry>::iterator sliceEnd = entries.begin() + min((unsigned int) entries.size(), sliceStart + sliceSize);
+            sort(entries.begin() + sliceStart, sliceEnd, compareCenterY);
+
+            for (vector<IndexEntry>::iterator first = entries.begin() + sliceStart; first != sliceEnd; )
             {
-                if (elementBox.min().x() < bounds.max().x() &&
-                    elementBox.max().x() > bounds.min().x() &&
-                    elementBox.min().y() < bounds.max().y() &&
-                    elementBox.max().y() > bounds.min().y())
+                vector<IndexEntry>::iterator last = first + min((unsigned int) (sliceEnd - first), IndexNodeCapacity);
+
+                Node node;
+                node.west = first->west;
+                node.south = first->south;
+                node.east = first->east;
+                node.north = first->north;
+                node.firstChild = m_children.size();
+                node.childCount = last - first;
+                node.isLeaf = false;
+
+                for (vector<IndexEntry>::iterator iter = first; iter != last; ++iter)
                 {
-                    tileContainsElement = true;
+                    node.west  = min(node.west,  iter->west);
+                    node.south = min(node.south, iter->south);
+                    node.east  = max(node.east,  iter->east);
+                    node.north = max(node.north, iter->north);
+                    m_children.push_back(iter->index);
                 }
+
+                IndexEntry parent;
+                parent.west = node.west;
+                parent.south = node.south;
+                parent.east = node.east;
+                parent.north = node.north;
+                parent.index = m_nodes.size();
+                parents.push_back(parent);
+
+                m_nodes.push_back(node);
+                first = last;
             }
         }
 
-        if (tileContainsElement)
-        {
-            Spectrum color = element->color();
-            glColor4f(color.red(), color.green(), color.blue(), element->opacity());
+        entries.swap(parents);
+    }
+
+    m_root = entries.front().index;
+}
 
-            if (element->opacity() < 1.0f)
+
+/** Find all elements with bounds that overlap the specified box. Elements that
+  * only touch the edge of the box aren't included. The element indices are
+  * returned in increasing order, so that elements are drawn in the order in
+  * which they were added.
+  */
+void
+MapElementIndex::query(const AlignedBox<float, 2>& box, vector<unsigned int>* elementIndices) const
+{
+    elementIndices->clear();
+    if (m_nodes.empty())
+    {
+        return;
+    }
+
+    float west = box.min().x();
+    float south = box.min().y();
+    float east = box.max().x();
+    float north = box.max().y();
+
+    vector<unsigned int> stack;
+    stack.push_back(m_root);
+    while (!stack.empty())
+    {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+
+        if (node.west < east && node.east > west && node.south < north && node.north > south)
+        {
+            if (node.isLeaf)
             {
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                elementIndices->push_back(node.firstChild);
             }
             else
             {
-                glDisable(GL_BLEND);
+                for (unsigned int i = node.firstChild; i < node.firstChild + node.childCount; ++i)
+                {
+                    stack.push_back(m_children[i]);
+                }
             }
-
-            element->render(box.west, box.south, box.east, box.north);
         }
     }
 
-    glDisable(GL_BLEND);
-#endif
+    sort(elementIndices->begin(), elementIndices->end());
 }
 
 
@@ -400,13 +633,25 @@ MapElement::MapElement() :
 }
 
 
+/** Draw the part of this element that lies within a longitude/latitude
+  * rectangle.
+  */
+void
+MapElement::render(float west, float south, float east, float north) const
+{
+    MapElementGeometry geometry;
+    clip(west, south, east, north, &geometry);
+    geometry.render();
+}
+
+
 MapLineString::MapLineString()
 {
 }
 
 
 void
-MapLineString::render(float west, float south, float east, float north) const
+MapLineString::clip(float west, float south, float east, float north, MapElementGeometry* geometry) const
 {
     SpherePatch box;
     box.west = west;
@@ -421,7 +666,7 @@ MapLineString::render(float west, float south, float east, float north) const
             Vector3f p0 = m_points.at(i - 1);
             Vector3f p1 = m_points.at(i);
 
-            clippedLine(box, p0.start<2>(), p1.start<2>());
+            clippedLine(box, p0.start<2>(), p1.start<2>(), geometry);
         }
     }
 }
@@ -457,25 +702,24 @@ MapPolygon::MapPolygon(MapLineString* border) :
 
 
 void
-MapPolygon::render(float west, float south, float east, float north) const
+MapPolygon::clip(float /* west */, float /* south */, float /* east */, float /* north */, MapElementGeometry* geometry) const
 {
-#ifndef VESTA_OGLES2
     if (m_border.isNull())
     {
         return;
     }
 
+    // Polygons aren't clipped; the complete polygon is generated for every tile
+    // that it overlaps.
     if (m_border->points().size() >= 3)
     {
-        glBegin(GL_POLYGON);
+        geometry->begin(MapElementGeometry::Polygon);
         for (unsigned int i = 0; i < m_border->points().size(); ++i)
         {
             Vector3f p = m_border->points().at(i);
-            glVertex3fv(sphToCart(p.x(), p.y()).data());
+            geometry->addVertex(sphToCart(p.x(), p.y()));
         }
-        glEnd();
     }
-#endif
 }
 
 
@@ -496,3 +740,40 @@ MapPolygon::setBorder(MapLineString* border)
     }
 }
 
+
+/** Start a new run of vertices.
+  */
+void
+MapElementGeometry::begin(PrimitiveType type)
+{
+    Run run;
+    run.type = type;
+    run.start = m_vertices.size();
+    run.count = 0;
+    m_runs.push_back(run);
+}
+
+
+void
+MapElementGeometry::clear()
+{
+    m_vertices.clear();
+    m_runs.clear();
+}
+
+
+void
+MapElementGeometry::render() const
+{
+#ifndef VESTA_OGLES2
+    for (vector<Run>::const_iterator iter = m_runs.begin(); iter != m_runs.end(); ++iter)
+    {
+        glBegin(iter->type == Polygon ? GL_POLYGON : GL_LINE_STRIP);
+        for (unsigned int i = iter->start; i < iter->start + iter->count; ++i)
+        {
+            glVertex3fv(m_vertices[i].data());
+        }
+        glEnd();
+    }
+#endif
+}
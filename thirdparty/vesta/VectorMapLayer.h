@@ -16,11 +16,69 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <vector>
+#include <list>
+#include <map>
 
 
 namespace vesta
 {
 
+/** MapElementGeometry holds the vertices generated for a map element: a sequence
+  * of runs, each of which is drawn as a single primitive. Vertices are points
+  * on the unit sphere.
+  */
+class MapElementGeometry
+{
+public:
+    enum PrimitiveType
+    {
+        LineStrip,
+        Polygon
+    };
+
+    void begin(PrimitiveType type);
+
+    void addVertex(const Eigen::Vector3f& v)
+    {
+        m_vertices.push_back(v);
+        m_runs.back().count++;
+    }
+
+    bool isEmpty() const
+    {
+        return m_runs.empty();
+    }
+
+    /** Get the number of runs of vertices.
+      */
+    unsigned int runCount() const
+    {
+        return m_runs.size();
+    }
+
+    /** Get the vertices of all runs.
+      */
+    const std::vector<Eigen::Vector3f>& vertices() const
+    {
+        return m_vertices;
+    }
+
+    void clear();
+    void render() const;
+
+private:
+    struct Run
+    {
+        PrimitiveType type;
+        unsigned int start;
+        unsigned int count;
+    };
+
+    std::vector<Eigen::Vector3f> m_vertices;
+    std::vector<Run> m_runs;
+};
+
+
 class MapElement : public Object
 {
 public:
@@ -49,7 +107,12 @@ public:
         m_opacity = opacity;
     }
 
-    virtual void render(float west, float south, float east, float north) const = 0;
+    /** Generate the geometry for the part of this element that lies within
+      * a longitude/latitude rectangle. Coordinates are in radians.
+      */
+    virtual void clip(float west, float south, float east, float north, MapElementGeometry* geometry) const = 0;
+
+    void render(float west, float south, float east, float north) const;
 
     Eigen::AlignedBox<float, 2> bounds() const
     {
@@ -76,7 +139,7 @@ public:
 
     MapLineString();
 
-    virtual void render(float west, float south, float east, float north) const;
+    virtual void clip(float west, float south, float east, float north, MapElementGeometry* geometry) const;
 
     void addPoint(const Eigen::Vector3f& p);
     const std::vector<Eigen::Vector3f>& points() const;
@@ -102,15 +165,52 @@ public:
 
     void setBorder(MapLineString* border);
 
-    virtual void render(float west, float south, float east, float north) const;
+    virtual void clip(float west, float south, float east, float north, MapElementGeometry* geometry) const;
 
 private:
     counted_ptr<MapLineString> m_border;
 };
 
 
+/** MapElementIndex is an R-tree over the longitude/latitude bounds of a set of map
+  * elements. The tree is static: it's bulk loaded from the complete set of elements
+  * (using the sort-tile-recursive algorithm) and must be rebuilt when elements
+  * are added.
+  */
+class MapElementIndex
+{
+public:
+    MapElementIndex();
+
+    void build(const std::vector<counted_ptr<MapElement> >& elements);
+    void query(const Eigen::AlignedBox<float, 2>& box, std::vector<unsigned int>* elementIndices) const;
+
+private:
+    struct Node
+    {
+        float west;
+        float south;
+        float east;
+        float north;
+        unsigned int firstChild;
+        unsigned int childCount;
+        bool isLeaf;
+    };
+
+    // Each element has a leaf node, with firstChild set to the element index. The
+    // children of other nodes are stored contiguously in m_children.
+    std::vector<Node> m_nodes;
+    std::vector<unsigned int> m_children;
+    unsigned int m_root;
+};
+
+
 /** VectorMapLayer is a world layer that contains a collection of vector shape elements: points,
   * lines, and polygons.
+  *
+  * The elements overlapping a tile are found with an R-tree, and the clipped geometry
+  * for recently drawn tiles is cached. Elements shouldn't be modified after they're
+  * added to a layer, except for color and opacity.
   */
 class VectorMapLayer : public WorldLayer
 {
@@ -126,8 +226,42 @@ public:
 
     void addElement(MapElement* e);
 
+private:
+    struct TileAddress
+    {
+        unsigned int level;
+        unsigned int column;
+        unsigned int row;
+
+        bool operator<(const TileAddress& other) const
+        {
+            if (level != other.level)   return level < other.level;
+            if (column != other.column) return column < other.column;
+            return row < other.row;
+        }
+    };
+
+    // Clipped geometry of all elements that overlap a tile
+    struct TileGeometry
+    {
+        TileAddress address;
+        std::vector<unsigned int> elementIndices;
+        std::vector<MapElementGeometry> geometry;
+    };
+
+    typedef std::list<TileGeometry> TileGeometryList;
+
+    const TileGeometry& tileGeometry(const QuadtreeTile* tile) const;
+
 private:
     std::vector<counted_ptr<MapElement> > m_elements;
+
+    mutable MapElementIndex m_index;
+    mutable bool m_indexValid;
+
+    // Cache of clipped tile geometry, in least recently used order
+    mutable TileGeometryList m_tileCache;
+    mutable std::map<TileAddress, TileGeometryList::iterator> m_tileCacheIndex;
 };
 
 }
@@ -10,6 +10,7 @@
 
 #include "WorldGeometry.h"
 #include "RenderContext.h"
+#include "PlanarProjection.h"
 #include "Units.h"
 #include "TextureMap.h"
 #include "TiledMap.h"
@@ -54,7 +55,10 @@ WorldGeometry::WorldGeometry() :
     m_specularReflectance(Spectrum(0.0f, 0.0f, 0.0f)),
     m_specularPower(20.0f),
     m_cloudAltitude(0.0f),
-    m_tileAllocator(NULL)
+    m_surfaceQuadtrees(NULL),
+    m_cloudQuadtrees(NULL),
+    m_atmosphereQuadtrees(NULL),
+    m_prefetchTileAllocator(NULL)
 {
     setClippingPolicy(Geometry::PreventClipping);
     setShadowCaster(true);
@@ -62,13 +66,19 @@ WorldGeometry::WorldGeometry() :
     m_material = new Material();
     m_material->setDiffuse(Spectrum(1.0f, 1.0f, 1.0f));
 
-    m_tileAllocator = new QuadtreeTileAllocator;
+    m_surfaceQuadtrees = new PersistentQuadtreeSet;
+    m_cloudQuadtrees = new PersistentQuadtreeSet;
+    m_atmosphereQuadtrees = new PersistentQuadtreeSet;
+    m_prefetchTileAllocator = new QuadtreeTileAllocator;
 }
 
 
 WorldGeometry::~WorldGeometry()
 {
-    delete m_tileAllocator;
+    delete m_surfaceQuadtrees;
+    delete m_cloudQuadtrees;
+    delete m_atmosphereQuadtrees;
+    delete m_prefetchTileAllocator;
 }
 
 
@@ -174,6 +184,44 @@ AtmosphereShellDistance(const Vector3f& eyePosition, const Vector3f& ellipsoidAx
 }
 
 
+// Compute the view frustum planes in model coordinates
+static void
+ComputeCullingPlanes(const Transform3f& modelview, const Frustum& viewFrustum, float farDistance, CullingPlaneSet* cullingPlanes)
+{
+    Matrix4f modelviewTranspose = modelview.matrix().transpose();
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        cullingPlanes->planes[i] = Hyperplane<float, 3>(viewFrustum.planeNormals[i].cast<float>(), 0.0f);
+        cullingPlanes->planes[i].coeffs() = modelviewTranspose * cullingPlanes->planes[i].coeffs();
+    }
+    cullingPlanes->planes[4].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f, -1.0f, -viewFrustum.nearZ);
+    cullingPlanes->planes[5].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f,  1.0f, farDistance);
+}
+
+
+// Get the apparent size at which surface quadtree tiles are split.
+float
+WorldGeometry::surfaceSplitThreshold(float pixelSize) const
+{
+    float splitThreshold = pixelSize * MaxTileSquareSize * QuadtreeTile::TileSubdivision;
+    if (m_baseTiledMap.isValid())
+    {
+        // Adjust split threshold based on tile size
+        //   - 0 is a special case indicating that the tile size shouldn't be used
+        //     to determine tessellation
+        //   - Prevent huge numbers of tiles from being generated if the tiled map
+        //     reports a very small tile size.
+        unsigned int tileSize = m_baseTiledMap->tileSize();
+        if (tileSize != 0 && tileSize < 1000)
+        {
+            splitThreshold *= float(max(128u, tileSize)) / 1000.0f;
+        }
+    }
+
+    return splitThreshold;
+}
+
+
 void
 WorldGeometry::render(RenderContext& rc, double clock) const
 {
@@ -211,13 +259,7 @@ WorldGeometry::render(RenderContext& rc, double clock) const
     float farDistance = max(viewFrustum.nearZ, min(horizonDistance, viewFrustum.farZ));
     Matrix4f modelviewTranspose = rc.modelview().matrix().transpose();
     CullingPlaneSet cullingPlanes;
-    for (unsigned int i = 0; i < 4; ++i)
-    {
-        cullingPlanes.planes[i] = Hyperplane<float, 3>(viewFrustum.planeNormals[i].cast<float>(), 0.0f);
-        cullingPlanes.planes[i].coeffs() = modelviewTranspose * cullingPlanes.planes[i].coeffs();
-    }
-    cullingPlanes.planes[4].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f, -1.0f, -viewFrustum.nearZ);
-    cullingPlanes.planes[5].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f,  1.0f, farDistance);
+    ComputeCullingPlanes(rc.modelview(), viewFrustum, farDistance, &cullingPlanes);
 
     rc.pushModelView();
     rc.scaleModelView(m_ellipsoidAxes * 0.5f);
@@ -291,33 +333,17 @@ WorldGeometry::render(RenderContext& rc, double clock) const
         rc.bindMaterial(&material);
     }
 
-    // Create the root quadtree nodes. Presently, we always start with two root
-    // tiles: one for the western hemisphere and one for the eastern hemisphere.
-    // But, depending on what sort of tiles we have, a different set of root
-    // tiles might be more appropriate.
+    // Bring the surface quadtree up to date with the current view. The tree is kept
+    // from the last time this view was drawn, and only tiles whose level of detail has
+    // changed are split or merged.
     Vector3f semiAxes = m_ellipsoidAxes * 0.5f;
 
-    QuadtreeTile* westHemi = NULL;
-    QuadtreeTile* eastHemi = NULL;
-    initQuadtree(semiAxes, &westHemi, &eastHemi);
-
-    float splitThreshold = rc.pixelSize() * MaxTileSquareSize * QuadtreeTile::TileSubdivision;
-    if (m_baseTiledMap.isValid())
-    {
-        // Adjust split threshold based on tile size
-        //   - 0 is a special case indicating that the tile size shouldn't be used
-        //     to determine tessellation
-        //   - Prevent huge numbers of tiles from being generated if the tiled map
-        //     reports a very small tile size.
-        unsigned int tileSize = m_baseTiledMap->tileSize();
-        if (tileSize != 0 && tileSize < 1000)
-        {
-            splitThreshold *= float(max(128u, tileSize)) / 1000.0f;
-        }
-    }
+    float splitThreshold = surfaceSplitThreshold(rc.pixelSize());
+    PersistentQuadtree* surfaceQuadtree = m_surfaceQuadtrees->tree(rc.viewKey());
+    surfaceQuadtree->update(eyePosition, cullingPlanes, semiAxes, splitThreshold, rc.pixelSize());
 
-    westHemi->tessellate(eyePosition, cullingPlanes, semiAxes, splitThreshold, rc.pixelSize());
-    eastHemi->tessellate(eyePosition, cullingPlanes, semiAxes, splitThreshold, rc.pixelSize());
+    QuadtreeTile* westHemi = surfaceQuadtree->westHemisphere();
+    QuadtreeTile* eastHemi = surfaceQuadtree->eastHemisphere();
 
     if (m_baseTiledMap.isNull())
     {
@@ -427,18 +453,17 @@ WorldGeometry::render(RenderContext& rc, double clock) const
 
         Vector3f cloudSemiAxes = m_ellipsoidAxes * 0.5f * scale;
         
-        QuadtreeTile* westHemi = NULL;
-        QuadtreeTile* eastHemi = NULL;
-        initQuadtree(cloudSemiAxes, &westHemi, &eastHemi);
-        
         // Adjust the distance of the far plane.
         float maxCloudDistance = CloudShellDistance(eyePosition, m_ellipsoidAxes, m_cloudAltitude);
         farDistance = max(viewFrustum.nearZ, min(maxCloudDistance, viewFrustum.farZ));
         cullingPlanes.planes[5].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f,  1.0f, farDistance);
         
         float splitThreshold = rc.pixelSize() * MaxTileSquareSize * QuadtreeTile::TileSubdivision;
-        westHemi->tessellate(eyePosition, cullingPlanes, cloudSemiAxes, splitThreshold, rc.pixelSize());
-        eastHemi->tessellate(eyePosition, cullingPlanes, cloudSemiAxes, splitThreshold, rc.pixelSize());
+        PersistentQuadtree* cloudQuadtree = m_cloudQuadtrees->tree(rc.viewKey());
+        cloudQuadtree->update(eyePosition, cullingPlanes, cloudSemiAxes, splitThreshold, rc.pixelSize());
+
+        QuadtreeTile* westHemi = cloudQuadtree->westHemisphere();
+        QuadtreeTile* eastHemi = cloudQuadtree->eastHemisphere();
         
         // Only draw the cloud layer if the cloud texture is resident; otherwise, the cloud
         // layer is drawn as an opaque shell until texture loading is complete.
@@ -490,10 +515,6 @@ WorldGeometry::render(RenderContext& rc, double clock) const
 
         Vector3f atmSemiAxes = m_ellipsoidAxes * 0.5f * scale;
 
-        QuadtreeTile* westHemi = NULL;
-        QuadtreeTile* eastHemi = NULL;
-        initQuadtree(atmSemiAxes, &westHemi, &eastHemi);
-
         // Adjust the distance of the near and far planes so that as much of the atmosphere
         // shell geometry as possible is culled.
         float maxAtmosphereDistance = 0.0f;
@@ -506,8 +527,11 @@ WorldGeometry::render(RenderContext& rc, double clock) const
         cullingPlanes.planes[4].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f, -1.0f, -nearDistance);
 
         float splitThreshold = rc.pixelSize() * MaxTileSquareSize * QuadtreeTile::TileSubdivision * 2;
-        westHemi->tessellate(eyePosition, cullingPlanes, atmSemiAxes, splitThreshold, rc.pixelSize());
-        eastHemi->tessellate(eyePosition, cullingPlanes, atmSemiAxes, splitThreshold, rc.pixelSize());
+        PersistentQuadtree* atmosphereQuadtree = m_atmosphereQuadtrees->tree(rc.viewKey());
+        atmosphereQuadtree->update(eyePosition, cullingPlanes, atmSemiAxes, splitThreshold, rc.pixelSize());
+
+        QuadtreeTile* westHemi = atmosphereQuadtree->westHemisphere();
+        QuadtreeTile* eastHemi = atmosphereQuadtree->eastHemisphere();
 
         westHemi->render(rc, QuadtreeTile::Normals);
         eastHemi->render(rc, QuadtreeTile::Normals);
@@ -537,8 +561,8 @@ WorldGeometry::render(RenderContext& rc, double clock) const
     glDisable(GL_DEPTH_TEST);
 
     float minExtent = 1.0f;
-    for (QuadtreeTileAllocator::TileArray::const_iterator iter = m_tileAllocator->tiles().begin();
-         iter != m_tileAllocator->tiles().end(); ++iter)
+    for (QuadtreeTileAllocator::TileArray::const_iterator iter = surfaceQuadtree->tiles().begin();
+         iter != surfaceQuadtree->tiles().end(); ++iter)
     {
         if (!iter->hasChildren() && !iter->isCulled())
         {
@@ -570,20 +594,71 @@ WorldGeometry::render(RenderContext& rc, double clock) const
 }
 
 
+/** Request loading of the surface map tiles that would be needed to draw this
+  * world from the specified viewpoint. This is used to start loading tiles
+  * before the camera arrives at a predicted position, so that they're
+  * available when they're first drawn. The tiles are chosen using the same
+  * level of detail calculation used for rendering.
+  *
+  * \param eyePosition position of the camera in the body-fixed frame (in km)
+  * \param cameraOrientation orientation of the camera in the body-fixed frame
+  * \param projection camera projection
+  * \param pixelSize angular size of a pixel
+  * \param maxRequests maximum number of new tile loads to queue
+  *
+  * \return the number of new tile loads queued
+  */
+unsigned int
+WorldGeometry::prefetchTiles(const Vector3f& eyePosition,
+                             const Quaternionf& cameraOrientation,
+                             const PlanarProjection& projection,
+                             float pixelSize,
+                             unsigned int maxRequests) const
+{
+    if (m_baseTiledMap.isNull() && m_tiledNormalMap.isNull())
+    {
+        return 0;
+    }
+
+    Frustum viewFrustum = projection.frustum();
+    float farDistance = max(viewFrustum.nearZ, min(HorizonDistance(eyePosition, m_ellipsoidAxes), viewFrustum.farZ));
+    Transform3f modelview = Transform3f(cameraOrientation.conjugate()) * Translation3f(-eyePosition);
+    CullingPlaneSet cullingPlanes;
+    ComputeCullingPlanes(modelview, viewFrustum, farDistance, &cullingPlanes);
+
+    // The prefetch quadtree has its own allocator so that it doesn't disturb the tiles
+    // used for rendering.
+    Vector3f semiAxes = m_ellipsoidAxes * 0.5f;
+    QuadtreeTile* westHemi = NULL;
+    QuadtreeTile* eastHemi = NULL;
+    initQuadtree(m_prefetchTileAllocator, semiAxes, &westHemi, &eastHemi);
+
+    float splitThreshold = surfaceSplitThreshold(pixelSize);
+    westHemi->tessellate(eyePosition, cullingPlanes, semiAxes, splitThreshold, pixelSize);
+    eastHemi->tessellate(eyePosition, cullingPlanes, semiAxes, splitThreshold, pixelSize);
+
+    unsigned int requestCount = 0;
+    if (m_baseTiledMap.isValid())
+    {
+        requestCount += westHemi->prefetch(m_baseTiledMap.ptr(), maxRequests - requestCount);
+        requestCount += eastHemi->prefetch(m_baseTiledMap.ptr(), maxRequests - requestCount);
+    }
+
+    if (m_tiledNormalMap.isValid())
+    {
+        requestCount += westHemi->prefetch(m_tiledNormalMap.ptr(), maxRequests - requestCount);
+        requestCount += eastHemi->prefetch(m_tiledNormalMap.ptr(), maxRequests - requestCount);
+    }
+
+    return requestCount;
+}
+
+
 void
-WorldGeometry::initQuadtree(const Vector3f& semiAxes, QuadtreeTile **westHemi, QuadtreeTile **eastHemi) const
+WorldGeometry::initQuadtree(QuadtreeTileAllocator* allocator, const Vector3f& semiAxes, QuadtreeTile **westHemi, QuadtreeTile **eastHemi) const
 {
-    m_tileAllocator->clear();
-    *westHemi = m_tileAllocator->newRootTile(0, 0, Vector2f(-1.0f, -0.5f), 1.0f, semiAxes);
-    *eastHemi = m_tileAllocator->newRootTile(0, 1, Vector2f( 0.0f, -0.5f), 1.0f, semiAxes);
-
-    // Set up the neighbor connections for the root nodes. Since the map wraps,
-    // the eastern hemisphere is both the east and west neighbor of the western
-    // hemisphere (and vice versa.) There are no north and south neighbors.
-    (*westHemi)->setNeighbor(QuadtreeTile::West, *eastHemi);
-    (*westHemi)->setNeighbor(QuadtreeTile::East, *eastHemi);
-    (*eastHemi)->setNeighbor(QuadtreeTile::West, *westHemi);
-    (*eastHemi)->setNeighbor(QuadtreeTile::East, *westHemi);
+    allocator->clear();
+    allocator->newGlobe(semiAxes, westHemi, eastHemi);
 }
 
 
@@ -15,6 +15,7 @@
 #include "Material.h"
 #include "MapLayer.h"
 #include <Eigen/Core>
+#include <Eigen/Geometry>
 #include <vector>
 
 
@@ -26,9 +27,11 @@ class TextureMap;
 class Atmosphere;
 class QuadtreeTile;
 class QuadtreeTileAllocator;
+class PersistentQuadtreeSet;
 class TiledMap;
 class PlanetaryRings;
 class WorldLayer;
+class PlanarProjection;
 
 /** WorldGeometry is a Geometry object specialized for rendering
   * spherical (or ellipsoidal) worlds. Optionally, a WorldGeometry
@@ -45,6 +48,12 @@ public:
 
     void render(RenderContext& rc,
                 double clock) const;
+
+    unsigned int prefetchTiles(const Eigen::Vector3f& eyePosition,
+                               const Eigen::Quaternionf& cameraOrientation,
+                               const PlanarProjection& projection,
+                               float pixelSize,
+                               unsigned int maxRequests) const;
     
     float boundingSphereRadius() const;
 
@@ -291,7 +300,8 @@ private:
                     float tStart,
                     float tEnd) const;
 
-    void initQuadtree(const Eigen::Vector3f& semiAxes, QuadtreeTile** westHemi, QuadtreeTile** eastHemi) const;
+    void initQuadtree(QuadtreeTileAllocator* allocator, const Eigen::Vector3f& semiAxes, QuadtreeTile** westHemi, QuadtreeTile** eastHemi) const;
+    float surfaceSplitThreshold(float pixelSize) const;
 
 private:
     Eigen::Vector3f m_ellipsoidAxes;
@@ -312,7 +322,13 @@ private:
     counted_ptr<TiledMap> m_tiledCloudMap;
     float m_cloudAltitude;
 
-    QuadtreeTileAllocator* m_tileAllocator;
+    // Separate quadtrees are kept for the surface, cloud, and atmosphere shells so
+    // that each can be updated incrementally from frame to frame. Each shell has one
+    // tree per view (stereo eye or cube map face.)
+    PersistentQuadtreeSet* m_surfaceQuadtrees;
+    PersistentQuadtreeSet* m_cloudQuadtrees;
+    PersistentQuadtreeSet* m_atmosphereQuadtrees;
+    QuadtreeTileAllocator* m_prefetchTileAllocator;
 
     static bool ms_atmospheresVisible;
     static bool ms_cloudLayersVisible;
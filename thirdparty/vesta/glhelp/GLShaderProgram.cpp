@@ -24,6 +24,7 @@
 #include "GLShaderProgram.h"
 #include "../Debug.h"
 #include "../Object.h"
+#include <cstring>
 
 using namespace vesta;
 using namespace std;
@@ -31,9 +32,28 @@ using namespace std;
 #ifdef VESTA_OGLES2
 #define glGetUniformLocationARB glGetUniformLocation
 #define glBindAttribLocationARB glBindAttribLocation
+#define glGetActiveUniformARB glGetActiveUniform
 #endif
 
 
+unsigned int GLShaderProgram::ms_uniformUploadCount = 0;
+unsigned int GLShaderProgram::ms_skippedUniformUploadCount = 0;
+
+
+// FNV-1a hash of a uniform name
+static unsigned int
+hashUniformName(const char* name)
+{
+    unsigned int hash = 2166136261u;
+    for (const char* c = name; *c; ++c)
+    {
+        hash = (hash ^ (unsigned char) *c) * 16777619u;
+    }
+
+    return hash;
+}
+
+
 GLShaderProgram::GLShaderProgram() :
     m_handle(0),
     m_isLinked(false)
@@ -116,9 +136,46 @@ GLShaderProgram::link()
     glGetObjectParameterivARB(m_handle, GL_OBJECT_LINK_STATUS_ARB, &status);
 #endif
 
+    clearUniforms();
     if (status == GL_TRUE)
     {
         m_isLinked = true;
+
+        // Look up the locations of all active uniforms now, so that setting a uniform
+        // never requires a name lookup by the driver. Arrays are reported with the
+        // name of their first element, e.g. "color[0]", which is also valid for the
+        // array as a whole.
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+#ifdef VESTA_OGLES2
+        glGetProgramiv(m_handle, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(m_handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+#else
+        glGetObjectParameterivARB(m_handle, GL_OBJECT_ACTIVE_UNIFORMS_ARB, &uniformCount);
+        glGetObjectParameterivARB(m_handle, GL_OBJECT_ACTIVE_UNIFORM_MAX_LENGTH_ARB, &maxNameLength);
+#endif
+        if (maxNameLength > 0)
+        {
+            vector<char> nameChars(maxNameLength + 1);
+            for (GLint i = 0; i < uniformCount; ++i)
+            {
+                GLsizei nameLength = 0;
+                GLint size = 0;
+                GLenum type = 0;
+                glGetActiveUniformARB(m_handle, i, maxNameLength, &nameLength, &size, &type, &nameChars[0]);
+                nameChars[nameLength] = '\0';
+
+                if (nameLength > 3 && strcmp(&nameChars[nameLength - 3], "[0]") == 0)
+                {
+                    nameChars[nameLength - 3] = '\0';
+                }
+
+                if (findUniform(&nameChars[0]) < 0)
+                {
+                    addUniform(&nameChars[0], glGetUniformLocationARB(m_handle, &nameChars[0]));
+                }
+            }
+        }
     }
 
     // Get the log of error and warning messages and store it with
@@ -157,7 +214,8 @@ GLShaderProgram::bindAttribute(const char* name, int location)
 void
 GLShaderProgram::setSampler(const char* name, unsigned int samplerIndex)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    float value = float(samplerIndex);
+    GLint location = changedUniformLocation(name, &value, 1);
     if (location >= 0)
     {
         glUniform1i(location, samplerIndex);
@@ -170,7 +228,7 @@ GLShaderProgram::setSampler(const char* name, unsigned int samplerIndex)
 void
 GLShaderProgram::setConstant(const char* name, float value)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, &value, 1);
     if (location >= 0)
     {
         glUniform1f(location, value);
@@ -183,7 +241,7 @@ GLShaderProgram::setConstant(const char* name, float value)
 void
 GLShaderProgram::setConstant(const char* name, const Eigen::Vector2f& value)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, value.data(), 2);
     if (location >= 0)
     {
         glUniform2fv(location, 1, value.data());
@@ -196,7 +254,7 @@ GLShaderProgram::setConstant(const char* name, const Eigen::Vector2f& value)
 void
 GLShaderProgram::setConstant(const char* name, const Eigen::Vector3f& value)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, value.data(), 3);
     if (location >= 0)
     {
         glUniform3fv(location, 1, value.data());
@@ -209,7 +267,7 @@ GLShaderProgram::setConstant(const char* name, const Eigen::Vector3f& value)
 void
 GLShaderProgram::setConstant(const char* name, const Eigen::Vector4f& value)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, value.data(), 4);
     if (location >= 0)
     {
         glUniform4fv(location, 1, value.data());
@@ -222,7 +280,7 @@ GLShaderProgram::setConstant(const char* name, const Eigen::Vector4f& value)
 void
 GLShaderProgram::setConstant(const char* name, const Eigen::Matrix2f& value)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, value.data(), 4);
     if (location >= 0)
     {
         glUniformMatrix2fv(location, 1, GL_FALSE, value.data());
@@ -235,7 +293,7 @@ GLShaderProgram::setConstant(const char* name, const Eigen::Matrix2f& value)
 void
 GLShaderProgram::setConstant(const char* name, const Eigen::Matrix3f& value)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, value.data(), 9);
     if (location >= 0)
     {
         glUniformMatrix3fv(location, 1, GL_FALSE, value.data());
@@ -248,7 +306,7 @@ GLShaderProgram::setConstant(const char* name, const Eigen::Matrix3f& value)
 void
 GLShaderProgram::setConstant(const char* name, const Eigen::Matrix4f& value)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, value.data(), 16);
     if (location >= 0)
     {
         glUniformMatrix4fv(location, 1, GL_FALSE, value.data());
@@ -261,7 +319,7 @@ GLShaderProgram::setConstant(const char* name, const Eigen::Matrix4f& value)
 void
 GLShaderProgram::setConstant(const char* name, const Spectrum& color)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, color.data(), 3);
     if (location >= 0)
     {
         glUniform3fv(location, 1, color.data());
@@ -274,7 +332,7 @@ GLShaderProgram::setConstant(const char* name, const Spectrum& color)
 void
 GLShaderProgram::setConstantArray(const char* name, const float values[], unsigned int count)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, values, count);
     if (location >= 0)
     {
         glUniform1fv(location, count, values);
@@ -287,7 +345,7 @@ GLShaderProgram::setConstantArray(const char* name, const float values[], unsign
 void
 GLShaderProgram::setConstantArray(const char* name, const Eigen::Vector2f values[], unsigned int count)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, values[0].data(), count * 2);
     if (location >= 0)
     {
         glUniform2fv(location, count, values[0].data());
@@ -300,7 +358,7 @@ GLShaderProgram::setConstantArray(const char* name, const Eigen::Vector2f values
 void
 GLShaderProgram::setConstantArray(const char* name, const Eigen::Vector3f values[], unsigned int count)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, values[0].data(), count * 3);
     if (location >= 0)
     {
         glUniform3fv(location, count, values[0].data());
@@ -313,7 +371,7 @@ GLShaderProgram::setConstantArray(const char* name, const Eigen::Vector3f values
 void
 GLShaderProgram::setConstantArray(const char* name, const Eigen::Vector4f values[], unsigned int count)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, values[0].data(), count * 4);
     if (location >= 0)
     {
         glUniform4fv(location, count, values[0].data());
@@ -326,7 +384,7 @@ GLShaderProgram::setConstantArray(const char* name, const Eigen::Vector4f values
 void
 GLShaderProgram::setConstantArray(const char* name, const Eigen::Matrix4f values[], unsigned int count)
 {
-    GLint location = glGetUniformLocationARB(m_handle, name);
+    GLint location = changedUniformLocation(name, values[0].data(), count * 16);
     if (location >= 0)
     {
         glUniformMatrix4fv(location, count, GL_FALSE, values[0].data());
@@ -334,6 +392,150 @@ GLShaderProgram::setConstantArray(const char* name, const Eigen::Matrix4f values
 }
 
 
+/** Reset the counts of uploaded and skipped uniform values to zero.
+  */
+void
+GLShaderProgram::resetUniformStatistics()
+{
+    ms_uniformUploadCount = 0;
+    ms_skippedUniformUploadCount = 0;
+}
+
+
+// Forget all uniform locations and values, e.g. because the program is being relinked
+void
+GLShaderProgram::clearUniforms()
+{
+    m_uniforms.clear();
+    m_uniformTable.clear();
+    m_uniformValues.clear();
+}
+
+
+// Get the index of the named uniform in the uniform list, or -1 if the name hasn't
+// been looked up yet.
+int
+GLShaderProgram::findUniform(const char* name)
+{
+    if (m_uniformTable.empty())
+    {
+        return -1;
+    }
+
+    unsigned int mask = m_uniformTable.size() - 1;
+    for (unsigned int slot = hashUniformName(name) & mask; m_uniformTable[slot] >= 0; slot = (slot + 1) & mask)
+    {
+        int index = m_uniformTable[slot];
+        if (m_uniforms[index].name == name)
+        {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+
+// Add a uniform to the uniform list and the hash table. Inactive uniforms are added with
+// a location of -1 so that OpenGL is only asked for their location once.
+int
+GLShaderProgram::addUniform(const char* name, GLint location)
+{
+    Uniform uniform;
+    uniform.name = name;
+    uniform.location = location;
+    uniform.valueOffset = 0;
+    uniform.valueCapacity = 0;
+    uniform.valueSize = 0;
+    m_uniforms.push_back(uniform);
+
+    // Keep the table at most half full; it's rebuilt whenever it grows
+    if (m_uniforms.size() * 2 > m_uniformTable.size())
+    {
+        m_uniformTable.assign(max((size_t) 32, m_uniformTable.size() * 2), -1);
+        for (unsigned int i = 0; i < m_uniforms.size(); ++i)
+        {
+            unsigned int mask = m_uniformTable.size() - 1;
+            unsigned int slot = hashUniformName(m_uniforms[i].name.c_str()) & mask;
+            while (m_uniformTable[slot] >= 0)
+            {
+                slot = (slot + 1) & mask;
+            }
+            m_uniformTable[slot] = int(i);
+        }
+    }
+    else
+    {
+        unsigned int mask = m_uniformTable.size() - 1;
+        unsigned int slot = hashUniformName(name) & mask;
+        while (m_uniformTable[slot] >= 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        m_uniformTable[slot] = int(m_uniforms.size() - 1);
+    }
+
+    return int(m_uniforms.size() - 1);
+}
+
+
+// Look up a uniform and compare a new value with the last one set. Return the location
+// of the uniform if the new value must be sent to OpenGL, or -1 if the uniform isn't
+// active or already has the value. Integer values (samplers) are stored as floats, which
+// represent them exactly.
+//
+// Arrays may be set with a different number of elements each time. Setting fewer
+// elements leaves the rest of the array unchanged in OpenGL, so the stored values
+// mirror the whole array: the block for a uniform is reused as long as it is large
+// enough, and only moved when the array is set with more elements than ever before.
+// The space used is thus bounded by the largest size set for each uniform.
+GLint
+GLShaderProgram::changedUniformLocation(const char* name, const float* value, unsigned int size)
+{
+    int index = findUniform(name);
+    if (index < 0)
+    {
+        // Not an active uniform found when the program was linked; this is either an
+        // inactive uniform or a single element of an array.
+        index = addUniform(name, glGetUniformLocationARB(m_handle, name));
+    }
+
+    Uniform& uniform = m_uniforms[index];
+    if (uniform.location < 0)
+    {
+        return -1;
+    }
+
+    if (size > uniform.valueCapacity)
+    {
+        // First value set for this uniform, or more elements than before: allocate
+        // space to store it. The values set so far are kept.
+        unsigned int offset = m_uniformValues.size();
+        m_uniformValues.resize(offset + size);
+        copy(m_uniformValues.begin() + uniform.valueOffset,
+             m_uniformValues.begin() + uniform.valueOffset + uniform.valueSize,
+             m_uniformValues.begin() + offset);
+        uniform.valueOffset = offset;
+        uniform.valueCapacity = size;
+    }
+    else if (size <= uniform.valueSize)
+    {
+        const float* lastValue = &m_uniformValues[uniform.valueOffset];
+        if (memcmp(lastValue, value, size * sizeof(float)) == 0)
+        {
+            ++ms_skippedUniformUploadCount;
+            return -1;
+        }
+    }
+
+    copy(value, value + size, m_uniformValues.begin() + uniform.valueOffset);
+    uniform.valueSize = max(uniform.valueSize, size);
+
+    ++ms_uniformUploadCount;
+    return uniform.location;
+}
+
+
 /** Create a shader program using the specified vertex and fragment
   * shader source strings.
   *
@@ -27,6 +27,7 @@
 #include "GLShader.h"
 #include "../Spectrum.h"
 #include <string>
+#include <vector>
 
 
 namespace vesta
@@ -34,6 +35,12 @@ namespace vesta
 
 /** GLShaderProgram is a C++ wrapper for OpenGL shader program
  *  objects.
+ *
+ *  Uniform locations are looked up by name in a hash table that is
+ *  filled in when the program is linked, and the last value set for
+ *  each uniform is kept so that setting a uniform to the value that it
+ *  already has doesn't call into the driver. As with glUniform, the
+ *  program must be bound when setSampler() and setConstant() are called.
  */
 class GLShaderProgram : public Object
 {
@@ -103,12 +110,52 @@ public:
     static GLShaderProgram* CreateShaderProgram(const std::string& vertexShaderSource,
                                                 const std::string& fragmentShaderSource);
 
+    /** Get the number of uniform values sent to OpenGL by all shader programs
+      * since the statistics were last reset.
+      */
+    static unsigned int uniformUploadCount()
+    {
+        return ms_uniformUploadCount;
+    }
+
+    /** Get the number of uniform values that weren't sent to OpenGL because the
+      * uniform already had the same value.
+      */
+    static unsigned int skippedUniformUploadCount()
+    {
+        return ms_skippedUniformUploadCount;
+    }
+
+    static void resetUniformStatistics();
+
+private:
+    struct Uniform
+    {
+        std::string name;
+        GLint location;
+        unsigned int valueOffset;
+        unsigned int valueCapacity;  // space reserved in m_uniformValues
+        unsigned int valueSize;      // number of leading values known to be set
+    };
+
+    void clearUniforms();
+    int findUniform(const char* name);
+    int addUniform(const char* name, GLint location);
+    GLint changedUniformLocation(const char* name, const float* value, unsigned int size);
+
 private:
     GLhandleARB m_handle;
     counted_ptr<GLShader> m_vertexShader;
     counted_ptr<GLShader> m_fragmentShader;
     std::string m_log;
     bool m_isLinked;
+
+    std::vector<Uniform> m_uniforms;
+    std::vector<int> m_uniformTable;
+    std::vector<float> m_uniformValues;
+
+    static unsigned int ms_uniformUploadCount;
+    static unsigned int ms_skippedUniformUploadCount;
 };
 
 }
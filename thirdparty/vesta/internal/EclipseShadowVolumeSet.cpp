@@ -11,6 +11,7 @@
 #include "EclipseShadowVolumeSet.h"
 #include "../Entity.h"
 #include "../Geometry.h"
+#include "../Units.h"
 #include <cmath>
 #include <cassert>
 #include <algorithm>
@@ -47,10 +48,111 @@ using namespace std;
 //
 // Notes:
 //   - clear() should be called for each frame rendered.
-//   - There is currently no spatial hierarchy created for shadow volumes; the
-//     number of ellipsoidal bodies in a solar system is expected to be low. However,
-//     the class interface was designed so that it doesn't need to be changed if some
-//     structure to accelerate intersection testing is eventually added.
+//   - Systems with many moons can have dozens of shadow volumes, and testing every
+//     one against every visible object gets expensive. frustumCull() therefore also
+//     builds an index for each light source: shadow cones are binned by their
+//     direction as seen from the light (using the cells of a cube map), and the cones
+//     in each bin are sorted by the distance of the occluder from the light. An object
+//     is only tested against cones in the bin containing its direction from the light
+//     and with occluders closer to the light than the far side of the object. The
+//     remaining cones are rejected cheaply by comparing directions before the full
+//     cone-sphere test is performed. None of these steps discards a shadow that the
+//     full test would accept, so the results are identical to testing every shadow.
+
+// Shadow cones are binned using a cube map with BinResolution x BinResolution cells per face
+static const unsigned int BinResolution = 8;
+static const unsigned int BinCount = 6 * BinResolution * BinResolution;
+
+// Relative tolerance used to keep the fast rejection tests conservative in the face of
+// roundoff error.
+static const double RejectionTolerance = 1.0e-6;
+
+
+// Get the point on the unit cube for a face and face coordinates s, t in [-1, 1]
+static Vector3d
+cubeFacePoint(unsigned int face, double s, double t)
+{
+    switch (face)
+    {
+    case 0:  return Vector3d( 1.0, s, t);
+    case 1:  return Vector3d(-1.0, s, t);
+    case 2:  return Vector3d(t,  1.0, s);
+    case 3:  return Vector3d(t, -1.0, s);
+    case 4:  return Vector3d(s, t,  1.0);
+    default: return Vector3d(s, t, -1.0);
+    }
+}
+
+
+// Get the index of the cube map cell containing a direction
+static unsigned int
+directionBin(const Vector3d& u)
+{
+    Vector3d a = u.cwise().abs();
+    unsigned int face;
+    double s;
+    double t;
+    double m;
+
+    if (a.x() >= a.y() && a.x() >= a.z())
+    {
+        face = u.x() > 0.0 ? 0 : 1;
+        m = a.x();
+        s = u.y();
+        t = u.z();
+    }
+    else if (a.y() >= a.z())
+    {
+        face = u.y() > 0.0 ? 2 : 3;
+        m = a.y();
+        s = u.z();
+        t = u.x();
+    }
+    else
+    {
+        face = u.z() > 0.0 ? 4 : 5;
+        m = a.z();
+        s = u.x();
+        t = u.y();
+    }
+
+    if (m <= 0.0)
+    {
+        return 0;
+    }
+
+    int i = int((s / m + 1.0) * 0.5 * BinResolution);
+    int j = int((t / m + 1.0) * 0.5 * BinResolution);
+    i = max(0, min(int(BinResolution) - 1, i));
+    j = max(0, min(int(BinResolution) - 1, j));
+
+    return (face * BinResolution + j) * BinResolution + i;
+}
+
+
+// Get the angle between two unit vectors
+static double
+angleBetween(const Vector3d& u, const Vector3d& v)
+{
+    return acos(max(-1.0, min(1.0, u.dot(v))));
+}
+
+
+// Order cone indices by the distance of the occluder from the light source
+struct OccluderDistancePredicate
+{
+    OccluderDistancePredicate(const vector<double>& distances) :
+        m_distances(distances)
+    {
+    }
+
+    bool operator()(unsigned int a, unsigned int b) const
+    {
+        return m_distances[a] < m_distances[b];
+    }
+
+    const vector<double>& m_distances;
+};
 
 // Test whether the cone completely contains a sphere
 static bool
@@ -108,8 +210,40 @@ coneContainsSphere(const Vector3d& apex,
 
 
 EclipseShadowVolumeSet::EclipseShadowVolumeSet() :
-    m_insideUmbra(false)
+    m_maxBinRadius(0.0),
+    m_insideUmbra(false),
+    m_indexingEnabled(true)
 {
+    // Precompute the center direction of each cube map cell and the angular radius
+    // of a cone about that direction that contains the whole cell.
+    m_binCenters.resize(BinCount);
+    m_binRadii.resize(BinCount);
+    for (unsigned int face = 0; face < 6; ++face)
+    {
+        for (unsigned int j = 0; j < BinResolution; ++j)
+        {
+            for (unsigned int i = 0; i < BinResolution; ++i)
+            {
+                double s0 = 2.0 * i / BinResolution - 1.0;
+                double s1 = 2.0 * (i + 1) / BinResolution - 1.0;
+                double t0 = 2.0 * j / BinResolution - 1.0;
+                double t1 = 2.0 * (j + 1) / BinResolution - 1.0;
+
+                unsigned int bin = (face * BinResolution + j) * BinResolution + i;
+                Vector3d center = cubeFacePoint(face, (s0 + s1) * 0.5, (t0 + t1) * 0.5).normalized();
+
+                double radius = 0.0;
+                radius = max(radius, angleBetween(center, cubeFacePoint(face, s0, t0).normalized()));
+                radius = max(radius, angleBetween(center, cubeFacePoint(face, s1, t0).normalized()));
+                radius = max(radius, angleBetween(center, cubeFacePoint(face, s0, t1).normalized()));
+                radius = max(radius, angleBetween(center, cubeFacePoint(face, s1, t1).normalized()));
+
+                m_binCenters[bin] = center;
+                m_binRadii[bin] = radius * 1.01;
+                m_maxBinRadius = max(m_maxBinRadius, m_binRadii[bin]);
+            }
+        }
+    }
 }
 
 
@@ -126,32 +260,325 @@ EclipseShadowVolumeSet::clear()
 {
     m_allShadows.clear();
     m_frustumShadows.clear();
+    m_lightIndices.clear();
     m_intersectingShadows.clear();
 }
 
 
+/** Enable or disable culling and indexing of shadows. When indexing is disabled,
+  * frustumCull() keeps every shadow and findIntersectingShadows() tests the object
+  * against each one. The results are the same either way for objects that intersect
+  * the view frustum; turning indexing off is only useful for checking the index.
+  */
+void
+EclipseShadowVolumeSet::setIndexingEnabled(bool enabled)
+{
+    m_indexingEnabled = enabled;
+}
+
+
 /** Generate the list of shadow volumes to test against by
   * filtering out shadows that don't intersect the view
-  * frustum.
+  * frustum, and build the indexes used to find the shadows
+  * affecting an object.
+  *
+  * Only the side planes of the frustum are used for culling. A
+  * shadow volume is culled when no sphere with a radius of
+  * maxReceiverRadius or less can both intersect the shadow volume
+  * and the frustum.
+  *
+  * \param frustum the view frustum in camera space
+  * \param cameraPosition the position of the camera
+  * \param cameraOrientation the orientation of the camera
+  * \param maxReceiverRadius radius of the largest object that will be tested for shadows
   *
   * \returns true if there were any shadows intersecting the frustum
   */
 bool
-EclipseShadowVolumeSet::frustumCull(const Frustum& /* frustum */)
+EclipseShadowVolumeSet::frustumCull(const Frustum& frustum,
+                                    const Vector3d& cameraPosition,
+                                    const Quaterniond& cameraOrientation,
+                                    double maxReceiverRadius)
 {
     m_frustumShadows.clear();
+    m_lightIndices.clear();
+
+    if (!m_indexingEnabled)
+    {
+        for (unsigned int i = 0; i < m_allShadows.size(); ++i)
+        {
+            m_frustumShadows.push_back(&m_allShadows.at(i));
+        }
+        return !m_frustumShadows.empty();
+    }
+
+    Matrix3d toCameraSpace = cameraOrientation.conjugate().toRotationMatrix();
 
     for (unsigned int i = 0; i < m_allShadows.size(); ++i)
     {
-        // This step isn't implemented yet. For now, we'll just copy every
-        // shadow into the frustum intersection list
-        m_frustumShadows.push_back(&m_allShadows.at(i));
+        ConicShadowVolume* cone = &m_allShadows.at(i);
+        if (!coneOutsideFrustum(*cone, frustum, cameraPosition, toCameraSpace, maxReceiverRadius))
+        {
+            // Find the index for the light casting this shadow
+            unsigned int lightIndex = 0;
+            while (lightIndex < m_lightIndices.size() && m_lightIndices[lightIndex].lightPosition != cone->lightPosition)
+            {
+                ++lightIndex;
+            }
+
+            if (lightIndex == m_lightIndices.size())
+            {
+                m_lightIndices.push_back(LightShadowIndex());
+                m_lightIndices.back().lightPosition = cone->lightPosition;
+                m_lightIndices.back().maxReceiverRadius = maxReceiverRadius;
+            }
+
+            m_lightIndices[lightIndex].cones.push_back(m_frustumShadows.size());
+            m_frustumShadows.push_back(cone);
+        }
+    }
+
+    for (vector<LightShadowIndex>::iterator iter = m_lightIndices.begin(); iter != m_lightIndices.end(); ++iter)
+    {
+        buildLightIndex(*iter);
     }
 
     return !m_frustumShadows.empty();
 }
 
 
+// Build the direction bins for all of the shadows cast by one light source
+void
+EclipseShadowVolumeSet::buildLightIndex(LightShadowIndex& index)
+{
+    vector<double> distances(m_frustumShadows.size(), 0.0);
+    for (unsigned int i = 0; i < index.cones.size(); ++i)
+    {
+        distances[index.cones[i]] = m_frustumShadows[index.cones[i]]->occluderDistance;
+    }
+
+    // Sorting by distance lets queries stop scanning a bin at the first occluder that's
+    // farther from the light than the object being tested.
+    stable_sort(index.cones.begin(), index.cones.end(), OccluderDistancePredicate(distances));
+
+    double r = index.maxReceiverRadius;
+
+    // Count the cones in each bin, then fill the bins
+    vector<double> coneRadii(index.cones.size(), 0.0);
+    vector<unsigned int> binCounts(BinCount, 0);
+    index.unbinnedCones.clear();
+
+    for (unsigned int pass = 0; pass < 2; ++pass)
+    {
+        if (pass == 1)
+        {
+            index.binOffsets.resize(BinCount + 1);
+            index.binOffsets[0] = 0;
+            for (unsigned int bin = 0; bin < BinCount; ++bin)
+            {
+                index.binOffsets[bin + 1] = index.binOffsets[bin] + binCounts[bin];
+                binCounts[bin] = 0;
+            }
+            index.binCones.resize(index.binOffsets[BinCount]);
+        }
+
+        for (unsigned int i = 0; i < index.cones.size(); ++i)
+        {
+            const ConicShadowVolume* cone = m_frustumShadows[index.cones[i]];
+
+            if (pass == 0)
+            {
+                // Calculate the angular radius (as seen from the light) of the region in which
+                // the center of an object of radius r must lie in order to intersect the cone.
+                // See coneMayContainSphere() for the derivation.
+                double dr = cone->occluderDistance - r;
+                if (dr <= 0.0)
+                {
+                    coneRadii[i] = PI;
+                }
+                else
+                {
+                    coneRadii[i] = atan(cone->tanAngle + r / (cone->cosAngle * dr)) * (1.0 + RejectionTolerance);
+                }
+
+                if (coneRadii[i] >= PI * 0.5)
+                {
+                    index.unbinnedCones.push_back(index.cones[i]);
+                }
+            }
+
+            if (coneRadii[i] >= PI * 0.5)
+            {
+                continue;
+            }
+
+            // Most bins are far from the cone; reject them with a dot product before
+            // computing the angle.
+            double minCosAngle = cos(min(PI, coneRadii[i] + m_maxBinRadius)) - RejectionTolerance;
+
+            for (unsigned int bin = 0; bin < BinCount; ++bin)
+            {
+                if (m_binCenters[bin].dot(cone->direction) >= minCosAngle &&
+                    angleBetween(m_binCenters[bin], cone->direction) <= coneRadii[i] + m_binRadii[bin])
+                {
+                    if (pass == 1)
+                    {
+                        index.binCones[index.binOffsets[bin] + binCounts[bin]] = index.cones[i];
+                    }
+                    ++binCounts[bin];
+                }
+            }
+        }
+    }
+}
+
+
+// Test whether a sphere might intersect a shadow cone, given the direction and
+// distance of the sphere center from the light source. This test is cheaper than
+// coneIntersectsSphere(), and it never rejects a sphere that coneIntersectsSphere()
+// would accept.
+//
+// Let a be the distance from the light to the cone apex and d the distance from the light
+// to the occluder. In the plane containing the cone axis and the sphere center, let x be
+// the distance of the center along the axis from the apex and y its distance from the axis.
+// coneIntersectsSphere() accepts only spheres with:
+//     y < x tan(coneAngle) + r / cos(coneAngle)
+//     x + r > d - a
+// The distance of the center along the axis from the light is t = x + a, so t > d - r, and
+// the angle phi between the cone axis and the direction to the sphere center satisfies:
+//     tan(phi) = y / t < tan(coneAngle) + r / (cos(coneAngle) * (d - r))
+bool
+EclipseShadowVolumeSet::coneMayContainSphere(const ConicShadowVolume& cone,
+                                             const Vector3d& direction,
+                                             double distance,
+                                             double r)
+{
+    // Objects entirely closer to the light than the occluder can't be shadowed
+    if (cone.occluderDistance >= (distance + r) * (1.0 + RejectionTolerance))
+    {
+        return false;
+    }
+
+    double dr = cone.occluderDistance - r;
+    if (dr <= 0.0)
+    {
+        return true;
+    }
+
+    double cosPhi = direction.dot(cone.direction);
+    if (cosPhi <= 0.0)
+    {
+        // The object center is behind the light
+        return false;
+    }
+
+    double tanPhi = sqrt(max(0.0, 1.0 - cosPhi * cosPhi)) / cosPhi;
+    return tanPhi <= (cone.tanAngle + r / (cone.cosAngle * dr)) * (1.0 + RejectionTolerance);
+}
+
+
+// Test whether a shadow cone lies entirely outside one of the side planes of the view
+// frustum, far enough that no receiver intersecting the frustum can also intersect the
+// cone. The region tested is the truncated cone expanded to include every sphere center
+// accepted by coneIntersectsSphere() for a sphere with radius maxReceiverRadius.
+bool
+EclipseShadowVolumeSet::coneOutsideFrustum(const ConicShadowVolume& cone,
+                                           const Frustum& frustum,
+                                           const Vector3d& cameraPosition,
+                                           const Matrix3d& toCameraSpace,
+                                           double maxReceiverRadius)
+{
+    double r = maxReceiverRadius;
+    Vector3d apex = toCameraSpace * (cone.apex - cameraPosition);
+    Vector3d direction = toCameraSpace * cone.direction;
+
+    // Near and far cross sections of the expanded cone
+    double x0 = cone.front - r;
+    double x1 = cone.back + r;
+    double radius0 = max(0.0, x0 * cone.tanAngle + r / cone.cosAngle);
+    double radius1 = max(0.0, x1 * cone.tanAngle + r / cone.cosAngle);
+    Vector3d center0 = apex + direction * x0;
+    Vector3d center1 = apex + direction * x1;
+
+    // Allow for roundoff in the single precision frustum test applied to receivers
+    double margin = r + (center0.norm() + center1.norm()) * RejectionTolerance;
+
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        const Vector3d& n = frustum.planeNormals[i];
+        double nd = n.dot(direction);
+        double s = sqrt(max(0.0, 1.0 - nd * nd));
+
+        // The cone is the convex hull of the two cross sections, so its maximum distance from
+        // the plane is reached at one of them.
+        double maxDistance = max(n.dot(center0) + radius0 * s, n.dot(center1) + radius1 * s);
+        if (maxDistance < -margin)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Add the cones from one light source that may intersect a sphere to the candidate list
+void
+EclipseShadowVolumeSet::findCandidateShadows(const LightShadowIndex& index, const Vector3d& center, double r)
+{
+    Vector3d toCenter = center - index.lightPosition;
+    double distance = toCenter.norm();
+
+    if (distance <= r)
+    {
+        // The object contains the light source; there's no direction to test.
+        m_candidateShadows.insert(m_candidateShadows.end(), index.cones.begin(), index.cones.end());
+        return;
+    }
+
+    Vector3d direction = toCenter / distance;
+
+    if (r > index.maxReceiverRadius)
+    {
+        // The bins were built for smaller objects, so check all cones from this light
+        for (vector<unsigned int>::const_iterator iter = index.cones.begin(); iter != index.cones.end(); ++iter)
+        {
+            if (coneMayContainSphere(*m_frustumShadows[*iter], direction, distance, r))
+            {
+                m_candidateShadows.push_back(*iter);
+            }
+        }
+        return;
+    }
+
+    unsigned int bin = directionBin(direction);
+    for (unsigned int i = index.binOffsets[bin]; i < index.binOffsets[bin + 1]; ++i)
+    {
+        unsigned int coneIndex = index.binCones[i];
+        const ConicShadowVolume& cone = *m_frustumShadows[coneIndex];
+
+        // Bins are sorted by occluder distance, so all remaining occluders are too far away
+        if (cone.occluderDistance >= (distance + r) * (1.0 + RejectionTolerance))
+        {
+            break;
+        }
+
+        if (coneMayContainSphere(cone, direction, distance, r))
+        {
+            m_candidateShadows.push_back(coneIndex);
+        }
+    }
+
+    for (vector<unsigned int>::const_iterator iter = index.unbinnedCones.begin(); iter != index.unbinnedCones.end(); ++iter)
+    {
+        if (coneMayContainSphere(*m_frustumShadows[*iter], direction, distance, r))
+        {
+            m_candidateShadows.push_back(*iter);
+        }
+    }
+}
+
+
 /** Find all shadows intersecting a given sphere. The list of
   * intersecting shadows is available via the intersectingShadows()
   * method. Calling this method will also set the insideUmbra flag
@@ -166,79 +593,106 @@ EclipseShadowVolumeSet::findIntersectingShadows(const Entity* entity, const Vect
     m_intersectingShadows.clear();
     m_insideUmbra = false;
 
-    for (vector<ConicShadowVolume*>::const_iterator iter = m_frustumShadows.begin(); iter != m_frustumShadows.end(); ++iter)
+    m_candidateShadows.clear();
+    if (m_indexingEnabled)
+    {
+        for (vector<LightShadowIndex>::const_iterator iter = m_lightIndices.begin(); iter != m_lightIndices.end(); ++iter)
+        {
+            findCandidateShadows(*iter, sphereCenter, sphereRadius);
+        }
+    }
+    else
+    {
+        for (unsigned int i = 0; i < m_frustumShadows.size(); ++i)
+        {
+            m_candidateShadows.push_back(i);
+        }
+    }
+
+    // Process the candidates in the order that the shadows were added so that the list of
+    // intersecting shadows doesn't depend on the indexing.
+    sort(m_candidateShadows.begin(), m_candidateShadows.end());
+
+    for (vector<unsigned int>::const_iterator iter = m_candidateShadows.begin(); iter != m_candidateShadows.end(); ++iter)
     {
-        ConicShadowVolume* cone = *iter;
+        ConicShadowVolume* cone = m_frustumShadows[*iter];
         if (entity != cone->occluder && coneIntersectsSphere(*cone, sphereCenter, sphereRadius))
         {
-            bool planarOccluder = cone->occluder->geometry()->ellipsoid().isDegenerate();
+            addIntersectingShadow(cone, sphereCenter, sphereRadius);
+        }
+    }
 
-            // Only compute the ellipse the first time that it's needed; for most shadow volumes,
-            // ellipse will never be required because no objects will lie within cone.
-            if (!cone->ellipseComputed)
-            {
-                Matrix3d r = cone->orientation.cast<double>().toRotationMatrix();
+    return !m_intersectingShadows.empty();
+}
 
-                if (planarOccluder)
-                {
-                    // For planar occluders, we'll just store the actual ellipse rather
-                    // than the projection. For now, we assume the occluder lies in the
-                    // xy-plane.
-                    const AlignedEllipsoid& ellipsoid = cone->occluder->geometry()->ellipsoid();
-                    cone->ellipse = GeneralEllipse(cone->center,
-                                                   r * (Vector3d::UnitX() * ellipsoid.semiAxes().x()),
-                                                   r * (Vector3d::UnitY() * ellipsoid.semiAxes().y()));
-                }
-                else
-                {
-                    // Calculate the limb of the occluding body as seen from the apex of
-                    // the shadow cone. We rotate the apex into the fixed frame of the occluder,
-                    // compute the limb ellipse, then rotate that ellipse back into the ICRF.
-                    Vector3d p = r.transpose() * (cone->apex - cone->center);
-                    GeneralEllipse projection = cone->occluder->geometry()->ellipsoid().orthogonalProjection(p.normalized());
-
-                    projection = GeneralEllipse(r * projection.center(), r * projection.v0(), r * projection.v1());
-                    Matrix<double, 3, 2> projAxes = projection.principalSemiAxes();
-                    cone->ellipse = GeneralEllipse(projection.center() + cone->center,
-                                                   projAxes.col(0),
-                                                   projAxes.col(1));
-                }
 
-                cone->ellipseComputed = true;
-            }
+void
+EclipseShadowVolumeSet::addIntersectingShadow(ConicShadowVolume* cone, const Vector3d& sphereCenter, double sphereRadius)
+{
+    bool planarOccluder = cone->occluder->geometry()->ellipsoid().isDegenerate();
 
-            EclipseShadow shadow;
-            shadow.occluder    = cone->occluder;
-            shadow.direction   = cone->direction;
-            shadow.position    = cone->center;
-            shadow.projection  = cone->ellipse;
-
-            // TODO: Remove the assumption that the light source is larger than the occluder;
-            // the negation below shouldn't be necessary.
-            shadow.umbraSlope    = float(-cone->sinUmbraConeAngle / cone->cosUmbraConeAngle);
-            shadow.penumbraSlope = float(cone->sinAngle / cone->cosAngle);
-
-            m_intersectingShadows.push_back(shadow);
-
-            // Check whether the object lies completely inside the shadow umbra, i.e. it
-            // receives no light at all from the light source.
-            // We treat degenerate ellipsoids specially; they are used to represent ring
-            // shadows, which will not completely obscure light.
-            if (!planarOccluder &&
-                coneContainsSphere(cone->center + cone->umbraLength * cone->direction,
-                                   -cone->direction,
-                                   cone->umbraLength,
-                                   cone->cosUmbraConeAngle,
-                                   cone->sinUmbraConeAngle,
-                                   sphereCenter,
-                                   sphereRadius))
-            {
-                m_insideUmbra = true;
-            }
+    // Only compute the ellipse the first time that it's needed; for most shadow volumes,
+    // ellipse will never be required because no objects will lie within cone.
+    if (!cone->ellipseComputed)
+    {
+        Matrix3d r = cone->orientation.cast<double>().toRotationMatrix();
+
+        if (planarOccluder)
+        {
+            // For planar occluders, we'll just store the actual ellipse rather
+            // than the projection. For now, we assume the occluder lies in the
+            // xy-plane.
+            const AlignedEllipsoid& ellipsoid = cone->occluder->geometry()->ellipsoid();
+            cone->ellipse = GeneralEllipse(cone->center,
+                                           r * (Vector3d::UnitX() * ellipsoid.semiAxes().x()),
+                                           r * (Vector3d::UnitY() * ellipsoid.semiAxes().y()));
+        }
+        else
+        {
+            // Calculate the limb of the occluding body as seen from the apex of
+            // the shadow cone. We rotate the apex into the fixed frame of the occluder,
+            // compute the limb ellipse, then rotate that ellipse back into the ICRF.
+            Vector3d p = r.transpose() * (cone->apex - cone->center);
+            GeneralEllipse projection = cone->occluder->geometry()->ellipsoid().orthogonalProjection(p.normalized());
+
+            projection = GeneralEllipse(r * projection.center(), r * projection.v0(), r * projection.v1());
+            Matrix<double, 3, 2> projAxes = projection.principalSemiAxes();
+            cone->ellipse = GeneralEllipse(projection.center() + cone->center,
+                                           projAxes.col(0),
+                                           projAxes.col(1));
         }
+
+        cone->ellipseComputed = true;
     }
 
-    return !m_intersectingShadows.empty();
+    EclipseShadow shadow;
+    shadow.occluder    = cone->occluder;
+    shadow.direction   = cone->direction;
+    shadow.position    = cone->center;
+    shadow.projection  = cone->ellipse;
+
+    // TODO: Remove the assumption that the light source is larger than the occluder;
+    // the negation below shouldn't be necessary.
+    shadow.umbraSlope    = float(-cone->sinUmbraConeAngle / cone->cosUmbraConeAngle);
+    shadow.penumbraSlope = float(cone->sinAngle / cone->cosAngle);
+
+    m_intersectingShadows.push_back(shadow);
+
+    // Check whether the object lies completely inside the shadow umbra, i.e. it
+    // receives no light at all from the light source.
+    // We treat degenerate ellipsoids specially; they are used to represent ring
+    // shadows, which will not completely obscure light.
+    if (!planarOccluder &&
+        coneContainsSphere(cone->center + cone->umbraLength * cone->direction,
+                           -cone->direction,
+                           cone->umbraLength,
+                           cone->cosUmbraConeAngle,
+                           cone->sinUmbraConeAngle,
+                           sphereCenter,
+                           sphereRadius))
+    {
+        m_insideUmbra = true;
+    }
 }
 
 
@@ -300,6 +754,9 @@ EclipseShadowVolumeSet::addShadow(const Entity* occluder,
     cone.back = coneLength;
     cone.cosAngle = cosConeAngle;
     cone.sinAngle = sqrt(max(0.0, 1.0 - cosConeAngle * cosConeAngle));
+    cone.tanAngle = cone.sinAngle / cone.cosAngle;
+    cone.lightPosition = lightPosition;
+    cone.occluderDistance = d;
 
     // Calculate the umbra cone parameters
     double r = occluder->geometry()->ellipsoid().semiAxes().minCoeff();
@@ -376,23 +833,3 @@ EclipseShadowVolumeSet::coneIntersectsSphere(const ConicShadowVolume& cone, cons
 
     return true;
 }
-
-
-#if 0
-// For use when frustum culling shadow volumes
-static bool cullConePlane(const Vector3d& coneApex, const Vector3d& coneDirection, double cosConeAngle, double coneH,
-                          const Hyperplane<double, 3>& plane)
-{
-    double NdC = plane.normal().dot(coneApex);
-    double NdD = plane.normal().dot(coneDirection);
-    double root = sqrt(1.0 - NdD * NdD);
-    if (root > cosConeAngle && NdD < 0)
-    {
-        return NdC < plane.offset();
-    }
-
-    // double r =  h * NdD + coneH * tanConeAngle * root;
-    // return NdC + r < plane.offset();
-    return true;
-}
-#endif
@@ -50,7 +50,10 @@ public:
                    const Eigen::Quaternionf& occluderOrientation,
                    const Eigen::Vector3d& lightPosition,
                    double lightRadius);
-    bool frustumCull(const Frustum& frustum);
+    bool frustumCull(const Frustum& frustum,
+                     const Eigen::Vector3d& cameraPosition,
+                     const Eigen::Quaterniond& cameraOrientation,
+                     double maxReceiverRadius);
     bool findIntersectingShadows(const Entity* entity, const Eigen::Vector3d& sphereCenter, double sphereRadius);
 
     const EclipseShadowVector& intersectingShadows() const
@@ -66,6 +69,15 @@ public:
         return m_insideUmbra;
     }
 
+    /** Returns true if shadows are culled and indexed (the default.)
+      */
+    bool isIndexingEnabled() const
+    {
+        return m_indexingEnabled;
+    }
+
+    void setIndexingEnabled(bool enabled);
+
 private:
     struct ConicShadowVolume
     {
@@ -83,20 +95,55 @@ private:
         double cosUmbraConeAngle;
         double sinUmbraConeAngle;
 
+        Eigen::Vector3d lightPosition;
+        double occluderDistance;
+        double tanAngle;
+
         Eigen::Quaternionf orientation;
         bool ellipseComputed;
         GeneralEllipse ellipse;
     };
 
+    // Index of the shadow cones cast by a single light source. Cones are binned by
+    // their direction as seen from the light, and each bin is sorted by distance
+    // from the light to the occluder.
+    struct LightShadowIndex
+    {
+        Eigen::Vector3d lightPosition;
+        double maxReceiverRadius;
+        std::vector<unsigned int> cones;
+        std::vector<unsigned int> unbinnedCones;
+        std::vector<unsigned int> binOffsets;
+        std::vector<unsigned int> binCones;
+    };
+
     static bool coneIntersectsSphere(const ConicShadowVolume& cone, const Eigen::Vector3d& center, double r);
+    static bool coneOutsideFrustum(const ConicShadowVolume& cone,
+                                   const Frustum& frustum,
+                                   const Eigen::Vector3d& cameraPosition,
+                                   const Eigen::Matrix3d& toCameraSpace,
+                                   double maxReceiverRadius);
+    static bool coneMayContainSphere(const ConicShadowVolume& cone,
+                                     const Eigen::Vector3d& direction,
+                                     double distance,
+                                     double r);
+    void buildLightIndex(LightShadowIndex& index);
+    void findCandidateShadows(const LightShadowIndex& index, const Eigen::Vector3d& center, double r);
+    void addIntersectingShadow(ConicShadowVolume* cone, const Eigen::Vector3d& center, double r);
 
 private:
     typedef std::vector<ConicShadowVolume, Eigen::aligned_allocator<ConicShadowVolume> > ShadowVolumeVector;
 
     ShadowVolumeVector m_allShadows;
     std::vector<ConicShadowVolume*> m_frustumShadows;
+    std::vector<LightShadowIndex> m_lightIndices;
+    std::vector<unsigned int> m_candidateShadows;
+    std::vector<Eigen::Vector3d> m_binCenters;
+    std::vector<double> m_binRadii;
+    double m_maxBinRadius;
     EclipseShadowVector m_intersectingShadows;
     bool m_insideUmbra;
+    bool m_indexingEnabled;
 };
 
 }
@@ -0,0 +1,235 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#include "MappedFile.h"
+#include "../Debug.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace vesta;
+using namespace std;
+
+
+const v_uint64 MappedFile::ChunkSize;
+const v_uint64 MappedFile::DefaultResidentLimit;
+
+
+MappedFile::MappedFile() :
+    m_data(NULL),
+    m_size(0),
+#ifdef _WIN32
+    m_fileHandle(INVALID_HANDLE_VALUE),
+    m_mappingHandle(NULL),
+#endif
+    m_residentLimit(DefaultResidentLimit),
+    m_clock(0)
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mappingHandle)
+    {
+        CloseHandle(m_mappingHandle);
+    }
+    if (m_fileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_fileHandle);
+    }
+#else
+    if (m_data)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+}
+
+
+/** Map a file into memory for reading. Returns null if the file can't be opened
+  * or mapped, or if the file is empty.
+  */
+MappedFile*
+MappedFile::Open(const char* filename)
+{
+    MappedFile* file = new MappedFile();
+
+#ifdef _WIN32
+    file->m_fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (file->m_fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(file->m_fileHandle, &size) || size.QuadPart == 0)
+    {
+        VESTA_LOG("Can't open file %s for mapping", filename);
+        delete file;
+        return NULL;
+    }
+
+    if (v_uint64(SIZE_T(size.QuadPart)) != v_uint64(size.QuadPart))
+    {
+        VESTA_LOG("File %s is too large to map", filename);
+        delete file;
+        return NULL;
+    }
+
+    file->m_mappingHandle = CreateFileMappingA(file->m_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (file->m_mappingHandle)
+    {
+        file->m_data = static_cast<const char*>(MapViewOfFile(file->m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    }
+    file->m_size = size.QuadPart;
+#else
+    int fd = open(filename, O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        VESTA_LOG("Can't open file %s for mapping", filename);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        delete file;
+        return NULL;
+    }
+
+    if (v_uint64(size_t(fileStat.st_size)) != v_uint64(fileStat.st_size))
+    {
+        VESTA_LOG("File %s is too large to map", filename);
+        close(fd);
+        delete file;
+        return NULL;
+    }
+
+    void* data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data != MAP_FAILED)
+    {
+        file->m_data = static_cast<const char*>(data);
+        file->m_size = fileStat.st_size;
+    }
+#endif
+
+    if (!file->m_data)
+    {
+        VESTA_LOG("Error mapping file %s", filename);
+        delete file;
+        return NULL;
+    }
+
+    file->m_chunkLastUse.resize((file->m_size + ChunkSize - 1) / ChunkSize, 0);
+
+    return file;
+}
+
+
+/** Report that a region of the file is about to be used. The region is read
+  * ahead, and other regions are released if the total size of all touched regions
+  * exceeds the resident limit. A region larger than the resident limit is never
+  * released while it is being touched, so it may temporarily exceed the limit.
+  */
+void
+MappedFile::touch(v_uint64 offset, v_uint64 length)
+{
+    if (length == 0 || offset >= m_size)
+    {
+        return;
+    }
+
+    v_uint64 firstChunk = offset / ChunkSize;
+    v_uint64 lastChunk = (min(m_size, offset + length) - 1) / ChunkSize;
+
+    ++m_clock;
+    for (v_uint64 chunk = firstChunk; chunk <= lastChunk; ++chunk)
+    {
+        if (m_chunkLastUse[chunk] == 0)
+        {
+            m_residentChunks.push_back(chunk);
+#ifndef _WIN32
+            v_uint64 chunkStart = chunk * ChunkSize;
+            madvise(const_cast<char*>(m_data) + chunkStart, min(ChunkSize, m_size - chunkStart), MADV_WILLNEED);
+#endif
+        }
+        m_chunkLastUse[chunk] = m_clock;
+    }
+
+    // Release the least recently touched chunks until the limit is met
+    while (residentBytes() > m_residentLimit)
+    {
+        unsigned int oldest = 0;
+        for (unsigned int i = 1; i < m_residentChunks.size(); ++i)
+        {
+            if (m_chunkLastUse[m_residentChunks[i]] < m_chunkLastUse[m_residentChunks[oldest]])
+            {
+                oldest = i;
+            }
+        }
+
+        if (m_chunkLastUse[m_residentChunks[oldest]] == m_clock)
+        {
+            // Everything remaining is part of the region just touched
+            break;
+        }
+
+        releaseChunk(m_residentChunks[oldest]);
+        m_residentChunks[oldest] = m_residentChunks.back();
+        m_residentChunks.pop_back();
+    }
+}
+
+
+/** Set the maximum number of bytes of touched regions to keep in memory.
+  */
+void
+MappedFile::setResidentLimit(v_uint64 bytes)
+{
+    m_residentLimit = bytes;
+}
+
+
+/** Release all touched regions from memory.
+  */
+void
+MappedFile::releaseAll()
+{
+    for (unsigned int i = 0; i < m_residentChunks.size(); ++i)
+    {
+        releaseChunk(m_residentChunks[i]);
+    }
+    m_residentChunks.clear();
+}
+
+
+void
+MappedFile::releaseChunk(v_uint64 chunk)
+{
+    m_chunkLastUse[chunk] = 0;
+
+    // The mapping is read-only, so released pages are simply discarded; they'll be
+    // read from the file again if they're accessed.
+    v_uint64 chunkStart = chunk * ChunkSize;
+    v_uint64 chunkLength = min(ChunkSize, m_size - chunkStart);
+#ifdef _WIN32
+    VirtualUnlock(const_cast<char*>(m_data) + chunkStart, chunkLength);
+#else
+    madvise(const_cast<char*>(m_data) + chunkStart, chunkLength, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,87 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#ifndef _VESTA_MAPPED_FILE_H_
+#define _VESTA_MAPPED_FILE_H_
+
+#include "../Object.h"
+#include "../IntegerTypes.h"
+#include <vector>
+
+namespace vesta
+{
+
+// An internal class for read-only access to a file mapped into memory. Pages of
+// the file are read from disk only when they're first accessed. In order to keep
+// the memory used by a very large file bounded, regions of the file that are used
+// should be reported by calling touch(); when the regions touched exceed the
+// resident limit, the least recently touched regions are released from memory
+// (they will be read again from disk if they are accessed later.)
+class MappedFile : public Object
+{
+public:
+    ~MappedFile();
+
+    static MappedFile* Open(const char* filename);
+
+    const char* data() const
+    {
+        return m_data;
+    }
+
+    v_uint64 size() const
+    {
+        return m_size;
+    }
+
+    void touch(v_uint64 offset, v_uint64 length);
+    void setResidentLimit(v_uint64 bytes);
+
+    /** Get the maximum number of bytes of touched regions that are kept in memory.
+      */
+    v_uint64 residentLimit() const
+    {
+        return m_residentLimit;
+    }
+
+    /** Get the number of bytes in touched regions that haven't been released.
+      */
+    v_uint64 residentBytes() const
+    {
+        return m_residentChunks.size() * ChunkSize;
+    }
+
+    void releaseAll();
+
+    static const v_uint64 ChunkSize = 1 << 20;
+    static const v_uint64 DefaultResidentLimit = 256 << 20;
+
+private:
+    MappedFile();
+
+    void releaseChunk(v_uint64 chunk);
+
+private:
+    const char* m_data;
+    v_uint64 m_size;
+#ifdef _WIN32
+    void* m_fileHandle;
+    void* m_mappingHandle;
+#endif
+
+    v_uint64 m_residentLimit;
+    v_uint64 m_clock;
+    std::vector<v_uint64> m_chunkLastUse;
+    std::vector<v_uint64> m_residentChunks;
+};
+
+}
+
+#endif // _VESTA_MAPPED_FILE_H_
@@ -0,0 +1,177 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#include "ShadowMapCache.h"
+#include "../Geometry.h"
+#include <cmath>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+ShadowMapCache::Signature::Signature() :
+    m_valid(false),
+    m_direction(Vector3f::Zero()),
+    m_extent(0.0f)
+{
+}
+
+
+/** Start a new signature with no shadow casters.
+  */
+void
+ShadowMapCache::Signature::clear()
+{
+    m_valid = true;
+    m_direction = Vector3f::Zero();
+    m_extent = 0.0f;
+    m_casters.clear();
+}
+
+
+/** Set the light projection used for the shadow map.
+  *
+  * \param direction the light direction (zero for a cubic shadow map)
+  * \param extent the radius of the region covered by the shadow map
+  */
+void
+ShadowMapCache::Signature::setProjection(const Vector3f& direction, float extent)
+{
+    m_direction = direction;
+    m_extent = extent;
+}
+
+
+/** Add a shadow caster to the signature.
+  *
+  * \param geometry the geometry drawn into the shadow map
+  * \param position the position of the geometry relative to the origin of the shadow map
+  * \param orientation the orientation of the geometry
+  * \param t the clock value passed to Geometry::renderShadow()
+  */
+void
+ShadowMapCache::Signature::addCaster(const Geometry* geometry,
+                                     const Vector3f& position,
+                                     const Quaternionf& orientation,
+                                     double t)
+{
+    Caster caster;
+    caster.geometry = geometry;
+    caster.boundingRadius = geometry->boundingSphereRadius();
+    caster.position = position;
+    caster.orientation = orientation;
+    caster.time = t;
+    caster.animated = geometry->isAnimated();
+    m_casters.push_back(caster);
+}
+
+
+/** Return true if a shadow map drawn with this signature would differ from one
+  * drawn with the other signature by no more than the specified tolerance. The
+  * tolerance is absoluteTolerance + relativeTolerance * d for a point at distance
+  * d from the shadow map origin.
+  *
+  * The same casters must appear in the same order in both signatures; only their
+  * poses may differ.
+  */
+bool
+ShadowMapCache::Signature::matches(const Signature& other, float absoluteTolerance, float relativeTolerance) const
+{
+    if (!m_valid || !other.m_valid || m_casters.size() != other.m_casters.size())
+    {
+        return false;
+    }
+
+    float extentTolerance = absoluteTolerance + relativeTolerance * m_extent;
+    if (abs(m_extent - other.m_extent) > extentTolerance)
+    {
+        return false;
+    }
+
+    // A change in light direction moves points at the edge of the map by the
+    // angle (approximately the chord length) times the extent.
+    if ((m_direction - other.m_direction).norm() * m_extent > extentTolerance)
+    {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < m_casters.size(); ++i)
+    {
+        const Caster& c0 = m_casters[i];
+        const Caster& c1 = other.m_casters[i];
+
+        if (c0.geometry != c1.geometry || c0.boundingRadius != c1.boundingRadius)
+        {
+            return false;
+        }
+
+        if (c0.animated && c0.time != c1.time)
+        {
+            return false;
+        }
+
+        float tolerance = absoluteTolerance + relativeTolerance * c0.position.norm();
+        if ((c0.position - c1.position).norm() > tolerance)
+        {
+            return false;
+        }
+
+        // Points on the bounding sphere of the caster move by at most the rotation
+        // angle times the radius.
+        if (c0.orientation.angularDistance(c1.orientation) * c0.boundingRadius > tolerance)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void
+ShadowMapCache::Signature::swap(Signature& other)
+{
+    std::swap(m_valid, other.m_valid);
+    std::swap(m_direction, other.m_direction);
+    std::swap(m_extent, other.m_extent);
+    m_casters.swap(other.m_casters);
+}
+
+
+ShadowMapCache::ShadowMapCache(unsigned int shadowMapCount, unsigned int omniShadowMapCount) :
+    m_shadowMaps(shadowMapCount),
+    m_omniShadowMapFaces(omniShadowMapCount * 6),
+    m_shadowMatrices(shadowMapCount, Matrix4f::Identity())
+{
+}
+
+
+ShadowMapCache::~ShadowMapCache()
+{
+}
+
+
+/** Mark the contents of all shadow maps as unknown, e.g. because the shadow map
+  * framebuffers were recreated.
+  */
+void
+ShadowMapCache::invalidate()
+{
+    for (unsigned int i = 0; i < m_shadowMaps.size(); ++i)
+    {
+        m_shadowMaps[i].invalidate();
+    }
+
+    for (unsigned int i = 0; i < m_omniShadowMapFaces.size(); ++i)
+    {
+        m_omniShadowMapFaces[i].invalidate();
+    }
+}
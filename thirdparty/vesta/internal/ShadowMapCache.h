@@ -0,0 +1,131 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#ifndef _VESTA_SHADOW_MAP_CACHE_H_
+#define _VESTA_SHADOW_MAP_CACHE_H_
+
+#include "../Object.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+#include <vector>
+
+namespace vesta
+{
+
+class Geometry;
+
+// An internal class that records what was drawn into each of the renderer's
+// shadow maps. A shadow map only needs to be redrawn when the light or one of
+// the shadow casters has moved by a visible fraction of a shadow map texel;
+// otherwise, the contents of the map are reused and only the matrix that maps
+// from camera space to shadow space is recomputed.
+class ShadowMapCache : public Object
+{
+public:
+    // A description of the contents of one shadow map or one face of a cubic
+    // shadow map: the light projection and the pose of every caster drawn.
+    class Signature
+    {
+    public:
+        Signature();
+
+        void clear();
+        void setProjection(const Eigen::Vector3f& direction, float extent);
+        void addCaster(const Geometry* geometry,
+                       const Eigen::Vector3f& position,
+                       const Eigen::Quaternionf& orientation,
+                       double t);
+        bool matches(const Signature& other, float absoluteTolerance, float relativeTolerance) const;
+        void swap(Signature& other);
+
+        /** Return true if this signature describes the current contents of a
+          * shadow map.
+          */
+        bool isValid() const
+        {
+            return m_valid;
+        }
+
+        void invalidate()
+        {
+            m_valid = false;
+        }
+
+    private:
+        struct Caster
+        {
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+            const Geometry* geometry;
+            float boundingRadius;
+            Eigen::Vector3f position;
+            Eigen::Quaternionf orientation;
+            double time;
+            bool animated;
+        };
+        typedef std::vector<Caster, Eigen::aligned_allocator<Caster> > CasterVector;
+
+        bool m_valid;
+        Eigen::Vector3f m_direction;
+        float m_extent;
+        CasterVector m_casters;
+    };
+
+    ShadowMapCache(unsigned int shadowMapCount, unsigned int omniShadowMapCount);
+    ~ShadowMapCache();
+
+    void invalidate();
+
+    /** Get the signature of the shadow map with the specified index.
+      */
+    Signature& shadowMap(unsigned int index)
+    {
+        return m_shadowMaps[index];
+    }
+
+    /** Get the signature of one face of the cubic shadow map with the specified index.
+      */
+    Signature& omniShadowMapFace(unsigned int index, unsigned int face)
+    {
+        return m_omniShadowMapFaces[index * 6 + face];
+    }
+
+    /** Get the matrix that was used to draw the shadow map with the specified index. It
+      * maps from shadow group space to shadow map coordinates.
+      */
+    const Eigen::Matrix4f& shadowMatrix(unsigned int index) const
+    {
+        return m_shadowMatrices[index];
+    }
+
+    void setShadowMatrix(unsigned int index, const Eigen::Matrix4f& m)
+    {
+        m_shadowMatrices[index] = m;
+    }
+
+    /** Get a signature for collecting the casters of the shadow map about to be drawn; it
+      * is swapped with the stored signature whenever the shadow map is redrawn.
+      */
+    Signature& pendingSignature()
+    {
+        return m_pending;
+    }
+
+private:
+    std::vector<Signature> m_shadowMaps;
+    std::vector<Signature> m_omniShadowMapFaces;
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > m_shadowMatrices;
+    Signature m_pending;
+};
+
+}
+
+#endif // _VESTA_SHADOW_MAP_CACHE_H_
@@ -0,0 +1,184 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#include "StarVertexStream.h"
+#include "../StarCatalog.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+// Star colors are looked up in a table of B-V color indices, since converting a
+// color index to RGB is much more expensive than anything else done per vertex.
+// The table resolution is fine enough that the 8-bit colors differ by at most one
+// from the exact ones. Stars outside the range of the table (which only occurs for
+// bad catalog data), or near a jump in the color function, are converted
+// individually.
+static const float MinTableColorIndex = -0.5f;
+static const float MaxTableColorIndex = 3.0f;
+static const unsigned int ColorTableStepsPerMagnitude = 200;
+static const unsigned int ColorTableSize = (unsigned int) ((MaxTableColorIndex - MinTableColorIndex) * ColorTableStepsPerMagnitude) + 1;
+
+
+static void
+computeColor(StarVertexStream::VertexFormat format, float bvColorIndex, v_uint8 color[])
+{
+    Spectrum srgb = Spectrum::XYZtoLinearSRGB(StarCatalog::StarColor(bvColorIndex));
+    srgb.normalize();
+    if (format == StarVertexStream::FixedFunctionVertices)
+    {
+        srgb = Spectrum::LinearSRGBtoSRGB(srgb);
+    }
+
+    color[0] = (int) (255.0f * srgb.red() + 0.5f);
+    color[1] = (int) (255.0f * srgb.green() + 0.5f);
+    color[2] = (int) (255.0f * srgb.blue() + 0.5f);
+}
+
+
+/** Create a new stream. For fixed function vertices, the brightness stored in the
+  * alpha channel is computed for the specified limiting magnitude.
+  */
+StarVertexStream::StarVertexStream(VertexFormat format, float limitingMagnitude) :
+    m_format(format),
+    m_limitingMagnitude(limitingMagnitude),
+    m_catalog(NULL),
+    m_currentRange(0),
+    m_currentOffset(0),
+    m_starCount(0)
+{
+    // Four bytes per entry: the color and a flag that is set when the entry can be used
+    m_colorTable.resize(ColorTableSize * 4);
+    for (unsigned int i = 0; i < ColorTableSize; ++i)
+    {
+        float bv = MinTableColorIndex + float(i) / float(ColorTableStepsPerMagnitude);
+        computeColor(m_format, bv, &m_colorTable[i * 4]);
+        m_colorTable[i * 4 + 3] = 1;
+    }
+
+    for (unsigned int i = 1; i < ColorTableSize; ++i)
+    {
+        v_uint8* c0 = &m_colorTable[(i - 1) * 4];
+        v_uint8* c1 = &m_colorTable[i * 4];
+        for (unsigned int j = 0; j < 3; ++j)
+        {
+            if (abs(int(c0[j]) - int(c1[j])) > 1)
+            {
+                c0[3] = 0;
+                c1[3] = 0;
+            }
+        }
+    }
+}
+
+
+/** Start generating vertices for a new set of sky index ranges of a catalog.
+  */
+void
+StarVertexStream::begin(StarCatalog* catalog, const vector<StarSkyIndex::StarRange>& ranges)
+{
+    m_catalog = catalog;
+    m_ranges = ranges;
+    m_currentRange = 0;
+    m_currentOffset = 0;
+
+    m_starCount = 0;
+    for (vector<StarSkyIndex::StarRange>::const_iterator iter = ranges.begin(); iter != ranges.end(); ++iter)
+    {
+        m_starCount += iter->count;
+    }
+}
+
+
+/** Write vertices for as many of the remaining stars as will fit in a buffer
+  * with room for capacity vertices.
+  *
+  * \return the number of vertices written; zero once the stream is complete
+  */
+unsigned int
+StarVertexStream::next(char* vertices, unsigned int capacity)
+{
+    unsigned int vertexCount = 0;
+    const StarSkyIndex* skyIndex = m_catalog ? m_catalog->skyIndex() : NULL;
+
+    while (!isComplete() && vertexCount < capacity)
+    {
+        const StarSkyIndex::StarRange& range = m_ranges[m_currentRange];
+        unsigned int first = range.first + m_currentOffset;
+        unsigned int count = min(range.count - m_currentOffset, capacity - vertexCount);
+
+        m_catalog->pageIn(first, count);
+
+        if (m_format == ShaderVertices)
+        {
+            ShaderVertex* v = reinterpret_cast<ShaderVertex*>(vertices) + vertexCount;
+            for (unsigned int i = first; i < first + count; ++i, ++v)
+            {
+                const StarCatalog::StarRecord& star = m_catalog->star(skyIndex->catalogIndex(i));
+                Vector3f position = StarCatalog::StarPosition(star);
+                v->x = position.x();
+                v->y = position.y();
+                v->appMag = star.apparentMagnitude;
+                setColor(star.bvColorIndex, v->color);
+                v->color[3] = position.z() < 0.0f ? 0 : 255;
+            }
+        }
+        else
+        {
+            FixedFunctionVertex* v = reinterpret_cast<FixedFunctionVertex*>(vertices) + vertexCount;
+            for (unsigned int i = first; i < first + count; ++i, ++v)
+            {
+                const StarCatalog::StarRecord& star = m_catalog->star(skyIndex->catalogIndex(i));
+                Vector3f position = StarCatalog::StarPosition(star);
+                v->x = position.x();
+                v->y = position.y();
+                v->z = position.z();
+                setColor(star.bvColorIndex, v->color);
+
+                // Brightness falls off linearly from magnitude zero to the limiting magnitude
+                float brightness = min(1.0f, max(0.0f, (m_limitingMagnitude - star.apparentMagnitude) / m_limitingMagnitude));
+                v->color[3] = (v_uint8) (255.99f * brightness);
+            }
+        }
+
+        vertexCount += count;
+        m_currentOffset += count;
+        if (m_currentOffset == range.count)
+        {
+            ++m_currentRange;
+            m_currentOffset = 0;
+        }
+    }
+
+    return vertexCount;
+}
+
+
+void
+StarVertexStream::setColor(float bvColorIndex, v_uint8 color[]) const
+{
+    if (bvColorIndex >= MinTableColorIndex && bvColorIndex <= MaxTableColorIndex)
+    {
+        unsigned int i = (unsigned int) ((bvColorIndex - MinTableColorIndex) * ColorTableStepsPerMagnitude + 0.5f);
+        const v_uint8* c = &m_colorTable[min(i, ColorTableSize - 1) * 4];
+        if (c[3] != 0)
+        {
+            color[0] = c[0];
+            color[1] = c[1];
+            color[2] = c[2];
+            return;
+        }
+    }
+
+    computeColor(m_format, bvColorIndex, color);
+}
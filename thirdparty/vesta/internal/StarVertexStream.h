@@ -0,0 +1,105 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#ifndef _VESTA_STAR_VERTEX_STREAM_H_
+#define _VESTA_STAR_VERTEX_STREAM_H_
+
+#include "../StarSkyIndex.h"
+#include "../IntegerTypes.h"
+#include <vector>
+
+namespace vesta
+{
+
+class StarCatalog;
+
+// An internal class that generates star vertices for ranges of sky index
+// positions, such as the visible ranges found by StarSkyIndex::findVisibleStars().
+// The vertices are written in pieces to a caller supplied buffer of fixed size,
+// so that only the stars in view need to be converted and stored, and a catalog
+// much larger than the vertex buffer can be drawn.
+//
+// StarVertexStream makes no OpenGL calls; StarsLayer copies the vertices into a
+// vertex buffer and draws them.
+class StarVertexStream
+{
+public:
+    enum VertexFormat
+    {
+        // Position x and y, apparent magnitude, and linear sRGB color with the
+        // sign of z in alpha (for the star shader.)
+        ShaderVertices        = 0,
+
+        // Position and sRGB color with brightness in alpha (for fixed function
+        // OpenGL.)
+        FixedFunctionVertices = 1,
+    };
+
+    struct ShaderVertex
+    {
+        float x;
+        float y;
+        float appMag;
+        v_uint8 color[4];
+    };
+
+    struct FixedFunctionVertex
+    {
+        float x;
+        float y;
+        float z;
+        v_uint8 color[4];
+    };
+
+    StarVertexStream(VertexFormat format, float limitingMagnitude);
+
+    VertexFormat format() const
+    {
+        return m_format;
+    }
+
+    // Size in bytes of a single vertex
+    unsigned int vertexSize() const
+    {
+        return m_format == ShaderVertices ? sizeof(ShaderVertex) : sizeof(FixedFunctionVertex);
+    }
+
+    void begin(StarCatalog* catalog, const std::vector<StarSkyIndex::StarRange>& ranges);
+    unsigned int next(char* vertices, unsigned int capacity);
+
+    // True when all of the stars in the ranges passed to begin() have been written
+    bool isComplete() const
+    {
+        return m_currentRange >= m_ranges.size();
+    }
+
+    // The total number of stars in the ranges passed to begin()
+    unsigned int starCount() const
+    {
+        return m_starCount;
+    }
+
+private:
+    void setColor(float bvColorIndex, v_uint8 color[]) const;
+
+private:
+    VertexFormat m_format;
+    float m_limitingMagnitude;
+    std::vector<v_uint8> m_colorTable;
+    StarCatalog* m_catalog;
+    std::vector<StarSkyIndex::StarRange> m_ranges;
+    unsigned int m_currentRange;
+    unsigned int m_currentOffset;
+    unsigned int m_starCount;
+};
+
+}
+
+#endif // _VESTA_STAR_VERTEX_STREAM_H_
@@ -0,0 +1,154 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#include "TextBatch.h"
+#include <algorithm>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+// Size of a vertex produced by TextureFont::renderStringToBuffer(): position (3 floats) and
+// texture coordinate (2 floats)
+static const unsigned int FontVertexFloats = 5;
+static const unsigned int FontGlyphSize = FontVertexFloats * sizeof(float) * 6;
+
+
+static inline v_uint8
+colorToByte(float c)
+{
+    return v_uint8(max(0.0f, min(1.0f, c)) * 255.0f + 0.5f);
+}
+
+
+TextBatch::TextBatch()
+{
+}
+
+
+TextBatch::~TextBatch()
+{
+}
+
+
+// Add the glyphs of a string to the batch. The glyphs are generated exactly as
+// TextureFont::renderStringToBuffer() generates them for a string starting at
+// origin; the offset is then added to the position of every vertex. Returns the
+// number of glyphs added.
+unsigned int
+TextBatch::addText(const TextureFont* font,
+                   const std::string& text,
+                   TextureFont::Encoding encoding,
+                   const Vector2f& origin,
+                   const Vector3f& offset,
+                   const Spectrum& color,
+                   float opacity)
+{
+    if (!font || text.empty())
+    {
+        return 0;
+    }
+
+    // No encoding produces more than one glyph per byte
+    unsigned int scratchSize = text.size() * FontGlyphSize;
+    if (m_scratch.size() < scratchSize)
+    {
+        m_scratch.resize(scratchSize);
+    }
+
+    unsigned int vertexCount = 0;
+    font->renderStringToBuffer(text, origin, encoding, &m_scratch[0], scratchSize, &vertexCount);
+    if (vertexCount == 0)
+    {
+        return 0;
+    }
+
+    Vertex v;
+    v.color[0] = colorToByte(color.red());
+    v.color[1] = colorToByte(color.green());
+    v.color[2] = colorToByte(color.blue());
+    v.color[3] = colorToByte(opacity);
+
+    // Resizing grows the storage geometrically; reserving the exact size needed
+    // for each string would copy the whole run every time.
+    FontRun& run = findRun(font);
+    unsigned int firstVertex = run.vertices.size();
+    run.vertices.resize(firstVertex + vertexCount, v);
+
+    const float* fontVertex = reinterpret_cast<const float*>(&m_scratch[0]);
+    Vertex* out = &run.vertices[firstVertex];
+    for (unsigned int i = 0; i < vertexCount; ++i, fontVertex += FontVertexFloats, ++out)
+    {
+        out->position[0] = fontVertex[0] + offset.x();
+        out->position[1] = fontVertex[1] + offset.y();
+        out->position[2] = fontVertex[2] + offset.z();
+        out->texCoord[0] = fontVertex[3];
+        out->texCoord[1] = fontVertex[4];
+    }
+
+    return vertexCount / 6;
+}
+
+
+// Remove all glyphs from the batch. Allocated storage is kept for reuse.
+void
+TextBatch::clear()
+{
+    for (vector<FontRun>::iterator iter = m_runs.begin(); iter != m_runs.end(); ++iter)
+    {
+        iter->vertices.clear();
+    }
+}
+
+
+bool
+TextBatch::empty() const
+{
+    for (vector<FontRun>::const_iterator iter = m_runs.begin(); iter != m_runs.end(); ++iter)
+    {
+        if (!iter->vertices.empty())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Find the run for a font, reusing the run of a font that has no glyphs in the
+// batch if this font doesn't have one yet. There are rarely more than a few fonts.
+TextBatch::FontRun&
+TextBatch::findRun(const TextureFont* font)
+{
+    FontRun* emptyRun = NULL;
+    for (vector<FontRun>::iterator iter = m_runs.begin(); iter != m_runs.end(); ++iter)
+    {
+        if (iter->font == font)
+        {
+            return *iter;
+        }
+        else if (!emptyRun && iter->vertices.empty())
+        {
+            emptyRun = &*iter;
+        }
+    }
+
+    if (emptyRun)
+    {
+        emptyRun->font = font;
+        return *emptyRun;
+    }
+
+    m_runs.push_back(FontRun());
+    m_runs.back().font = font;
+    return m_runs.back();
+}
@@ -0,0 +1,87 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#ifndef _VESTA_TEXT_BATCH_H_
+#define _VESTA_TEXT_BATCH_H_
+
+#include "../TextureFont.h"
+#include "../Spectrum.h"
+#include "../IntegerTypes.h"
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+
+namespace vesta
+{
+
+// An internal class that accumulates the glyph quads of many strings so that they
+// can be drawn with a single draw call per font. Strings are converted to
+// triangles in viewport coordinates, with the color and opacity of each string
+// stored in its vertices. The layout of a vertex matches VertexSpec::PositionColorTex.
+//
+// TextBatch makes no OpenGL calls; RenderContext draws the accumulated vertices.
+class TextBatch
+{
+public:
+    TextBatch();
+    ~TextBatch();
+
+    struct Vertex
+    {
+        float position[3];
+        v_uint8 color[4];
+        float texCoord[2];
+    };
+
+    unsigned int addText(const TextureFont* font,
+                         const std::string& text,
+                         TextureFont::Encoding encoding,
+                         const Eigen::Vector2f& origin,
+                         const Eigen::Vector3f& offset,
+                         const Spectrum& color,
+                         float opacity);
+
+    void clear();
+    bool empty() const;
+
+    // The number of fonts with vertices in the batch (including fonts whose
+    // vertices were cleared; check the vertex count before drawing.)
+    unsigned int fontCount() const
+    {
+        return m_runs.size();
+    }
+
+    const TextureFont* font(unsigned int index) const
+    {
+        return m_runs[index].font;
+    }
+
+    const std::vector<Vertex>& vertices(unsigned int index) const
+    {
+        return m_runs[index].vertices;
+    }
+
+private:
+    struct FontRun
+    {
+        const TextureFont* font;
+        std::vector<Vertex> vertices;
+    };
+
+    FontRun& findRun(const TextureFont* font);
+
+private:
+    std::vector<FontRun> m_runs;
+    std::vector<char> m_scratch;
+};
+
+}
+
+#endif // _VESTA_TEXT_BATCH_H_
@@ -0,0 +1,146 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#include "TileVertexCache.h"
+#include "../Units.h"
+#include <cmath>
+#include <cstring>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+TileVertexCache::TileVertexCache(unsigned int capacity) :
+    m_capacity(capacity),
+    m_missCount(0)
+{
+}
+
+
+/** Get a vertex buffer with the vertices of a tile, generating them if they
+  * aren't already in the cache. Returns NULL if a vertex buffer couldn't be
+  * created.
+  */
+VertexBuffer*
+TileVertexCache::tileVertices(const Key& key, const Vector2f& southwest, float extent)
+{
+    EntryIndex::iterator iter = m_index.find(key);
+    if (iter != m_index.end())
+    {
+        // Move the entry to the front of the LRU list
+        m_entries.splice(m_entries.begin(), m_entries, iter->second);
+        return iter->second->vertices.ptr();
+    }
+
+    ++m_missCount;
+
+    const unsigned int size = VertexCount * VertexStride * sizeof(float);
+    float vertexData[VertexCount * VertexStride];
+    GenerateVertices(southwest, extent, key.u0, key.v0, key.du, key.dv, vertexData);
+
+    counted_ptr<VertexBuffer> vertices;
+    if (m_entries.size() >= m_capacity)
+    {
+        // Evict the least recently used entry and reuse its buffer
+        vertices = m_entries.back().vertices;
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+
+        void* data = vertices->mapWriteOnly();
+        if (data)
+        {
+            memcpy(data, vertexData, size);
+            vertices->unmap();
+        }
+        else
+        {
+            vertices = NULL;
+        }
+    }
+
+    if (vertices.isNull())
+    {
+        vertices = VertexBuffer::Create(size, VertexBuffer::StaticDraw, vertexData);
+        if (vertices.isNull())
+        {
+            return NULL;
+        }
+    }
+
+    m_entries.push_front(Entry(key, vertices.ptr()));
+    m_index[key] = m_entries.begin();
+
+    return vertices.ptr();
+}
+
+
+/** Fill in the vertices of a tile patch. Positions lie on the unit sphere; the
+  * modelview matrix is used to scale them to the size of the world. Texture
+  * coordinates of vertex (i, j) are (u0 + j * du, 1 - (v0 + i * dv)).
+  */
+void
+TileVertexCache::GenerateVertices(const Vector2f& southwest, float extent,
+                                  float u0, float v0, float du, float dv,
+                                  float* vertexData)
+{
+    const unsigned int n = QuadtreeTile::TileSubdivision;
+
+    float tileArc = float(PI) * extent;
+    float lonWest = float(PI) * southwest.x();
+    float latSouth = float(PI) * southwest.y();
+    float dlon = tileArc / float(n);
+    float dlat = tileArc / float(n);
+
+    // Precompute a trig table for this patch
+    float sines[QuadtreeTile::TileSubdivision + 1];
+    float cosines[QuadtreeTile::TileSubdivision + 1];
+    for (unsigned int i = 0; i <= n; ++i)
+    {
+        float lon = lonWest + i * dlon;
+        sines[i] = sin(lon);
+        cosines[i] = cos(lon);
+    }
+
+    float* vertex = vertexData;
+    for (unsigned int i = 0; i <= n; ++i)
+    {
+        float v = v0 + i * dv;
+        float lat = latSouth + i * dlat;
+        float cosLat = cos(lat);
+        float sinLat = sin(lat);
+
+        for (unsigned int j = 0; j <= n; ++j)
+        {
+            Vector3f p(cosLat * cosines[j], cosLat * sines[j], sinLat);
+
+            // Position
+            vertex[0]  = p.x();
+            vertex[1]  = p.y();
+            vertex[2]  = p.z();
+
+            // Vertex normal
+            vertex[3]  = p.x();
+            vertex[4]  = p.y();
+            vertex[5]  = p.z();
+
+            // Texture coordinate
+            vertex[6]  = u0 + j * du;
+            vertex[7]  = 1.0f - v;
+
+            // Tangent (we use dP/du), where P(u,v) is the sphere parametrization
+            vertex[8]  = -sines[j];
+            vertex[9]  = cosines[j];
+            vertex[10] = 0.0f;
+
+            vertex += VertexStride;
+        }
+    }
+}
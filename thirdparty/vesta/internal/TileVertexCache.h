@@ -0,0 +1,126 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#ifndef _VESTA_TILE_VERTEX_CACHE_H_
+#define _VESTA_TILE_VERTEX_CACHE_H_
+
+#include "../QuadtreeTile.h"
+#include "../VertexBuffer.h"
+#include <Eigen/Core>
+#include <list>
+#include <map>
+
+namespace vesta
+{
+
+// An internal class that keeps the vertices of recently drawn quadtree tiles in
+// vertex buffers so that they don't have to be recomputed every frame. Since tile
+// vertices lie on the unit sphere, a cache entry depends only on the tile address
+// and the texture coordinates, and it can be shared by every world (and by cloud
+// and atmosphere shells.) Once the cache is full, the buffer of the least recently
+// used entry is reused.
+//
+// Every vertex has the full position, normal, texture coordinate, and tangent
+// layout; vertex specs with explicit offsets select the attributes that a
+// particular drawing path needs.
+class TileVertexCache
+{
+public:
+    struct Key
+    {
+        unsigned int level;
+        unsigned int column;
+        unsigned int row;
+        float u0;
+        float v0;
+        float du;
+        float dv;
+
+        bool operator<(const Key& other) const
+        {
+            if (level != other.level)   return level < other.level;
+            if (column != other.column) return column < other.column;
+            if (row != other.row)       return row < other.row;
+            if (u0 != other.u0)         return u0 < other.u0;
+            if (v0 != other.v0)         return v0 < other.v0;
+            if (du != other.du)         return du < other.du;
+            return dv < other.dv;
+        }
+    };
+
+    TileVertexCache(unsigned int capacity = DefaultCapacity);
+
+    VertexBuffer* tileVertices(const Key& key, const Eigen::Vector2f& southwest, float extent);
+
+    static void GenerateVertices(const Eigen::Vector2f& southwest, float extent,
+                                 float u0, float v0, float du, float dv,
+                                 float* vertexData);
+
+    unsigned int capacity() const
+    {
+        return m_capacity;
+    }
+
+    /** Get the number of tiles that currently have cached vertices.
+      */
+    unsigned int entryCount() const
+    {
+        return (unsigned int) m_entries.size();
+    }
+
+    /** Get the total number of times that vertices were generated because a tile
+      * wasn't in the cache.
+      */
+    unsigned long missCount() const
+    {
+        return m_missCount;
+    }
+
+    /** Number of vertices in a tile patch.
+      */
+    static const unsigned int VertexCount = (QuadtreeTile::TileSubdivision + 1) * (QuadtreeTile::TileSubdivision + 1);
+
+    /** Number of floats in each vertex.
+      */
+    static const unsigned int VertexStride = 11;
+
+    /** Capacity of the cache shared by all quadtree tiles. The cache must hold every
+      * tile drawn in a frame, or tiles are regenerated on every draw. A planet drawn
+      * with surface and cloud shells in two stereo eyes and six cube map faces uses
+      * up to about 270 entries at 2160 pixels (see tools/tilevertexbench), so this
+      * leaves room for several planets and a second cube map. At 17x17 vertices of
+      * 44 bytes each, this is about 26MB of vertex data.
+      */
+    static const unsigned int DefaultCapacity = 2048;
+
+private:
+    struct Entry
+    {
+        Entry(const Key& _key, VertexBuffer* _vertices) :
+            key(_key), vertices(_vertices)
+        {
+        }
+
+        Key key;
+        counted_ptr<VertexBuffer> vertices;
+    };
+
+    typedef std::list<Entry> EntryList;
+    typedef std::map<Key, EntryList::iterator> EntryIndex;
+
+    unsigned int m_capacity;
+    EntryList m_entries;
+    EntryIndex m_index;
+    unsigned long m_missCount;
+};
+
+}
+
+#endif // _VESTA_TILE_VERTEX_CACHE_H_
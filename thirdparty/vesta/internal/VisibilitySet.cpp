@@ -0,0 +1,493 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#include "VisibilitySet.h"
+#include "../Entity.h"
+#include "../Geometry.h"
+#include "../Visualizer.h"
+#include "../BoundingSphere.h"
+#include <algorithm>
+#include <iterator>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+// Same as UniverseRenderer::MinimumNearDistance
+static const float MinimumNearPlaneDistance = 0.00001f;  // 1 centimeter
+
+// Near distances for objects that may be clipped are never less than this
+// fraction of the bounding diameter.
+static const float MinimumNearFarRatio = 0.001f;
+
+
+static bool
+visibleItemPredicate(const VisibilitySet::VisibleItem& item0,
+                     const VisibilitySet::VisibleItem& item1)
+{
+    return item0.farDistance < item1.farDistance;
+}
+
+
+VisibilitySet::VisibilitySet() :
+    m_time(0.0),
+    m_candidatesValid(false),
+    m_candidateCameraPosition(Vector3d::Zero()),
+    m_candidatePixelSize(0.0f),
+    m_candidateVisualizersEnabled(false)
+{
+}
+
+
+VisibilitySet::~VisibilitySet()
+{
+}
+
+
+// Get the number of bins (and threads) to use for a pass over the specified
+// number of items, and clear the bins.
+unsigned int
+VisibilitySet::binCount(int itemCount)
+{
+    unsigned int count = 1;
+#ifdef _OPENMP
+    if (itemCount >= MinimumParallelEntityCount)
+    {
+        count = (unsigned int) max(1, omp_get_max_threads());
+    }
+#endif
+
+    if (m_bins.size() < count)
+    {
+        m_bins.resize(count);
+    }
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        Bin& bin = m_bins[i];
+        bin.entityStates.clear();
+        bin.visualizerStates.clear();
+        bin.shadowCasters.clear();
+        bin.candidates.clear();
+        bin.visibleItems.clear();
+        bin.splittableItems.clear();
+    }
+
+    return count;
+}
+
+
+/** Evaluate the positions of all entities visible at time t. This must be
+  * called at the start of every view set, before build() is called for any
+  * of the views.
+  *
+  * This method must not be called while the entities, their trajectories, or
+  * their geometry are being modified.
+  */
+void
+VisibilitySet::evaluate(const vector<Entity*>& entities, double t, bool shadowCastersRequired)
+{
+    m_time = t;
+    m_candidatesValid = false;
+
+    int entityCount = int(entities.size());
+    unsigned int bins = binCount(entityCount);
+
+    // A static schedule hands each thread one contiguous block of entities, with
+    // the blocks assigned in thread order.
+#pragma omp parallel for num_threads(bins) schedule(static) if(bins > 1)
+    for (int i = 0; i < entityCount; ++i)
+    {
+#ifdef _OPENMP
+        Bin& bin = m_bins[omp_get_thread_num()];
+#else
+        Bin& bin = m_bins[0];
+#endif
+        evaluateEntity(bin, entities[i], shadowCastersRequired);
+    }
+
+    m_entityStates.clear();
+    m_visualizerStates.clear();
+    m_shadowCasters.clear();
+    for (unsigned int i = 0; i < bins; ++i)
+    {
+        const Bin& bin = m_bins[i];
+
+        // Visualizer indices in the bin are relative to the bin's visualizer list
+        unsigned int visualizerOffset = m_visualizerStates.size();
+        for (EntityStateVector::const_iterator iter = bin.entityStates.begin(); iter != bin.entityStates.end(); ++iter)
+        {
+            m_entityStates.push_back(*iter);
+            m_entityStates.back().firstVisualizer += visualizerOffset;
+        }
+
+        m_visualizerStates.insert(m_visualizerStates.end(), bin.visualizerStates.begin(), bin.visualizerStates.end());
+        m_shadowCasters.insert(m_shadowCasters.end(), bin.shadowCasters.begin(), bin.shadowCasters.end());
+    }
+}
+
+
+/** Find all visible items for a view. Only the entities evaluated by the last
+  * call to evaluate() are considered. Each thread sorts the items it finds, and
+  * the per-thread lists are then merged into the final depth sorted lists.
+  */
+void
+VisibilitySet::build(const ViewParameters& view)
+{
+    findCandidates(view);
+
+    int candidateCount = int(m_candidates.size());
+    unsigned int bins = binCount(candidateCount);
+
+#pragma omp parallel num_threads(bins) if(bins > 1)
+    {
+#ifdef _OPENMP
+        Bin& bin = m_bins[omp_get_thread_num()];
+#else
+        Bin& bin = m_bins[0];
+#endif
+
+        // Each entity is handled by exactly one thread, so its cached orientations
+        // may be filled in without locking.
+#pragma omp for schedule(static)
+        for (int i = 0; i < candidateCount; ++i)
+        {
+            addEntityItems(bin, m_entityStates[m_candidates[i]], view);
+        }
+
+        sort(bin.visibleItems.begin(), bin.visibleItems.end(), visibleItemPredicate);
+        sort(bin.splittableItems.begin(), bin.splittableItems.end(), visibleItemPredicate);
+    }
+
+    mergeBins(m_visibleItems, m_bins, bins, &Bin::visibleItems);
+    mergeBins(m_splittableItems, m_bins, bins, &Bin::splittableItems);
+}
+
+
+// Merge the sorted item lists from all bins into a single sorted list.
+void
+VisibilitySet::mergeBins(VisibleItemVector& items, const vector<Bin>& bins, unsigned int binCount, VisibleItemVector Bin::* list)
+{
+    items.clear();
+
+    VisibleItemVector merged;
+    for (unsigned int i = 0; i < binCount; ++i)
+    {
+        const VisibleItemVector& binItems = bins[i].*list;
+        if (binItems.empty())
+        {
+            continue;
+        }
+
+        if (items.empty())
+        {
+            items = binItems;
+        }
+        else
+        {
+            merged.clear();
+            merged.reserve(items.size() + binItems.size());
+            merge(items.begin(), items.end(), binItems.begin(), binItems.end(), back_inserter(merged), visibleItemPredicate);
+            items.swap(merged);
+        }
+    }
+}
+
+
+// Record the state of an entity if it's visible and has anything that could be
+// drawn. This is called concurrently from multiple threads, and so must not
+// modify anything but the bin.
+void
+VisibilitySet::evaluateEntity(Bin& bin, const Entity* entity, bool shadowCastersRequired) const
+{
+    if (!entity->isVisible(m_time))
+    {
+        return;
+    }
+
+    unsigned int firstVisualizer = bin.visualizerStates.size();
+    if (entity->hasVisualizers())
+    {
+        for (Entity::VisualizerTable::const_iterator iter = entity->visualizers()->begin();
+             iter != entity->visualizers()->end(); ++iter)
+        {
+            const Visualizer* visualizer = iter->second.ptr();
+            if (visualizer->isVisible())
+            {
+                VisualizerState visualizerState;
+                visualizerState.visualizer = visualizer;
+                visualizerState.orientation = Quaternionf::Identity();
+                visualizerState.orientationValid = false;
+                bin.visualizerStates.push_back(visualizerState);
+            }
+        }
+    }
+
+    unsigned int visualizerCount = bin.visualizerStates.size() - firstVisualizer;
+
+    // Objects without geometry are always culled, so there's no need to compute
+    // their positions unless they have visualizers.
+    const Geometry* geometry = entity->geometry();
+    if (!geometry && visualizerCount == 0)
+    {
+        return;
+    }
+
+    EntityState state;
+    state.entity = entity;
+    state.position = entity->position(m_time);
+    state.orientation = Quaternionf::Identity();
+    state.orientationValid = false;
+    state.firstVisualizer = firstVisualizer;
+    state.visualizerCount = visualizerCount;
+
+    if (shadowCastersRequired &&
+        geometry &&
+        geometry->isEllipsoidal() &&
+        geometry->isShadowCaster() &&
+        !entity->lightSource())
+    {
+        state.orientation = entity->orientation(m_time).cast<float>();
+        state.orientationValid = true;
+
+        ShadowCaster caster;
+        caster.entity = entity;
+        caster.position = state.position;
+        caster.orientation = state.orientation;
+        bin.shadowCasters.push_back(caster);
+    }
+
+    bin.entityStates.push_back(state);
+}
+
+
+// Return true if an entity may have items visible in the specified view: either
+// its geometry is at least half a pixel in size or it has visualizers. Visualizers
+// have sizes that may be unrelated to the size of the object, so they aren't
+// culled.
+bool
+VisibilitySet::isCandidate(const EntityState& state, const ViewParameters& view) const
+{
+    if (view.visualizersEnabled && state.visualizerCount > 0)
+    {
+        return true;
+    }
+
+    const Geometry* geometry = state.entity->geometry();
+    if (geometry)
+    {
+        Vector3d cameraRelativePosition = state.position - view.cameraPosition;
+        float projectedSize = (geometry->boundingSphereRadius() / float(cameraRelativePosition.norm())) / view.pixelSize;
+        return projectedSize >= 0.5f;
+    }
+
+    return false;
+}
+
+
+// Apply the size test to all evaluated entities. The test depends only on the
+// camera position and pixel size, so the candidates are reused when consecutive
+// views differ only in their orientation.
+void
+VisibilitySet::findCandidates(const ViewParameters& view)
+{
+    if (m_candidatesValid &&
+        m_candidateCameraPosition == view.cameraPosition &&
+        m_candidatePixelSize == view.pixelSize &&
+        m_candidateVisualizersEnabled == view.visualizersEnabled)
+    {
+        return;
+    }
+
+    int stateCount = int(m_entityStates.size());
+    unsigned int bins = binCount(stateCount);
+
+#pragma omp parallel for num_threads(bins) schedule(static) if(bins > 1)
+    for (int i = 0; i < stateCount; ++i)
+    {
+#ifdef _OPENMP
+        Bin& bin = m_bins[omp_get_thread_num()];
+#else
+        Bin& bin = m_bins[0];
+#endif
+        if (isCandidate(m_entityStates[i], view))
+        {
+            bin.candidates.push_back((unsigned int) i);
+        }
+    }
+
+    m_candidates.clear();
+    for (unsigned int i = 0; i < bins; ++i)
+    {
+        m_candidates.insert(m_candidates.end(), m_bins[i].candidates.begin(), m_bins[i].candidates.end());
+    }
+
+    m_candidatesValid = true;
+    m_candidateCameraPosition = view.cameraPosition;
+    m_candidatePixelSize = view.pixelSize;
+    m_candidateVisualizersEnabled = view.visualizersEnabled;
+}
+
+
+// Add the items for an entity and all of its visualizers. This is called
+// concurrently from multiple threads, and so must not modify anything but the
+// bin and the entity's own state.
+void
+VisibilitySet::addEntityItems(Bin& bin, EntityState& state, const ViewParameters& view)
+{
+    const Entity* entity = state.entity;
+    const Geometry* geometry = entity->geometry();
+
+    // Calculate the difference at double precision, then convert to single
+    // precision for the rest of the work.
+    Vector3d cameraRelativePosition = state.position - view.cameraPosition;
+
+    // We need the camera space position of the object in order to depth
+    // sort the objects.
+    Vector3f cameraSpacePosition = view.toCameraSpace * cameraRelativePosition.cast<float>();
+
+    // Candidates with visualizers may still have geometry too small to draw
+    bool sizeCull = true;
+    if (geometry)
+    {
+        float projectedSize = (geometry->boundingSphereRadius() / float(cameraRelativePosition.norm())) / view.pixelSize;
+        sizeCull = projectedSize < 0.5f;
+    }
+
+    if (!sizeCull)
+    {
+        if (!state.orientationValid)
+        {
+            state.orientation = entity->orientation(m_time).cast<float>();
+            state.orientationValid = true;
+        }
+
+        addItem(bin, entity, geometry,
+                state.position, cameraRelativePosition, cameraSpacePosition,
+                state.orientation,
+                view);
+    }
+
+    if (view.visualizersEnabled)
+    {
+        for (unsigned int i = state.firstVisualizer; i < state.firstVisualizer + state.visualizerCount; ++i)
+        {
+            VisualizerState& visualizerState = m_visualizerStates[i];
+            const Visualizer* visualizer = visualizerState.visualizer;
+
+            Vector3d adjustedPosition = cameraRelativePosition;
+            Vector3f adjustedCameraSpacePosition = cameraSpacePosition;
+
+            if (visualizer->depthAdjustment() == Visualizer::AdjustToFront)
+            {
+                // Adjust the position of the visualizer so that it is drawn in
+                // front of the object to which it is attached.
+                if (geometry)
+                {
+                    float z = -cameraSpacePosition.z() - geometry->boundingSphereRadius();
+                    float f = z / -cameraSpacePosition.z();
+                    adjustedPosition *= f;
+                    adjustedCameraSpacePosition *= f;
+                }
+            }
+
+            if (!visualizerState.orientationValid)
+            {
+                visualizerState.orientation = visualizer->orientation(entity, m_time).cast<float>();
+                visualizerState.orientationValid = true;
+            }
+
+            addItem(bin, entity, visualizer->geometry(),
+                    state.position, adjustedPosition, adjustedCameraSpacePosition,
+                    visualizerState.orientation,
+                    view);
+        }
+    }
+}
+
+
+void
+VisibilitySet::addItem(Bin& bin,
+                       const Entity* entity,
+                       const Geometry* geometry,
+                       const Vector3d& position,
+                       const Vector3d& cameraRelativePosition,
+                       const Vector3f& cameraSpacePosition,
+                       const Quaternionf& orientation,
+                       const ViewParameters& view)
+{
+    // Compute the signed distance from the camera plane to the most
+    // distant part of the entity. A distance < 0 indicates that the
+    // entity lies completely behind the camera.
+    float boundingRadius = geometry->boundingSphereRadius();
+    float farDistance = -cameraSpacePosition.z() + boundingRadius;
+
+    // Calculate a near distance that's as far from the camera as possible.
+    float nearDistance = geometry->nearPlaneDistance(orientation.conjugate() * -cameraRelativePosition.cast<float>());
+
+    // Generally, the near distance for an individual object will never be less
+    // than MinimumNearFarRatio times the bounding diameter. Exceptions are things
+    // like trajectories, which should never be clipped by the near plane. This
+    // is handled by marking trajectories as splittable, so that they will be
+    // drawn into multiple depth buffer spans when necessary.
+    switch (geometry->clippingPolicy())
+    {
+    case Geometry::PreserveDepthPrecision:
+        nearDistance = std::max(nearDistance, boundingRadius * MinimumNearFarRatio * 2.0f);
+        break;
+
+    case Geometry::PreventClipping:
+    case Geometry::SplitToPreventClipping:
+        nearDistance = std::max(nearDistance, MinimumNearPlaneDistance);
+        break;
+
+    case Geometry::ZeroExtent:
+        nearDistance = std::max(nearDistance * 0.98f, MinimumNearPlaneDistance);
+        farDistance = farDistance * 1.02f;
+        break;
+    }
+
+    // ...but make sure that the near plane of the view frustum doesn't
+    // intersect the object's geometry. Note that if nearDistance is greater
+    // farDistance, it means that the object lies outside the view frustum.
+    nearDistance *= view.nearAdjust;
+
+    // Objects outside the frustum are kept (and marked) because they may still
+    // cast shadows into the view.
+    bool intersectsFrustum = view.frustum.intersects(BoundingSphere<float>(cameraSpacePosition, boundingRadius));
+
+    // Add entities in front of the camera to the list of visible items
+    if (farDistance > 0 && nearDistance < farDistance)
+    {
+        VisibleItem visibleItem;
+        visibleItem.entity = entity;
+        visibleItem.geometry = geometry;
+        visibleItem.position = position;
+        visibleItem.cameraRelativePosition = cameraRelativePosition;
+        visibleItem.orientation = orientation;
+        visibleItem.boundingRadius = boundingRadius;
+        visibleItem.nearDistance = nearDistance;
+        visibleItem.farDistance = farDistance;
+        visibleItem.outsideFrustum = !intersectsFrustum;
+
+        if (geometry->clippingPolicy() == Geometry::SplitToPreventClipping)
+        {
+            bin.splittableItems.push_back(visibleItem);
+        }
+        else
+        {
+            bin.visibleItems.push_back(visibleItem);
+        }
+    }
+}
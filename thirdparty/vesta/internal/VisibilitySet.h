@@ -0,0 +1,187 @@
+/*
+ * $Revision$ $Date$
+ *
+ * Copyright by Astos Solutions GmbH, Germany
+ *
+ * this file is published under the Astos Solutions Free Public License
+ * For details on copyright and terms of use see
+ * http://www.astos.de/Astos_Solutions_Free_Public_License.html
+ */
+
+#ifndef _VESTA_VISIBILITY_SET_H_
+#define _VESTA_VISIBILITY_SET_H_
+
+#include "../UniverseRenderer.h"
+#include "../Frustum.h"
+#include "../Object.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+#include <vector>
+
+namespace vesta
+{
+
+class Entity;
+class Visualizer;
+
+// An internal class that determines which entities in a universe are visible
+// from a camera position. The work is done in two passes, neither of which
+// makes any OpenGL calls, so both run in parallel:
+//
+//   evaluate() - once per view set, computes the positions of all visible
+//                entities and finds the eclipse shadow casters.
+//   build()    - once per view, culls the evaluated entities against the view
+//                and produces depth sorted lists of visible items.
+//
+// All views in a view set (the faces of a cube map, a pair of stereo views, or
+// a reflection map and the main view) share the entity positions, and each
+// orientation is computed at most once per view set.
+class VisibilitySet : public Object
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    VisibilitySet();
+    ~VisibilitySet();
+
+    typedef UniverseRenderer::VisibleItem VisibleItem;
+    typedef UniverseRenderer::VisibleItemVector VisibleItemVector;
+
+    // An ellipsoidal body that may cast an eclipse shadow
+    struct ShadowCaster
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        const Entity* entity;
+        Eigen::Vector3d position;
+        Eigen::Quaternionf orientation;
+    };
+    typedef std::vector<ShadowCaster, Eigen::aligned_allocator<ShadowCaster> > ShadowCasterVector;
+
+    struct ViewParameters
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        Eigen::Vector3d cameraPosition;
+        Eigen::Matrix3f toCameraSpace;
+        Frustum frustum;
+        float pixelSize;
+        float nearAdjust;
+        bool visualizersEnabled;
+    };
+
+    void evaluate(const std::vector<Entity*>& entities, double t, bool shadowCastersRequired);
+    void build(const ViewParameters& view);
+
+    /** Get the items that can be drawn in a single depth buffer span, sorted from
+      * front to back.
+      */
+    VisibleItemVector& visibleItems()
+    {
+        return m_visibleItems;
+    }
+
+    /** Get the items that may need to be split across depth buffer spans, sorted
+      * from front to back.
+      */
+    VisibleItemVector& splittableItems()
+    {
+        return m_splittableItems;
+    }
+
+    /** Get the ellipsoidal shadow casters found by the last call to evaluate(). The
+      * list is only filled in when shadow casters were requested.
+      */
+    const ShadowCasterVector& shadowCasters() const
+    {
+        return m_shadowCasters;
+    }
+
+    /** Get the number of entities with evaluated positions.
+      */
+    unsigned int evaluatedEntityCount() const
+    {
+        return m_entityStates.size();
+    }
+
+    /** Item count below which a pass is always run on the calling thread; for
+      * small universes, the work isn't worth the cost of waking worker threads.
+      */
+    static const int MinimumParallelEntityCount = 256;
+
+private:
+    // The view independent state of an entity that is visible at the view set time
+    struct EntityState
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        const Entity* entity;
+        Eigen::Vector3d position;
+        Eigen::Quaternionf orientation;
+        bool orientationValid;
+        unsigned int firstVisualizer;
+        unsigned int visualizerCount;
+    };
+    typedef std::vector<EntityState, Eigen::aligned_allocator<EntityState> > EntityStateVector;
+
+    struct VisualizerState
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        const Visualizer* visualizer;
+        Eigen::Quaternionf orientation;
+        bool orientationValid;
+    };
+    typedef std::vector<VisualizerState, Eigen::aligned_allocator<VisualizerState> > VisualizerStateVector;
+
+    // Results from a single thread. Each thread handles a contiguous range of
+    // entities, so concatenating the bins preserves entity order.
+    struct Bin
+    {
+        EntityStateVector entityStates;
+        VisualizerStateVector visualizerStates;
+        ShadowCasterVector shadowCasters;
+        std::vector<unsigned int> candidates;
+        VisibleItemVector visibleItems;
+        VisibleItemVector splittableItems;
+    };
+
+    unsigned int binCount(int itemCount);
+    void evaluateEntity(Bin& bin, const Entity* entity, bool shadowCastersRequired) const;
+    bool isCandidate(const EntityState& state, const ViewParameters& view) const;
+    void findCandidates(const ViewParameters& view);
+    void addEntityItems(Bin& bin, EntityState& state, const ViewParameters& view);
+    static void addItem(Bin& bin,
+                        const Entity* entity,
+                        const Geometry* geometry,
+                        const Eigen::Vector3d& position,
+                        const Eigen::Vector3d& cameraRelativePosition,
+                        const Eigen::Vector3f& cameraSpacePosition,
+                        const Eigen::Quaternionf& orientation,
+                        const ViewParameters& view);
+    static void mergeBins(VisibleItemVector& items, const std::vector<Bin>& bins, unsigned int binCount, VisibleItemVector Bin::* list);
+
+private:
+    double m_time;
+    std::vector<Bin> m_bins;
+
+    EntityStateVector m_entityStates;
+    VisualizerStateVector m_visualizerStates;
+    ShadowCasterVector m_shadowCasters;
+
+    // Entities that pass the size test for the last view. Views that share a camera
+    // position and pixel size (such as the faces of a cube map) share candidates.
+    std::vector<unsigned int> m_candidates;
+    bool m_candidatesValid;
+    Eigen::Vector3d m_candidateCameraPosition;
+    float m_candidatePixelSize;
+    bool m_candidateVisualizersEnabled;
+
+    VisibleItemVector m_visibleItems;
+    VisibleItemVector m_splittableItems;
+};
+
+}
+
+#endif // _VESTA_VISIBILITY_SET_H_
@@ -0,0 +1,236 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** cubeschedule - Check that amortized cube map updates converge
+ *
+ * Usage: cubeschedule [trial count]
+ *
+ * A simulated cube map records, for each face, the center and time at which
+ * it was last drawn. Each trial moves the center and advances the time for a
+ * random number of frames (with occasional large jumps), then holds them
+ * still. Faces are drawn only when CubeMapUpdateSchedule asks for them. Once
+ * the center and time stop changing, every face must be drawn within
+ * ceil(6 / faces per update) frames, after which the map must match one
+ * drawn with all six faces at once and no further faces may be requested.
+ * No OpenGL context is required.
+ */
+
+#include <vesta/CubeMapUpdateSchedule.h>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const unsigned int FaceCount = 6;
+static const unsigned int AllFaces = 0x3f;
+static const double JumpThreshold = 100.0;
+
+
+static double
+uniformRandom()
+{
+    return double(rand()) / double(RAND_MAX);
+}
+
+
+struct FaceContents
+{
+    Vector3d center;
+    double t;
+};
+
+
+struct SimulatedCubeMap
+{
+    FaceContents faces[FaceCount];
+
+    void draw(unsigned int faceMask, const Vector3d& center, double t)
+    {
+        for (unsigned int face = 0; face < FaceCount; ++face)
+        {
+            if ((faceMask & (1u << face)) != 0)
+            {
+                faces[face].center = center;
+                faces[face].t = t;
+            }
+        }
+    }
+
+    bool isCurrent(const Vector3d& center, double t) const
+    {
+        for (unsigned int face = 0; face < FaceCount; ++face)
+        {
+            if ((faces[face].center - center).norm() != 0.0 || faces[face].t != t)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+
+static unsigned int
+faceCount(unsigned int faceMask)
+{
+    unsigned int count = 0;
+    for (unsigned int face = 0; face < FaceCount; ++face)
+    {
+        if ((faceMask & (1u << face)) != 0)
+        {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+
+// Run one trial; return the number of problems found.
+static unsigned int
+runTrial(unsigned int facesPerUpdate, unsigned int* framesToConverge)
+{
+    unsigned int problems = 0;
+
+    CubeMapUpdateSchedule schedule(facesPerUpdate);
+    schedule.setJumpThreshold(JumpThreshold);
+    SimulatedCubeMap cubeMap;
+
+    Vector3d center(uniformRandom() * 1000.0, uniformRandom() * 1000.0, uniformRandom() * 1000.0);
+    double t = uniformRandom() * 1.0e6;
+
+    // The first update always draws everything
+    unsigned int faces = schedule.nextFaces(center, t);
+    if (faces != AllFaces)
+    {
+        ++problems;
+    }
+    cubeMap.draw(faces, center, t);
+
+    // Moving phase. While things change every frame, each face must still be drawn
+    // at least once every ceil(6 / facesPerUpdate) frames.
+    unsigned int interval = (FaceCount + facesPerUpdate - 1) / facesPerUpdate;
+    unsigned int lastDrawn[FaceCount] = { 0, 0, 0, 0, 0, 0 };
+    unsigned int movingFrames = 1 + rand() % 50;
+    for (unsigned int frame = 1; frame <= movingFrames; ++frame)
+    {
+        bool jump = uniformRandom() < 0.05;
+        double step = jump ? JumpThreshold * 2.0 : uniformRandom();
+        Vector3d previousCenter = center;
+        center += Vector3d(uniformRandom() - 0.5, uniformRandom() - 0.5, uniformRandom() - 0.5).normalized() * step;
+        if (uniformRandom() < 0.5)
+        {
+            t += uniformRandom() * 60.0;
+        }
+
+        faces = schedule.nextFaces(center, t);
+        cubeMap.draw(faces, center, t);
+
+        if ((center - previousCenter).norm() > JumpThreshold && faces != AllFaces)
+        {
+            ++problems;
+        }
+        if (faceCount(faces) > facesPerUpdate && faces != AllFaces)
+        {
+            ++problems;
+        }
+
+        for (unsigned int face = 0; face < FaceCount; ++face)
+        {
+            if ((faces & (1u << face)) != 0)
+            {
+                lastDrawn[face] = frame;
+            }
+            else if (frame - lastDrawn[face] >= interval)
+            {
+                ++problems;
+            }
+        }
+    }
+
+    // Still phase
+    unsigned int frame = 0;
+    while (!schedule.isComplete() && frame <= interval)
+    {
+        faces = schedule.nextFaces(center, t);
+        cubeMap.draw(faces, center, t);
+        ++frame;
+    }
+    *framesToConverge = frame;
+
+    if (frame > interval || !cubeMap.isCurrent(center, t))
+    {
+        ++problems;
+    }
+
+    // Nothing more should be drawn
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        if (schedule.nextFaces(center, t) != 0)
+        {
+            ++problems;
+        }
+    }
+
+    return problems;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int trialCount = argc > 1 ? atoi(argv[1]) : 10000;
+    if (argc > 2 || trialCount <= 0)
+    {
+        cerr << "Usage: cubeschedule [trial count]" << endl;
+        return 1;
+    }
+
+    srand(1);
+
+    unsigned long failures = 0;
+
+    cout << "Faces/update   Bound (frames)   Worst (frames)   Failed trials" << endl;
+    for (unsigned int facesPerUpdate = 1; facesPerUpdate <= FaceCount; ++facesPerUpdate)
+    {
+        unsigned int bound = (FaceCount + facesPerUpdate - 1) / facesPerUpdate;
+        unsigned int worst = 0;
+        unsigned int failedTrials = 0;
+        for (int trial = 0; trial < trialCount; ++trial)
+        {
+            unsigned int frames = 0;
+            if (runTrial(facesPerUpdate, &frames) != 0)
+            {
+                ++failedTrials;
+            }
+            worst = max(worst, frames);
+        }
+        failures += failedTrials;
+
+        cout << setw(12) << facesPerUpdate
+             << setw(17) << bound
+             << setw(17) << worst
+             << setw(16) << failedTrials << endl;
+    }
+
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
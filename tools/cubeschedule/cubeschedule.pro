@@ -0,0 +1,15 @@
+# Qt project file for the cubeschedule tool
+
+TEMPLATE = app
+TARGET = cubeschedule
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+
+SOURCES = \
+    cubeschedule.cpp \
+    $$VESTA_PATH/CubeMapUpdateSchedule.cpp
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR
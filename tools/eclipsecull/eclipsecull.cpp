@@ -0,0 +1,343 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** eclipsecull - Check eclipse shadow culling and indexing against brute force
+ *
+ * Usage: eclipsecull [moon count] [view count]
+ *
+ * Synthetic Jupiter and Saturn systems with many moons (and rings for Saturn)
+ * are viewed from random camera positions. For every object in the view, the
+ * eclipse shadows found with frustum culling and the per-light index are
+ * compared with those found by testing the object against every shadow. The
+ * time spent in each method is reported. No OpenGL context is required.
+ */
+
+#include <vesta/Body.h>
+#include <vesta/Geometry.h>
+#include <vesta/PlanarProjection.h>
+#include <vesta/Units.h>
+#include <vesta/internal/EclipseShadowVolumeSet.h>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const double SolarRadius = 6.96e5;
+
+
+// Geometry that is never drawn; it only has to report its shape to the shadow tests.
+// Rings are represented by an ellipsoid with a zero z semi-axis.
+class EllipsoidGeometry : public Geometry
+{
+public:
+    EllipsoidGeometry(const Vector3d& semiAxes) :
+        m_semiAxes(semiAxes)
+    {
+        setShadowCaster(true);
+    }
+
+    virtual void render(RenderContext& /* rc */, double /* clock */) const
+    {
+    }
+
+    virtual float boundingSphereRadius() const
+    {
+        return float(m_semiAxes.maxCoeff());
+    }
+
+    virtual bool isEllipsoidal() const
+    {
+        return true;
+    }
+
+    virtual AlignedEllipsoid ellipsoid() const
+    {
+        return AlignedEllipsoid(m_semiAxes);
+    }
+
+private:
+    Vector3d m_semiAxes;
+};
+
+
+struct SystemObject
+{
+    Body* body;
+    Vector3d position;
+    Quaternionf orientation;
+    double radius;
+    bool occluder;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef vector<SystemObject, aligned_allocator<SystemObject> > SystemObjectVector;
+
+
+static double
+uniformRandom()
+{
+    return double(rand()) / double(RAND_MAX);
+}
+
+
+static SystemObject
+makeObject(const Vector3d& semiAxes, const Vector3d& position, const Quaternionf& orientation, bool occluder)
+{
+    SystemObject object;
+    object.body = new Body();
+    object.body->addRef();
+    object.body->setGeometry(new EllipsoidGeometry(semiAxes));
+    object.position = position;
+    object.orientation = orientation;
+    object.radius = semiAxes.maxCoeff();
+    object.occluder = occluder;
+    return object;
+}
+
+
+// Build a planet with moons in a thin disk, optional rings, and small non-occluding
+// receivers (spacecraft) scattered close to the planet and the moons.
+static void
+buildSystem(SystemObjectVector& objects,
+            const Vector3d& center,
+            double radius,
+            double oblateness,
+            double ringRadius,
+            double maxOrbit,
+            unsigned int moonCount)
+{
+    Quaternionf tilt(AngleAxis<float>(float(toRadians(25.0)), Vector3f::UnitX()));
+    Vector3d planetAxes(radius, radius, radius * (1.0 - oblateness));
+    objects.push_back(makeObject(planetAxes, center, tilt, true));
+
+    if (ringRadius > 0.0)
+    {
+        objects.push_back(makeObject(Vector3d(ringRadius, ringRadius, 0.0), center, tilt, true));
+    }
+
+    Matrix3d toSystem = tilt.cast<double>().toRotationMatrix();
+    for (unsigned int i = 0; i < moonCount; ++i)
+    {
+        // Mostly small moons at a range of distances, a few large inner ones
+        double orbit = radius * 3.0 + (maxOrbit - radius * 3.0) * pow(uniformRandom(), 2.0);
+        double moonRadius = i < 4 ? 1500.0 + 1200.0 * uniformRandom() : 1.0 + 200.0 * pow(uniformRandom(), 3.0);
+        double angle = 2.0 * PI * uniformRandom();
+        double height = orbit * 0.02 * (uniformRandom() - 0.5);
+        Vector3d position = center + toSystem * Vector3d(orbit * cos(angle), orbit * sin(angle), height);
+        objects.push_back(makeObject(Vector3d(moonRadius, moonRadius * 0.9, moonRadius * 0.85), position, tilt, true));
+
+        // A spacecraft near every fourth moon, a little farther from the Sun
+        if (i % 4 == 0)
+        {
+            Vector3d offset = position.normalized() * moonRadius * (1.0 + 20.0 * uniformRandom());
+            objects.push_back(makeObject(Vector3d::Constant(0.01), position + offset, Quaternionf::Identity(), false));
+        }
+    }
+
+    // Spacecraft close to the night side of the planet
+    for (unsigned int i = 0; i < 20; ++i)
+    {
+        Vector3d offset = center.normalized() * radius * (1.05 + 5.0 * uniformRandom());
+        offset += Vector3d(uniformRandom() - 0.5, uniformRandom() - 0.5, uniformRandom() - 0.5) * radius * 2.0;
+        objects.push_back(makeObject(Vector3d::Constant(0.01), center + offset, Quaternionf::Identity(), false));
+    }
+}
+
+
+// Ring shadows have no umbra, and their umbra slope is NaN
+static bool
+sameSlope(float s0, float s1)
+{
+    return s0 == s1 || (s0 != s0 && s1 != s1);
+}
+
+
+static bool
+sameShadows(const EclipseShadowVolumeSet::EclipseShadowVector& s0,
+            const EclipseShadowVolumeSet::EclipseShadowVector& s1)
+{
+    if (s0.size() != s1.size())
+    {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < s0.size(); ++i)
+    {
+        if (s0[i].occluder != s1[i].occluder ||
+            s0[i].position != s1[i].position ||
+            s0[i].direction != s1[i].direction ||
+            !sameSlope(s0[i].umbraSlope, s1[i].umbraSlope) ||
+            !sameSlope(s0[i].penumbraSlope, s1[i].penumbraSlope))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int moonCount = argc > 1 ? atoi(argv[1]) : 80;
+    int viewCount = argc > 2 ? atoi(argv[2]) : 1000;
+    if (argc > 3 || moonCount < 0 || viewCount < 1)
+    {
+        cerr << "Usage: eclipsecull [moon count] [view count]" << endl;
+        return 1;
+    }
+
+    srand(1);
+
+    // The Sun is at the origin
+    Vector3d jupiterPosition = Vector3d(7.78e8, 0.0, 0.0);
+    Vector3d saturnPosition = AngleAxis<double>(toRadians(40.0), Vector3d::UnitZ()) * Vector3d(1.43e9, 0.0, 0.0);
+
+    SystemObjectVector objects;
+    buildSystem(objects, jupiterPosition, 71492.0, 0.065, 0.0, 2.5e7, moonCount);
+    buildSystem(objects, saturnPosition, 60268.0, 0.098, 140000.0, 2.0e7, moonCount);
+
+    unsigned int occluderCount = 0;
+    for (unsigned int i = 0; i < objects.size(); ++i)
+    {
+        occluderCount += objects[i].occluder ? 1 : 0;
+    }
+
+    counted_ptr<EclipseShadowVolumeSet> indexed(new EclipseShadowVolumeSet());
+    counted_ptr<EclipseShadowVolumeSet> bruteForce(new EclipseShadowVolumeSet());
+    bruteForce->setIndexingEnabled(false);
+
+    // Shadow volumes aren't view dependent, so they're added only once.
+    for (unsigned int i = 0; i < objects.size(); ++i)
+    {
+        if (objects[i].occluder)
+        {
+            indexed->addShadow(objects[i].body, objects[i].position, objects[i].orientation, Vector3d::Zero(), SolarRadius);
+            bruteForce->addShadow(objects[i].body, objects[i].position, objects[i].orientation, Vector3d::Zero(), SolarRadius);
+        }
+    }
+
+    PlanarProjection projection = PlanarProjection::CreatePerspective(float(toRadians(50.0)), 16.0f / 9.0f, 1.0f, 1.0e12f);
+    Frustum frustum = projection.frustum();
+
+    double indexedTime = 0.0;
+    double bruteForceTime = 0.0;
+    unsigned long receiverTests = 0;
+    unsigned long shadowedReceivers = 0;
+    unsigned long umbraReceivers = 0;
+    unsigned long mismatches = 0;
+
+    for (int view = 0; view < viewCount; ++view)
+    {
+        // Look at one of the planets, or at a point near it, from a random distance
+        Vector3d target = view % 2 == 0 ? jupiterPosition : saturnPosition;
+        double distance = 1.0e5 * pow(500.0, uniformRandom());
+        Vector3d direction = Vector3d(uniformRandom() - 0.5, uniformRandom() - 0.5, uniformRandom() - 0.5).normalized();
+        Vector3d cameraPosition = target + direction * distance;
+        Vector3d lookAt = target + Vector3d(uniformRandom() - 0.5, uniformRandom() - 0.5, uniformRandom() - 0.5) * distance;
+
+        Vector3d back = (cameraPosition - lookAt).normalized();
+        Vector3d right = Vector3d::UnitZ().cross(back).normalized();
+        Matrix3d m;
+        m.col(0) = right;
+        m.col(1) = back.cross(right);
+        m.col(2) = back;
+        Quaterniond cameraOrientation(m);
+        Matrix3d toCameraSpace = cameraOrientation.conjugate().toRotationMatrix();
+
+        // Objects in the view, as found by the renderer
+        vector<unsigned int> visible;
+        double maxReceiverRadius = 0.0;
+        for (unsigned int i = 0; i < objects.size(); ++i)
+        {
+            Vector3f cameraSpacePosition = (toCameraSpace * (objects[i].position - cameraPosition)).cast<float>();
+            if (frustum.intersects(BoundingSphere<float>(cameraSpacePosition, float(objects[i].radius))))
+            {
+                visible.push_back(i);
+                maxReceiverRadius = max(maxReceiverRadius, objects[i].radius);
+            }
+        }
+
+        double startTime = omp_get_wtime();
+        indexed->frustumCull(frustum, cameraPosition, cameraOrientation, maxReceiverRadius);
+        for (unsigned int i = 0; i < visible.size(); ++i)
+        {
+            const SystemObject& object = objects[visible[i]];
+            indexed->findIntersectingShadows(object.body, object.position, object.radius);
+        }
+        indexedTime += omp_get_wtime() - startTime;
+
+        startTime = omp_get_wtime();
+        bruteForce->frustumCull(frustum, cameraPosition, cameraOrientation, maxReceiverRadius);
+        for (unsigned int i = 0; i < visible.size(); ++i)
+        {
+            const SystemObject& object = objects[visible[i]];
+            bruteForce->findIntersectingShadows(object.body, object.position, object.radius);
+        }
+        bruteForceTime += omp_get_wtime() - startTime;
+
+        // Compare the results for each object outside of the timed loops
+        for (unsigned int i = 0; i < visible.size(); ++i)
+        {
+            const SystemObject& object = objects[visible[i]];
+            bool indexedResult = indexed->findIntersectingShadows(object.body, object.position, object.radius);
+            bool bruteForceResult = bruteForce->findIntersectingShadows(object.body, object.position, object.radius);
+
+            ++receiverTests;
+            if (bruteForceResult)
+            {
+                ++shadowedReceivers;
+                if (bruteForce->insideUmbra())
+                {
+                    ++umbraReceivers;
+                }
+            }
+
+            if (indexedResult != bruteForceResult ||
+                indexed->insideUmbra() != bruteForce->insideUmbra() ||
+                !sameShadows(indexed->intersectingShadows(), bruteForce->intersectingShadows()))
+            {
+                ++mismatches;
+            }
+        }
+    }
+
+    cout << "Objects: " << objects.size() << " (" << occluderCount << " shadow casters), views: " << viewCount << endl;
+    cout << "Objects tested: " << receiverTests << ", shadowed: " << shadowedReceivers
+         << ", completely inside an umbra: " << umbraReceivers << endl;
+    cout << endl;
+    cout << "Shadow lookup time per view:" << endl;
+    cout << "  all shadows:               " << setw(9) << fixed << setprecision(3) << bruteForceTime * 1000.0 / viewCount << " ms" << endl;
+    cout << "  culled and indexed:        " << setw(9) << indexedTime * 1000.0 / viewCount << " ms" << endl;
+    cout << endl;
+    cout << "Objects with different shadows: " << mismatches << " of " << receiverTests << endl;
+    cout << endl << (mismatches == 0 ? "ok" : "FAILED") << endl;
+
+    for (unsigned int i = 0; i < objects.size(); ++i)
+    {
+        objects[i].body->release();
+    }
+
+    return mismatches == 0 ? 0 : 1;
+}
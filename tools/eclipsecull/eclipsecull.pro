@@ -0,0 +1,39 @@
+# Qt project file for the eclipsecull tool
+
+TEMPLATE = app
+TARGET = eclipsecull
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+
+SOURCES = \
+    eclipsecull.cpp \
+    $$VESTA_PATH/AlignedEllipsoid.cpp \
+    $$VESTA_PATH/Arc.cpp \
+    $$VESTA_PATH/Body.cpp \
+    $$VESTA_PATH/Chronology.cpp \
+    $$VESTA_PATH/Debug.cpp \
+    $$VESTA_PATH/Entity.cpp \
+    $$VESTA_PATH/FixedPointTrajectory.cpp \
+    $$VESTA_PATH/FixedRotationModel.cpp \
+    $$VESTA_PATH/Frame.cpp \
+    $$VESTA_PATH/GeneralEllipse.cpp \
+    $$VESTA_PATH/Geometry.cpp \
+    $$VESTA_PATH/InertialFrame.cpp \
+    $$VESTA_PATH/PlanarProjection.cpp \
+    $$VESTA_PATH/Visualizer.cpp \
+    $$VESTA_PATH/internal/EclipseShadowVolumeSet.cpp
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR
+
+# OpenMP is used only for its timer
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+!win32-msvc* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
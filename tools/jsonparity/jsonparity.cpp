@@ -0,0 +1,478 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** jsonparity - Compare the catalog JSON reader with the QJson parser
+ *
+ * Usage: jsonparity [directory]
+ *
+ * Every .json file in the directory (by default the bundled data directory) is
+ * parsed both with JsonReader and with the regular expression comment stripping
+ * and QJson parser that catalog loading used before, and the resulting QVariant
+ * trees are compared value by value and type by type. The parse times of both
+ * are reported, for each file and for a large synthetic add-on catalog. The peak
+ * memory use of each parser is measured by running this program again in a child
+ * process for each one. No OpenGL context is required.
+ */
+
+#include "catalog/JsonReader.h"
+#include <qjson/parser.h>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QRegExp>
+#include <QProcess>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#ifndef Q_OS_WIN
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+
+// Runs of each parse; the fastest time is reported
+static const int TimingRounds = 5;
+
+// Number of bodies in the synthetic catalog, which is about 10 MB of text
+static const int SyntheticBodyCount = 12000;
+
+
+enum ParserType
+{
+    NoParser,
+    QJsonParser,
+    StreamingReader,
+};
+
+
+// The parse that ParseCatalogFile used before JsonReader. The regular expression
+// can't tell comment markers from string contents, so it may damage strings with
+// // in them; such files are reported but not counted as mismatches.
+static QVariant
+parseWithQJson(const QByteArray& data, bool* ok)
+{
+    QString catalogText(data);
+    QRegExp stripComments("//[^\"]*[\n\r]");
+    stripComments.setMinimal(true);
+    QByteArray catalogBytes = catalogText.replace(stripComments, " ").toUtf8();
+
+    QBuffer buffer(&catalogBytes);
+    QJson::Parser parser;
+    return parser.parse(&buffer, ok);
+}
+
+
+static QVariant
+parseWithReader(const QByteArray& data, bool* ok)
+{
+    JsonReader reader(data);
+    QVariant result = reader.read();
+    *ok = !reader.error();
+    return result;
+}
+
+
+static QVariant
+parse(ParserType parser, const QByteArray& data, bool* ok)
+{
+    if (parser == QJsonParser)
+    {
+        return parseWithQJson(data, ok);
+    }
+    else
+    {
+        return parseWithReader(data, ok);
+    }
+}
+
+
+// Compare two value trees, including the QVariant types of the values. Returns
+// an empty string if they're identical, otherwise the path to the first difference.
+static QString
+compareValues(const QVariant& expected, const QVariant& actual, const QString& path)
+{
+    if (expected.type() != actual.type())
+    {
+        return QString("%1 (type %2, expected %3)").arg(path, actual.typeName(), expected.typeName());
+    }
+
+    if (expected.type() == QVariant::Map)
+    {
+        QVariantMap expectedMap = expected.toMap();
+        QVariantMap actualMap = actual.toMap();
+        if (expectedMap.keys() != actualMap.keys())
+        {
+            return QString("%1 (member names differ)").arg(path);
+        }
+
+        for (QVariantMap::const_iterator iter = expectedMap.begin(); iter != expectedMap.end(); ++iter)
+        {
+            QString difference = compareValues(iter.value(), actualMap.value(iter.key()), path + "." + iter.key());
+            if (!difference.isEmpty())
+            {
+                return difference;
+            }
+        }
+    }
+    else if (expected.type() == QVariant::List)
+    {
+        QVariantList expectedList = expected.toList();
+        QVariantList actualList = actual.toList();
+        if (expectedList.size() != actualList.size())
+        {
+            return QString("%1 (%2 elements, expected %3)").arg(path).arg(actualList.size()).arg(expectedList.size());
+        }
+
+        for (int i = 0; i < expectedList.size(); ++i)
+        {
+            QString difference = compareValues(expectedList.at(i), actualList.at(i), QString("%1[%2]").arg(path).arg(i));
+            if (!difference.isEmpty())
+            {
+                return difference;
+            }
+        }
+    }
+    else if (expected != actual)
+    {
+        return QString("%1 (%2, expected %3)").arg(path, actual.toString(), expected.toString());
+    }
+
+    return QString();
+}
+
+
+// A catalog of the size and shape of a large add-on: many bodies with nested
+// trajectory, rotation model, and geometry definitions, and comments throughout.
+static QByteArray
+syntheticCatalog()
+{
+    QByteArray text;
+    text += "// Synthetic add-on catalog\n";
+    text += "{\n  \"version\": \"1.0\",\n  \"name\": \"Synthetic\",\n  \"items\" :\n  [\n";
+    for (int i = 0; i < SyntheticBodyCount; ++i)
+    {
+        QByteArray body = QString(
+            "    {\n"
+            "      \"name\": \"Object %1\", // body %1\n"
+            "      \"class\": \"asteroid\",\n"
+            "      \"center\": \"Sun\",\n"
+            "      \"startTime\": \"1950-01-01 00:00:00\",\n"
+            "      \"trajectory\":\n"
+            "      {\n"
+            "        \"type\": \"Keplerian\",\n"
+            "        \"semiMajorAxis\": \"%2au\",\n"
+            "        \"eccentricity\": %3,\n"
+            "        \"inclination\": %4,\n"
+            "        \"ascendingNode\": %5,\n"
+            "        \"argumentOfPeriapsis\": %6,\n"
+            "        \"meanAnomaly\": %7,\n"
+            "        \"epoch\": %8\n"
+            "      },\n"
+            "      \"rotationModel\":\n"
+            "      {\n"
+            "        \"type\": \"Uniform\",\n"
+            "        \"period\": \"%9h\",\n"
+            "        \"inclination\": %10,\n"
+            "        \"meridianAngle\": %11\n"
+            "      },\n"
+            "      \"geometry\": { \"type\": \"Globe\", \"radii\": [ %12, %13, %14 ], \"baseMap\": \"textures/asteroid.jpg\" },\n"
+            "      \"label\": { \"color\": [ 0.6, 0.6, 0.6 ], \"fadeSize\": 1e6, \"showText\": true },\n"
+            "      \"trajectoryPlot\": { \"fade\": 0.5, \"duration\": \"%15 d\", \"visible\": false }\n"
+            "    }%16\n")
+            .arg(i)
+            .arg(1.5 + (i % 997) * 0.003, 0, 'f', 6)
+            .arg((i % 89) * 0.004, 0, 'f', 5)
+            .arg((i % 313) * 0.1, 0, 'f', 3)
+            .arg((i * 7) % 360)
+            .arg((i * 13) % 360)
+            .arg((i * 31) % 3600 * 0.1, 0, 'f', 1)
+            .arg(2451545.0 + i, 0, 'f', 1)
+            .arg(2.0 + (i % 50) * 0.37, 0, 'f', 2)
+            .arg((i % 180) - 90)
+            .arg((i * 3) % 360)
+            .arg(1.0 + (i % 40))
+            .arg(0.8 + (i % 40))
+            .arg(0.7 + (i % 40))
+            .arg(365 + i % 1000)
+            .arg(i < SyntheticBodyCount - 1 ? "," : "")
+            .toUtf8();
+        text += body;
+    }
+    text += "  ]\n}\n";
+
+    return text;
+}
+
+
+static QStringList
+catalogFiles(const QString& directory)
+{
+    QDir dir(directory);
+    QStringList files;
+    foreach (QString name, dir.entryList(QStringList("*.json"), QDir::Files, QDir::Name))
+    {
+        files << dir.filePath(name);
+    }
+
+    return files;
+}
+
+
+static bool
+readFile(const QString& fileName, QByteArray* data)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    *data = file.readAll();
+    return true;
+}
+
+
+// Fastest of several parses, in milliseconds
+static double
+parseTime(ParserType parser, const QByteArray& data)
+{
+    double best = 0.0;
+    for (int round = 0; round < TimingRounds; ++round)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = false;
+        QVariant result = parse(parser, data, &ok);
+        double t = timer.nsecsElapsed() * 1.0e-6;
+        if (round == 0 || t < best)
+        {
+            best = t;
+        }
+    }
+
+    return best;
+}
+
+
+// Peak resident set size of this process in kilobytes, or -1 if unknown
+static long
+peakMemory()
+{
+#ifdef Q_OS_WIN
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return -1;
+    }
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+
+// Child process mode: parse the files (or with NoParser, only read them) while
+// keeping every tree, as a loaded catalog would, and print the peak memory use.
+static int
+measureMemory(ParserType parser, const QStringList& files)
+{
+    QList<QVariant> trees;
+    foreach (QString fileName, files)
+    {
+        QByteArray data;
+        if (fileName.isEmpty())
+        {
+            data = syntheticCatalog();
+        }
+        else if (!readFile(fileName, &data))
+        {
+            return 1;
+        }
+
+        if (parser != NoParser)
+        {
+            bool ok = false;
+            trees << parse(parser, data, &ok);
+        }
+    }
+
+    printf("%ld\n", peakMemory());
+
+    return 0;
+}
+
+
+static long
+childPeakMemory(const QString& mode, const QString& directory)
+{
+    QProcess child;
+    child.start(QCoreApplication::applicationFilePath(), QStringList() << "--measure" << mode << directory);
+    if (!child.waitForFinished(-1) || child.exitCode() != 0)
+    {
+        return -1;
+    }
+
+    bool ok = false;
+    long kbytes = QString(child.readAllStandardOutput()).trimmed().toLong(&ok);
+    return ok ? kbytes : -1;
+}
+
+
+static void
+reportMemory(const char* parserName, long baseline, long peak)
+{
+    cout << setw(10) << parserName;
+    if (baseline < 0 || peak < 0)
+    {
+        cout << setw(16) << "unavailable" << endl;
+    }
+    else
+    {
+        cout << setw(16) << setprecision(1) << (peak - baseline) / 1024.0 << endl;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+
+    if (args.size() == 4 && args.at(1) == "--measure")
+    {
+        QStringList files = catalogFiles(args.at(3));
+        files << QString();     // the synthetic catalog
+        ParserType parser = NoParser;
+        if (args.at(2) == "qjson")
+        {
+            parser = QJsonParser;
+        }
+        else if (args.at(2) == "reader")
+        {
+            parser = StreamingReader;
+        }
+        return measureMemory(parser, files);
+    }
+
+    if (args.size() > 2)
+    {
+        cerr << "Usage: jsonparity [directory]" << endl;
+        return 1;
+    }
+
+    QString directory = args.size() > 1 ? args.at(1) : QString("../../data");
+    QStringList files = catalogFiles(directory);
+    if (files.isEmpty())
+    {
+        cerr << "No .json files found in " << directory.toUtf8().data() << endl;
+        return 1;
+    }
+
+    unsigned int failures = 0;
+    unsigned int damaged = 0;
+    double totalQJsonTime = 0.0;
+    double totalReaderTime = 0.0;
+
+    cout << fixed;
+    cout << "                          File   Size (KB)  QJson (ms)  Reader (ms)  Result" << endl;
+
+    files << QString();
+    foreach (QString fileName, files)
+    {
+        QByteArray data;
+        QString name = fileName.isEmpty() ? QString("synthetic") : QFileInfo(fileName).fileName();
+        if (fileName.isEmpty())
+        {
+            data = syntheticCatalog();
+        }
+        else if (!readFile(fileName, &data))
+        {
+            cerr << "Error reading " << fileName.toUtf8().data() << endl;
+            return 1;
+        }
+
+        bool qjsonOk = false;
+        bool readerOk = false;
+        QVariant expected = parseWithQJson(data, &qjsonOk);
+        QVariant actual = parseWithReader(data, &readerOk);
+
+        QString result;
+        if (!readerOk)
+        {
+            result = "reader error";
+            ++failures;
+        }
+        else if (!qjsonOk)
+        {
+            // Comment stripping broke the file for QJson; only the reader's
+            // result is usable.
+            result = "QJson error";
+            ++damaged;
+        }
+        else
+        {
+            QString difference = compareValues(expected, actual, "");
+            if (difference.isEmpty())
+            {
+                result = "same";
+            }
+            else
+            {
+                result = "differs at " + difference;
+                ++failures;
+            }
+        }
+
+        double qjsonTime = parseTime(QJsonParser, data);
+        double readerTime = parseTime(StreamingReader, data);
+        totalQJsonTime += qjsonTime;
+        totalReaderTime += readerTime;
+
+        cout << setw(30) << name.toUtf8().data()
+             << setw(12) << setprecision(1) << data.size() / 1024.0
+             << setw(12) << setprecision(2) << qjsonTime
+             << setw(13) << setprecision(2) << readerTime
+             << "  " << result.toUtf8().data() << endl;
+    }
+
+    cout << setw(30) << "total" << setw(12) << ""
+         << setw(12) << setprecision(2) << totalQJsonTime
+         << setw(13) << setprecision(2) << totalReaderTime << endl;
+    cout << endl;
+
+    cout << "    Parser  Peak memory (MB)" << endl;
+    long baseline = childPeakMemory("none", directory);
+    reportMemory("QJson", baseline, childPeakMemory("qjson", directory));
+    reportMemory("reader", baseline, childPeakMemory("reader", directory));
+
+    if (damaged != 0)
+    {
+        cout << endl << damaged << " file(s) could not be parsed by QJson after comment stripping" << endl;
+    }
+
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+# Qt project file for the jsonparity tool
+
+TEMPLATE = app
+TARGET = jsonparity
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+
+MAIN_PATH = ../../src/main
+QJSON_PATH = ../../thirdparty/qjson
+
+SOURCES = \
+    jsonparity.cpp \
+    $$MAIN_PATH/catalog/JsonReader.cpp \
+    $$QJSON_PATH/json_parser.cc \
+    $$QJSON_PATH/json_scanner.cpp \
+    $$QJSON_PATH/parser.cpp
+
+HEADERS = \
+    $$MAIN_PATH/catalog/JsonReader.h \
+    $$QJSON_PATH/parser.h
+
+INCLUDEPATH += $$MAIN_PATH ../../thirdparty
+
+DEFINES += QJSON_EXPORT=
@@ -0,0 +1,475 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** labelarbiter - Check LabelArbiter on synthetic label sets
+ *
+ * Usage: labelarbiter [label count]
+ *
+ * Random sets of label rectangles are resolved by LabelArbiter, and the labels
+ * shown are compared with a greedy placement that tests every pair of labels. No
+ * two labels shown may overlap. Small cases check that higher priority labels
+ * win, that ties are broken consistently, that a shown label is only displaced
+ * by a label with a priority greater by more than the hysteresis, and that
+ * labels fade in and out at the expected rate. No OpenGL context is required.
+ */
+
+#include <vesta/LabelArbiter.h>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const float ViewportWidth = 1920.0f;
+static const float ViewportHeight = 1080.0f;
+static const unsigned int TrialCount = 20;
+static const unsigned int FlickerFrameCount = 200;
+
+
+static float
+uniformRandom()
+{
+    return float((rand() + 1.0) / (RAND_MAX + 1.0));
+}
+
+
+struct TestLabel
+{
+    Vector2f minCorner;
+    Vector2f maxCorner;
+    float priority;
+};
+
+
+// Labels sized like text labels, with a few spread far outside the viewport
+// (as labels of objects near the edge of a wide field of view can be.)
+static vector<TestLabel>
+randomLabels(unsigned int count)
+{
+    vector<TestLabel> labels(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        float scale = i % 50 == 0 ? 20.0f : 1.0f;
+        Vector2f p(ViewportWidth * scale * uniformRandom(), ViewportHeight * scale * uniformRandom());
+        Vector2f size(20.0f + 120.0f * uniformRandom(), 12.0f + 8.0f * uniformRandom());
+        labels[i].minCorner = p;
+        labels[i].maxCorner = p + size;
+
+        // Coarse priorities so that there are ties
+        labels[i].priority = float(rand() % 8);
+    }
+
+    return labels;
+}
+
+
+static bool
+overlaps(const TestLabel& a, const TestLabel& b, float halfMargin)
+{
+    return a.minCorner.x() - halfMargin < b.maxCorner.x() + halfMargin &&
+           b.minCorner.x() - halfMargin < a.maxCorner.x() + halfMargin &&
+           a.minCorner.y() - halfMargin < b.maxCorner.y() + halfMargin &&
+           b.minCorner.y() - halfMargin < a.maxCorner.y() + halfMargin;
+}
+
+
+class PriorityPredicate
+{
+public:
+    PriorityPredicate(const vector<TestLabel>& labels) : m_labels(labels) {}
+
+    bool operator()(unsigned int i0, unsigned int i1) const
+    {
+        if (m_labels[i0].priority != m_labels[i1].priority)
+        {
+            return m_labels[i0].priority > m_labels[i1].priority;
+        }
+        else
+        {
+            return i0 < i1;
+        }
+    }
+
+private:
+    const vector<TestLabel>& m_labels;
+};
+
+
+// Place labels in priority order, testing each against every label already placed
+static vector<bool>
+bruteForcePlacement(const vector<TestLabel>& labels, float margin)
+{
+    vector<unsigned int> order(labels.size());
+    for (unsigned int i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), PriorityPredicate(labels));
+
+    vector<bool> shown(labels.size(), false);
+    vector<unsigned int> placed;
+    for (unsigned int i = 0; i < order.size(); ++i)
+    {
+        const TestLabel& label = labels[order[i]];
+        bool free = true;
+        for (unsigned int j = 0; free && j < placed.size(); ++j)
+        {
+            free = !overlaps(label, labels[placed[j]], margin * 0.5f);
+        }
+
+        if (free)
+        {
+            placed.push_back(order[i]);
+            shown[order[i]] = true;
+        }
+    }
+
+    return shown;
+}
+
+
+// Resolve a single frame of labels
+static void
+resolveLabels(LabelArbiter* arbiter, const void* owner, const vector<TestLabel>& labels, double realTime)
+{
+    arbiter->beginFrame(realTime);
+    for (unsigned int i = 0; i < labels.size(); ++i)
+    {
+        arbiter->requestLabel(owner, i, labels[i].minCorner, labels[i].maxCorner, labels[i].priority);
+    }
+    arbiter->endFrame();
+}
+
+
+// Compare the arbiter with brute force placement for random label sets. Returns
+// the number of trials with any difference.
+static unsigned int
+checkOverlap(unsigned int labelCount, double* arbiterTime, double* bruteForceTime, unsigned int* shownCount)
+{
+    unsigned int problems = 0;
+    *arbiterTime = 0.0;
+    *bruteForceTime = 0.0;
+    *shownCount = 0;
+
+    int owner = 0;
+    for (unsigned int trial = 0; trial < TrialCount; ++trial)
+    {
+        vector<TestLabel> labels = randomLabels(labelCount);
+
+        counted_ptr<LabelArbiter> arbiter(new LabelArbiter());
+
+        double startTime = omp_get_wtime();
+        resolveLabels(arbiter.ptr(), &owner, labels, 0.0);
+        *arbiterTime += omp_get_wtime() - startTime;
+
+        startTime = omp_get_wtime();
+        vector<bool> expected = bruteForcePlacement(labels, arbiter->margin());
+        *bruteForceTime += omp_get_wtime() - startTime;
+
+        bool ok = arbiter->requestCount() == labelCount;
+        vector<unsigned int> shown;
+        unsigned int expectedShownCount = 0;
+        for (unsigned int i = 0; i < labelCount; ++i)
+        {
+            if (arbiter->isLabelShown(&owner, i))
+            {
+                shown.push_back(i);
+            }
+            if (arbiter->isLabelShown(&owner, i) != expected[i])
+            {
+                ok = false;
+            }
+            if (expected[i])
+            {
+                ++expectedShownCount;
+            }
+        }
+        ok = ok && arbiter->shownCount() == expectedShownCount;
+
+        // Labels shown must never overlap, whatever the placement order
+        for (unsigned int i = 0; ok && i < shown.size(); ++i)
+        {
+            for (unsigned int j = i + 1; ok && j < shown.size(); ++j)
+            {
+                ok = !overlaps(labels[shown[i]], labels[shown[j]], 0.0f);
+            }
+        }
+
+        if (!ok)
+        {
+            ++problems;
+        }
+        *shownCount += arbiter->shownCount();
+    }
+
+    *arbiterTime /= TrialCount;
+    *bruteForceTime /= TrialCount;
+    *shownCount /= TrialCount;
+
+    return problems;
+}
+
+
+static bool
+report(const char* name, bool ok)
+{
+    cout << "  " << setw(48) << left << name << right << (ok ? "pass" : "FAIL") << endl;
+    return ok;
+}
+
+
+// Two overlapping labels and one apart from both
+static vector<TestLabel>
+overlappingPair(float priority0, float priority1)
+{
+    vector<TestLabel> labels(3);
+    labels[0].minCorner = Vector2f(100.0f, 100.0f);
+    labels[0].maxCorner = Vector2f(200.0f, 115.0f);
+    labels[0].priority = priority0;
+    labels[1].minCorner = Vector2f(150.0f, 110.0f);
+    labels[1].maxCorner = Vector2f(250.0f, 125.0f);
+    labels[1].priority = priority1;
+    labels[2].minCorner = Vector2f(500.0f, 500.0f);
+    labels[2].maxCorner = Vector2f(600.0f, 515.0f);
+    labels[2].priority = 0.0f;
+
+    return labels;
+}
+
+
+static unsigned int
+checkPriority()
+{
+    unsigned int failures = 0;
+    int owner = 0;
+
+    counted_ptr<LabelArbiter> arbiter(new LabelArbiter());
+    resolveLabels(arbiter.ptr(), &owner, overlappingPair(1.0f, 2.0f), 0.0);
+    failures += report("Higher priority label wins",
+                       !arbiter->isLabelShown(&owner, 0) && arbiter->isLabelShown(&owner, 1) && arbiter->isLabelShown(&owner, 2)) ? 0 : 1;
+
+    arbiter = new LabelArbiter();
+    resolveLabels(arbiter.ptr(), &owner, overlappingPair(1.0f, 1.0f), 0.0);
+    failures += report("Tie goes to the lower index",
+                       arbiter->isLabelShown(&owner, 0) && !arbiter->isLabelShown(&owner, 1)) ? 0 : 1;
+
+    // Labels closer than the margin overlap
+    vector<TestLabel> labels = overlappingPair(1.0f, 2.0f);
+    labels[1].minCorner = Vector2f(labels[0].maxCorner.x() + 1.0f, labels[0].minCorner.y());
+    labels[1].maxCorner = labels[1].minCorner + Vector2f(100.0f, 15.0f);
+    arbiter = new LabelArbiter();
+    arbiter->setMargin(2.0f);
+    resolveLabels(arbiter.ptr(), &owner, labels, 0.0);
+    bool closeHidden = !arbiter->isLabelShown(&owner, 0);
+    arbiter = new LabelArbiter();
+    arbiter->setMargin(0.5f);
+    resolveLabels(arbiter.ptr(), &owner, labels, 0.0);
+    failures += report("Margin separates nearby labels",
+                       closeHidden && arbiter->isLabelShown(&owner, 0) && arbiter->isLabelShown(&owner, 1)) ? 0 : 1;
+
+    // Only the first request for a label in a frame counts
+    arbiter = new LabelArbiter();
+    labels = overlappingPair(2.0f, 1.0f);
+    arbiter->beginFrame(0.0);
+    arbiter->requestLabel(&owner, 0, labels[0].minCorner, labels[0].maxCorner, labels[0].priority);
+    arbiter->requestLabel(&owner, 1, labels[1].minCorner, labels[1].maxCorner, labels[1].priority);
+    arbiter->requestLabel(&owner, 0, labels[0].minCorner, labels[0].maxCorner, 0.0f);
+    arbiter->endFrame();
+    failures += report("Repeated requests are ignored",
+                       arbiter->requestCount() == 2 && arbiter->isLabelShown(&owner, 0)) ? 0 : 1;
+
+    return failures;
+}
+
+
+static unsigned int
+checkHysteresis()
+{
+    unsigned int failures = 0;
+    int owner = 0;
+
+    counted_ptr<LabelArbiter> arbiter(new LabelArbiter());
+    arbiter->setHysteresis(0.1f);
+    float hysteresis = arbiter->hysteresis();
+
+    // Label 0 wins the first frame. A slightly higher priority for label 1 must not
+    // displace it, but a priority higher by more than the hysteresis must.
+    resolveLabels(arbiter.ptr(), &owner, overlappingPair(1.0f, 0.0f), 0.0);
+    resolveLabels(arbiter.ptr(), &owner, overlappingPair(1.0f, 1.0f + hysteresis * 0.5f), 0.1);
+    bool kept = arbiter->isLabelShown(&owner, 0) && !arbiter->isLabelShown(&owner, 1);
+    resolveLabels(arbiter.ptr(), &owner, overlappingPair(1.0f, 1.0f + hysteresis * 2.0f), 0.2);
+    bool displaced = !arbiter->isLabelShown(&owner, 0) && arbiter->isLabelShown(&owner, 1);
+    failures += report("Shown label keeps its place within hysteresis", kept) ? 0 : 1;
+    failures += report("Shown label displaced beyond hysteresis", displaced) ? 0 : 1;
+
+    // Priorities that wander by less than the hysteresis, as they do when a
+    // label's priority depends on its size on screen, must never cause flicker.
+    unsigned int labelCount = 500;
+    vector<TestLabel> labels = randomLabels(labelCount);
+    arbiter = new LabelArbiter();
+    arbiter->setHysteresis(0.1f);
+    resolveLabels(arbiter.ptr(), &owner, labels, 0.0);
+
+    vector<bool> firstShown(labelCount);
+    for (unsigned int i = 0; i < labelCount; ++i)
+    {
+        firstShown[i] = arbiter->isLabelShown(&owner, i);
+    }
+
+    unsigned int flips = 0;
+    for (unsigned int frame = 1; frame < FlickerFrameCount; ++frame)
+    {
+        vector<TestLabel> jittered = labels;
+        for (unsigned int i = 0; i < labelCount; ++i)
+        {
+            jittered[i].priority += hysteresis * 0.45f * (uniformRandom() * 2.0f - 1.0f);
+        }
+        resolveLabels(arbiter.ptr(), &owner, jittered, frame * 0.02);
+
+        for (unsigned int i = 0; i < labelCount; ++i)
+        {
+            if (arbiter->isLabelShown(&owner, i) != firstShown[i])
+            {
+                ++flips;
+            }
+        }
+    }
+    failures += report("No flicker with wandering priorities", flips == 0) ? 0 : 1;
+
+    return failures;
+}
+
+
+static unsigned int
+checkFade()
+{
+    unsigned int failures = 0;
+    int owner = 0;
+
+    counted_ptr<LabelArbiter> arbiter(new LabelArbiter());
+    arbiter->setFadeTime(0.25f);
+    vector<TestLabel> labels = overlappingPair(1.0f, 0.0f);
+
+    // New labels start transparent and fade in over the fade time, starting one
+    // frame after they win space.
+    vector<float> opacities;
+    for (unsigned int frame = 0; frame < 8; ++frame)
+    {
+        arbiter->beginFrame(frame * 0.05);
+        opacities.push_back(arbiter->requestLabel(&owner, 0, labels[0].minCorner, labels[0].maxCorner, labels[0].priority));
+        arbiter->requestLabel(&owner, 1, labels[1].minCorner, labels[1].maxCorner, labels[1].priority);
+        arbiter->endFrame();
+    }
+
+    bool fadeIn = true;
+    for (unsigned int frame = 0; frame < opacities.size(); ++frame)
+    {
+        float expected = min(1.0f, frame * 0.2f);
+        fadeIn = fadeIn && abs(opacities[frame] - expected) < 1.0e-4f;
+    }
+    fadeIn = fadeIn && arbiter->labelOpacity(&owner, 1) == 0.0f;
+    failures += report("Winning label fades in", fadeIn) ? 0 : 1;
+
+    // When label 1 takes over, label 0 fades out while label 1 fades in
+    labels = overlappingPair(1.0f, 2.0f);
+    bool fadeOut = true;
+    for (unsigned int frame = 8; frame < 16; ++frame)
+    {
+        arbiter->beginFrame(frame * 0.05);
+        float opacity0 = arbiter->requestLabel(&owner, 0, labels[0].minCorner, labels[0].maxCorner, labels[0].priority);
+        float opacity1 = arbiter->requestLabel(&owner, 1, labels[1].minCorner, labels[1].maxCorner, labels[1].priority);
+        arbiter->endFrame();
+
+        float expected = max(0.0f, 1.0f - (frame - 8) * 0.2f);
+        fadeOut = fadeOut && abs(opacity0 - expected) < 1.0e-4f && abs(opacity1 - (1.0f - expected)) < 1.0e-4f;
+    }
+    failures += report("Displaced label fades out", fadeOut) ? 0 : 1;
+
+    // A label that isn't requested for a frame is forgotten and must fade in again
+    arbiter->beginFrame(0.85);
+    arbiter->requestLabel(&owner, 0, labels[0].minCorner, labels[0].maxCorner, labels[0].priority);
+    arbiter->endFrame();
+    arbiter->beginFrame(0.90);
+    float opacity = arbiter->requestLabel(&owner, 1, labels[1].minCorner, labels[1].maxCorner, labels[1].priority);
+    arbiter->endFrame();
+    failures += report("Label missing for a frame is forgotten", opacity == 0.0f) ? 0 : 1;
+
+    // With no fade time, labels switch on the frame after they're decided
+    arbiter = new LabelArbiter();
+    arbiter->setFadeTime(0.0f);
+    arbiter->beginFrame(0.0);
+    float opacity0 = arbiter->requestLabel(&owner, 0, labels[0].minCorner, labels[0].maxCorner, labels[0].priority);
+    arbiter->endFrame();
+    arbiter->beginFrame(0.0);
+    float opacity1 = arbiter->requestLabel(&owner, 0, labels[0].minCorner, labels[0].maxCorner, labels[0].priority);
+    arbiter->endFrame();
+    failures += report("Zero fade time switches immediately", opacity0 == 0.0f && opacity1 == 1.0f) ? 0 : 1;
+
+    return failures;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int maxLabelCount = argc > 1 ? atoi(argv[1]) : 10000;
+    if (argc > 2 || maxLabelCount < 1)
+    {
+        cerr << "Usage: labelarbiter [label count]" << endl;
+        return 1;
+    }
+
+    srand(1);
+
+    unsigned int failures = 0;
+
+    cout << "Random label sets, " << TrialCount << " trials each" << endl;
+    cout << endl;
+    cout << "  Labels   Shown  Arbiter (ms)  Brute force (ms)  Mismatches" << endl;
+    cout << fixed;
+    for (unsigned int labelCount = 10; labelCount <= (unsigned int) maxLabelCount; labelCount *= 10)
+    {
+        double arbiterTime = 0.0;
+        double bruteForceTime = 0.0;
+        unsigned int shownCount = 0;
+        unsigned int problems = checkOverlap(labelCount, &arbiterTime, &bruteForceTime, &shownCount);
+        failures += problems;
+
+        cout << setw(8) << labelCount
+             << setw(8) << shownCount
+             << setw(14) << setprecision(3) << arbiterTime * 1000.0
+             << setw(18) << setprecision(3) << bruteForceTime * 1000.0
+             << setw(12) << problems << endl;
+    }
+
+    cout << endl;
+    cout << "Priority" << endl;
+    failures += checkPriority();
+    cout << "Hysteresis" << endl;
+    failures += checkHysteresis();
+    cout << "Fading" << endl;
+    failures += checkFade();
+
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
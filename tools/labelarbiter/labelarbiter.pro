@@ -0,0 +1,25 @@
+# Qt project file for the labelarbiter tool
+
+TEMPLATE = app
+TARGET = labelarbiter
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+
+SOURCES = \
+    labelarbiter.cpp \
+    $$VESTA_PATH/LabelArbiter.cpp
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR
+
+# OpenMP is only used for its wall clock timer
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+!win32-msvc* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
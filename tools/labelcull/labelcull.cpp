@@ -0,0 +1,292 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** labelcull - Check feature label culling against a test of every feature
+ *
+ * Usage: labelcull [feature count] [viewpoint count]
+ *
+ * Random features are added to a FeatureLabelSetGeometry on a Mars-sized
+ * ellipsoid, and the labels chosen by findVisibleLabels(), which skips whole
+ * cells of features that are too small or beyond the horizon, are compared with
+ * those chosen by testing every feature the way the labels were drawn before the
+ * cells were added. Viewpoints range from just above the surface to far enough
+ * away that no labels are shown. No OpenGL context is required.
+ */
+
+#include "geometry/FeatureLabelSetGeometry.h"
+#include <vesta/Intersect.h>
+#include <vesta/Units.h>
+#include <Eigen/LU>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const Vector3d MarsSemiAxes(3396.19, 3396.19, 3376.20);
+
+// Size of a pixel at unit distance for a 50 degree field of view 1080 pixels high
+static const float PixelSize = float(2.0 * tan(toRadians(25.0)) / 1080.0);
+
+// Labels with a position or size this close to the brute force result are the same
+static const float Tolerance = 1.0e-5f;
+
+
+static double
+uniformRandom()
+{
+    return (rand() + 1.0) / (RAND_MAX + 1.0);
+}
+
+
+static Vector3f
+randomDirection()
+{
+    double lon = uniformRandom() * 2.0 * PI;
+    double z = uniformRandom() * 2.0 - 1.0;
+    double s = sqrt(1.0 - z * z);
+    return Vector3f(float(s * cos(lon)), float(s * sin(lon)), float(z));
+}
+
+
+struct TestFeature
+{
+    Vector3f position;
+    float size;
+};
+
+
+// Features on the surface of the ellipsoid, with a few raised or lowered as much as
+// the tallest mountains and deepest basins. Most features are small; the number larger
+// than s falls off as 1/s.
+static vector<TestFeature>
+createFeatures(unsigned int featureCount)
+{
+    vector<TestFeature> features(featureCount);
+    for (unsigned int i = 0; i < featureCount; ++i)
+    {
+        Vector3f direction = randomDirection();
+        Vector3f surfacePoint = direction.cwise() * MarsSemiAxes.cast<float>();
+        features[i].position = surfacePoint * float(1.0 + 0.006 * (uniformRandom() - 0.5));
+        features[i].size = float(1.0 / (uniformRandom() * 0.999 + 0.0005));
+    }
+
+    return features;
+}
+
+
+// The labels drawn before features were grouped into cells: every feature is tested.
+static void
+findVisibleLabelsBruteForce(const vector<TestFeature>& features,
+                            float boundingRadius,
+                            const Transform3f& modelview,
+                            vector<FeatureLabelSetGeometry::VisibleLabel>& labels)
+{
+    labels.clear();
+
+    Transform3f inv = Transform3f(modelview.inverse(Affine));
+    Vector3f cameraPosition = inv.translation();
+    float overallPixelSize = boundingRadius / (PixelSize * cameraPosition.norm());
+    if (overallPixelSize <= FeatureLabelSetGeometry::VisibleSizeThreshold)
+    {
+        return;
+    }
+
+    AlignedEllipsoid testEllipsoid(MarsSemiAxes * 0.999);
+    Vector3f ellipsoidSemiAxes = testEllipsoid.semiAxes().cast<float>();
+
+    Vector3f viewDir = -cameraPosition / cameraPosition.norm();
+    double distanceToEllipsoid = (cameraPosition.norm() - ellipsoidSemiAxes.maxCoeff()) * 0.99f;
+    Hyperplane<float, 3> labelPlane(viewDir, cameraPosition + viewDir * float(distanceToEllipsoid));
+
+    for (unsigned int i = 0; i < features.size(); ++i)
+    {
+        Vector3f r = features[i].position - cameraPosition;
+        float k = -(labelPlane.normal().dot(cameraPosition) + labelPlane.offset()) / (labelPlane.normal().dot(r));
+        Vector3f labelPosition = cameraPosition + k * r;
+
+        float featureDistance = (modelview * labelPosition).norm();
+        float pixelSize = features[i].size / (PixelSize * featureDistance);
+
+        float d = r.norm();
+        r /= d;
+        double t = 0.0;
+        TestRayEllipsoidIntersection(cameraPosition, r, ellipsoidSemiAxes, &t);
+
+        if (pixelSize > FeatureLabelSetGeometry::VisibleSizeThreshold && d < t)
+        {
+            FeatureLabelSetGeometry::VisibleLabel label;
+            label.feature = i;
+            label.position = labelPosition;
+            label.pixelSize = pixelSize;
+            labels.push_back(label);
+        }
+    }
+}
+
+
+static bool
+featureLess(const FeatureLabelSetGeometry::VisibleLabel& a, const FeatureLabelSetGeometry::VisibleLabel& b)
+{
+    return a.feature < b.feature;
+}
+
+
+// Compare two sets of labels; the order of the labels doesn't matter.
+static bool
+sameLabels(vector<FeatureLabelSetGeometry::VisibleLabel> a, vector<FeatureLabelSetGeometry::VisibleLabel> b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+
+    sort(a.begin(), a.end(), featureLess);
+    sort(b.begin(), b.end(), featureLess);
+    for (unsigned int i = 0; i < a.size(); ++i)
+    {
+        float scale = a[i].position.norm();
+        if (a[i].feature != b[i].feature ||
+            (a[i].position - b[i].position).norm() > Tolerance * scale ||
+            abs(a[i].pixelSize - b[i].pixelSize) > Tolerance * a[i].pixelSize)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// A camera at the specified distance from the center of the body, looking toward a
+// point near the body and rolled randomly.
+static Transform3f
+randomView(float distance)
+{
+    Vector3f cameraPosition = randomDirection() * distance;
+    Vector3f target = randomDirection() * float(MarsSemiAxes.x() * uniformRandom());
+    Vector3f forward = (target - cameraPosition).normalized();
+    Vector3f right = forward.cross(randomDirection()).normalized();
+    Vector3f up = right.cross(forward);
+
+    // Rows of the rotation are the camera axes; the camera looks down -z
+    Matrix3f rotation;
+    rotation.row(0) = right;
+    rotation.row(1) = up;
+    rotation.row(2) = -forward;
+
+    Transform3f modelview;
+    modelview.setIdentity();
+    modelview.linear() = rotation;
+    modelview.translation() = -(rotation * cameraPosition);
+
+    return modelview;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int featureCount = argc > 1 ? atoi(argv[1]) : 40000;
+    int viewCount = argc > 2 ? atoi(argv[2]) : 200;
+    if (argc > 3 || featureCount < 1 || viewCount < 1)
+    {
+        cerr << "Usage: labelcull [feature count] [viewpoint count]" << endl;
+        return 1;
+    }
+
+    srand(1);
+
+    vector<TestFeature> features = createFeatures((unsigned int) featureCount);
+
+    counted_ptr<FeatureLabelSetGeometry> labelSet(new FeatureLabelSetGeometry());
+    for (unsigned int i = 0; i < features.size(); ++i)
+    {
+        char name[32];
+        sprintf(name, "Feature %u", i);
+        labelSet->addFeature(name, features[i].position, features[i].size, Spectrum::White());
+    }
+
+    AlignedEllipsoid occluder(MarsSemiAxes);
+    labelSet->setOccluder(occluder);
+
+    // Build the cell index before timing anything
+    vector<FeatureLabelSetGeometry::VisibleLabel> culled;
+    labelSet->findVisibleLabels(randomView(1.0e6f), PixelSize, culled);
+
+    cout << "Features: " << featureCount << ", viewpoints: " << viewCount << endl;
+    cout << endl;
+    cout << fixed;
+    cout << "  Altitude (radii)  Views  Labels/view  Culled (us)  Brute force (us)  Mismatches" << endl;
+
+    // Altitude bands from close approach to far away, in planet radii
+    const double bands[][2] = { { 0.005, 0.1 }, { 0.1, 1.0 }, { 1.0, 10.0 }, { 10.0, 100.0 } };
+    const unsigned int bandCount = sizeof(bands) / sizeof(bands[0]);
+
+    unsigned long failures = 0;
+    vector<FeatureLabelSetGeometry::VisibleLabel> expected;
+    for (unsigned int band = 0; band < bandCount; ++band)
+    {
+        unsigned int views = (unsigned int) viewCount / bandCount + (band < (unsigned int) viewCount % bandCount ? 1 : 0);
+        unsigned long labelCount = 0;
+        unsigned long mismatches = 0;
+        double culledTime = 0.0;
+        double bruteForceTime = 0.0;
+
+        for (unsigned int i = 0; i < views; ++i)
+        {
+            double altitude = bands[band][0] * pow(bands[band][1] / bands[band][0], uniformRandom());
+            Transform3f modelview = randomView(float(MarsSemiAxes.x() * (1.0 + altitude)));
+
+            double startTime = omp_get_wtime();
+            labelSet->findVisibleLabels(modelview, PixelSize, culled);
+            culledTime += omp_get_wtime() - startTime;
+
+            startTime = omp_get_wtime();
+            findVisibleLabelsBruteForce(features, labelSet->boundingSphereRadius(), modelview, expected);
+            bruteForceTime += omp_get_wtime() - startTime;
+
+            labelCount += expected.size();
+            if (!sameLabels(culled, expected))
+            {
+                ++mismatches;
+            }
+        }
+
+        char bandName[32];
+        sprintf(bandName, "%g - %g", bands[band][0], bands[band][1]);
+        double n = max(1u, views);
+        cout << setw(18) << bandName
+             << setw(7) << views
+             << setw(13) << setprecision(1) << labelCount / n
+             << setw(13) << setprecision(1) << culledTime / n * 1.0e6
+             << setw(18) << setprecision(1) << bruteForceTime / n * 1.0e6
+             << setw(12) << mismatches << endl;
+
+        failures += mismatches;
+    }
+
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** mapindex - Check and time the vector map element index
+ *
+ * Usage: mapindex [line string count] [polygon count]
+ *
+ * A synthetic set of random line strings and polygons is clipped to every
+ * quadtree tile at several levels, once by testing every element against
+ * every tile (as VectorMapLayer did before it had an index) and once by
+ * clipping only the elements returned by MapElementIndex. The clipped
+ * geometry from the two methods must be identical. Index queries are also
+ * compared against a linear scan of the element bounds for random boxes.
+ * No OpenGL context is required.
+ */
+
+#include <vesta/VectorMapLayer.h>
+#include <vesta/Units.h>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const unsigned int MinTileLevel = 1;
+static const unsigned int MaxTileLevel = 5;
+static const unsigned int RandomQueryCount = 5000;
+
+
+static float
+uniformRandom()
+{
+    return float(rand()) / float(RAND_MAX);
+}
+
+
+// A random walk in longitude and latitude (radians). Steps are small compared to
+// the tiles at the finest level, and the walk doesn't cross the 180 degree meridian.
+static MapLineString*
+randomLineString(unsigned int pointCount, float stepSize)
+{
+    MapLineString* line = new MapLineString();
+
+    float lon = float(PI) * (uniformRandom() * 2.0f - 1.0f);
+    float lat = float(PI) * (uniformRandom() - 0.5f) * 0.9f;
+    for (unsigned int i = 0; i < pointCount; ++i)
+    {
+        line->addPoint(Vector3f(lon, lat, 0.0f));
+        lon = max(float(-PI), min(float(PI), lon + stepSize * (uniformRandom() * 2.0f - 1.0f)));
+        lat = max(float(-PI / 2), min(float(PI / 2), lat + stepSize * (uniformRandom() * 2.0f - 1.0f)));
+    }
+
+    return line;
+}
+
+
+static MapPolygon*
+randomPolygon(unsigned int pointCount, float radius)
+{
+    MapLineString* border = new MapLineString();
+
+    float lon = float(PI) * (uniformRandom() * 2.0f - 1.0f) * 0.95f;
+    float lat = float(PI) * (uniformRandom() - 0.5f) * 0.9f;
+    for (unsigned int i = 0; i < pointCount; ++i)
+    {
+        float theta = float(2.0 * PI) * float(i) / float(pointCount);
+        float r = radius * (0.5f + 0.5f * uniformRandom());
+        border->addPoint(Vector3f(lon + r * cos(theta), lat + r * sin(theta), 0.0f));
+    }
+
+    return new MapPolygon(border);
+}
+
+
+// Longitude/latitude bounds of a quadtree tile, computed the same way as in
+// VectorMapLayer. The map covers [-1, 1] x [-0.5, 0.5] in units of pi radians; the
+// two root tiles are the western and eastern hemispheres.
+struct TileBox
+{
+    float west;
+    float south;
+    float east;
+    float north;
+};
+
+
+static vector<TileBox>
+tilesAtLevel(unsigned int level)
+{
+    vector<TileBox> tiles;
+    float extent = 1.0f / float(1u << level);
+    float tileArc = float(PI) * extent;
+    for (unsigned int row = 0; row < (1u << level); ++row)
+    {
+        for (unsigned int column = 0; column < (2u << level); ++column)
+        {
+            TileBox box;
+            box.west = float(PI) * (-1.0f + column * extent);
+            box.south = float(PI) * (-0.5f + row * extent);
+            box.east = box.west + tileArc;
+            box.north = box.south + tileArc;
+            tiles.push_back(box);
+        }
+    }
+
+    return tiles;
+}
+
+
+static bool
+sameGeometry(const MapElementGeometry& g0, const MapElementGeometry& g1)
+{
+    return g0.runCount() == g1.runCount() && g0.vertices() == g1.vertices();
+}
+
+
+int main(int argc, char* argv[])
+{
+    int lineCount = argc > 1 ? atoi(argv[1]) : 2000;
+    int polygonCount = argc > 2 ? atoi(argv[2]) : 500;
+    if (argc > 3 || lineCount < 0 || polygonCount < 0)
+    {
+        cerr << "Usage: mapindex [line string count] [polygon count]" << endl;
+        return 1;
+    }
+
+    srand(1);
+
+    vector<counted_ptr<MapElement> > elements;
+    for (int i = 0; i < lineCount; ++i)
+    {
+        elements.push_back(counted_ptr<MapElement>(randomLineString(20, 0.02f)));
+    }
+    for (int i = 0; i < polygonCount; ++i)
+    {
+        elements.push_back(counted_ptr<MapElement>(randomPolygon(24, 0.05f)));
+    }
+
+    double startTime = omp_get_wtime();
+    MapElementIndex index;
+    index.build(elements);
+    double buildTime = omp_get_wtime() - startTime;
+
+    cout << "Elements: " << lineCount << " line strings, " << polygonCount << " polygons" << endl;
+    cout << "Index build: " << fixed << setprecision(3) << buildTime * 1000.0 << " ms" << endl;
+    cout << endl;
+
+    unsigned long failures = 0;
+
+    // Index queries against a linear scan of the element bounds
+    for (unsigned int i = 0; i < RandomQueryCount; ++i)
+    {
+        float size = float(PI) * 0.2f * uniformRandom() * uniformRandom();
+        Vector2f sw(float(PI) * (uniformRandom() * 2.0f - 1.0f), float(PI) * (uniformRandom() - 0.5f));
+        AlignedBox<float, 2> box(sw, sw + Vector2f(size * 2.0f, size));
+
+        vector<unsigned int> expected;
+        for (unsigned int j = 0; j < elements.size(); ++j)
+        {
+            AlignedBox<float, 2> bounds = elements[j]->bounds();
+            if (bounds.min().x() < box.max().x() && bounds.max().x() > box.min().x() &&
+                bounds.min().y() < box.max().y() && bounds.max().y() > box.min().y())
+            {
+                expected.push_back(j);
+            }
+        }
+
+        vector<unsigned int> found;
+        index.query(box, &found);
+        if (found != expected)
+        {
+            ++failures;
+        }
+    }
+    cout << "Random box queries differing from a linear scan: " << failures << " of " << RandomQueryCount << endl;
+    cout << endl;
+
+    // Clipped geometry for every tile at each level
+    cout << "Level   Tiles   All elements (ms)   Indexed (ms)   Clipped elements   Mismatched tiles" << endl;
+    for (unsigned int level = MinTileLevel; level <= MaxTileLevel; ++level)
+    {
+        vector<TileBox> tiles = tilesAtLevel(level);
+        vector<vector<MapElementGeometry> > bruteForce(tiles.size());
+        vector<vector<MapElementGeometry> > indexed(tiles.size());
+
+        // Brute force: clip every element to every tile. Polygons aren't clipped and
+        // generate their full outline for any tile, so the brute force path only
+        // keeps the polygons that overlap the tile.
+        startTime = omp_get_wtime();
+        for (unsigned int t = 0; t < tiles.size(); ++t)
+        {
+            const TileBox& box = tiles[t];
+            for (unsigned int i = 0; i < elements.size(); ++i)
+            {
+                MapElementGeometry geometry;
+                elements[i]->clip(box.west, box.south, box.east, box.north, &geometry);
+                if (!geometry.isEmpty() && (i < (unsigned int) lineCount ||
+                    (elements[i]->bounds().min().x() < box.east && elements[i]->bounds().max().x() > box.west &&
+                     elements[i]->bounds().min().y() < box.north && elements[i]->bounds().max().y() > box.south)))
+                {
+                    bruteForce[t].push_back(geometry);
+                }
+            }
+        }
+        double bruteForceTime = omp_get_wtime() - startTime;
+
+        // The same steps as VectorMapLayer::tileGeometry()
+        startTime = omp_get_wtime();
+        unsigned long clippedCount = 0;
+        vector<unsigned int> candidates;
+        for (unsigned int t = 0; t < tiles.size(); ++t)
+        {
+            const TileBox& box = tiles[t];
+            AlignedBox<float, 2> bounds(Vector2f(box.west, box.south), Vector2f(box.east, box.north));
+            index.query(bounds, &candidates);
+            clippedCount += candidates.size();
+            for (vector<unsigned int>::const_iterator iter = candidates.begin(); iter != candidates.end(); ++iter)
+            {
+                MapElementGeometry geometry;
+                elements[*iter]->clip(box.west, box.south, box.east, box.north, &geometry);
+                if (!geometry.isEmpty())
+                {
+                    indexed[t].push_back(geometry);
+                }
+            }
+        }
+        double indexedTime = omp_get_wtime() - startTime;
+
+        unsigned int mismatchedTiles = 0;
+        for (unsigned int t = 0; t < tiles.size(); ++t)
+        {
+            bool same = bruteForce[t].size() == indexed[t].size();
+            for (unsigned int i = 0; same && i < indexed[t].size(); ++i)
+            {
+                same = sameGeometry(bruteForce[t][i], indexed[t][i]);
+            }
+
+            if (!same)
+            {
+                ++mismatchedTiles;
+            }
+        }
+        failures += mismatchedTiles;
+
+        cout << setw(5) << level
+             << setw(8) << tiles.size()
+             << setw(20) << setprecision(2) << bruteForceTime * 1000.0
+             << setw(15) << indexedTime * 1000.0
+             << setw(19) << clippedCount
+             << setw(19) << mismatchedTiles << endl;
+    }
+
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+# Qt project file for the mapindex tool
+
+TEMPLATE = app
+TARGET = mapindex
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+GLEW_PATH = ../../thirdparty/glew
+
+# VectorMapLayer contains the drawing code as well, so the renderer and GLEW are
+# linked even though no GL calls are made.
+SOURCES = \
+    mapindex.cpp \
+    $$VESTA_PATH/DataChunk.cpp \
+    $$VESTA_PATH/Debug.cpp \
+    $$VESTA_PATH/LabelArbiter.cpp \
+    $$VESTA_PATH/PlanarProjection.cpp \
+    $$VESTA_PATH/PrimitiveBatch.cpp \
+    $$VESTA_PATH/QuadtreeTile.cpp \
+    $$VESTA_PATH/RenderContext.cpp \
+    $$VESTA_PATH/ShaderBuilder.cpp \
+    $$VESTA_PATH/TextureFont.cpp \
+    $$VESTA_PATH/TextureMap.cpp \
+    $$VESTA_PATH/TextureMapLoader.cpp \
+    $$VESTA_PATH/VectorMapLayer.cpp \
+    $$VESTA_PATH/VertexBuffer.cpp \
+    $$VESTA_PATH/VertexSpec.cpp \
+    $$VESTA_PATH/glhelp/GLBufferObject.cpp \
+    $$VESTA_PATH/glhelp/GLShader.cpp \
+    $$VESTA_PATH/glhelp/GLShaderProgram.cpp \
+    $$VESTA_PATH/glhelp/GLVertexBuffer.cpp \
+    $$VESTA_PATH/internal/DefaultFont.cpp \
+    $$VESTA_PATH/internal/InputDataStream.cpp \
+    $$VESTA_PATH/internal/OutputDataStream.cpp \
+    $$VESTA_PATH/internal/TextBatch.cpp \
+    $$VESTA_PATH/internal/TileVertexCache.cpp \
+    $$VESTA_PATH/particlesys/ParticleEmitter.cpp \
+    $$GLEW_PATH/glew.c
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH $$GLEW_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR GLEW_STATIC
+
+# OpenMP is used only for its timer
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+!win32-msvc* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+
+unix:!macx {
+    LIBS += -lGL
+}
+
+macx {
+    LIBS += -framework OpenGL
+}
+
+win32 {
+    LIBS += opengl32.lib
+}
@@ -0,0 +1,189 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** meshplaceholder - Check the size of mesh geometry loaded in the background
+ *
+ * Usage: meshplaceholder [mesh count]
+ *
+ * Mesh instances are created the way the catalog loader creates them when mesh
+ * files are loaded in the background: without a mesh and with the catalog size as
+ * the radius hint. The bounding sphere radius of each placeholder is checked, then
+ * a box mesh is installed and fit to the size as processLoadedMeshes() does, and
+ * the result is compared with an instance created with the mesh already loaded.
+ * No OpenGL context is required.
+ */
+
+#include "geometry/MeshInstanceGeometry.h"
+#include <vesta/MeshGeometry.h>
+#include <vesta/Submesh.h>
+#include <vesta/VertexArray.h>
+#include <vesta/PrimitiveBatch.h>
+#include <vesta/Material.h>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static double
+uniformRandom()
+{
+    return (rand() + 1.0) / (RAND_MAX + 1.0);
+}
+
+
+// Create a box mesh centered at the origin
+static MeshGeometry*
+createBox(const Vector3f& size)
+{
+    const unsigned int VertexCount = 8;
+    float* data = reinterpret_cast<float*>(new char[VertexCount * 3 * sizeof(float)]);
+    for (unsigned int i = 0; i < VertexCount; ++i)
+    {
+        data[i * 3 + 0] = (i & 1 ? 0.5f : -0.5f) * size.x();
+        data[i * 3 + 1] = (i & 2 ? 0.5f : -0.5f) * size.y();
+        data[i * 3 + 2] = (i & 4 ? 0.5f : -0.5f) * size.z();
+    }
+
+    static const v_uint16 indices[36] =
+    {
+        0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,
+        0, 1, 4,  1, 5, 4,  2, 6, 3,  3, 6, 7,
+        0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5,
+    };
+
+    Submesh* submesh = new Submesh(new VertexArray(data, VertexCount, VertexSpec::Position, 3 * sizeof(float)));
+    submesh->addPrimitiveBatch(new PrimitiveBatch(PrimitiveBatch::Triangles, indices, 12), 0);
+
+    MeshGeometry* mesh = new MeshGeometry();
+    mesh->addMaterial(new Material());
+    mesh->addSubmesh(submesh);
+
+    return mesh;
+}
+
+
+static bool
+sameRadius(float a, float b)
+{
+    return abs(a - b) <= 1.0e-6f * max(abs(a), abs(b));
+}
+
+
+int main(int argc, char* argv[])
+{
+    int meshCount = argc > 1 ? atoi(argv[1]) : 1000;
+    if (argc > 2 || meshCount < 1)
+    {
+        cerr << "Usage: meshplaceholder [mesh count]" << endl;
+        return 1;
+    }
+
+    srand(1);
+
+    unsigned int placeholderProblems = 0;
+    unsigned int installProblems = 0;
+    unsigned int pickProblems = 0;
+    float minRatio = 1.0e30f;
+    float maxRatio = 0.0f;
+
+    // An instance with no mesh and no hint keeps the old behavior
+    counted_ptr<MeshInstanceGeometry> empty(new MeshInstanceGeometry(NULL));
+    if (empty->boundingSphereRadius() != 0.0f)
+    {
+        ++placeholderProblems;
+    }
+
+    for (int i = 0; i < meshCount; ++i)
+    {
+        // Sizes from a few meters (spacecraft) to thousands of kilometers,
+        // and boxes with aspect ratios up to 10:1
+        float radius = float(0.001 * pow(10.0, 7.0 * uniformRandom()));
+        Vector3f boxSize(float(0.1 + uniformRandom()), float(0.1 + uniformRandom()), float(0.1 + uniformRandom()));
+        boxSize *= float(pow(10.0, 4.0 * uniformRandom() - 2.0));
+        counted_ptr<MeshGeometry> mesh(createBox(boxSize));
+
+        // Placeholder, as created by UniverseLoader::loadMeshGeometry()
+        counted_ptr<MeshInstanceGeometry> placeholder(new MeshInstanceGeometry(NULL));
+        placeholder->setRadiusHint(radius);
+
+        float hintedRadius = placeholder->boundingSphereRadius();
+        if (hintedRadius != radius)
+        {
+            ++placeholderProblems;
+        }
+
+        // Nothing to pick until the mesh is installed. The ray is aimed a bit off
+        // the center of the box, which lies on the diagonal of a face.
+        Vector3d origin(0.02 * radius, 0.01 * radius, -10.0 * radius);
+        double distance = 0.0;
+        if (placeholder->rayPick(origin, Vector3d::UnitZ(), 0.0, &distance))
+        {
+            ++pickProblems;
+        }
+
+        // Mesh installed by UniverseLoader::processLoadedMeshes()
+        placeholder->setMesh(mesh.ptr());
+        placeholder->fitToRadius(radius);
+
+        // Mesh loaded synchronously
+        counted_ptr<MeshInstanceGeometry> loaded(new MeshInstanceGeometry(mesh.ptr()));
+        loaded->fitToRadius(radius);
+
+        float loadedRadius = loaded->boundingSphereRadius();
+        if (!sameRadius(placeholder->boundingSphereRadius(), loadedRadius) ||
+            !sameRadius(placeholder->scale(), loaded->scale()))
+        {
+            ++installProblems;
+        }
+
+        // The mesh is fit so that its largest dimension equals the diameter, so
+        // its bounding sphere can be up to sqrt(3) times the size.
+        float ratio = loadedRadius / hintedRadius;
+        minRatio = min(minRatio, ratio);
+        maxRatio = max(maxRatio, ratio);
+        if (ratio < 1.0f - 1.0e-5f || ratio > sqrt(3.0f) + 1.0e-5f)
+        {
+            ++installProblems;
+        }
+
+        if (!placeholder->rayPick(origin, Vector3d::UnitZ(), 0.0, &distance))
+        {
+            ++pickProblems;
+        }
+    }
+
+    cout << "Meshes: " << meshCount << endl;
+    cout << endl;
+    cout << fixed;
+    cout << "            Check    Problems" << endl;
+    cout << setw(17) << "placeholder" << setw(12) << placeholderProblems << endl;
+    cout << setw(17) << "installed" << setw(12) << installProblems << endl;
+    cout << setw(17) << "pick" << setw(12) << pickProblems << endl;
+    cout << endl;
+    cout << "Loaded radius / hint: " << setprecision(3) << minRatio << " - " << maxRatio << endl;
+
+    unsigned int failures = placeholderProblems + installProblems + pickProblems;
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,349 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** quadbench - Compare persistent planet quadtrees with per-frame tessellation
+ *
+ * Usage: quadbench [frame count]
+ *
+ * A camera approaches an Earth sized planet and every frame the planet is seen
+ * from several views: two stereo eyes and the six faces of a cube map. The
+ * surface quadtree for each view is built three ways: tessellated from the root
+ * tiles, updated from a single persistent tree shared by all views, and updated
+ * from a persistent tree kept for each view. The time taken by each method is
+ * reported, and the visible tiles of the persistent trees are checked against
+ * those of the freshly tessellated tree. No OpenGL context is required.
+ */
+
+#include <vesta/QuadtreeTile.h>
+#include <vesta/PlanarProjection.h>
+#include <vesta/Frustum.h>
+#include <vesta/Units.h>
+#include <cstdlib>
+#include <cmath>
+#include <set>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+// Same as the constant used by WorldGeometry
+static const float MaxTileSquareSize = 256.0f;
+
+// Tile size of the base map; WorldGeometry scales the split threshold by
+// the tile size for tiled maps.
+static const unsigned int MapTileSize = 256;
+
+static const float EquatorialRadius = 6378.0f;
+static const float PolarRadius = 6357.0f;
+
+static const unsigned int StereoViewCount = 2;
+static const unsigned int CubeFaceCount = 6;
+static const unsigned int CubeFaceSize = 512;
+
+// View keys; cube map faces are numbered the same way as by UniverseRenderer.
+static const unsigned int CubeMapViewKeyBase = 0x10000;
+
+
+struct View
+{
+    unsigned int key;
+    Vector3f eyePosition;
+    CullingPlaneSet cullingPlanes;
+    float pixelSize;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+
+// A tile is identified by its level, row, and column.
+struct TileKey
+{
+    unsigned int level;
+    unsigned int row;
+    unsigned int column;
+
+    bool operator<(const TileKey& other) const
+    {
+        if (level != other.level)
+            return level < other.level;
+        if (row != other.row)
+            return row < other.row;
+        return column < other.column;
+    }
+};
+
+
+static TileKey
+tileKey(const QuadtreeTile& tile)
+{
+    TileKey key;
+    key.level = tile.level();
+    key.row = tile.row();
+    key.column = tile.column();
+    return key;
+}
+
+
+// Same calculation as in WorldGeometry
+static View
+makeView(unsigned int key,
+         const Vector3f& position,
+         const Quaternionf& orientation,
+         const PlanarProjection& projection,
+         unsigned int viewportHeight)
+{
+    Transform3f modelview(orientation.conjugate());
+    modelview.translate(-position);
+
+    View view;
+    view.key = key;
+    view.eyePosition = position;
+    view.pixelSize = float(2.0 * tan(projection.fovY() / 2.0) / viewportHeight);
+
+    float approxAltitude = position.norm() - PolarRadius;
+    float horizonDistance = 0.0f;
+    if (approxAltitude > 0.0f)
+    {
+        horizonDistance = sqrt((2 * EquatorialRadius + approxAltitude) * approxAltitude);
+    }
+
+    Frustum frustum = projection.frustum();
+    float farDistance = max(frustum.nearZ, min(horizonDistance, frustum.farZ));
+
+    Matrix4f modelviewTranspose = modelview.matrix().transpose();
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        view.cullingPlanes.planes[i] = Hyperplane<float, 3>(frustum.planeNormals[i].cast<float>(), 0.0f);
+        view.cullingPlanes.planes[i].coeffs() = modelviewTranspose * view.cullingPlanes.planes[i].coeffs();
+    }
+    view.cullingPlanes.planes[4].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f, -1.0f, -frustum.nearZ);
+    view.cullingPlanes.planes[5].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f,  1.0f, farDistance);
+
+    return view;
+}
+
+
+static Quaternionf
+lookAt(const Vector3f& direction, const Vector3f& up)
+{
+    Vector3f back = -direction.normalized();
+    Vector3f right = up.cross(back).normalized();
+    Vector3f trueUp = back.cross(right);
+
+    Matrix3f m;
+    m.col(0) = right;
+    m.col(1) = trueUp;
+    m.col(2) = back;
+    return Quaternionf(m);
+}
+
+
+// Build the views for one frame. The camera approaches from 60000 km to 20 km above
+// the surface while circling the planet; as it gets closer, it turns from the center
+// of the planet toward the horizon.
+static vector<View>
+frameViews(unsigned int frame, unsigned int frameCount)
+{
+    float s = float(frame) / float(max(1u, frameCount - 1));
+    float altitude = 60000.0f * pow(20.0f / 60000.0f, s);
+    float longitude = float(toRadians(90.0)) * s;
+
+    Vector3f radial(cos(longitude), sin(longitude), 0.0f);
+    Vector3f tangent(-sin(longitude), cos(longitude), 0.0f);
+    Vector3f up = Vector3f::UnitZ();
+    Vector3f position = radial * (EquatorialRadius + altitude);
+
+    float down = max(0.2f, min(1.0f, altitude / 5000.0f));
+    Vector3f direction = -radial * down + tangent * (1.0f - down);
+    Quaternionf orientation = lookAt(direction, up);
+
+    vector<View> views;
+
+    // Stereo eyes separated by a small fraction of the altitude
+    PlanarProjection eyeProjection = PlanarProjection::CreatePerspective(float(toRadians(50.0)), 16.0f / 9.0f, 0.001f, 1.0e9f);
+    Vector3f eyeOffset = (orientation * Vector3f::UnitX()) * (altitude * 0.002f);
+    views.push_back(makeView(1, position - eyeOffset, orientation, eyeProjection, 1080));
+    views.push_back(makeView(2, position + eyeOffset, orientation, eyeProjection, 1080));
+
+    // Cube map centered on the camera
+    PlanarProjection faceProjection = PlanarProjection::CreatePerspective(float(toRadians(90.0)), 1.0f, 0.001f, 1.0e9f);
+    const Vector3f faceDirections[CubeFaceCount] =
+    {
+        Vector3f::UnitX(), -Vector3f::UnitX(), Vector3f::UnitY(), -Vector3f::UnitY(), Vector3f::UnitZ(), -Vector3f::UnitZ()
+    };
+    const Vector3f faceUps[CubeFaceCount] =
+    {
+        -Vector3f::UnitY(), -Vector3f::UnitY(), Vector3f::UnitZ(), -Vector3f::UnitZ(), -Vector3f::UnitY(), -Vector3f::UnitY()
+    };
+    for (unsigned int face = 0; face < CubeFaceCount; ++face)
+    {
+        views.push_back(makeView(CubeMapViewKeyBase + face, position, lookAt(faceDirections[face], faceUps[face]), faceProjection, CubeFaceSize));
+    }
+
+    return views;
+}
+
+
+struct Comparison
+{
+    Comparison() :
+        visibleLeaves(0),
+        missingLeaves(0)
+    {
+    }
+
+    unsigned long visibleLeaves;
+    unsigned long missingLeaves;
+};
+
+
+// Count the visible leaves of the reference tree, and how many of those aren't
+// present in the persistent tree at all. A visible leaf of the reference tree may be
+// split further in the persistent tree (merging has some hysteresis), but it may not
+// be missing, which would mean the persistent tree is coarser than it should be.
+static void
+compareTiles(const QuadtreeTileAllocator::TileArray& reference,
+             const QuadtreeTileAllocator::TileArray& persistent,
+             Comparison* comparison)
+{
+    // Freed tiles are kept in the pool marked as culled; they never have children
+    set<TileKey> persistentTiles;
+    for (QuadtreeTileAllocator::TileArray::const_iterator iter = persistent.begin(); iter != persistent.end(); ++iter)
+    {
+        if (iter->hasChildren() || !iter->isCulled())
+        {
+            persistentTiles.insert(tileKey(*iter));
+        }
+    }
+
+    for (QuadtreeTileAllocator::TileArray::const_iterator iter = reference.begin(); iter != reference.end(); ++iter)
+    {
+        if (!iter->hasChildren() && !iter->isCulled())
+        {
+            comparison->visibleLeaves++;
+            if (persistentTiles.find(tileKey(*iter)) == persistentTiles.end())
+            {
+                comparison->missingLeaves++;
+            }
+        }
+    }
+}
+
+
+static unsigned long
+visibleLeafCount(const QuadtreeTileAllocator::TileArray& tiles)
+{
+    unsigned long count = 0;
+    for (QuadtreeTileAllocator::TileArray::const_iterator iter = tiles.begin(); iter != tiles.end(); ++iter)
+    {
+        if (!iter->hasChildren() && !iter->isCulled())
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int frameCount = argc > 1 ? atoi(argv[1]) : 600;
+    if (argc > 2 || frameCount < 2)
+    {
+        cerr << "Usage: quadbench [frame count]" << endl;
+        return 1;
+    }
+
+    Vector3f semiAxes(EquatorialRadius, EquatorialRadius, PolarRadius);
+
+    QuadtreeTileAllocator freshAllocator;
+    PersistentQuadtree sharedTree;
+    PersistentQuadtreeSet perViewTrees;
+
+    double freshTime = 0.0;
+    double sharedTime = 0.0;
+    double perViewTime = 0.0;
+
+    Comparison sharedComparison;
+    Comparison perViewComparison;
+    unsigned long freshLeaves = 0;
+    unsigned long perViewLeaves = 0;
+    unsigned long viewCount = 0;
+
+    for (int frame = 0; frame < frameCount; ++frame)
+    {
+        vector<View> views = frameViews(frame, frameCount);
+        for (unsigned int i = 0; i < views.size(); ++i)
+        {
+            const View& view = views[i];
+            float splitThreshold = view.pixelSize * MaxTileSquareSize * QuadtreeTile::TileSubdivision * float(MapTileSize) / 1000.0f;
+
+            // Tessellate from the root tiles, as WorldGeometry did before the trees
+            // were kept between frames.
+            double startTime = omp_get_wtime();
+            freshAllocator.clear();
+            QuadtreeTile* westHemi = NULL;
+            QuadtreeTile* eastHemi = NULL;
+            freshAllocator.newGlobe(semiAxes, &westHemi, &eastHemi);
+            westHemi->tessellate(view.eyePosition, view.cullingPlanes, semiAxes, splitThreshold, view.pixelSize);
+            eastHemi->tessellate(view.eyePosition, view.cullingPlanes, semiAxes, splitThreshold, view.pixelSize);
+            freshTime += omp_get_wtime() - startTime;
+
+            startTime = omp_get_wtime();
+            sharedTree.update(view.eyePosition, view.cullingPlanes, semiAxes, splitThreshold, view.pixelSize);
+            sharedTime += omp_get_wtime() - startTime;
+
+            startTime = omp_get_wtime();
+            PersistentQuadtree* viewTree = perViewTrees.tree(view.key);
+            viewTree->update(view.eyePosition, view.cullingPlanes, semiAxes, splitThreshold, view.pixelSize);
+            perViewTime += omp_get_wtime() - startTime;
+
+            compareTiles(freshAllocator.tiles(), sharedTree.tiles(), &sharedComparison);
+            compareTiles(freshAllocator.tiles(), viewTree->tiles(), &perViewComparison);
+            freshLeaves += visibleLeafCount(freshAllocator.tiles());
+            perViewLeaves += visibleLeafCount(viewTree->tiles());
+            ++viewCount;
+        }
+    }
+
+    cout << "Frames: " << frameCount << ", views per frame: " << StereoViewCount + CubeFaceCount
+         << " (" << StereoViewCount << " stereo eyes, " << CubeFaceCount << " cube map faces)" << endl;
+    cout << endl;
+
+    cout << "Quadtree update time per frame:" << endl;
+    cout << "  tessellated every view:   " << setw(9) << fixed << setprecision(3) << freshTime * 1000.0 / frameCount << " ms" << endl;
+    cout << "  one shared tree:          " << setw(9) << sharedTime * 1000.0 / frameCount << " ms" << endl;
+    cout << "  persistent tree per view: " << setw(9) << perViewTime * 1000.0 / frameCount << " ms" << endl;
+    cout << endl;
+
+    cout << "Visible leaf tiles per view: " << setprecision(1)
+         << double(freshLeaves) / viewCount << " tessellated, "
+         << double(perViewLeaves) / viewCount << " persistent" << endl;
+    cout << "Tessellated leaves missing from the shared tree:   " << sharedComparison.missingLeaves
+         << " of " << sharedComparison.visibleLeaves << endl;
+    cout << "Tessellated leaves missing from the per-view trees: " << perViewComparison.missingLeaves
+         << " of " << perViewComparison.visibleLeaves << endl;
+
+    bool ok = sharedComparison.missingLeaves == 0 && perViewComparison.missingLeaves == 0;
+    cout << endl << (ok ? "ok" : "FAILED") << endl;
+
+    return ok ? 0 : 1;
+}
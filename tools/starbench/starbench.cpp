@@ -0,0 +1,360 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** starbench - Compare loading a star file with mapping a starcat file
+ *
+ * Usage: starbench [star count] [directory]
+ *
+ * A synthetic catalog with the specified number of stars is written as both a
+ * binary star file and a starcat file. The time to read the star file and build
+ * the sky index is compared with the time to map the starcat file and find the
+ * stars in a field of view. Star vertices are generated as StarsLayer does,
+ * streaming only the stars in view through a fixed size buffer; for comparison,
+ * the time to create vertices for the whole catalog (as StarsLayer did before it
+ * streamed stars) is also reported. Then the camera is panned around the sky to
+ * show that the memory used by the mapped catalog stays within the resident
+ * limit.
+ */
+
+#include <vesta/StarCatalog.h>
+#include <vesta/PlanarProjection.h>
+#include <vesta/Units.h>
+#include <vesta/internal/StarVertexStream.h>
+#include <Eigen/Geometry>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const float LimitingMagnitude = 12.0f;
+static const float FieldOfView = 50.0f;     // degrees
+static const unsigned int PanStepCount = 72;
+static const v_uint64 ResidentLimit = 64 << 20;
+static const unsigned int StarStreamCapacity = 131072;   // same as StarsLayer
+
+
+static void
+writeBigEndian(ofstream& out, v_uint32 value)
+{
+    unsigned char bytes[4] = { (unsigned char) (value >> 24), (unsigned char) (value >> 16), (unsigned char) (value >> 8), (unsigned char) value };
+    out.write(reinterpret_cast<const char*>(bytes), 4);
+}
+
+
+static void
+writeBigEndian(ofstream& out, float value)
+{
+    v_uint32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    writeBigEndian(out, bits);
+}
+
+
+static double
+uniformRandom()
+{
+    return (rand() + 1.0) / (RAND_MAX + 1.0);
+}
+
+
+// Write a star file with stars distributed uniformly over the sky. The number of
+// stars brighter than magnitude m grows by a factor of 10^0.4 per magnitude.
+static bool
+writeSyntheticStarFile(const string& filename, unsigned int starCount)
+{
+    ofstream out(filename.c_str(), ios::out | ios::binary);
+    if (!out.good())
+    {
+        return false;
+    }
+
+    srand(1);
+    float brightest = float(2.5 * log10(double(starCount)));
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        float ra = float(uniformRandom() * 360.0);
+        float dec = float(toDegrees(asin(uniformRandom() * 2.0 - 1.0)));
+        float vmag = float(2.5 * log10(uniformRandom()) + brightest);
+        float bv = float(uniformRandom() * 2.3 - 0.3);
+
+        writeBigEndian(out, v_uint32(i + 1));
+        writeBigEndian(out, ra);
+        writeBigEndian(out, dec);
+        writeBigEndian(out, vmag);
+        writeBigEndian(out, bv);
+    }
+
+    return out.good();
+}
+
+
+static v_uint32
+readBigEndianUint32(const unsigned char* bytes)
+{
+    return (v_uint32(bytes[0]) << 24) | (v_uint32(bytes[1]) << 16) | (v_uint32(bytes[2]) << 8) | v_uint32(bytes[3]);
+}
+
+
+static float
+readBigEndianFloat(const unsigned char* bytes)
+{
+    v_uint32 bits = readBigEndianUint32(bytes);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+// Load a star file the way that Cosmographia does when no starcat file is present
+static StarCatalog*
+loadStarFile(const string& filename)
+{
+    ifstream in(filename.c_str(), ios::in | ios::binary);
+    if (!in.good())
+    {
+        return NULL;
+    }
+
+    StarCatalog* catalog = new StarCatalog();
+    unsigned char record[20];
+    while (in.read(reinterpret_cast<char*>(record), sizeof(record)))
+    {
+        catalog->addStar(readBigEndianUint32(record),
+                         toRadians(readBigEndianFloat(record + 4)),
+                         toRadians(readBigEndianFloat(record + 8)),
+                         readBigEndianFloat(record + 12),
+                         readBigEndianFloat(record + 16));
+    }
+
+    catalog->buildCatalogIndex();
+    catalog->skyIndex();
+
+    return catalog;
+}
+
+
+// Find the sky index ranges visible in a view looking toward the specified RA
+// (declination zero.)
+static void
+findViewRanges(StarCatalog* catalog, double ra, vector<StarSkyIndex::StarRange>& ranges)
+{
+    Matrix4f projection = PlanarProjection::CreatePerspective(float(toRadians(FieldOfView)), 1.0f, 0.1f, 10.0f).matrix();
+
+    // The camera looks down the -z axis; rotate the view direction to the requested RA
+    Matrix3f viewRotation = (AngleAxisf(float(ra), Vector3f::UnitZ()) * AngleAxisf(float(toRadians(-90.0)), Vector3f::UnitY())).toRotationMatrix();
+    Matrix4f modelview = Matrix4f::Identity();
+    modelview.corner<3, 3>(TopLeft) = viewRotation.transpose();
+
+    ranges.clear();
+    catalog->skyIndex()->findVisibleStars(projection * modelview, LimitingMagnitude, ranges);
+}
+
+
+// Find the stars in a view looking toward the specified RA and stream their
+// vertices through a buffer of StarStreamCapacity vertices, as the star renderer
+// does. Returns the number of stars visible.
+static unsigned int
+viewStars(StarCatalog* catalog, double ra, StarVertexStream& stream, vector<char>& vertexBuffer)
+{
+    vector<StarSkyIndex::StarRange> ranges;
+    findViewRanges(catalog, ra, ranges);
+
+    vertexBuffer.resize(stream.vertexSize() * StarStreamCapacity);
+    stream.begin(catalog, ranges);
+    while (!stream.isComplete())
+    {
+        stream.next(&vertexBuffer[0], StarStreamCapacity);
+    }
+
+    return stream.starCount();
+}
+
+
+// Create vertices for every star in the catalog, as StarsLayer did before vertices
+// were streamed. Colors are computed exactly for each star.
+static void
+allStarVertices(StarCatalog* catalog, vector<StarVertexStream::ShaderVertex>& vertices)
+{
+    const StarSkyIndex* index = catalog->skyIndex();
+    vertices.resize(catalog->size());
+    for (unsigned int i = 0; i < catalog->size(); ++i)
+    {
+        const StarCatalog::StarRecord& star = catalog->star(index->catalogIndex(i));
+        Vector3f position = StarCatalog::StarPosition(star);
+        vertices[i].x = position.x();
+        vertices[i].y = position.y();
+        vertices[i].appMag = star.apparentMagnitude;
+
+        Spectrum srgb = Spectrum::XYZtoLinearSRGB(StarCatalog::StarColor(star.bvColorIndex));
+        srgb.normalize();
+        vertices[i].color[0] = (int) (255.0f * srgb.red() + 0.5f);
+        vertices[i].color[1] = (int) (255.0f * srgb.green() + 0.5f);
+        vertices[i].color[2] = (int) (255.0f * srgb.blue() + 0.5f);
+        vertices[i].color[3] = position.z() < 0.0f ? 0 : 255;
+    }
+}
+
+
+// Return the largest difference between the streamed vertices of a set of ranges
+// and the vertices for the whole catalog.
+static unsigned int
+compareVertices(StarCatalog* catalog,
+                const vector<StarVertexStream::ShaderVertex>& allVertices,
+                const vector<StarSkyIndex::StarRange>& ranges)
+{
+    StarVertexStream stream(StarVertexStream::ShaderVertices, LimitingMagnitude);
+    vector<StarVertexStream::ShaderVertex> streamed(StarStreamCapacity);
+    stream.begin(catalog, ranges);
+
+    unsigned int maxDifference = 0;
+    unsigned int range = 0;
+    unsigned int offset = 0;
+    while (!stream.isComplete())
+    {
+        unsigned int count = stream.next(reinterpret_cast<char*>(&streamed[0]), StarStreamCapacity);
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            const StarVertexStream::ShaderVertex& v0 = streamed[i];
+            const StarVertexStream::ShaderVertex& v1 = allVertices[ranges[range].first + offset];
+            if (v0.x != v1.x || v0.y != v1.y || v0.appMag != v1.appMag || v0.color[3] != v1.color[3])
+            {
+                maxDifference = 255;
+            }
+            for (unsigned int j = 0; j < 3; ++j)
+            {
+                maxDifference = max(maxDifference, (unsigned int) abs(int(v0.color[j]) - int(v1.color[j])));
+            }
+
+            if (++offset == ranges[range].count)
+            {
+                ++range;
+                offset = 0;
+            }
+        }
+    }
+
+    return maxDifference;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int starCount = argc > 1 ? atoi(argv[1]) : 2500000;
+    string directory = argc > 2 ? argv[2] : ".";
+    if (argc > 3 || starCount < 1)
+    {
+        cerr << "Usage: starbench [star count] [directory]" << endl;
+        return 1;
+    }
+
+    string starFileName = directory + "/starbench.stars";
+    string starCatFileName = directory + "/starbench.starcat";
+
+    cout << "Writing " << starCount << " synthetic stars" << endl;
+    if (!writeSyntheticStarFile(starFileName, (unsigned int) starCount))
+    {
+        cerr << "Error writing " << starFileName << endl;
+        return 1;
+    }
+
+    cout << fixed << setprecision(3);
+
+    double startTime = omp_get_wtime();
+    counted_ptr<StarCatalog> loadedCatalog(loadStarFile(starFileName));
+    if (loadedCatalog.isNull())
+    {
+        cerr << "Error reading " << starFileName << endl;
+        return 1;
+    }
+    double loadTime = omp_get_wtime() - startTime;
+    cout << "Star file load and index:      " << setw(10) << loadTime << " s" << endl;
+
+    StarVertexStream stream(StarVertexStream::ShaderVertices, LimitingMagnitude);
+    vector<char> vertexBuffer;
+
+    startTime = omp_get_wtime();
+    vector<StarVertexStream::ShaderVertex> allVertices;
+    allStarVertices(loadedCatalog.ptr(), allVertices);
+    double allVerticesTime = omp_get_wtime() - startTime;
+
+    startTime = omp_get_wtime();
+    unsigned int loadedViewCount = viewStars(loadedCatalog.ptr(), 0.0, stream, vertexBuffer);
+    double streamTime = omp_get_wtime() - startTime;
+
+    vector<StarSkyIndex::StarRange> ranges;
+    findViewRanges(loadedCatalog.ptr(), 0.0, ranges);
+    unsigned int maxDifference = compareVertices(loadedCatalog.ptr(), allVertices, ranges);
+    allVertices.clear();
+
+    cout << "Vertices for all stars:        " << setw(10) << allVerticesTime * 1000.0 << " ms, "
+         << loadedCatalog->size() * double(sizeof(StarVertexStream::ShaderVertex)) / double(1 << 20) << " MB" << endl;
+    cout << "Streamed vertices for view:    " << setw(10) << streamTime * 1000.0 << " ms, "
+         << vertexBuffer.size() / double(1 << 20) << " MB buffer" << endl;
+    cout << "Largest streamed color error:  " << setw(10) << maxDifference << " / 255" << endl;
+
+    startTime = omp_get_wtime();
+    if (!loadedCatalog->SaveStarCat(starCatFileName.c_str()))
+    {
+        cerr << "Error writing " << starCatFileName << endl;
+        return 1;
+    }
+    cout << "starcat file write:            " << setw(10) << omp_get_wtime() - startTime << " s" << endl;
+
+    loadedCatalog = NULL;
+
+    startTime = omp_get_wtime();
+    counted_ptr<StarCatalog> mappedCatalog(StarCatalog::MapStarCat(starCatFileName.c_str()));
+    if (mappedCatalog.isNull())
+    {
+        cerr << "Error mapping " << starCatFileName << endl;
+        return 1;
+    }
+    double mapTime = omp_get_wtime() - startTime;
+    mappedCatalog->setResidentLimit(ResidentLimit);
+
+    unsigned int mappedViewCount = viewStars(mappedCatalog.ptr(), 0.0, stream, vertexBuffer);
+    double firstViewTime = omp_get_wtime() - startTime;
+
+    cout << "starcat map:                   " << setw(10) << mapTime << " s" << endl;
+    cout << "starcat map and first view:    " << setw(10) << firstViewTime << " s" << endl;
+    cout << "Speedup:                       " << setw(10) << setprecision(1) << loadTime / firstViewTime << "x" << endl;
+    cout << "Stars in view (loaded/mapped): " << loadedViewCount << " / " << mappedViewCount << endl;
+
+    v_uint64 maxResident = 0;
+    startTime = omp_get_wtime();
+    for (unsigned int i = 0; i < PanStepCount; ++i)
+    {
+        viewStars(mappedCatalog.ptr(), 2.0 * PI * i / PanStepCount, stream, vertexBuffer);
+        maxResident = max(maxResident, mappedCatalog->residentBytes());
+    }
+    double panTime = (omp_get_wtime() - startTime) / PanStepCount;
+
+    cout << setprecision(3);
+    cout << "Average time per panned view:  " << setw(10) << panTime * 1000.0 << " ms" << endl;
+    cout << "Maximum resident bytes:        " << setw(10) << maxResident / double(1 << 20) << " MB (limit "
+         << ResidentLimit / double(1 << 20) << " MB)" << endl;
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+# Qt project file for the starbench tool
+
+TEMPLATE = app
+TARGET = starbench
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+
+SOURCES = \
+    starbench.cpp \
+    $$VESTA_PATH/Debug.cpp \
+    $$VESTA_PATH/PlanarProjection.cpp \
+    $$VESTA_PATH/Spectrum.cpp \
+    $$VESTA_PATH/StarCatalog.cpp \
+    $$VESTA_PATH/StarSkyIndex.cpp \
+    $$VESTA_PATH/internal/MappedFile.cpp \
+    $$VESTA_PATH/internal/OutputDataStream.cpp \
+    $$VESTA_PATH/internal/StarVertexStream.cpp
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR
+
+# OpenMP is only used for its wall clock timer
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+!win32-msvc* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
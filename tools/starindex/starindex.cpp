@@ -0,0 +1,438 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** starindex - Check the star sky index against brute force
+ *
+ * Usage: starindex [star count] [max stars per cell]
+ *
+ * A synthetic catalog is indexed with StarSkyIndex. The structure of the index
+ * is checked (every star appears once, child cells partition their parents,
+ * leaf cells are sorted by brightness), and every star must lie in the leaf
+ * cell whose range contains it, which must also be the cell returned by
+ * findCell(). Then the stars found by findVisibleStars() for random views and
+ * limiting magnitudes are compared with a test of every star against the view
+ * frustum: no star in the frustum may be missed. The same checks are repeated
+ * for an index created with setCells() from the cells of the first one, as is
+ * done for starcat files. No OpenGL context is required.
+ */
+
+#include <vesta/StarCatalog.h>
+#include <vesta/StarSkyIndex.h>
+#include <vesta/PlanarProjection.h>
+#include <vesta/Units.h>
+#include <Eigen/Geometry>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const unsigned int ViewCount = 500;
+
+// Stars may be assigned to either cell when they lie within roundoff of an edge.
+// The edges of child cells are computed from normalized midpoints, so in deep
+// cells they can drift from the parent edges by a couple of millionths of a radian
+// per level. The bounding cap, which is what culling relies on, must still contain
+// every star exactly.
+static const float EdgeTolerance = 2.0e-6f;
+
+
+static double
+uniformRandom()
+{
+    return (rand() + 1.0) / (RAND_MAX + 1.0);
+}
+
+
+// Build a catalog with stars spread uniformly over the sky, a concentration
+// along the galactic plane, and stars lying exactly on the edges and corners of
+// the root cells.
+static StarCatalog*
+createCatalog(unsigned int starCount)
+{
+    StarCatalog* catalog = new StarCatalog();
+
+    srand(1);
+    float brightest = float(2.5 * log10(double(starCount)));
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        double ra = uniformRandom() * 2.0 * PI;
+        double dec = asin(uniformRandom() * 2.0 - 1.0);
+        switch (i % 8)
+        {
+        case 0:
+            // Root cell edges: the equator and four meridians
+            if (i % 16 == 0)
+            {
+                dec = 0.0;
+            }
+            else
+            {
+                ra = (rand() % 4) * PI / 2.0;
+            }
+            break;
+        case 1:
+        case 2:
+            // A band near the equator
+            dec = toRadians(10.0 * (uniformRandom() - 0.5));
+            break;
+        default:
+            break;
+        }
+
+        // Octahedron vertices
+        if (i < 6)
+        {
+            ra = (i % 4) * PI / 2.0;
+            dec = i < 4 ? 0.0 : (i == 4 ? PI / 2.0 : -PI / 2.0);
+        }
+
+        float vmag = float(2.5 * log10(uniformRandom()) + brightest);
+        catalog->addStar(v_uint32(i + 1), ra, dec, vmag, 0.65);
+    }
+
+    catalog->buildCatalogIndex();
+
+    return catalog;
+}
+
+
+// Signed distance from the nearest edge of a cell (negative outside)
+static float
+edgeDistance(const StarSkyIndex::Cell& cell, const Vector3f& direction)
+{
+    const Vector3f* v = cell.vertices;
+    float d0 = v[0].cross(v[1]).normalized().dot(direction);
+    float d1 = v[1].cross(v[2]).normalized().dot(direction);
+    float d2 = v[2].cross(v[0]).normalized().dot(direction);
+    return min(d0, min(d1, d2));
+}
+
+
+// Check the structure of the index and the cell membership of every star. Returns
+// the number of problems found.
+static unsigned int
+checkStructure(StarCatalog* catalog, const StarSkyIndex* index, unsigned int* leafCount, unsigned int* maxDepth)
+{
+    unsigned int problems = 0;
+    unsigned int starCount = index->starCount();
+
+    // Every catalog star must appear exactly once
+    vector<unsigned int> seen(starCount, 0);
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        unsigned int catalogIndex = index->catalogIndex(i);
+        if (catalogIndex >= starCount || seen[catalogIndex]++ != 0)
+        {
+            ++problems;
+        }
+    }
+
+    // The root cells cover the whole index in order
+    unsigned int nextStar = 0;
+    for (unsigned int i = 0; i < StarSkyIndex::RootCellCount; ++i)
+    {
+        if (index->cell(i).firstStar != nextStar)
+        {
+            ++problems;
+        }
+        nextStar = index->cell(i).firstStar + index->cell(i).starCount;
+    }
+    if (nextStar != starCount)
+    {
+        ++problems;
+    }
+
+    *leafCount = 0;
+    *maxDepth = 0;
+    for (unsigned int c = 0; c < index->cellCount(); ++c)
+    {
+        const StarSkyIndex::Cell& cell = index->cell(c);
+        *maxDepth = max(*maxDepth, cell.depth);
+
+        if (!cell.isLeaf())
+        {
+            // The children partition the parent's range, and the parent's brightest
+            // magnitude is the brightest of the children.
+            unsigned int childStar = cell.firstStar;
+            float brightest = 1.0e30f;
+            for (unsigned int j = 0; j < 4; ++j)
+            {
+                const StarSkyIndex::Cell& child = index->cell(cell.firstChild + j);
+                if (child.firstStar != childStar || child.depth != cell.depth + 1)
+                {
+                    ++problems;
+                }
+                childStar = child.firstStar + child.starCount;
+                if (child.starCount > 0)
+                {
+                    brightest = min(brightest, child.brightestMagnitude);
+                }
+            }
+            if (childStar != cell.firstStar + cell.starCount || (cell.starCount > 0 && brightest != cell.brightestMagnitude))
+            {
+                ++problems;
+            }
+            continue;
+        }
+
+        ++*leafCount;
+        for (unsigned int i = cell.firstStar; i < cell.firstStar + cell.starCount; ++i)
+        {
+            const StarCatalog::StarRecord& star = catalog->star(index->catalogIndex(i));
+            Vector3f position = StarCatalog::StarPosition(star);
+
+            // Stars within a leaf are sorted from brightest to faintest
+            if (index->magnitude(i) != star.apparentMagnitude ||
+                (i > cell.firstStar && index->magnitude(i) < index->magnitude(i - 1)))
+            {
+                ++problems;
+            }
+
+            if (i == cell.firstStar && cell.brightestMagnitude != index->magnitude(i))
+            {
+                ++problems;
+            }
+
+            if (edgeDistance(cell, position) < -EdgeTolerance * (cell.depth + 1) || StarSkyIndex::AngularDistance(cell, position) > 0.0f)
+            {
+                ++problems;
+            }
+
+            if (index->findCell(position) != c)
+            {
+                ++problems;
+            }
+        }
+    }
+
+    return problems;
+}
+
+
+// Compare the stars found with the index for random views against a test of every
+// star. Reports the total number of stars drawn using the index and the number
+// actually in view.
+static unsigned int
+checkCulling(StarCatalog* catalog, const StarSkyIndex* index, unsigned long* indexedStars, unsigned long* visibleStars,
+             double* indexedTime, double* bruteForceTime)
+{
+    unsigned int problems = 0;
+    unsigned int starCount = index->starCount();
+
+    vector<Vector3f> positions(starCount);
+    vector<float> magnitudes(starCount);
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        const StarCatalog::StarRecord& star = catalog->star(index->catalogIndex(i));
+        positions[i] = StarCatalog::StarPosition(star);
+        magnitudes[i] = star.apparentMagnitude;
+    }
+
+    *indexedStars = 0;
+    *visibleStars = 0;
+    *indexedTime = 0.0;
+    *bruteForceTime = 0.0;
+
+    srand(2);
+    vector<StarSkyIndex::StarRange> ranges;
+    vector<unsigned char> found(starCount);
+    for (unsigned int view = 0; view < ViewCount; ++view)
+    {
+        float fov = float(toRadians(1.0 + 119.0 * uniformRandom() * uniformRandom()));
+        float aspectRatio = float(0.5 + uniformRandom() * 1.5);
+        float limitingMagnitude = magnitudes.empty() ? 0.0f : float(uniformRandom() * 16.0 - 1.0);
+
+        Vector3f axis(float(uniformRandom() - 0.5), float(uniformRandom() - 0.5), float(uniformRandom() - 0.5));
+        Matrix3f rotation = AngleAxisf(float(uniformRandom() * 2.0 * PI), axis.normalized()).toRotationMatrix();
+        Matrix4f modelview = Matrix4f::Identity();
+        modelview.corner<3, 3>(TopLeft) = rotation;
+        Matrix4f viewProjection = PlanarProjection::CreatePerspective(fov, aspectRatio, 0.1f, 10.0f).matrix() * modelview;
+
+        double startTime = omp_get_wtime();
+        ranges.clear();
+        index->findVisibleStars(viewProjection, limitingMagnitude, ranges);
+        *indexedTime += omp_get_wtime() - startTime;
+
+        fill(found.begin(), found.end(), 0);
+        for (unsigned int i = 0; i < ranges.size(); ++i)
+        {
+            for (unsigned int j = ranges[i].first; j < ranges[i].first + ranges[i].count; ++j)
+            {
+                if (found[j] != 0 || magnitudes[j] > limitingMagnitude)
+                {
+                    ++problems;
+                }
+                found[j] = 1;
+            }
+            *indexedStars += ranges[i].count;
+        }
+
+        // A star is in view when it's inside the four side planes of the frustum
+        startTime = omp_get_wtime();
+        Vector4f planes[4];
+        planes[0] = (viewProjection.row(3) + viewProjection.row(0)).transpose();
+        planes[1] = (viewProjection.row(3) - viewProjection.row(0)).transpose();
+        planes[2] = (viewProjection.row(3) + viewProjection.row(1)).transpose();
+        planes[3] = (viewProjection.row(3) - viewProjection.row(1)).transpose();
+        unsigned int missed = 0;
+        for (unsigned int i = 0; i < starCount; ++i)
+        {
+            if (magnitudes[i] <= limitingMagnitude)
+            {
+                Vector4f p(positions[i].x(), positions[i].y(), positions[i].z(), 1.0f);
+                if (planes[0].dot(p) >= 0.0f && planes[1].dot(p) >= 0.0f && planes[2].dot(p) >= 0.0f && planes[3].dot(p) >= 0.0f)
+                {
+                    ++*visibleStars;
+                    if (!found[i])
+                    {
+                        ++missed;
+                    }
+                }
+            }
+        }
+        *bruteForceTime += omp_get_wtime() - startTime;
+
+        problems += missed;
+    }
+
+    return problems;
+}
+
+
+// Run all checks on an index and print a line of the report
+static unsigned int
+checkIndex(const char* label, StarCatalog* catalog, const StarSkyIndex* index)
+{
+    unsigned int leafCount = 0;
+    unsigned int maxDepth = 0;
+    unsigned int structureProblems = checkStructure(catalog, index, &leafCount, &maxDepth);
+
+    unsigned long indexedStars = 0;
+    unsigned long visibleStars = 0;
+    double indexedTime = 0.0;
+    double bruteForceTime = 0.0;
+    unsigned int cullingProblems = checkCulling(catalog, index, &indexedStars, &visibleStars, &indexedTime, &bruteForceTime);
+
+    cout << setw(10) << label
+         << setw(8) << index->cellCount()
+         << setw(8) << leafCount
+         << setw(7) << maxDepth
+         << setw(11) << structureProblems
+         << setw(13) << fixed << setprecision(2) << double(indexedStars) / max(1.0, double(visibleStars))
+         << setw(14) << setprecision(3) << indexedTime * 1000.0 / ViewCount
+         << setw(15) << bruteForceTime * 1000.0 / ViewCount
+         << setw(10) << cullingProblems << endl;
+
+    return structureProblems + cullingProblems;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int starCount = argc > 1 ? atoi(argv[1]) : 200000;
+    int maxStarsPerCell = argc > 2 ? atoi(argv[2]) : 256;
+    if (argc > 3 || starCount < 0 || maxStarsPerCell < 1)
+    {
+        cerr << "Usage: starindex [star count] [max stars per cell]" << endl;
+        return 1;
+    }
+
+    counted_ptr<StarCatalog> catalog(createCatalog((unsigned int) starCount));
+    StarSkyIndex built;
+    built.build(catalog.ptr(), (unsigned int) maxStarsPerCell);
+
+    // Rebuild the same index from its cells, as for a starcat file. A starcat file
+    // stores the stars in index order, so make a copy of the catalog in that order.
+    counted_ptr<StarCatalog> sortedCatalog(new StarCatalog());
+    for (unsigned int i = 0; i < built.starCount(); ++i)
+    {
+        const StarCatalog::StarRecord& star = catalog->star(built.catalogIndex(i));
+        sortedCatalog->addStar(star.identifier, star.RA, star.declination, star.apparentMagnitude, star.bvColorIndex);
+    }
+
+    // Don't call buildCatalogIndex() for the copy: it sorts the stars by identifier
+
+    vector<StarSkyIndex::Cell> cells;
+    for (unsigned int i = 0; i < built.cellCount(); ++i)
+    {
+        cells.push_back(built.cell(i));
+    }
+    vector<float> magnitudes(built.starCount());
+    for (unsigned int i = 0; i < built.starCount(); ++i)
+    {
+        magnitudes[i] = built.magnitude(i);
+    }
+
+    cout << "Stars: " << starCount << ", max stars per cell: " << maxStarsPerCell << ", views: " << ViewCount << endl;
+    cout << endl;
+    cout << "     Index   Cells  Leaves  Depth  Structure  Drawn/seen  Index (ms)  Brute (ms)  Missed" << endl;
+
+    unsigned int failures = checkIndex("build", catalog.ptr(), &built);
+
+    StarSkyIndex prebuilt;
+    if (!prebuilt.setCells(cells, magnitudes.empty() ? NULL : &magnitudes[0], built.starCount()))
+    {
+        cout << "setCells() rejected a valid index" << endl;
+        ++failures;
+    }
+    else
+    {
+        failures += checkIndex("setCells", sortedCatalog.ptr(), &prebuilt);
+
+        // The cell geometry is recomputed by setCells(); it must match exactly
+        unsigned int mismatchedCells = 0;
+        for (unsigned int i = 0; i < prebuilt.cellCount(); ++i)
+        {
+            for (unsigned int j = 0; j < 3; ++j)
+            {
+                if ((prebuilt.cell(i).vertices[j] - built.cell(i).vertices[j]).norm() != 0.0f)
+                {
+                    ++mismatchedCells;
+                    break;
+                }
+            }
+        }
+        if (mismatchedCells != 0)
+        {
+            cout << "setCells() geometry differs in " << mismatchedCells << " cells" << endl;
+            ++failures;
+        }
+
+        // Corrupt the child index of a root cell; setCells() must refuse it
+        if (!cells[0].isLeaf())
+        {
+            vector<StarSkyIndex::Cell> badCells(cells);
+            badCells[0].firstChild = badCells.size() - 2;
+            StarSkyIndex rejected;
+            if (rejected.setCells(badCells, &magnitudes[0], built.starCount()))
+            {
+                cout << "setCells() accepted an invalid index" << endl;
+                ++failures;
+            }
+        }
+    }
+
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+# Qt project file for the starindex tool
+
+TEMPLATE = app
+TARGET = starindex
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+
+SOURCES = \
+    starindex.cpp \
+    $$VESTA_PATH/Debug.cpp \
+    $$VESTA_PATH/PlanarProjection.cpp \
+    $$VESTA_PATH/Spectrum.cpp \
+    $$VESTA_PATH/StarCatalog.cpp \
+    $$VESTA_PATH/StarSkyIndex.cpp \
+    $$VESTA_PATH/internal/MappedFile.cpp \
+    $$VESTA_PATH/internal/OutputDataStream.cpp
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR
+
+# OpenMP is used only for its timer
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+!win32-msvc* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
@@ -0,0 +1,192 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** starpack - Convert a star catalog to a memory mappable starcat file
+ *
+ * Usage: starpack <input file> <output file>
+ *
+ * The input is either a binary star file in the format read by Cosmographia
+ * (e.g. tycho2.stars) or, if the file name ends in .csv, a text file with one
+ * star per line: identifier, RA, declination, V magnitude, B-V color index. RA
+ * and declination are in degrees for both formats.
+ */
+
+#include <vesta/StarCatalog.h>
+#include <vesta/Units.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <string>
+
+using namespace vesta;
+using namespace std;
+
+
+// Constrain maximum B-V color index; conversion to RGB color is not valid for
+// large values. This matches the limit applied by Cosmographia when it loads a
+// star file.
+static const float MaxBVColorIndex = 2.5f;
+
+
+static void
+usage()
+{
+    cerr << "Usage: starpack <input file> <output file>" << endl;
+}
+
+
+static void
+addStar(StarCatalog* catalog, v_uint32 id, float ra, float dec, float vmag, float bv)
+{
+    catalog->addStar(id, toRadians(ra), toRadians(dec), vmag, min(bv, MaxBVColorIndex));
+}
+
+
+static v_uint32
+bigEndianUint32(const unsigned char* bytes)
+{
+    return (v_uint32(bytes[0]) << 24) | (v_uint32(bytes[1]) << 16) | (v_uint32(bytes[2]) << 8) | v_uint32(bytes[3]);
+}
+
+
+static float
+bigEndianFloat(const unsigned char* bytes)
+{
+    v_uint32 bits = bigEndianUint32(bytes);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+// Read a binary star file: a sequence of 20 byte big endian records containing
+// the identifier (uint32), RA, declination, V magnitude, and B-V color index
+// (floats).
+static bool
+readStarFile(const char* filename, StarCatalog* catalog)
+{
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in.good())
+    {
+        cerr << "Can't open star file " << filename << endl;
+        return false;
+    }
+
+    unsigned char record[20];
+    while (in.read(reinterpret_cast<char*>(record), sizeof(record)))
+    {
+        addStar(catalog,
+                bigEndianUint32(record),
+                bigEndianFloat(record + 4),
+                bigEndianFloat(record + 8),
+                bigEndianFloat(record + 12),
+                bigEndianFloat(record + 16));
+    }
+
+    return true;
+}
+
+
+static bool
+readCsvFile(const char* filename, StarCatalog* catalog)
+{
+    ifstream in(filename);
+    if (!in.good())
+    {
+        cerr << "Can't open CSV file " << filename << endl;
+        return false;
+    }
+
+    string line;
+    unsigned int lineNumber = 0;
+    bool firstRecord = true;
+    while (getline(in, line))
+    {
+        ++lineNumber;
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        unsigned int id = 0;
+        float ra = 0.0f;
+        float dec = 0.0f;
+        float vmag = 0.0f;
+        float bv = 0.0f;
+        if (sscanf(line.c_str(), "%u , %f , %f , %f , %f", &id, &ra, &dec, &vmag, &bv) != 5)
+        {
+            // Allow a header line
+            if (firstRecord)
+            {
+                firstRecord = false;
+                continue;
+            }
+
+            cerr << "Bad star record at line " << lineNumber << " of " << filename << endl;
+            return false;
+        }
+
+        addStar(catalog, id, ra, dec, vmag, bv);
+        firstRecord = false;
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        usage();
+        return 1;
+    }
+
+    string inputFileName = argv[1];
+    string outputFileName = argv[2];
+
+    counted_ptr<StarCatalog> catalog(new StarCatalog());
+
+    bool ok = false;
+    if (inputFileName.size() > 4 && inputFileName.compare(inputFileName.size() - 4, 4, ".csv") == 0)
+    {
+        ok = readCsvFile(inputFileName.c_str(), catalog.ptr());
+    }
+    else
+    {
+        ok = readStarFile(inputFileName.c_str(), catalog.ptr());
+    }
+
+    if (!ok)
+    {
+        return 1;
+    }
+
+    catalog->buildCatalogIndex();
+    StarSkyIndex* index = catalog->skyIndex();
+
+    if (!catalog->SaveStarCat(outputFileName.c_str()))
+    {
+        cerr << "Error writing starcat file " << outputFileName << endl;
+        return 1;
+    }
+
+    cout << "Wrote " << catalog->size() << " stars in " << index->cellCount() << " sky cells to " << outputFileName << endl;
+
+    return 0;
+}
@@ -0,0 +1,20 @@
+# Qt project file for the starpack tool
+
+TEMPLATE = app
+TARGET = starpack
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+
+SOURCES = \
+    starpack.cpp \
+    $$VESTA_PATH/Debug.cpp \
+    $$VESTA_PATH/Spectrum.cpp \
+    $$VESTA_PATH/StarCatalog.cpp \
+    $$VESTA_PATH/StarSkyIndex.cpp \
+    $$VESTA_PATH/internal/MappedFile.cpp \
+    $$VESTA_PATH/internal/OutputDataStream.cpp
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR
@@ -0,0 +1,361 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** starquery - Check the star catalog spatial queries against brute force
+ *
+ * Usage: starquery [star count] [directory]
+ *
+ * A synthetic catalog is searched with StarCatalog::findStarsInCone(),
+ * findNearestStars(), and pickStar() for random directions, radii, and limiting
+ * magnitudes, and the results are compared with a scan of every star in the
+ * catalog. The queries are run on the catalog in memory, and then on the same
+ * catalog written to a starcat file in the specified directory and mapped.
+ * No OpenGL context is required.
+ */
+
+#include <vesta/StarCatalog.h>
+#include <vesta/Units.h>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const unsigned int QueryCount = 200;
+
+// Stars within this many radians of the edge of a cone may be either found or
+// missed, since the index computes distances in single precision.
+static const double DistanceTolerance = 1.0e-6;
+
+
+static double
+uniformRandom()
+{
+    return (rand() + 1.0) / (RAND_MAX + 1.0);
+}
+
+
+static Vector3f
+randomDirection()
+{
+    double ra = uniformRandom() * 2.0 * PI;
+    double dec = asin(uniformRandom() * 2.0 - 1.0);
+    return Vector3f(float(cos(dec) * cos(ra)), float(cos(dec) * sin(ra)), float(sin(dec)));
+}
+
+
+// Stars spread uniformly over the sky, with the number of stars brighter than
+// magnitude m growing by a factor of 10^0.4 per magnitude. A few pairs of stars
+// are placed very close together to exercise picking.
+static StarCatalog*
+createCatalog(unsigned int starCount)
+{
+    StarCatalog* catalog = new StarCatalog();
+
+    float brightest = float(2.5 * log10(double(starCount)));
+    for (unsigned int i = 0; i < starCount; ++i)
+    {
+        double ra = uniformRandom() * 2.0 * PI;
+        double dec = asin(uniformRandom() * 2.0 - 1.0);
+        double vmag = 2.5 * log10(uniformRandom()) + brightest;
+        if (i % 1000 == 1)
+        {
+            // Companion of the previous star
+            const StarCatalog::StarRecord& previous = catalog->star(i - 1);
+            ra = previous.RA + 1.0e-4 * uniformRandom();
+            dec = previous.declination;
+        }
+
+        catalog->addStar(i + 1, ra, dec, vmag, uniformRandom() * 2.0 - 0.3);
+    }
+
+    catalog->buildCatalogIndex();
+
+    return catalog;
+}
+
+
+// Angle in radians between a star and a direction, computed in double precision
+static double
+starDistance(const StarCatalog::StarRecord& star, const Vector3f& direction)
+{
+    Vector3d p = StarCatalog::StarPosition(star).cast<double>();
+    double chord = (p - direction.cast<double>().normalized()).norm();
+    return 2.0 * asin(min(1.0, chord * 0.5));
+}
+
+
+struct QueryResults
+{
+    unsigned long problems;
+    double indexTime;
+    double bruteForceTime;
+};
+
+
+// Compare cone queries with a test of every star. Returns the number of queries
+// whose results differ.
+static QueryResults
+checkCones(StarCatalog* catalog)
+{
+    QueryResults results = { 0, 0.0, 0.0 };
+
+    for (unsigned int q = 0; q < QueryCount; ++q)
+    {
+        Vector3f direction = randomDirection();
+        float radius = float(toRadians(0.01 + 5.0 * uniformRandom() * uniformRandom()));
+        float limitingMagnitude = float(6.0 + 8.0 * uniformRandom());
+
+        vector<unsigned int> found;
+        double startTime = omp_get_wtime();
+        catalog->findStarsInCone(direction, radius, limitingMagnitude, found);
+        results.indexTime += omp_get_wtime() - startTime;
+
+        startTime = omp_get_wtime();
+        vector<unsigned int> expected;
+        vector<unsigned int> borderline;
+        for (unsigned int i = 0; i < catalog->size(); ++i)
+        {
+            const StarCatalog::StarRecord& star = catalog->star(i);
+            if (star.apparentMagnitude <= limitingMagnitude)
+            {
+                double d = starDistance(star, direction);
+                if (d <= radius - DistanceTolerance)
+                {
+                    expected.push_back(i);
+                }
+                else if (d <= radius + DistanceTolerance)
+                {
+                    borderline.push_back(i);
+                }
+            }
+        }
+        results.bruteForceTime += omp_get_wtime() - startTime;
+
+        // Every expected star must be found exactly once, and every other star
+        // found must be a borderline one.
+        sort(found.begin(), found.end());
+        bool ok = adjacent_find(found.begin(), found.end()) == found.end() &&
+                  includes(found.begin(), found.end(), expected.begin(), expected.end());
+        for (unsigned int i = 0; ok && i < found.size(); ++i)
+        {
+            ok = binary_search(expected.begin(), expected.end(), found[i]) ||
+                 binary_search(borderline.begin(), borderline.end(), found[i]);
+        }
+
+        if (!ok)
+        {
+            ++results.problems;
+        }
+    }
+
+    return results;
+}
+
+
+// Compare nearest neighbor queries with a sort of the distances to every star.
+// The distances of the stars found must match those of the closest stars, which
+// allows for ties and roundoff.
+static QueryResults
+checkNearest(StarCatalog* catalog)
+{
+    QueryResults results = { 0, 0.0, 0.0 };
+
+    for (unsigned int q = 0; q < QueryCount; ++q)
+    {
+        Vector3f direction = randomDirection();
+        unsigned int count = 1 + rand() % 50;
+        float limitingMagnitude = float(6.0 + 8.0 * uniformRandom());
+
+        vector<unsigned int> found;
+        double startTime = omp_get_wtime();
+        catalog->findNearestStars(direction, count, limitingMagnitude, found);
+        results.indexTime += omp_get_wtime() - startTime;
+
+        startTime = omp_get_wtime();
+        vector<double> distances;
+        for (unsigned int i = 0; i < catalog->size(); ++i)
+        {
+            const StarCatalog::StarRecord& star = catalog->star(i);
+            if (star.apparentMagnitude <= limitingMagnitude)
+            {
+                distances.push_back(starDistance(star, direction));
+            }
+        }
+        unsigned int expectedCount = min((unsigned int) distances.size(), count);
+        partial_sort(distances.begin(), distances.begin() + expectedCount, distances.end());
+        results.bruteForceTime += omp_get_wtime() - startTime;
+
+        bool ok = found.size() == expectedCount;
+        for (unsigned int i = 0; ok && i < found.size(); ++i)
+        {
+            const StarCatalog::StarRecord& star = catalog->star(found[i]);
+            ok = star.apparentMagnitude <= limitingMagnitude &&
+                 abs(starDistance(star, direction) - distances[i]) <= DistanceTolerance;
+        }
+
+        if (!ok)
+        {
+            ++results.problems;
+        }
+    }
+
+    return results;
+}
+
+
+// Compare picking with the brightness weighted distance to every star within the
+// pick radius.
+static QueryResults
+checkPicks(StarCatalog* catalog)
+{
+    QueryResults results = { 0, 0.0, 0.0 };
+
+    for (unsigned int q = 0; q < QueryCount; ++q)
+    {
+        // Pick near a catalog star, as a user clicking on a star would
+        const StarCatalog::StarRecord& target = catalog->star(rand() % catalog->size());
+        Vector3f offset = randomDirection() * float(toRadians(0.05));
+        Vector3f direction = (StarCatalog::StarPosition(target) + offset).normalized();
+        float pickRadius = float(toRadians(0.02 + 0.2 * uniformRandom()));
+        float limitingMagnitude = float(6.0 + 8.0 * uniformRandom());
+
+        double startTime = omp_get_wtime();
+        const StarCatalog::StarRecord* picked = catalog->pickStar(direction, pickRadius, limitingMagnitude);
+        results.indexTime += omp_get_wtime() - startTime;
+
+        startTime = omp_get_wtime();
+        double bestDistance = -1.0;
+        for (unsigned int i = 0; i < catalog->size(); ++i)
+        {
+            const StarCatalog::StarRecord& star = catalog->star(i);
+            double d = starDistance(star, direction);
+            if (star.apparentMagnitude <= limitingMagnitude && d <= pickRadius - DistanceTolerance)
+            {
+                double weighted = d * pow(10.0, 0.2 * (star.apparentMagnitude - limitingMagnitude));
+                if (bestDistance < 0.0 || weighted < bestDistance)
+                {
+                    bestDistance = weighted;
+                }
+            }
+        }
+        results.bruteForceTime += omp_get_wtime() - startTime;
+
+        bool ok = true;
+        if (!picked)
+        {
+            ok = bestDistance < 0.0;
+        }
+        else
+        {
+            double weighted = starDistance(*picked, direction) * pow(10.0, 0.2 * (picked->apparentMagnitude - limitingMagnitude));
+            ok = picked->apparentMagnitude <= limitingMagnitude &&
+                 starDistance(*picked, direction) <= pickRadius + DistanceTolerance &&
+                 (bestDistance < 0.0 || weighted <= bestDistance * (1.0 + 1.0e-4) + DistanceTolerance);
+        }
+
+        if (!ok)
+        {
+            ++results.problems;
+        }
+    }
+
+    return results;
+}
+
+
+static unsigned long
+reportQueries(const char* catalogName, const char* queryName, const QueryResults& results)
+{
+    cout << setw(8) << catalogName
+         << setw(10) << queryName
+         << setw(14) << setprecision(1) << results.indexTime / QueryCount * 1.0e6
+         << setw(16) << setprecision(1) << results.bruteForceTime / QueryCount * 1.0e6
+         << setw(12) << results.problems << endl;
+
+    return results.problems;
+}
+
+
+static unsigned long
+checkCatalog(const char* catalogName, StarCatalog* catalog)
+{
+    // Build the index before timing any queries
+    vector<unsigned int> stars;
+    catalog->findStarsInCone(Vector3f::UnitX(), 0.0f, 0.0f, stars);
+
+    unsigned long failures = 0;
+    failures += reportQueries(catalogName, "cone", checkCones(catalog));
+    failures += reportQueries(catalogName, "nearest", checkNearest(catalog));
+    failures += reportQueries(catalogName, "pick", checkPicks(catalog));
+
+    return failures;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int starCount = argc > 1 ? atoi(argv[1]) : 500000;
+    string directory = argc > 2 ? argv[2] : ".";
+    if (argc > 3 || starCount < 2)
+    {
+        cerr << "Usage: starquery [star count] [directory]" << endl;
+        return 1;
+    }
+
+    srand(1);
+
+    counted_ptr<StarCatalog> catalog(createCatalog((unsigned int) starCount));
+
+    cout << "Stars: " << starCount << ", queries of each kind: " << QueryCount << endl;
+    cout << endl;
+    cout << fixed;
+    cout << " Catalog     Query  Index (us)  Brute force (us)  Mismatches" << endl;
+
+    unsigned long failures = checkCatalog("memory", catalog.ptr());
+
+    string starCatFileName = directory + "/starquery.starcat";
+    if (!catalog->SaveStarCat(starCatFileName.c_str()))
+    {
+        cerr << "Error writing " << starCatFileName << endl;
+        return 1;
+    }
+
+    counted_ptr<StarCatalog> mappedCatalog(StarCatalog::MapStarCat(starCatFileName.c_str()));
+    if (mappedCatalog.isNull())
+    {
+        cerr << "Error mapping " << starCatFileName << endl;
+        return 1;
+    }
+
+    failures += checkCatalog("mapped", mappedCatalog.ptr());
+
+    mappedCatalog = NULL;
+    remove(starCatFileName.c_str());
+
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
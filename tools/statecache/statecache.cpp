@@ -0,0 +1,403 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** statecache - Check that render state caching doesn't change the image
+ *
+ * Usage: statecache [image size]
+ *
+ * A small scene (planets, several instances of shared meshes with different
+ * materials, and translucent meshes) is drawn from a few viewpoints with the
+ * UniverseRenderer state cache enabled and disabled. With the cache disabled,
+ * opaque items are drawn in depth order and the complete material and vertex
+ * array state is sent for every draw, as before the cache existed. The two
+ * sets of images must be identical.
+ *
+ * The images are rendered offscreen with Mesa's software renderer through
+ * EGL, so no window or display is needed.
+ */
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <vesta/UniverseRenderer.h>
+#include <vesta/Universe.h>
+#include <vesta/Body.h>
+#include <vesta/Arc.h>
+#include <vesta/Chronology.h>
+#include <vesta/FixedPointTrajectory.h>
+#include <vesta/UniformRotationModel.h>
+#include <vesta/InertialFrame.h>
+#include <vesta/LightingEnvironment.h>
+#include <vesta/MeshGeometry.h>
+#include <vesta/Submesh.h>
+#include <vesta/VertexArray.h>
+#include <vesta/PrimitiveBatch.h>
+#include <vesta/WorldGeometry.h>
+#include <vesta/Framebuffer.h>
+#include <vesta/PlanarProjection.h>
+#include <vesta/Viewport.h>
+#include <vesta/Units.h>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+// The scene is placed far enough from the Sun (at the origin) that the light
+// direction is nearly the same for every object.
+static const Vector3d SceneCenter(-3.0e7, 1.0e7, -1.0e8);
+static const unsigned int ViewCount = 3;
+
+
+// Create a surfaceless EGL context with the desktop OpenGL API. Return false if
+// no context could be created.
+static bool
+createContext()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (!getPlatformDisplay)
+    {
+        return false;
+    }
+
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        return false;
+    }
+
+    EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config = 0;
+    EGLint configCount = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+
+    EGLContext context = eglCreateContext(display, configCount > 0 ? config : 0, EGL_NO_CONTEXT, NULL);
+    if (context == EGL_NO_CONTEXT)
+    {
+        return false;
+    }
+
+    return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_TRUE;
+}
+
+
+// Create a box mesh with a different material on each pair of opposite faces
+static MeshGeometry*
+createBox(const Vector3f& size, Material* materials[3])
+{
+    const unsigned int VertexCount = 24;
+    float* data = reinterpret_cast<float*>(new char[VertexCount * 6 * sizeof(float)]);
+    unsigned int n = 0;
+
+    vector<v_uint16> indices[3];
+    for (unsigned int axis = 0; axis < 3; ++axis)
+    {
+        for (int sign = -1; sign <= 1; sign += 2)
+        {
+            Vector3f normal = Vector3f::Zero();
+            normal[axis] = float(sign);
+            Vector3f u = Vector3f::Zero();
+            Vector3f v = Vector3f::Zero();
+            u[(axis + 1) % 3] = 1.0f;
+            v[(axis + 2) % 3] = float(sign);
+
+            v_uint16 first = v_uint16(n);
+            const float corners[4][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                Vector3f p = (normal + u * corners[i][0] + v * corners[i][1]).cwise() * size * 0.5f;
+                float* vertex = data + n * 6;
+                vertex[0] = p.x(); vertex[1] = p.y(); vertex[2] = p.z();
+                vertex[3] = normal.x(); vertex[4] = normal.y(); vertex[5] = normal.z();
+                ++n;
+            }
+
+            v_uint16 quad[6] = { first, v_uint16(first + 1), v_uint16(first + 2),
+                                 first, v_uint16(first + 2), v_uint16(first + 3) };
+            indices[axis].insert(indices[axis].end(), quad, quad + 6);
+        }
+    }
+
+    Submesh* submesh = new Submesh(new VertexArray(data, VertexCount, VertexSpec::PositionNormal, 6 * sizeof(float)));
+    MeshGeometry* mesh = new MeshGeometry();
+    for (unsigned int axis = 0; axis < 3; ++axis)
+    {
+        submesh->addPrimitiveBatch(new PrimitiveBatch(PrimitiveBatch::Triangles, &indices[axis][0], 4), axis);
+        mesh->addMaterial(materials[axis]);
+    }
+    mesh->addSubmesh(submesh);
+
+    return mesh;
+}
+
+
+static Material*
+createMaterial(const Spectrum& diffuse, float opacity = 1.0f, bool specular = false)
+{
+    Material* material = new Material();
+    material->setDiffuse(diffuse);
+    material->setOpacity(opacity);
+    if (opacity < 1.0f)
+    {
+        material->setBlendMode(Material::AlphaBlend);
+    }
+    if (specular)
+    {
+        material->setBrdf(Material::BlinnPhong);
+        material->setSpecular(Spectrum(0.8f, 0.8f, 0.8f));
+        material->setPhongExponent(40.0f);
+    }
+
+    return material;
+}
+
+
+static Body*
+createBody(Geometry* geometry, const Vector3d& offset, double rotationPeriod)
+{
+    Arc* arc = new Arc();
+    arc->setTrajectoryFrame(InertialFrame::equatorJ2000());
+    arc->setBodyFrame(InertialFrame::equatorJ2000());
+    arc->setTrajectory(new FixedPointTrajectory(SceneCenter + offset));
+    arc->setRotationModel(new UniformRotationModel(Vector3d(1.0, 2.0, 3.0).normalized(), 2.0 * PI / rotationPeriod, 0.5));
+    arc->setDuration(daysToSeconds(365.25));
+
+    Body* body = new Body();
+    body->chronology()->setBeginning(0.0);
+    body->chronology()->addArc(arc);
+    body->setGeometry(geometry);
+
+    return body;
+}
+
+
+static Universe*
+createScene()
+{
+    Universe* universe = new Universe();
+
+    WorldGeometry* planet = new WorldGeometry();
+    planet->setSphere(8.0f);
+    universe->addEntity(createBody(planet, Vector3d(0.0, 0.0, -30.0), 1000.0));
+
+    WorldGeometry* moon = new WorldGeometry();
+    moon->setSpheroid(3.0f, 0.2f);
+    universe->addEntity(createBody(moon, Vector3d(14.0, 6.0, -24.0), 700.0));
+
+    // Several instances of the same meshes, so that the opaque pass has items to group
+    Material* boxMaterials[3] = { createMaterial(Spectrum(0.9f, 0.2f, 0.1f)),
+                                  createMaterial(Spectrum(0.2f, 0.8f, 0.2f), 1.0f, true),
+                                  createMaterial(Spectrum(0.2f, 0.3f, 0.9f)) };
+    MeshGeometry* box = createBox(Vector3f(2.0f, 3.0f, 1.5f), boxMaterials);
+
+    Material* slabMaterials[3] = { createMaterial(Spectrum(0.7f, 0.7f, 0.7f), 1.0f, true),
+                                   createMaterial(Spectrum(0.9f, 0.8f, 0.1f)),
+                                   createMaterial(Spectrum(0.6f, 0.1f, 0.6f)) };
+    MeshGeometry* slab = createBox(Vector3f(4.0f, 0.5f, 2.5f), slabMaterials);
+
+    Material* glassMaterials[3] = { createMaterial(Spectrum(0.3f, 0.9f, 0.9f), 0.4f),
+                                    createMaterial(Spectrum(0.9f, 0.9f, 0.3f), 0.6f),
+                                    createMaterial(Spectrum(0.9f, 0.3f, 0.9f), 0.5f, true) };
+    MeshGeometry* glass = createBox(Vector3f(3.0f, 3.0f, 3.0f), glassMaterials);
+
+    srand(1);
+    for (unsigned int i = 0; i < 24; ++i)
+    {
+        Vector3d offset(double(rand() % 41 - 20), double(rand() % 31 - 15), -double(rand() % 30) - 5.0);
+        MeshGeometry* geometry = i % 3 == 0 ? slab : (i % 5 == 0 ? glass : box);
+        universe->addEntity(createBody(geometry, offset, 50.0 + i * 13.0));
+    }
+
+    return universe;
+}
+
+
+// Render each view into its own framebuffer and read the pixels back
+static bool
+renderViews(UniverseRenderer* renderer, const Universe* universe, Framebuffer* framebuffer, unsigned int size,
+            vector<vector<unsigned char> >* images)
+{
+    const Vector3d cameraOffsets[ViewCount] =
+    {
+        Vector3d(0.0, 0.0, 20.0),
+        Vector3d(-12.0, 4.0, 12.0),
+        Vector3d(10.0, -6.0, 8.0)
+    };
+
+    PlanarProjection projection = PlanarProjection::CreatePerspective(float(toRadians(60.0)), 1.0f, 0.5f, 1000.0f);
+    Viewport viewport(size, size);
+    LightingEnvironment lighting;
+
+    images->resize(ViewCount);
+    renderer->beginViewSet(universe, daysToSeconds(10.0));
+    for (unsigned int view = 0; view < ViewCount; ++view)
+    {
+        framebuffer->bind();
+        glDepthMask(GL_TRUE);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Aim the camera at the scene center (slightly in front of the planet)
+        Vector3d position = SceneCenter + cameraOffsets[view];
+        Vector3d direction = (SceneCenter + Vector3d(0.0, 0.0, -15.0) - position).normalized();
+        Quaterniond orientation;
+        orientation.setFromTwoVectors(-Vector3d::UnitZ(), direction);
+
+        if (renderer->renderView(&lighting, position, orientation, projection, viewport, framebuffer) != UniverseRenderer::RenderOk)
+        {
+            renderer->endViewSet();
+            return false;
+        }
+
+        // The framebuffer object doesn't set a read buffer
+        framebuffer->bind();
+        glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+        (*images)[view].resize(size * size * 4);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, &(*images)[view][0]);
+    }
+    renderer->endViewSet();
+    Framebuffer::unbind();
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int size = argc > 1 ? atoi(argv[1]) : 256;
+    if (argc > 2 || size <= 0)
+    {
+        cerr << "Usage: statecache [image size]" << endl;
+        return 1;
+    }
+
+    if (!createContext())
+    {
+        cerr << "Unable to create an offscreen OpenGL context." << endl;
+        return 1;
+    }
+
+    UniverseRenderer* renderer = new UniverseRenderer();
+    if (!renderer->initializeGraphics())
+    {
+        cerr << "Renderer initialization failed." << endl;
+        return 1;
+    }
+
+    counted_ptr<Framebuffer> framebuffer(Framebuffer::CreateFramebuffer(size, size, TextureMap::R8G8B8A8));
+    if (framebuffer.isNull() || !framebuffer->isValid())
+    {
+        cerr << "Unable to create a framebuffer object." << endl;
+        return 1;
+    }
+
+    counted_ptr<Universe> universe(createScene());
+
+    cout << "Renderer: " << glGetString(GL_RENDERER) << endl;
+    cout << endl;
+
+    vector<vector<unsigned char> > cachedImages;
+    vector<vector<unsigned char> > uncachedImages;
+    UniverseRenderer::RenderStatistics stats[2];
+
+    for (unsigned int run = 0; run < 2; ++run)
+    {
+        bool cached = run == 0;
+        renderer->setStateCacheEnabled(cached);
+        renderer->resetStatistics();
+        if (!renderViews(renderer, universe.ptr(), framebuffer.ptr(), size, cached ? &cachedImages : &uncachedImages))
+        {
+            cerr << "Rendering failed." << endl;
+            return 1;
+        }
+        stats[run] = renderer->statistics();
+    }
+
+    cout << "State cache   Draws   Materials sent   Materials skipped   Array changes   Array changes skipped" << endl;
+    for (unsigned int run = 0; run < 2; ++run)
+    {
+        cout << setw(11) << (run == 0 ? "on" : "off")
+             << setw(8) << stats[run].drawCallCount
+             << setw(17) << stats[run].materialUpdateCount
+             << setw(20) << stats[run].materialUpdatesSkipped
+             << setw(16) << stats[run].arrayStateChangeCount
+             << setw(24) << stats[run].arrayStateChangesSkipped << endl;
+    }
+    cout << endl;
+
+    unsigned int failures = 0;
+    cout << "View   Covered pixels   Differing pixels   Max difference" << endl;
+    for (unsigned int view = 0; view < ViewCount; ++view)
+    {
+        const vector<unsigned char>& image0 = cachedImages[view];
+        const vector<unsigned char>& image1 = uncachedImages[view];
+
+        unsigned int coveredPixels = 0;
+        unsigned int differingPixels = 0;
+        int maxDifference = 0;
+        for (unsigned int i = 0; i < image0.size(); i += 4)
+        {
+            if (image0[i] != 0 || image0[i + 1] != 0 || image0[i + 2] != 0)
+            {
+                ++coveredPixels;
+            }
+
+            if (memcmp(&image0[i], &image1[i], 4) != 0)
+            {
+                ++differingPixels;
+                for (unsigned int j = 0; j < 4; ++j)
+                {
+                    maxDifference = max(maxDifference, abs(int(image0[i + j]) - int(image1[i + j])));
+                }
+            }
+        }
+
+        // An empty image would make the comparison meaningless
+        if (differingPixels != 0 || coveredPixels == 0)
+        {
+            ++failures;
+        }
+
+        cout << setw(4) << view
+             << setw(17) << coveredPixels
+             << setw(19) << differingPixels
+             << setw(17) << maxDifference << endl;
+    }
+
+    // Without the cache, nothing should have been skipped
+    if (stats[1].materialUpdatesSkipped != 0 || stats[1].arrayStateChangesSkipped != 0)
+    {
+        ++failures;
+    }
+
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
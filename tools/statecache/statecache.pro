@@ -0,0 +1,100 @@
+# Qt project file for the statecache tool
+
+TEMPLATE = app
+TARGET = statecache
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+LIB3DS_PATH = ../../thirdparty/lib3ds
+GLEW_PATH = ../../thirdparty/glew
+
+SOURCES = \
+    statecache.cpp \
+    $$VESTA_PATH/AlignedEllipsoid.cpp \
+    $$VESTA_PATH/Arc.cpp \
+    $$VESTA_PATH/Atmosphere.cpp \
+    $$VESTA_PATH/Body.cpp \
+    $$VESTA_PATH/Chronology.cpp \
+    $$VESTA_PATH/CubeMapFramebuffer.cpp \
+    $$VESTA_PATH/DataChunk.cpp \
+    $$VESTA_PATH/Debug.cpp \
+    $$VESTA_PATH/Entity.cpp \
+    $$VESTA_PATH/FixedPointTrajectory.cpp \
+    $$VESTA_PATH/FixedRotationModel.cpp \
+    $$VESTA_PATH/Framebuffer.cpp \
+    $$VESTA_PATH/GeneralEllipse.cpp \
+    $$VESTA_PATH/Geometry.cpp \
+    $$VESTA_PATH/GlareOverlay.cpp \
+    $$VESTA_PATH/InertialFrame.cpp \
+    $$VESTA_PATH/LabelArbiter.cpp \
+    $$VESTA_PATH/LightSource.cpp \
+    $$VESTA_PATH/MeshGeometry.cpp \
+    $$VESTA_PATH/Observer.cpp \
+    $$VESTA_PATH/PickContext.cpp \
+    $$VESTA_PATH/PlanarProjection.cpp \
+    $$VESTA_PATH/PlanetaryRings.cpp \
+    $$VESTA_PATH/PrimitiveBatch.cpp \
+    $$VESTA_PATH/QuadtreeTile.cpp \
+    $$VESTA_PATH/RenderContext.cpp \
+    $$VESTA_PATH/ShaderBuilder.cpp \
+    $$VESTA_PATH/StarCatalog.cpp \
+    $$VESTA_PATH/StarSkyIndex.cpp \
+    $$VESTA_PATH/Submesh.cpp \
+    $$VESTA_PATH/TextureFont.cpp \
+    $$VESTA_PATH/TextureMap.cpp \
+    $$VESTA_PATH/TextureMapLoader.cpp \
+    $$VESTA_PATH/UniformRotationModel.cpp \
+    $$VESTA_PATH/Universe.cpp \
+    $$VESTA_PATH/UniverseRenderer.cpp \
+    $$VESTA_PATH/VertexArray.cpp \
+    $$VESTA_PATH/VertexBuffer.cpp \
+    $$VESTA_PATH/VertexPool.cpp \
+    $$VESTA_PATH/VertexSpec.cpp \
+    $$VESTA_PATH/Visualizer.cpp \
+    $$VESTA_PATH/WorldGeometry.cpp \
+    $$VESTA_PATH/glhelp/GLBufferObject.cpp \
+    $$VESTA_PATH/glhelp/GLFramebuffer.cpp \
+    $$VESTA_PATH/glhelp/GLShader.cpp \
+    $$VESTA_PATH/glhelp/GLShaderProgram.cpp \
+    $$VESTA_PATH/glhelp/GLVertexBuffer.cpp \
+    $$VESTA_PATH/internal/DefaultFont.cpp \
+    $$VESTA_PATH/internal/EclipseShadowVolumeSet.cpp \
+    $$VESTA_PATH/internal/InputDataStream.cpp \
+    $$VESTA_PATH/internal/MappedFile.cpp \
+    $$VESTA_PATH/internal/ObjLoader.cpp \
+    $$VESTA_PATH/internal/OutputDataStream.cpp \
+    $$VESTA_PATH/internal/ShadowMapCache.cpp \
+    $$VESTA_PATH/internal/TextBatch.cpp \
+    $$VESTA_PATH/internal/TileVertexCache.cpp \
+    $$VESTA_PATH/internal/VisibilitySet.cpp \
+    $$VESTA_PATH/particlesys/ParticleEmitter.cpp \
+    $$LIB3DS_PATH/lib3ds_atmosphere.c \
+    $$LIB3DS_PATH/lib3ds_background.c \
+    $$LIB3DS_PATH/lib3ds_camera.c \
+    $$LIB3DS_PATH/lib3ds_chunk.c \
+    $$LIB3DS_PATH/lib3ds_chunktable.c \
+    $$LIB3DS_PATH/lib3ds_file.c \
+    $$LIB3DS_PATH/lib3ds_io.c \
+    $$LIB3DS_PATH/lib3ds_light.c \
+    $$LIB3DS_PATH/lib3ds_material.c \
+    $$LIB3DS_PATH/lib3ds_math.c \
+    $$LIB3DS_PATH/lib3ds_matrix.c \
+    $$LIB3DS_PATH/lib3ds_mesh.c \
+    $$LIB3DS_PATH/lib3ds_node.c \
+    $$LIB3DS_PATH/lib3ds_quat.c \
+    $$LIB3DS_PATH/lib3ds_shadow.c \
+    $$LIB3DS_PATH/lib3ds_track.c \
+    $$LIB3DS_PATH/lib3ds_util.c \
+    $$LIB3DS_PATH/lib3ds_vector.c \
+    $$LIB3DS_PATH/lib3ds_viewport.c \
+    $$GLEW_PATH/glew.c
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH $$LIB3DS_PATH $$GLEW_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR GLEW_STATIC
+
+# The offscreen context is created with EGL on Mesa's surfaceless platform,
+# so this tool only builds on Linux.
+unix:!macx {
+    LIBS += -lEGL -lGL
+}
@@ -0,0 +1,523 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** texcompress - Check the quality and speed of TextureCompressor
+ *
+ * Usage: texcompress [image file ...]
+ *
+ * Each image is compressed with TextureCompressor, the top mip level is decoded,
+ * and its PSNR is compared with that of a slow reference encoder that searches
+ * every pair of block colors for the best DXT1 endpoints. Then the throughput
+ * of the compressor is measured on one core and on all cores. Without any
+ * image files, synthetic test images are used.
+ */
+
+#include "vext/TextureCompressor.h"
+#include <QCoreApplication>
+#include <QImage>
+#include <QFileInfo>
+#include <QtEndian>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace std;
+
+
+// The compressor is allowed to be this much worse than the reference encoder
+static const double MaxPSNRLoss = 1.0;   // dB
+
+static const int DDSHeaderSize = 128;
+static const quint32 FourCC_DXT5 = 0x35545844;
+
+
+static inline void
+unpackRGB565(quint16 c, int color[3])
+{
+    int r = (c >> 11) & 0x1f;
+    int g = (c >> 5) & 0x3f;
+    int b = c & 0x1f;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+
+static inline quint16
+packRGB565(int r, int g, int b)
+{
+    return quint16(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+
+// Build the four colors of a DXT color block. Blocks in DXT5 textures always use
+// four color mode.
+static void
+blockPalette(quint16 c0, quint16 c1, bool forceFourColor, int palette[4][3])
+{
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int k = 0; k < 3; ++k)
+    {
+        if (c0 > c1 || forceFourColor)
+        {
+            palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+            palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+        }
+        else
+        {
+            palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+            palette[3][k] = 0;
+        }
+    }
+}
+
+
+// Decode a DXT1 or DXT5 image into 8-bit RGBA
+static void
+decodeImage(const unsigned char* data, unsigned int width, unsigned int height, bool dxt5, vector<unsigned char>* rgba)
+{
+    rgba->assign(width * height * 4, 255);
+    unsigned int blocksWide = (width + 3) / 4;
+    unsigned int blocksHigh = (height + 3) / 4;
+    const unsigned char* block = data;
+
+    for (unsigned int by = 0; by < blocksHigh; ++by)
+    {
+        for (unsigned int bx = 0; bx < blocksWide; ++bx)
+        {
+            int alphas[8];
+            quint64 alphaBits = 0;
+            if (dxt5)
+            {
+                alphas[0] = block[0];
+                alphas[1] = block[1];
+                if (alphas[0] > alphas[1])
+                {
+                    for (int i = 1; i < 7; ++i)
+                    {
+                        alphas[i + 1] = ((7 - i) * alphas[0] + i * alphas[1]) / 7;
+                    }
+                }
+                else
+                {
+                    for (int i = 1; i < 5; ++i)
+                    {
+                        alphas[i + 1] = ((5 - i) * alphas[0] + i * alphas[1]) / 5;
+                    }
+                    alphas[6] = 0;
+                    alphas[7] = 255;
+                }
+                for (int i = 0; i < 6; ++i)
+                {
+                    alphaBits |= quint64(block[2 + i]) << (8 * i);
+                }
+                block += 8;
+            }
+
+            int palette[4][3];
+            blockPalette(qFromLittleEndian<quint16>(block), qFromLittleEndian<quint16>(block + 2), dxt5, palette);
+            quint32 colorBits = qFromLittleEndian<quint32>(block + 4);
+            block += 8;
+
+            for (unsigned int i = 0; i < 16; ++i)
+            {
+                unsigned int x = bx * 4 + (i & 3);
+                unsigned int y = by * 4 + (i >> 2);
+                if (x >= width || y >= height)
+                {
+                    continue;
+                }
+
+                unsigned char* p = &(*rgba)[(y * width + x) * 4];
+                const int* color = palette[(colorBits >> (2 * i)) & 3];
+                p[0] = (unsigned char) color[0];
+                p[1] = (unsigned char) color[1];
+                p[2] = (unsigned char) color[2];
+                if (dxt5)
+                {
+                    p[3] = (unsigned char) alphas[(alphaBits >> (3 * i)) & 7];
+                }
+            }
+        }
+    }
+}
+
+
+// Squared error of the best palette entry for each pixel of a block
+static int
+blockError(const unsigned char* pixels, const int palette[4][3], unsigned int paletteSize, quint32* indices)
+{
+    int totalError = 0;
+    quint32 bits = 0;
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        const unsigned char* p = pixels + i * 4;
+        int bestError = INT_MAX;
+        unsigned int bestIndex = 0;
+        for (unsigned int j = 0; j < paletteSize; ++j)
+        {
+            int dr = p[0] - palette[j][0];
+            int dg = p[1] - palette[j][1];
+            int db = p[2] - palette[j][2];
+            int error = dr * dr + dg * dg + db * db;
+            if (error < bestError)
+            {
+                bestError = error;
+                bestIndex = j;
+            }
+        }
+        totalError += bestError;
+        bits |= bestIndex << (2 * i);
+    }
+
+    *indices = bits;
+    return totalError;
+}
+
+
+// Reference DXT1 encoder: every pair of colors in the block is tried as the pair
+// of endpoints, and the pair giving the smallest error is kept. This is far too
+// slow for use at load time, but it's a good yardstick for the fast encoder.
+static void
+referenceEncodeImage(const vector<unsigned char>& rgba, unsigned int width, unsigned int height, vector<unsigned char>* decoded)
+{
+    decoded->assign(width * height * 4, 255);
+    unsigned int blocksWide = (width + 3) / 4;
+    unsigned int blocksHigh = (height + 3) / 4;
+
+#pragma omp parallel for
+    for (int by = 0; by < int(blocksHigh); ++by)
+    {
+        unsigned char pixels[16 * 4];
+        for (unsigned int bx = 0; bx < blocksWide; ++bx)
+        {
+            for (unsigned int i = 0; i < 16; ++i)
+            {
+                unsigned int x = min(bx * 4 + (i & 3), width - 1);
+                unsigned int y = min((unsigned int) by * 4 + (i >> 2), height - 1);
+                for (unsigned int k = 0; k < 4; ++k)
+                {
+                    pixels[i * 4 + k] = rgba[(y * width + x) * 4 + k];
+                }
+            }
+
+            int bestError = INT_MAX;
+            int bestPalette[4][3];
+            quint32 bestIndices = 0;
+            for (unsigned int i = 0; i < 16; ++i)
+            {
+                for (unsigned int j = i; j < 16; ++j)
+                {
+                    quint16 c0 = packRGB565(pixels[i * 4], pixels[i * 4 + 1], pixels[i * 4 + 2]);
+                    quint16 c1 = packRGB565(pixels[j * 4], pixels[j * 4 + 1], pixels[j * 4 + 2]);
+                    if (c0 < c1)
+                    {
+                        swap(c0, c1);
+                    }
+
+                    int palette[4][3];
+                    blockPalette(c0, c1, true, palette);
+                    quint32 indices = 0;
+                    int error = blockError(pixels, palette, 4, &indices);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        bestIndices = indices;
+                        memcpy(bestPalette, palette, sizeof(palette));
+                    }
+                }
+            }
+
+            for (unsigned int i = 0; i < 16; ++i)
+            {
+                unsigned int x = bx * 4 + (i & 3);
+                unsigned int y = by * 4 + (i >> 2);
+                if (x < width && y < height)
+                {
+                    const int* color = bestPalette[(bestIndices >> (2 * i)) & 3];
+                    unsigned char* p = &(*decoded)[(y * width + x) * 4];
+                    p[0] = (unsigned char) color[0];
+                    p[1] = (unsigned char) color[1];
+                    p[2] = (unsigned char) color[2];
+                }
+            }
+        }
+    }
+}
+
+
+// Peak signal to noise ratio of the first channelCount channels of an RGBA image
+static double
+psnr(const vector<unsigned char>& a, const vector<unsigned char>& b, unsigned int firstChannel, unsigned int channelCount)
+{
+    double sumSquares = 0.0;
+    unsigned int sampleCount = 0;
+    for (unsigned int i = 0; i < a.size(); i += 4)
+    {
+        for (unsigned int k = firstChannel; k < firstChannel + channelCount; ++k)
+        {
+            double d = double(a[i + k]) - double(b[i + k]);
+            sumSquares += d * d;
+            ++sampleCount;
+        }
+    }
+
+    if (sumSquares == 0.0)
+    {
+        return 99.0;
+    }
+
+    double mse = sumSquares / sampleCount;
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+
+static void
+unpackImage(const QImage& image, vector<unsigned char>* rgba)
+{
+    QImage argbImage = image.convertToFormat(QImage::Format_ARGB32);
+    rgba->resize(image.width() * image.height() * 4);
+    unsigned char* p = &(*rgba)[0];
+    for (int y = 0; y < image.height(); ++y)
+    {
+        const QRgb* row = reinterpret_cast<const QRgb*>(argbImage.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x)
+        {
+            p[0] = (unsigned char) qRed(row[x]);
+            p[1] = (unsigned char) qGreen(row[x]);
+            p[2] = (unsigned char) qBlue(row[x]);
+            p[3] = (unsigned char) qAlpha(row[x]);
+            p += 4;
+        }
+    }
+}
+
+
+static double
+uniformRandom()
+{
+    return double(rand()) / double(RAND_MAX);
+}
+
+
+// Synthetic test images: smooth gradients, hard edges, and noise, which are the
+// cases that block compression handles best and worst.
+static QImage
+syntheticImage(unsigned int index, bool alpha)
+{
+    const int size = 512;
+    QImage image(size, size, alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            int r, g, b;
+            if (index == 0)
+            {
+                // Gradients
+                r = x * 255 / (size - 1);
+                g = y * 255 / (size - 1);
+                b = int(127.5 + 127.5 * sin(x * 0.05) * cos(y * 0.03));
+            }
+            else if (index == 1)
+            {
+                // Hard edged shapes
+                bool inCircle = (x - 200) * (x - 200) + (y - 260) * (y - 260) < 120 * 120;
+                bool inStripe = (x / 16 + y / 16) % 2 == 0;
+                r = inCircle ? 230 : (inStripe ? 40 : 180);
+                g = inCircle ? 60 : (inStripe ? 90 : 200);
+                b = inCircle ? 20 : (inStripe ? 160 : 70);
+            }
+            else
+            {
+                // Noise over a gradient, like a surface texture
+                int n = int(60.0 * (uniformRandom() - 0.5));
+                r = qBound(0, 120 + x / 8 + n, 255);
+                g = qBound(0, 100 + y / 10 + n, 255);
+                b = qBound(0, 80 + n, 255);
+            }
+
+            int a = alpha ? qBound(0, int(255.0 * (0.5 + 0.5 * sin((x + y) * 0.02))), 255) : 255;
+            image.setPixel(x, y, qRgba(r, g, b, a));
+        }
+    }
+
+    return image;
+}
+
+
+// Round image dimensions up to powers of two, since only those can be compressed
+static QImage
+powerOfTwoImage(const QImage& image)
+{
+    int width = 1;
+    int height = 1;
+    while (width < image.width())
+    {
+        width *= 2;
+    }
+    while (height < image.height())
+    {
+        height *= 2;
+    }
+
+    if (width == image.width() && height == image.height())
+    {
+        return image;
+    }
+    else
+    {
+        return image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+}
+
+
+static int FailureCount = 0;
+
+static void
+testImage(const QString& name, const QImage& image, double* pixelCount, double* compressTime)
+{
+    vector<unsigned char> original;
+    unpackImage(image, &original);
+    unsigned int width = image.width();
+    unsigned int height = image.height();
+
+    double startTime = omp_get_wtime();
+    DataChunk* dds = TextureCompressor::compress(image);
+    double elapsed = omp_get_wtime() - startTime;
+    if (!dds)
+    {
+        cout << setw(28) << left << name.toLocal8Bit().constData() << right << "  could not be compressed" << endl;
+        ++FailureCount;
+        return;
+    }
+
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(dds->data());
+    bool dxt5 = qFromLittleEndian<quint32>(data + 84) == FourCC_DXT5;
+    vector<unsigned char> decoded;
+    decodeImage(data + DDSHeaderSize, width, height, dxt5, &decoded);
+    delete dds;
+
+    vector<unsigned char> reference;
+    referenceEncodeImage(original, width, height, &reference);
+
+    double colorPSNR = psnr(original, decoded, 0, 3);
+    double referencePSNR = psnr(original, reference, 0, 3);
+    bool ok = colorPSNR >= referencePSNR - MaxPSNRLoss;
+    if (!ok)
+    {
+        ++FailureCount;
+    }
+
+    cout << setw(28) << left << name.toLocal8Bit().constData() << right
+         << setw(6) << width << "x" << setw(5) << left << height << right
+         << setw(6) << (dxt5 ? "DXT5" : "DXT1")
+         << fixed << setprecision(2)
+         << setw(9) << colorPSNR
+         << setw(11) << referencePSNR;
+    if (dxt5)
+    {
+        cout << setw(9) << psnr(original, decoded, 3, 1);
+    }
+    else
+    {
+        cout << setw(9) << "-";
+    }
+    cout << setw(8) << (ok ? "ok" : "FAIL") << endl;
+
+    *pixelCount += double(width) * double(height);
+    *compressTime += elapsed;
+}
+
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QList<QImage> images;
+    QStringList names;
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            QString fileName = QString::fromLocal8Bit(argv[i]);
+            QImage image(fileName);
+            if (image.isNull())
+            {
+                cerr << "Error loading image " << argv[i] << endl;
+                return 1;
+            }
+            images << powerOfTwoImage(image);
+            names << QFileInfo(fileName).fileName();
+        }
+    }
+    else
+    {
+        const char* syntheticNames[] = { "gradient", "edges", "noise" };
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            images << syntheticImage(i, false);
+            names << syntheticNames[i];
+        }
+        images << syntheticImage(0, true);
+        names << "gradient with alpha";
+    }
+
+    cout << "PSNR of the top mip level in dB; the reference encoder is DXT1 with exhaustive endpoint search" << endl;
+    cout << "image                          size      format    color  reference    alpha" << endl;
+
+    double pixelCount = 0.0;
+    double compressTime = 0.0;
+    for (int i = 0; i < images.size(); ++i)
+    {
+        testImage(names[i], images[i], &pixelCount, &compressTime);
+    }
+
+    // Throughput, including building the mipmaps. The single core figure comes from
+    // the runs above; for all cores, every core compresses its own copy of each image.
+    int threadCount = omp_get_max_threads();
+    double startTime = omp_get_wtime();
+#pragma omp parallel for
+    for (int i = 0; i < threadCount; ++i)
+    {
+        for (int j = 0; j < images.size(); ++j)
+        {
+            delete TextureCompressor::compress(images[j]);
+        }
+    }
+    double parallelTime = omp_get_wtime() - startTime;
+
+    cout << endl;
+    cout << fixed << setprecision(1);
+    cout << "Throughput, 1 core: " << pixelCount / compressTime * 1.0e-6 << " Mpixels/s" << endl;
+    cout << "Throughput, " << threadCount << " cores: " << pixelCount * threadCount / parallelTime * 1.0e-6 << " Mpixels/s ("
+         << pixelCount / parallelTime * 1.0e-6 << " Mpixels/s per core)" << endl;
+
+    if (FailureCount > 0)
+    {
+        cout << FailureCount << " images failed" << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,29 @@
+# Qt project file for the texcompress tool
+
+TEMPLATE = app
+TARGET = texcompress
+CONFIG += console
+CONFIG -= app_bundle
+
+VESTA_PATH = ../../thirdparty/vesta
+MAIN_PATH = ../../src/main
+
+SOURCES = \
+    texcompress.cpp \
+    $$MAIN_PATH/vext/TextureCompressor.cpp \
+    $$VESTA_PATH/DataChunk.cpp
+
+HEADERS = \
+    $$MAIN_PATH/vext/TextureCompressor.h
+
+INCLUDEPATH += ../../thirdparty $$MAIN_PATH
+
+# OpenMP is used to measure throughput on all cores
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+!win32-msvc* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
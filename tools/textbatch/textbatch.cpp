@@ -0,0 +1,429 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** textbatch - Check batched text geometry against the per-string path
+ *
+ * Usage: textbatch [string count]
+ *
+ * Random strings in ASCII, Latin-1, and UTF-8 are added to a TextBatch using
+ * several synthetic fonts. The vertices of each font's run are compared with
+ * the vertices that RenderContext::drawEncodedText() produces for each string
+ * when text isn't batched: the glyphs from TextureFont::renderStringToBuffer()
+ * moved by the string's offset. Positions and texture coordinates must match
+ * exactly, and every vertex must carry the color and opacity of its string.
+ * The width reported by TextureFont::textWidth() for each string must match
+ * the advance of the drawn glyphs. No OpenGL context is required.
+ */
+
+#include <vesta/TextureFont.h>
+#include <vesta/internal/TextBatch.h>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const unsigned int FontCount = 3;
+static const unsigned int FontVertexFloats = 5;
+static const unsigned int FontGlyphSize = FontVertexFloats * sizeof(float) * 6;
+
+
+static float
+uniformRandom()
+{
+    return float((rand() + 1.0) / (RAND_MAX + 1.0));
+}
+
+
+static void
+addRandomGlyph(TextureFont* font, unsigned int characterId)
+{
+    TextureFont::Glyph glyph;
+    glyph.characterId = characterId;
+    glyph.offset = Vector2f(float(rand() % 3) - 1.0f, float(rand() % 5) - 3.0f);
+    glyph.size = Vector2f(float(4 + rand() % 10), float(8 + rand() % 10));
+    glyph.advance = glyph.size.x() + float(rand() % 4) * 0.25f;
+
+    Vector2f texCoord(uniformRandom(), uniformRandom());
+    Vector2f texSize = glyph.size / 512.0f;
+    glyph.textureCoords[0] = texCoord;
+    glyph.textureCoords[1] = texCoord + Vector2f(texSize.x(), 0.0f);
+    glyph.textureCoords[2] = texCoord + texSize;
+    glyph.textureCoords[3] = texCoord + Vector2f(0.0f, texSize.y());
+
+    font->addGlyph(glyph);
+}
+
+
+// A font with random glyph metrics covering ASCII, Latin-1, Greek, and a few CJK
+// characters. Some printable characters are left out, as real fonts lack some
+// glyphs. No glyph texture is created.
+static TextureFont*
+createFont()
+{
+    TextureFont* font = new TextureFont();
+    for (unsigned int c = 32; c < 256; ++c)
+    {
+        if ((c < 127 || c >= 160) && rand() % 20 != 0)
+        {
+            addRandomGlyph(font, c);
+        }
+    }
+
+    for (unsigned int c = 0x391; c <= 0x3c9; ++c)
+    {
+        addRandomGlyph(font, c);
+    }
+
+    for (unsigned int c = 0x4e00; c < 0x4e10; ++c)
+    {
+        addRandomGlyph(font, c);
+    }
+
+    font->buildCharacterSet();
+
+    return font;
+}
+
+
+static void
+appendUtf8(string& s, unsigned int c)
+{
+    if (c < 0x80)
+    {
+        s += char(c);
+    }
+    else if (c < 0x800)
+    {
+        s += char(0xc0 | (c >> 6));
+        s += char(0x80 | (c & 0x3f));
+    }
+    else
+    {
+        s += char(0xe0 | (c >> 12));
+        s += char(0x80 | ((c >> 6) & 0x3f));
+        s += char(0x80 | (c & 0x3f));
+    }
+}
+
+
+// A random label-like string. UTF-8 strings may include Greek and CJK characters,
+// and a few end with a truncated character.
+static string
+randomString(TextureFont::Encoding encoding)
+{
+    string s;
+    unsigned int length = 1 + rand() % 40;
+    for (unsigned int i = 0; i < length; ++i)
+    {
+        unsigned int c = 32 + rand() % 95;
+        if (encoding == TextureFont::Latin1 && rand() % 4 == 0)
+        {
+            c = 160 + rand() % 96;
+        }
+
+        if (encoding == TextureFont::Utf8)
+        {
+            switch (rand() % 4)
+            {
+            case 0:
+                c = 160 + rand() % 96;
+                break;
+            case 1:
+                c = 0x391 + rand() % (0x3c9 - 0x391 + 1);
+                break;
+            case 2:
+                c = 0x4e00 + rand() % 16;
+                break;
+            default:
+                break;
+            }
+            appendUtf8(s, c);
+        }
+        else
+        {
+            s += char(c);
+        }
+    }
+
+    if (encoding == TextureFont::Utf8 && rand() % 20 == 0)
+    {
+        s += char(0xce);
+    }
+
+    return s;
+}
+
+
+struct TestString
+{
+    const TextureFont* font;
+    string text;
+    TextureFont::Encoding encoding;
+    Vector2f origin;
+    Vector3f offset;
+    Spectrum color;
+    float opacity;
+};
+
+
+static v_uint8
+expectedColorByte(float c)
+{
+    return v_uint8(max(0.0f, min(1.0f, c)) * 255.0f + 0.5f);
+}
+
+
+struct CheckResults
+{
+    unsigned int glyphCount;
+    unsigned int vertexMismatches;
+    unsigned int colorMismatches;
+    unsigned int widthMismatches;
+    unsigned int runMismatches;
+};
+
+
+// Compare the batch contents with the per-string vertices. Strings are added to
+// the batch in order, so the vertices of each font's run must be the vertices of
+// that font's strings, in order.
+static CheckResults
+checkBatch(const TextBatch& batch, const vector<TestString>& strings, const vector<TextureFont*>& fonts)
+{
+    CheckResults results = { 0, 0, 0, 0, 0 };
+
+    vector<char> vertexData;
+    for (unsigned int f = 0; f < fonts.size(); ++f)
+    {
+        const vector<TextBatch::Vertex>* run = NULL;
+        for (unsigned int i = 0; i < batch.fontCount(); ++i)
+        {
+            if (batch.font(i) == fonts[f] && !batch.vertices(i).empty())
+            {
+                if (run)
+                {
+                    // A font must have just one run
+                    ++results.runMismatches;
+                }
+                run = &batch.vertices(i);
+            }
+        }
+
+        unsigned int runIndex = 0;
+        for (unsigned int s = 0; s < strings.size(); ++s)
+        {
+            const TestString& str = strings[s];
+            if (str.font != fonts[f])
+            {
+                continue;
+            }
+
+            vertexData.resize(max(size_t(1), str.text.size()) * FontGlyphSize);
+            unsigned int vertexCount = 0;
+            Vector2f end = str.font->renderStringToBuffer(str.text, str.origin, str.encoding,
+                                                          &vertexData[0], vertexData.size(), &vertexCount);
+            results.glyphCount += vertexCount / 6;
+
+            if (end.x() - str.origin.x() != str.font->textWidth(str.text, str.encoding))
+            {
+                ++results.widthMismatches;
+            }
+
+            v_uint8 color[4] = { expectedColorByte(str.color.red()),
+                                 expectedColorByte(str.color.green()),
+                                 expectedColorByte(str.color.blue()),
+                                 expectedColorByte(str.opacity) };
+
+            const float* fontVertex = reinterpret_cast<const float*>(&vertexData[0]);
+            for (unsigned int i = 0; i < vertexCount; ++i, fontVertex += FontVertexFloats, ++runIndex)
+            {
+                if (!run || runIndex >= run->size())
+                {
+                    ++results.vertexMismatches;
+                    continue;
+                }
+
+                // The unbatched path draws the glyphs with the offset applied as
+                // a translation of the modelview matrix.
+                const TextBatch::Vertex& v = (*run)[runIndex];
+                if (v.position[0] != fontVertex[0] + str.offset.x() ||
+                    v.position[1] != fontVertex[1] + str.offset.y() ||
+                    v.position[2] != fontVertex[2] + str.offset.z() ||
+                    v.texCoord[0] != fontVertex[3] ||
+                    v.texCoord[1] != fontVertex[4])
+                {
+                    ++results.vertexMismatches;
+                }
+
+                if (v.color[0] != color[0] || v.color[1] != color[1] ||
+                    v.color[2] != color[2] || v.color[3] != color[3])
+                {
+                    ++results.colorMismatches;
+                }
+            }
+        }
+
+        // No extra vertices may be in the run
+        if (run && runIndex != run->size())
+        {
+            results.vertexMismatches += run->size() - min(runIndex, (unsigned int) run->size());
+        }
+    }
+
+    return results;
+}
+
+
+static vector<TestString>
+randomStrings(unsigned int count, const vector<TextureFont*>& fonts)
+{
+    vector<TestString> strings(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        TestString& str = strings[i];
+        str.font = fonts[rand() % fonts.size()];
+        str.encoding = TextureFont::Encoding(rand() % 3);
+        str.text = randomString(str.encoding);
+
+        // Pixel snapped origins, as computed by drawEncodedText(), and the
+        // offset that it adds to keep texel centers off of pixel boundaries
+        str.origin = Vector2f(floor(1920.0f * uniformRandom() + 0.5f), floor(1080.0f * uniformRandom() + 0.5f));
+        str.offset = Vector3f(float(rand() % 20) + 0.125f, float(rand() % 20) - 10.0f + 0.125f, -uniformRandom());
+        str.color = Spectrum(uniformRandom(), uniformRandom(), uniformRandom());
+        str.opacity = uniformRandom() * 1.2f;
+    }
+
+    return strings;
+}
+
+
+static unsigned int
+reportResults(const char* name, const CheckResults& results)
+{
+    cout << setw(10) << name
+         << setw(10) << results.glyphCount
+         << setw(12) << results.vertexMismatches
+         << setw(12) << results.colorMismatches
+         << setw(12) << results.widthMismatches
+         << setw(8) << results.runMismatches << endl;
+
+    return results.vertexMismatches + results.colorMismatches + results.widthMismatches + results.runMismatches;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int stringCount = argc > 1 ? atoi(argv[1]) : 2000;
+    if (argc > 2 || stringCount < 1)
+    {
+        cerr << "Usage: textbatch [string count]" << endl;
+        return 1;
+    }
+
+    srand(1);
+
+    vector<TextureFont*> fonts;
+    vector<counted_ptr<TextureFont> > fontRefs;
+    for (unsigned int i = 0; i < FontCount; ++i)
+    {
+        fonts.push_back(createFont());
+        fontRefs.push_back(counted_ptr<TextureFont>(fonts.back()));
+    }
+
+    unsigned int failures = 0;
+
+    cout << "Strings per batch: " << stringCount << ", fonts: " << FontCount << endl;
+    cout << endl;
+    cout << "     Batch    Glyphs    Vertices      Colors      Widths    Runs" << endl;
+
+    // The same batch is reused for several frames, as RenderContext does, so
+    // that runs left empty by clear() are reused.
+    TextBatch batch;
+    double batchTime = 0.0;
+    double perStringTime = 0.0;
+    unsigned int frameCount = 4;
+    for (unsigned int frame = 0; frame < frameCount; ++frame)
+    {
+        // Use fewer fonts in some frames
+        vector<TextureFont*> frameFonts(fonts.begin(), fonts.begin() + 1 + frame % FontCount);
+        vector<TestString> strings = randomStrings((unsigned int) stringCount, frameFonts);
+
+        // The strings are added twice, and only the second time is measured: from
+        // frame to frame, the batch storage is normally already large enough.
+        double startTime = 0.0;
+        for (unsigned int pass = 0; pass < 2; ++pass)
+        {
+            batch.clear();
+            startTime = omp_get_wtime();
+            for (unsigned int i = 0; i < strings.size(); ++i)
+            {
+                const TestString& str = strings[i];
+                batch.addText(str.font, str.text, str.encoding, str.origin, str.offset, str.color, str.opacity);
+            }
+        }
+        batchTime += omp_get_wtime() - startTime;
+
+        // Time the glyph generation of the unbatched path for comparison
+        startTime = omp_get_wtime();
+        char vertexData[4096];
+        for (unsigned int i = 0; i < strings.size(); ++i)
+        {
+            const TestString& str = strings[i];
+            unsigned int vertexCount = 0;
+            str.font->renderStringToBuffer(str.text, str.origin, str.encoding, vertexData, sizeof(vertexData), &vertexCount);
+        }
+        perStringTime += omp_get_wtime() - startTime;
+
+        ostringstream name;
+        name << frame + 1;
+        failures += reportResults(name.str().c_str(), checkBatch(batch, strings, fonts));
+
+        batch.clear();
+        if (!batch.empty())
+        {
+            cout << "Batch not empty after clear()" << endl;
+            ++failures;
+        }
+    }
+
+    // Text that produces no glyphs adds nothing
+    unsigned int emptyGlyphs = batch.addText(fonts[0], "", TextureFont::Latin1, Vector2f::Zero(), Vector3f::Zero(), Spectrum::White(), 1.0f) +
+                               batch.addText(NULL, "text", TextureFont::Latin1, Vector2f::Zero(), Vector3f::Zero(), Spectrum::White(), 1.0f) +
+                               batch.addText(fonts[0], "\xce", TextureFont::Utf8, Vector2f::Zero(), Vector3f::Zero(), Spectrum::White(), 1.0f);
+    if (emptyGlyphs != 0 || !batch.empty())
+    {
+        cout << "Empty text added glyphs" << endl;
+        ++failures;
+    }
+
+    cout << endl;
+    cout << fixed << setprecision(1);
+    cout << "Batched glyph generation:    " << batchTime / frameCount * 1000.0 << " ms per batch" << endl;
+    cout << "Per-string glyph generation: " << perStringTime / frameCount * 1000.0 << " ms per batch" << endl;
+
+    cout << endl << (failures == 0 ? "ok" : "FAILED") << endl;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+# Qt project file for the textbatch tool
+
+TEMPLATE = app
+TARGET = textbatch
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+GLEW_PATH = ../../thirdparty/glew
+
+# TextureFont contains the glyph texture code as well, so GLEW and the texture
+# classes are linked even though no GL calls are made.
+SOURCES = \
+    textbatch.cpp \
+    $$VESTA_PATH/DataChunk.cpp \
+    $$VESTA_PATH/Debug.cpp \
+    $$VESTA_PATH/Spectrum.cpp \
+    $$VESTA_PATH/TextureFont.cpp \
+    $$VESTA_PATH/TextureMap.cpp \
+    $$VESTA_PATH/TextureMapLoader.cpp \
+    $$VESTA_PATH/internal/DefaultFont.cpp \
+    $$VESTA_PATH/internal/InputDataStream.cpp \
+    $$VESTA_PATH/internal/TextBatch.cpp \
+    $$GLEW_PATH/glew.c
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH $$GLEW_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR GLEW_STATIC
+
+# OpenMP is used only for its timer
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+!win32-msvc* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+
+unix:!macx {
+    LIBS += -lGL
+}
+
+macx {
+    LIBS += -framework OpenGL
+}
+
+win32 {
+    LIBS += opengl32.lib
+}
@@ -0,0 +1,100 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** tilemanifest - Build a manifest of the tiles in a local tile pyramid
+ *
+ * Usage: tilemanifest [-o <output file>] <name pattern> <level count>
+ *
+ * The manifest is for a NameTemplate tiled texture, so row 0 is the northernmost
+ * row of each level.
+ */
+
+#include "vext/TileManifest.h"
+#include <QString>
+#include <iostream>
+
+using namespace std;
+
+
+static void
+usage()
+{
+    cerr << "Usage: tilemanifest [-o <output file>] <name pattern> <level count>" << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    QString outputFileName;
+    QString namePattern;
+    int levelCount = 0;
+
+    int argIndex = 1;
+    while (argIndex < argc && argv[argIndex][0] == '-')
+    {
+        QString option = QString::fromLocal8Bit(argv[argIndex]);
+        if (option == "-o" && argIndex + 1 < argc)
+        {
+            outputFileName = QString::fromLocal8Bit(argv[++argIndex]);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+        ++argIndex;
+    }
+
+    if (argc - argIndex != 2)
+    {
+        usage();
+        return 1;
+    }
+
+    namePattern = QString::fromLocal8Bit(argv[argIndex]);
+    levelCount = QString::fromLocal8Bit(argv[argIndex + 1]).toInt();
+    if (levelCount < 1 || levelCount > 16)
+    {
+        cerr << "Level count must be between 1 and 16" << endl;
+        return 1;
+    }
+
+    if (!namePattern.contains("%level") || !namePattern.contains("%column") || !namePattern.contains("%row"))
+    {
+        cerr << "Name pattern must contain %level, %column, and %row" << endl;
+        return 1;
+    }
+
+    // NameTemplate tiled textures number rows from the north, and Cosmographia
+    // rejects manifests with any other row order.
+    TileManifest manifest(namePattern, true, (unsigned int) levelCount);
+    manifest.build();
+
+    if (outputFileName.isEmpty())
+    {
+        outputFileName = manifest.fileName();
+    }
+
+    if (!manifest.save(outputFileName))
+    {
+        cerr << "Error writing manifest to " << outputFileName.toLocal8Bit().data() << endl;
+        return 1;
+    }
+
+    cout << manifest.tileCount() << " tiles recorded in " << outputFileName.toLocal8Bit().data() << endl;
+
+    return 0;
+}
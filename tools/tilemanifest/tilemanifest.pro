@@ -0,0 +1,18 @@
+# Qt project file for the tilemanifest tool
+
+TEMPLATE = app
+TARGET = tilemanifest
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+
+MAIN_PATH = ../../src/main
+
+SOURCES = \
+    tilemanifest.cpp \
+    $$MAIN_PATH/vext/TileManifest.cpp
+
+HEADERS = \
+    $$MAIN_PATH/vext/TileManifest.h
+
+INCLUDEPATH += $$MAIN_PATH
@@ -0,0 +1,125 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** tilepack - Pack a directory tile pyramid into a single tile archive
+ *
+ * Usage: tilepack [-f] <name pattern> <level count> <output file>
+ */
+
+#include "vext/TileArchive.h"
+#include "vext/TileManifest.h"
+#include <QFile>
+#include <QString>
+#include <iostream>
+
+using namespace std;
+
+
+static void
+usage()
+{
+    cerr << "Usage: tilepack [-f] <name pattern> <level count> <output file>" << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    bool flipped = false;
+
+    int argIndex = 1;
+    if (argIndex < argc && QString(argv[argIndex]) == "-f")
+    {
+        flipped = true;
+        ++argIndex;
+    }
+
+    if (argc - argIndex != 3)
+    {
+        usage();
+        return 1;
+    }
+
+    QString namePattern = QString::fromLocal8Bit(argv[argIndex]);
+    int levelCount = QString::fromLocal8Bit(argv[argIndex + 1]).toInt();
+    QString outputFileName = QString::fromLocal8Bit(argv[argIndex + 2]);
+
+    if (levelCount < 1 || levelCount > 16)
+    {
+        cerr << "Level count must be between 1 and 16" << endl;
+        return 1;
+    }
+
+    namePattern.replace("%1", "%level").replace("%2", "%column").replace("%3", "%row");
+
+    TileArchive::TileFormat format = TileArchive::ImageFormat;
+    if (namePattern.toLower().endsWith(".dds") || namePattern.toLower().endsWith(".dxt5nm"))
+    {
+        format = TileArchive::DDSFormat;
+    }
+
+    // Use a manifest to find the tiles that are present
+    TileManifest manifest(namePattern, flipped, (unsigned int) levelCount);
+    manifest.build();
+
+    TileArchiveWriter writer(outputFileName, (unsigned int) levelCount, format);
+    if (!writer.open())
+    {
+        cerr << "Error creating archive " << outputFileName.toLocal8Bit().data() << endl;
+        return 1;
+    }
+
+    unsigned int tileCount = 0;
+    for (unsigned int level = 0; level < (unsigned int) levelCount; ++level)
+    {
+        unsigned int rowCount = 1u << level;
+        unsigned int columnCount = 2u << level;
+        for (unsigned int row = 0; row < rowCount; ++row)
+        {
+            for (unsigned int column = 0; column < columnCount; ++column)
+            {
+                if (!manifest.contains(level, column, row))
+                {
+                    continue;
+                }
+
+                QString tileFileName = manifest.tileFileName(level, column, row);
+                QFile tileFile(tileFileName);
+                if (!tileFile.open(QIODevice::ReadOnly))
+                {
+                    cerr << "Error reading " << tileFileName.toLocal8Bit().data() << endl;
+                    return 1;
+                }
+
+                if (!writer.addTile(level, column, row, tileFile.readAll()))
+                {
+                    cerr << "Error writing to archive " << outputFileName.toLocal8Bit().data() << endl;
+                    return 1;
+                }
+                ++tileCount;
+            }
+        }
+    }
+
+    if (!writer.finish())
+    {
+        cerr << "Error writing to archive " << outputFileName.toLocal8Bit().data() << endl;
+        return 1;
+    }
+
+    cout << tileCount << " tiles written to " << outputFileName.toLocal8Bit().data() << endl;
+
+    return 0;
+}
@@ -0,0 +1,20 @@
+# Qt project file for the tilepack tool
+
+TEMPLATE = app
+TARGET = tilepack
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+
+MAIN_PATH = ../../src/main
+
+SOURCES = \
+    tilepack.cpp \
+    $$MAIN_PATH/vext/TileArchive.cpp \
+    $$MAIN_PATH/vext/TileManifest.cpp
+
+HEADERS = \
+    $$MAIN_PATH/vext/TileArchive.h \
+    $$MAIN_PATH/vext/TileManifest.h
+
+INCLUDEPATH += $$MAIN_PATH
@@ -0,0 +1,487 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** tilereplay - Measure how often fallback tiles are drawn, with and without prefetching
+ *
+ * Usage: tilereplay [--latency frames] [--rate loads] [path file]
+ *
+ * A camera path is replayed around a planet with a tiled base map, once with
+ * the tile prefetcher disabled and once with it enabled. Tile loads are
+ * simulated: each load completes a fixed number of frames after it's issued,
+ * and only a limited number of loads complete per frame. For every frame, the
+ * tiles that the renderer would draw are found with the same quadtree level of
+ * detail calculation used for rendering, and the frame is counted as showing
+ * fallback tiles if any of them have to be drawn with a lower resolution
+ * ancestor. No OpenGL context is required.
+ */
+
+#include "TilePrefetcher.h"
+#include "ObserverAction.h"
+#include "RotationUtility.h"
+#include <vesta/Body.h>
+#include <vesta/Arc.h>
+#include <vesta/Chronology.h>
+#include <vesta/FixedPointTrajectory.h>
+#include <vesta/FixedRotationModel.h>
+#include <vesta/InertialFrame.h>
+#include <vesta/WorldGeometry.h>
+#include <vesta/HierarchicalTiledMap.h>
+#include <vesta/TextureMapLoader.h>
+#include <vesta/PlanarProjection.h>
+#include <vesta/Units.h>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const double PlanetRadius = 6378.0;       // km
+static const unsigned int MaxMapLevel = 9;
+static const unsigned int TileSize = 512;
+static const double FrameRate = 60.0;
+static const float FieldOfView = 50.0f;          // degrees
+static const unsigned int ViewportWidth = 1280;
+static const unsigned int ViewportHeight = 720;
+static const double SimTime = 1.0;
+
+
+// One frame of a camera path. The position and orientation are relative to the
+// planet center in the J2000 ecliptic frame.
+struct PathFrame
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    double time;
+    Vector3d position;
+    Quaterniond orientation;
+};
+
+
+// Texture loader that never touches the disk or the GPU. A load request completes
+// after a fixed number of frames; requests are handled in order, as they are by
+// the image loading thread, and only a limited number complete in each frame.
+// Tiles are considered resident once their status is Ready.
+class ReplayTextureLoader : public TextureMapLoader
+{
+public:
+    ReplayTextureLoader(unsigned int latency, unsigned int loadsPerFrame) :
+        m_latency(latency),
+        m_loadsPerFrame(loadsPerFrame),
+        m_loadCount(0)
+    {
+    }
+
+    virtual bool handleMakeResident(TextureMap* texture)
+    {
+        texture->setStatus(TextureMap::Loading);
+
+        PendingLoad load;
+        load.texture = texture;
+        load.readyFrame = frameCount() + m_latency;
+        m_pendingLoads.push_back(load);
+        ++m_loadCount;
+
+        return false;
+    }
+
+    void completeLoads()
+    {
+        unsigned int completeCount = 0;
+        while (!m_pendingLoads.empty() &&
+               m_pendingLoads.front().readyFrame <= frameCount() &&
+               completeCount < m_loadsPerFrame)
+        {
+            m_pendingLoads.front().texture->setStatus(TextureMap::Ready);
+            m_pendingLoads.pop_front();
+            ++completeCount;
+        }
+    }
+
+    unsigned int loadCount() const
+    {
+        return m_loadCount;
+    }
+
+private:
+    struct PendingLoad
+    {
+        TextureMap* texture;
+        v_int64 readyFrame;
+    };
+
+    unsigned int m_latency;
+    unsigned int m_loadsPerFrame;
+    unsigned int m_loadCount;
+    deque<PendingLoad> m_pendingLoads;
+};
+
+
+// Tiled map with every tile present down to MaxMapLevel. In draw mode, the
+// prefetchTile() calls made by WorldGeometry::prefetchTiles() are handled the way
+// that HierarchicalTiledMap::tile() handles tiles during rendering: the requested
+// tile and its ancestors are made resident until a loaded one is found. This gives
+// the set of tiles the renderer would draw without needing a GL context.
+class ReplayTiledMap : public HierarchicalTiledMap
+{
+public:
+    ReplayTiledMap(TextureMapLoader* loader) :
+        HierarchicalTiledMap(loader, TileSize),
+        m_drawMode(false),
+        m_drawnTileCount(0),
+        m_fallbackTileCount(0)
+    {
+    }
+
+    virtual string tileResourceIdentifier(unsigned int level, unsigned int column, unsigned int row)
+    {
+        ostringstream str;
+        str << "tile:" << level << ":" << column << ":" << row;
+        return str.str();
+    }
+
+    virtual bool isValidTileAddress(unsigned int level, unsigned int column, unsigned int row)
+    {
+        return level <= MaxMapLevel && column < (2u << level) && row < (1u << level);
+    }
+
+    virtual bool prefetchTile(unsigned int level, unsigned int x, unsigned int y)
+    {
+        if (!m_drawMode)
+        {
+            return HierarchicalTiledMap::prefetchTile(level, x, y);
+        }
+
+        while (level > MaxMapLevel)
+        {
+            level--;
+            x /= 2;
+            y /= 2;
+        }
+
+        ++m_drawnTileCount;
+        int testLevel = int(level);
+        while (testLevel >= 0)
+        {
+            TextureMap* texture = loader()->loadTexture(tileResourceIdentifier(testLevel, x, y), TextureProperties(TextureProperties::Clamp));
+            texture->makeResident();
+            if (texture->status() == TextureMap::Ready)
+            {
+                break;
+            }
+
+            x /= 2;
+            y /= 2;
+            testLevel--;
+        }
+
+        if (testLevel < int(level))
+        {
+            ++m_fallbackTileCount;
+        }
+
+        // Never count as a load request, so that the whole view is visited
+        return false;
+    }
+
+    void beginDraw()
+    {
+        m_drawMode = true;
+        m_drawnTileCount = 0;
+        m_fallbackTileCount = 0;
+    }
+
+    void endDraw()
+    {
+        m_drawMode = false;
+    }
+
+    unsigned int drawnTileCount() const
+    {
+        return m_drawnTileCount;
+    }
+
+    unsigned int fallbackTileCount() const
+    {
+        return m_fallbackTileCount;
+    }
+
+private:
+    bool m_drawMode;
+    unsigned int m_drawnTileCount;
+    unsigned int m_fallbackTileCount;
+};
+
+
+struct ReplayResult
+{
+    unsigned int frameCount;
+    unsigned int fallbackFrameCount;
+    unsigned int drawnTileCount;
+    unsigned int fallbackTileCount;
+    unsigned int loadCount;
+    unsigned int prefetchCount;
+};
+
+
+static Body*
+createPlanet(WorldGeometry* world)
+{
+    Arc* arc = new Arc();
+    arc->setTrajectoryFrame(InertialFrame::eclipticJ2000());
+    arc->setBodyFrame(InertialFrame::eclipticJ2000());
+    arc->setTrajectory(new FixedPointTrajectory(Vector3d::Zero()));
+    arc->setRotationModel(new FixedRotationModel(Quaterniond::Identity()));
+    arc->setDuration(daysToSeconds(1.0));
+
+    Body* body = new Body();
+    body->chronology()->setBeginning(0.0);
+    body->chronology()->addArc(arc);
+    body->setGeometry(world);
+
+    return body;
+}
+
+
+// Built in camera path: a goto from far away to low altitude, followed by a
+// low pass over the surface while looking ahead toward the horizon. The goto is
+// driven by a GotoObserverAction so that the prefetcher predicts it from the
+// action; the pass over the surface has to be extrapolated from the observer's
+// motion.
+static const double GotoDuration = 6.0;
+static const double PassDuration = 10.0;
+static const double PassAltitude = 150.0;
+static const double PassRate = toRadians(3.0);  // radians per second
+
+static void
+passState(double t, Vector3d* position, Quaterniond* orientation)
+{
+    double radius = PlanetRadius + PassAltitude;
+    double angle = PassRate * t;
+    *position = AngleAxisd(angle, Vector3d::UnitZ()) * Vector3d(radius, 0.0, 0.0);
+    Vector3d lookAt = AngleAxisd(angle + toRadians(15.0), Vector3d::UnitZ()) * Vector3d(PlanetRadius, 0.0, 0.0);
+    *orientation = LookRotation(*position, lookAt, position->normalized());
+}
+
+
+static ReplayResult
+replay(const vector<PathFrame>& path, bool prefetch, unsigned int latency, unsigned int loadsPerFrame)
+{
+    counted_ptr<ReplayTextureLoader> loader(new ReplayTextureLoader(latency, loadsPerFrame));
+    counted_ptr<ReplayTiledMap> tiledMap(new ReplayTiledMap(loader.ptr()));
+    WorldGeometry* world = new WorldGeometry();
+    world->setSphere(float(PlanetRadius));
+    world->setBaseMap(tiledMap.ptr());
+    counted_ptr<Body> planet(createPlanet(world));
+
+    counted_ptr<Observer> observer(new Observer(planet.ptr()));
+    TilePrefetcher prefetcher;
+    prefetcher.setEnabled(prefetch);
+
+    float fovY = float(toRadians(FieldOfView));
+    Viewport viewport(ViewportWidth, ViewportHeight);
+    float pixelSize = float(2.0 * tan(fovY / 2.0) / viewport.height());
+    PlanarProjection projection = PlanarProjection::CreatePerspective(fovY, viewport.aspectRatio(), 0.00001f, 1.0e12f);
+
+    bool builtinPath = path.empty();
+    unsigned int frameCount = builtinPath ? (unsigned int) ((GotoDuration + PassDuration) * FrameRate) : (unsigned int) path.size();
+
+    counted_ptr<ObserverAction> action;
+    if (builtinPath)
+    {
+        observer->setPosition(Vector3d(60000.0, 0.0, 0.0));
+        observer->setOrientation(LookRotation(observer->position(), Vector3d::Zero(), Vector3d::UnitZ()));
+        action = new GotoObserverAction(observer.ptr(), planet.ptr(), GotoDuration, 0.0, SimTime, PlanetRadius + PassAltitude);
+    }
+
+    ReplayResult result;
+    memset(&result, 0, sizeof(result));
+    result.frameCount = frameCount;
+
+    for (unsigned int frame = 0; frame < frameCount; ++frame)
+    {
+        double realTime;
+        if (builtinPath)
+        {
+            realTime = frame / FrameRate;
+            if (action.isValid())
+            {
+                if (action->updateObserver(observer.ptr(), realTime, SimTime))
+                {
+                    action = NULL;
+                }
+            }
+            else
+            {
+                Vector3d position;
+                Quaterniond orientation;
+                passState(realTime - GotoDuration, &position, &orientation);
+                observer->setPosition(position);
+                observer->setOrientation(orientation);
+            }
+        }
+        else
+        {
+            realTime = path[frame].time;
+            observer->setPosition(path[frame].position);
+            observer->setOrientation(path[frame].orientation);
+        }
+
+        loader->incrementFrameCount();
+
+        // Draw the frame
+        tiledMap->beginDraw();
+        Vector3f eyePosition = (observer->absolutePosition(SimTime) - planet->position(SimTime)).cast<float>();
+        Quaternionf cameraOrientation = observer->absoluteOrientation(SimTime).cast<float>();
+        world->prefetchTiles(eyePosition, cameraOrientation, projection, pixelSize, ~0u);
+        tiledMap->endDraw();
+
+        result.drawnTileCount += tiledMap->drawnTileCount();
+        result.fallbackTileCount += tiledMap->fallbackTileCount();
+        if (tiledMap->fallbackTileCount() > 0)
+        {
+            ++result.fallbackFrameCount;
+        }
+
+        // Prefetch after drawing, as UniverseView does
+        if (prefetch)
+        {
+            prefetcher.update(observer.ptr(), action.ptr(), realTime, SimTime, 0.0, fovY, viewport);
+            result.prefetchCount += loader->issuePrefetches(prefetcher.maxRequestsPerFrame());
+        }
+
+        loader->completeLoads();
+    }
+
+    result.loadCount = loader->loadCount();
+
+    return result;
+}
+
+
+// Read a camera path. Each line has the time in seconds, the position in km, and
+// the orientation as a quaternion (w x y z); positions and orientations are in the
+// J2000 ecliptic frame, relative to the center of the planet. Lines beginning with
+// # are ignored.
+static bool
+readPath(const char* fileName, vector<PathFrame>* path)
+{
+    ifstream in(fileName);
+    if (!in.good())
+    {
+        return false;
+    }
+
+    string line;
+    while (getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        istringstream str(line);
+        PathFrame f;
+        double qw = 1.0, qx = 0.0, qy = 0.0, qz = 0.0;
+        str >> f.time >> f.position.x() >> f.position.y() >> f.position.z() >> qw >> qx >> qy >> qz;
+        if (str.fail())
+        {
+            return false;
+        }
+        f.orientation = Quaterniond(qw, qx, qy, qz).normalized();
+        path->push_back(f);
+    }
+
+    return !path->empty();
+}
+
+
+static void
+report(const char* label, const ReplayResult& r)
+{
+    cout << setw(12) << left << label << right
+         << setw(8) << r.frameCount
+         << setw(10) << r.fallbackFrameCount
+         << setw(10) << fixed << setprecision(1) << 100.0 * r.fallbackFrameCount / max(1u, r.frameCount) << "%"
+         << setw(11) << setprecision(2) << 100.0 * r.fallbackTileCount / max(1u, r.drawnTileCount) << "%"
+         << setw(8) << r.loadCount
+         << setw(10) << r.prefetchCount
+         << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    unsigned int latency = 6;
+    unsigned int loadsPerFrame = 3;
+    const char* pathFileName = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc)
+        {
+            latency = (unsigned int) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+        {
+            loadsPerFrame = max(1, atoi(argv[++i]));
+        }
+        else if (argv[i][0] == '-')
+        {
+            cerr << "Usage: tilereplay [--latency frames] [--rate loads] [path file]" << endl;
+            return 1;
+        }
+        else
+        {
+            pathFileName = argv[i];
+        }
+    }
+
+    vector<PathFrame> path;
+    if (pathFileName)
+    {
+        if (!readPath(pathFileName, &path))
+        {
+            cerr << "Error reading camera path from " << pathFileName << endl;
+            return 1;
+        }
+        cout << "Camera path: " << pathFileName << " (" << path.size() << " frames)" << endl;
+    }
+    else
+    {
+        cout << "Camera path: built in goto and surface pass (" << GotoDuration + PassDuration << " s at " << FrameRate << " fps)" << endl;
+    }
+    cout << "Load latency: " << latency << " frames, " << loadsPerFrame << " loads per frame" << endl;
+    cout << endl;
+
+    ReplayResult withoutPrefetch = replay(path, false, latency, loadsPerFrame);
+    ReplayResult withPrefetch = replay(path, true, latency, loadsPerFrame);
+
+    cout << "            frames  fallback  fraction  tile frac.   loads  prefetch" << endl;
+    report("no prefetch", withoutPrefetch);
+    report("prefetch", withPrefetch);
+
+    return 0;
+}
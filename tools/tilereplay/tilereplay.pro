@@ -0,0 +1,68 @@
+# Qt project file for the tilereplay tool
+
+TEMPLATE = app
+TARGET = tilereplay
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+GLEW_PATH = ../../thirdparty/glew
+MAIN_PATH = ../../src/main
+
+# WorldGeometry pulls in most of the renderer, so the GL helpers and GLEW are
+# linked even though no GL calls are made.
+SOURCES = \
+    tilereplay.cpp \
+    $$MAIN_PATH/ObserverAction.cpp \
+    $$MAIN_PATH/RotationUtility.cpp \
+    $$MAIN_PATH/TilePrefetcher.cpp \
+    $$VESTA_PATH/Arc.cpp \
+    $$VESTA_PATH/Atmosphere.cpp \
+    $$VESTA_PATH/Body.cpp \
+    $$VESTA_PATH/Chronology.cpp \
+    $$VESTA_PATH/DataChunk.cpp \
+    $$VESTA_PATH/Debug.cpp \
+    $$VESTA_PATH/Entity.cpp \
+    $$VESTA_PATH/FixedPointTrajectory.cpp \
+    $$VESTA_PATH/FixedRotationModel.cpp \
+    $$VESTA_PATH/HierarchicalTiledMap.cpp \
+    $$VESTA_PATH/InertialFrame.cpp \
+    $$VESTA_PATH/LabelArbiter.cpp \
+    $$VESTA_PATH/Observer.cpp \
+    $$VESTA_PATH/PlanarProjection.cpp \
+    $$VESTA_PATH/PrimitiveBatch.cpp \
+    $$VESTA_PATH/QuadtreeTile.cpp \
+    $$VESTA_PATH/RenderContext.cpp \
+    $$VESTA_PATH/ShaderBuilder.cpp \
+    $$VESTA_PATH/TextureFont.cpp \
+    $$VESTA_PATH/TextureMap.cpp \
+    $$VESTA_PATH/TextureMapLoader.cpp \
+    $$VESTA_PATH/VertexBuffer.cpp \
+    $$VESTA_PATH/VertexSpec.cpp \
+    $$VESTA_PATH/WorldGeometry.cpp \
+    $$VESTA_PATH/glhelp/GLBufferObject.cpp \
+    $$VESTA_PATH/glhelp/GLShader.cpp \
+    $$VESTA_PATH/glhelp/GLShaderProgram.cpp \
+    $$VESTA_PATH/glhelp/GLVertexBuffer.cpp \
+    $$VESTA_PATH/internal/DefaultFont.cpp \
+    $$VESTA_PATH/internal/InputDataStream.cpp \
+    $$VESTA_PATH/internal/OutputDataStream.cpp \
+    $$VESTA_PATH/internal/TextBatch.cpp \
+    $$VESTA_PATH/internal/TileVertexCache.cpp \
+    $$VESTA_PATH/particlesys/ParticleEmitter.cpp \
+    $$GLEW_PATH/glew.c
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH $$GLEW_PATH $$MAIN_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR GLEW_STATIC
+
+unix:!macx {
+    LIBS += -lGL
+}
+
+macx {
+    LIBS += -framework OpenGL
+}
+
+win32 {
+    LIBS += opengl32.lib
+}
@@ -0,0 +1,439 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** tilevertexbench - Compare cached planet tile vertices with per-draw generation
+ *
+ * Usage: tilevertexbench [frame count]
+ *
+ * A camera approaches an Earth sized planet as in quadbench, and every frame the
+ * planet is drawn in two stereo eyes and six cube map faces. Each view draws a
+ * surface with a tiled map and a cloud shell with a single texture, so tiles are
+ * looked up with two different texture coordinate mappings. The vertices of the
+ * visible tiles are either generated for every draw, as QuadtreeTile did before
+ * the vertex cache was added, or looked up in a TileVertexCache. The time taken by
+ * each method is reported, along with the cache misses per frame, and the cache
+ * is checked to hold every tile drawn in a frame. No OpenGL context is required;
+ * cached vertices are kept in ordinary memory.
+ */
+
+#include <vesta/QuadtreeTile.h>
+#include <vesta/PlanarProjection.h>
+#include <vesta/Frustum.h>
+#include <vesta/Units.h>
+#include <vesta/internal/TileVertexCache.h>
+#include <cstdlib>
+#include <cmath>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+// Same as the constant used by WorldGeometry
+static const float MaxTileSquareSize = 256.0f;
+
+// Tile size of the surface map; WorldGeometry scales the split threshold of
+// surfaces with tiled maps by the tile size.
+static const unsigned int MapTileSize = 256;
+
+static const float EquatorialRadius = 6378.0f;
+static const float PolarRadius = 6357.0f;
+static const float CloudAltitude = 10.0f;
+
+static const unsigned int StereoViewCount = 2;
+static const unsigned int CubeFaceCount = 6;
+
+// Capacity of the cache before it was sized for a full frame of views
+static const unsigned int OldCacheCapacity = 1024;
+
+// View keys; cube map faces are numbered the same way as by UniverseRenderer.
+static const unsigned int CubeMapViewKeyBase = 0x10000;
+
+
+struct View
+{
+    unsigned int key;
+    Vector3f eyePosition;
+    CullingPlaneSet cullingPlanes;
+    float pixelSize;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+
+// A tile drawn with a particular texture coordinate mapping
+struct Draw
+{
+    TileVertexCache::Key key;
+    Vector2f southwest;
+    float extent;
+};
+
+
+// Same calculation as in WorldGeometry
+static View
+makeView(unsigned int key,
+         const Vector3f& position,
+         const Quaternionf& orientation,
+         const PlanarProjection& projection,
+         unsigned int viewportHeight)
+{
+    Transform3f modelview(orientation.conjugate());
+    modelview.translate(-position);
+
+    View view;
+    view.key = key;
+    view.eyePosition = position;
+    view.pixelSize = float(2.0 * tan(projection.fovY() / 2.0) / viewportHeight);
+
+    float approxAltitude = position.norm() - PolarRadius;
+    float horizonDistance = 0.0f;
+    if (approxAltitude > 0.0f)
+    {
+        horizonDistance = sqrt((2 * EquatorialRadius + approxAltitude) * approxAltitude);
+    }
+
+    Frustum frustum = projection.frustum();
+    float farDistance = max(frustum.nearZ, min(horizonDistance, frustum.farZ));
+
+    Matrix4f modelviewTranspose = modelview.matrix().transpose();
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        view.cullingPlanes.planes[i] = Hyperplane<float, 3>(frustum.planeNormals[i].cast<float>(), 0.0f);
+        view.cullingPlanes.planes[i].coeffs() = modelviewTranspose * view.cullingPlanes.planes[i].coeffs();
+    }
+    view.cullingPlanes.planes[4].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f, -1.0f, -frustum.nearZ);
+    view.cullingPlanes.planes[5].coeffs() = modelviewTranspose * Vector4f(0.0f, 0.0f,  1.0f, farDistance);
+
+    return view;
+}
+
+
+static Quaternionf
+lookAt(const Vector3f& direction, const Vector3f& up)
+{
+    Vector3f back = -direction.normalized();
+    Vector3f right = up.cross(back).normalized();
+    Vector3f trueUp = back.cross(right);
+
+    Matrix3f m;
+    m.col(0) = right;
+    m.col(1) = trueUp;
+    m.col(2) = back;
+    return Quaternionf(m);
+}
+
+
+// Build the views for one frame along the same path as quadbench: the camera
+// approaches from 60000 km to 20 km above the surface while circling the planet.
+static vector<View>
+frameViews(unsigned int frame, unsigned int frameCount, unsigned int eyeHeight, unsigned int faceSize)
+{
+    float s = float(frame) / float(max(1u, frameCount - 1));
+    float altitude = 60000.0f * pow(20.0f / 60000.0f, s);
+    float longitude = float(toRadians(90.0)) * s;
+
+    Vector3f radial(cos(longitude), sin(longitude), 0.0f);
+    Vector3f tangent(-sin(longitude), cos(longitude), 0.0f);
+    Vector3f up = Vector3f::UnitZ();
+    Vector3f position = radial * (EquatorialRadius + altitude);
+
+    float down = max(0.2f, min(1.0f, altitude / 5000.0f));
+    Vector3f direction = -radial * down + tangent * (1.0f - down);
+    Quaternionf orientation = lookAt(direction, up);
+
+    vector<View> views;
+
+    PlanarProjection eyeProjection = PlanarProjection::CreatePerspective(float(toRadians(50.0)), 16.0f / 9.0f, 0.001f, 1.0e9f);
+    Vector3f eyeOffset = (orientation * Vector3f::UnitX()) * (altitude * 0.002f);
+    views.push_back(makeView(1, position - eyeOffset, orientation, eyeProjection, eyeHeight));
+    views.push_back(makeView(2, position + eyeOffset, orientation, eyeProjection, eyeHeight));
+
+    PlanarProjection faceProjection = PlanarProjection::CreatePerspective(float(toRadians(90.0)), 1.0f, 0.001f, 1.0e9f);
+    const Vector3f faceDirections[CubeFaceCount] =
+    {
+        Vector3f::UnitX(), -Vector3f::UnitX(), Vector3f::UnitY(), -Vector3f::UnitY(), Vector3f::UnitZ(), -Vector3f::UnitZ()
+    };
+    const Vector3f faceUps[CubeFaceCount] =
+    {
+        -Vector3f::UnitY(), -Vector3f::UnitY(), Vector3f::UnitZ(), -Vector3f::UnitZ(), -Vector3f::UnitY(), -Vector3f::UnitY()
+    };
+    for (unsigned int face = 0; face < CubeFaceCount; ++face)
+    {
+        views.push_back(makeView(CubeMapViewKeyBase + face, position, lookAt(faceDirections[face], faceUps[face]), faceProjection, faceSize));
+    }
+
+    return views;
+}
+
+
+// Append the visible leaf tiles of a quadtree. With a tiled map, every tile has a
+// whole map tile of its own (all map tiles are assumed to be loaded); otherwise,
+// the texture coordinates map the whole globe to a single texture, as in
+// QuadtreeTile::drawPatch().
+static void
+addDraws(const PersistentQuadtree& tree, bool tiledMap, vector<Draw>& draws)
+{
+    const float n = float(QuadtreeTile::TileSubdivision);
+    for (QuadtreeTileAllocator::TileArray::const_iterator iter = tree.tiles().begin(); iter != tree.tiles().end(); ++iter)
+    {
+        if (iter->hasChildren() || iter->isCulled())
+        {
+            continue;
+        }
+
+        Draw draw;
+        draw.southwest = iter->southwest();
+        draw.extent = iter->extent();
+        draw.key.level = iter->level();
+        draw.key.column = iter->column();
+        draw.key.row = iter->row();
+        if (tiledMap)
+        {
+            draw.key.u0 = 0.0f;
+            draw.key.v0 = 0.0f;
+            draw.key.du = 1.0f / n;
+            draw.key.dv = 1.0f / n;
+        }
+        else
+        {
+            draw.key.u0 = draw.southwest.x() * 0.5f + 0.5f;
+            draw.key.v0 = draw.southwest.y() + 0.5f;
+            draw.key.du = draw.extent / n * 0.5f;
+            draw.key.dv = draw.extent / n;
+        }
+        draws.push_back(draw);
+    }
+}
+
+
+struct Result
+{
+    Result() :
+        perDrawTime(0.0),
+        cachedTime(0.0),
+        draws(0),
+        maxViewTiles(0),
+        maxFrameTiles(0),
+        misses(0),
+        maxFrameMisses(0),
+        oldCapacityMisses(0),
+        unexpectedMisses(0)
+    {
+    }
+
+    double perDrawTime;
+    double cachedTime;
+    unsigned long draws;
+    unsigned long maxViewTiles;
+    unsigned long maxFrameTiles;
+    unsigned long misses;
+    unsigned long maxFrameMisses;
+    unsigned long oldCapacityMisses;
+    unsigned long unexpectedMisses;
+};
+
+
+static Result
+runPath(unsigned int frameCount, unsigned int eyeHeight, unsigned int faceSize)
+{
+    Vector3f surfaceAxes(EquatorialRadius, EquatorialRadius, PolarRadius);
+    Vector3f cloudAxes = surfaceAxes + Vector3f::Constant(CloudAltitude);
+
+    PersistentQuadtreeSet surfaceTrees;
+    PersistentQuadtreeSet cloudTrees;
+    TileVertexCache cache;
+    TileVertexCache oldCapacityCache(OldCacheCapacity);
+
+    float vertexData[TileVertexCache::VertexCount * TileVertexCache::VertexStride];
+    float checksum = 0.0f;
+
+    Result result;
+    set<TileVertexCache::Key> lastFrameKeys;
+
+    for (unsigned int frame = 0; frame < frameCount; ++frame)
+    {
+        vector<View> views = frameViews(frame, frameCount, eyeHeight, faceSize);
+
+        // The quadtrees are updated the same way by both methods, so they are
+        // left out of the timing.
+        vector<Draw> draws;
+        for (unsigned int i = 0; i < views.size(); ++i)
+        {
+            const View& view = views[i];
+            float splitThreshold = view.pixelSize * MaxTileSquareSize * QuadtreeTile::TileSubdivision;
+
+            PersistentQuadtree* surface = surfaceTrees.tree(view.key);
+            surface->update(view.eyePosition, view.cullingPlanes, surfaceAxes, splitThreshold * float(MapTileSize) / 1000.0f, view.pixelSize);
+            unsigned long drawCount = draws.size();
+            addDraws(*surface, true, draws);
+            result.maxViewTiles = max(result.maxViewTiles, (unsigned long) draws.size() - drawCount);
+
+            PersistentQuadtree* clouds = cloudTrees.tree(view.key);
+            clouds->update(view.eyePosition, view.cullingPlanes, cloudAxes, splitThreshold, view.pixelSize);
+            drawCount = draws.size();
+            addDraws(*clouds, false, draws);
+            result.maxViewTiles = max(result.maxViewTiles, (unsigned long) draws.size() - drawCount);
+        }
+
+        // Generate the vertices of every tile when it is drawn
+        double startTime = omp_get_wtime();
+        for (unsigned int i = 0; i < draws.size(); ++i)
+        {
+            const Draw& d = draws[i];
+            TileVertexCache::GenerateVertices(d.southwest, d.extent, d.key.u0, d.key.v0, d.key.du, d.key.dv, vertexData);
+            checksum += vertexData[0];
+        }
+        result.perDrawTime += omp_get_wtime() - startTime;
+
+        // Look up the vertices in the cache
+        unsigned long missesBefore = cache.missCount();
+        startTime = omp_get_wtime();
+        for (unsigned int i = 0; i < draws.size(); ++i)
+        {
+            const Draw& d = draws[i];
+            VertexBuffer* vertices = cache.tileVertices(d.key, d.southwest, d.extent);
+            checksum += static_cast<const float*>(vertices->mapReadOnly())[0];
+        }
+        result.cachedTime += omp_get_wtime() - startTime;
+
+        unsigned long frameMisses = cache.missCount() - missesBefore;
+        result.misses += frameMisses;
+        result.maxFrameMisses = max(result.maxFrameMisses, frameMisses);
+
+        for (unsigned int i = 0; i < draws.size(); ++i)
+        {
+            const Draw& d = draws[i];
+            oldCapacityCache.tileVertices(d.key, d.southwest, d.extent);
+        }
+
+        // Only tiles that weren't drawn in the previous frame should miss; if any
+        // others did, the cache can't hold a whole frame.
+        set<TileVertexCache::Key> frameKeys;
+        for (unsigned int i = 0; i < draws.size(); ++i)
+        {
+            frameKeys.insert(draws[i].key);
+        }
+
+        unsigned long newTiles = 0;
+        for (set<TileVertexCache::Key>::const_iterator iter = frameKeys.begin(); iter != frameKeys.end(); ++iter)
+        {
+            if (lastFrameKeys.find(*iter) == lastFrameKeys.end())
+            {
+                ++newTiles;
+            }
+        }
+        if (frameMisses > newTiles)
+        {
+            result.unexpectedMisses += frameMisses - newTiles;
+        }
+
+        result.draws += draws.size();
+        result.maxFrameTiles = max(result.maxFrameTiles, (unsigned long) frameKeys.size());
+        lastFrameKeys.swap(frameKeys);
+    }
+
+    result.oldCapacityMisses = oldCapacityCache.missCount();
+
+    // Keep the compiler from discarding the generated vertices
+    if (checksum == 12345.0f)
+    {
+        cout << " ";
+    }
+
+    return result;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int frameCount = argc > 1 ? atoi(argv[1]) : 600;
+    if (argc > 2 || frameCount < 2)
+    {
+        cerr << "Usage: tilevertexbench [frame count]" << endl;
+        return 1;
+    }
+
+    unsigned int capacity = TileVertexCache().capacity();
+
+    cout << "Frames: " << frameCount << ", views per frame: " << StereoViewCount + CubeFaceCount
+         << " (" << StereoViewCount << " stereo eyes, " << CubeFaceCount << " cube map faces)"
+         << ", cache capacity: " << capacity << " tiles" << endl;
+    cout << endl;
+    cout << fixed;
+
+    // Stereo eye viewport height and cube map face size
+    const unsigned int resolutions[][2] = { { 1080, 512 }, { 2160, 1024 } };
+    const unsigned int resolutionCount = sizeof(resolutions) / sizeof(resolutions[0]);
+
+    vector<Result> results;
+    for (unsigned int i = 0; i < resolutionCount; ++i)
+    {
+        results.push_back(runPath((unsigned int) frameCount, resolutions[i][0], resolutions[i][1]));
+    }
+
+    double n = double(frameCount);
+
+    cout << "Tiles (a tile drawn with two texture coordinate mappings counts twice):" << endl;
+    cout << "  Eyes  Faces  Draws/frame  Max tiles/view  Max tiles/frame  Total misses  Misses with " << OldCacheCapacity << endl;
+    for (unsigned int i = 0; i < resolutionCount; ++i)
+    {
+        const Result& result = results[i];
+        cout << setw(6) << resolutions[i][0]
+             << setw(7) << resolutions[i][1]
+             << setw(13) << setprecision(1) << result.draws / n
+             << setw(16) << result.maxViewTiles
+             << setw(17) << result.maxFrameTiles
+             << setw(14) << result.misses
+             << setw(17) << result.oldCapacityMisses << endl;
+    }
+    cout << endl;
+
+    cout << "Vertex time per frame:" << endl;
+    cout << "  Eyes  Faces  Per-draw (ms)  Cached (ms)  Misses/frame  Worst misses  Generate (us/tile)" << endl;
+    for (unsigned int i = 0; i < resolutionCount; ++i)
+    {
+        const Result& result = results[i];
+        cout << setw(6) << resolutions[i][0]
+             << setw(7) << resolutions[i][1]
+             << setw(15) << setprecision(3) << result.perDrawTime * 1000.0 / n
+             << setw(13) << result.cachedTime * 1000.0 / n
+             << setw(14) << setprecision(1) << result.misses / n
+             << setw(14) << result.maxFrameMisses
+             << setw(20) << setprecision(2) << result.perDrawTime * 1.0e6 / max(1ul, result.draws) << endl;
+    }
+
+    bool ok = true;
+    for (unsigned int i = 0; i < resolutionCount; ++i)
+    {
+        if (results[i].unexpectedMisses > 0 || results[i].maxFrameTiles > capacity)
+        {
+            cout << endl << resolutions[i][0] << "/" << resolutions[i][1] << ": " << results[i].unexpectedMisses
+                 << " misses of tiles drawn in the previous frame" << endl;
+            ok = false;
+        }
+    }
+
+    cout << endl << (ok ? "ok" : "FAILED") << endl;
+
+    return ok ? 0 : 1;
+}
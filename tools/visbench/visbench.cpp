@@ -0,0 +1,294 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** visbench - Measure the cost of visibility determination
+ *
+ * Usage: visbench [entity count] [frame count]
+ *
+ * A synthetic universe of bodies in Keplerian orbits is built, and the visible
+ * item lists for a moving camera are computed with 1, 2, 4, ... threads. Then
+ * the number of entity evaluations for a cube map render is counted, with and
+ * without sharing the evaluation across faces. No OpenGL context is required.
+ */
+
+#include <vesta/Body.h>
+#include <vesta/Arc.h>
+#include <vesta/Chronology.h>
+#include <vesta/Geometry.h>
+#include <vesta/Visualizer.h>
+#include <vesta/KeplerianTrajectory.h>
+#include <vesta/UniformRotationModel.h>
+#include <vesta/InertialFrame.h>
+#include <vesta/PlanarProjection.h>
+#include <vesta/Units.h>
+#include <vesta/internal/VisibilitySet.h>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+
+using namespace vesta;
+using namespace Eigen;
+using namespace std;
+
+
+static const double AU = 1.495978707e8;           // kilometers
+static const double SolarGM = 1.32712440018e11;   // km^3/s^2
+
+
+// Number of trajectory evaluations since the counter was last reset
+static long TrajectoryEvaluationCount = 0;
+
+
+// Keplerian trajectory that counts how many times it is evaluated
+class CountingTrajectory : public KeplerianTrajectory
+{
+public:
+    CountingTrajectory(const OrbitalElements& elements) :
+        KeplerianTrajectory(elements)
+    {
+    }
+
+    virtual StateVector state(double t) const
+    {
+#pragma omp atomic
+        TrajectoryEvaluationCount++;
+        return KeplerianTrajectory::state(t);
+    }
+};
+
+
+// Geometry that is never drawn; it only has to report its size and shape to the
+// visibility tests.
+class SphereGeometry : public Geometry
+{
+public:
+    SphereGeometry(float radius, bool ellipsoidal, NearClippingPolicy clippingPolicy = PreserveDepthPrecision) :
+        m_radius(radius),
+        m_ellipsoidal(ellipsoidal)
+    {
+        setShadowCaster(ellipsoidal);
+        setClippingPolicy(clippingPolicy);
+    }
+
+    virtual void render(RenderContext& /* rc */, double /* clock */) const
+    {
+    }
+
+    virtual float boundingSphereRadius() const
+    {
+        return m_radius;
+    }
+
+    virtual bool isEllipsoidal() const
+    {
+        return m_ellipsoidal;
+    }
+
+    virtual AlignedEllipsoid ellipsoid() const
+    {
+        return AlignedEllipsoid(Vector3d::Constant(m_radius));
+    }
+
+private:
+    float m_radius;
+    bool m_ellipsoidal;
+};
+
+
+static double
+uniformRandom()
+{
+    return double(rand()) / double(RAND_MAX);
+}
+
+
+static Body*
+createBody(Geometry* geometry)
+{
+    OrbitalElements elements;
+    double semiMajorAxis = AU * (0.3 + 49.7 * uniformRandom() * uniformRandom());
+    elements.eccentricity = 0.3 * uniformRandom();
+    elements.periapsisDistance = semiMajorAxis * (1.0 - elements.eccentricity);
+    elements.inclination = toRadians(20.0 * (uniformRandom() - 0.5));
+    elements.longitudeOfAscendingNode = 2.0 * PI * uniformRandom();
+    elements.argumentOfPeriapsis = 2.0 * PI * uniformRandom();
+    elements.meanAnomalyAtEpoch = 2.0 * PI * uniformRandom();
+    elements.meanMotion = sqrt(SolarGM / (semiMajorAxis * semiMajorAxis * semiMajorAxis));
+
+    Arc* arc = new Arc();
+    arc->setTrajectoryFrame(InertialFrame::eclipticJ2000());
+    arc->setBodyFrame(InertialFrame::eclipticJ2000());
+    arc->setTrajectory(new CountingTrajectory(elements));
+    arc->setRotationModel(new UniformRotationModel(Vector3d::UnitZ(), 2.0 * PI / (daysToSeconds(0.2 + uniformRandom())), 0.0));
+    arc->setDuration(daysToSeconds(365.25 * 100.0));
+
+    Body* body = new Body();
+    body->chronology()->setBeginning(0.0);
+    body->chronology()->addArc(arc);
+    body->setGeometry(geometry);
+
+    return body;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int entityCount = argc > 1 ? atoi(argv[1]) : 50000;
+    int frameCount = argc > 2 ? atoi(argv[2]) : 50;
+    if (argc > 3 || entityCount < 1 || frameCount < 1)
+    {
+        cerr << "Usage: visbench [entity count] [frame count]" << endl;
+        return 1;
+    }
+
+    srand(1);
+
+    // Mostly small bodies, with an ellipsoidal shadow caster and a visualizer
+    // attached to a few percent of them.
+    vector<Entity*> entities;
+    for (int i = 0; i < entityCount; ++i)
+    {
+        bool major = i % 50 == 0;
+        float radius = float(major ? 1000.0 + 5.0e4 * uniformRandom() : 1.0 + 500.0 * uniformRandom());
+        Body* body = createBody(new SphereGeometry(radius, major));
+        if (major)
+        {
+            Visualizer* marker = new Visualizer(new SphereGeometry(radius * 3.0f, false, Geometry::PreventClipping));
+            marker->setDepthAdjustment(Visualizer::AdjustToFront);
+            body->setVisualizer("marker", marker);
+        }
+
+        body->addRef();
+        entities.push_back(body);
+    }
+
+    PlanarProjection projection = PlanarProjection::CreatePerspective(float(toRadians(50.0)), 16.0f / 9.0f, 1.0f, 1.0e12f);
+
+    VisibilitySet::ViewParameters view;
+    view.frustum = projection.frustum();
+    view.pixelSize = float(2.0 * tan(toRadians(50.0) / 2.0) / 1080.0);
+    view.nearAdjust = float(cos(toRadians(50.0) / 2.0) / sqrt(1.0 + (16.0 / 9.0) * (16.0 / 9.0)));
+    view.visualizersEnabled = true;
+
+    counted_ptr<VisibilitySet> visibilitySet(new VisibilitySet());
+
+    // Thread counts to test: powers of two, and the number of processors
+    vector<int> threadCounts;
+    int maxThreads = omp_get_max_threads();
+    for (int threadCount = 1; threadCount < maxThreads; threadCount *= 2)
+    {
+        threadCounts.push_back(threadCount);
+    }
+    threadCounts.push_back(maxThreads);
+
+    double serialTime = 0.0;
+
+    cout << "entities: " << entityCount << ", frames: " << frameCount << endl;
+    cout << "threads    ms/frame   speedup   visible items" << endl;
+
+    for (unsigned int i = 0; i < threadCounts.size(); ++i)
+    {
+        int threadCount = threadCounts[i];
+        omp_set_num_threads(threadCount);
+
+        unsigned long itemCount = 0;
+        double startTime = omp_get_wtime();
+        for (int frame = 0; frame < frameCount; ++frame)
+        {
+            // Orbit the camera around the inner solar system, looking at the sun
+            double t = daysToSeconds(double(frame));
+            double angle = 2.0 * PI * frame / frameCount;
+            Vector3d cameraPosition = 3.0 * AU * Vector3d(cos(angle), sin(angle), 0.2);
+            Quaterniond cameraOrientation = Quaterniond().setFromTwoVectors(-Vector3d::UnitZ(), -cameraPosition.normalized());
+
+            view.cameraPosition = cameraPosition;
+            view.toCameraSpace = cameraOrientation.conjugate().cast<float>().toRotationMatrix();
+
+            visibilitySet->evaluate(entities, t, true);
+            visibilitySet->build(view);
+            itemCount += visibilitySet->visibleItems().size() + visibilitySet->splittableItems().size();
+        }
+        double elapsed = (omp_get_wtime() - startTime) / frameCount;
+
+        if (i == 0)
+        {
+            serialTime = elapsed;
+        }
+
+        cout << setw(7) << threadCount
+             << setw(12) << fixed << setprecision(3) << elapsed * 1000.0
+             << setw(10) << setprecision(2) << serialTime / elapsed
+             << setw(16) << itemCount / frameCount << endl;
+    }
+
+    // Render the six faces of a cube map (as for a reflection map), first evaluating
+    // the entities separately for every face as the renderer used to, then sharing
+    // one evaluation across all faces as it does now.
+    static const Vector3d cubeFaceDirections[6] =
+    {
+        Vector3d::UnitX(), -Vector3d::UnitX(), Vector3d::UnitY(), -Vector3d::UnitY(), Vector3d::UnitZ(), -Vector3d::UnitZ()
+    };
+
+    PlanarProjection cubeFaceProjection = PlanarProjection::CreatePerspective(float(toRadians(90.0)), 1.0f, 1.0f, 1.0e12f);
+    view.frustum = cubeFaceProjection.frustum();
+    view.pixelSize = float(2.0 / 512.0);
+    view.nearAdjust = float(cos(toRadians(45.0)) / sqrt(2.0));
+    view.cameraPosition = Vector3d(AU, 0.0, 0.0);
+    omp_set_num_threads(maxThreads);
+
+    long evaluationCounts[2];
+    unsigned long cubeItemCounts[2];
+    for (int shared = 0; shared < 2; ++shared)
+    {
+        TrajectoryEvaluationCount = 0;
+        cubeItemCounts[shared] = 0;
+
+        if (shared)
+        {
+            visibilitySet->evaluate(entities, 0.0, true);
+        }
+
+        for (int face = 0; face < 6; ++face)
+        {
+            if (!shared)
+            {
+                visibilitySet->evaluate(entities, 0.0, true);
+            }
+
+            Quaterniond faceOrientation = Quaterniond().setFromTwoVectors(-Vector3d::UnitZ(), cubeFaceDirections[face]);
+            view.toCameraSpace = faceOrientation.conjugate().cast<float>().toRotationMatrix();
+            visibilitySet->build(view);
+            cubeItemCounts[shared] += visibilitySet->visibleItems().size() + visibilitySet->splittableItems().size();
+        }
+
+        evaluationCounts[shared] = TrajectoryEvaluationCount;
+    }
+
+    cout << endl;
+    cout << "cube map entity evaluations    per face: " << setw(8) << evaluationCounts[0]
+         << "   visible items: " << cubeItemCounts[0] << endl;
+    cout << "cube map entity evaluations      shared: " << setw(8) << evaluationCounts[1]
+         << "   visible items: " << cubeItemCounts[1] << endl;
+
+    for (vector<Entity*>::iterator iter = entities.begin(); iter != entities.end(); ++iter)
+    {
+        (*iter)->release();
+    }
+
+    return 0;
+}
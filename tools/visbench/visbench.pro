@@ -0,0 +1,40 @@
+# Qt project file for the visbench tool
+
+TEMPLATE = app
+TARGET = visbench
+CONFIG += console
+CONFIG -= app_bundle qt
+
+VESTA_PATH = ../../thirdparty/vesta
+
+SOURCES = \
+    visbench.cpp \
+    $$VESTA_PATH/Arc.cpp \
+    $$VESTA_PATH/Body.cpp \
+    $$VESTA_PATH/Chronology.cpp \
+    $$VESTA_PATH/Debug.cpp \
+    $$VESTA_PATH/Entity.cpp \
+    $$VESTA_PATH/FixedPointTrajectory.cpp \
+    $$VESTA_PATH/FixedRotationModel.cpp \
+    $$VESTA_PATH/Frame.cpp \
+    $$VESTA_PATH/Geometry.cpp \
+    $$VESTA_PATH/InertialFrame.cpp \
+    $$VESTA_PATH/KeplerianTrajectory.cpp \
+    $$VESTA_PATH/OrbitalElements.cpp \
+    $$VESTA_PATH/PlanarProjection.cpp \
+    $$VESTA_PATH/UniformRotationModel.cpp \
+    $$VESTA_PATH/Visualizer.cpp \
+    $$VESTA_PATH/internal/VisibilitySet.cpp
+
+INCLUDEPATH += ../../thirdparty $$VESTA_PATH
+DEFINES += EIGEN_USE_NEW_STDVECTOR
+
+# OpenMP is required; the point of the benchmark is to compare thread counts.
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+!win32-msvc* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
@@ -0,0 +1,410 @@
+// This file is part of Cosmographia.
+//
+// Copyright (C) 2012 Chris Laurel <claurel@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** wmstest - Test WMSRequester against a local stand-in for a WMS server
+ *
+ * Usage: wmstest
+ *
+ * A small HTTP server on the loopback interface answers WMS requests with
+ * fixed images. Tiles are requested through WMSRequester, and the test checks
+ * that duplicate and sibling requests are coalesced into a single server
+ * request, that decoded WMS tiles are reused, that finished tiles are served
+ * from the local tile store, and that failed requests are retried. No network
+ * connection is needed.
+ */
+
+#include "WMSRequester.h"
+#include <QGuiApplication>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QBuffer>
+#include <QColor>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include <QStringList>
+#include <iostream>
+
+using namespace std;
+
+
+// Colors of the four quadrants of every image served
+static const QRgb NorthwestColor = qRgb(255, 0, 0);
+static const QRgb NortheastColor = qRgb(0, 255, 0);
+static const QRgb SouthwestColor = qRgb(0, 0, 255);
+static const QRgb SoutheastColor = qRgb(255, 255, 0);
+
+// Time to wait for tiles before giving up
+static const int Timeout = 10000;   // milliseconds
+
+
+// Minimal HTTP server that stands in for a WMS server. Every GET request is
+// answered with a PNG image of the requested size divided into four colored
+// quadrants, except for requests for the layer named "missing", which get a
+// 404 response. The server counts requests for each URL.
+class TileServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    TileServer(QObject* parent = NULL) :
+        QTcpServer(parent)
+    {
+        connect(this, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+    }
+
+    int requestCount() const
+    {
+        int total = 0;
+        foreach (int count, m_requestCounts)
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    void resetCounts()
+    {
+        m_requestCounts.clear();
+    }
+
+private slots:
+    void acceptConnection()
+    {
+        while (hasPendingConnections())
+        {
+            QTcpSocket* socket = nextPendingConnection();
+            connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+            connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        }
+    }
+
+    void readRequest()
+    {
+        QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+        if (!socket)
+        {
+            return;
+        }
+
+        QByteArray& request = m_partialRequests[socket];
+        request += socket->readAll();
+        if (!request.contains("\r\n\r\n"))
+        {
+            return;
+        }
+
+        QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+        m_partialRequests.remove(socket);
+        if (requestLine.size() < 2 || requestLine[0] != "GET")
+        {
+            reply(socket, "400 Bad Request", "text/plain", QByteArray());
+            return;
+        }
+
+        QString path = QString::fromLatin1(requestLine[1]);
+        m_requestCounts[path]++;
+
+        QUrlQuery query(QUrl(path).query());
+        if (query.queryItemValue("layers") == "missing")
+        {
+            reply(socket, "404 Not Found", "text/plain", QByteArray());
+            return;
+        }
+
+        int width = qMax(1, query.queryItemValue("width").toInt());
+        int height = qMax(1, query.queryItemValue("height").toInt());
+        QImage image(width, height, QImage::Format_RGB32);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                bool north = y < height / 2;
+                bool west = x < width / 2;
+                image.setPixel(x, y, north ? (west ? NorthwestColor : NortheastColor) : (west ? SouthwestColor : SoutheastColor));
+            }
+        }
+
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+
+        reply(socket, "200 OK", "image/png", png);
+    }
+
+private:
+    void reply(QTcpSocket* socket, const char* status, const char* contentType, const QByteArray& body)
+    {
+        QByteArray header;
+        header += QByteArray("HTTP/1.1 ") + status + "\r\n";
+        header += QByteArray("Content-Type: ") + contentType + "\r\n";
+        header += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+        header += "Cache-Control: no-store\r\n";
+        header += "Connection: close\r\n\r\n";
+        socket->write(header + body);
+        socket->disconnectFromHost();
+    }
+
+private:
+    QHash<QString, int> m_requestCounts;
+    QHash<QTcpSocket*, QByteArray> m_partialRequests;
+};
+
+
+// Collects the tiles delivered by a WMSRequester
+class TileCollector : public QObject
+{
+    Q_OBJECT
+
+public:
+    TileCollector(WMSRequester* requester)
+    {
+        connect(requester, SIGNAL(imageCompleted(const QString&, const QImage&)),
+                this, SLOT(addTile(const QString&, const QImage&)));
+    }
+
+    int completedCount(const QString& tileName) const
+    {
+        return m_completedCounts.value(tileName);
+    }
+
+    int totalCompletedCount() const
+    {
+        int total = 0;
+        foreach (int count, m_completedCounts)
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    QImage image(const QString& tileName) const
+    {
+        return m_images.value(tileName);
+    }
+
+    void clear()
+    {
+        m_completedCounts.clear();
+        m_images.clear();
+    }
+
+public slots:
+    void addTile(const QString& tileName, const QImage& image)
+    {
+        m_completedCounts[tileName]++;
+        m_images[tileName] = image;
+    }
+
+private:
+    QHash<QString, int> m_completedCounts;
+    QHash<QString, QImage> m_images;
+};
+
+
+static int FailureCount = 0;
+
+static void
+check(bool condition, const char* description)
+{
+    cout << (condition ? "  ok    " : "  FAIL  ") << description << endl;
+    if (!condition)
+    {
+        ++FailureCount;
+    }
+}
+
+
+// Process events until the collector has received the expected number of tiles
+// and the requester has no outstanding requests, or until the timeout expires.
+static bool
+waitForTiles(const TileCollector& collector, const WMSRequester& requester, int expectedCount)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < Timeout)
+    {
+        if (collector.totalCompletedCount() >= expectedCount && requester.pendingTileCount() == 0)
+        {
+            return true;
+        }
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 50);
+    }
+
+    return false;
+}
+
+
+// Tile names are converted to boxes the same way that NetworkTextureLoader does it
+static QString
+tileName(const QString& surface, unsigned int level, unsigned int x, unsigned int y)
+{
+    return QString("%1,%2,%3,%4").arg(surface).arg(level).arg(x).arg(y);
+}
+
+
+static void
+retrieve(WMSRequester* requester, const QString& surface, unsigned int level, unsigned int x, unsigned int y, unsigned int tileSize)
+{
+    double tileExtent = 180.0 / double(1 << level);
+    WMSRequester::LatLongBoundingBox tileBox;
+    tileBox.west = -180 + x * tileExtent;
+    tileBox.south = -90 + y * tileExtent;
+    tileBox.east = tileBox.west + tileExtent;
+    tileBox.north = tileBox.south + tileExtent;
+
+    requester->retrieveTile(tileName(surface, level, x, y), surface, tileBox.toRect(), tileSize, NULL);
+}
+
+
+// Get the color expected at the center of a level 1 tile. Every level 1 tile in the
+// western hemisphere is cut from the single level 0 WMS tile covering it, so its
+// color is that of the corresponding quadrant.
+static QRgb
+expectedColor(unsigned int x, unsigned int y)
+{
+    return y == 1 ? (x == 0 ? NorthwestColor : NortheastColor) : (x == 0 ? SouthwestColor : SoutheastColor);
+}
+
+
+static bool
+centerColorMatches(const QImage& image, QRgb color)
+{
+    if (image.isNull())
+    {
+        return false;
+    }
+
+    QRgb pixel = image.pixel(image.width() / 2, image.height() / 2);
+    return qAbs(qRed(pixel) - qRed(color)) < 8 &&
+           qAbs(qGreen(pixel) - qGreen(color)) < 8 &&
+           qAbs(qBlue(pixel) - qBlue(color)) < 8;
+}
+
+
+int main(int argc, char* argv[])
+{
+    // The test needs no display
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    app.setApplicationName("wmstest");
+
+    // Keep the tile store and network cache away from the user's real cache
+    QStandardPaths::setTestModeEnabled(true);
+    QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).removeRecursively();
+
+    TileServer server;
+    if (!server.listen(QHostAddress::LocalHost))
+    {
+        cerr << "Unable to start the local tile server" << endl;
+        return 1;
+    }
+    QString baseUrl = QString("http://127.0.0.1:%1/wms?request=GetMap&format=image/png").arg(server.serverPort());
+
+    // One level 0 WMS tile covers the western hemisphere, another the eastern. With
+    // 128 pixel texture tiles, the four level 1 tiles in the western hemisphere are
+    // all cut from the same WMS tile.
+    WMSRequester::LatLongBoundingBox topLeft(-180.0, -90.0, 0.0, 90.0);
+    const unsigned int tileSize = 128;
+
+    {
+        WMSRequester requester(NULL);
+        requester.addSurfaceDefinition("test", baseUrl + "&layers=test", topLeft, 256, 256);
+        requester.addSurfaceDefinition("missing", baseUrl + "&layers=missing", topLeft, 256, 256);
+        TileCollector collector(&requester);
+
+        cout << "Sibling and duplicate requests" << endl;
+        retrieve(&requester, "test", 1, 0, 0, tileSize);
+        retrieve(&requester, "test", 1, 1, 0, tileSize);
+        retrieve(&requester, "test", 1, 0, 1, tileSize);
+        retrieve(&requester, "test", 1, 1, 1, tileSize);
+        retrieve(&requester, "test", 1, 0, 0, tileSize);
+        bool finished = waitForTiles(collector, requester, 4);
+        check(finished, "all tiles delivered");
+        check(server.requestCount() == 1, "one server request for the shared WMS tile");
+        bool eachOnce = true;
+        bool colorsMatch = true;
+        for (unsigned int y = 0; y < 2; ++y)
+        {
+            for (unsigned int x = 0; x < 2; ++x)
+            {
+                QString name = tileName("test", 1, x, y);
+                eachOnce = eachOnce && collector.completedCount(name) == 1;
+                // Assembled tiles are delivered with red and blue swapped, ready to be
+                // used as BGR textures.
+                colorsMatch = colorsMatch && centerColorMatches(collector.image(name).rgbSwapped(), expectedColor(x, y));
+            }
+        }
+        check(eachOnce, "each tile delivered exactly once");
+        check(colorsMatch, "each tile cut from the right part of the WMS tile");
+
+        cout << "Reuse of decoded WMS tiles" << endl;
+        server.resetCounts();
+        collector.clear();
+        retrieve(&requester, "test", 2, 1, 2, tileSize / 2);
+        finished = waitForTiles(collector, requester, 1);
+        check(finished && collector.completedCount(tileName("test", 2, 1, 2)) == 1, "tile delivered");
+        check(server.requestCount() == 0, "no server request for a recently decoded WMS tile");
+
+        cout << "Failed requests" << endl;
+        server.resetCounts();
+        collector.clear();
+        retrieve(&requester, "missing", 1, 0, 0, tileSize);
+        retrieve(&requester, "missing", 1, 1, 0, tileSize);
+        finished = waitForTiles(collector, requester, 0);
+        check(finished, "no requests left pending");
+        check(collector.totalCompletedCount() == 0, "no tiles delivered");
+        check(server.requestCount() == 1, "one server request for the shared WMS tile");
+        retrieve(&requester, "missing", 1, 0, 0, tileSize);
+        waitForTiles(collector, requester, 0);
+        check(server.requestCount() == 2, "failed tile requested again when retried");
+    }
+
+    {
+        cout << "Local tile store" << endl;
+        server.resetCounts();
+        WMSRequester requester(NULL);
+        requester.addSurfaceDefinition("test", baseUrl + "&layers=test", topLeft, 256, 256);
+        TileCollector collector(&requester);
+
+        retrieve(&requester, "test", 1, 1, 1, tileSize);
+        check(collector.completedCount(tileName("test", 1, 1, 1)) == 1, "stored tile delivered immediately");
+        check(server.requestCount() == 0, "no server request for a stored tile");
+        // Tiles read from the store are 32-bit images, which are already in BGRA order
+        check(centerColorMatches(collector.image(tileName("test", 1, 1, 1)), expectedColor(1, 1)), "stored tile matches the assembled tile");
+    }
+
+    QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).removeRecursively();
+
+    if (FailureCount > 0)
+    {
+        cout << FailureCount << " checks failed" << endl;
+        return 1;
+    }
+    else
+    {
+        cout << "All checks passed" << endl;
+        return 0;
+    }
+}
+
+#include "wmstest.moc"
@@ -0,0 +1,18 @@
+# Qt project file for the wmstest tool
+
+TEMPLATE = app
+TARGET = wmstest
+CONFIG += console
+CONFIG -= app_bundle
+QT += network
+
+MAIN_PATH = ../../src/main
+
+SOURCES = \
+    wmstest.cpp \
+    $$MAIN_PATH/WMSRequester.cpp
+
+HEADERS = \
+    $$MAIN_PATH/WMSRequester.h
+
+INCLUDEPATH += ../../thirdparty $$MAIN_PATH